@@ -37,7 +37,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define DATA_SYNCS2(PREFIX, MSG0, MSG1) \
 		DATA_SYNC2(PREFIX, Approximate, MSG0, MSG1) \
 		DATA_SYNC2(PREFIX, Exact, MSG0, MSG1) \
-		void PREFIX##Callback(const MSG0##ConstPtr&, const MSG1##ConstPtr&);
+		void PREFIX##Callback(const MSG0##ConstPtr&, const MSG1##ConstPtr&); \
+		void PREFIX##SyncStats(const MSG0##ConstPtr& m0, const MSG1##ConstPtr& m1) { \
+			double stamps[] = {m0->header.stamp.toSec(), m1->header.stamp.toSec()}; \
+			syncStatsUpdate(stamps, 2); \
+		}
 
 #define DATA_SYNC3(PREFIX, SYNC_NAME, MSG0, MSG1, MSG2) \
 		typedef message_filters::sync_policies::SYNC_NAME##Time<MSG0, MSG1, MSG2> PREFIX##SYNC_NAME##SyncPolicy; \
@@ -47,6 +51,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 		DATA_SYNC3(PREFIX, Approximate, MSG0, MSG1, MSG2) \
 		DATA_SYNC3(PREFIX, Exact, MSG0, MSG1, MSG2) \
 		void PREFIX##Callback(const MSG0##ConstPtr&, const MSG1##ConstPtr&, const MSG2##ConstPtr&); \
+		void PREFIX##SyncStats(const MSG0##ConstPtr& m0, const MSG1##ConstPtr& m1, const MSG2##ConstPtr& m2) { \
+			double stamps[] = {m0->header.stamp.toSec(), m1->header.stamp.toSec(), m2->header.stamp.toSec()}; \
+			syncStatsUpdate(stamps, 3); \
+		} \
 
 #define DATA_SYNC4(PREFIX, SYNC_NAME, MSG0, MSG1, MSG2, MSG3) \
 		typedef message_filters::sync_policies::SYNC_NAME##Time<MSG0, MSG1, MSG2, MSG3> PREFIX##SYNC_NAME##SyncPolicy; \
@@ -56,6 +64,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 		DATA_SYNC4(PREFIX, Approximate, MSG0, MSG1, MSG2, MSG3) \
 		DATA_SYNC4(PREFIX, Exact, MSG0, MSG1, MSG2, MSG3) \
 		void PREFIX##Callback(const MSG0##ConstPtr&, const MSG1##ConstPtr&, const MSG2##ConstPtr&, const MSG3##ConstPtr&); \
+		void PREFIX##SyncStats(const MSG0##ConstPtr& m0, const MSG1##ConstPtr& m1, const MSG2##ConstPtr& m2, const MSG3##ConstPtr& m3) { \
+			double stamps[] = {m0->header.stamp.toSec(), m1->header.stamp.toSec(), m2->header.stamp.toSec(), m3->header.stamp.toSec()}; \
+			syncStatsUpdate(stamps, 4); \
+		} \
 
 #define DATA_SYNC5(PREFIX, SYNC_NAME, MSG0, MSG1, MSG2, MSG3, MSG4) \
 		typedef message_filters::sync_policies::SYNC_NAME##Time<MSG0, MSG1, MSG2, MSG3, MSG4> PREFIX##SYNC_NAME##SyncPolicy; \
@@ -65,6 +77,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 		DATA_SYNC5(PREFIX, Approximate, MSG0, MSG1, MSG2, MSG3, MSG4) \
 		DATA_SYNC5(PREFIX, Exact, MSG0, MSG1, MSG2, MSG3, MSG4) \
 		void PREFIX##Callback(const MSG0##ConstPtr&, const MSG1##ConstPtr&, const MSG2##ConstPtr&, const MSG3##ConstPtr&, const MSG4##ConstPtr&); \
+		void PREFIX##SyncStats(const MSG0##ConstPtr& m0, const MSG1##ConstPtr& m1, const MSG2##ConstPtr& m2, const MSG3##ConstPtr& m3, const MSG4##ConstPtr& m4) { \
+			double stamps[] = {m0->header.stamp.toSec(), m1->header.stamp.toSec(), m2->header.stamp.toSec(), m3->header.stamp.toSec(), m4->header.stamp.toSec()}; \
+			syncStatsUpdate(stamps, 5); \
+		} \
 
 #define DATA_SYNC6(PREFIX, SYNC_NAME, MSG0, MSG1, MSG2, MSG3, MSG4, MSG5) \
 		typedef message_filters::sync_policies::SYNC_NAME##Time<MSG0, MSG1, MSG2, MSG3, MSG4, MSG5> PREFIX##SYNC_NAME##SyncPolicy; \
@@ -74,6 +90,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 		DATA_SYNC6(PREFIX, Approximate, MSG0, MSG1, MSG2, MSG3, MSG4, MSG5) \
 		DATA_SYNC6(PREFIX, Exact, MSG0, MSG1, MSG2, MSG3, MSG4, MSG5) \
 		void PREFIX##Callback(const MSG0##ConstPtr&, const MSG1##ConstPtr&, const MSG2##ConstPtr&, const MSG3##ConstPtr&, const MSG4##ConstPtr&, const MSG5##ConstPtr&); \
+		void PREFIX##SyncStats(const MSG0##ConstPtr& m0, const MSG1##ConstPtr& m1, const MSG2##ConstPtr& m2, const MSG3##ConstPtr& m3, const MSG4##ConstPtr& m4, const MSG5##ConstPtr& m5) { \
+			double stamps[] = {m0->header.stamp.toSec(), m1->header.stamp.toSec(), m2->header.stamp.toSec(), m3->header.stamp.toSec(), m4->header.stamp.toSec(), m5->header.stamp.toSec()}; \
+			syncStatsUpdate(stamps, 6); \
+		} \
 
 #define DATA_SYNC7(PREFIX, SYNC_NAME, MSG0, MSG1, MSG2, MSG3, MSG4, MSG5, MSG6) \
 		typedef message_filters::sync_policies::SYNC_NAME##Time<MSG0, MSG1, MSG2, MSG3, MSG4, MSG5, MSG6> PREFIX##SYNC_NAME##SyncPolicy; \
@@ -83,6 +103,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 		DATA_SYNC7(PREFIX, Approximate, MSG0, MSG1, MSG2, MSG3, MSG4, MSG5, MSG6) \
 		DATA_SYNC7(PREFIX, Exact, MSG0, MSG1, MSG2, MSG3, MSG4, MSG5, MSG6) \
 		void PREFIX##Callback(const MSG0##ConstPtr&, const MSG1##ConstPtr&, const MSG2##ConstPtr&, const MSG3##ConstPtr&, const MSG4##ConstPtr&, const MSG5##ConstPtr&, const MSG6##ConstPtr&); \
+		void PREFIX##SyncStats(const MSG0##ConstPtr& m0, const MSG1##ConstPtr& m1, const MSG2##ConstPtr& m2, const MSG3##ConstPtr& m3, const MSG4##ConstPtr& m4, const MSG5##ConstPtr& m5, const MSG6##ConstPtr& m6) { \
+			double stamps[] = {m0->header.stamp.toSec(), m1->header.stamp.toSec(), m2->header.stamp.toSec(), m3->header.stamp.toSec(), m4->header.stamp.toSec(), m5->header.stamp.toSec(), m6->header.stamp.toSec()}; \
+			syncStatsUpdate(stamps, 7); \
+		} \
 
 #define DATA_SYNC8(PREFIX, SYNC_NAME, MSG0, MSG1, MSG2, MSG3, MSG4, MSG5, MSG6, MSG7) \
 		typedef message_filters::sync_policies::SYNC_NAME##Time<MSG0, MSG1, MSG2, MSG3, MSG4, MSG5, MSG6, MSG7> PREFIX##SYNC_NAME##SyncPolicy; \
@@ -92,6 +116,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 		DATA_SYNC8(PREFIX, Approximate, MSG0, MSG1, MSG2, MSG3, MSG4, MSG5, MSG6, MSG7) \
 		DATA_SYNC8(PREFIX, Exact, MSG0, MSG1, MSG2, MSG3, MSG4, MSG5, MSG6, MSG7) \
 		void PREFIX##Callback(const MSG0##ConstPtr&, const MSG1##ConstPtr&, const MSG2##ConstPtr&, const MSG3##ConstPtr&, const MSG4##ConstPtr&, const MSG5##ConstPtr&, const MSG6##ConstPtr&, const MSG7##ConstPtr&); \
+		void PREFIX##SyncStats(const MSG0##ConstPtr& m0, const MSG1##ConstPtr& m1, const MSG2##ConstPtr& m2, const MSG3##ConstPtr& m3, const MSG4##ConstPtr& m4, const MSG5##ConstPtr& m5, const MSG6##ConstPtr& m6, const MSG7##ConstPtr& m7) { \
+			double stamps[] = {m0->header.stamp.toSec(), m1->header.stamp.toSec(), m2->header.stamp.toSec(), m3->header.stamp.toSec(), m4->header.stamp.toSec(), m5->header.stamp.toSec(), m6->header.stamp.toSec(), m7->header.stamp.toSec()}; \
+			syncStatsUpdate(stamps, 8); \
+		} \
 
 
 // Constructor
@@ -104,18 +132,27 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 	if(PREFIX##ApproximateSync_) delete PREFIX##ApproximateSync_; \
 	if(PREFIX##ExactSync_) delete PREFIX##ExactSync_;
 
+// Count received messages of each synchronized topic (see syncStatsReceived())
+#define SYNC_STATS_SUB(INDEX, SUB) \
+		syncStatsTopic(INDEX, SUB.getTopic()); \
+		SUB.registerCallback(boost::bind(&CommonDataSubscriber::syncStatsReceived, this, INDEX));
+
 // Sync declarations
 #define SYNC_DECL2(PREFIX, APPROX, QUEUE_SIZE, SUB0, SUB1) \
+		SYNC_STATS_SUB(0, SUB0) \
+		SYNC_STATS_SUB(1, SUB1) \
 		if(APPROX) \
 		{ \
 			PREFIX##ApproximateSync_ = new message_filters::Synchronizer<PREFIX##ApproximateSyncPolicy>( \
 					PREFIX##ApproximateSyncPolicy(QUEUE_SIZE), SUB0, SUB1); \
+			PREFIX##ApproximateSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##SyncStats, this, _1, _2)); \
 			PREFIX##ApproximateSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##Callback, this, _1, _2)); \
 		} \
 		else \
 		{ \
 			PREFIX##ExactSync_ = new message_filters::Synchronizer<PREFIX##ExactSyncPolicy>( \
 					PREFIX##ExactSyncPolicy(QUEUE_SIZE), SUB0, SUB1); \
+			PREFIX##ExactSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##SyncStats, this, _1, _2)); \
 			PREFIX##ExactSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##Callback, this, _1, _2)); \
 		} \
 		subscribedTopicsMsg_ = uFormat("\n%s subscribed to (%s sync):\n   %s \\\n   %s", \
@@ -125,16 +162,21 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 				SUB1.getTopic().c_str());
 
 #define SYNC_DECL3(PREFIX, APPROX, QUEUE_SIZE, SUB0, SUB1, SUB2) \
+		SYNC_STATS_SUB(0, SUB0) \
+		SYNC_STATS_SUB(1, SUB1) \
+		SYNC_STATS_SUB(2, SUB2) \
 		if(APPROX) \
 		{ \
 			PREFIX##ApproximateSync_ = new message_filters::Synchronizer<PREFIX##ApproximateSyncPolicy>( \
 					PREFIX##ApproximateSyncPolicy(QUEUE_SIZE), SUB0, SUB1, SUB2); \
+			PREFIX##ApproximateSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##SyncStats, this, _1, _2, _3)); \
 			PREFIX##ApproximateSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##Callback, this, _1, _2, _3)); \
 		} \
 		else \
 		{ \
 			PREFIX##ExactSync_ = new message_filters::Synchronizer<PREFIX##ExactSyncPolicy>( \
 					PREFIX##ExactSyncPolicy(QUEUE_SIZE), SUB0, SUB1, SUB2); \
+			PREFIX##ExactSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##SyncStats, this, _1, _2, _3)); \
 			PREFIX##ExactSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##Callback, this, _1, _2, _3)); \
 		} \
 		subscribedTopicsMsg_ = uFormat("\n%s subscribed to (%s sync):\n   %s \\\n   %s \\\n   %s", \
@@ -145,16 +187,22 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 				SUB2.getTopic().c_str());
 
 #define SYNC_DECL4(PREFIX, APPROX, QUEUE_SIZE, SUB0, SUB1, SUB2, SUB3) \
+		SYNC_STATS_SUB(0, SUB0) \
+		SYNC_STATS_SUB(1, SUB1) \
+		SYNC_STATS_SUB(2, SUB2) \
+		SYNC_STATS_SUB(3, SUB3) \
 		if(APPROX) \
 		{ \
 			PREFIX##ApproximateSync_ = new message_filters::Synchronizer<PREFIX##ApproximateSyncPolicy>( \
 					PREFIX##ApproximateSyncPolicy(QUEUE_SIZE), SUB0, SUB1, SUB2, SUB3); \
+			PREFIX##ApproximateSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##SyncStats, this, _1, _2, _3, _4)); \
 			PREFIX##ApproximateSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##Callback, this, _1, _2, _3, _4)); \
 		} \
 		else \
 		{ \
 			PREFIX##ExactSync_ = new message_filters::Synchronizer<PREFIX##ExactSyncPolicy>( \
 					PREFIX##ExactSyncPolicy(QUEUE_SIZE), SUB0, SUB1, SUB2, SUB3); \
+			PREFIX##ExactSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##SyncStats, this, _1, _2, _3, _4)); \
 			PREFIX##ExactSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##Callback, this, _1, _2, _3, _4)); \
 		} \
 		subscribedTopicsMsg_ = uFormat("\n%s subscribed to (%s sync):\n   %s \\\n   %s \\\n   %s \\\n   %s", \
@@ -166,16 +214,23 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 				SUB3.getTopic().c_str());
 
 #define SYNC_DECL5(PREFIX, APPROX, QUEUE_SIZE, SUB0, SUB1, SUB2, SUB3, SUB4) \
+		SYNC_STATS_SUB(0, SUB0) \
+		SYNC_STATS_SUB(1, SUB1) \
+		SYNC_STATS_SUB(2, SUB2) \
+		SYNC_STATS_SUB(3, SUB3) \
+		SYNC_STATS_SUB(4, SUB4) \
 		if(APPROX) \
 		{ \
 			PREFIX##ApproximateSync_ = new message_filters::Synchronizer<PREFIX##ApproximateSyncPolicy>( \
 					PREFIX##ApproximateSyncPolicy(QUEUE_SIZE), SUB0, SUB1, SUB2, SUB3, SUB4); \
+			PREFIX##ApproximateSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##SyncStats, this, _1, _2, _3, _4, _5)); \
 			PREFIX##ApproximateSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##Callback, this, _1, _2, _3, _4, _5)); \
 		} \
 		else \
 		{ \
 			PREFIX##ExactSync_ = new message_filters::Synchronizer<PREFIX##ExactSyncPolicy>( \
 					PREFIX##ExactSyncPolicy(QUEUE_SIZE), SUB0, SUB1, SUB2, SUB3, SUB4); \
+			PREFIX##ExactSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##SyncStats, this, _1, _2, _3, _4, _5)); \
 			PREFIX##ExactSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##Callback, this, _1, _2, _3, _4, _5)); \
 		} \
 		subscribedTopicsMsg_ = uFormat("\n%s subscribed to (%s sync):\n   %s \\\n   %s \\\n   %s \\\n   %s \\\n   %s", \
@@ -188,16 +243,24 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 				SUB4.getTopic().c_str());
 
 #define SYNC_DECL6(PREFIX, APPROX, QUEUE_SIZE, SUB0, SUB1, SUB2, SUB3, SUB4, SUB5) \
+		SYNC_STATS_SUB(0, SUB0) \
+		SYNC_STATS_SUB(1, SUB1) \
+		SYNC_STATS_SUB(2, SUB2) \
+		SYNC_STATS_SUB(3, SUB3) \
+		SYNC_STATS_SUB(4, SUB4) \
+		SYNC_STATS_SUB(5, SUB5) \
 		if(APPROX) \
 		{ \
 			PREFIX##ApproximateSync_ = new message_filters::Synchronizer<PREFIX##ApproximateSyncPolicy>( \
 					PREFIX##ApproximateSyncPolicy(QUEUE_SIZE), SUB0, SUB1, SUB2, SUB3, SUB4, SUB5); \
+			PREFIX##ApproximateSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##SyncStats, this, _1, _2, _3, _4, _5, _6)); \
 			PREFIX##ApproximateSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##Callback, this, _1, _2, _3, _4, _5, _6)); \
 		} \
 		else \
 		{ \
 			PREFIX##ExactSync_ = new message_filters::Synchronizer<PREFIX##ExactSyncPolicy>( \
 					PREFIX##ExactSyncPolicy(QUEUE_SIZE), SUB0, SUB1, SUB2, SUB3, SUB4, SUB5); \
+			PREFIX##ExactSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##SyncStats, this, _1, _2, _3, _4, _5, _6)); \
 			PREFIX##ExactSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##Callback, this, _1, _2, _3, _4, _5, _6)); \
 		} \
 		subscribedTopicsMsg_ = uFormat("\n%s subscribed to (%s sync):\n   %s \\\n   %s \\\n   %s \\\n   %s \\\n   %s \\\n   %s", \
@@ -211,16 +274,25 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 				SUB5.getTopic().c_str());
 
 #define SYNC_DECL7(PREFIX, APPROX, QUEUE_SIZE, SUB0, SUB1, SUB2, SUB3, SUB4, SUB5, SUB6) \
+		SYNC_STATS_SUB(0, SUB0) \
+		SYNC_STATS_SUB(1, SUB1) \
+		SYNC_STATS_SUB(2, SUB2) \
+		SYNC_STATS_SUB(3, SUB3) \
+		SYNC_STATS_SUB(4, SUB4) \
+		SYNC_STATS_SUB(5, SUB5) \
+		SYNC_STATS_SUB(6, SUB6) \
 		if(APPROX) \
 		{ \
 			PREFIX##ApproximateSync_ = new message_filters::Synchronizer<PREFIX##ApproximateSyncPolicy>( \
 					PREFIX##ApproximateSyncPolicy(QUEUE_SIZE), SUB0, SUB1, SUB2, SUB3, SUB4, SUB5, SUB6); \
+			PREFIX##ApproximateSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##SyncStats, this, _1, _2, _3, _4, _5, _6, _7)); \
 			PREFIX##ApproximateSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##Callback, this, _1, _2, _3, _4, _5, _6, _7)); \
 		} \
 		else \
 		{ \
 			PREFIX##ExactSync_ = new message_filters::Synchronizer<PREFIX##ExactSyncPolicy>( \
 					PREFIX##ExactSyncPolicy(QUEUE_SIZE), SUB0, SUB1, SUB2, SUB3, SUB4, SUB5, SUB6); \
+			PREFIX##ExactSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##SyncStats, this, _1, _2, _3, _4, _5, _6, _7)); \
 			PREFIX##ExactSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##Callback, this, _1, _2, _3, _4, _5, _6, _7)); \
 		} \
 		subscribedTopicsMsg_ = uFormat("\n%s subscribed to (%s sync):\n   %s \\\n   %s \\\n   %s \\\n   %s \\\n   %s \\\n   %s \\\n   %s", \
@@ -235,16 +307,26 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 				SUB6.getTopic().c_str());
 
 #define SYNC_DECL8(PREFIX, APPROX, QUEUE_SIZE, SUB0, SUB1, SUB2, SUB3, SUB4, SUB5, SUB6, SUB7) \
+		SYNC_STATS_SUB(0, SUB0) \
+		SYNC_STATS_SUB(1, SUB1) \
+		SYNC_STATS_SUB(2, SUB2) \
+		SYNC_STATS_SUB(3, SUB3) \
+		SYNC_STATS_SUB(4, SUB4) \
+		SYNC_STATS_SUB(5, SUB5) \
+		SYNC_STATS_SUB(6, SUB6) \
+		SYNC_STATS_SUB(7, SUB7) \
 		if(APPROX) \
 		{ \
 			PREFIX##ApproximateSync_ = new message_filters::Synchronizer<PREFIX##ApproximateSyncPolicy>( \
 					PREFIX##ApproximateSyncPolicy(QUEUE_SIZE), SUB0, SUB1, SUB2, SUB3, SUB4, SUB5, SUB6, SUB7); \
+			PREFIX##ApproximateSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##SyncStats, this, _1, _2, _3, _4, _5, _6, _7, _8)); \
 			PREFIX##ApproximateSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##Callback, this, _1, _2, _3, _4, _5, _6, _7, _8)); \
 		} \
 		else \
 		{ \
 			PREFIX##ExactSync_ = new message_filters::Synchronizer<PREFIX##ExactSyncPolicy>( \
 					PREFIX##ExactSyncPolicy(QUEUE_SIZE), SUB0, SUB1, SUB2, SUB3, SUB4, SUB5, SUB6, SUB7); \
+			PREFIX##ExactSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##SyncStats, this, _1, _2, _3, _4, _5, _6, _7, _8)); \
 			PREFIX##ExactSync_->registerCallback(boost::bind(&CommonDataSubscriber::PREFIX##Callback, this, _1, _2, _3, _4, _5, _6, _7, _8)); \
 		} \
 		subscribedTopicsMsg_ = uFormat("\n%s subscribed to (%s sync):\n   %s \\\n   %s \\\n   %s \\\n   %s \\\n   %s \\\n   %s \\\n   %s \\\n   %s", \
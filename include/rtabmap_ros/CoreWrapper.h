@@ -30,9 +30,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 #include <nodelet/nodelet.h>
 
 #include <std_srvs/Empty.h>
+#include <std_srvs/Trigger.h>
 
 #include <tf/transform_listener.h>
 #include <tf2_ros/transform_broadcaster.h>
@@ -61,10 +63,20 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap_ros/CommonDataSubscriber.h"
 #include "rtabmap_ros/OdomInfo.h"
 #include "rtabmap_ros/AddLink.h"
+#include "rtabmap_ros/AddLinks.h"
 #include "rtabmap_ros/GetNodesInRadius.h"
+#include "rtabmap_ros/GetNodesByDescriptor.h"
 #include "rtabmap_ros/LoadDatabase.h"
+#include "rtabmap_ros/GetCloudChunks.h"
 
 #include "MapsManager.h"
+#include "RollingPercentiles.h"
+#include "NodesSpatialIndex.h"
+#include "PlanCache.h"
+#include "DescriptorIndex.h"
+#include "MapSnapshot.h"
+#include "TransformSnapshot.h"
+#include "StampedRingBuffer.h"
 
 #ifdef WITH_OCTOMAP_MSGS
 #include <octomap_msgs/GetOctomap.h>
@@ -88,12 +100,29 @@ class StereoDense;
 
 namespace rtabmap_ros {
 
+class StaticTransformCache;
+
 class CoreWrapper : public CommonDataSubscriber, public nodelet::Nodelet
 {
 public:
 	CoreWrapper();
 	virtual ~CoreWrapper();
 
+	/**
+	 * Process data without ROS transport (see the benchmark tool): the
+	 * data goes through the same process() than data received by the
+	 * callbacks, on the caller thread. "process_async" should be false.
+	 * @param statistics RTAB-Map statistics of the update ("Timing/...")
+	 *        and the stage times of the ROS wrapper ("RtabmapROS/...")
+	 * @return true if the data has been processed by RTAB-Map
+	 */
+	bool processData(
+			rtabmap::SensorData & data,
+			const rtabmap::Transform & odom,
+			const cv::Mat & odomCovariance,
+			const rtabmap::OdometryInfo & odomInfo,
+			std::map<std::string, float> & statistics);
+
 private:
 
 	virtual void onInit();
@@ -164,6 +193,7 @@ private:
 	void imuAsyncCallback(const sensor_msgs::ImuConstPtr & tagDetections);
 	void interOdomCallback(const nav_msgs::OdometryConstPtr & msg);
 	void interOdomInfoCallback(const nav_msgs::OdometryConstPtr & msg1, const rtabmap_ros::OdomInfoConstPtr & msg2);
+	void pushInterOdom(const nav_msgs::Odometry & odom, const rtabmap_ros::OdomInfo & info);
 
 	void initialPoseCallback(const geometry_msgs::PoseWithCovarianceStampedConstPtr & msg);
 
@@ -185,6 +215,25 @@ private:
 			const cv::Mat & odomCovariance = cv::Mat::eye(6,6,CV_64FC1),
 			const rtabmap::OdometryInfo & odomInfo = rtabmap::OdometryInfo(),
 			double timeMsgConversion = 0.0);
+	void processImpl(
+			const ros::Time & stamp,
+			rtabmap::SensorData & data,
+			const rtabmap::Transform & odom,
+			const std::string & odomFrameId,
+			const cv::Mat & odomCovariance,
+			const rtabmap::OdometryInfo & odomInfo,
+			double timeMsgConversion,
+			double timeTfWait = 0.0,
+			double timeQueued = 0.0);
+	void processLoop();
+	void clearProcessQueue();
+	void publishMapsLoop();
+	void clearMapsUpdate();
+	void loadSavedMap(const char * logPrefix);
+	void loadMapsCacheFile(unsigned long long databaseStamp);
+	void saveMapsCacheFile();
+	void loadMapCacheAsync(const std::map<int, rtabmap::Transform> & poses);
+	void loadMapCacheLoop();
 	std::map<int, rtabmap::Transform> filterNodesToAssemble(
 			const std::map<int, rtabmap::Transform> & nodes,
 			const rtabmap::Transform & currentPose);
@@ -196,6 +245,19 @@ private:
 	bool loadDatabaseCallback(rtabmap_ros::LoadDatabase::Request&, rtabmap_ros::LoadDatabase::Response&);
 	bool triggerNewMapCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&);
 	bool backupDatabaseCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&);
+	bool backupDatabaseAsyncCallback(std_srvs::Trigger::Request&, std_srvs::Trigger::Response&);
+	void flushDatabase();
+	void backupDatabaseLoop(unsigned int jobId);
+	bool copyDatabaseBlocks(
+			const std::string & src,
+			const std::string & dst,
+			unsigned int jobId,
+			unsigned int pass,
+			const std::set<unsigned long> * blocks,
+			std::set<unsigned long> & changedBlocks,
+			unsigned long & srcSize,
+			unsigned long & bytesWritten);
+	void publishBackupProgress(unsigned int jobId, unsigned long total, unsigned long checked, unsigned long written, unsigned int pass, bool done, bool success, const std::string & message);
 	bool setModeLocalizationCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&);
 	bool setModeMappingCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&);
 	bool setLogDebug(std_srvs::Empty::Request&, std_srvs::Empty::Response&);
@@ -217,7 +279,10 @@ private:
 	bool setLabelCallback(rtabmap_ros::SetLabel::Request& req, rtabmap_ros::SetLabel::Response& res);
 	bool listLabelsCallback(rtabmap_ros::ListLabels::Request& req, rtabmap_ros::ListLabels::Response& res);
 	bool addLinkCallback(rtabmap_ros::AddLink::Request&, rtabmap_ros::AddLink::Response&);
+	bool addLinksCallback(rtabmap_ros::AddLinks::Request&, rtabmap_ros::AddLinks::Response&);
 	bool getNodesInRadiusCallback(rtabmap_ros::GetNodesInRadius::Request&, rtabmap_ros::GetNodesInRadius::Response&);
+	bool getNodesByDescriptorCallback(rtabmap_ros::GetNodesByDescriptor::Request&, rtabmap_ros::GetNodesByDescriptor::Response&);
+	bool getCloudChunksCallback(rtabmap_ros::GetCloudChunks::Request&, rtabmap_ros::GetCloudChunks::Response&);
 #ifdef WITH_OCTOMAP_MSGS
 	bool octomapBinaryCallback(octomap_msgs::GetOctomap::Request  &req, octomap_msgs::GetOctomap::Response &res);
 	bool octomapFullCallback(octomap_msgs::GetOctomap::Request  &req, octomap_msgs::GetOctomap::Response &res);
@@ -229,15 +294,37 @@ private:
 	void publishLoop(double tfDelay, double tfTolerance);
 
 	void publishStats(const ros::Time & stamp);
+	bool isLocalizationLightweight() const;
+	void publishLocalizationMaps(const ros::Time & stamp);
+	void addStageTime(const std::string & name, double seconds, bool computePercentiles);
+	void updateMemoryUsage();
 	void publishCurrentGoal(const ros::Time & stamp);
 	void goalDoneCb(const actionlib::SimpleClientGoalState& state, const move_base_msgs::MoveBaseResultConstPtr& result);
 	void goalActiveCb();
 	void goalFeedbackCb(const move_base_msgs::MoveBaseFeedbackConstPtr& feedback);
 	void publishLocalPath(const ros::Time & stamp);
 	void publishGlobalPath(const ros::Time & stamp);
+	void updateMapSnapshot();
+	void updateNodesIndex();
+
+private:
+	// Data converted on the callback thread, waiting to be processed by processLoop()
+	struct ProcessQueueItem
+	{
+		ros::Time stamp;
+		rtabmap::SensorData data;
+		rtabmap::Transform odom;
+		std::string odomFrameId;
+		cv::Mat odomCovariance;
+		rtabmap::OdometryInfo odomInfo;
+		double timeMsgConversion;
+		double timeTfWait;
+		ros::WallTime queuedTime;
+	};
 
 private:
 	rtabmap::Rtabmap rtabmap_;
+	UMutex rtabmapMutex_; // recursive, locked while rtabmap_ is accessed
 	bool paused_;
 	rtabmap::Transform lastPose_;
 	ros::Time lastPoseStamp_;
@@ -276,11 +363,14 @@ private:
 
 	rtabmap::Transform mapToOdom_;
 	boost::mutex mapToOdomMutex_;
+	TransformSnapshot mapToOdomSnapshot_; // read by publishLoop() without locking
 
 	MapsManager mapsManager_;
+	boost::mutex mapsMutex_; // locked while mapsManager_ is accessed, after rtabmapMutex_
 
 	ros::Publisher infoPub_;
 	ros::Publisher mapDataPub_;
+	ros::Publisher mapDataGridsPub_; // mapData with only the local grids of the nodes
 	ros::Publisher mapGraphPub_;
 	ros::Publisher landmarksPub_;
 	ros::Publisher labelsPub_;
@@ -304,6 +394,7 @@ private:
 
 	tf2_ros::TransformBroadcaster tfBroadcaster_;
 	tf::TransformListener tfListener_;
+	StaticTransformCache * tfStaticCache_; // tf_static_cache
 
 	ros::ServiceServer updateSrv_;
 	ros::ServiceServer resetSrv_;
@@ -312,6 +403,7 @@ private:
 	ros::ServiceServer loadDatabaseSrv_;
 	ros::ServiceServer triggerNewMapSrv_;
 	ros::ServiceServer backupDatabase_;
+	ros::ServiceServer backupDatabaseAsync_;
 	ros::ServiceServer setModeLocalizationSrv_;
 	ros::ServiceServer setModeMappingSrv_;
 	ros::ServiceServer setLogDebugSrv_;
@@ -333,7 +425,10 @@ private:
 	ros::ServiceServer setLabelSrv_;
 	ros::ServiceServer listLabelsSrv_;
 	ros::ServiceServer addLinkSrv_;
+	ros::ServiceServer addLinksSrv_;
 	ros::ServiceServer getNodesInRadiusSrv_;
+	ros::ServiceServer getNodesByDescriptorSrv_;
+	ros::ServiceServer getCloudChunksSrv_;
 #ifdef WITH_OCTOMAP_MSGS
 	ros::ServiceServer octomapBinarySrv_;
 	ros::ServiceServer octomapFullSrv_;
@@ -343,6 +438,101 @@ private:
 
 	boost::thread* transformThread_;
 	bool tfThreadRunning_;
+	bool tfExtrapolate_;
+
+	// asynchronous processing
+	bool processAsync_;
+	int processAsyncQueueSize_;
+	bool processAsyncKeepLatest_;
+	boost::thread* processThread_;
+	bool processThreadRunning_;
+	std::list<ProcessQueueItem> processQueue_;
+	boost::mutex processQueueMutex_;
+	boost::condition_variable processQueueCondition_;
+	unsigned long processQueueDropped_;
+
+	// asynchronous map publishing, only the latest request is kept
+	bool publishMapsAsync_;
+	boost::thread* mapsThread_;
+	bool mapsThreadRunning_;
+	bool mapsUpdatePending_;
+	std::map<int, rtabmap::Transform> mapsUpdatePoses_;
+	std::map<int, rtabmap::Signature> mapsUpdateSignatures_;
+	ros::Time mapsUpdateStamp_;
+	unsigned long mapsUpdatesCoalesced_;
+	double mapsLastUpdateTime_;
+	double mapsLastPublishTime_;
+	boost::mutex mapsUpdateMutex_;
+	boost::condition_variable mapsUpdateCondition_;
+
+	// encoding of NodeData words (see rtabmap_ros::nodeDataToROS())
+	int wordsPacking_;
+	// encoding of MapGraph poses and links (see rtabmap_ros::mapGraphToROS())
+	int graphPacking_;
+
+	// localization_lightweight: in localization mode, the maps are generated
+	// and latched once, map data/graph are not published
+	bool localizationLightweight_;
+	bool localizationMapsLatched_;
+	std::map<int, rtabmap::Transform> localizationMapPoses_;
+
+	// map_cache_persist: local grids/clouds cached in "<database>.maps_cache"
+	bool mapCachePersist_;
+
+	// fast start: local grids of the saved map are loaded in background
+	bool fastStart_;
+	boost::thread* mapCacheThread_;
+	bool mapCacheThreadRunning_;
+	std::map<int, rtabmap::Transform> mapCachePoses_;
+	unsigned int mapCacheGeneration_;
+	boost::mutex mapCacheMutex_;
+	boost::condition_variable mapCacheCondition_;
+
+	// asynchronous incremental backup
+	boost::thread* backupThread_;
+	bool backupThreadRunning_;
+	bool backupJobRunning_;
+	unsigned int backupJobId_;
+	double backupMaxRate_; // MB/s
+	boost::mutex backupMutex_;
+	ros::Publisher backupProgressPub_;
+
+	// per-stage timing statistics
+	int latencyWindowSize_;
+	std::map<std::string, RollingPercentiles> stageTimes_;
+
+	// per-structure memory accounting (bytes)
+	double memorySoftLimit_; // MB, limit of the evictable map caches
+	std::map<std::string, unsigned long> mapsMemoryUsage_;
+	unsigned long mapsMemoryEvictable_;
+	double timeOdomTfWait_;
+
+	// delta encoding of mapData/mapGraph topics
+	bool mapDeltaEnabled_;
+	double mapDeltaLinearUpdate_;
+	double mapDeltaAngularUpdate_;
+	int mapDeltaKeyFrameInterval_;
+	unsigned int mapDeltaVersion_;
+	std::map<int, rtabmap::Transform> mapDeltaPoses_; // graph as known by subscribers
+	std::multimap<int, rtabmap::Link> mapDeltaLinks_;
+
+	// spatial index of the optimized poses, refreshed lazily on proximity queries
+	NodesSpatialIndex nodesIndex_;
+	bool nodesIndexOutdated_;
+
+	// ANN index of the global descriptors of the nodes in the graph, new nodes
+	// are added on update, removed/retrieved nodes are synchronized on queries
+	DescriptorIndex descriptorIndex_;
+	std::set<int> nodesWithoutDescriptor_;
+	bool descriptorIndexOutdated_;
+
+	// plans between nodes, invalidated when the graph version changes (new links, reset)
+	PlanCache planCache_;
+	unsigned long planGraphVersion_;
+	// last published global path, only poses that changed are updated
+	nav_msgs::Path globalPathMsg_;
+	rtabmap_ros::Path globalPathNodesMsg_;
+	std::vector<rtabmap::Transform> globalPathPoses_;
 
 	// for loop closure detection only
 	image_transport::Subscriber defaultSub_;
@@ -351,6 +541,8 @@ private:
 	cv::Mat userData_;
 	UMutex userDataMutex_;
 
+	// globalPose_, gps_, tags_, imus_ and imuFrameId_
+	boost::mutex asyncDataMutex_;
 	ros::Subscriber globalPoseAsyncSub_;
 	geometry_msgs::PoseWithCovarianceStamped globalPose_;
 	ros::Subscriber gpsFixAsyncSub_;
@@ -358,18 +550,38 @@ private:
 	ros::Subscriber tagDetectionsSub_;
 	std::map<int, geometry_msgs::PoseWithCovarianceStamped> tags_;
 	ros::Subscriber imuSub_;
-	std::map<double, rtabmap::Transform> imus_;
+	StampedRingBuffer<rtabmap::Transform> imus_;
 	std::string imuFrameId_;
 
 	ros::Subscriber interOdomSub_;
-	std::list<std::pair<nav_msgs::Odometry, rtabmap_ros::OdomInfo> > interOdoms_;
+	StampedRingBuffer<std::pair<nav_msgs::Odometry, rtabmap_ros::OdomInfo> > interOdoms_;
+	boost::mutex interOdomsMutex_;
 	message_filters::Subscriber<nav_msgs::Odometry> interOdomSyncSub_;
 	message_filters::Subscriber<rtabmap_ros::OdomInfo> interOdomInfoSyncSub_;
 	typedef message_filters::sync_policies::ExactTime<nav_msgs::Odometry, rtabmap_ros::OdomInfo> MyExactInterOdomSyncPolicy;
 	message_filters::Synchronizer<MyExactInterOdomSyncPolicy> * interOdomSync_;
 
+	// async inputs above served by their own thread instead of the nodelet's queue
+	ros::CallbackQueue asyncQueue_;
+	ros::AsyncSpinner * asyncSpinner_;
+
+	// read-only map services served by their own threads from the latest
+	// snapshot (published after each update) if query_threads > 0
+	int queryThreads_;
+	ros::CallbackQueue queryQueue_;
+	ros::AsyncSpinner * querySpinner_;
+	MapSnapshotHolder mapSnapshot_;
+
 	bool stereoToDepth_;
 	bool odomSensorSync_;
+	bool compressedPassthrough_; // keep compressed images of rgbd_image as is in SensorData
+	std::string sensorDataHandoffTopic_; // rgbd_image topic if sensor_data_handoff is enabled
+
+	// conversion temporaries of commonDepthCallbackImpl(), reused from one frame to the next
+	std::vector<rtabmap::CameraModel> frameCameraModels_;
+	std::vector<cv::KeyPoint> frameKeyPoints_;
+	std::vector<cv::Point3f> framePoints_;
+	FrameAllocStats frameAllocStats_;
 	float rate_;
 	bool createIntermediateNodes_;
 	int mappingMaxNodes_;
@@ -0,0 +1,89 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef DEPTHREGISTRATION_H_
+#define DEPTHREGISTRATION_H_
+
+#include <rtabmap/core/CameraModel.h>
+#include <rtabmap/core/Transform.h>
+#include <rtabmap_ros/ImageBufferPool.h>
+#include <opencv2/core/core.hpp>
+#include <vector>
+
+namespace rtabmap_ros {
+
+/**
+ * Registers depth images in the RGB camera frame. The rays of the depth
+ * camera are precomputed in the RGB camera frame (rotation of the
+ * extrinsic included) when the models or the extrinsic change, so that
+ * each depth pixel is projected with a multiply-add per axis
+ * and a division. Rows are projected in parallel in separate z-buffers
+ * (closest depth kept), then merged with the depth scale applied.
+ * Input depth images should be rectified. Not thread-safe.
+ */
+class DepthRegistration
+{
+public:
+	DepthRegistration();
+
+	/**
+	 * @param depthModel model of the input depth images
+	 * @param rgbModel model of the RGB images, size of the registered images
+	 * @param rgbToDepth pose of the depth camera in the RGB camera frame
+	 * @return true if the ray tables have been recomputed, false if they
+	 *         didn't change or if the models are not valid (isValid() is
+	 *         then false)
+	 */
+	bool update(
+			const rtabmap::CameraModel & depthModel,
+			const rtabmap::CameraModel & rgbModel,
+			const rtabmap::Transform & rgbToDepth);
+	bool isValid() const {return !rays_.empty();}
+
+	/**
+	 * @param depth CV_16UC1 (mm) or CV_32FC1 (m), size of the depth model
+	 * @param depthScale depth multiplier applied to registered values
+	 * @return registered depth of same type, size of the RGB model, in a
+	 *         recycled buffer when the images previously returned are not
+	 *         referenced anymore. Empty if not isValid() or if the type
+	 *         or the size of depth don't match.
+	 */
+	cv::Mat registerDepth(const cv::Mat & depth, float depthScale = 1.0f);
+
+private:
+	rtabmap::CameraModel depthModel_;
+	rtabmap::CameraModel rgbModel_;
+	rtabmap::Transform rgbToDepth_;
+	std::vector<float> rays_; // [v][u][xyz]
+	std::vector<cv::Mat> zBuffers_;
+	MatBufferPool buffers_; // registered images, for frames still in use downstream
+};
+
+}
+
+#endif /* DEPTHREGISTRATION_H_ */
@@ -0,0 +1,87 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef DEPTHUNDISTORTER_H_
+#define DEPTHUNDISTORTER_H_
+
+#include <rtabmap_ros/ImageBufferPool.h>
+#include <opencv2/core/core.hpp>
+#include <string>
+#include <vector>
+
+namespace rtabmap_ros {
+
+/**
+ * Applies a CLAMS depth distortion model (see undistort_depth) with a
+ * lookup table of multipliers precomputed when the model is loaded: for
+ * each frustum of the model (bin of pixels), the multiplier is sampled
+ * every samplingStep meters and linearly interpolated between samples.
+ * Images are undistorted by rows in parallel, without modifying the input.
+ * Not thread-safe.
+ */
+class DepthUndistorter
+{
+public:
+	DepthUndistorter();
+
+	/**
+	 * @param samplingStep depth step (m) of the lookup table
+	 * @return false if the model cannot be loaded or is not valid
+	 */
+	bool load(const std::string & path, float samplingStep = 0.01f);
+	bool isValid() const {return !table_.empty();}
+	int width() const {return width_;}
+	int height() const {return height_;}
+
+	/**
+	 * @param depth CV_16UC1 (mm) or CV_32FC1 (m), size of the model
+	 * @param output same size and type than depth, can be depth (in place)
+	 */
+	void undistort(const cv::Mat & depth, cv::Mat & output) const;
+
+	/**
+	 * Same as above, but written in a recycled buffer when the
+	 * images previously returned are not referenced anymore.
+	 */
+	cv::Mat undistort(const cv::Mat & depth);
+
+private:
+	int width_;
+	int height_;
+	int binWidth_;
+	int binHeight_;
+	int binsX_;
+	float samplingStep_;
+	int samples_;
+	std::vector<float> table_; // [frustum][sample]
+	MatBufferPool buffers_; // undistorted images, for frames still in use downstream
+};
+
+}
+
+#endif /* DEPTHUNDISTORTER_H_ */
@@ -0,0 +1,112 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef DESCRIPTORINDEX_H_
+#define DESCRIPTORINDEX_H_
+
+#include <opencv2/core/core.hpp>
+#include <map>
+#include <vector>
+
+namespace rtabmap_ros {
+
+/**
+ * Approximate nearest neighbor index (HNSW, Malkov and Yashunin 2016)
+ * of node global descriptors, with L2 distance (same ranking than cosine
+ * distance for normalized descriptors like NetVLAD). Nodes are inserted
+ * incrementally. Removed nodes are only marked as deleted (still used to
+ * navigate in the graph, never returned) until they are more than the
+ * remaining ones, then the index is rebuilt. All descriptors should have
+ * the same size. Not thread-safe.
+ */
+class DescriptorIndex
+{
+public:
+	/**
+	 * @param maxLinks maximum links per node in the upper layers (twice in layer 0)
+	 * @param efConstruction candidates explored when inserting nodes
+	 */
+	DescriptorIndex(int maxLinks = 16, int efConstruction = 100);
+
+	void clear();
+	size_t size() const {return idToIndex_.size();}
+	int dimension() const {return dim_;}
+	bool contains(int id) const {return idToIndex_.find(id) != idToIndex_.end();}
+	const std::map<int, int> & ids() const {return idToIndex_;} // id -> internal index
+
+	/**
+	 * @param descriptor 1 row (or continuous) of any type, converted to float
+	 * @return false if the descriptor is empty or its size doesn't match
+	 *         the other descriptors
+	 */
+	bool add(int id, const cv::Mat & descriptor);
+	void remove(int id);
+
+	/**
+	 * @param ef candidates explored, higher is more accurate (at least k)
+	 * @return up to k (id, squared L2 distance) sorted by distance
+	 */
+	std::vector<std::pair<int, float> > knnSearch(const cv::Mat & descriptor, int k, int ef = 64);
+
+	// descriptor of a node (empty if not indexed)
+	cv::Mat descriptor(int id) const;
+
+private:
+	struct Node
+	{
+		int id;
+		bool deleted;
+		std::vector<std::vector<int> > links; // per layer
+	};
+	typedef std::pair<float, int> Candidate; // distance, index
+
+	cv::Mat toFloat(const cv::Mat & descriptor) const;
+	float distance(const float * a, int b) const;
+	std::vector<Candidate> searchLayer(const float * query, int entry, int ef, int layer);
+	std::vector<int> selectNeighbors(const std::vector<Candidate> & candidates, int maxLinks) const;
+	void insert(int index);
+	void rebuild();
+
+private:
+	int maxLinks_;
+	int efConstruction_;
+	double levelMult_;
+	int dim_;
+	std::vector<float> data_; // [index][dim]
+	std::vector<Node> nodes_;
+	std::map<int, int> idToIndex_; // not deleted nodes
+	int entry_;
+	int maxLayer_;
+	unsigned int seed_;
+	std::vector<unsigned int> visited_;
+	unsigned int visitedTag_;
+};
+
+}
+
+#endif /* DESCRIPTORINDEX_H_ */
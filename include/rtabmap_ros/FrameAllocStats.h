@@ -0,0 +1,118 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef FRAMEALLOCSTATS_H_
+#define FRAMEALLOCSTATS_H_
+
+#include <vector>
+#include <cstddef>
+
+namespace rtabmap_ros {
+
+/**
+ * Growth counter of the storage reused from one frame to the next (member
+ * vectors cleared or reassigned each frame instead of local temporaries).
+ * Each frame, the capacity of each tracked vector is recorded with add(),
+ * in the same order, then frame() compares each one to the previous
+ * frame. This detects the vectors that had to grow, it doesn't count
+ * allocations: a vector reallocated without growing (e.g., swapped with
+ * a new one of the same capacity) is not seen, and neither is the memory
+ * owned by the elements (e.g., image data shared with the messages). The
+ * benchmark tools count the real allocations of the process (see
+ * src/AllocationCounter.h). Not thread-safe.
+ */
+class FrameAllocStats
+{
+public:
+	FrameAllocStats() :
+		frames_(0),
+		framesGrown_(0),
+		lastGrownFrame_(0),
+		previousBytes_(0)
+	{}
+
+	template<typename T>
+	void add(const std::vector<T> & v)
+	{
+		capacities_.push_back(v.capacity()*sizeof(T));
+	}
+	template<typename T>
+	void add(const std::vector<std::vector<T> > & v)
+	{
+		capacities_.push_back(v.capacity()*sizeof(std::vector<T>));
+		for(size_t i=0; i<v.size(); ++i)
+		{
+			add(v[i]);
+		}
+	}
+
+	/**
+	 * Close the frame.
+	 * @return true if a tracked vector grew since the previous frame
+	 */
+	bool frame()
+	{
+		bool grown = false;
+		size_t bytes = 0;
+		for(size_t i=0; i<capacities_.size(); ++i)
+		{
+			// vectors not there at the previous frame grew from 0
+			grown = grown || capacities_[i] > (i<previousCapacities_.size()?previousCapacities_[i]:0);
+			bytes += capacities_[i];
+		}
+		++frames_;
+		if(grown)
+		{
+			++framesGrown_;
+			lastGrownFrame_ = frames_;
+		}
+		previousBytes_ = bytes;
+		previousCapacities_.swap(capacities_);
+		capacities_.clear();
+		return grown;
+	}
+
+	unsigned long frames() const {return frames_;}
+	// frames during which a tracked vector grew
+	unsigned long framesGrown() const {return framesGrown_;}
+	unsigned long lastGrownFrame() const {return lastGrownFrame_;}
+	// bytes reserved by the tracked storage at the last frame
+	size_t reservedBytes() const {return previousBytes_;}
+
+private:
+	unsigned long frames_;
+	unsigned long framesGrown_;
+	unsigned long lastGrownFrame_;
+	size_t previousBytes_;
+	std::vector<size_t> capacities_;
+	std::vector<size_t> previousCapacities_;
+};
+
+}
+
+#endif /* FRAMEALLOCSTATS_H_ */
@@ -35,12 +35,18 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap_ros/Goal.h"
 #include "rtabmap/utilite/UEventsHandler.h"
 #include "rtabmap/core/Transform.h"
+#include "rtabmap/core/Link.h"
+#include "rtabmap/core/OdometryEvent.h"
 
 #include <tf/transform_listener.h>
 
 #include <geometry_msgs/TwistStamped.h>
 #include <nav_msgs/Path.h>
 #include <std_msgs/Bool.h>
+#include <std_srvs/Empty.h>
+
+#include <boost/thread.hpp>
+#include <list>
 
 #include <rtabmap_ros/CommonDataSubscriber.h>
 
@@ -51,6 +57,7 @@ namespace rtabmap
 }
 
 class QApplication;
+class QObject;
 
 namespace rtabmap_ros {
 
@@ -60,11 +67,17 @@ public:
 	GuiWrapper(int & argc, char** argv);
 	virtual ~GuiWrapper();
 
+	// Called from the Qt thread to process the latest odometry received
+	void processPendingOdometry();
+
 protected:
 	virtual bool handleEvent(UEvent * anEvent);
 
 private:
 	void infoMapCallback(const rtabmap_ros::InfoConstPtr & infoMsg, const rtabmap_ros::MapDataConstPtr & mapMsg);
+	void processInfoMap(const rtabmap_ros::InfoConstPtr & infoMsg, const rtabmap_ros::MapDataConstPtr & mapMsg);
+	void infoMapThread();
+	void handOffOdometry(const rtabmap::OdometryEvent & odomEvent, bool ignoreData);
 	void goalPathCallback(const rtabmap_ros::GoalConstPtr & goalMsg, const nav_msgs::PathConstPtr & pathMsg);
 	void goalReachedCallback(const std_msgs::BoolConstPtr & value);
 
@@ -111,6 +124,9 @@ private:
 	void defaultCallback(const nav_msgs::OdometryConstPtr & odomMsg);
 
 	void processRequestedMap(const rtabmap_ros::MapData & map);
+	void downloadMap(bool global, bool optimized);
+	void stopMapDownload();
+	bool cancelMapDownloadCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&);
 
 private:
 	rtabmap::PreferencesDialog * prefDialog_;
@@ -129,6 +145,33 @@ private:
 
 	message_filters::Subscriber<rtabmap_ros::Info> infoTopic_;
 	message_filters::Subscriber<rtabmap_ros::MapData> mapDataTopic_;
+	// graph received with delta encoding
+	std::map<int, rtabmap::Transform> graphPoses_;
+	std::multimap<int, rtabmap::Link> graphLinks_;
+	unsigned int graphVersion_;
+
+	// map updates are converted in order by a worker thread
+	std::list<std::pair<rtabmap_ros::InfoConstPtr, rtabmap_ros::MapDataConstPtr> > infoMapQueue_;
+	boost::mutex infoMapMutex_;
+	boost::condition_variable infoMapCondition_;
+	boost::thread * infoMapThread_;
+	bool infoMapStop_;
+
+	// only the latest odometry is handed over to the Qt thread
+	bool odomLatestOnly_;
+	QObject * odomHandoff_;
+	boost::mutex pendingOdomMutex_;
+	boost::shared_ptr<rtabmap::OdometryEvent> pendingOdom_;
+	bool pendingOdomIgnoreData_;
+	bool pendingOdomPosted_;
+	int skippedOdom_;
+
+	// progressive map download
+	int mapDownloadChunkSize_;
+	boost::thread * mapDownloadThread_;
+	bool mapDownloadCancel_;
+	boost::mutex mapDownloadMutex_;
+	ros::ServiceServer cancelMapDownloadSrv_;
 
 	message_filters::Subscriber<rtabmap_ros::Goal> goalTopic_;
 	message_filters::Subscriber<nav_msgs::Path> pathTopic_;
@@ -0,0 +1,94 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef IMAGEBUFFERPOOL_H_
+#define IMAGEBUFFERPOOL_H_
+
+#include <sensor_msgs/Image.h>
+#include <opencv2/core/core.hpp>
+#include <vector>
+#include <string>
+
+namespace rtabmap_ros {
+
+/**
+ * Pool of preallocated image messages for drivers. Images published as
+ * shared pointers are delivered without copy to subscribers in the same
+ * process; a buffer is reused only when no subscriber holds it anymore,
+ * otherwise another one is allocated (up to the pool size, then images
+ * are allocated outside the pool). Not thread-safe, to be used by
+ * the capture thread.
+ */
+class ImageBufferPool
+{
+public:
+	ImageBufferPool(size_t size = 4);
+
+	void setSize(size_t size);
+	size_t size() const {return size_;}
+
+	/**
+	 * @return image with data allocated for the size and type (cv type among
+	 *         CV_8UC1, CV_8UC3, CV_16UC1 or CV_32FC1), the header is not set.
+	 */
+	sensor_msgs::ImagePtr acquire(int width, int height, int type);
+	// cv::Mat sharing the data of the image
+	static cv::Mat toCvMat(sensor_msgs::Image & image);
+
+	unsigned long allocations() const {return allocations_;} // new buffers allocated
+	unsigned long exhausted() const {return exhausted_;} // images allocated outside the pool
+
+private:
+	size_t size_;
+	std::vector<sensor_msgs::ImagePtr> buffers_;
+	unsigned long allocations_;
+	unsigned long exhausted_;
+};
+
+/**
+ * Same for cv::Mat outputs of the processing classes: a buffer is reused
+ * when only the pool refers to it (images returned previously are not
+ * used anymore downstream). When all buffers are used, a new one replaces
+ * one not used of another size, or the oldest one. Not thread-safe.
+ */
+class MatBufferPool
+{
+public:
+	MatBufferPool(size_t size = 4);
+
+	cv::Mat acquire(const cv::Size & size, int type);
+	void clear() {buffers_.clear();}
+
+private:
+	size_t size_;
+	std::vector<cv::Mat> buffers_;
+};
+
+}
+
+#endif /* IMAGEBUFFERPOOL_H_ */
@@ -0,0 +1,91 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef LAZYSUBSCRIPTION_H_
+#define LAZYSUBSCRIPTION_H_
+
+#include <ros/ros.h>
+#include <image_transport/image_transport.h>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <string>
+#include <vector>
+
+namespace rtabmap_ros {
+
+/**
+ * Subscribe to the inputs of a nodelet only while at least one of its
+ * outputs has subscribers ("lazy_subscription" private parameter, false
+ * by default). Outputs are advertised with connectCallback() (or
+ * imageConnectCallback()) as connect and disconnect callbacks and
+ * registered with addOutput(). start() is called once all outputs are
+ * advertised: inputs are then subscribed right away if lazy subscription
+ * is disabled, otherwise when the first output subscriber connects, and
+ * unsubscribed when the last one disconnects. All methods are thread-safe.
+ */
+class LazySubscription
+{
+public:
+	LazySubscription();
+
+	void init(
+			ros::NodeHandle & pnh,
+			const std::string & name,
+			const boost::function<void()> & subscribe,
+			const boost::function<void()> & unsubscribe);
+	bool enabled() const {return enabled_;}
+	// Inputs are currently subscribed
+	bool subscribed() const;
+
+	ros::SubscriberStatusCallback connectCallback();
+	image_transport::SubscriberStatusCallback imageConnectCallback();
+	void addOutput(const ros::Publisher & pub);
+	void addOutput(const image_transport::Publisher & pub);
+
+	void start();
+
+private:
+	void connectCallbackImpl(const ros::SingleSubscriberPublisher &) {update();}
+	void imageConnectCallbackImpl(const image_transport::SingleSubscriberPublisher &) {update();}
+	void update();
+
+private:
+	std::string name_;
+	bool enabled_;
+	bool started_;
+	bool subscribed_;
+	mutable boost::mutex mutex_;
+	boost::function<void()> subscribe_;
+	boost::function<void()> unsubscribe_;
+	std::vector<ros::Publisher> outputs_;
+	std::vector<image_transport::Publisher> imageOutputs_;
+};
+
+}
+
+#endif /* LAZYSUBSCRIPTION_H_ */
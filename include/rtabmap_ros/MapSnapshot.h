@@ -0,0 +1,118 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MAPSNAPSHOT_H_
+#define MAPSNAPSHOT_H_
+
+#include <rtabmap/core/Transform.h>
+#include <rtabmap/core/Link.h>
+#include <rtabmap_ros/NodesSpatialIndex.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <map>
+#include <string>
+
+namespace rtabmap {
+class Rtabmap;
+}
+
+namespace rtabmap_ros {
+
+/**
+ * Read-only copy of the graph state used by the query services
+ * (optimized poses with their spatial index, links, labels), built by
+ * the SLAM thread after each update so that queries don't have to lock
+ * rtabmap. A snapshot is never modified once published: parts that did
+ * not change since the previous snapshot are shared with it instead of
+ * being copied (copy-on-write), so holding an old snapshot while a new
+ * one is published is cheap.
+ */
+class MapSnapshot
+{
+public:
+	typedef boost::shared_ptr<const MapSnapshot> ConstPtr;
+
+	/**
+	 * Must be called with rtabmap locked.
+	 */
+	static ConstPtr create(
+			const ConstPtr & previous,
+			const rtabmap::Rtabmap & rtabmap,
+			const rtabmap::Transform & mapToOdom,
+			float indexCellSize,
+			double stamp);
+
+	unsigned long version() const {return version_;}
+	double stamp() const {return stamp_;}
+	const std::map<int, rtabmap::Transform> & poses() const {return nodesIndex_->poses();}
+	const NodesSpatialIndex & nodesIndex() const {return *nodesIndex_;}
+	const std::multimap<int, rtabmap::Link> & links() const {return *links_;}
+	const std::map<int, std::string> & labels() const {return *labels_;}
+	const rtabmap::Transform & mapToOdom() const {return mapToOdom_;}
+	const rtabmap::Transform & lastLocalizationPose() const {return lastLocalizationPose_;}
+	float localRadius() const {return localRadius_;}
+
+private:
+	MapSnapshot();
+
+private:
+	unsigned long version_;
+	double stamp_;
+	boost::shared_ptr<const NodesSpatialIndex> nodesIndex_;
+	boost::shared_ptr<const std::multimap<int, rtabmap::Link> > links_;
+	boost::shared_ptr<const std::map<int, std::string> > labels_;
+	rtabmap::Transform mapToOdom_;
+	rtabmap::Transform lastLocalizationPose_;
+	float localRadius_;
+};
+
+/**
+ * Latest published snapshot. The mutex is only held while the pointer is
+ * copied, readers then use their snapshot without any lock.
+ */
+class MapSnapshotHolder
+{
+public:
+	void set(const MapSnapshot::ConstPtr & snapshot)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		snapshot_ = snapshot;
+	}
+	MapSnapshot::ConstPtr get() const
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		return snapshot_;
+	}
+private:
+	mutable boost::mutex mutex_;
+	MapSnapshot::ConstPtr snapshot_;
+};
+
+}
+
+#endif /* MAPSNAPSHOT_H_ */
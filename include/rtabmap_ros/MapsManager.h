@@ -35,6 +35,18 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <pcl/point_types.h>
 #include <ros/time.h>
 #include <ros/publisher.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <nav_msgs/OccupancyGrid.h>
+#include <map_msgs/OccupancyGridUpdate.h>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <set>
+#ifdef WITH_OCTOMAP_MSGS
+#include <octomap_msgs/Octomap.h>
+#endif
+#include "rtabmap_ros/VoxelCloudMap.h"
+#include "rtabmap_ros/CloudChunk.h"
 
 namespace rtabmap {
 class OctoMap;
@@ -50,12 +62,25 @@ public:
 	void init(ros::NodeHandle & nh, ros::NodeHandle & pnh, const std::string & name, bool usePublicNamespace);
 	void clear();
 	bool hasSubscribers() const;
+	// Some map topics have subscribers that didn't receive the latched map yet
+	bool hasUnlatchedSubscribers() const;
+	// True if the local grid of the node is cached (possibly evicted compressed)
+	bool isGridCached(int id) const;
 	void backwardCompatibilityParameters(ros::NodeHandle & pnh, rtabmap::ParametersMap & parameters) const;
 	void setParameters(const rtabmap::ParametersMap & parameters);
 	void set2DMap(const cv::Mat & map, float xMin, float yMin, float cellSize, const std::map<int, rtabmap::Transform> & poses, const rtabmap::Memory * memory = 0);
 
+	// Uncompress the local grids of the data (in parallel), this can be
+	// done without locking the maps before calling addToGridCache().
+	static void uncompressLocalGrids(std::vector<rtabmap::SensorData> & data);
+	// Add uncompressed local grids to cache, nodes already cached are ignored.
+	void addToGridCache(const std::vector<rtabmap::SensorData> & data);
+
+	// Nodes assembled in the maps: landmarks are removed, then nodes are
+	// filtered by map_filter_radius/map_filter_angle (the latest data, id 0,
+	// is kept). Same filter than the one used by updateMapCaches().
 	std::map<int, rtabmap::Transform> getFilteredPoses(
-			const std::map<int, rtabmap::Transform> & poses);
+			const std::map<int, rtabmap::Transform> & poses) const;
 
 	std::map<int, rtabmap::Transform> updateMapCaches(
 			const std::map<int, rtabmap::Transform> & poses,
@@ -64,6 +89,13 @@ public:
 			bool updateOctomap,
 			const std::map<int, rtabmap::Signature> & signatures = std::map<int, rtabmap::Signature>());
 
+	// Copy from memory the data of the nodes not already cached, so that
+	// updateMapCaches() can be called afterwards without memory access.
+	void loadUncachedSignatures(
+			const std::map<int, rtabmap::Transform> & poses,
+			const rtabmap::Memory * memory,
+			std::map<int, rtabmap::Signature> & signatures) const;
+
 	void publishMaps(
 			const std::map<int, rtabmap::Transform> & poses,
 			const ros::Time & stamp,
@@ -79,9 +111,129 @@ public:
 			float & yMin,
 			float & gridCellSize);
 
-	const rtabmap::OctoMap * getOctomap() const {return octomap_;}
+	// Chunks of the cloud map (cloud_chunk_size>0) at the level of detail
+	// requested, changed since sinceVersion and intersecting the region
+	// of interest (ignored if roiMin is not lower than roiMax). Returns
+	// the current version of the chunked cloud map.
+	unsigned int getCloudChunks(
+			const std::map<int, rtabmap::Transform> & poses,
+			int level,
+			const cv::Point3f & roiMin,
+			const cv::Point3f & roiMax,
+			unsigned int sinceVersion,
+			std::vector<rtabmap_ros::CloudChunk> & chunks);
+
+	// Offline only (see map_export tool): with octomap_async, the tree is
+	// modified by octomapThread_ without lock, use getOctomapMsg() instead.
+	const rtabmap::OctoMap * getOctomap() const;
+#ifdef WITH_OCTOMAP_MSGS
+	// Serialized octomap, cached until the tree changes. With
+	// octomap_async, wait for the update in progress.
+	bool getOctomapMsg(bool full, octomap_msgs::Octomap & msg);
+#endif
 	const rtabmap::OccupancyGrid * getOccupancyGrid() const {return occupancyGrid_;}
 
+	// Without init() (offline, nothing is published), map_parallel_update
+	// can be set directly.
+	void setParallelUpdate(bool enabled) {mapParallelUpdate_ = enabled;}
+	// Mutex locked by the caller around publishMaps(), also locked when
+	// the outputs skipped by their max rate are flushed (set before init()).
+	void setOutputsMutex(boost::mutex * mutex) {outputsMutex_ = mutex;}
+	// Voxelized ground and obstacle clouds of the local grids cached by
+	// updateMapCaches() (updateGrid or updateOctomap should have been
+	// true), without publishers (see map_export tool).
+	void getAssembledClouds(
+			const std::map<int, rtabmap::Transform> & poses,
+			pcl::PointCloud<pcl::PointXYZRGB> & ground,
+			pcl::PointCloud<pcl::PointXYZRGB> & obstacles);
+
+	// Approximated bytes used by each cache, "evictable" is the part that
+	// reduceCacheMemory() can release (local grids and local clouds).
+	void getMemoryUsage(std::map<std::string, unsigned long> & usage, unsigned long & evictable);
+	// Compress/remove the least recently used local grids and clouds
+	// until the local caches use less than maxBytes.
+	void reduceCacheMemory(size_t maxBytes);
+
+	// Persistent cache of the local grids and local clouds (see MapsManager.cpp
+	// for the format). databaseStamp identifies the database version the cache
+	// has been saved with, the cache is ignored on load if it differs. Nodes
+	// not in "ids" are not loaded.
+	bool saveCacheFile(const std::string & path, unsigned long long databaseStamp) const;
+	int loadCacheFile(const std::string & path, const std::set<int> & ids, unsigned long long databaseStamp);
+
+private:
+	void updateOctomapCache(const std::map<int, rtabmap::Transform> & poses);
+	// Get the local grid of a node, uncompressed if it has been evicted
+	// (it stays evicted). Returns false if the grid is not cached.
+	bool getGridMap(int id, std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> & grid);
+	// Evict least recently used local grids (kept compressed) and clouds
+	// if the cache is over map_cache_max_memory. The grids are also
+	// released from the occupancy grid cache, they are given back to it
+	// only while the occupancy grid is regenerated.
+	void limitCacheMemory();
+	bool occupancyGridRegenerationRequired(const std::map<int, rtabmap::Transform> & poses) const;
+	// Update incrementally the voxelized ground or obstacle cloud, returns the
+	// number of nodes added, moved or removed.
+	int updateVoxelCloud(
+			const std::map<int, rtabmap::Transform> & poses,
+			bool ground);
+	void publishClouds(
+			const std::map<int, rtabmap::Transform> & poses,
+			const ros::Time & stamp,
+			const std::string & mapFrameId);
+	bool hasCloudChunkSubscribers() const;
+	// Give a new version to chunks modified in ground and obstacle voxel maps,
+	// they are added to dirtyChunks
+	void updateCloudChunkVersions(std::set<unsigned long long> & dirtyChunks);
+	void getCloudChunk(
+			unsigned long long chunk,
+			int level,
+			rtabmap_ros::CloudChunk & msg) const;
+	void publishCloudChunks(
+			const std::set<unsigned long long> & dirtyChunks,
+			const ros::Time & stamp,
+			const std::string & mapFrameId);
+	// Outputs generated by publishMaps(), by publish function
+	enum Output {kOutputGrids=0, kOutputClouds, kOutputOctomap, kOutputCount};
+	bool hasOutputSubscribers(int output) const;
+	// Rate limit of the output: false if the output should be skipped
+	// for this update (it is then coalesced with the next one)
+	bool isOutputDue(int output, bool force, const ros::WallTime & now);
+	void publishOutput(
+			int output,
+			const std::map<int, rtabmap::Transform> & poses,
+			const ros::Time & stamp,
+			const std::string & mapFrameId);
+	// Latched state and subscriber counts of the output publishers. When the
+	// output has been skipped, subscriber counts are only decreased so that
+	// new subscribers are still detected on the next publish.
+	void updateOutputSubscribers(int output, bool published);
+	// Publish the outputs skipped by their max rate once they are due
+	void flushPendingOutputs(const ros::WallTimerEvent & event);
+	void octomapLoop();
+	void clearOctomap();
+	// Generate missing outputs for the current tree version (octomapMutex_ should be locked)
+	void generateOctomapOutputs(bool clouds, bool projection, bool binary, bool full);
+	void publishOctomap(
+			const std::map<int, rtabmap::Transform> & poses,
+			const ros::Time & stamp,
+			const std::string & mapFrameId);
+	void publishGrids(
+			const std::map<int, rtabmap::Transform> & poses,
+			const ros::Time & stamp,
+			const std::string & mapFrameId);
+	// Publish the tiles of a grid (grid_map or octomap_grid) that changed
+	// since the last published grid (last), returns false if the full grid
+	// should be published instead.
+	bool publishGridTiles(
+			const nav_msgs::OccupancyGrid & map,
+			const std::map<int, rtabmap::Transform> & poses,
+			const ros::Publisher & gridPub,
+			const ros::Publisher & updatesPub,
+			uint32_t previousSubscribers,
+			nav_msgs::OccupancyGrid & last,
+			std::map<int, rtabmap::Transform> & lastPoses);
+
 private:
 	// mapping stuff
 	bool cloudOutputVoxelized_;
@@ -90,14 +242,17 @@ private:
 	double mapFilterRadius_;
 	double mapFilterAngle_;
 	bool mapCacheCleanup_;
+	double mapCacheMaxMemory_; // MB
 	bool alwaysUpdateMap_;
 	bool scanEmptyRayTracing_;
+	bool mapParallelUpdate_;
 
 	ros::Publisher cloudMapPub_;
 	ros::Publisher cloudGroundPub_;
 	ros::Publisher cloudObstaclesPub_;
 	ros::Publisher projMapPub_;
 	ros::Publisher gridMapPub_;
+	ros::Publisher gridMapUpdatesPub_;
 	ros::Publisher gridProbMapPub_;
 	ros::Publisher scanMapPub_;
 	ros::Publisher octoMapPubBin_;
@@ -108,6 +263,7 @@ private:
 	ros::Publisher octoMapObstacleCloud_;
 	ros::Publisher octoMapEmptySpace_;
 	ros::Publisher octoMapProj_;
+	ros::Publisher octoMapProjUpdatesPub_;
 
 	std::map<int, rtabmap::Transform> assembledGroundPoses_;
 	std::map<int, rtabmap::Transform> assembledObstaclePoses_;
@@ -117,21 +273,125 @@ private:
 	rtabmap::FlannIndex assembledObstacleIndex_;
 	std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr > groundClouds_;
 	std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr > obstacleClouds_;
+	VoxelCloudMap groundVoxels_;
+	VoxelCloudMap obstacleVoxels_;
+
+	// With cloud_chunk_size>0, the voxelized cloud map is also published by
+	// chunks on cloud_map_chunks_lodN, only chunks changed are republished.
+	double cloudChunkSize_;
+	int cloudChunkLevels_;
+	std::vector<ros::Publisher> cloudChunkPubs_; // one per level of detail
+	std::vector<uint32_t> cloudChunkSubscribers_;
+	std::map<unsigned long long, unsigned int> cloudChunkVersions_;
+	unsigned int cloudChunkVersion_;
+	std::set<unsigned long long> cloudChunksUnpublished_; // versioned, not published yet on the topics
 
 	std::map<int, rtabmap::Transform> gridPoses_;
 	cv::Mat gridMap_;
 	std::map<int, std::pair< std::pair<cv::Mat, cv::Mat>, cv::Mat> > gridMaps_; // < <ground, obstacles>, empty cells >
 	std::map<int, cv::Point3f> gridMapsViewpoints_;
+	std::map<int, std::pair< std::pair<cv::Mat, cv::Mat>, cv::Mat> > gridMapsCompressed_; // evicted local grids
+	std::map<int, unsigned long> gridMapsAccess_; // last access of each node, for LRU eviction
+	unsigned long cacheAccessCount_;
+	unsigned long cacheHits_;
+	unsigned long cacheCompressedHits_;
+	unsigned long cacheMisses_;
+	unsigned long cacheEvictions_;
 
 	rtabmap::OccupancyGrid * occupancyGrid_;
 	bool gridUpdated_;
 
+	// With grid_map_tile_size>0, only the tiles that changed since the last
+	// published grid are sent on grid_map_updates.
+	int gridMapTileSize_;
+	double gridMapTileMaxRatio_;
+	nav_msgs::OccupancyGrid gridMapPublished_;
+	std::map<int, rtabmap::Transform> gridMapPublishedPoses_;
+	uint32_t gridMapSubscribers_;
+	// same for octomap_grid on octomap_grid_updates
+	nav_msgs::OccupancyGrid octoMapProjPublished_;
+	std::map<int, rtabmap::Transform> octoMapProjPublishedPoses_;
+	uint32_t octoMapProjSubscribers_;
+
 	rtabmap::OctoMap * octomap_;
 	int octomapTreeDepth_;
 	bool octomapUpdated_;
 
+	// Octomap outputs are generated once per tree version. With octomap_async,
+	// the tree is updated and the outputs generated on octomapThread_, the
+	// last outputs are published in the meantime.
+	struct OctomapOutputs
+	{
+		OctomapOutputs() :
+			version(0),
+			hasClouds(false),
+			hasProjection(false),
+			hasBinary(false),
+			hasFull(false)
+		{}
+		unsigned long version;
+		bool hasClouds;
+		bool hasProjection;
+		bool hasBinary;
+		bool hasFull;
+		sensor_msgs::PointCloud2 occupied;
+		sensor_msgs::PointCloud2 frontier;
+		sensor_msgs::PointCloud2 obstacles;
+		sensor_msgs::PointCloud2 ground;
+		sensor_msgs::PointCloud2 empty;
+		nav_msgs::OccupancyGrid projection;
+#ifdef WITH_OCTOMAP_MSGS
+		octomap_msgs::Octomap binary;
+		octomap_msgs::Octomap full;
+#endif
+	};
+	bool octomapAsync_;
+	unsigned long octomapVersion_;
+	boost::mutex octomapMutex_; // octomap_ and octomapVersion_
+	OctomapOutputs octomapOutputs_;
+	boost::mutex octomapOutputsMutex_;
+	std::map<void*, unsigned long> octomapPublishedVersions_;
+	boost::thread * octomapThread_;
+	bool octomapThreadRunning_;
+	bool octomapJobPending_;
+	bool octomapJobRunning_;
+	bool octomapJobUpdate_;
+	std::map<int, std::pair< std::pair<cv::Mat, cv::Mat>, cv::Mat> > octomapJobGrids_;
+	std::map<int, cv::Point3f> octomapJobViewpoints_;
+	std::map<int, rtabmap::Transform> octomapJobPoses_;
+	boost::mutex octomapJobMutex_;
+	boost::condition_variable octomapJobCondition_;
+	std::set<int> octomapSentNodes_; // nodes sent to octomapThread_
+
 	rtabmap::ParametersMap parameters_;
 
+	// Per output max publish rate (Hz, 0=each map update) and priority
+	// (lower is generated first, in the calling thread with map_parallel_update)
+	struct OutputSchedule
+	{
+		OutputSchedule() :
+			maxRate(0.0),
+			priority(0),
+			pending(false),
+			published(0),
+			skipped(0),
+			coalesced(0)
+		{}
+		double maxRate;
+		int priority;
+		ros::WallTime last;
+		bool pending; // updates have been skipped since last publish
+		unsigned long published;
+		unsigned long skipped;   // updates not published because of the rate
+		unsigned long coalesced; // publishes that included skipped updates
+	};
+	OutputSchedule outputSchedules_[kOutputCount];
+	boost::mutex * outputsMutex_;
+	ros::WallTimer outputsFlushTimer_;
+	std::map<int, rtabmap::Transform> pendingPoses_; // last update skipped by an output
+	ros::Time pendingStamp_;
+	std::string pendingMapFrameId_;
+
 	bool latching_;
 	std::map<void*, bool> latched_;
 };
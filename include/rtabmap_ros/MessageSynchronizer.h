@@ -0,0 +1,132 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MESSAGESYNCHRONIZER_H_
+#define MESSAGESYNCHRONIZER_H_
+
+#include <boost/shared_ptr.hpp>
+#include <deque>
+#include <vector>
+
+namespace rtabmap_ros {
+
+/**
+ * Synchronize any number of topics, the number of topics being known only
+ * at runtime. Messages are added with their stamp and synchronized sets
+ * (one message per topic) are taken with pop(), in stamp order.
+ *
+ * Exact sync matches messages with the same stamp on all topics. Approx
+ * sync uses the same algorithm as message_filters::sync_policies::ApproximateTime
+ * (without inter message bounds and age penalty): a set is published
+ * only when no message not received yet can make a set with a smaller
+ * interval. It can then wait for the next message of a topic.
+ *
+ * Synchronized sets are kept in a ring of queueSize preallocated slots
+ * reused by pop(), if sets are not taken fast enough the oldest one is
+ * dropped.
+ *
+ * Not thread-safe, callers receiving messages on many threads should lock.
+ */
+class MessageSynchronizer
+{
+public:
+	typedef boost::shared_ptr<void const> MessagePtr;
+
+public:
+	MessageSynchronizer();
+
+	/**
+	 * @param maxInterval with approx sync, maximum interval between the
+	 *        messages of a set, ignored if <= 0
+	 */
+	void init(int topics, int queueSize, bool approxSync, double maxInterval = 0.0);
+	int topics() const {return (int)queues_.size();}
+	void clear();
+
+	/**
+	 * Add a message. Messages older than the last one received on the
+	 * same topic are ignored.
+	 * @return false if the message has been ignored or if an old message
+	 *         has been dropped because the queue of the topic is full
+	 */
+	bool add(int topic, double stamp, const MessagePtr & msg);
+
+	/**
+	 * Take the oldest synchronized set.
+	 * @return false if no set is ready
+	 */
+	bool pop(std::vector<MessagePtr> & msgs, std::vector<double> & stamps);
+
+private:
+	struct Entry
+	{
+		Entry() : stamp(0.0) {}
+		Entry(double s, const MessagePtr & m) : stamp(s), msg(m) {}
+		double stamp;
+		MessagePtr msg;
+	};
+	struct Queue
+	{
+		Queue() : lastStamp(-1.0), dropped(false) {}
+		std::deque<Entry> msgs;
+		std::deque<Entry> past; // approx sync, moved out while searching the candidate
+		double lastStamp;
+		bool dropped;
+	};
+
+	void exactProcess();
+	void approxProcess();
+	void recover(int topic);
+	void deleteFront(int topic);
+	void moveFrontToPast(int topic);
+	void makeCandidate();
+	void publishCandidate();
+	std::vector<Entry> & pushReady();
+
+private:
+	std::vector<Queue> queues_;
+	int queueSize_;
+	bool approxSync_;
+	double maxInterval_;
+	std::vector<std::vector<Entry> > ready_; // ring of synchronized sets
+	size_t readyFront_;
+	size_t readySize_;
+	std::vector<size_t> matches_; // exact sync
+
+	// approx sync
+	int nonEmpty_;
+	std::vector<Entry> candidate_;
+	double candidateStart_;
+	double candidateEnd_;
+	int pivot_;
+	double pivotTime_;
+};
+
+} /* namespace rtabmap_ros */
+
+#endif /* MESSAGESYNCHRONIZER_H_ */
@@ -42,6 +42,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <opencv2/features2d/features2d.hpp>
 #include <cv_bridge/cv_bridge.h>
 
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
 #include <rtabmap/core/Transform.h>
 #include <rtabmap/core/Link.h>
 #include <rtabmap/core/Signature.h>
@@ -74,12 +77,38 @@ rtabmap::Transform transformFromPoseMsg(const geometry_msgs::Pose & msg, bool ig
 
 void toCvCopy(const rtabmap_ros::RGBDImage & image, cv_bridge::CvImagePtr & rgb, cv_bridge::CvImagePtr & depth);
 void toCvShare(const rtabmap_ros::RGBDImageConstPtr & image, cv_bridge::CvImageConstPtr & rgb, cv_bridge::CvImageConstPtr & depth);
+// Compressed images of all cameras (rgb and depth) are decoded in parallel
+void toCvShare(
+		const std::vector<rtabmap_ros::RGBDImageConstPtr> & images,
+		std::vector<cv_bridge::CvImageConstPtr> & rgbs,
+		std::vector<cv_bridge::CvImageConstPtr> & depths);
 void rgbdImageToROS(const rtabmap::SensorData & data, rtabmap_ros::RGBDImage & msg, const std::string & sensorFrameId);
 rtabmap::SensorData rgbdImageFromROS(const rtabmap_ros::RGBDImageConstPtr & image);
 
+// Depth compression: "png" (rtabmap::compressImage) or "rvl" (fast lossless
+// run-length/variable-length coding of 16UC1 depth, 32FC1 depth is saved in png).
+// The format used is set in msg.format. RVL data starts with a magic number,
+// a version and a byte order mark, uncompressDepthRVL() rejects data not matching them.
+void depthToCompressedMsg(const cv::Mat & depth, const std::string & format, sensor_msgs::CompressedImage & msg);
+// Uncompress depth saved with depthToCompressedMsg() (not jpg)
+cv::Mat depthFromCompressedMsg(const sensor_msgs::CompressedImage & msg);
+std::vector<unsigned char> compressDepthRVL(const cv::Mat & depth);
+cv::Mat uncompressDepthRVL(const std::vector<unsigned char> & bytes);
+
 // copy data
 void compressedMatToBytes(const cv::Mat & compressed, std::vector<unsigned char> & bytes);
 cv::Mat compressedMatFromBytes(const std::vector<unsigned char> & bytes, bool copy = true);
+// no copy: the returned matrix references bytes and keeps owner (e.g., the
+// message containing bytes) alive until the matrix is released. If owner is
+// null or OpenCV<3, data is copied.
+cv::Mat compressedMatFromBytes(const std::vector<unsigned char> & bytes, const boost::shared_ptr<const void> & owner);
+
+// Compressed rgb/depth of a RGBDImage that can be stored as is in
+// rtabmap::SensorData (jpeg/png 8-bit rgb, rtabmap's png depth), referencing
+// the message (see compressedMatFromBytes()). Empty if the format is not
+// compatible (the image should then be decoded and compressed again).
+cv::Mat compressedRgbForSensorData(const rtabmap_ros::RGBDImageConstPtr & image);
+cv::Mat compressedDepthForSensorData(const rtabmap_ros::RGBDImageConstPtr & image);
 
 void infoFromROS(const rtabmap_ros::Info & info, rtabmap::Statistics & stat);
 void infoToROS(const rtabmap::Statistics & stats, rtabmap_ros::Info & info);
@@ -93,6 +122,9 @@ void keypointToROS(const cv::KeyPoint & kpt, rtabmap_ros::KeyPoint & msg);
 std::vector<cv::KeyPoint> keypointsFromROS(const std::vector<rtabmap_ros::KeyPoint> & msg);
 void keypointsFromROS(const std::vector<rtabmap_ros::KeyPoint> & msg, std::vector<cv::KeyPoint> & kpts, int xShift=0);
 void keypointsToROS(const std::vector<cv::KeyPoint> & kpts, std::vector<rtabmap_ros::KeyPoint> & msg);
+// Packed binary format of NodeData::wordKptsPacked, optionally compressed
+void keypointsToBytes(const std::vector<cv::KeyPoint> & kpts, std::vector<unsigned char> & bytes, bool compress = false);
+std::vector<cv::KeyPoint> keypointsFromBytes(const std::vector<unsigned char> & bytes, bool compressed = false);
 
 rtabmap::GlobalDescriptor globalDescriptorFromROS(const rtabmap_ros::GlobalDescriptor & msg);
 void globalDescriptorToROS(const rtabmap::GlobalDescriptor & desc, rtabmap_ros::GlobalDescriptor & msg);
@@ -117,6 +149,9 @@ void point3fToROS(const cv::Point3f & pt, rtabmap_ros::Point3f & msg);
 std::vector<cv::Point3f> points3fFromROS(const std::vector<rtabmap_ros::Point3f> & msg, const rtabmap::Transform & transform = rtabmap::Transform());
 void points3fFromROS(const std::vector<rtabmap_ros::Point3f> & msg, std::vector<cv::Point3f> & points3, const rtabmap::Transform & transform = rtabmap::Transform());
 void points3fToROS(const std::vector<cv::Point3f> & pts, std::vector<rtabmap_ros::Point3f> & msg, const rtabmap::Transform & transform = rtabmap::Transform());
+// Packed binary format of NodeData::wordPtsPacked, optionally compressed
+void points3fToBytes(const std::vector<cv::Point3f> & pts, std::vector<unsigned char> & bytes, bool compress = false);
+std::vector<cv::Point3f> points3fFromBytes(const std::vector<unsigned char> & bytes, bool compressed = false);
 
 rtabmap::CameraModel cameraModelFromROS(
 		const sensor_msgs::CameraInfo & camInfo,
@@ -142,27 +177,86 @@ void mapDataFromROS(
 		std::map<int, rtabmap::Transform> & poses,
 		std::multimap<int, rtabmap::Link> & links,
 		std::map<int, rtabmap::Signature> & signatures,
-		rtabmap::Transform & mapToOdom);
+		rtabmap::Transform & mapToOdom,
+		const boost::shared_ptr<const void> & owner = boost::shared_ptr<const void>());
 void mapDataToROS(
 		const std::map<int, rtabmap::Transform> & poses,
 		const std::multimap<int, rtabmap::Link> & links,
 		const std::map<int, rtabmap::Signature> & signatures,
 		const rtabmap::Transform & mapToOdom,
-		rtabmap_ros::MapData & msg);
+		rtabmap_ros::MapData & msg,
+		int wordsPacking = 0,
+		int graphPacking = 0);
 
-void mapGraphFromROS(
+// Returns false (poses and links unchanged) if the packed fields are malformed.
+bool mapGraphFromROS(
 		const rtabmap_ros::MapGraph & msg,
 		std::map<int, rtabmap::Transform> & poses,
 		std::multimap<int, rtabmap::Link> & links,
 		rtabmap::Transform & mapToOdom);
+// graphPacking: 0=poses and links arrays, 1=packed, 2=packed and compressed
 void mapGraphToROS(
 		const std::map<int, rtabmap::Transform> & poses,
 		const std::multimap<int, rtabmap::Link> & links,
 		const rtabmap::Transform & mapToOdom,
-		rtabmap_ros::MapGraph & msg);
-
-rtabmap::Signature nodeDataFromROS(const rtabmap_ros::NodeData & msg);
-void nodeDataToROS(const rtabmap::Signature & signature, rtabmap_ros::NodeData & msg);
+		rtabmap_ros::MapGraph & msg,
+		int graphPacking = 0);
+
+// Move posesId, poses and links of msg to the packed fields (see
+// MapGraph::posesPacked). Poses are converted to float32 relative to the
+// first pose, so precision is kept for large maps.
+void mapGraphPack(rtabmap_ros::MapGraph & msg, bool compress = false);
+bool mapGraphIsPacked(const rtabmap_ros::MapGraph & msg);
+// Decode the packed fields of msg. Returns false if they are malformed.
+bool mapGraphUnpack(
+		const rtabmap_ros::MapGraph & msg,
+		std::vector<int> & posesId,
+		std::vector<geometry_msgs::Pose> & poses,
+		std::vector<rtabmap_ros::Link> & links);
+
+// Delta encoding of a graph: only poses added or moved more than
+// linearUpdate (m) / angularUpdate (rad) since they were last sent, new links
+// and removed poses/links are set in msg. referencePoses and referenceLinks are
+// the graph as known by the subscribers, they are updated accordingly.
+// msg.version and msg.baseVersion should be set by the caller.
+void mapGraphDeltaToROS(
+		const std::map<int, rtabmap::Transform> & poses,
+		const std::multimap<int, rtabmap::Link> & links,
+		const rtabmap::Transform & mapToOdom,
+		std::map<int, rtabmap::Transform> & referencePoses,
+		std::multimap<int, rtabmap::Link> & referenceLinks,
+		float linearUpdate,
+		float angularUpdate,
+		rtabmap_ros::MapGraph & msg,
+		int graphPacking = 0);
+// Apply a full or delta graph on poses and links previously received.
+// Returns false if msg is a delta not based on "version" (some messages
+// have been missed), a keyframe should then be requested with get_map_data2.
+// Also false if the packed fields are malformed: nothing is applied and
+// version is unchanged.
+bool mapGraphDeltaFromROS(
+		const rtabmap_ros::MapGraph & msg,
+		std::map<int, rtabmap::Transform> & poses,
+		std::multimap<int, rtabmap::Link> & links,
+		rtabmap::Transform & mapToOdom,
+		unsigned int & version);
+
+// If owner is set (e.g., the message containing msg), compressed data of
+// the signature references the message buffers instead of being copied.
+// The whole owner is then kept alive as long as the signature: don't set
+// it if the signature is cached for long and owner contains other nodes
+// (e.g., a MapData message), set it to the node message itself or copy.
+rtabmap::Signature nodeDataFromROS(const rtabmap_ros::NodeData & msg, const boost::shared_ptr<const void> & owner = boost::shared_ptr<const void>());
+// wordsPacking: 0=wordKpts/wordPts arrays, 1=packed (wordKptsPacked/wordPtsPacked),
+// 2=packed and compressed. Receivers support all formats.
+void nodeDataToROS(const rtabmap::Signature & signature, rtabmap_ros::NodeData & msg, int wordsPacking = 0);
+// Remove raw sensor data (images, scan, user data) and features of the node,
+// keeping its local occupancy grid, camera models and pose: enough for
+// MapsManager to assemble the maps.
+void stripNodeDataToLocalGrid(rtabmap_ros::NodeData & msg);
+// Same fields as nodeDataToROS() followed by stripNodeDataToLocalGrid(),
+// without converting the other data (e.g., mapDataGrids topic).
+void nodeLocalGridToROS(const rtabmap::Signature & signature, rtabmap_ros::NodeData & msg);
 
 rtabmap::Signature nodeInfoFromROS(const rtabmap_ros::NodeData & msg);
 void nodeInfoToROS(const rtabmap::Signature & signature, rtabmap_ros::NodeData & msg);
@@ -249,6 +343,65 @@ bool convertScanMsg(
 		double waitForTransform,
 		bool outputInFrameId = false);
 
+// Project the ranges of the scan in a single pass with cached per-beam
+// cos/sin tables (recomputed only when angle_min, angle_increment or the
+// number of beams change). Same points than laser_geometry without motion
+// compensation: NaN and ranges outside [range_min, range_max[ are removed.
+// Then one valid beam every downsamplingStep is kept, points outside
+// [rangeMin, rangeMax] (if >0) are removed and transform (if not null) is
+// applied. Returns the points in LaserScan format (kXY or kXYI).
+cv::Mat laserScan2dFromLaserScanMsg(
+		const sensor_msgs::LaserScan & msg,
+		const rtabmap::Transform & transform = rtabmap::Transform(),
+		int downsamplingStep = 1,
+		float rangeMin = 0.0f,
+		float rangeMax = 0.0f);
+
+// Project a depth image (16UC1 in mm or 32FC1 in m) directly in a PointCloud2
+// with x,y,z fields (and rgb if image is set, 8UC1 or 8UC3 bgr of the same
+// size than depth). The rays (u-cx)/fx and (v-cy)/fy are cached for each
+// camera model, decimation and image size, and rows are projected in
+// parallel. Same points than util3d::cloudFromDepth()/cloudFromDepthRGB():
+// invalid depths and depths outside [minDepth, maxDepth] (maxDepth<=0: no
+// limit) are set to NaN in the organized cloud, or removed if filterNaNs is
+// true (then the cloud is dense with height=1). Points are 16 bytes with rgb
+// at offset 12, which is not the memory layout of pcl::PointXYZRGB (32
+// bytes): use pcl::fromROSMsg() to convert, not a copy of the data.
+void depthToPointCloud2Msg(
+		const cv::Mat & depth,
+		const rtabmap::CameraModel & model,
+		int decimation,
+		float minDepth,
+		float maxDepth,
+		bool filterNaNs,
+		sensor_msgs::PointCloud2 & msg,
+		const cv::Mat & image = cv::Mat());
+
+// Same projection than depthToPointCloud2Msg() with filterNaNs=true, but in
+// a dense PCL cloud. If transform is set (e.g. camera to base frame), the
+// points are transformed in the same pass.
+void depthToPointCloud(
+		const cv::Mat & depth,
+		const rtabmap::CameraModel & model,
+		int decimation,
+		float minDepth,
+		float maxDepth,
+		pcl::PointCloud<pcl::PointXYZ> & cloud,
+		const rtabmap::Transform & transform = rtabmap::Transform());
+
+// Read the fields of the cloud directly in LaserScan format (XYZ, XYZI,
+// XYZRGB, with normals if available), removing NaN points and points
+// outside [rangeMin, rangeMax] (if >0) in a single pass. Points stay in
+// the sensor frame, localTransform is set in the scan. Falls back on
+// rtabmap::util3d::laserScanFromPointCloud() if fields are not float32.
+rtabmap::LaserScan laserScanFromPointCloud2(
+		const sensor_msgs::PointCloud2 & msg,
+		const rtabmap::Transform & localTransform = rtabmap::Transform::getIdentity(),
+		int maxPoints = 0,
+		float maxRange = 0.0f,
+		float rangeMin = 0.0f,
+		float rangeMax = 0.0f);
+
 bool convertScan3dMsg(
 		const sensor_msgs::PointCloud2 & scan3dMsg,
 		const std::string & frameId,
@@ -260,6 +413,20 @@ bool convertScan3dMsg(
 		int maxPoints = 0,
 		float maxRange = 0.0f);
 
+// Get all parameters under the namespace of the node handle in a
+// single request to the ROS master. Returns an empty struct on failure.
+XmlRpc::XmlRpcValue getParameterTree(const ros::NodeHandle & nh);
+
+// Value of "key" (can contain '/') in the parameter tree, converted to
+// string with the same precedence than successive getParam() calls for
+// string, bool, double then int (an int is converted as a double).
+// Returns false if the parameter is not set.
+bool getParameterFromTree(
+		XmlRpc::XmlRpcValue & tree,
+		const std::string & key,
+		std::string & value,
+		XmlRpc::XmlRpcValue::Type * type = 0);
+
 }
 
 #endif /* MSGCONVERSION_H_ */
@@ -0,0 +1,137 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef NODELETDIAGNOSTICS_H_
+#define NODELETDIAGNOSTICS_H_
+
+#include <ros/ros.h>
+#include <std_msgs/Header.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <rtabmap_ros/RollingPercentiles.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/function.hpp>
+#include <string>
+
+namespace rtabmap_ros {
+
+/**
+ * Publish on /diagnostics, every period, the status filled by a callback
+ * (called with the time elapsed since the previous status). Used by
+ * NodeletDiagnostics and by the synchronizer health of CommonDataSubscriber.
+ */
+class DiagnosticsPublisher
+{
+public:
+	typedef boost::function<void(diagnostic_msgs::DiagnosticStatus &, double)> StatusCallback;
+
+	void start(ros::NodeHandle & nh, double period, const StatusCallback & callback);
+	void stop();
+
+private:
+	void timerCallback(const ros::WallTimerEvent & event);
+
+private:
+	StatusCallback callback_;
+	ros::Publisher pub_;
+	ros::WallTimer timer_;
+	ros::WallTime lastTime_;
+};
+
+/**
+ * Performance statistics of a nodelet published on /diagnostics every
+ * "diagnostics_period" seconds (private parameter, 0 disables them):
+ * input and output rates, processing time percentiles of the callbacks,
+ * dropped inputs and latency between the input stamp and the output.
+ * Inputs are dropped by the nodelet itself (tickDrop()) or lost before the
+ * callback, detected by gaps in the sequence numbers of the input headers
+ * (subscriber queue full, synchronization). Recording a sample only
+ * updates a few counters, all methods are thread-safe.
+ */
+class NodeletDiagnostics
+{
+public:
+	NodeletDiagnostics();
+
+	void init(ros::NodeHandle & nh, ros::NodeHandle & pnh, const std::string & name);
+	bool enabled() const {return period_ > 0.0;}
+	double period() const {return period_;}
+
+	// An input (or a synchronized set, with the header of one of its messages) is received
+	void tickInput(const std_msgs::Header & header);
+	// Same without lost inputs detection (e.g., inputs are filtered before the callback)
+	void tickInput();
+	// An input is not processed (busy, throttled, no subscribers...)
+	void tickDrop(unsigned int count = 1);
+	// An output computed from an input with this stamp is published
+	void tickOutput(const ros::Time & inputStamp);
+	void addProcessingTime(double seconds);
+
+	// Processing time of the current scope (e.g., a callback)
+	class ScopedTimer
+	{
+	public:
+		ScopedTimer(NodeletDiagnostics & diagnostics) :
+			diagnostics_(diagnostics),
+			start_(diagnostics.enabled()?ros::WallTime::now():ros::WallTime())
+		{}
+		~ScopedTimer()
+		{
+			if(diagnostics_.enabled())
+			{
+				diagnostics_.addProcessingTime((ros::WallTime::now() - start_).toSec());
+			}
+		}
+	private:
+		NodeletDiagnostics & diagnostics_;
+		ros::WallTime start_;
+	};
+
+private:
+	void fillStatus(diagnostic_msgs::DiagnosticStatus & status, double period);
+
+private:
+	std::string name_;
+	double period_;
+	boost::mutex mutex_;
+	// since last diagnostics
+	unsigned long inputs_;
+	unsigned long outputs_;
+	unsigned long dropped_;
+	unsigned long lost_;
+	double latencySum_;
+	double latencyMax_;
+	double processingTimeMax_;
+	RollingPercentiles processingTimes_;
+	uint32_t lastSeq_;
+	unsigned long totalDropped_;
+	DiagnosticsPublisher publisher_;
+};
+
+}
+
+#endif /* NODELETDIAGNOSTICS_H_ */
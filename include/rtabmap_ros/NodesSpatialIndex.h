@@ -0,0 +1,86 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef NODESSPATIALINDEX_H_
+#define NODESSPATIALINDEX_H_
+
+#include <rtabmap/core/Transform.h>
+#include <map>
+#include <vector>
+
+namespace rtabmap_ros {
+
+/**
+ * Uniform hash grid of node positions for radius and nearest node
+ * queries. update() is incremental: only nodes added, moved or
+ * removed since the last call are changed in the grid.
+ */
+class NodesSpatialIndex
+{
+public:
+	NodesSpatialIndex(float cellSize = 1.0f);
+
+	float cellSize() const {return cellSize_;}
+	void clear();
+	size_t size() const {return poses_.size();}
+	const std::map<int, rtabmap::Transform> & poses() const {return poses_;}
+
+	// Returns number of nodes added, moved or removed.
+	int update(const std::map<int, rtabmap::Transform> & poses);
+
+	// Nodes at less than radius (3D) of position.
+	std::map<int, rtabmap::Transform> radiusSearch(
+			const rtabmap::Transform & position,
+			float radius,
+			int ignoredId = 0) const;
+
+	// Returns 0 if not found within maxRadius.
+	int nearest(const rtabmap::Transform & position, float maxRadius) const;
+
+private:
+	struct CellKey
+	{
+		CellKey(int x, int y, int z) : x(x), y(y), z(z) {}
+		bool operator<(const CellKey & k) const
+		{
+			return x<k.x || (x==k.x && (y<k.y || (y==k.y && z<k.z)));
+		}
+		int x, y, z;
+	};
+	CellKey key(const rtabmap::Transform & t) const;
+	void insert(int id, const rtabmap::Transform & pose);
+	void remove(int id, const rtabmap::Transform & pose);
+
+private:
+	float cellSize_;
+	std::map<int, rtabmap::Transform> poses_;
+	std::map<CellKey, std::vector<int> > cells_;
+};
+
+}
+
+#endif /* NODESSPATIALINDEX_H_ */
@@ -37,19 +37,28 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <std_srvs/Empty.h>
 #include <std_msgs/Header.h>
 #include <sensor_msgs/Imu.h>
+#include <nav_msgs/Odometry.h>
 
 #include <rtabmap_ros/ResetPose.h>
 #include <rtabmap/core/SensorData.h>
 #include <rtabmap/core/Parameters.h>
+#include <rtabmap/core/OdometryInfo.h>
+
+#include "rtabmap_ros/StampedRingBuffer.h"
+#include "rtabmap_ros/NodeletDiagnostics.h"
 
 #include <boost/thread.hpp>
+#include <list>
 
 namespace rtabmap {
 class Odometry;
+class Feature2D;
 }
 
 namespace rtabmap_ros {
 
+class StaticTransformCache;
+
 class OdometryROS : public nodelet::Nodelet
 {
 
@@ -80,7 +89,20 @@ protected:
 
 	virtual void flushCallbacks() = 0;
 	tf::TransformListener & tfListener() {return tfListener_;}
-	virtual void postProcessData(const rtabmap::SensorData & data, const std_msgs::Header & header) const {}
+	// Called after each update, pose is null if odometry is lost
+	virtual void postProcessData(
+			const rtabmap::SensorData & data,
+			const std_msgs::Header & header,
+			const rtabmap::Transform & pose,
+			const rtabmap::OdometryInfo & info) const {}
+
+	// Features extracted outside odometry_ are used as is by the visual
+	// registration. createFeatureExtractor() returns false if the
+	// odometry strategy cannot use them.
+	bool createFeatureExtractor();
+	void extractFeatures(rtabmap::SensorData & data) const;
+	// With pipeline_depth>0, processData() extracts the features itself
+	int pipelineDepth() const {return pipelineDepth_;}
 
 private:
 	void warningLoop(const std::string & subscribedTopicsMsg, bool approxSync);
@@ -89,7 +111,24 @@ private:
 	virtual void updateParameters(rtabmap::ParametersMap & parameters) {}
 
 	void callbackIMU(const sensor_msgs::ImuConstPtr& msg);
+	void callbackGuessOdom(const nav_msgs::OdometryConstPtr& msg);
+	rtabmap::Transform lookupGuess(const ros::Time & stamp);
 	void reset(const rtabmap::Transform & pose = rtabmap::Transform::getIdentity());
+	void processDataImpl(rtabmap::SensorData & data, const std_msgs::Header & header);
+	void pipelineLoop();
+	bool dropFrame(const rtabmap::SensorData & data, const std_msgs::Header & header);
+	void publishOdomInfo(
+			const rtabmap::OdometryInfo & info,
+			const std_msgs::Header & header,
+			int framesDropped,
+			float effectiveRate);
+	void publishAuxiliaryOutputs(
+			const rtabmap::OdometryInfo & info,
+			const rtabmap::SensorData & data,
+			const std_msgs::Header & header,
+			const rtabmap::Transform & pose,
+			const std::vector<cv::Point3f> & lastFrameWords3);
+	void auxLoop();
 
 private:
 	rtabmap::Odometry * odometry_;
@@ -112,6 +151,7 @@ private:
 	rtabmap::ParametersMap parameters_;
 
 	ros::Publisher odomPub_;
+	NodeletDiagnostics diagnostics_;
 	ros::Publisher odomInfoPub_;
 	ros::Publisher odomInfoLitePub_;
 	ros::Publisher odomLocalMap_;
@@ -128,6 +168,7 @@ private:
 	ros::ServiceServer setLogErrorSrv_;
 	tf2_ros::TransformBroadcaster tfBroadcaster_;
 	tf::TransformListener tfListener_;
+	StaticTransformCache * tfStaticCache_; // tf_static_cache
 	ros::Subscriber imuSub_;
 
 	bool paused_;
@@ -144,8 +185,67 @@ private:
 	int odomStrategy_;
 	bool waitIMUToinit_;
 	bool imuProcessed_;
-	std::map<double, rtabmap::IMU> imus_;
+	StampedRingBuffer<rtabmap::IMU> imus_;
 	std::pair<rtabmap::SensorData, std_msgs::Header > bufferedData_;
+	boost::mutex processMutex_; // odometry_ and its state
+
+	// With pipeline_depth>0, registration is done on pipelineThread_ while
+	// the next frames are converted (and their features extracted) on the
+	// callback thread. At most pipeline_depth frames wait to be processed.
+	int pipelineDepth_;
+	rtabmap::Feature2D * pipelineFeatures_;
+	rtabmap::ParametersMap pipelineFeaturesParameters_;
+	boost::thread * pipelineThread_;
+	bool pipelineRunning_;
+	std::list<std::pair<rtabmap::SensorData, std_msgs::Header> > pipelineQueue_;
+	boost::mutex pipelineMutex_;
+	boost::condition_variable pipelineCondition_;
+
+	// With publish_aux_async, odom_local_map, odom_local_scan_map,
+	// odom_last_frame and odom_rgbd_image are published on auxThread_. Only
+	// the latest frame is published if it is late. odom_info and
+	// odom_info_lite are always published with odom.
+	struct AuxFrame
+	{
+		AuxFrame() : valid(false) {}
+		rtabmap::OdometryInfo info;
+		rtabmap::SensorData data;
+		std_msgs::Header header;
+		rtabmap::Transform pose;
+		std::vector<cv::Point3f> lastFrameWords3;
+		bool valid;
+	};
+	AuxFrame auxFrame_;
+	boost::thread * auxThread_;
+	bool auxRunning_;
+	boost::mutex auxMutex_;
+	boost::condition_variable auxCondition_;
+
+	// With adaptive_frame_dropping, frames are dropped when they arrive
+	// faster than they can be processed or when they are late (newer
+	// frames are waiting), while keeping at least min_update_rate.
+	bool adaptiveFrameDropping_;
+	double minUpdateRate_;
+	double processingTime_; // moving average (s)
+	// Minimum transport latency (s) of the frames received in the current
+	// and previous windows, so that a lasting latency rise (clock drift,
+	// slower transport) becomes the new baseline after two windows.
+	double minLatency_;
+	double minLatencyPrevious_;
+	double minLatencyWindowStamp_;
+	double lastAdmittedStamp_;
+	int framesDropped_;
+	unsigned long framesDroppedTotal_;
+	float effectiveRate_; // moving average (Hz)
+	boost::mutex frameDropMutex_;
+
+	// With guess_from_odom_topic, the guess_frame_id -> frame_id poses are
+	// taken from the "guess_odom" topic and interpolated (or extrapolated
+	// up to wait_for_transform_duration) at the frame stamp without
+	// waiting for TF. TF is used when the buffer cannot answer.
+	ros::Subscriber guessOdomSub_;
+	StampedRingBuffer<rtabmap::Transform> guessOdoms_;
+	boost::mutex guessOdomsMutex_;
 };
 
 }
@@ -0,0 +1,96 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef PLANCACHE_H_
+#define PLANCACHE_H_
+
+#include <rtabmap/core/Transform.h>
+#include <rtabmap_ros/Path.h>
+#include <map>
+#include <vector>
+
+namespace rtabmap_ros {
+
+/**
+ * Plans between nodes kept for a graph version (incremented by the caller
+ * when links are added or the graph is reset). A cached plan is repaired
+ * when only some of its nodes moved after an optimization: the poses of
+ * the moved nodes are updated in the path and its message, otherwise
+ * (too many nodes moved or a node is not in the graph anymore) the plan is
+ * removed and should be recomputed. Least recently used plans are
+ * removed when the cache is full.
+ */
+class PlanCache
+{
+public:
+	struct Plan
+	{
+		std::vector<std::pair<int, rtabmap::Transform> > path;
+		rtabmap::Transform transformToGoal;
+		rtabmap_ros::Path msg; // poses of path, then the goal if transformToGoal is not identity
+	};
+
+public:
+	PlanCache(int maxPlans = 16, float maxRepairRatio = 0.2f);
+
+	void setMaxPlans(int maxPlans);
+	void setMaxRepairRatio(float ratio) {maxRepairRatio_ = ratio;}
+	bool enabled() const {return maxPlans_ > 0;}
+	void clear();
+	size_t size() const {return plans_.size();}
+
+	// Returns 0 if not cached or cannot be repaired.
+	const Plan * get(int startId, int goalId, unsigned long graphVersion, const std::map<int, rtabmap::Transform> & poses);
+	void add(int startId, int goalId, unsigned long graphVersion, const Plan & plan);
+
+	unsigned long hits() const {return hits_;}
+	unsigned long repairs() const {return repairs_;}
+	unsigned long misses() const {return misses_;}
+
+private:
+	struct Entry
+	{
+		Plan plan;
+		unsigned long graphVersion;
+		unsigned long lastUsed;
+	};
+	bool repair(Plan & plan, const std::map<int, rtabmap::Transform> & poses);
+
+private:
+	int maxPlans_;
+	float maxRepairRatio_;
+	std::map<std::pair<int, int>, Entry> plans_;
+	unsigned long useCount_;
+	unsigned long hits_;
+	unsigned long repairs_;
+	unsigned long misses_;
+};
+
+}
+
+#endif /* PLANCACHE_H_ */
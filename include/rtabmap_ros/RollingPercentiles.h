@@ -0,0 +1,108 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef ROLLINGPERCENTILES_H_
+#define ROLLINGPERCENTILES_H_
+
+#include <vector>
+#include <algorithm>
+
+namespace rtabmap_ros {
+
+/**
+ * Keeps the latest samples in a fixed-size window to compute
+ * rolling percentiles (e.g., p50/p95/p99 of a processing time).
+ * Adding a sample is O(1), percentiles are computed on request.
+ */
+class RollingPercentiles
+{
+public:
+	RollingPercentiles(size_t windowSize = 100) :
+		samples_(windowSize>0?windowSize:1),
+		index_(0),
+		count_(0)
+	{}
+
+	void add(float value)
+	{
+		samples_[index_] = value;
+		index_ = (index_+1) % samples_.size();
+		if(count_ < samples_.size())
+		{
+			++count_;
+		}
+	}
+
+	size_t size() const {return count_;}
+	size_t windowSize() const {return samples_.size();}
+	void clear() {index_ = 0; count_ = 0;}
+
+	// ratio in [0,1], e.g. 0.95 for p95
+	float percentile(float ratio) const
+	{
+		std::vector<float> sorted(samples_.begin(), samples_.begin()+count_);
+		return percentile(sorted, ratio);
+	}
+
+	// Compute all requested percentiles with one copy of the window.
+	std::vector<float> percentiles(const std::vector<float> & ratios) const
+	{
+		return ratios.empty()?std::vector<float>():percentiles(&ratios[0], ratios.size());
+	}
+	std::vector<float> percentiles(const float * ratios, size_t count) const
+	{
+		std::vector<float> sorted(samples_.begin(), samples_.begin()+count_);
+		std::vector<float> output(count, 0.0f);
+		for(size_t i=0; i<count; ++i)
+		{
+			output[i] = percentile(sorted, ratios[i]);
+		}
+		return output;
+	}
+
+private:
+	static float percentile(std::vector<float> & samples, float ratio)
+	{
+		if(samples.empty())
+		{
+			return 0.0f;
+		}
+		ratio = ratio<0.0f?0.0f:ratio>1.0f?1.0f:ratio;
+		std::vector<float>::iterator nth = samples.begin() + (size_t)(ratio*float(samples.size()-1) + 0.5f);
+		std::nth_element(samples.begin(), nth, samples.end());
+		return *nth;
+	}
+
+private:
+	std::vector<float> samples_;
+	size_t index_;
+	size_t count_;
+};
+
+}
+
+#endif /* ROLLINGPERCENTILES_H_ */
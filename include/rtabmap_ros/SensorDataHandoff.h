@@ -0,0 +1,79 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef SENSORDATAHANDOFF_H_
+#define SENSORDATAHANDOFF_H_
+
+#include <ros/time.h>
+#include <rtabmap/core/SensorData.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <list>
+#include <map>
+#include <string>
+
+namespace rtabmap_ros {
+
+/**
+ * Process-wide handoff of SensorData between nodelets loaded in the same
+ * nodelet manager. A consumer (rtabmap) registers the topic it subscribes
+ * to with the frame in which it expects the data. When all subscribers of
+ * a topic are registered consumers, the producer (odometry) puts its
+ * SensorData (images, camera models, keypoints, 3D words and descriptors
+ * already computed) here and publishes only the headers on the topic;
+ * the consumer gets the data back with the stamp of the message. When
+ * there are other subscribers (e.g., in another process), the full
+ * message is published as before.
+ */
+class SensorDataHandoff
+{
+public:
+	static SensorDataHandoff & instance();
+
+	void addConsumer(const std::string & topic, const std::string & frameId);
+	void removeConsumer(const std::string & topic, const std::string & frameId);
+	// Consumers of this topic in the process expecting data in frameId
+	int consumers(const std::string & topic, const std::string & frameId) const;
+
+	// Keep the data for the consumers (only the latest ones are kept)
+	void put(const std::string & topic, const ros::Time & stamp, const boost::shared_ptr<const rtabmap::SensorData> & data);
+	// @return null if not found
+	boost::shared_ptr<const rtabmap::SensorData> get(const std::string & topic, const ros::Time & stamp) const;
+
+private:
+	SensorDataHandoff() {}
+
+private:
+	mutable boost::mutex mutex_;
+	std::map<std::pair<std::string, std::string>, int> consumers_; // <topic, frame>
+	std::map<std::string, std::list<std::pair<ros::Time, boost::shared_ptr<const rtabmap::SensorData> > > > data_;
+};
+
+}
+
+#endif /* SENSORDATAHANDOFF_H_ */
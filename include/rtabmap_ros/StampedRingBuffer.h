@@ -0,0 +1,198 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef STAMPEDRINGBUFFER_H_
+#define STAMPEDRINGBUFFER_H_
+
+#include <vector>
+#include <cstddef>
+
+namespace rtabmap_ros {
+
+/**
+ * Preallocated circular buffer of values sorted by stamp. Values are
+ * normally pushed in chronological order (O(1)); out-of-order values are
+ * inserted at their place. When the buffer is full, the oldest value is
+ * overwritten and the overflow counter is incremented. Stamp lookups are
+ * binary searches. Index 0 is always the oldest value.
+ * Not thread-safe.
+ */
+template<typename T>
+class StampedRingBuffer
+{
+public:
+	StampedRingBuffer(size_t capacity = 1000) :
+		stamps_(capacity>0?capacity:1),
+		values_(capacity>0?capacity:1),
+		head_(0),
+		size_(0),
+		overflows_(0)
+	{}
+
+	size_t capacity() const {return stamps_.size();}
+	size_t size() const {return size_;}
+	bool empty() const {return size_ == 0;}
+	bool full() const {return size_ == stamps_.size();}
+	// number of values dropped because the buffer was full
+	unsigned long overflows() const {return overflows_;}
+	// bytes preallocated (memory owned by the values themselves is not included)
+	size_t memoryUsage() const {return stamps_.capacity()*sizeof(double) + values_.capacity()*sizeof(T);}
+
+	void clear()
+	{
+		head_ = 0;
+		size_ = 0;
+	}
+
+	/**
+	 * @return false if a value with the same stamp already exists (it is not replaced)
+	 */
+	bool push(double stamp, const T & value)
+	{
+		if(size_ == 0 || stamp > lastStamp())
+		{
+			if(full())
+			{
+				popFront();
+				++overflows_;
+			}
+			size_t i = physical(size_++);
+			stamps_[i] = stamp;
+			values_[i] = value;
+			return true;
+		}
+
+		size_t pos = lowerBound(stamp);
+		if(pos < size_ && this->stamp(pos) == stamp)
+		{
+			return false;
+		}
+		if(full())
+		{
+			if(pos == 0)
+			{
+				// older than everything we have
+				++overflows_;
+				return true;
+			}
+			popFront();
+			++overflows_;
+			--pos;
+		}
+		++size_;
+		for(size_t j=size_-1; j>pos; --j)
+		{
+			stamps_[physical(j)] = stamps_[physical(j-1)];
+			values_[physical(j)] = values_[physical(j-1)];
+		}
+		stamps_[physical(pos)] = stamp;
+		values_[physical(pos)] = value;
+		return true;
+	}
+
+	void popFront(size_t n = 1)
+	{
+		if(n >= size_)
+		{
+			clear();
+		}
+		else
+		{
+			head_ = physical(n);
+			size_ -= n;
+		}
+	}
+
+	double stamp(size_t i) const {return stamps_[physical(i)];}
+	const T & value(size_t i) const {return values_[physical(i)];}
+	T & value(size_t i) {return values_[physical(i)];}
+	double firstStamp() const {return stamp(0);}
+	double lastStamp() const {return stamp(size_-1);}
+
+	/**
+	 * @return index of the first value with stamp >= "stamp", size() if none
+	 */
+	size_t lowerBound(double stamp) const
+	{
+		size_t first = 0;
+		size_t count = size_;
+		while(count > 0)
+		{
+			size_t step = count / 2;
+			if(this->stamp(first + step) < stamp)
+			{
+				first += step + 1;
+				count -= step + 1;
+			}
+			else
+			{
+				count = step;
+			}
+		}
+		return first;
+	}
+
+	/**
+	 * Find values around "stamp" for interpolation.
+	 * @return false if stamp is outside the buffer, otherwise
+	 *         stamp(before) <= stamp <= stamp(after) (before==after on exact match)
+	 */
+	bool bracket(double stamp, size_t & before, size_t & after) const
+	{
+		size_t i = lowerBound(stamp);
+		if(i == size_)
+		{
+			return false;
+		}
+		if(this->stamp(i) == stamp)
+		{
+			before = after = i;
+			return true;
+		}
+		if(i == 0)
+		{
+			return false;
+		}
+		before = i-1;
+		after = i;
+		return true;
+	}
+
+private:
+	size_t physical(size_t i) const {return (head_ + i) % stamps_.size();}
+
+private:
+	std::vector<double> stamps_;
+	std::vector<T> values_;
+	size_t head_;
+	size_t size_;
+	unsigned long overflows_;
+};
+
+}
+
+#endif /* STAMPEDRINGBUFFER_H_ */
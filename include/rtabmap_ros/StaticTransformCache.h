@@ -0,0 +1,89 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef STATICTRANSFORMCACHE_H_
+#define STATICTRANSFORMCACHE_H_
+
+#include <ros/ros.h>
+#include <tf/transform_listener.h>
+#include <tf2_msgs/TFMessage.h>
+#include <rtabmap/core/Transform.h>
+#include <boost/thread/mutex.hpp>
+#include <map>
+#include <string>
+
+namespace rtabmap_ros {
+
+/**
+ * Cache of transforms between frames linked only by static transforms
+ * (published on /tf_static), owned by the nodelet that enabled it. While
+ * it exists, rtabmap_ros::getTransform() returns cached static transforms
+ * directly for lookups done with the listener of that nodelet, instead of
+ * waiting on the listener. Lookups with the listeners of other nodelets
+ * of the same process are not affected. Lookups between frames linked by
+ * at least one dynamic transform are not cached.
+ */
+class StaticTransformCache
+{
+public:
+	// Subscribe to /tf_static with nh, the cache should be deleted before listener
+	StaticTransformCache(ros::NodeHandle & nh, const tf::TransformListener & listener);
+	~StaticTransformCache();
+
+	/**
+	 * @return transform targetFrame <- sourceFrame if all transforms between
+	 *         them are static, null otherwise
+	 */
+	rtabmap::Transform lookup(
+			const std::string & targetFrame,
+			const std::string & sourceFrame);
+
+	/**
+	 * Lookup in the cache created with this listener, if any.
+	 * @return null if there is no cache for this listener or if the
+	 *         transform is not static
+	 */
+	static rtabmap::Transform lookup(
+			const std::string & targetFrame,
+			const std::string & sourceFrame,
+			const tf::TransformListener & listener);
+
+private:
+	void callback(const tf2_msgs::TFMessageConstPtr & msg);
+	bool isStatic(const std::string & targetFrame, const std::string & sourceFrame) const;
+
+private:
+	const tf::TransformListener & listener_;
+	ros::Subscriber sub_;
+	boost::mutex mutex_;
+	std::map<std::string, std::string> staticParents_; // child -> parent
+	std::map<std::pair<std::string, std::string>, rtabmap::Transform> transforms_;
+};
+
+}
+
+#endif /* STATICTRANSFORMCACHE_H_ */
@@ -0,0 +1,92 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef STEREOCLOUDGENERATOR_H_
+#define STEREOCLOUDGENERATOR_H_
+
+#include <rtabmap/core/StereoCameraModel.h>
+#include <rtabmap/core/Parameters.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <opencv2/core/core.hpp>
+#include <vector>
+
+namespace rtabmap_ros {
+
+/**
+ * Cloud from rectified stereo images: the images are decimated before
+ * matching, cropped to the region of interest, then the disparity
+ * (StereoBM parameters, see rtabmap::util2d::disparityFromStereoImages())
+ * is computed by horizontal stripes in parallel, each stripe being
+ * converted to points right after its disparity. Stripes are matched with
+ * blockSize/2+1 extra rows on each side, so that the matching window of
+ * the rows at stripe borders sees the same neighborhood than on the full
+ * image. The organized cloud and the image buffers are reused between
+ * frames, the disparity of each stripe is allocated by
+ * rtabmap::util2d::disparityFromStereoImages(). Not thread-safe.
+ */
+class StereoCloudGenerator
+{
+public:
+	StereoCloudGenerator();
+
+	void setParameters(const rtabmap::ParametersMap & stereoParameters);
+	void setStripes(int stripes) {stripes_ = stripes>0?stripes:1;}
+	int stripes() const {return stripes_;}
+
+	/**
+	 * @param left mono8 or bgr8
+	 * @param right mono8
+	 * @param roiRatios [left, right, top, bottom] ratios of the image removed
+	 * @param indices valid points of the returned organized cloud
+	 */
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr generate(
+			const cv::Mat & left,
+			const cv::Mat & right,
+			const rtabmap::StereoCameraModel & model,
+			int decimation,
+			float maxDepth,
+			float minDepth,
+			const std::vector<float> & roiRatios,
+			std::vector<int> & indices);
+
+private:
+	rtabmap::ParametersMap parameters_;
+	int stripes_;
+	int overlap_; // rows, blockSize/2+1
+	int maxDisparity_; // columns
+	cv::Mat leftBuffer_;
+	cv::Mat rightBuffer_;
+	cv::Mat leftGrayBuffer_;
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_;
+	std::vector<std::vector<int> > stripeIndices_;
+};
+
+}
+
+#endif /* STEREOCLOUDGENERATOR_H_ */
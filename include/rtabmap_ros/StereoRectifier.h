@@ -0,0 +1,93 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef STEREORECTIFIER_H_
+#define STEREORECTIFIER_H_
+
+#include <sensor_msgs/CameraInfo.h>
+#include <rtabmap/core/StereoCameraModel.h>
+#include <rtabmap/core/Transform.h>
+#include <rtabmap_ros/ImageBufferPool.h>
+#include <opencv2/core/core.hpp>
+#include <vector>
+
+namespace rtabmap_ros {
+
+/**
+ * Rectifies raw stereo images with remap tables computed once per
+ * calibration. The tables are recomputed only when the content of the
+ * camera_info messages (or the stereo transform) changes. Rectified
+ * images are written in recycled buffers when the previous outputs are
+ * not referenced anymore. Not thread-safe.
+ */
+class StereoRectifier
+{
+public:
+	StereoRectifier();
+
+	/**
+	 * @return false if the calibration cannot be used for rectification
+	 */
+	bool update(
+			const sensor_msgs::CameraInfo & leftCamInfo,
+			const sensor_msgs::CameraInfo & rightCamInfo,
+			const rtabmap::Transform & localTransform,
+			const rtabmap::Transform & stereoTransform = rtabmap::Transform());
+
+	// Model of the rectified images, valid after update() returned true
+	const rtabmap::StereoCameraModel & rectifiedModel() const {return rectifiedModel_;}
+
+	void rectify(
+			const cv::Mat & left,
+			const cv::Mat & right,
+			cv::Mat & leftRectified,
+			cv::Mat & rightRectified);
+
+private:
+	bool sameCalibration(
+			const sensor_msgs::CameraInfo & leftCamInfo,
+			const sensor_msgs::CameraInfo & rightCamInfo,
+			const rtabmap::Transform & stereoTransform) const;
+
+private:
+	sensor_msgs::CameraInfo leftCamInfo_;
+	sensor_msgs::CameraInfo rightCamInfo_;
+	rtabmap::Transform stereoTransform_;
+	bool valid_;
+	cv::Mat leftMap1_;
+	cv::Mat leftMap2_;
+	cv::Mat rightMap1_;
+	cv::Mat rightMap2_;
+	rtabmap::StereoCameraModel rectifiedModel_;
+	MatBufferPool leftBuffers_; // rectified images, for frames still in use downstream
+	MatBufferPool rightBuffers_;
+};
+
+}
+
+#endif /* STEREORECTIFIER_H_ */
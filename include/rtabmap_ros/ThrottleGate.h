@@ -0,0 +1,91 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef THROTTLEGATE_H_
+#define THROTTLEGATE_H_
+
+#include <ros/ros.h>
+#include <std_msgs/Empty.h>
+#include <rtabmap_ros/Info.h>
+#include <rtabmap_ros/OdomInfo.h>
+#include <boost/thread/mutex.hpp>
+#include <string>
+
+namespace rtabmap_ros {
+
+/**
+ * Rate decision of the throttle nodelets, based on the input stamps so
+ * that it can be taken on each input before synchronization (and before
+ * any conversion). With "feedback" set, the output period follows the
+ * consumer:
+ *  - "odom_info": processing time of odometry (OdomInfo::timeEstimation),
+ *  - "info": processing time of rtabmap (Info statistics "Timing/Total/ms"),
+ *  - "ready": a frame is forwarded only after the previous one has been
+ *    acknowledged by a std_msgs/Empty message on "ready" (or after
+ *    "ready_timeout" seconds).
+ * Parameters "rate" (max rate, 0=unlimited), "feedback", "feedback_margin"
+ * and "ready_timeout" are read from the private node handle.
+ */
+class ThrottleGate
+{
+public:
+	ThrottleGate();
+
+	void init(ros::NodeHandle & nh, ros::NodeHandle & pnh, const std::string & name);
+
+	// Could a frame with this stamp be forwarded? Thread-safe.
+	bool accept(const ros::Time & stamp) const;
+
+	// Same as accept(), but the frame is considered forwarded if true is returned.
+	bool forward(const ros::Time & stamp);
+
+	double rate() const {return rate_;}
+
+private:
+	bool acceptImpl(const ros::Time & stamp) const;
+	void processingTime(double seconds);
+	void odomInfoCallback(const rtabmap_ros::OdomInfoConstPtr & msg);
+	void infoCallback(const rtabmap_ros::InfoConstPtr & msg);
+	void readyCallback(const std_msgs::EmptyConstPtr & msg);
+
+private:
+	mutable boost::mutex mutex_;
+	double rate_;
+	std::string feedback_;
+	double margin_;
+	double readyTimeout_;
+	double processingTime_; // filtered, in seconds
+	bool waitingReady_;
+	ros::Time lastForwardStamp_;
+	ros::WallTime lastForwardTime_;
+	ros::Subscriber feedbackSub_;
+};
+
+}
+
+#endif /* THROTTLEGATE_H_ */
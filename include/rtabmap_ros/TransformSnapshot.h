@@ -0,0 +1,158 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TRANSFORMSNAPSHOT_H_
+#define TRANSFORMSNAPSHOT_H_
+
+#include <rtabmap/core/Transform.h>
+#include <boost/atomic.hpp>
+#include <boost/thread/thread.hpp>
+#include <cstring>
+
+namespace rtabmap_ros {
+
+/**
+ * Single writer / multiple readers snapshot of a transform, protected
+ * by a sequence lock: readers never block the writer and never wait on
+ * a mutex, they only retry if the transform was updated while copying it.
+ * Only plain floats are stored so that a torn copy is always harmless.
+ * Concurrent calls to set() must be serialized by the caller.
+ */
+class TransformSnapshot
+{
+public:
+	TransformSnapshot() :
+		sequence_(0),
+		stamp_(0.0),
+		previousStamp_(0.0)
+	{
+		setIdentity(current_);
+		setIdentity(previous_);
+	}
+
+	/**
+	 * @param keepHistory if false, the previous transform is also reset to
+	 *        this one (no extrapolation until the next update)
+	 */
+	void set(const rtabmap::Transform & transform, double stamp, bool keepHistory = true)
+	{
+		unsigned int sequence = sequence_.load(boost::memory_order_relaxed);
+		sequence_.store(sequence+1, boost::memory_order_relaxed);
+		boost::atomic_thread_fence(boost::memory_order_release);
+
+		if(keepHistory)
+		{
+			memcpy(previous_, current_, sizeof(current_));
+			previousStamp_ = stamp_;
+		}
+		if(transform.isNull())
+		{
+			setIdentity(current_);
+		}
+		else
+		{
+			memcpy(current_, transform.data(), sizeof(current_));
+		}
+		if(!keepHistory)
+		{
+			memcpy(previous_, current_, sizeof(current_));
+			previousStamp_ = stamp;
+		}
+		stamp_ = stamp;
+
+		sequence_.store(sequence+2, boost::memory_order_release);
+	}
+
+	/**
+	 * Latest transform. If extrapolate is true and time is after the latest
+	 * update, the motion between the two latest updates is applied
+	 * proportionally to the elapsed time, up to one update period.
+	 */
+	rtabmap::Transform get(double time = 0.0, bool extrapolate = false) const
+	{
+		float current[12];
+		float previous[12];
+		double stamp;
+		double previousStamp;
+		for(;;)
+		{
+			unsigned int sequence = sequence_.load(boost::memory_order_acquire);
+			if(sequence & 1)
+			{
+				boost::this_thread::yield();
+				continue;
+			}
+			memcpy(current, current_, sizeof(current));
+			memcpy(previous, previous_, sizeof(previous));
+			stamp = stamp_;
+			previousStamp = previousStamp_;
+			boost::atomic_thread_fence(boost::memory_order_acquire);
+			if(sequence == sequence_.load(boost::memory_order_relaxed))
+			{
+				break;
+			}
+		}
+
+		rtabmap::Transform t = toTransform(current);
+		if(extrapolate && stamp > previousStamp && previousStamp > 0.0 && time > stamp)
+		{
+			float ratio = float((time - stamp) / (stamp - previousStamp));
+			if(ratio > 1.0f)
+			{
+				ratio = 1.0f;
+			}
+			rtabmap::Transform delta = toTransform(previous).inverse() * t;
+			t = t * rtabmap::Transform::getIdentity().interpolate(ratio, delta);
+		}
+		return t;
+	}
+
+private:
+	static void setIdentity(float * data)
+	{
+		memset(data, 0, sizeof(float)*12);
+		data[0] = data[5] = data[10] = 1.0f;
+	}
+	static rtabmap::Transform toTransform(const float * d)
+	{
+		return rtabmap::Transform(
+				d[0], d[1], d[2], d[3],
+				d[4], d[5], d[6], d[7],
+				d[8], d[9], d[10], d[11]);
+	}
+
+private:
+	boost::atomic<unsigned int> sequence_;
+	float current_[12];
+	float previous_[12];
+	double stamp_;
+	double previousStamp_;
+};
+
+}
+
+#endif /* TRANSFORMSNAPSHOT_H_ */
@@ -0,0 +1,98 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef USERDATALAYER_H_
+#define USERDATALAYER_H_
+
+#include <rtabmap/core/Signature.h>
+#include <rtabmap/core/Transform.h>
+#include <rtabmap_ros/MapData.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <map>
+
+namespace rtabmap_ros {
+
+/**
+ * Point cloud layer of values sampled along the trajectory (e.g., from the
+ * user data or environment sensors of the nodes of the map). Each sample
+ * is drawn with local points created once by the subclass, anchored at the
+ * position interpolated between the nodes around the sample's stamp.
+ *
+ * On each map update, only the samples whose surrounding nodes moved
+ * are re-transformed in the cloud message, which is reused between
+ * updates (x y z rgb float32 fields).
+ */
+class UserDataLayer
+{
+public:
+	UserDataLayer(float poseUpdateThreshold = 0.01f); // m
+	virtual ~UserDataLayer() {}
+
+	// Add the samples of the new nodes and update the cloud with the poses of the map data
+	void update(const rtabmap_ros::MapDataConstPtr & msg);
+	void clear();
+
+	const sensor_msgs::PointCloud2 & cloud() const {return cloud_;}
+	const std::map<double, float> & values() const {return values_;}
+
+protected:
+	// Returns true if the node has a sample for this layer.
+	virtual bool extractValue(const rtabmap::Signature & node, double & stamp, float & value) const = 0;
+	// Points of a sample, relative to its anchor.
+	virtual void createPoints(float value, pcl::PointCloud<pcl::PointXYZRGB> & points) const = 0;
+	// Called when samples have been added, returns true if the points of all
+	// samples should be created again (e.g., the color scale changed).
+	virtual bool updateScale(const std::map<double, float> & values) {return false;}
+
+private:
+	struct Sample
+	{
+		Sample() : nodeA(0), nodeB(0), offset(-1) {}
+		pcl::PointCloud<pcl::PointXYZRGB> points;
+		int nodeA;
+		int nodeB;
+		rtabmap::Transform poseA;
+		rtabmap::Transform poseB;
+		rtabmap::Transform anchor;
+		int offset; // first point in the cloud, -1 if not shown
+	};
+	void writeSample(const Sample & sample);
+
+private:
+	float poseUpdateThreshold_;
+	std::map<double, float> values_;
+	std::map<double, int> nodeStamps_;
+	std::map<double, Sample> samples_;
+	sensor_msgs::PointCloud2 cloud_;
+};
+
+}
+
+#endif /* USERDATALAYER_H_ */
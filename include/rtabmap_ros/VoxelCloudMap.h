@@ -0,0 +1,117 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef VOXELCLOUDMAP_H_
+#define VOXELCLOUDMAP_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace rtabmap_ros {
+
+/**
+ * Incremental voxelized point cloud map. Each voxel keeps the centroid
+ * (position and color) of the points of all nodes falling in it. Nodes can
+ * be added or removed in O(points of the node), so that only nodes whose
+ * poses have changed need to be re-inserted after a graph correction.
+ *
+ * With a chunk size set, voxels are also grouped in cubic chunks of
+ * chunkSize voxels per side, and the chunks modified since the last call
+ * to popDirtyChunks() are tracked so that they can be republished alone.
+ */
+class VoxelCloudMap
+{
+public:
+	VoxelCloudMap(float voxelSize = 0.05f);
+
+	void setVoxelSize(float voxelSize); // clear the map if changed
+	float voxelSize() const {return voxelSize_;}
+	void clear();
+	bool empty() const {return voxels_.empty();}
+	size_t voxels() const {return voxels_.size();}
+	size_t nodes() const {return nodes_.size();}
+	bool contains(int id) const {return nodes_.find(id) != nodes_.end();}
+	// Approximated bytes used by the voxels and the contribution of the nodes
+	size_t memoryUsage() const;
+
+	void setChunkSize(int voxels); // voxels per chunk side, 0=disabled, clear the map if changed
+	int chunkSize() const {return chunkSize_;}
+	float chunkLength() const {return chunkSize_*voxelSize_;}
+	const boost::unordered_map<unsigned long long, boost::unordered_set<unsigned long long> > & chunks() const {return chunks_;}
+	// Chunks modified (or removed) since the last call
+	void popDirtyChunks(std::set<unsigned long long> & chunks);
+	// Append the points of a chunk, averaged in voxels of voxelSize*2^level
+	void getChunkCloud(
+			unsigned long long chunk,
+			int level,
+			pcl::PointCloud<pcl::PointXYZRGB> & cloud) const;
+	static unsigned long long key(int x, int y, int z);
+	static void keyToIndex(unsigned long long key, int & x, int & y, int & z);
+
+	// cloud in map frame, replace points of the node if already added
+	void addNode(int id, const pcl::PointCloud<pcl::PointXYZRGB> & cloud);
+	bool removeNode(int id);
+
+	// Keep points having less than minNeighbors points of the map at
+	// less than radius (<= voxel size), see subtractFiltering() in MapsManager.
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr subtract(
+			const pcl::PointCloud<pcl::PointXYZRGB> & cloud,
+			float radius,
+			int minNeighbors) const;
+
+	// One point per voxel (centroid)
+	void getCloud(pcl::PointCloud<pcl::PointXYZRGB> & cloud) const;
+
+private:
+	struct Voxel
+	{
+		Voxel() : x(0), y(0), z(0), r(0), g(0), b(0), count(0) {}
+		double x, y, z;
+		unsigned int r, g, b;
+		int count;
+	};
+	unsigned long long key(float x, float y, float z) const;
+	unsigned long long chunkKey(unsigned long long voxelKey) const;
+
+private:
+	float voxelSize_;
+	boost::unordered_map<unsigned long long, Voxel> voxels_;
+	// contribution of each node to the voxels, to remove it exactly
+	std::map<int, std::vector<std::pair<unsigned long long, Voxel> > > nodes_;
+	int chunkSize_;
+	boost::unordered_map<unsigned long long, boost::unordered_set<unsigned long long> > chunks_; // voxels of each chunk
+	std::set<unsigned long long> dirtyChunks_;
+};
+
+}
+
+#endif /* VOXELCLOUDMAP_H_ */
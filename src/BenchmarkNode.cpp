@@ -0,0 +1,417 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <ros/ros.h>
+#include <rtabmap_ros/OdometryROS.h>
+#include <rtabmap_ros/CoreWrapper.h>
+
+#include <rtabmap/core/DBReader.h>
+#include <rtabmap/core/CameraInfo.h>
+#include <rtabmap/core/Parameters.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UTimer.h>
+#include <rtabmap/utilite/UFile.h>
+#include <rtabmap/utilite/UConversion.h>
+#include <rtabmap/utilite/UStl.h>
+
+#include <sys/resource.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "AllocationCounter.h"
+
+void showUsage()
+{
+	printf("\nUsage:\n"
+			"rosrun rtabmap_ros benchmark [options] database.db\n"
+			"  Feed the data of a database as fast as possible to an odometry nodelet\n"
+			"  (OdometryROS::processData()) and to the rtabmap nodelet (CoreWrapper::process()),\n"
+			"  without ROS transport, then print a JSON report (frames/s, latency percentiles,\n"
+			"  peak RSS, allocations). A roscore should be running: the nodelets read their\n"
+			"  parameters and advertise their topics, but nothing is subscribed.\n"
+			"Options:\n"
+			"  --slam_only          Use odometry poses saved in the database.\n"
+			"  --odom_only          Don't do mapping.\n"
+			"  --odom_icp           With images and scans, use rgbdicp_odometry parameters\n"
+			"                       (default visual odometry, ICP odometry without images).\n"
+			"  --max_frames #       Stop after # frames (default 0 = all).\n"
+			"  --output \"file\"      Write the JSON report to this file instead of stdout.\n"
+			"  --Param value        Any RTAB-Map parameter (e.g., --Odom/Strategy 1).\n\n");
+	exit(1);
+}
+
+// Odometry nodelet fed directly with processData(), the other nodelets
+// only differ by their subscriptions
+class BenchmarkOdometry : public rtabmap_ros::OdometryROS
+{
+public:
+	BenchmarkOdometry(bool stereoParams, bool visParams, bool icpParams) :
+		rtabmap_ros::OdometryROS(stereoParams, visParams, icpParams),
+		processed_(false)
+	{}
+
+	// @return false if the data has been ignored (e.g., invalid stamp)
+	bool process(rtabmap::SensorData & data, rtabmap::Transform & pose, rtabmap::OdometryInfo & info)
+	{
+		std_msgs::Header header;
+		header.stamp = ros::Time(data.stamp());
+		header.frame_id = frameId();
+		processed_ = false;
+		processData(data, header);
+		if(processed_)
+		{
+			pose = pose_;
+			info = info_;
+		}
+		else
+		{
+			pose.setNull();
+		}
+		return processed_;
+	}
+
+private:
+	virtual void onOdomInit() {}
+	virtual void flushCallbacks() {}
+	virtual void postProcessData(
+			const rtabmap::SensorData &,
+			const std_msgs::Header &,
+			const rtabmap::Transform & pose,
+			const rtabmap::OdometryInfo & info) const
+	{
+		pose_ = pose;
+		info_ = info;
+		processed_ = true;
+	}
+
+private:
+	mutable bool processed_;
+	mutable rtabmap::Transform pose_;
+	mutable rtabmap::OdometryInfo info_;
+};
+
+class LatencyStats
+{
+public:
+	void add(const std::string & name, float ms)
+	{
+		values_[name].push_back(ms);
+	}
+
+	void writeJson(FILE * f) const
+	{
+		fprintf(f, "  \"latency_ms\": {\n");
+		for(std::map<std::string, std::vector<float> >::const_iterator iter=values_.begin(); iter!=values_.end(); ++iter)
+		{
+			std::vector<float> v = iter->second;
+			std::sort(v.begin(), v.end());
+			double sum = 0.0;
+			for(size_t i=0; i<v.size(); ++i)
+			{
+				sum += v[i];
+			}
+			fprintf(f, "    \"%s\": {\"count\": %d, \"mean\": %f, \"p50\": %f, \"p90\": %f, \"p99\": %f, \"max\": %f}%s\n",
+					iter->first.c_str(),
+					(int)v.size(),
+					v.empty()?0.0:sum/double(v.size()),
+					percentile(v, 0.5),
+					percentile(v, 0.9),
+					percentile(v, 0.99),
+					v.empty()?0.0f:v.back(),
+					std::next(iter)==values_.end()?"":",");
+		}
+		fprintf(f, "  }");
+	}
+
+private:
+	static float percentile(const std::vector<float> & sorted, double p)
+	{
+		if(sorted.empty())
+		{
+			return 0.0f;
+		}
+		size_t i = std::min(sorted.size()-1, (size_t)(p*double(sorted.size()-1)+0.5));
+		return sorted[i];
+	}
+
+private:
+	std::map<std::string, std::vector<float> > values_;
+};
+
+// "Timing/Memory update/ms" -> "Memory update"
+std::string statName(const std::string & key, size_t prefixSize)
+{
+	std::string name = key.substr(prefixSize);
+	if(name.size() > 3 && name.compare(name.size()-3, 3, "/ms") == 0)
+	{
+		name.erase(name.size()-3);
+	}
+	return name;
+}
+
+int main(int argc, char * argv[])
+{
+	ULogger::setType(ULogger::kTypeConsole);
+	ULogger::setLevel(ULogger::kWarning);
+
+	ros::init(argc, argv, "rtabmap_benchmark");
+
+	if(argc < 2)
+	{
+		showUsage();
+	}
+
+	bool slamOnly = false;
+	bool odomOnly = false;
+	bool odomIcp = false;
+	int maxFrames = 0;
+	std::string outputPath;
+	for(int i=1; i<argc-1; ++i)
+	{
+		if(strcmp(argv[i], "--slam_only") == 0)
+		{
+			slamOnly = true;
+		}
+		else if(strcmp(argv[i], "--odom_only") == 0)
+		{
+			odomOnly = true;
+		}
+		else if(strcmp(argv[i], "--odom_icp") == 0)
+		{
+			odomIcp = true;
+		}
+		else if(strcmp(argv[i], "--max_frames") == 0 && i+1 < argc-1)
+		{
+			maxFrames = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "--output") == 0 && i+1 < argc-1)
+		{
+			outputPath = argv[++i];
+		}
+		else if(strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0)
+		{
+			showUsage();
+		}
+	}
+	if(slamOnly && odomOnly)
+	{
+		printf("--slam_only and --odom_only cannot be used at the same time.\n");
+		showUsage();
+	}
+
+	std::string databasePath = argv[argc-1];
+	if(!UFile::exists(databasePath))
+	{
+		printf("Database \"%s\" doesn't exist.\n", databasePath.c_str());
+		showUsage();
+	}
+
+	if(!ros::master::check())
+	{
+		printf("ROS master is not running, the nodelets cannot read their parameters.\n");
+		return -1;
+	}
+
+	rtabmap::DBReader reader(databasePath, 0.0f, !slamOnly, false, false);
+	if(!reader.init())
+	{
+		printf("Cannot open database \"%s\".\n", databasePath.c_str());
+		return -1;
+	}
+	rtabmap::CameraInfo cameraInfo;
+	rtabmap::SensorData data = reader.takeImage(&cameraInfo);
+
+	// RTAB-Map parameters are passed to the nodelets like with "rosrun
+	// nodelet nodelet standalone rtabmap_ros/rtabmap [args]"
+	std::vector<std::string> args;
+	for(int i=1; i<argc-1; ++i)
+	{
+		args.push_back(argv[i]);
+	}
+	std::string prefix = ros::this_node::getName();
+
+	BenchmarkOdometry * odometry = 0;
+	if(!slamOnly)
+	{
+		// processData() should return after the update
+		std::string name = prefix + "/odometry/odometry";
+		ros::param::set(name + "/pipeline_depth", 0);
+		ros::param::set(name + "/adaptive_frame_dropping", false);
+		ros::param::set(name + "/wait_imu_to_init", false);
+		ros::param::set(name + "/publish_aux_async", false);
+		bool images = !data.imageRaw().empty();
+		bool scans = !data.laserScanRaw().isEmpty();
+		odometry = new BenchmarkOdometry(
+				!data.stereoCameraModels().empty(),
+				images,
+				!images || (odomIcp && scans));
+		odometry->init(name, nodelet::M_string(), args);
+	}
+	rtabmap_ros::CoreWrapper * rtabmap = 0;
+	std::string rtabmapDatabasePath;
+	if(!odomOnly)
+	{
+		// don't modify the input database, the map is kept in RAM
+		std::string name = prefix + "/rtabmap/rtabmap";
+		rtabmapDatabasePath = uFormat("/tmp/rtabmap_benchmark_%d.db", (int)getpid());
+		ros::param::set(name + "/database_path", rtabmapDatabasePath);
+		ros::param::set(name + "/process_async", false);
+		ros::param::set(name + "/" + rtabmap::Parameters::kDbSqlite3InMemory(), std::string("true"));
+		std::vector<std::string> rtabmapArgs = args;
+		rtabmapArgs.push_back("--delete_db_on_start");
+		rtabmap = new rtabmap_ros::CoreWrapper();
+		rtabmap->init(name, nodelet::M_string(), rtabmapArgs);
+	}
+
+	LatencyStats stats;
+	int frames = 0;
+	int lost = 0;
+	int ignored = 0;
+	double readTime = 0.0;
+	unsigned long allocationsStart = g_allocations;
+	unsigned long allocatedBytesStart = g_allocatedBytes;
+	UTimer totalTimer;
+	UTimer timer;
+	while(data.isValid() && (maxFrames <= 0 || frames < maxFrames))
+	{
+		rtabmap::Transform pose = cameraInfo.odomPose;
+		rtabmap::OdometryInfo info;
+		cv::Mat covariance = cameraInfo.odomCovariance;
+		if(odometry)
+		{
+			timer.restart();
+			bool processed = odometry->process(data, pose, info);
+			stats.add("odometry/total", timer.ticks()*1000.0f);
+			if(!processed)
+			{
+				++ignored;
+			}
+			else
+			{
+				stats.add("odometry/estimation", info.timeEstimation*1000.0f);
+				if(info.timeParticleFiltering > 0.0f)
+				{
+					stats.add("odometry/particle_filtering", info.timeParticleFiltering*1000.0f);
+				}
+				covariance = info.reg.covariance;
+				if(pose.isNull())
+				{
+					++lost;
+				}
+			}
+		}
+
+		if(rtabmap && !pose.isNull())
+		{
+			if(covariance.empty() || covariance.at<double>(0,0) <= 0.0)
+			{
+				covariance = cv::Mat::eye(6,6,CV_64FC1);
+			}
+			std::map<std::string, float> statistics;
+			timer.restart();
+			bool processed = rtabmap->processData(data, pose, covariance, info, statistics);
+			stats.add("mapping/total", timer.ticks()*1000.0f);
+			if(processed)
+			{
+				for(std::map<std::string, float>::const_iterator iter=statistics.begin(); iter!=statistics.end(); ++iter)
+				{
+					if(iter->first.compare(0, 7, "Timing/") == 0)
+					{
+						stats.add("mapping/" + statName(iter->first, 7), iter->second);
+					}
+					else if(iter->first.compare(0, 15, "RtabmapROS/Time") == 0)
+					{
+						// "RtabmapROS/TimeUpdatingMaps/ms" -> "rtabmap_ros/TimeUpdatingMaps"
+						stats.add("rtabmap_ros/" + statName(iter->first, 11), iter->second);
+					}
+				}
+			}
+		}
+		++frames;
+
+		timer.restart();
+		cameraInfo = rtabmap::CameraInfo();
+		data = reader.takeImage(&cameraInfo);
+		readTime += timer.ticks();
+	}
+	double totalTime = totalTimer.ticks();
+	unsigned long allocations = g_allocations - allocationsStart;
+	unsigned long allocatedBytes = g_allocatedBytes - allocatedBytesStart;
+
+	delete odometry;
+	delete rtabmap;
+	if(!rtabmapDatabasePath.empty())
+	{
+		UFile::erase(rtabmapDatabasePath);
+	}
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	FILE * f = stdout;
+	if(!outputPath.empty())
+	{
+		f = fopen(outputPath.c_str(), "w");
+		if(f == 0)
+		{
+			printf("Cannot open \"%s\" for writing.\n", outputPath.c_str());
+			return -1;
+		}
+	}
+	double processingTime = totalTime - readTime;
+	fprintf(f, "{\n");
+	fprintf(f, "  \"database\": \"%s\",\n", databasePath.c_str());
+	fprintf(f, "  \"mode\": \"%s\",\n", slamOnly?"slam":odomOnly?"odometry":"odometry+slam");
+	fprintf(f, "  \"frames\": %d,\n", frames);
+	fprintf(f, "  \"odometry_lost\": %d,\n", lost);
+	fprintf(f, "  \"odometry_ignored\": %d,\n", ignored);
+	fprintf(f, "  \"total_time_s\": %f,\n", totalTime);
+	fprintf(f, "  \"read_time_s\": %f,\n", readTime);
+	fprintf(f, "  \"frames_per_second\": %f,\n", processingTime>0.0?double(frames)/processingTime:0.0);
+	fprintf(f, "  \"peak_rss_kb\": %ld,\n", usage.ru_maxrss);
+	fprintf(f, "  \"allocations\": %lu,\n", allocations);
+	fprintf(f, "  \"allocations_per_frame\": %f,\n", frames?double(allocations)/double(frames):0.0);
+	fprintf(f, "  \"allocated_bytes\": %lu,\n", allocatedBytes);
+	stats.writeJson(f);
+	fprintf(f, "\n}\n");
+	if(f != stdout)
+	{
+		fclose(f);
+	}
+
+	return 0;
+}
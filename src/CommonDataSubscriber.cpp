@@ -26,6 +26,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <rtabmap_ros/CommonDataSubscriber.h>
+#include <rtabmap_ros/MsgConversion.h>
 
 namespace rtabmap_ros {
 
@@ -43,6 +44,10 @@ CommonDataSubscriber::CommonDataSubscriber(bool gui) :
 		subscribedToScan3d_(false),
 		subscribedToScanDescriptor_(false),
 		subscribedToOdomInfo_(false),
+		syncStatsSets_(0),
+		syncStatsPeriodSets_(0),
+		syncStatsSpreadSum_(0.0),
+		syncStatsSpreadMax_(0.0),
 
 		// RGB + Depth
 		SYNC_INIT(depth),
@@ -135,6 +140,9 @@ CommonDataSubscriber::CommonDataSubscriber(bool gui) :
 		SYNC_INIT(rgbOdomDataScan3dInfo),
 		SYNC_INIT(rgbOdomDataScanDescInfo),
 #endif
+		// N RGBD
+		rgbdXCameras_(0),
+
 		// 1 RGBD
 		SYNC_INIT(rgbdScan2d),
 		SYNC_INIT(rgbdScan3d),
@@ -164,124 +172,6 @@ CommonDataSubscriber::CommonDataSubscriber(bool gui) :
 		SYNC_INIT(rgbdOdomDataInfo),
 #endif
 
-#ifdef RTABMAP_SYNC_MULTI_RGBD
-		// 2 RGBD
-		SYNC_INIT(rgbd2),
-		SYNC_INIT(rgbd2Scan2d),
-		SYNC_INIT(rgbd2Scan3d),
-		SYNC_INIT(rgbd2ScanDesc),
-		SYNC_INIT(rgbd2Info),
-
-		// 2 RGBD + Odom
-		SYNC_INIT(rgbd2Odom),
-		SYNC_INIT(rgbd2OdomScan2d),
-		SYNC_INIT(rgbd2OdomScan3d),
-		SYNC_INIT(rgbd2OdomScanDesc),
-		SYNC_INIT(rgbd2OdomInfo),
-
-#ifdef RTABMAP_SYNC_USER_DATA
-		// 2 RGBD + User Data
-		SYNC_INIT(rgbd2Data),
-		SYNC_INIT(rgbd2DataScan2d),
-		SYNC_INIT(rgbd2DataScan3d),
-		SYNC_INIT(rgbd2DataScanDesc),
-		SYNC_INIT(rgbd2DataInfo),
-
-		// 2 RGBD + Odom + User Data
-		SYNC_INIT(rgbd2OdomData),
-		SYNC_INIT(rgbd2OdomDataScan2d),
-		SYNC_INIT(rgbd2OdomDataScan3d),
-		SYNC_INIT(rgbd2OdomDataScanDesc),
-		SYNC_INIT(rgbd2OdomDataInfo),
-#endif
-
-		// 3 RGBD
-		SYNC_INIT(rgbd3),
-		SYNC_INIT(rgbd3Scan2d),
-		SYNC_INIT(rgbd3Scan3d),
-		SYNC_INIT(rgbd3ScanDesc),
-		SYNC_INIT(rgbd3Info),
-
-		// 3 RGBD + Odom
-		SYNC_INIT(rgbd3Odom),
-		SYNC_INIT(rgbd3OdomScan2d),
-		SYNC_INIT(rgbd3OdomScan3d),
-		SYNC_INIT(rgbd3OdomScanDesc),
-		SYNC_INIT(rgbd3OdomInfo),
-
-#ifdef RTABMAP_SYNC_USER_DATA
-		// 3 RGBD + User Data
-		SYNC_INIT(rgbd3Data),
-		SYNC_INIT(rgbd3DataScan2d),
-		SYNC_INIT(rgbd3DataScan3d),
-		SYNC_INIT(rgbd3DataScanDesc),
-		SYNC_INIT(rgbd3DataInfo),
-
-		// 3 RGBD + Odom + User Data
-		SYNC_INIT(rgbd3OdomData),
-		SYNC_INIT(rgbd3OdomDataScan2d),
-		SYNC_INIT(rgbd3OdomDataScan3d),
-		SYNC_INIT(rgbd3OdomDataScanDesc),
-		SYNC_INIT(rgbd3OdomDataInfo),
-#endif
-
-		// 4 RGBD
-		SYNC_INIT(rgbd4),
-		SYNC_INIT(rgbd4Scan2d),
-		SYNC_INIT(rgbd4Scan3d),
-		SYNC_INIT(rgbd4ScanDesc),
-		SYNC_INIT(rgbd4Info),
-
-		// 4 RGBD + Odom
-		SYNC_INIT(rgbd4Odom),
-		SYNC_INIT(rgbd4OdomScan2d),
-		SYNC_INIT(rgbd4OdomScan3d),
-		SYNC_INIT(rgbd4OdomScanDesc),
-		SYNC_INIT(rgbd4OdomInfo),
-
-#ifdef RTABMAP_SYNC_USER_DATA
-		// 4 RGBD + User Data
-		SYNC_INIT(rgbd4Data),
-		SYNC_INIT(rgbd4DataScan2d),
-		SYNC_INIT(rgbd4DataScan3d),
-		SYNC_INIT(rgbd4DataScanDesc),
-		SYNC_INIT(rgbd4DataInfo),
-
-		// 4 RGBD + Odom + User Data
-		SYNC_INIT(rgbd4OdomData),
-		SYNC_INIT(rgbd4OdomDataScan2d),
-		SYNC_INIT(rgbd4OdomDataScan3d),
-		SYNC_INIT(rgbd4OdomDataScanDesc),
-		SYNC_INIT(rgbd4OdomDataInfo),
-#endif
-		// 5 RGBD
-		SYNC_INIT(rgbd5),
-		SYNC_INIT(rgbd5Scan2d),
-		SYNC_INIT(rgbd5Scan3d),
-		SYNC_INIT(rgbd5ScanDesc),
-		SYNC_INIT(rgbd5Info),
-
-		// 5 RGBD + Odom
-		SYNC_INIT(rgbd5Odom),
-		SYNC_INIT(rgbd5OdomScan2d),
-		SYNC_INIT(rgbd5OdomScan3d),
-		SYNC_INIT(rgbd5OdomScanDesc),
-		SYNC_INIT(rgbd5OdomInfo),
-
-		// 6 RGBD
-		SYNC_INIT(rgbd6),
-		SYNC_INIT(rgbd6Scan2d),
-		SYNC_INIT(rgbd6Scan3d),
-		SYNC_INIT(rgbd6ScanDesc),
-		SYNC_INIT(rgbd6Info),
-
-		// 6 RGBD + Odom
-		SYNC_INIT(rgbd6Odom),
-		SYNC_INIT(rgbd6OdomScan2d),
-		SYNC_INIT(rgbd6OdomScan3d),
-		SYNC_INIT(rgbd6OdomScanDesc),
-		SYNC_INIT(rgbd6OdomInfo),
-#endif // RTABMAP_SYNC_MULTI_RGBD
 
 		// Scan
 		SYNC_INIT(scan2dInfo),
@@ -338,6 +228,8 @@ void CommonDataSubscriber::setupCallbacks(
 	bool subscribeUserData = false;
 	bool subscribeOdom = true;
 	int rgbdCameras = 1;
+	double approxSyncMaxInterval = 0.0;
+	double syncDiagnosticsPeriod = 1.0;
 	name_ = name;
 
 	// ROS related parameters (private)
@@ -437,6 +329,8 @@ void CommonDataSubscriber::setupCallbacks(
 	{
 		pnh.param("approx_sync", approxSync_, approxSync_);
 	}
+	pnh.param("approx_sync_max_interval", approxSyncMaxInterval, approxSyncMaxInterval);
+	pnh.param("sync_diagnostics_period", syncDiagnosticsPeriod, syncDiagnosticsPeriod);
 
 	if(rgbdCameras <= 0 && subscribedToRGBD_)
 	{
@@ -454,6 +348,11 @@ void CommonDataSubscriber::setupCallbacks(
 	ROS_INFO("%s: subscribe_scan_descriptor = %s", name.c_str(), subscribeScanDesc?"true":"false");
 	ROS_INFO("%s: queue_size    = %d", name.c_str(), queueSize_);
 	ROS_INFO("%s: approx_sync   = %s", name.c_str(), approxSync_?"true":"false");
+	if(subscribedToRGBD_ && rgbdCameras > 1)
+	{
+		ROS_INFO("%s: approx_sync_max_interval = %f s", name.c_str(), approxSyncMaxInterval);
+	}
+	ROS_INFO("%s: sync_diagnostics_period = %f s", name.c_str(), syncDiagnosticsPeriod);
 
 	subscribedToOdom_ = odomFrameId.empty() && subscribeOdom;
 	if(subscribedToDepth_)
@@ -496,68 +395,12 @@ void CommonDataSubscriber::setupCallbacks(
 	}
 	else if(subscribedToRGBD_)
 	{
-#ifdef RTABMAP_SYNC_MULTI_RGBD
-		if(rgbdCameras == 6)
-		{
-			setupRGBD6Callbacks(
-					nh,
-					pnh,
-					subscribedToOdom_,
-					subscribeUserData,
-					subscribeScan2d,
-					subscribeScan3d,
-					subscribeScanDesc,
-					subscribeOdomInfo,
-					queueSize_,
-					approxSync_);
-		}
-		else if(rgbdCameras == 5)
-		{
-			setupRGBD5Callbacks(
-					nh,
-					pnh,
-					subscribedToOdom_,
-					subscribeUserData,
-					subscribeScan2d,
-					subscribeScan3d,
-					subscribeScanDesc,
-					subscribeOdomInfo,
-					queueSize_,
-					approxSync_);
-		}
-		else if(rgbdCameras == 4)
-		{
-			setupRGBD4Callbacks(
-					nh,
-					pnh,
-					subscribedToOdom_,
-					subscribeUserData,
-					subscribeScan2d,
-					subscribeScan3d,
-					subscribeScanDesc,
-					subscribeOdomInfo,
-					queueSize_,
-					approxSync_);
-		}
-		else if(rgbdCameras == 3)
-		{
-			setupRGBD3Callbacks(
-					nh,
-					pnh,
-					subscribedToOdom_,
-					subscribeUserData,
-					subscribeScan2d,
-					subscribeScan3d,
-					subscribeScanDesc,
-					subscribeOdomInfo,
-					queueSize_,
-					approxSync_);
-		}
-		else if(rgbdCameras == 2)
+		if(rgbdCameras > 1)
 		{
-			setupRGBD2Callbacks(
+			setupRGBDXCallbacks(
 					nh,
 					pnh,
+					rgbdCameras,
 					subscribedToOdom_,
 					subscribeUserData,
 					subscribeScan2d,
@@ -565,14 +408,9 @@ void CommonDataSubscriber::setupCallbacks(
 					subscribeScanDesc,
 					subscribeOdomInfo,
 					queueSize_,
-					approxSync_);
-		}
-#else
-		if(rgbdCameras>1)
-		{
-			ROS_FATAL("Cannot synchronize more than 1 rgbd topic (rtabmap_ros has been built without RTABMAP_SYNC_MULTI_RGBD option)");
+					approxSync_,
+					approxSyncMaxInterval);
 		}
-#endif
 		else
 		{
 			setupRGBDCallbacks(
@@ -617,10 +455,17 @@ void CommonDataSubscriber::setupCallbacks(
 		warningThread_ = new boost::thread(boost::bind(&CommonDataSubscriber::warningLoop, this));
 		ROS_INFO("%s", subscribedTopicsMsg_.c_str());
 	}
+
+	if(syncDiagnosticsPeriod > 0.0 && !syncStats_.empty())
+	{
+		// Only synchronized topics are monitored
+		syncDiagnostics_.start(nh, syncDiagnosticsPeriod, boost::bind(&CommonDataSubscriber::syncDiagnosticsStatus, this, _1, _2));
+	}
 }
 
 CommonDataSubscriber::~CommonDataSubscriber()
 {
+	syncDiagnostics_.stop();
 	if(warningThread_)
 	{
 		callbackCalled();
@@ -749,124 +594,6 @@ CommonDataSubscriber::~CommonDataSubscriber()
 	SYNC_DEL(rgbdOdomDataInfo);
 #endif
 
-#ifdef RTABMAP_SYNC_MULTI_RGBD
-	// 2 RGBD
-	SYNC_DEL(rgbd2);
-	SYNC_DEL(rgbd2Scan2d);
-	SYNC_DEL(rgbd2Scan3d);
-	SYNC_DEL(rgbd2ScanDesc);
-	SYNC_DEL(rgbd2Info);
-
-	// 2 RGBD + Odom
-	SYNC_DEL(rgbd2Odom);
-	SYNC_DEL(rgbd2OdomScan2d);
-	SYNC_DEL(rgbd2OdomScan3d);
-	SYNC_DEL(rgbd2OdomScanDesc);
-	SYNC_DEL(rgbd2OdomInfo);
-
-#ifdef RTABMAP_SYNC_USER_DATA
-	// 2 RGBD + User Data
-	SYNC_DEL(rgbd2Data);
-	SYNC_DEL(rgbd2DataScan2d);
-	SYNC_DEL(rgbd2DataScan3d);
-	SYNC_DEL(rgbd2DataScanDesc);
-	SYNC_DEL(rgbd2DataInfo);
-
-	// 2 RGBD + Odom + User Data
-	SYNC_DEL(rgbd2OdomData);
-	SYNC_DEL(rgbd2OdomDataScan2d);
-	SYNC_DEL(rgbd2OdomDataScan3d);
-	SYNC_DEL(rgbd2OdomDataScanDesc);
-	SYNC_DEL(rgbd2OdomDataInfo);
-#endif
-
-	// 3 RGBD
-	SYNC_DEL(rgbd3);
-	SYNC_DEL(rgbd3Scan2d);
-	SYNC_DEL(rgbd3Scan3d);
-	SYNC_DEL(rgbd3ScanDesc);
-	SYNC_DEL(rgbd3Info);
-
-	// 3 RGBD + Odom
-	SYNC_DEL(rgbd3Odom);
-	SYNC_DEL(rgbd3OdomScan2d);
-	SYNC_DEL(rgbd3OdomScan3d);
-	SYNC_DEL(rgbd3OdomScanDesc);
-	SYNC_DEL(rgbd3OdomInfo);
-
-#ifdef RTABMAP_SYNC_USER_DATA
-	// 3 RGBD + User Data
-	SYNC_DEL(rgbd3Data);
-	SYNC_DEL(rgbd3DataScan2d);
-	SYNC_DEL(rgbd3DataScan3d);
-	SYNC_DEL(rgbd3DataScanDesc);
-	SYNC_DEL(rgbd3DataInfo);
-
-	// 3 RGBD + Odom + User Data
-	SYNC_DEL(rgbd3OdomData);
-	SYNC_DEL(rgbd3OdomDataScan2d);
-	SYNC_DEL(rgbd3OdomDataScan3d);
-	SYNC_DEL(rgbd3OdomDataScanDesc);
-	SYNC_DEL(rgbd3OdomDataInfo);
-#endif
-
-	// 4 RGBD
-	SYNC_DEL(rgbd4);
-	SYNC_DEL(rgbd4Scan2d);
-	SYNC_DEL(rgbd4Scan3d);
-	SYNC_DEL(rgbd4ScanDesc);
-	SYNC_DEL(rgbd4Info);
-
-	// 4 RGBD + Odom
-	SYNC_DEL(rgbd4Odom);
-	SYNC_DEL(rgbd4OdomScan2d);
-	SYNC_DEL(rgbd4OdomScan3d);
-	SYNC_DEL(rgbd4OdomScanDesc);
-	SYNC_DEL(rgbd4OdomInfo);
-
-#ifdef RTABMAP_SYNC_USER_DATA
-	// 4 RGBD + User Data
-	SYNC_DEL(rgbd4Data);
-	SYNC_DEL(rgbd4DataScan2d);
-	SYNC_DEL(rgbd4DataScan3d);
-	SYNC_DEL(rgbd4DataScanDesc);
-	SYNC_DEL(rgbd4DataInfo);
-
-	// 4 RGBD + Odom + User Data
-	SYNC_DEL(rgbd4OdomData);
-	SYNC_DEL(rgbd4OdomDataScan2d);
-	SYNC_DEL(rgbd4OdomDataScan3d);
-	SYNC_DEL(rgbd4OdomDataScanDesc);
-	SYNC_DEL(rgbd4OdomDataInfo);
-#endif
-	// 5 RGBD
-	SYNC_DEL(rgbd5);
-	SYNC_DEL(rgbd5Scan2d);
-	SYNC_DEL(rgbd5Scan3d);
-	SYNC_DEL(rgbd5ScanDesc);
-	SYNC_DEL(rgbd5Info);
-
-	// 5 RGBD + Odom
-	SYNC_DEL(rgbd5Odom);
-	SYNC_DEL(rgbd5OdomScan2d);
-	SYNC_DEL(rgbd5OdomScan3d);
-	SYNC_DEL(rgbd5OdomScanDesc);
-	SYNC_DEL(rgbd5OdomInfo);
-
-	// 6 RGBD
-	SYNC_DEL(rgbd6);
-	SYNC_DEL(rgbd6Scan2d);
-	SYNC_DEL(rgbd6Scan3d);
-	SYNC_DEL(rgbd6ScanDesc);
-	SYNC_DEL(rgbd6Info);
-
-	// 6 RGBD + Odom
-	SYNC_DEL(rgbd6Odom);
-	SYNC_DEL(rgbd6OdomScan2d);
-	SYNC_DEL(rgbd6OdomScan3d);
-	SYNC_DEL(rgbd6OdomScanDesc);
-	SYNC_DEL(rgbd6OdomInfo);
-#endif //RTABMAP_SYNC_MULTI_RGBD
 
 	// Scan
 	SYNC_DEL(scan2dInfo);
@@ -930,6 +657,7 @@ CommonDataSubscriber::~CommonDataSubscriber()
 	pnh.deleteParam("queue_size");
 	pnh.deleteParam("approx_sync");
 	pnh.deleteParam("stereo_approx_sync");
+	pnh.deleteParam("sync_diagnostics_period");
 }
 
 void CommonDataSubscriber::warningLoop()
@@ -953,6 +681,146 @@ void CommonDataSubscriber::warningLoop()
 	}
 }
 
+void CommonDataSubscriber::syncStatsTopic(int index, const std::string & topic)
+{
+	boost::mutex::scoped_lock lock(syncStatsMutex_);
+	if(index >= (int)syncStats_.size())
+	{
+		syncStats_.resize(index+1);
+	}
+	syncStats_[index].topic = topic;
+}
+
+void CommonDataSubscriber::syncStatsReceived(int index)
+{
+	boost::mutex::scoped_lock lock(syncStatsMutex_);
+	if(index < (int)syncStats_.size())
+	{
+		++syncStats_[index].received;
+	}
+}
+
+void CommonDataSubscriber::syncStatsUpdate(const double * stamps, int size)
+{
+	double now = ros::Time::now().toSec();
+	boost::mutex::scoped_lock lock(syncStatsMutex_);
+	double minStamp = stamps[0];
+	double maxStamp = stamps[0];
+	for(int i=0; i<size && i<(int)syncStats_.size(); ++i)
+	{
+		// Stamps of optional messages (e.g., no odom info) may be null
+		if(stamps[i] > 0.0)
+		{
+			minStamp = minStamp>0.0?std::min(minStamp, stamps[i]):stamps[i];
+			maxStamp = std::max(maxStamp, stamps[i]);
+			double age = now - stamps[i];
+			++syncStats_[i].used;
+			syncStats_[i].ageSum += age;
+			syncStats_[i].ageMax = std::max(syncStats_[i].ageMax, age);
+		}
+	}
+	double spread = maxStamp - minStamp;
+	syncStatsSpreadSum_ += spread;
+	syncStatsSpreadMax_ = std::max(syncStatsSpreadMax_, spread);
+	++syncStatsSets_;
+	++syncStatsPeriodSets_;
+}
+
+void CommonDataSubscriber::syncDiagnosticsStatus(diagnostic_msgs::DiagnosticStatus & status, double period)
+{
+	status.name = name_ + ": Synchronizer";
+	status.hardware_id = name_;
+
+	boost::mutex::scoped_lock lock(syncStatsMutex_);
+	diagnostic_msgs::KeyValue value;
+	value.key = "Sync";
+	value.value = approxSync_?"approx":"exact";
+	status.values.push_back(value);
+	value.key = "Queue size";
+	value.value = uNumber2Str(queueSize_);
+	status.values.push_back(value);
+	value.key = "Synchronized sets";
+	value.value = uNumber2Str((unsigned int)syncStatsSets_);
+	status.values.push_back(value);
+	value.key = "Rate (Hz)";
+	value.value = uNumber2Str(period>0.0?double(syncStatsPeriodSets_)/period:0.0);
+	status.values.push_back(value);
+	value.key = "Stamp spread mean (s)";
+	value.value = uNumber2Str(syncStatsPeriodSets_?syncStatsSpreadSum_/double(syncStatsPeriodSets_):0.0);
+	status.values.push_back(value);
+	value.key = "Stamp spread max (s)";
+	value.value = uNumber2Str(syncStatsSpreadMax_);
+	status.values.push_back(value);
+
+	size_t slowest = 0; // the topic with the fewest messages limits the sync
+	for(size_t i=1; i<syncStats_.size(); ++i)
+	{
+		if(syncStats_[i].received < syncStats_[slowest].received)
+		{
+			slowest = i;
+		}
+	}
+	unsigned long expectedSets = syncStats_[slowest].received;
+
+	unsigned long maxMissed = 0;
+	for(size_t i=0; i<syncStats_.size(); ++i)
+	{
+		SyncTopicStats & stats = syncStats_[i];
+		// Messages of faster topics not used in a set are expected, only
+		// messages missing in the sets are reported (message_filters
+		// doesn't expose its drops).
+		unsigned long expected = std::min(stats.received, expectedSets);
+		unsigned long missed = expected > stats.used?expected - stats.used:0;
+		value.key = stats.topic + " received";
+		value.value = uNumber2Str((unsigned int)stats.received);
+		status.values.push_back(value);
+		value.key = stats.topic + " expected";
+		value.value = uNumber2Str((unsigned int)expected);
+		status.values.push_back(value);
+		value.key = stats.topic + " used";
+		value.value = uNumber2Str((unsigned int)stats.used);
+		status.values.push_back(value);
+		value.key = stats.topic + " missed";
+		value.value = uNumber2Str((unsigned int)missed);
+		status.values.push_back(value);
+		value.key = stats.topic + " age mean (s)";
+		value.value = uNumber2Str(stats.used?stats.ageSum/double(stats.used):0.0);
+		status.values.push_back(value);
+		value.key = stats.topic + " age max (s)";
+		value.value = uNumber2Str(stats.ageMax);
+		status.values.push_back(value);
+		maxMissed = std::max(maxMissed, missed);
+	}
+
+	if(syncStatsPeriodSets_ == 0)
+	{
+		status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+		status.message = uFormat("No synchronized data since %f s (fewest messages received on %s)", period, syncStats_[slowest].topic.c_str());
+	}
+	else if(maxMissed > std::max(1ul, expectedSets/10))
+	{
+		// more than 10% (one message can be at the limit of the period)
+		status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+		status.message = uFormat("%lu/%lu expected sets not synchronized (%s is the slowest topic)",
+				maxMissed, expectedSets, syncStats_[slowest].topic.c_str());
+	}
+	else
+	{
+		status.level = diagnostic_msgs::DiagnosticStatus::OK;
+		status.message = "OK";
+	}
+	for(size_t i=0; i<syncStats_.size(); ++i)
+	{
+		syncStats_[i].received = 0;
+		syncStats_[i].used = 0;
+		syncStats_[i].ageSum = 0.0;
+		syncStats_[i].ageMax = 0.0;
+	}
+	syncStatsPeriodSets_ = 0;
+	syncStatsSpreadSum_ = 0.0;
+	syncStatsSpreadMax_ = 0.0;
+}
+
 void CommonDataSubscriber::commonSingleDepthCallback(
 		const nav_msgs::OdometryConstPtr & odomMsg,
 		const rtabmap_ros::UserDataConstPtr & userDataMsg,
@@ -970,43 +838,49 @@ void CommonDataSubscriber::commonSingleDepthCallback(
 {
 	callbackCalled();
 
-	std::vector<std::vector<rtabmap_ros::KeyPoint> > localKeyPointsMsgs;
-	localKeyPointsMsgs.push_back(localKeyPoints);
-	std::vector<std::vector<rtabmap_ros::Point3f> > localPoints3dMsgs;
-	localPoints3dMsgs.push_back(localPoints3d);
-	std::vector<cv::Mat> localDescriptorsMsgs;
-	localDescriptorsMsgs.push_back(localDescriptors);
-
 	if(depthMsg.get() == 0 ||
 	   depthMsg->encoding.compare(sensor_msgs::image_encodings::TYPE_16UC1) == 0 ||
 	   depthMsg->encoding.compare(sensor_msgs::image_encodings::TYPE_32FC1) == 0 ||
 	   depthMsg->encoding.compare(sensor_msgs::image_encodings::MONO16) == 0)
 	{
-		std::vector<cv_bridge::CvImageConstPtr> imageMsgs;
-		std::vector<cv_bridge::CvImageConstPtr> depthMsgs;
-		std::vector<sensor_msgs::CameraInfo> cameraInfoMsgs;
+		// The vectors keep their capacity between frames (assignments
+		// reuse the buffers of the previous frame)
+		singleRgbs_.clear();
+		singleDepths_.clear();
 		if(imageMsg.get())
 		{
-			imageMsgs.push_back(imageMsg);
+			singleRgbs_.push_back(imageMsg);
 		}
 		if(depthMsg.get())
 		{
-			depthMsgs.push_back(depthMsg);
+			singleDepths_.push_back(depthMsg);
 		}
-		cameraInfoMsgs.push_back(rgbCameraInfoMsg);
+		singleCameraInfos_.resize(1);
+		singleCameraInfos_[0] = rgbCameraInfoMsg;
+		singleKeyPoints_.resize(1);
+		singleKeyPoints_[0] = localKeyPoints;
+		singlePoints3d_.resize(1);
+		singlePoints3d_[0] = localPoints3d;
+		singleDescriptors_.resize(1);
+		singleDescriptors_[0] = localDescriptors;
 		commonDepthCallback(
 				odomMsg,
 				userDataMsg,
-				imageMsgs,
-				depthMsgs,
-				cameraInfoMsgs,
+				singleRgbs_,
+				singleDepths_,
+				singleCameraInfos_,
 				scanMsg,
 				scan3dMsg,
 				odomInfoMsg,
 				globalDescriptorMsgs,
-				localKeyPointsMsgs,
-				localPoints3dMsgs,
-				localDescriptorsMsgs);
+				singleKeyPoints_,
+				singlePoints3d_,
+				singleDescriptors_);
+
+		// don't hold the images until the next frame
+		singleRgbs_.clear();
+		singleDepths_.clear();
+		singleDescriptors_[0] = cv::Mat();
 	}
 	else // assuming stereo
 	{
@@ -1025,6 +899,36 @@ void CommonDataSubscriber::commonSingleDepthCallback(
 				localPoints3d,
 				localDescriptors);
 	}
+	currentRGBDImage_.reset();
+}
+
+void CommonDataSubscriber::rgbdToCvShare(
+		const rtabmap_ros::RGBDImageConstPtr & image,
+		cv_bridge::CvImageConstPtr & rgb,
+		cv_bridge::CvImageConstPtr & depth)
+{
+	rtabmap_ros::toCvShare(image, rgb, depth);
+	currentRGBDImage_ = image;
+}
+
+void CommonDataSubscriber::addFrameStorage(FrameAllocStats & stats) const
+{
+	stats.add(rgbdXMsgs_);
+	stats.add(rgbdXStamps_);
+	stats.add(rgbdXImages_);
+	stats.add(rgbdXRgbs_);
+	stats.add(rgbdXDepths_);
+	stats.add(rgbdXCameraInfos_);
+	stats.add(rgbdXGlobalDescriptors_);
+	stats.add(rgbdXKeyPoints_);
+	stats.add(rgbdXPoints3d_);
+	stats.add(rgbdXDescriptors_);
+	stats.add(singleRgbs_);
+	stats.add(singleDepths_);
+	stats.add(singleCameraInfos_);
+	stats.add(singleKeyPoints_);
+	stats.add(singlePoints3d_);
+	stats.add(singleDescriptors_);
 }
 
 } /* namespace rtabmap_ros */
@@ -28,6 +28,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap_ros/CoreWrapper.h"
 
 #include <stdio.h>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <ros/ros.h>
 #include "pluginlib/class_list_macros.h"
 
@@ -48,6 +53,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/utilite/UConversion.h>
 #include <rtabmap/utilite/UStl.h>
 #include <rtabmap/utilite/UMath.h>
+#include <rtabmap/utilite/UThread.h>
 
 #include <rtabmap/core/util2d.h>
 #include <rtabmap/core/util3d.h>
@@ -75,13 +81,27 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap_ros/MapData.h"
 #include "rtabmap_ros/MapGraph.h"
 #include "rtabmap_ros/Path.h"
+#include "rtabmap_ros/BackupProgress.h"
 
 #include "rtabmap_ros/MsgConversion.h"
+#include "rtabmap_ros/StaticTransformCache.h"
+#include "rtabmap_ros/SensorDataHandoff.h"
 
 using namespace rtabmap;
 
 namespace rtabmap_ros {
 
+// Changes each time the database is written (saving the cache is done after closing it)
+static unsigned long long databaseStamp(const std::string & path)
+{
+	struct stat st;
+	if(path.empty() || stat(path.c_str(), &st) != 0)
+	{
+		return 0;
+	}
+	return ((unsigned long long)st.st_mtim.tv_sec << 32) ^ ((unsigned long long)st.st_mtim.tv_nsec << 2) ^ (unsigned long long)st.st_size;
+}
+
 CoreWrapper::CoreWrapper() :
 		CommonDataSubscriber(false),
 		paused_(false),
@@ -114,9 +134,53 @@ CoreWrapper::CoreWrapper() :
 		mapToOdom_(rtabmap::Transform::getIdentity()),
 		transformThread_(0),
 		tfThreadRunning_(false),
+		tfExtrapolate_(false),
+		processAsync_(false),
+		processAsyncQueueSize_(1),
+		processAsyncKeepLatest_(false),
+		processThread_(0),
+		processThreadRunning_(false),
+		processQueueDropped_(0),
+		publishMapsAsync_(false),
+		mapsThread_(0),
+		mapsThreadRunning_(false),
+		mapsUpdatePending_(false),
+		mapsUpdatesCoalesced_(0),
+		mapsLastUpdateTime_(0.0),
+		mapsLastPublishTime_(0.0),
+		wordsPacking_(0),
+		graphPacking_(0),
+		localizationLightweight_(false),
+		localizationMapsLatched_(false),
+		mapCachePersist_(false),
+		fastStart_(false),
+		mapCacheThread_(0),
+		mapCacheThreadRunning_(false),
+		mapCacheGeneration_(0),
+		backupThread_(0),
+		backupThreadRunning_(false),
+		backupJobRunning_(false),
+		backupJobId_(0),
+		backupMaxRate_(0.0),
+		latencyWindowSize_(100),
+		memorySoftLimit_(0.0),
+		mapsMemoryEvictable_(0),
+		timeOdomTfWait_(0.0),
+		mapDeltaEnabled_(false),
+		mapDeltaLinearUpdate_(0.01),
+		mapDeltaAngularUpdate_(0.01),
+		mapDeltaKeyFrameInterval_(0),
+		mapDeltaVersion_(0),
+		nodesIndexOutdated_(true),
+		descriptorIndexOutdated_(true),
+		planGraphVersion_(0),
 		stereoToDepth_(false),
 		interOdomSync_(0),
+		asyncSpinner_(0),
+		queryThreads_(0),
+		querySpinner_(0),
 		odomSensorSync_(false),
+		compressedPassthrough_(false),
 		rate_(Parameters::defaultRtabmapDetectionRate()),
 		createIntermediateNodes_(Parameters::defaultRtabmapCreateIntermediateNodes()),
 		mappingMaxNodes_(Parameters::defaultGridGlobalMaxNodes()),
@@ -124,6 +188,7 @@ CoreWrapper::CoreWrapper() :
 		alreadyRectifiedImages_(Parameters::defaultRtabmapImagesAlreadyRectified()),
 		twoDMapping_(Parameters::defaultRegForce3DoF()),
 		previousStamp_(0),
+		tfStaticCache_(0),
 		mbClient_(0)
 {
 	char * rosHomePath = getenv("ROS_HOME");
@@ -134,9 +199,11 @@ CoreWrapper::CoreWrapper() :
 
 void CoreWrapper::onInit()
 {
+	UTimer initTimer;
 	ros::NodeHandle & nh = getNodeHandle();
 	ros::NodeHandle & pnh = getPrivateNodeHandle();
 
+	mapsManager_.setOutputsMutex(&mapsMutex_);
 	mapsManager_.init(nh, pnh, getName(), true);
 
 	bool publishTf = true;
@@ -174,6 +241,7 @@ void CoreWrapper::onInit()
 
 	pnh.param("publish_tf",          publishTf, publishTf);
 	pnh.param("tf_delay",            tfDelay, tfDelay);
+	pnh.param("tf_extrapolate",      tfExtrapolate_, tfExtrapolate_);
 	if(pnh.hasParam("tf_prefix"))
 	{
 		ROS_ERROR("tf_prefix parameter has been removed, use directly map_frame_id, odom_frame_id and frame_id parameters.");
@@ -183,10 +251,39 @@ void CoreWrapper::onInit()
 	pnh.param("odom_tf_linear_variance", odomDefaultLinVariance_, odomDefaultLinVariance_);
 	pnh.param("landmark_angular_variance", landmarkDefaultAngVariance_, landmarkDefaultAngVariance_);
 	pnh.param("landmark_linear_variance", landmarkDefaultLinVariance_, landmarkDefaultLinVariance_);
+	pnh.param("backup_async_max_rate", backupMaxRate_, backupMaxRate_);
 	pnh.param("wait_for_transform",  waitForTransform_, waitForTransform_);
 	pnh.param("wait_for_transform_duration",  waitForTransformDuration_, waitForTransformDuration_);
+	bool tfStaticCache = false;
+	pnh.param("tf_static_cache",     tfStaticCache, tfStaticCache);
+	if(tfStaticCache)
+	{
+		// static sensor transforms are then looked up only once
+		tfStaticCache_ = new StaticTransformCache(nh, tfListener_);
+	}
 	pnh.param("use_action_for_goal", useActionForGoal_, useActionForGoal_);
 	pnh.param("use_saved_map", useSavedMap_, useSavedMap_);
+	pnh.param("fast_start", fastStart_, fastStart_);
+	pnh.param("map_cache_persist", mapCachePersist_, mapCachePersist_);
+	pnh.param("localization_lightweight", localizationLightweight_, localizationLightweight_);
+	int planCacheSize = 16;
+	double planCacheRepairRatio = 0.2;
+	pnh.param("plan_cache_size", planCacheSize, planCacheSize);
+	pnh.param("plan_cache_repair_ratio", planCacheRepairRatio, planCacheRepairRatio);
+	planCache_.setMaxPlans(planCacheSize);
+	planCache_.setMaxRepairRatio(planCacheRepairRatio);
+	pnh.param("query_threads", queryThreads_, queryThreads_);
+	if(localizationLightweight_)
+	{
+		bool latch = true;
+		pnh.param("latch", latch, latch);
+		if(!latch)
+		{
+			NODELET_WARN("rtabmap: localization_lightweight is used with latch=false, the maps will be regenerated on every update while they have subscribers.");
+		}
+	}
+	pnh.param("words_packing", wordsPacking_, wordsPacking_);
+	pnh.param("graph_packing", graphPacking_, graphPacking_);
 	pnh.param("gen_scan",            genScan_, genScan_);
 	pnh.param("gen_scan_max_depth",  genScanMaxDepth_, genScanMaxDepth_);
 	pnh.param("gen_scan_min_depth",  genScanMinDepth_, genScanMinDepth_);
@@ -208,6 +305,35 @@ void CoreWrapper::onInit()
 	}
 	pnh.param("stereo_to_depth", stereoToDepth_, stereoToDepth_);
 	pnh.param("odom_sensor_sync", odomSensorSync_, odomSensorSync_);
+	pnh.param("compressed_passthrough", compressedPassthrough_, compressedPassthrough_);
+	bool sensorDataHandoff = false;
+	pnh.param("sensor_data_handoff", sensorDataHandoff, sensorDataHandoff);
+	pnh.param("process_async", processAsync_, processAsync_);
+	bool asyncCallbackQueue = false;
+	pnh.param("async_callback_queue", asyncCallbackQueue, asyncCallbackQueue);
+	pnh.param("process_async_queue_size", processAsyncQueueSize_, processAsyncQueueSize_);
+	pnh.param("latency_window_size", latencyWindowSize_, latencyWindowSize_);
+	pnh.param("memory_soft_limit", memorySoftLimit_, memorySoftLimit_);
+	std::string processAsyncDropPolicy = "drop_oldest";
+	pnh.param("process_async_drop_policy", processAsyncDropPolicy, processAsyncDropPolicy);
+	if(processAsyncDropPolicy.compare("keep_latest") == 0)
+	{
+		processAsyncKeepLatest_ = true;
+	}
+	else if(processAsyncDropPolicy.compare("drop_oldest") != 0)
+	{
+		NODELET_ERROR("Parameter \"process_async_drop_policy\" should be \"drop_oldest\" or \"keep_latest\" (set to \"%s\"), using \"drop_oldest\".", processAsyncDropPolicy.c_str());
+	}
+	pnh.param("publish_maps_async", publishMapsAsync_, publishMapsAsync_);
+	pnh.param("publish_map_delta", mapDeltaEnabled_, mapDeltaEnabled_);
+	pnh.param("map_delta_linear_update", mapDeltaLinearUpdate_, mapDeltaLinearUpdate_);
+	pnh.param("map_delta_angular_update", mapDeltaAngularUpdate_, mapDeltaAngularUpdate_);
+	pnh.param("map_delta_keyframe_interval", mapDeltaKeyFrameInterval_, mapDeltaKeyFrameInterval_);
+	if(processAsyncQueueSize_ < 1)
+	{
+		NODELET_WARN("Parameter \"process_async_queue_size\" should be >= 1 (set to %d), using 1.", processAsyncQueueSize_);
+		processAsyncQueueSize_ = 1;
+	}
 	if(pnh.hasParam("flip_scan"))
 	{
 		NODELET_WARN("Parameter \"flip_scan\" doesn't exist anymore. Rtabmap now "
@@ -228,9 +354,46 @@ void CoreWrapper::onInit()
 	}
 	NODELET_INFO("rtabmap: map_frame_id  = %s", mapFrameId_.c_str());
 	NODELET_INFO("rtabmap: use_action_for_goal  = %s", useActionForGoal_?"true":"false");
+	NODELET_INFO("rtabmap: fast_start    = %s", fastStart_?"true":"false");
+	NODELET_INFO("rtabmap: map_cache_persist = %s", mapCachePersist_?"true":"false");
+	NODELET_INFO("rtabmap: localization_lightweight = %s", localizationLightweight_?"true":"false");
+	NODELET_INFO("rtabmap: plan_cache_size = %d", planCacheSize);
+	NODELET_INFO("rtabmap: plan_cache_repair_ratio = %f", planCacheRepairRatio);
+	NODELET_INFO("rtabmap: query_threads = %d", queryThreads_);
+	NODELET_INFO("rtabmap: words_packing = %d", wordsPacking_);
+	NODELET_INFO("rtabmap: graph_packing = %d", graphPacking_);
 	NODELET_INFO("rtabmap: tf_delay      = %f", tfDelay);
 	NODELET_INFO("rtabmap: tf_tolerance  = %f", tfTolerance);
+	NODELET_INFO("rtabmap: tf_extrapolate = %s", tfExtrapolate_?"true":"false");
+	NODELET_INFO("rtabmap: backup_async_max_rate = %f MB/s", backupMaxRate_);
+	NODELET_INFO("rtabmap: memory_soft_limit = %f MB", memorySoftLimit_);
+	NODELET_INFO("rtabmap: tf_static_cache = %s", tfStaticCache_?"true":"false");
 	NODELET_INFO("rtabmap: odom_sensor_sync   = %s", odomSensorSync_?"true":"false");
+	NODELET_INFO("rtabmap: compressed_passthrough = %s", compressedPassthrough_?"true":"false");
+	NODELET_INFO("rtabmap: sensor_data_handoff = %s", sensorDataHandoff?"true":"false");
+	NODELET_INFO("rtabmap: process_async      = %s", processAsync_?"true":"false");
+	if(processAsync_)
+	{
+		NODELET_INFO("rtabmap: process_async_queue_size  = %d", processAsyncQueueSize_);
+		NODELET_INFO("rtabmap: process_async_drop_policy = %s", processAsyncKeepLatest_?"keep_latest":"drop_oldest");
+	}
+	NODELET_INFO("rtabmap: async_callback_queue = %s", asyncCallbackQueue?"true":"false");
+	NODELET_INFO("rtabmap: publish_maps_async = %s", publishMapsAsync_?"true":"false");
+	NODELET_INFO("rtabmap: publish_map_delta  = %s", mapDeltaEnabled_?"true":"false");
+	if(mapDeltaEnabled_)
+	{
+		NODELET_INFO("rtabmap: map_delta_linear_update     = %f", mapDeltaLinearUpdate_);
+		NODELET_INFO("rtabmap: map_delta_angular_update    = %f", mapDeltaAngularUpdate_);
+		NODELET_INFO("rtabmap: map_delta_keyframe_interval = %d", mapDeltaKeyFrameInterval_);
+	}
+	// IMU, intermediate odometry, GPS, tags and user data can be served by
+	// their own thread, so they are not delayed by the synchronized callbacks
+	ros::NodeHandle asyncNh = nh;
+	if(asyncCallbackQueue)
+	{
+		asyncNh.setCallbackQueue(&asyncQueue_);
+	}
+
 	bool subscribeStereo = false;
 	pnh.param("subscribe_stereo",      subscribeStereo, subscribeStereo);
 	if(subscribeStereo)
@@ -262,6 +425,7 @@ void CoreWrapper::onInit()
 
 	infoPub_ = nh.advertise<rtabmap_ros::Info>("info", 1);
 	mapDataPub_ = nh.advertise<rtabmap_ros::MapData>("mapData", 1);
+	mapDataGridsPub_ = nh.advertise<rtabmap_ros::MapData>("mapDataGrids", 10);
 	mapGraphPub_ = nh.advertise<rtabmap_ros::MapGraph>("mapGraph", 1);
 	landmarksPub_ = nh.advertise<geometry_msgs::PoseArray>("landmarks", 1);
 	labelsPub_ = nh.advertise<visualization_msgs::MarkerArray>("labels", 1);
@@ -331,42 +495,26 @@ void CoreWrapper::onInit()
 		}
 	}
 
-	// update parameters with user input parameters (private)
+	// update parameters with user input parameters (private), all
+	// fetched at once instead of requesting the master for each parameter
+	UTimer paramTimer;
+	XmlRpc::XmlRpcValue paramTree = rtabmap_ros::getParameterTree(pnh);
 	for(ParametersMap::iterator iter=allParameters.begin(); iter!=allParameters.end(); ++iter)
 	{
 		std::string vStr;
-		bool vBool;
-		int vInt;
-		double vDouble;
-		if(pnh.getParam(iter->first, vStr))
+		XmlRpc::XmlRpcValue::Type type;
+		if(rtabmap_ros::getParameterFromTree(paramTree, iter->first, vStr, &type))
 		{
 			NODELET_INFO("Setting RTAB-Map parameter \"%s\"=\"%s\"", iter->first.c_str(), vStr.c_str());
 
-			if(iter->first.compare(Parameters::kRtabmapWorkingDirectory()) == 0)
-			{
-				vStr = uReplaceChar(vStr, '~', UDirectory::homeDir());
-			}
-			else if(iter->first.compare(Parameters::kKpDictionaryPath()) == 0)
+			if(type == XmlRpc::XmlRpcValue::TypeString &&
+			   (iter->first.compare(Parameters::kRtabmapWorkingDirectory()) == 0 ||
+				iter->first.compare(Parameters::kKpDictionaryPath()) == 0))
 			{
 				vStr = uReplaceChar(vStr, '~', UDirectory::homeDir());
 			}
 			uInsert(parameters_, ParametersPair(iter->first, vStr));
 		}
-		else if(pnh.getParam(iter->first, vBool))
-		{
-			NODELET_INFO("Setting RTAB-Map parameter \"%s\"=\"%s\"", iter->first.c_str(), uBool2Str(vBool).c_str());
-			uInsert(parameters_, ParametersPair(iter->first, uBool2Str(vBool)));
-		}
-		else if(pnh.getParam(iter->first, vDouble))
-		{
-			NODELET_INFO("Setting RTAB-Map parameter \"%s\"=\"%s\"", iter->first.c_str(), uNumber2Str(vDouble).c_str());
-			uInsert(parameters_, ParametersPair(iter->first, uNumber2Str(vDouble)));
-		}
-		else if(pnh.getParam(iter->first, vInt))
-		{
-			NODELET_INFO("Setting RTAB-Map parameter \"%s\"=\"%s\"", iter->first.c_str(), uNumber2Str(vInt).c_str());
-			uInsert(parameters_, ParametersPair(iter->first, uNumber2Str(vInt)));
-		}
 	}
 
 	//parse input arguments
@@ -394,27 +542,8 @@ void CoreWrapper::onInit()
 		iter!=Parameters::getRemovedParameters().end();
 		++iter)
 	{
-		std::string vStr;
-		bool vBool;
-		int vInt;
-		double vDouble;
 		std::string paramValue;
-		if(pnh.getParam(iter->first, vStr))
-		{
-			paramValue = vStr;
-		}
-		else if(pnh.getParam(iter->first, vBool))
-		{
-			paramValue = uBool2Str(vBool);
-		}
-		else if(pnh.getParam(iter->first, vDouble))
-		{
-			paramValue = uNumber2Str(vDouble);
-		}
-		else if(pnh.getParam(iter->first, vInt))
-		{
-			paramValue = uNumber2Str(vInt);
-		}
+		rtabmap_ros::getParameterFromTree(paramTree, iter->first, paramValue);
 		if(!paramValue.empty())
 		{
 			if(iter->second.first)
@@ -440,6 +569,8 @@ void CoreWrapper::onInit()
 		}
 	}
 
+	double paramTime = paramTimer.ticks();
+
 	// Backward compatibility (MapsManager)
 	mapsManager_.backwardCompatibilityParameters(pnh, parameters_);
 
@@ -573,13 +704,13 @@ void CoreWrapper::onInit()
 					NODELET_INFO("Subscribe to inter odom + info messages");
 					interOdomSync_ = new message_filters::Synchronizer<MyExactInterOdomSyncPolicy>(MyExactInterOdomSyncPolicy(100), interOdomSyncSub_, interOdomInfoSyncSub_);
 					interOdomSync_->registerCallback(boost::bind(&CoreWrapper::interOdomInfoCallback, this, _1, _2));
-					interOdomSyncSub_.subscribe(nh, "inter_odom", 1);
-					interOdomInfoSyncSub_.subscribe(nh, "inter_odom_info", 1);
+					interOdomSyncSub_.subscribe(asyncNh, "inter_odom", 1);
+					interOdomInfoSyncSub_.subscribe(asyncNh, "inter_odom_info", 1);
 				}
 				else
 				{
 					NODELET_INFO("Subscribe to inter odom messages");
-					interOdomSub_ = nh.subscribe("inter_odom", 100, &CoreWrapper::interOdomCallback, this);
+					interOdomSub_ = asyncNh.subscribe("inter_odom", 100, &CoreWrapper::interOdomCallback, this);
 				}
 
 			}
@@ -621,6 +752,7 @@ void CoreWrapper::onInit()
 		{
 			NODELET_INFO("rtabmap: Deleted database \"%s\" (--delete_db_on_start or -d are set).", databasePath_.c_str());
 		}
+		UFile::erase(databasePath_ + ".maps_cache");
 	}
 
 	if(databasePath_.size())
@@ -635,19 +767,16 @@ void CoreWrapper::onInit()
 	mapsManager_.setParameters(parameters_);
 
 	// Init RTAB-Map
+	unsigned long long dbStamp = databaseStamp(databasePath_);
 	rtabmap_.init(parameters_, databasePath_);
 
 	if(rtabmap_.getMemory())
 	{
+		loadMapsCacheFile(dbStamp);
+
 		if(useSavedMap_ && !rtabmap_.getMemory()->isIncremental())
 		{
-			float xMin, yMin, gridCellSize;
-			cv::Mat map = rtabmap_.getMemory()->load2DMap(xMin, yMin, gridCellSize);
-			if(!map.empty())
-			{
-				NODELET_INFO("rtabmap: 2D occupancy grid map loaded (%dx%d).", map.cols, map.rows);
-				mapsManager_.set2DMap(map, xMin, yMin, gridCellSize, rtabmap_.getLocalOptimizedPoses(), rtabmap_.getMemory());
-			}
+			loadSavedMap("rtabmap");
 		}
 
 		if(rtabmap_.getMemory()->getWorkingMem().size()>1)
@@ -672,7 +801,12 @@ void CoreWrapper::onInit()
 		}
 	}
 
-	// setup services
+	// setup services, read-only map queries can be served by their own threads
+	ros::NodeHandle queryNh = nh;
+	if(queryThreads_ > 0)
+	{
+		queryNh.setCallbackQueue(&queryQueue_);
+	}
 	updateSrv_ = nh.advertiseService("update_parameters", &CoreWrapper::updateRtabmapCallback, this);
 	resetSrv_ = nh.advertiseService("reset", &CoreWrapper::resetRtabmapCallback, this);
 	pauseSrv_ = nh.advertiseService("pause", &CoreWrapper::pauseRtabmapCallback, this);
@@ -680,13 +814,15 @@ void CoreWrapper::onInit()
 	loadDatabaseSrv_ = nh.advertiseService("load_database", &CoreWrapper::loadDatabaseCallback, this);
 	triggerNewMapSrv_ = nh.advertiseService("trigger_new_map", &CoreWrapper::triggerNewMapCallback, this);
 	backupDatabase_ = nh.advertiseService("backup", &CoreWrapper::backupDatabaseCallback, this);
+	backupDatabaseAsync_ = nh.advertiseService("backup_async", &CoreWrapper::backupDatabaseAsyncCallback, this);
+	backupProgressPub_ = nh.advertise<rtabmap_ros::BackupProgress>("backup_progress", 1, true);
 	setModeLocalizationSrv_ = nh.advertiseService("set_mode_localization", &CoreWrapper::setModeLocalizationCallback, this);
 	setModeMappingSrv_ = nh.advertiseService("set_mode_mapping", &CoreWrapper::setModeMappingCallback, this);
 	getNodeDataSrv_ = nh.advertiseService("get_node_data", &CoreWrapper::getNodeDataCallback, this);
-	getMapDataSrv_ = nh.advertiseService("get_map_data", &CoreWrapper::getMapDataCallback, this);
+	getMapDataSrv_ = queryNh.advertiseService("get_map_data", &CoreWrapper::getMapDataCallback, this);
 	getMapData2Srv_ = nh.advertiseService("get_map_data2", &CoreWrapper::getMapData2Callback, this);
-	getMapSrv_ = nh.advertiseService("get_map", &CoreWrapper::getMapCallback, this);
-	getProbMapSrv_ = nh.advertiseService("get_prob_map", &CoreWrapper::getProbMapCallback, this);
+	getMapSrv_ = queryNh.advertiseService("get_map", &CoreWrapper::getMapCallback, this);
+	getProbMapSrv_ = queryNh.advertiseService("get_prob_map", &CoreWrapper::getProbMapCallback, this);
 	getGridMapSrv_ = nh.advertiseService("get_grid_map", &CoreWrapper::getGridMapCallback, this);
 	getProjMapSrv_ = nh.advertiseService("get_proj_map", &CoreWrapper::getProjMapCallback, this);
 	publishMapDataSrv_ = nh.advertiseService("publish_map", &CoreWrapper::publishMapCallback, this);
@@ -695,13 +831,16 @@ void CoreWrapper::onInit()
 	setGoalSrv_ = nh.advertiseService("set_goal", &CoreWrapper::setGoalCallback, this);
 	cancelGoalSrv_ = nh.advertiseService("cancel_goal", &CoreWrapper::cancelGoalCallback, this);
 	setLabelSrv_ = nh.advertiseService("set_label", &CoreWrapper::setLabelCallback, this);
-	listLabelsSrv_ = nh.advertiseService("list_labels", &CoreWrapper::listLabelsCallback, this);
+	listLabelsSrv_ = queryNh.advertiseService("list_labels", &CoreWrapper::listLabelsCallback, this);
 	addLinkSrv_ = nh.advertiseService("add_link", &CoreWrapper::addLinkCallback, this);
-	getNodesInRadiusSrv_ = nh.advertiseService("get_nodes_in_radius", &CoreWrapper::getNodesInRadiusCallback, this);
+	addLinksSrv_ = nh.advertiseService("add_links", &CoreWrapper::addLinksCallback, this);
+	getNodesInRadiusSrv_ = queryNh.advertiseService("get_nodes_in_radius", &CoreWrapper::getNodesInRadiusCallback, this);
+	getNodesByDescriptorSrv_ = nh.advertiseService("get_nodes_by_descriptor", &CoreWrapper::getNodesByDescriptorCallback, this);
+	getCloudChunksSrv_ = nh.advertiseService("get_cloud_chunks", &CoreWrapper::getCloudChunksCallback, this);
 #ifdef WITH_OCTOMAP_MSGS
 #ifdef RTABMAP_OCTOMAP
 	octomapBinarySrv_ = nh.advertiseService("octomap_binary", &CoreWrapper::octomapBinaryCallback, this);
-	octomapFullSrv_ = nh.advertiseService("octomap_full", &CoreWrapper::octomapFullCallback, this);
+	octomapFullSrv_ = queryNh.advertiseService("octomap_full", &CoreWrapper::octomapFullCallback, this);
 #endif
 #endif
 	//private services
@@ -723,7 +862,34 @@ void CoreWrapper::onInit()
 				Parameters::kOptimizerIterations().c_str(), mapFrameId_.c_str());
 	}
 
+	if(processAsync_)
+	{
+		processThreadRunning_ = true;
+		processThread_ = new boost::thread(boost::bind(&CoreWrapper::processLoop, this));
+	}
+
+	if(publishMapsAsync_)
+	{
+		mapsThreadRunning_ = true;
+		mapsThread_ = new boost::thread(boost::bind(&CoreWrapper::publishMapsLoop, this));
+	}
+
 	setupCallbacks(nh, pnh, getName()); // do it at the end
+	if(sensorDataHandoff)
+	{
+		if(this->isSubscribedToRGBD() && this->rgbdCameras() == 1)
+		{
+			// Odometry in the same nodelet manager publishing on this
+			// topic hands off its SensorData instead of the images
+			sensorDataHandoffTopic_ = nh.resolveName("rgbd_image");
+			SensorDataHandoff::instance().addConsumer(sensorDataHandoffTopic_, frameId_);
+			NODELET_INFO("rtabmap: SensorData handoff enabled on %s", sensorDataHandoffTopic_.c_str());
+		}
+		else
+		{
+			NODELET_WARN("rtabmap: sensor_data_handoff is only supported with subscribe_rgbd=true and rgbd_cameras=1, it is ignored.");
+		}
+	}
 	if(!this->isDataSubscribed())
 	{
 		bool isRGBD = uStr2Bool(parameters_.at(Parameters::kRGBDEnabled()).c_str());
@@ -803,22 +969,101 @@ void CoreWrapper::onInit()
 
 	// set public parameters
 	nh.setParam("is_rtabmap_paused", paused_);
+	// set one by one: setting a group as a struct would replace the
+	// whole namespace, removing the other parameters already set in it
 	for(ParametersMap::iterator iter=parameters_.begin(); iter!=parameters_.end(); ++iter)
 	{
 		nh.setParam(iter->first, iter->second);
 	}
 
-	userDataAsyncSub_ = nh.subscribe("user_data_async", 1, &CoreWrapper::userDataAsyncCallback, this);
-	globalPoseAsyncSub_ = nh.subscribe("global_pose", 1, &CoreWrapper::globalPoseAsyncCallback, this);
-	gpsFixAsyncSub_ = nh.subscribe("gps/fix", 1, &CoreWrapper::gpsFixAsyncCallback, this);
+	userDataAsyncSub_ = asyncNh.subscribe("user_data_async", 1, &CoreWrapper::userDataAsyncCallback, this);
+	globalPoseAsyncSub_ = asyncNh.subscribe("global_pose", 1, &CoreWrapper::globalPoseAsyncCallback, this);
+	gpsFixAsyncSub_ = asyncNh.subscribe("gps/fix", 1, &CoreWrapper::gpsFixAsyncCallback, this);
 #ifdef WITH_APRILTAG_ROS
-	tagDetectionsSub_ = nh.subscribe("tag_detections", 1, &CoreWrapper::tagDetectionsAsyncCallback, this);
+	tagDetectionsSub_ = asyncNh.subscribe("tag_detections", 1, &CoreWrapper::tagDetectionsAsyncCallback, this);
 #endif
-	imuSub_ = nh.subscribe("imu", 100, &CoreWrapper::imuAsyncCallback, this);
+	imuSub_ = asyncNh.subscribe("imu", 100, &CoreWrapper::imuAsyncCallback, this);
+
+	if(asyncCallbackQueue)
+	{
+		asyncSpinner_ = new ros::AsyncSpinner(1, &asyncQueue_);
+		asyncSpinner_->start();
+	}
+
+	if(queryThreads_ > 0)
+	{
+		{
+			UScopeMutex lock(rtabmapMutex_);
+			updateMapSnapshot();
+		}
+		querySpinner_ = new ros::AsyncSpinner(queryThreads_, &queryQueue_);
+		querySpinner_->start();
+	}
+
+	NODELET_INFO("rtabmap: initialized in %f s (parameters read in %f s)", initTimer.ticks(), paramTime);
 }
 
 CoreWrapper::~CoreWrapper()
 {
+	if(!sensorDataHandoffTopic_.empty())
+	{
+		SensorDataHandoff::instance().removeConsumer(sensorDataHandoffTopic_, frameId_);
+	}
+
+	if(asyncSpinner_)
+	{
+		asyncSpinner_->stop();
+		delete asyncSpinner_;
+		asyncSpinner_ = 0;
+	}
+	if(querySpinner_)
+	{
+		querySpinner_->stop();
+		delete querySpinner_;
+		querySpinner_ = 0;
+	}
+
+	if(processThread_)
+	{
+		processQueueMutex_.lock();
+		processThreadRunning_ = false;
+		processQueueCondition_.notify_all();
+		processQueueMutex_.unlock();
+		processThread_->join();
+		delete processThread_;
+		processThread_ = 0;
+	}
+
+	if(mapsThread_)
+	{
+		mapsUpdateMutex_.lock();
+		mapsThreadRunning_ = false;
+		mapsUpdateCondition_.notify_all();
+		mapsUpdateMutex_.unlock();
+		mapsThread_->join();
+		delete mapsThread_;
+		mapsThread_ = 0;
+	}
+
+	if(mapCacheThread_)
+	{
+		mapCacheMutex_.lock();
+		mapCacheThreadRunning_ = false;
+		mapCacheCondition_.notify_all();
+		mapCacheMutex_.unlock();
+		mapCacheThread_->join();
+		delete mapCacheThread_;
+		mapCacheThread_ = 0;
+	}
+
+	if(backupThread_)
+	{
+		backupThreadRunning_ = false;
+		backupThread_->join();
+		delete backupThread_;
+		backupThread_ = 0;
+	}
+
 	if(transformThread_)
 	{
 		tfThreadRunning_ = false;
@@ -850,9 +1095,11 @@ CoreWrapper::~CoreWrapper()
 
 	rtabmap_.close();
 	printf("rtabmap: Saving database/long-term memory...done! (located at %s, %ld MB)\n", databasePath_.c_str(), UFile::length(databasePath_)/(1024*1024));
+	saveMapsCacheFile();
 
 	delete interOdomSync_;
 	delete mbClient_;
+	delete tfStaticCache_;
 }
 
 void CoreWrapper::loadParameters(const std::string & configFile, ParametersMap & parameters)
@@ -891,19 +1138,26 @@ void CoreWrapper::publishLoop(double tfDelay, double tfTolerance)
 	if(tfDelay == 0)
 		return;
 	ros::Rate r(1.0 / tfDelay);
+	std::string odomFrameId;
 	while(tfThreadRunning_)
 	{
-		if(!odomFrameId_.empty())
+		// Never wait on process(): the correction is read from a lock-free
+		// snapshot and the odometry frame is only refreshed if not busy.
+		if(mapToOdomMutex_.try_lock())
+		{
+			odomFrameId = odomFrameId_;
+			mapToOdomMutex_.unlock();
+		}
+		if(!odomFrameId.empty())
 		{
-			mapToOdomMutex_.lock();
-			ros::Time tfExpiration = ros::Time::now() + ros::Duration(tfTolerance);
+			ros::Time now = ros::Time::now();
+			ros::Time tfExpiration = now + ros::Duration(tfTolerance);
 			geometry_msgs::TransformStamped msg;
-			msg.child_frame_id = odomFrameId_;
+			msg.child_frame_id = odomFrameId;
 			msg.header.frame_id = mapFrameId_;
 			msg.header.stamp = tfExpiration;
-			rtabmap_ros::transformToGeometryMsg(mapToOdom_, msg.transform);
+			rtabmap_ros::transformToGeometryMsg(mapToOdomSnapshot_.get(now.toSec(), tfExtrapolate_), msg.transform);
 			tfBroadcaster_.sendTransform(msg);
-			mapToOdomMutex_.unlock();
 		}
 		r.sleep();
 	}
@@ -950,6 +1204,7 @@ void CoreWrapper::defaultCallback(const sensor_msgs::ImageConstPtr & imageMsg)
 		}
 
 		// process data
+		UScopeMutex lock(rtabmapMutex_);
 		UTimer timer;
 		if(rtabmap_.isIDsGenerated() || ptrImage->header.seq > 0)
 		{
@@ -959,6 +1214,8 @@ void CoreWrapper::defaultCallback(const sensor_msgs::ImageConstPtr & imageMsg)
 			}
 			else
 			{
+				nodesIndexOutdated_ = true;
+				updateMapSnapshot();
 				this->publishStats(ros::Time::now());
 			}
 		}
@@ -980,12 +1237,15 @@ void CoreWrapper::defaultCallback(const sensor_msgs::ImageConstPtr & imageMsg)
 
 bool CoreWrapper::odomUpdate(const nav_msgs::OdometryConstPtr & odomMsg, ros::Time stamp)
 {
+	timeOdomTfWait_ = 0.0;
 	if(!paused_)
 	{
 		Transform odom = rtabmap_ros::transformFromPoseMsg(odomMsg->pose.pose);
 		if(!odom.isNull())
 		{
+			UTimer tfTimer;
 			Transform odomTF = rtabmap_ros::getTransform(odomMsg->header.frame_id, frameId_, stamp, tfListener_, waitForTransform_?waitForTransformDuration_:0.0);
+			timeOdomTfWait_ = tfTimer.ticks();
 			if(odomTF.isNull())
 			{
 				static bool shown = false;
@@ -1081,10 +1341,13 @@ bool CoreWrapper::odomUpdate(const nav_msgs::OdometryConstPtr & odomMsg, ros::Ti
 
 bool CoreWrapper::odomTFUpdate(const ros::Time & stamp)
 {
+	timeOdomTfWait_ = 0.0;
 	if(!paused_)
 	{
 		// Odom TF ready?
+		UTimer tfTimer;
 		Transform odom = rtabmap_ros::getTransform(odomFrameId_, frameId_, stamp, tfListener_, waitForTransform_?waitForTransformDuration_:0.0);
+		timeOdomTfWait_ = tfTimer.ticks();
 		if(odom.isNull())
 		{
 			return false;
@@ -1220,13 +1483,51 @@ void CoreWrapper::commonDepthCallbackImpl(
 		const std::vector<cv::Mat> & localDescriptorsMsgs)
 {
 	UTimer timerConversion;
+
+#ifdef RTABMAP_ROS_FRAME_ALLOC_STATS
+	// capacity left by the previous frame, should stop growing after the first frames
+	frameAllocStats_.add(frameCameraModels_);
+	frameAllocStats_.add(frameKeyPoints_);
+	frameAllocStats_.add(framePoints_);
+	addFrameStorage(frameAllocStats_);
+	if(frameAllocStats_.frame())
+	{
+		NODELET_INFO("rtabmap: per-frame storage grew at frame %lu (%lu bytes reserved, growth in %lu/%lu frames)",
+				frameAllocStats_.frames(),
+				frameAllocStats_.reservedBytes(),
+				frameAllocStats_.framesGrown(),
+				frameAllocStats_.frames());
+	}
+#endif
+
 	cv::Mat rgb;
 	cv::Mat depth;
-	std::vector<rtabmap::CameraModel> cameraModels;
-	std::vector<cv::KeyPoint> keypoints;
-	std::vector<cv::Point3f> points;
+	std::vector<rtabmap::CameraModel> & cameraModels = frameCameraModels_;
+	std::vector<cv::KeyPoint> & keypoints = frameKeyPoints_;
+	std::vector<cv::Point3f> & points = framePoints_;
+	cameraModels.clear();
+	keypoints.clear();
+	points.clear();
 	cv::Mat descriptors;
-	if(!rtabmap_ros::convertRGBDMsgs(
+	if(!sensorDataHandoffTopic_.empty() && imageMsgs.empty() && depthMsgs.empty() && cameraInfoMsgs.size() == 1)
+	{
+		// Only headers received, the data has been handed off by odometry
+		// (already in frameId_ at the same stamp than the odometry)
+		boost::shared_ptr<const SensorData> handoff = SensorDataHandoff::instance().get(sensorDataHandoffTopic_, cameraInfoMsgs[0].header.stamp);
+		if(handoff.get() == 0)
+		{
+			NODELET_ERROR("Could not find handed off SensorData (stamp=%f) on %s! Aborting rtabmap update...",
+					cameraInfoMsgs[0].header.stamp.toSec(), sensorDataHandoffTopic_.c_str());
+			return;
+		}
+		rgb = handoff->imageRaw();
+		depth = handoff->depthRaw();
+		cameraModels = handoff->cameraModels();
+		keypoints = handoff->keypoints();
+		points = handoff->keypoints3D();
+		descriptors = handoff->descriptors();
+	}
+	else if(!rtabmap_ros::convertRGBDMsgs(
 			imageMsgs,
 			depthMsgs,
 			cameraInfoMsgs,
@@ -1386,6 +1687,23 @@ void CoreWrapper::commonDepthCallbackImpl(
 			rtabmap_ros::timestampFromROS(lastPoseStamp_),
 			userData);
 
+	if(compressedPassthrough_ && currentRGBDImage().get() && imageMsgs.size() == 1 && cameraModels.size() == 1)
+	{
+		// The received compressed images are stored as is in memory instead
+		// of compressing again the raw images (still used for features and maps).
+		// Depth converted to 16 bits (Mem/SaveDepth16Format) cannot be used.
+		cv::Mat rgbCompressed = compressedRgbForSensorData(currentRGBDImage());
+		cv::Mat depthCompressed;
+		if(depthMsgs.size() == 1 && depthMsgs[0]->image.type() == depth.type())
+		{
+			depthCompressed = compressedDepthForSensorData(currentRGBDImage());
+		}
+		if(!rgbCompressed.empty() && (depth.empty() || !depthCompressed.empty()))
+		{
+			data.setRGBDImage(rgbCompressed, depthCompressed, cameraModels, false);
+		}
+	}
+
 	OdometryInfo odomInfo;
 	if(odomInfoMsg.get())
 	{
@@ -1868,128 +2186,68 @@ void CoreWrapper::process(
 	UTimer timer;
 	if(rtabmap_.isIDsGenerated() || data.id() > 0)
 	{
-		// Add intermediate nodes?
-		for(std::list<std::pair<nav_msgs::Odometry, rtabmap_ros::OdomInfo> >::iterator iter=interOdoms_.begin(); iter!=interOdoms_.end();)
+		//Add async stuff
+		Transform groundTruthPose;
+		if(!groundTruthFrameId_.empty())
 		{
-			if(iter->first.header.stamp < lastPoseStamp_)
+			groundTruthPose = rtabmap_ros::getTransform(groundTruthFrameId_, groundTruthBaseFrameId_, stamp, tfListener_, waitForTransform_?waitForTransformDuration_:0.0);
+		}
+		data.setGroundTruth(groundTruthPose);
+
+		// Take the async data received since the last update, the
+		// transforms are looked up after releasing the lock
+		geometry_msgs::PoseWithCovarianceStamped globalPoseMsg;
+		rtabmap::GPS gps;
+		std::map<int, geometry_msgs::PoseWithCovarianceStamped> tags;
+		Transform imuOrientation;
+		std::string imuFrameId;
+		int imuBufferSize = 0;
+		{
+			boost::mutex::scoped_lock lock(asyncDataMutex_);
+			globalPoseMsg = globalPose_;
+			globalPose_.header.stamp = ros::Time(0);
+			gps = gps_;
+			gps_ = rtabmap::GPS();
+			tags.swap(tags_);
+			if(!imus_.empty())
 			{
-				Transform interOdom;
-				if(!rtabmap_.getLocalOptimizedPoses().empty())
+				size_t before, after;
+				if(imus_.bracket(data.stamp(), before, after))
 				{
-					// add intermediate poses only if the current local graph is not empty
-					interOdom = rtabmap_ros::transformFromPoseMsg(iter->first.pose.pose);
-				}
-				if(!interOdom.isNull())
-				{
-					cv::Mat covariance;
-					double variance = iter->first.twist.covariance[0];
-					if(variance == BAD_COVARIANCE || variance <= 0.0f)
-					{
-						//use the one of the pose
-						covariance = cv::Mat(6,6,CV_64FC1, (void*)iter->first.pose.covariance.data()).clone();
-						covariance /= 2.0;
-					}
-					else
-					{
-						covariance = cv::Mat(6,6,CV_64FC1, (void*)iter->first.twist.covariance.data()).clone();
-					}
-					if(!uIsFinite(covariance.at<double>(0,0)) || covariance.at<double>(0,0)<=0.0f)
-					{
-						covariance = cv::Mat::eye(6,6,CV_64FC1);
-						if(odomDefaultLinVariance_ > 0.0f)
-						{
-							covariance.at<double>(0,0) = odomDefaultLinVariance_;
-							covariance.at<double>(1,1) = odomDefaultLinVariance_;
-							covariance.at<double>(2,2) = odomDefaultLinVariance_;
-						}
-						if(odomDefaultAngVariance_ > 0.0f)
-						{
-							covariance.at<double>(3,3) = odomDefaultAngVariance_;
-							covariance.at<double>(4,4) = odomDefaultAngVariance_;
-							covariance.at<double>(5,5) = odomDefaultAngVariance_;
-						}
-					}
-					else if(twoDMapping_)
-					{
-						// If 2d mapping, make sure all diagonal values of the covariance that even not used are not null.
-						covariance.at<double>(2,2) = covariance.at<double>(2,2)!=0?covariance.at<double>(2,2):1;
-						covariance.at<double>(3,3) = covariance.at<double>(3,3)!=0?covariance.at<double>(3,3):1;
-						covariance.at<double>(4,4) = covariance.at<double>(4,4)!=0?covariance.at<double>(4,4):1;
-					}
-
-					SensorData interData(cv::Mat(), cv::Mat(), CameraModel(), -1, rtabmap_ros::timestampFromROS(iter->first.header.stamp));
-					Transform gt;
-					if(!groundTruthFrameId_.empty())
+					imuOrientation = imus_.value(before);
+					if(before != after)
 					{
-						gt = rtabmap_ros::getTransform(groundTruthFrameId_, groundTruthBaseFrameId_, iter->first.header.stamp, tfListener_, waitForTransform_?waitForTransformDuration_:0.0);
+						imuOrientation = imuOrientation.interpolate(
+								float((data.stamp()-imus_.stamp(before)) / (imus_.stamp(after)-imus_.stamp(before))),
+								imus_.value(after));
 					}
-					interData.setGroundTruth(gt);
-
-					std::map<std::string, float> externalStats;
-					std::vector<float> odomVelocity;
-					if(iter->second.timeEstimation != 0.0f)
-					{
-						OdometryInfo info = odomInfoFromROS(iter->second, true);
-						externalStats = rtabmap_ros::odomInfoToStatistics(info);
-
-						if(info.interval>0.0)
-						{
-							odomVelocity.resize(6);
-							float x,y,z,roll,pitch,yaw;
-							info.transform.getTranslationAndEulerAngles(x,y,z,roll,pitch,yaw);
-							odomVelocity[0] = x/info.interval;
-							odomVelocity[1] = y/info.interval;
-							odomVelocity[2] = z/info.interval;
-							odomVelocity[3] = roll/info.interval;
-							odomVelocity[4] = pitch/info.interval;
-							odomVelocity[5] = yaw/info.interval;
-						}
-					}
-
-					rtabmap_.process(interData, interOdom, covariance, odomVelocity, externalStats);
 				}
-				interOdoms_.erase(iter++);
-			}
-			else if(iter->first.header.stamp == lastPoseStamp_)
-			{
-				interOdoms_.erase(iter++);
-				break;
-			}
-			else
-			{
-				break;
+				imuFrameId = imuFrameId_;
+				imuBufferSize = (int)imus_.size();
 			}
 		}
 
-		//Add async stuff
-		Transform groundTruthPose;
-		if(!groundTruthFrameId_.empty())
-		{
-			groundTruthPose = rtabmap_ros::getTransform(groundTruthFrameId_, groundTruthBaseFrameId_, lastPoseStamp_, tfListener_, waitForTransform_?waitForTransformDuration_:0.0);
-		}
-		data.setGroundTruth(groundTruthPose);
-
 		//global pose
-		if(!globalPose_.header.stamp.isZero())
+		if(!globalPoseMsg.header.stamp.isZero())
 		{
 			// assume sensor is fixed
 			Transform sensorToBase = rtabmap_ros::getTransform(
-					globalPose_.header.frame_id,
+					globalPoseMsg.header.frame_id,
 					frameId_,
-					lastPoseStamp_,
+					stamp,
 					tfListener_,
 					waitForTransform_?waitForTransformDuration_:0.0);
 			if(!sensorToBase.isNull())
 			{
-				Transform globalPose = rtabmap_ros::transformFromPoseMsg(globalPose_.pose.pose);
+				Transform globalPose = rtabmap_ros::transformFromPoseMsg(globalPoseMsg.pose.pose);
 				globalPose *= sensorToBase; // transform global pose from sensor frame to robot base frame
 
 				// Correction of the global pose accounting the odometry movement since we received it
 				Transform correction = rtabmap_ros::getTransform(
 						frameId_,
 						odomFrameId,
-						globalPose_.header.stamp,
-						lastPoseStamp_,
+						globalPoseMsg.header.stamp,
+						stamp,
 						tfListener_,
 						waitForTransform_?waitForTransformDuration_:0.0);
 				if(!correction.isNull())
@@ -2002,45 +2260,41 @@ void CoreWrapper::process(
 							"If odometry is small since it received the global pose and "
 							"covariance is large, this should not be a problem.");
 				}
-				cv::Mat globalPoseCovariance = cv::Mat(6,6, CV_64FC1, (void*)globalPose_.pose.covariance.data()).clone();
+				cv::Mat globalPoseCovariance = cv::Mat(6,6, CV_64FC1, (void*)globalPoseMsg.pose.covariance.data()).clone();
 				data.setGlobalPose(globalPose, globalPoseCovariance);
 			}
 		}
-		globalPose_.header.stamp = ros::Time(0);
 
-		if(gps_.stamp() > 0.0)
+		if(gps.stamp() > 0.0)
 		{
-			data.setGPS(gps_);
+			data.setGPS(gps);
 		}
-		gps_ = rtabmap::GPS();
 
 		//tag detections
 		Landmarks landmarks = rtabmap_ros::landmarksFromROS(
-				tags_,
+				tags,
 				frameId_,
 				odomFrameId,
-				lastPoseStamp_,
+				stamp,
 				tfListener_,
 				waitForTransform_?waitForTransformDuration_:0,
 				landmarkDefaultLinVariance_,
 				landmarkDefaultAngVariance_);
-		tags_.clear();
 		if(!landmarks.empty())
 		{
 			data.setLandmarks(landmarks);
 		}
 
 		// IMU
-		if(!imus_.empty())
+		if(imuBufferSize)
 		{
-			Transform t = Transform::getTransform(imus_, data.stamp());
-			if(!t.isNull())
+			if(!imuOrientation.isNull())
 			{
 				// get local transform
 				rtabmap::Transform localTransform;
-				if(frameId_.compare(imuFrameId_) != 0)
+				if(frameId_.compare(imuFrameId) != 0)
 				{
-					localTransform = getTransform(frameId_, imuFrameId_, ros::Time(data.stamp()), tfListener_, waitForTransform_?waitForTransformDuration_:0.0);
+					localTransform = getTransform(frameId_, imuFrameId, ros::Time(data.stamp()), tfListener_, waitForTransform_?waitForTransformDuration_:0.0);
 				}
 				else
 				{
@@ -2049,7 +2303,7 @@ void CoreWrapper::process(
 
 				if(!localTransform.isNull())
 				{
-					Eigen::Quaterniond q = t.getQuaterniond();
+					Eigen::Quaterniond q = imuOrientation.getQuaterniond();
 					data.setIMU(IMU(cv::Vec4d(q.x(), q.y(), q.z(), q.w()), cv::Mat::eye(3,3,CV_64FC1),
 							cv::Vec3d(), cv::Mat(),
 							cv::Vec3d(), cv::Mat(),
@@ -2060,276 +2314,854 @@ void CoreWrapper::process(
 			{
 				ROS_WARN("We are receiving imu data (buffer=%d), but cannot interpolate "
 						"imu transform at time %f. IMU won't be added to graph.",
-						(int)imus_.size(), data.stamp());
+						imuBufferSize, data.stamp());
 			}
 		}
 
-		double timeRtabmap = 0.0;
-		double timeUpdateMaps = 0.0;
-		double timePublishMaps = 0.0;
+		// the async data above is mostly waiting for TF
+		double timeTfWait = timeOdomTfWait_ + timer.elapsed();
+		timeMsgConversion += timer.ticks();
 
-		cv::Mat covariance = odomCovariance;
-		if(covariance.empty() || !uIsFinite(covariance.at<double>(0,0)) || covariance.at<double>(0,0)<=0.0f)
-		{
-			covariance = cv::Mat::eye(6,6,CV_64FC1);
-			if(odomDefaultLinVariance_ > 0.0f)
+		if(processThread_)
+		{
+			ProcessQueueItem item;
+			item.stamp = stamp;
+			item.data = data;
+			item.odom = odom;
+			item.odomFrameId = odomFrameId;
+			item.odomCovariance = odomCovariance;
+			item.odomInfo = odomInfo;
+			item.timeMsgConversion = timeMsgConversion;
+			item.timeTfWait = timeTfWait;
+			item.queuedTime = ros::WallTime::now();
+
+			boost::mutex::scoped_lock lock(processQueueMutex_);
+			size_t dropped = 0;
+			if(processAsyncKeepLatest_)
 			{
-				covariance.at<double>(0,0) = odomDefaultLinVariance_;
-				covariance.at<double>(1,1) = odomDefaultLinVariance_;
-				covariance.at<double>(2,2) = odomDefaultLinVariance_;
+				dropped = processQueue_.size();
+				processQueue_.clear();
 			}
-			if(odomDefaultAngVariance_ > 0.0f)
+			else
+			{
+				while((int)processQueue_.size() >= processAsyncQueueSize_)
+				{
+					processQueue_.pop_front();
+					++dropped;
+				}
+			}
+			if(dropped)
 			{
-				covariance.at<double>(3,3) = odomDefaultAngVariance_;
-				covariance.at<double>(4,4) = odomDefaultAngVariance_;
-				covariance.at<double>(5,5) = odomDefaultAngVariance_;
+				processQueueDropped_ += dropped;
+				NODELET_WARN_THROTTLE(5.0, "rtabmap: Processing is slower than input rate, "
+						"frames are dropped from the processing queue (total dropped=%lu, process_async_drop_policy=%s).",
+						processQueueDropped_,
+						processAsyncKeepLatest_?"keep_latest":"drop_oldest");
 			}
+			processQueue_.push_back(item);
+			processQueueCondition_.notify_one();
 		}
-		else if(twoDMapping_)
+		else
 		{
-			// If 2d mapping, make sure all diagonal values of the covariance that even not used are not null.
-			covariance.at<double>(2,2) = covariance.at<double>(2,2)!=0?covariance.at<double>(2,2):1;
-			covariance.at<double>(3,3) = covariance.at<double>(3,3)!=0?covariance.at<double>(3,3):1;
-			covariance.at<double>(4,4) = covariance.at<double>(4,4)!=0?covariance.at<double>(4,4):1;
+			processImpl(stamp, data, odom, odomFrameId, odomCovariance, odomInfo, timeMsgConversion, timeTfWait);
 		}
+	}
+	else if(!rtabmap_.isIDsGenerated())
+	{
+		NODELET_WARN("Ignoring received image because its sequence ID=0. Please "
+				 "set \"Mem/GenerateIds\"=\"true\" to ignore ros generated sequence id. "
+				 "Use only \"Mem/GenerateIds\"=\"false\" for once-time run of RTAB-Map and "
+				 "when you need to have IDs output of RTAB-map synchronized with the source "
+				 "image sequence ID.");
+	}
+}
 
-		std::map<std::string, float> externalStats;
-		std::vector<float> odomVelocity;
-		if(odomInfo.timeEstimation != 0.0f)
-		{
-			externalStats = rtabmap_ros::odomInfoToStatistics(odomInfo);
+bool CoreWrapper::processData(
+		SensorData & data,
+		const Transform & odom,
+		const cv::Mat & odomCovariance,
+		const OdometryInfo & odomInfo,
+		std::map<std::string, float> & statistics)
+{
+	UASSERT_MSG(processThread_ == 0, "processData() is synchronous, \"process_async\" should be false.");
+	process(ros::Time(data.stamp()), data, odom, odomFrameId_, odomCovariance, odomInfo);
+	// the stage times of this update are sent with the next one
+	const Statistics & stats = rtabmap_.getStatistics();
+	statistics = stats.data();
+	statistics.insert(rtabmapROSStats_.begin(), rtabmapROSStats_.end());
+	return stats.stamp() == data.stamp();
+}
 
-			if(odomInfo.interval>0.0)
+void CoreWrapper::processLoop()
+{
+	while(processThreadRunning_)
+	{
+		ProcessQueueItem item;
+		{
+			boost::mutex::scoped_lock lock(processQueueMutex_);
+			while(processThreadRunning_ && processQueue_.empty())
 			{
-				odomVelocity.resize(6);
-				float x,y,z,roll,pitch,yaw;
-				odomInfo.transform.getTranslationAndEulerAngles(x,y,z,roll,pitch,yaw);
-				odomVelocity[0] = x/odomInfo.interval;
-				odomVelocity[1] = y/odomInfo.interval;
-				odomVelocity[2] = z/odomInfo.interval;
-				odomVelocity[3] = roll/odomInfo.interval;
-				odomVelocity[4] = pitch/odomInfo.interval;
-				odomVelocity[5] = yaw/odomInfo.interval;
+				processQueueCondition_.wait(lock);
 			}
-		}
-		if(rtabmapROSStats_.size())
-		{
-			externalStats.insert(rtabmapROSStats_.begin(), rtabmapROSStats_.end());
-			rtabmapROSStats_.clear();
+			if(!processThreadRunning_)
+			{
+				break;
+			}
+			item = processQueue_.front();
+			processQueue_.pop_front();
 		}
 
-		timeMsgConversion += timer.ticks();
-		if(rtabmap_.process(data, odom, covariance, odomVelocity, externalStats))
-		{
-			timeRtabmap = timer.ticks();
-			mapToOdomMutex_.lock();
-			mapToOdom_ = rtabmap_.getMapCorrection();
+		processImpl(
+				item.stamp,
+				item.data,
+				item.odom,
+				item.odomFrameId,
+				item.odomCovariance,
+				item.odomInfo,
+				item.timeMsgConversion,
+				item.timeTfWait,
+				(ros::WallTime::now() - item.queuedTime).toSec());
+	}
+}
+
+void CoreWrapper::clearProcessQueue()
+{
+	boost::mutex::scoped_lock lock(processQueueMutex_);
+	processQueue_.clear();
+}
 
-			if(!odomFrameId.empty() && !odomFrameId_.empty() && odomFrameId_.compare(odomFrameId)!=0)
+void CoreWrapper::publishMapsLoop()
+{
+	while(mapsThreadRunning_)
+	{
+		{
+			boost::mutex::scoped_lock lock(mapsUpdateMutex_);
+			while(mapsThreadRunning_ && !mapsUpdatePending_)
 			{
-				ROS_ERROR("Odometry received doesn't have same frame_id "
-						  "than the one previously set (old=%s, new=%s). "
-						  "Are there multiple nodes publishing on same odometry topic name? "
-						  "The new frame_id is now used.", odomFrameId_.c_str(), odomFrameId.c_str());
+				mapsUpdateCondition_.wait(lock);
 			}
-
-			odomFrameId_ = odomFrameId;
-			mapToOdomMutex_.unlock();
-
-			if(data.id() < 0)
+			if(!mapsThreadRunning_)
 			{
-				NODELET_INFO("Intermediate node added");
+				break;
 			}
-			else
+		}
+
+		// Lock order: rtabmapMutex_, mapsMutex_, then mapsUpdateMutex_. The
+		// request is taken only once rtabmap is locked so that a reset done
+		// in the meantime cannot leave us with poses of the previous map.
+		rtabmapMutex_.lock();
+		mapsMutex_.lock();
+		std::map<int, Transform> poses;
+		std::map<int, Signature> signatures;
+		ros::Time stamp;
+		{
+			boost::mutex::scoped_lock lock(mapsUpdateMutex_);
+			if(!mapsUpdatePending_)
 			{
-				// Publish local graph, info
-				this->publishStats(stamp);
-				if(localizationPosePub_.getNumSubscribers() &&
-					!rtabmap_.getStatistics().localizationCovariance().empty())
-				{
-					geometry_msgs::PoseWithCovarianceStamped poseMsg;
-					poseMsg.header.frame_id = mapFrameId_;
-					poseMsg.header.stamp = stamp;
-					rtabmap_ros::transformToPoseMsg(mapToOdom_*odom, poseMsg.pose.pose);
-					poseMsg.pose.covariance;
-					const cv::Mat & cov = rtabmap_.getStatistics().localizationCovariance();
-					memcpy(poseMsg.pose.covariance.data(), cov.data, cov.total()*sizeof(double));
-					localizationPosePub_.publish(poseMsg);
-				}
-				std::map<int, rtabmap::Transform> filteredPoses(rtabmap_.getLocalOptimizedPoses().lower_bound(1), rtabmap_.getLocalOptimizedPoses().end());
-
-				// create a tmp signature with latest sensory data if latest signature was ignored
-				std::map<int, rtabmap::Signature> tmpSignature;
-				if(rtabmap_.getMemory() == 0 ||
-					filteredPoses.size() == 0 ||
-					rtabmap_.getMemory()->getLastSignatureId() != filteredPoses.rbegin()->first ||
-					rtabmap_.getMemory()->getLastWorkingSignature() == 0 ||
-					rtabmap_.getMemory()->getLastWorkingSignature()->sensorData().gridCellSize() == 0 ||
-					(!mapsManager_.getOccupancyGrid()->isGridFromDepth() && data.laserScanRaw().is2d())) // 2d laser scan would fill empty space for latest data
-				{
-					SensorData tmpData = data;
-					tmpData.setId(0);
-					tmpSignature.insert(std::make_pair(0, Signature(0, -1, 0, data.stamp(), "", odom, Transform(), tmpData)));
-					filteredPoses.insert(std::make_pair(0, mapToOdom_*odom));
-				}
+				mapsMutex_.unlock();
+				rtabmapMutex_.unlock();
+				continue;
+			}
+			poses.swap(mapsUpdatePoses_);
+			signatures.swap(mapsUpdateSignatures_);
+			stamp = mapsUpdateStamp_;
+			mapsUpdatePending_ = false;
+		}
 
-				if((mappingMaxNodes_ > 0 || mappingAltitudeDelta_>0.0) && filteredPoses.size()>1)
-				{
-					std::map<int, Transform> nearestPoses = filterNodesToAssemble(filteredPoses, mapToOdom_*odom);
+		UTimer timer;
+		// Only the data of nodes not already in cache is copied from memory,
+		// rtabmap can then process the next data while the maps are generated.
+		mapsManager_.loadUncachedSignatures(poses, rtabmap_.getMemory(), signatures);
+		rtabmapMutex_.unlock();
 
-					//add latest/zero and make sure those on a planned path are not filtered
-					std::set<int> onPath;
-					if(rtabmap_.getPath().size())
-					{
-						std::vector<int> nextNodes = rtabmap_.getPathNextNodes();
-						onPath.insert(nextNodes.begin(), nextNodes.end());
-					}
-					for(std::map<int, Transform>::iterator iter=filteredPoses.begin(); iter!=filteredPoses.end(); ++iter)
-					{
-						if(iter->first == 0 || onPath.find(iter->first) != onPath.end())
-						{
-							nearestPoses.insert(*iter);
-						}
-						else if(onPath.empty())
-						{
-							break;
-						}
-					}
+		poses = mapsManager_.updateMapCaches(poses, 0, false, false, signatures);
+		double timeUpdate = timer.ticks();
+		mapsManager_.publishMaps(poses, stamp, mapFrameId_);
+		double timePublish = timer.ticks();
+		mapsMutex_.unlock();
 
-					filteredPoses = nearestPoses;
-				}
+		boost::mutex::scoped_lock lock(mapsUpdateMutex_);
+		mapsLastUpdateTime_ = timeUpdate;
+		mapsLastPublishTime_ = timePublish;
+	}
+}
 
-				// Update maps
-				filteredPoses = mapsManager_.updateMapCaches(
-						filteredPoses,
-						rtabmap_.getMemory(),
-						false,
-						false,
-						tmpSignature);
+void CoreWrapper::clearMapsUpdate()
+{
+	boost::mutex::scoped_lock lock(mapsUpdateMutex_);
+	mapsUpdatePending_ = false;
+	mapsUpdatePoses_.clear();
+	mapsUpdateSignatures_.clear();
+}
 
-				timeUpdateMaps = timer.ticks();
+void CoreWrapper::loadSavedMap(const char * logPrefix)
+{
+	// rtabmapMutex_ and mapsMutex_ should be locked
+	float xMin, yMin, gridCellSize;
+	cv::Mat map = rtabmap_.getMemory()->load2DMap(xMin, yMin, gridCellSize);
+	if(!map.empty())
+	{
+		NODELET_INFO("%s: 2D occupancy grid map loaded (%dx%d).", logPrefix, map.cols, map.rows);
+		if(fastStart_)
+		{
+			// Ready to localize right away with the saved map, the local
+			// grids (needed only if the map has to be regenerated) are
+			// loaded in background.
+			mapsManager_.set2DMap(map, xMin, yMin, gridCellSize, rtabmap_.getLocalOptimizedPoses());
+			loadMapCacheAsync(rtabmap_.getLocalOptimizedPoses());
+		}
+		else
+		{
+			mapsManager_.set2DMap(map, xMin, yMin, gridCellSize, rtabmap_.getLocalOptimizedPoses(), rtabmap_.getMemory());
+		}
+	}
+}
 
-				mapsManager_.publishMaps(filteredPoses, stamp, mapFrameId_);
+bool CoreWrapper::isLocalizationLightweight() const
+{
+	return localizationLightweight_ && rtabmap_.getMemory() && !rtabmap_.getMemory()->isIncremental();
+}
 
-				// update goal if planning is enabled
-				if(!currentMetricGoal_.isNull())
-				{
-					if(rtabmap_.getPath().size() == 0)
-					{
-						// Don't send status yet if move_base actionlib is used unless it failed,
-						// let move_base finish reaching the goal
-						if(mbClient_ == 0 || rtabmap_.getPathStatus() <= 0)
-						{
-							if(rtabmap_.getPathStatus() > 0)
-							{
-								// Goal reached
-								NODELET_INFO("Planning: Publishing goal reached!");
-							}
-							else if(rtabmap_.getPathStatus() <= 0)
-							{
-								NODELET_WARN("Planning: Plan failed!");
-								if(mbClient_ && mbClient_->isServerConnected())
-								{
-									mbClient_->cancelGoal();
-								}
-							}
+void CoreWrapper::publishLocalizationMaps(const ros::Time & stamp)
+{
+	// rtabmapMutex_ should be locked
+	boost::mutex::scoped_lock lock(mapsMutex_);
+	if(!localizationMapsLatched_)
+	{
+		// Nodes of the loaded map only, new nodes are not kept in localization
+		localizationMapPoses_ = std::map<int, Transform>(rtabmap_.getLocalOptimizedPoses().lower_bound(1), rtabmap_.getLocalOptimizedPoses().end());
+		if(localizationMapPoses_.empty())
+		{
+			return;
+		}
+		UTimer timer;
+		// the grid is always generated, other maps only if they have subscribers
+		localizationMapPoses_ = mapsManager_.updateMapCaches(localizationMapPoses_, rtabmap_.getMemory(), true, false);
+		mapsManager_.publishMaps(localizationMapPoses_, stamp, mapFrameId_);
+		localizationMapsLatched_ = true;
+		NODELET_INFO("rtabmap: Localization maps generated and latched (%d nodes, %fs).", (int)localizationMapPoses_.size(), timer.ticks());
+	}
+	else
+	{
+		// poses didn't change, only maps of the new subscribers are generated
+		mapsManager_.updateMapCaches(localizationMapPoses_, rtabmap_.getMemory(), false, false);
+		mapsManager_.publishMaps(localizationMapPoses_, stamp, mapFrameId_);
+	}
+	// local grids/clouds are reloaded from the memory if needed
+	mapsManager_.reduceCacheMemory(0);
+}
 
-							if(goalReachedPub_.getNumSubscribers())
+void CoreWrapper::loadMapsCacheFile(unsigned long long databaseStamp)
+{
+	// rtabmapMutex_ and mapsMutex_ should be locked (if already running)
+	if(mapCachePersist_ && databaseStamp != 0)
+	{
+		mapsManager_.loadCacheFile(databasePath_ + ".maps_cache", rtabmap_.getMemory()->getAllSignatureIds(), databaseStamp);
+	}
+}
+
+void CoreWrapper::saveMapsCacheFile()
+{
+	// after rtabmap_.close(), so that the stamp of the saved database is used
+	if(mapCachePersist_ && !databasePath_.empty())
+	{
+		mapsManager_.saveCacheFile(databasePath_ + ".maps_cache", databaseStamp(databasePath_));
+	}
+}
+
+void CoreWrapper::loadMapCacheAsync(const std::map<int, rtabmap::Transform> & poses)
+{
+	// Empty poses cancels the current loading. If the maps are cleared,
+	// this should be called while mapsMutex_ is locked.
+	boost::mutex::scoped_lock lock(mapCacheMutex_);
+	++mapCacheGeneration_;
+	mapCachePoses_ = poses;
+	if(!poses.empty() && mapCacheThread_ == 0)
+	{
+		mapCacheThreadRunning_ = true;
+		mapCacheThread_ = new boost::thread(boost::bind(&CoreWrapper::loadMapCacheLoop, this));
+	}
+	mapCacheCondition_.notify_one();
+}
+
+void CoreWrapper::loadMapCacheLoop()
+{
+	const size_t batchSize = 100;
+	while(mapCacheThreadRunning_)
+	{
+		std::map<int, Transform> poses;
+		unsigned int generation;
+		{
+			boost::mutex::scoped_lock lock(mapCacheMutex_);
+			while(mapCacheThreadRunning_ && mapCachePoses_.empty())
+			{
+				mapCacheCondition_.wait(lock);
+			}
+			if(!mapCacheThreadRunning_)
+			{
+				break;
+			}
+			poses.swap(mapCachePoses_);
+			generation = mapCacheGeneration_;
+		}
+
+		UTimer timer;
+		int loaded = 0;
+		bool canceled = false;
+		std::map<int, Transform>::const_iterator iter = poses.lower_bound(1);
+		while(iter != poses.end() && !canceled)
+		{
+			// load a batch from the database, processing is blocked only during this step
+			std::vector<SensorData> batch;
+			rtabmapMutex_.lock();
+			if(rtabmap_.getMemory())
+			{
+				for(; iter!=poses.end() && batch.size()<batchSize; ++iter)
+				{
+					batch.push_back(rtabmap_.getMemory()->getNodeData(iter->first, false, false, false, true));
+				}
+			}
+			else
+			{
+				iter = poses.end();
+			}
+			rtabmapMutex_.unlock();
+
+			MapsManager::uncompressLocalGrids(batch);
+
+			boost::mutex::scoped_lock mapsLock(mapsMutex_);
+			{
+				boost::mutex::scoped_lock lock(mapCacheMutex_);
+				canceled = !mapCacheThreadRunning_ || generation != mapCacheGeneration_;
+			}
+			if(!canceled)
+			{
+				mapsManager_.addToGridCache(batch);
+				loaded += batch.size();
+			}
+		}
+		NODELET_INFO("rtabmap: Loaded %d/%d local occupancy grids in background (%fs)%s",
+				loaded, (int)poses.size(), timer.elapsed(), canceled?", canceled":"");
+	}
+}
+
+void CoreWrapper::processImpl(
+		const ros::Time & stamp,
+		SensorData & data,
+		const Transform & odom,
+		const std::string & odomFrameId,
+		const cv::Mat & odomCovariance,
+		const OdometryInfo & odomInfo,
+		double timeMsgConversion,
+		double timeTfWait,
+		double timeQueued)
+{
+	UScopeMutex lock(rtabmapMutex_);
+	UTimer timer;
+	double dataAge = (ros::Time::now() - stamp).toSec();
+	// Add intermediate nodes?
+	std::list<std::pair<nav_msgs::Odometry, rtabmap_ros::OdomInfo> > interOdoms;
+	interOdomsMutex_.lock();
+	size_t interOdomsEnd = interOdoms_.lowerBound(stamp.toSec());
+	for(size_t i=0; i<interOdomsEnd; ++i)
+	{
+		interOdoms.push_back(interOdoms_.value(i));
+	}
+	if(interOdomsEnd < interOdoms_.size() && interOdoms_.stamp(interOdomsEnd) == stamp.toSec())
+	{
+		// same stamp than the current data
+		++interOdomsEnd;
+	}
+	interOdoms_.popFront(interOdomsEnd);
+	interOdomsMutex_.unlock();
+	for(std::list<std::pair<nav_msgs::Odometry, rtabmap_ros::OdomInfo> >::iterator iter=interOdoms.begin(); iter!=interOdoms.end(); ++iter)
+	{
+		Transform interOdom;
+		if(!rtabmap_.getLocalOptimizedPoses().empty())
+		{
+			// add intermediate poses only if the current local graph is not empty
+			interOdom = rtabmap_ros::transformFromPoseMsg(iter->first.pose.pose);
+		}
+		if(!interOdom.isNull())
+		{
+			cv::Mat covariance;
+			double variance = iter->first.twist.covariance[0];
+			if(variance == BAD_COVARIANCE || variance <= 0.0f)
+			{
+				//use the one of the pose
+				covariance = cv::Mat(6,6,CV_64FC1, (void*)iter->first.pose.covariance.data()).clone();
+				covariance /= 2.0;
+			}
+			else
+			{
+				covariance = cv::Mat(6,6,CV_64FC1, (void*)iter->first.twist.covariance.data()).clone();
+			}
+			if(!uIsFinite(covariance.at<double>(0,0)) || covariance.at<double>(0,0)<=0.0f)
+			{
+				covariance = cv::Mat::eye(6,6,CV_64FC1);
+				if(odomDefaultLinVariance_ > 0.0f)
+				{
+					covariance.at<double>(0,0) = odomDefaultLinVariance_;
+					covariance.at<double>(1,1) = odomDefaultLinVariance_;
+					covariance.at<double>(2,2) = odomDefaultLinVariance_;
+				}
+				if(odomDefaultAngVariance_ > 0.0f)
+				{
+					covariance.at<double>(3,3) = odomDefaultAngVariance_;
+					covariance.at<double>(4,4) = odomDefaultAngVariance_;
+					covariance.at<double>(5,5) = odomDefaultAngVariance_;
+				}
+			}
+			else if(twoDMapping_)
+			{
+				// If 2d mapping, make sure all diagonal values of the covariance that even not used are not null.
+				covariance.at<double>(2,2) = covariance.at<double>(2,2)!=0?covariance.at<double>(2,2):1;
+				covariance.at<double>(3,3) = covariance.at<double>(3,3)!=0?covariance.at<double>(3,3):1;
+				covariance.at<double>(4,4) = covariance.at<double>(4,4)!=0?covariance.at<double>(4,4):1;
+			}
+
+			SensorData interData(cv::Mat(), cv::Mat(), CameraModel(), -1, rtabmap_ros::timestampFromROS(iter->first.header.stamp));
+			Transform gt;
+			if(!groundTruthFrameId_.empty())
+			{
+				gt = rtabmap_ros::getTransform(groundTruthFrameId_, groundTruthBaseFrameId_, iter->first.header.stamp, tfListener_, waitForTransform_?waitForTransformDuration_:0.0);
+			}
+			interData.setGroundTruth(gt);
+
+			std::map<std::string, float> externalStats;
+			std::vector<float> odomVelocity;
+			if(iter->second.timeEstimation != 0.0f)
+			{
+				OdometryInfo info = odomInfoFromROS(iter->second, true);
+				externalStats = rtabmap_ros::odomInfoToStatistics(info);
+
+				if(info.interval>0.0)
+				{
+					odomVelocity.resize(6);
+					float x,y,z,roll,pitch,yaw;
+					info.transform.getTranslationAndEulerAngles(x,y,z,roll,pitch,yaw);
+					odomVelocity[0] = x/info.interval;
+					odomVelocity[1] = y/info.interval;
+					odomVelocity[2] = z/info.interval;
+					odomVelocity[3] = roll/info.interval;
+					odomVelocity[4] = pitch/info.interval;
+					odomVelocity[5] = yaw/info.interval;
+				}
+			}
+
+			rtabmap_.process(interData, interOdom, covariance, odomVelocity, externalStats);
+			nodesIndexOutdated_ = true;
+		}
+	}
+	double timeIntermediateNodes = timer.ticks();
+
+	double timeRtabmap = 0.0;
+	double timePublishStats = 0.0;
+	double timeUpdateMaps = 0.0;
+	double timePublishMaps = 0.0;
+	double timePlanning = 0.0;
+
+	cv::Mat covariance = odomCovariance;
+	if(covariance.empty() || !uIsFinite(covariance.at<double>(0,0)) || covariance.at<double>(0,0)<=0.0f)
+	{
+		covariance = cv::Mat::eye(6,6,CV_64FC1);
+		if(odomDefaultLinVariance_ > 0.0f)
+		{
+			covariance.at<double>(0,0) = odomDefaultLinVariance_;
+			covariance.at<double>(1,1) = odomDefaultLinVariance_;
+			covariance.at<double>(2,2) = odomDefaultLinVariance_;
+		}
+		if(odomDefaultAngVariance_ > 0.0f)
+		{
+			covariance.at<double>(3,3) = odomDefaultAngVariance_;
+			covariance.at<double>(4,4) = odomDefaultAngVariance_;
+			covariance.at<double>(5,5) = odomDefaultAngVariance_;
+		}
+	}
+	else if(twoDMapping_)
+	{
+		// If 2d mapping, make sure all diagonal values of the covariance that even not used are not null.
+		covariance.at<double>(2,2) = covariance.at<double>(2,2)!=0?covariance.at<double>(2,2):1;
+		covariance.at<double>(3,3) = covariance.at<double>(3,3)!=0?covariance.at<double>(3,3):1;
+		covariance.at<double>(4,4) = covariance.at<double>(4,4)!=0?covariance.at<double>(4,4):1;
+	}
+
+	std::map<std::string, float> externalStats;
+	std::vector<float> odomVelocity;
+	if(odomInfo.timeEstimation != 0.0f)
+	{
+		externalStats = rtabmap_ros::odomInfoToStatistics(odomInfo);
+
+		if(odomInfo.interval>0.0)
+		{
+			odomVelocity.resize(6);
+			float x,y,z,roll,pitch,yaw;
+			odomInfo.transform.getTranslationAndEulerAngles(x,y,z,roll,pitch,yaw);
+			odomVelocity[0] = x/odomInfo.interval;
+			odomVelocity[1] = y/odomInfo.interval;
+			odomVelocity[2] = z/odomInfo.interval;
+			odomVelocity[3] = roll/odomInfo.interval;
+			odomVelocity[4] = pitch/odomInfo.interval;
+			odomVelocity[5] = yaw/odomInfo.interval;
+		}
+	}
+	if(rtabmapROSStats_.size())
+	{
+		externalStats.insert(rtabmapROSStats_.begin(), rtabmapROSStats_.end());
+		rtabmapROSStats_.clear();
+	}
+
+	timeMsgConversion += timer.ticks();
+	if(rtabmap_.process(data, odom, covariance, odomVelocity, externalStats))
+	{
+		timeRtabmap = timer.ticks();
+		nodesIndexOutdated_ = true;
+		descriptorIndexOutdated_ = true;
+		if(rtabmap_.getMemory()->isIncremental())
+		{
+			const Signature & s = rtabmap_.getStatistics().getLastSignatureData();
+			if(s.id() > 0 && !s.sensorData().globalDescriptors().empty())
+			{
+				descriptorIndex_.add(s.id(), s.sensorData().globalDescriptors().front().data());
+			}
+		}
+		if(rtabmap_.getStatistics().loopClosureId() > 0 || rtabmap_.getStatistics().proximityDetectionId() > 0)
+		{
+			// new links, cached plans may not be the shortest anymore
+			++planGraphVersion_;
+		}
+		mapToOdomMutex_.lock();
+		mapToOdom_ = rtabmap_.getMapCorrection();
+		mapToOdomSnapshot_.set(mapToOdom_, ros::Time::now().toSec());
+
+		if(!odomFrameId.empty() && !odomFrameId_.empty() && odomFrameId_.compare(odomFrameId)!=0)
+		{
+			ROS_ERROR("Odometry received doesn't have same frame_id "
+					  "than the one previously set (old=%s, new=%s). "
+					  "Are there multiple nodes publishing on same odometry topic name? "
+					  "The new frame_id is now used.", odomFrameId_.c_str(), odomFrameId.c_str());
+		}
+
+		odomFrameId_ = odomFrameId;
+		mapToOdomMutex_.unlock();
+		updateMapSnapshot();
+
+		if(data.id() < 0)
+		{
+			NODELET_INFO("Intermediate node added");
+		}
+		else
+		{
+			// Publish local graph, info
+			this->publishStats(stamp);
+			if(localizationPosePub_.getNumSubscribers() &&
+				!rtabmap_.getStatistics().localizationCovariance().empty())
+			{
+				geometry_msgs::PoseWithCovarianceStamped poseMsg;
+				poseMsg.header.frame_id = mapFrameId_;
+				poseMsg.header.stamp = stamp;
+				rtabmap_ros::transformToPoseMsg(mapToOdom_*odom, poseMsg.pose.pose);
+				poseMsg.pose.covariance;
+				const cv::Mat & cov = rtabmap_.getStatistics().localizationCovariance();
+				memcpy(poseMsg.pose.covariance.data(), cov.data, cov.total()*sizeof(double));
+				localizationPosePub_.publish(poseMsg);
+			}
+			timePublishStats = timer.ticks();
+
+			std::map<int, rtabmap::Transform> filteredPoses(rtabmap_.getLocalOptimizedPoses().lower_bound(1), rtabmap_.getLocalOptimizedPoses().end());
+
+			// create a tmp signature with latest sensory data if latest signature was ignored
+			std::map<int, rtabmap::Signature> tmpSignature;
+			if(rtabmap_.getMemory() == 0 ||
+				filteredPoses.size() == 0 ||
+				rtabmap_.getMemory()->getLastSignatureId() != filteredPoses.rbegin()->first ||
+				rtabmap_.getMemory()->getLastWorkingSignature() == 0 ||
+				rtabmap_.getMemory()->getLastWorkingSignature()->sensorData().gridCellSize() == 0 ||
+				(!mapsManager_.getOccupancyGrid()->isGridFromDepth() && data.laserScanRaw().is2d())) // 2d laser scan would fill empty space for latest data
+			{
+				SensorData tmpData = data;
+				tmpData.setId(0);
+				tmpSignature.insert(std::make_pair(0, Signature(0, -1, 0, data.stamp(), "", odom, Transform(), tmpData)));
+				filteredPoses.insert(std::make_pair(0, mapToOdom_*odom));
+			}
+
+			if(!isLocalizationLightweight() && (mappingMaxNodes_ > 0 || mappingAltitudeDelta_>0.0) && filteredPoses.size()>1)
+			{
+				std::map<int, Transform> nearestPoses = filterNodesToAssemble(filteredPoses, mapToOdom_*odom);
+
+				//add latest/zero and make sure those on a planned path are not filtered
+				std::set<int> onPath;
+				if(rtabmap_.getPath().size())
+				{
+					std::vector<int> nextNodes = rtabmap_.getPathNextNodes();
+					onPath.insert(nextNodes.begin(), nextNodes.end());
+				}
+				for(std::map<int, Transform>::iterator iter=filteredPoses.begin(); iter!=filteredPoses.end(); ++iter)
+				{
+					if(iter->first == 0 || onPath.find(iter->first) != onPath.end())
+					{
+						nearestPoses.insert(*iter);
+					}
+					else if(onPath.empty())
+					{
+						break;
+					}
+				}
+
+				filteredPoses = nearestPoses;
+			}
+
+			// Update maps
+			if(isLocalizationLightweight())
+			{
+				// The map is fixed, the maps are generated once (or for new subscribers)
+				if(!localizationMapsLatched_ || mapsManager_.hasUnlatchedSubscribers())
+				{
+					publishLocalizationMaps(stamp);
+				}
+				timeUpdateMaps = timer.ticks();
+				timePublishMaps = 0.0;
+			}
+			else if(mapsThread_)
+			{
+				// Only the latest request is kept, a pending one is already stale
+				boost::mutex::scoped_lock lock(mapsUpdateMutex_);
+				if(mapsUpdatePending_)
+				{
+					++mapsUpdatesCoalesced_;
+				}
+				mapsUpdatePoses_ = filteredPoses;
+				mapsUpdateSignatures_ = tmpSignature;
+				mapsUpdateStamp_ = stamp;
+				mapsUpdatePending_ = true;
+				mapsUpdateCondition_.notify_one();
+				timeUpdateMaps = timer.ticks();
+				timePublishMaps = 0.0;
+			}
+			else
+			{
+				boost::mutex::scoped_lock lock(mapsMutex_);
+				filteredPoses = mapsManager_.updateMapCaches(
+						filteredPoses,
+						rtabmap_.getMemory(),
+						false,
+						false,
+						tmpSignature);
+
+				timeUpdateMaps = timer.ticks();
+
+				mapsManager_.publishMaps(filteredPoses, stamp, mapFrameId_);
+				timePublishMaps = timer.ticks();
+			}
+
+			// update goal if planning is enabled
+			if(!currentMetricGoal_.isNull())
+			{
+				if(rtabmap_.getPath().size() == 0)
+				{
+					// Don't send status yet if move_base actionlib is used unless it failed,
+					// let move_base finish reaching the goal
+					if(mbClient_ == 0 || rtabmap_.getPathStatus() <= 0)
+					{
+						if(rtabmap_.getPathStatus() > 0)
+						{
+							// Goal reached
+							NODELET_INFO("Planning: Publishing goal reached!");
+						}
+						else if(rtabmap_.getPathStatus() <= 0)
+						{
+							NODELET_WARN("Planning: Plan failed!");
+							if(mbClient_ && mbClient_->isServerConnected())
 							{
-								std_msgs::Bool result;
-								result.data = rtabmap_.getPathStatus() > 0;
-								goalReachedPub_.publish(result);
+								mbClient_->cancelGoal();
 							}
-							currentMetricGoal_.setNull();
-							lastPublishedMetricGoal_.setNull();
-							goalFrameId_.clear();
-							latestNodeWasReached_ = false;
 						}
+
+						if(goalReachedPub_.getNumSubscribers())
+						{
+							std_msgs::Bool result;
+							result.data = rtabmap_.getPathStatus() > 0;
+							goalReachedPub_.publish(result);
+						}
+						currentMetricGoal_.setNull();
+						lastPublishedMetricGoal_.setNull();
+						goalFrameId_.clear();
+						latestNodeWasReached_ = false;
 					}
-					else
+				}
+				else
+				{
+					currentMetricGoal_ = rtabmap_.getPose(rtabmap_.getPathCurrentGoalId());
+					if(!currentMetricGoal_.isNull())
 					{
-						currentMetricGoal_ = rtabmap_.getPose(rtabmap_.getPathCurrentGoalId());
-						if(!currentMetricGoal_.isNull())
+						// Adjust the target pose relative to last node
+						if(rtabmap_.getPathCurrentGoalId() == rtabmap_.getPath().back().first && rtabmap_.getLocalOptimizedPoses().size())
 						{
-							// Adjust the target pose relative to last node
-							if(rtabmap_.getPathCurrentGoalId() == rtabmap_.getPath().back().first && rtabmap_.getLocalOptimizedPoses().size())
+							if(latestNodeWasReached_ ||
+							   rtabmap_.getLastLocalizationPose().getDistance(currentMetricGoal_) < rtabmap_.getLocalRadius())
 							{
-								if(latestNodeWasReached_ ||
-								   rtabmap_.getLastLocalizationPose().getDistance(currentMetricGoal_) < rtabmap_.getLocalRadius())
+								latestNodeWasReached_ = true;
+								Transform goalLocalTransform = Transform::getIdentity();
+								if(!goalFrameId_.empty() && goalFrameId_.compare(frameId_) != 0)
 								{
-									latestNodeWasReached_ = true;
-									Transform goalLocalTransform = Transform::getIdentity();
-									if(!goalFrameId_.empty() && goalFrameId_.compare(frameId_) != 0)
+									Transform localT = rtabmap_ros::getTransform(frameId_, goalFrameId_, ros::Time::now(), tfListener_, waitForTransform_?waitForTransformDuration_:0.0);
+									if(!localT.isNull())
 									{
-										Transform localT = rtabmap_ros::getTransform(frameId_, goalFrameId_, ros::Time::now(), tfListener_, waitForTransform_?waitForTransformDuration_:0.0);
-										if(!localT.isNull())
-										{
-											goalLocalTransform = localT.inverse().to3DoF();
-										}
+										goalLocalTransform = localT.inverse().to3DoF();
 									}
-									currentMetricGoal_ *= rtabmap_.getPathTransformToGoal()*goalLocalTransform;
 								}
+								currentMetricGoal_ *= rtabmap_.getPathTransformToGoal()*goalLocalTransform;
 							}
+						}
 
-							// publish next goal with updated currentMetricGoal_
-							publishCurrentGoal(stamp);
+						// publish next goal with updated currentMetricGoal_
+						publishCurrentGoal(stamp);
 
-							// publish local path
-							publishLocalPath(stamp);
+						// publish local path
+						publishLocalPath(stamp);
 
-							// publish global path
-							publishGlobalPath(stamp);
-						}
-						else
+						// publish global path
+						publishGlobalPath(stamp);
+					}
+					else
+					{
+						NODELET_ERROR("Planning: Local map broken, current goal id=%d (the robot may have moved to far from planned nodes)",
+								rtabmap_.getPathCurrentGoalId());
+						rtabmap_.clearPath(-1);
+						if(goalReachedPub_.getNumSubscribers())
 						{
-							NODELET_ERROR("Planning: Local map broken, current goal id=%d (the robot may have moved to far from planned nodes)",
-									rtabmap_.getPathCurrentGoalId());
-							rtabmap_.clearPath(-1);
-							if(goalReachedPub_.getNumSubscribers())
-							{
-								std_msgs::Bool result;
-								result.data = false;
-								goalReachedPub_.publish(result);
-							}
-							currentMetricGoal_.setNull();
-							lastPublishedMetricGoal_.setNull();
-							goalFrameId_.clear();
-							latestNodeWasReached_ = false;
+							std_msgs::Bool result;
+							result.data = false;
+							goalReachedPub_.publish(result);
 						}
+						currentMetricGoal_.setNull();
+						lastPublishedMetricGoal_.setNull();
+						goalFrameId_.clear();
+						latestNodeWasReached_ = false;
 					}
 				}
-
-				timePublishMaps = timer.ticks();
 			}
+
+			timePlanning = timer.ticks();
 		}
-		else
-		{
-			timeRtabmap = timer.ticks();
-		}
-		NODELET_INFO("rtabmap (%d): Rate=%.2fs, Limit=%.3fs, Conversion=%.4fs, RTAB-Map=%.4fs, Maps update=%.4fs pub=%.4fs (local map=%d, WM=%d)",
-				rtabmap_.getLastLocationId(),
-				rate_>0?1.0f/rate_:0,
-				rtabmap_.getTimeThreshold()/1000.0f,
-				timeMsgConversion,
-				timeRtabmap,
-				timeUpdateMaps,
-				timePublishMaps,
-				(int)rtabmap_.getLocalOptimizedPoses().size(),
-				rtabmap_.getWMSize()+rtabmap_.getSTMSize());
-		rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/HasSubscribers/"), mapsManager_.hasSubscribers()?1:0));
-		rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/TimeMsgConversion/ms"), timeMsgConversion*1000.0f));
-		rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/TimeRtabmap/ms"), timeRtabmap*1000.0f));
-		rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/TimeUpdatingMaps/ms"), timeUpdateMaps*1000.0f));
-		rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/TimePublishing/ms"), timePublishMaps*1000.0f));
-		rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/TimeTotal/ms"), (timeMsgConversion+timeRtabmap+timeUpdateMaps+timePublishMaps)*1000.0f));
 	}
-	else if(!rtabmap_.isIDsGenerated())
+	else
 	{
-		NODELET_WARN("Ignoring received image because its sequence ID=0. Please "
-				 "set \"Mem/GenerateIds\"=\"true\" to ignore ros generated sequence id. "
-				 "Use only \"Mem/GenerateIds\"=\"false\" for once-time run of RTAB-Map and "
-				 "when you need to have IDs output of RTAB-map synchronized with the source "
-				 "image sequence ID.");
+		timeRtabmap = timer.ticks();
+	}
+	NODELET_INFO("rtabmap (%d): Rate=%.2fs, Limit=%.3fs, Conversion=%.4fs, RTAB-Map=%.4fs, Maps update=%.4fs pub=%.4fs (local map=%d, WM=%d)",
+			rtabmap_.getLastLocationId(),
+			rate_>0?1.0f/rate_:0,
+			rtabmap_.getTimeThreshold()/1000.0f,
+			timeMsgConversion,
+			timeRtabmap,
+			timeUpdateMaps,
+			timePublishStats+timePublishMaps+timePlanning,
+			(int)rtabmap_.getLocalOptimizedPoses().size(),
+			rtabmap_.getWMSize()+rtabmap_.getSTMSize());
+	rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/HasSubscribers/"), mapsManager_.hasSubscribers()?1:0));
+	// Percentiles are only computed if someone is listening to info topic
+	bool computePercentiles = latencyWindowSize_ > 0 && infoPub_.getNumSubscribers();
+	addStageTime("TimeMsgConversion", timeMsgConversion, computePercentiles);
+	addStageTime("TimeTfWait", timeTfWait, computePercentiles); // included in TimeMsgConversion
+	addStageTime("TimeIntermediateNodes", timeIntermediateNodes, computePercentiles);
+	addStageTime("TimeRtabmap", timeRtabmap, computePercentiles);
+	addStageTime("TimePublishingStats", timePublishStats, computePercentiles);
+	addStageTime("TimeUpdatingMaps", timeUpdateMaps, computePercentiles);
+	addStageTime("TimePublishingMaps", timePublishMaps, computePercentiles);
+	addStageTime("TimePlanning", timePlanning, computePercentiles);
+	addStageTime("TimePublishing", timePublishStats+timePublishMaps+timePlanning, computePercentiles);
+	addStageTime("TimeTotal", timeMsgConversion+timeIntermediateNodes+timeRtabmap+timePublishStats+timeUpdateMaps+timePublishMaps+timePlanning, computePercentiles);
+	addStageTime("TimeDataAge", dataAge, computePercentiles);
+	if(processThread_)
+	{
+		addStageTime("TimeQueued", timeQueued, computePercentiles);
+		boost::mutex::scoped_lock lock(processQueueMutex_);
+		rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/ProcessQueueSize/"), (float)processQueue_.size()));
+		rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/ProcessQueueDropped/"), (float)processQueueDropped_));
+	}
+	if(mapsThread_)
+	{
+		boost::mutex::scoped_lock lock(mapsUpdateMutex_);
+		rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/MapsThreadTimeUpdating/ms"), (float)mapsLastUpdateTime_*1000.0f));
+		rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/MapsThreadTimePublishing/ms"), (float)mapsLastPublishTime_*1000.0f));
+		rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/MapsUpdatesCoalesced/"), (float)mapsUpdatesCoalesced_));
+	}
+	updateMemoryUsage();
+}
+
+void CoreWrapper::updateMemoryUsage()
+{
+	// Only if someone is listening to info topic or a limit is set
+	if(memorySoftLimit_ <= 0.0 && !infoPub_.getNumSubscribers())
+	{
+		return;
+	}
+
+	// Don't wait for a maps update in progress (publish_maps_async), previous values are used
+	if(mapsMutex_.try_lock())
+	{
+		mapsMemoryUsage_.clear();
+		mapsManager_.getMemoryUsage(mapsMemoryUsage_, mapsMemoryEvictable_);
+		mapsMutex_.unlock();
+	}
+	std::map<std::string, unsigned long> usage = mapsMemoryUsage_;
+	{
+		boost::mutex::scoped_lock lock(interOdomsMutex_);
+		usage["InterOdoms"] = interOdoms_.memoryUsage();
+	}
+	{
+		boost::mutex::scoped_lock lock(asyncDataMutex_);
+		usage["Imus"] = imus_.memoryUsage();
+	}
+	if(rtabmap_.getMemory())
+	{
+		usage["CoreMemory"] = rtabmap_.getMemory()->getMemoryUsed();
+	}
+
+	unsigned long total = 0;
+	for(std::map<std::string, unsigned long>::iterator iter=usage.begin(); iter!=usage.end(); ++iter)
+	{
+		total += iter->second;
+		rtabmapROSStats_.insert(std::make_pair("RtabmapROS/Memory"+iter->first+"/MB", float(iter->second)/1048576.0f));
+	}
+	rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/MemoryTotal/MB"), float(total)/1048576.0f));
+
+	// Only the local grids and clouds of the maps can be released (they
+	// are regenerated from the memory when needed), so only them are
+	// compared to the limit. Other caches (compressed grids, occupancy
+	// grid, core memory...) are only reported.
+	unsigned long limit = (unsigned long)(memorySoftLimit_*1048576.0);
+	if(limit > 0 && mapsMemoryEvictable_ > limit)
+	{
+		NODELET_INFO_THROTTLE(60, "rtabmap: evictable map caches (%lu MB) are over memory_soft_limit (%f MB), "
+				"releasing least recently used local grids and clouds (total memory used %lu MB).",
+				mapsMemoryEvictable_/1048576, memorySoftLimit_, total/1048576);
+		boost::mutex::scoped_lock lock(mapsMutex_);
+		mapsManager_.reduceCacheMemory(limit);
+	}
+}
+
+void CoreWrapper::addStageTime(const std::string & name, double seconds, bool computePercentiles)
+{
+	float ms = seconds*1000.0f;
+	rtabmapROSStats_.insert(std::make_pair("RtabmapROS/"+name+"/ms", ms));
+	if(latencyWindowSize_ > 0)
+	{
+		std::map<std::string, RollingPercentiles>::iterator iter = stageTimes_.find(name);
+		if(iter == stageTimes_.end())
+		{
+			iter = stageTimes_.insert(std::make_pair(name, RollingPercentiles(latencyWindowSize_))).first;
+		}
+		iter->second.add(ms);
+		if(computePercentiles)
+		{
+			static const float ratios[] = {0.5f, 0.95f, 0.99f};
+			std::vector<float> values = iter->second.percentiles(ratios, 3);
+			rtabmapROSStats_.insert(std::make_pair("RtabmapROS/"+name+"P50/ms", values[0]));
+			rtabmapROSStats_.insert(std::make_pair("RtabmapROS/"+name+"P95/ms", values[1]));
+			rtabmapROSStats_.insert(std::make_pair("RtabmapROS/"+name+"P99/ms", values[2]));
+		}
 	}
 }
 
@@ -2386,6 +3218,7 @@ void CoreWrapper::globalPoseAsyncCallback(const geometry_msgs::PoseWithCovarianc
 {
 	if(!paused_)
 	{
+		boost::mutex::scoped_lock lock(asyncDataMutex_);
 		globalPose_ = *globalPoseMsg;
 	}
 }
@@ -2403,6 +3236,7 @@ void CoreWrapper::gpsFixAsyncCallback(const sensor_msgs::NavSatFixConstPtr & gps
 				error = sqrt(variance);
 			}
 		}
+		boost::mutex::scoped_lock lock(asyncDataMutex_);
 		gps_ = rtabmap::GPS(
 				gpsFixMsg->header.stamp.toSec(),
 				gpsFixMsg->longitude,
@@ -2454,6 +3288,7 @@ void CoreWrapper::tagDetectionsAsyncCallback(const apriltag_ros::AprilTagDetecti
 						warned = true;
 					}
 				}
+				boost::mutex::scoped_lock lock(asyncDataMutex_);
 				uInsert(tags_, std::make_pair(tagDetections.detections[i].id[0], p));
 			}
 		}
@@ -2472,11 +3307,9 @@ void CoreWrapper::imuAsyncCallback(const sensor_msgs::ImuConstPtr & msg)
 		else
 		{
 			Transform orientation(0,0,0, msg->orientation.x, msg->orientation.y, msg->orientation.z, msg->orientation.w);
-			imus_.insert(std::make_pair(msg->header.stamp.toSec(), orientation));
-			if(imus_.size() > 1000)
-			{
-				imus_.erase(imus_.begin());
-			}
+			boost::mutex::scoped_lock lock(asyncDataMutex_);
+			// oldest orientations are overwritten when the buffer is full
+			imus_.push(msg->header.stamp.toSec(), orientation);
 			if(!imuFrameId_.empty() && imuFrameId_.compare(msg->header.frame_id) != 0)
 			{
 				ROS_ERROR("IMU frame_id has changed from %s to %s! Are "
@@ -2500,7 +3333,8 @@ void CoreWrapper::interOdomCallback(const nav_msgs::OdometryConstPtr & msg)
 {
 	if(!paused_)
 	{
-		interOdoms_.push_back(std::make_pair(*msg, rtabmap_ros::OdomInfo()));
+		boost::mutex::scoped_lock lock(interOdomsMutex_);
+		pushInterOdom(*msg, rtabmap_ros::OdomInfo());
 	}
 }
 
@@ -2508,13 +3342,27 @@ void CoreWrapper::interOdomInfoCallback(const nav_msgs::OdometryConstPtr & msg1,
 {
 	if(!paused_)
 	{
-		interOdoms_.push_back(std::make_pair(*msg1, *msg2));
+		boost::mutex::scoped_lock lock(interOdomsMutex_);
+		pushInterOdom(*msg1, *msg2);
+	}
+}
+
+void CoreWrapper::pushInterOdom(const nav_msgs::Odometry & odom, const rtabmap_ros::OdomInfo & info)
+{
+	unsigned long overflows = interOdoms_.overflows();
+	interOdoms_.push(odom.header.stamp.toSec(), std::make_pair(odom, info));
+	if(interOdoms_.overflows() != overflows)
+	{
+		NODELET_WARN_THROTTLE(5.0, "rtabmap: Intermediate odometry buffer is full (%d), oldest "
+				"poses are dropped (%ld dropped so far). Is rtabmap processing slower than odometry?",
+				(int)interOdoms_.capacity(), interOdoms_.overflows());
 	}
 }
 
 
 void CoreWrapper::initialPoseCallback(const geometry_msgs::PoseWithCovarianceStampedConstPtr & msg)
 {
+	UScopeMutex lock(rtabmapMutex_);
 	Transform intialPose = rtabmap_ros::transformFromPoseMsg(msg->pose.pose);
 	if(intialPose.isNull())
 	{
@@ -2533,6 +3381,7 @@ void CoreWrapper::goalCommonCallback(
 		const ros::Time & stamp,
 		double * planningTime)
 {
+	UScopeMutex lock(rtabmapMutex_);
 	UTimer timer;
 
 	if(id == 0 && !label.empty() && rtabmap_.getMemory())
@@ -2717,6 +3566,8 @@ void CoreWrapper::goalNodeCallback(const rtabmap_ros::GoalConstPtr & msg)
 
 bool CoreWrapper::updateRtabmapCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
 {
+	UScopeMutex lock(rtabmapMutex_);
+	boost::mutex::scoped_lock mapsLock(mapsMutex_);
 	ros::NodeHandle nh;
 	for(rtabmap::ParametersMap::iterator iter=parameters_.begin(); iter!=parameters_.end(); ++iter)
 	{
@@ -2783,6 +3634,9 @@ bool CoreWrapper::updateRtabmapCallback(std_srvs::Empty::Request&, std_srvs::Emp
 
 bool CoreWrapper::resetRtabmapCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
 {
+	UScopeMutex lock(rtabmapMutex_);
+	boost::mutex::scoped_lock mapsLock(mapsMutex_);
+	loadMapCacheAsync(std::map<int, Transform>());
 	NODELET_INFO("rtabmap: Reset");
 	rtabmap_.resetMemory();
 	covariance_ = cv::Mat();
@@ -2793,19 +3647,37 @@ bool CoreWrapper::resetRtabmapCallback(std_srvs::Empty::Request&, std_srvs::Empt
 	goalFrameId_.clear();
 	latestNodeWasReached_ = false;
 	mapsManager_.clear();
+	localizationMapsLatched_ = false;
+	mapDeltaPoses_.clear();
+	mapDeltaLinks_.clear();
+	nodesIndex_.clear();
+	planCache_.clear();
+	descriptorIndex_.clear();
+	nodesWithoutDescriptor_.clear();
+	descriptorIndexOutdated_ = true;
+	++planGraphVersion_;
+	nodesIndexOutdated_ = true;
 	previousStamp_ = ros::Time(0);
+	asyncDataMutex_.lock();
 	globalPose_.header.stamp = ros::Time(0);
 	gps_ = rtabmap::GPS();
 	tags_.clear();
+	imus_.clear();
+	imuFrameId_.clear();
+	asyncDataMutex_.unlock();
 	userDataMutex_.lock();
 	userData_ = cv::Mat();
 	userDataMutex_.unlock();
-	imus_.clear();
-	imuFrameId_.clear();
+	interOdomsMutex_.lock();
 	interOdoms_.clear();
+	interOdomsMutex_.unlock();
+	clearProcessQueue();
+	clearMapsUpdate();
 	mapToOdomMutex_.lock();
 	mapToOdom_.setIdentity();
+	mapToOdomSnapshot_.set(mapToOdom_, 0.0, false);
 	mapToOdomMutex_.unlock();
+	updateMapSnapshot();
 
 	return true;
 }
@@ -2844,6 +3716,9 @@ bool CoreWrapper::resumeRtabmapCallback(std_srvs::Empty::Request&, std_srvs::Emp
 
 bool CoreWrapper::loadDatabaseCallback(rtabmap_ros::LoadDatabase::Request& req, rtabmap_ros::LoadDatabase::Response&)
 {
+	UScopeMutex lock(rtabmapMutex_);
+	boost::mutex::scoped_lock mapsLock(mapsMutex_);
+	loadMapCacheAsync(std::map<int, Transform>());
 	NODELET_INFO("LoadDatabase: Loading database (%s, clear=%s)...", req.database_path.c_str(), req.clear?"true":"false");
 	std::string newDatabasePath = uReplaceChar(req.database_path, '~', UDirectory::homeDir());
 	std::string dir = UDirectory::getDir(newDatabasePath);
@@ -2856,6 +3731,7 @@ bool CoreWrapper::loadDatabaseCallback(rtabmap_ros::LoadDatabase::Request& req,
 	if(UFile::exists(newDatabasePath) && req.clear)
 	{
 		UFile::erase(newDatabasePath);
+		UFile::erase(newDatabasePath + ".maps_cache");
 	}
 
 	// Close old database
@@ -2873,6 +3749,7 @@ bool CoreWrapper::loadDatabaseCallback(rtabmap_ros::LoadDatabase::Request& req,
 	}
 	rtabmap_.close();
 	NODELET_INFO("LoadDatabase: Saving current map (%s, %ld MB)... done!", databasePath_.c_str(), UFile::length(databasePath_)/(1024*1024));
+	saveMapsCacheFile();
 
 	covariance_ = cv::Mat();
 	lastPose_.setIdentity();
@@ -2882,18 +3759,35 @@ bool CoreWrapper::loadDatabaseCallback(rtabmap_ros::LoadDatabase::Request& req,
 	goalFrameId_.clear();
 	latestNodeWasReached_ = false;
 	mapsManager_.clear();
+	localizationMapsLatched_ = false;
+	mapDeltaPoses_.clear();
+	mapDeltaLinks_.clear();
+	nodesIndex_.clear();
+	planCache_.clear();
+	descriptorIndex_.clear();
+	nodesWithoutDescriptor_.clear();
+	descriptorIndexOutdated_ = true;
+	++planGraphVersion_;
+	nodesIndexOutdated_ = true;
 	previousStamp_ = ros::Time(0);
+	asyncDataMutex_.lock();
 	globalPose_.header.stamp = ros::Time(0);
 	gps_ = rtabmap::GPS();
 	tags_.clear();
+	imus_.clear();
+	imuFrameId_.clear();
+	asyncDataMutex_.unlock();
 	userDataMutex_.lock();
 	userData_ = cv::Mat();
 	userDataMutex_.unlock();
-	imus_.clear();
-	imuFrameId_.clear();
+	interOdomsMutex_.lock();
 	interOdoms_.clear();
+	interOdomsMutex_.unlock();
+	clearProcessQueue();
+	clearMapsUpdate();
 	mapToOdomMutex_.lock();
 	mapToOdom_.setIdentity();
+	mapToOdomSnapshot_.set(mapToOdom_, 0.0, false);
 	mapToOdomMutex_.unlock();
 
 	// Open new database
@@ -2931,20 +3825,17 @@ bool CoreWrapper::loadDatabaseCallback(rtabmap_ros::LoadDatabase::Request& req,
 	}
 
 	NODELET_INFO("LoadDatabase: Loading database...");
+	unsigned long long dbStamp = databaseStamp(databasePath_);
 	rtabmap_.init(parameters_, databasePath_);
 	NODELET_INFO("LoadDatabase: Loading database... done!");
 
 	if(rtabmap_.getMemory())
 	{
+		loadMapsCacheFile(dbStamp);
+
 		if(useSavedMap_ && !rtabmap_.getMemory()->isIncremental())
 		{
-			float xMin, yMin, gridCellSize;
-			cv::Mat map = rtabmap_.getMemory()->load2DMap(xMin, yMin, gridCellSize);
-			if(!map.empty())
-			{
-				NODELET_INFO("LoadDatabase: 2D occupancy grid map loaded (%dx%d).", map.cols, map.rows);
-				mapsManager_.set2DMap(map, xMin, yMin, gridCellSize, rtabmap_.getLocalOptimizedPoses(), rtabmap_.getMemory());
-			}
+			loadSavedMap("LoadDatabase");
 		}
 
 		if(rtabmap_.getMemory()->getWorkingMem().size()>1)
@@ -2968,6 +3859,7 @@ bool CoreWrapper::loadDatabaseCallback(rtabmap_ros::LoadDatabase::Request& req,
 			NODELET_INFO("LoadDatabase: Localization mode (%s=false)", Parameters::kMemIncrementalMemory().c_str());
 		}
 
+		updateMapSnapshot();
 		return true;
 	}
 
@@ -2976,13 +3868,15 @@ bool CoreWrapper::loadDatabaseCallback(rtabmap_ros::LoadDatabase::Request& req,
 
 bool CoreWrapper::triggerNewMapCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
 {
+	UScopeMutex lock(rtabmapMutex_);
 	NODELET_INFO("rtabmap: Trigger new map");
 	rtabmap_.triggerNewMap();
 	return true;
 }
 
-bool CoreWrapper::backupDatabaseCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
+void CoreWrapper::flushDatabase()
 {
+	// rtabmapMutex_ and mapsMutex_ should be locked
 	NODELET_INFO("Backup: Saving memory...");
 	if(rtabmap_.getMemory())
 	{
@@ -3007,9 +3901,18 @@ bool CoreWrapper::backupDatabaseCallback(std_srvs::Empty::Request&, std_srvs::Em
 	userDataMutex_.lock();
 	userData_ = cv::Mat();
 	userDataMutex_.unlock();
+	asyncDataMutex_.lock();
 	globalPose_.header.stamp = ros::Time(0);
 	gps_ = rtabmap::GPS();
 	tags_.clear();
+	asyncDataMutex_.unlock();
+}
+
+bool CoreWrapper::backupDatabaseCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
+{
+	UScopeMutex lock(rtabmapMutex_);
+	boost::mutex::scoped_lock mapsLock(mapsMutex_);
+	flushDatabase();
 
 	NODELET_INFO("Backup: Saving \"%s\" to \"%s\"...", databasePath_.c_str(), (databasePath_+".back").c_str());
 	UFile::copy(databasePath_, databasePath_+".back");
@@ -3019,12 +3922,264 @@ bool CoreWrapper::backupDatabaseCallback(std_srvs::Empty::Request&, std_srvs::Em
 	rtabmap_.init(parameters_, databasePath_);
 	NODELET_INFO("Backup: Reloading memory... done!");
 
-	return true;
+	return true;
+}
+
+bool CoreWrapper::backupDatabaseAsyncCallback(std_srvs::Trigger::Request&, std_srvs::Trigger::Response& res)
+{
+	boost::mutex::scoped_lock lock(backupMutex_);
+	if(databasePath_.empty())
+	{
+		res.success = false;
+		res.message = "No database is used, nothing to backup.";
+		return true;
+	}
+	if(backupJobRunning_)
+	{
+		res.success = false;
+		res.message = uFormat("Backup job %d is already running.", backupJobId_);
+		return true;
+	}
+	if(backupThread_)
+	{
+		backupThread_->join();
+		delete backupThread_;
+	}
+	backupJobRunning_ = true;
+	backupThreadRunning_ = true;
+	++backupJobId_;
+	backupThread_ = new boost::thread(boost::bind(&CoreWrapper::backupDatabaseLoop, this, backupJobId_));
+	res.success = true;
+	res.message = uNumber2Str(backupJobId_);
+	NODELET_INFO("Backup: Started job %d (progress on \"%s\")", backupJobId_, backupProgressPub_.getTopic().c_str());
+	return true;
+}
+
+static const unsigned long kBackupBlockSize = 1024*1024;
+
+static bool databaseModified(const std::string & path, const struct stat & before)
+{
+	struct stat st;
+	return stat(path.c_str(), &st) != 0 ||
+		st.st_size != before.st_size ||
+		st.st_mtim.tv_sec != before.st_mtim.tv_sec ||
+		st.st_mtim.tv_nsec != before.st_mtim.tv_nsec;
+}
+
+void CoreWrapper::backupDatabaseLoop(unsigned int jobId)
+{
+	std::string backupPath = databasePath_+".back";
+	// the previous backup is replaced only when the new one is complete
+	std::string tmpPath = backupPath+".tmp";
+	publishBackupProgress(jobId, 0, 0, 0, 0, false, true, "Saving memory");
+
+	// The working memory should be saved to the database first, processing
+	// is paused only during this step, the copy is done in background.
+	{
+		UScopeMutex lock(rtabmapMutex_);
+		boost::mutex::scoped_lock mapsLock(mapsMutex_);
+		flushDatabase();
+		NODELET_INFO("Backup: Reloading memory...");
+		rtabmap_.init(parameters_, databasePath_);
+		NODELET_INFO("Backup: Reloading memory... done!");
+	}
+
+	// Copy the database without pausing processing. If the database is
+	// modified during a pass, another pass rewrites only the blocks that
+	// changed. If it is still modified during the last unlocked pass, a last
+	// pass is done with processing paused, only on the blocks that changed
+	// during the previous pass, the first one (SQLite header) and those
+	// appended since. The whole file is never read with processing paused.
+	const unsigned int maxUnlockedPasses = 3;
+	bool success = true;
+	bool modified = true;
+	unsigned long bytesWritten = 0;
+	unsigned long size = 0;
+	std::set<unsigned long> changedBlocks;
+	unsigned int pass = 0;
+	UTimer timer;
+	while(modified && pass<maxUnlockedPasses && success && backupThreadRunning_)
+	{
+		struct stat before;
+		if(stat(databasePath_.c_str(), &before) != 0)
+		{
+			success = false;
+			break;
+		}
+		changedBlocks.clear();
+		success = copyDatabaseBlocks(databasePath_, tmpPath, jobId, pass++, 0, changedBlocks, size, bytesWritten);
+		modified = databaseModified(databasePath_, before);
+	}
+	if(modified && success && backupThreadRunning_)
+	{
+		UScopeMutex lock(rtabmapMutex_);
+		std::set<unsigned long> blocks = changedBlocks;
+		blocks.insert(0);
+		unsigned long total = UFile::length(databasePath_);
+		for(unsigned long i=size/kBackupBlockSize; i*kBackupBlockSize<total; ++i)
+		{
+			blocks.insert(i);
+		}
+		NODELET_INFO("Backup: Job %d: Copying %d blocks with processing paused...", jobId, (int)blocks.size());
+		changedBlocks.clear();
+		success = copyDatabaseBlocks(databasePath_, tmpPath, jobId, pass, &blocks, changedBlocks, size, bytesWritten);
+	}
+	bool aborted = !backupThreadRunning_;
+	if(success && !aborted && rename(tmpPath.c_str(), backupPath.c_str()) != 0)
+	{
+		success = false;
+	}
+	if(!success || aborted)
+	{
+		UFile::erase(tmpPath);
+	}
+
+	std::string message;
+	if(aborted)
+	{
+		success = false;
+		message = "Backup aborted.";
+	}
+	else if(success)
+	{
+		message = uFormat("Backup saved to \"%s\" (%lu bytes written, %f s).", backupPath.c_str(), bytesWritten, timer.elapsed());
+		NODELET_INFO("Backup: Job %d: %s", jobId, message.c_str());
+	}
+	else
+	{
+		message = uFormat("Failed to copy \"%s\" to \"%s\".", databasePath_.c_str(), backupPath.c_str());
+		NODELET_ERROR("Backup: Job %d: %s", jobId, message.c_str());
+	}
+	long backupSize = UFile::length(backupPath);
+	publishBackupProgress(jobId, backupSize, backupSize, bytesWritten, 0, true, success, message);
+
+	boost::mutex::scoped_lock lock(backupMutex_);
+	backupJobRunning_ = false;
+}
+
+bool CoreWrapper::copyDatabaseBlocks(
+		const std::string & src,
+		const std::string & dst,
+		unsigned int jobId,
+		unsigned int pass,
+		const std::set<unsigned long> * blocks,
+		std::set<unsigned long> & changedBlocks,
+		unsigned long & srcSize,
+		unsigned long & bytesWritten)
+{
+	std::ifstream in(src.c_str(), std::ios::in | std::ios::binary);
+	if(!in.is_open())
+	{
+		return false;
+	}
+	if(pass == 0)
+	{
+		// new backup
+		std::ofstream(dst.c_str(), std::ios::out | std::ios::binary | std::ios::trunc).close();
+	}
+	std::fstream out(dst.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+	if(!out.is_open())
+	{
+		return false;
+	}
+
+	in.seekg(0, std::ios::end);
+	unsigned long total = in.tellg();
+	srcSize = total;
+
+	// All blocks when none are given, throttled as processing is not paused
+	const bool throttled = blocks == 0;
+	const unsigned long count = blocks?blocks->size():(total+kBackupBlockSize-1)/kBackupBlockSize;
+	std::set<unsigned long>::const_iterator iter;
+	if(blocks)
+	{
+		iter = blocks->begin();
+	}
+	std::vector<char> srcBlock(kBackupBlockSize);
+	std::vector<char> dstBlock(kBackupBlockSize);
+	UTimer timer;
+	double lastProgressTime = 0.0;
+	unsigned long checked = 0;
+	for(unsigned long i=0; i<count && backupThreadRunning_; ++i)
+	{
+		unsigned long block = blocks?*iter++:i;
+		unsigned long offset = block*kBackupBlockSize;
+		if(offset >= total)
+		{
+			// blocks are sorted
+			break;
+		}
+		unsigned long size = std::min(kBackupBlockSize, total-offset);
+		in.seekg(offset);
+		if(!in.read(&srcBlock[0], size))
+		{
+			return false;
+		}
+		out.seekg(offset);
+		out.read(&dstBlock[0], size);
+		bool same = (unsigned long)out.gcount() == size && memcmp(&srcBlock[0], &dstBlock[0], size) == 0;
+		out.clear();
+		if(!same)
+		{
+			out.seekp(offset);
+			if(!out.write(&srcBlock[0], size))
+			{
+				return false;
+			}
+			bytesWritten += size;
+			changedBlocks.insert(block);
+		}
+		checked += size;
+
+		if(throttled && backupMaxRate_ > 0.0)
+		{
+			double expectedTime = double(checked) / (backupMaxRate_*1024.0*1024.0);
+			double elapsed = timer.elapsed();
+			if(expectedTime > elapsed)
+			{
+				uSleep(int((expectedTime - elapsed)*1000.0));
+			}
+		}
+		if(timer.elapsed() - lastProgressTime > 1.0)
+		{
+			lastProgressTime = timer.elapsed();
+			publishBackupProgress(jobId, total, checked, bytesWritten, pass, false, true, "Copying");
+		}
+	}
+	out.close();
+	return backupThreadRunning_ && truncate(dst.c_str(), total) == 0;
+}
+
+void CoreWrapper::publishBackupProgress(
+		unsigned int jobId,
+		unsigned long total,
+		unsigned long checked,
+		unsigned long written,
+		unsigned int pass,
+		bool done,
+		bool success,
+		const std::string & message)
+{
+	rtabmap_ros::BackupProgress msg;
+	msg.header.stamp = ros::Time::now();
+	msg.jobId = jobId;
+	msg.path = databasePath_+".back";
+	msg.bytesTotal = total;
+	msg.bytesChecked = checked;
+	msg.bytesWritten = written;
+	msg.pass = pass;
+	msg.progress = done?1.0f:total>0?float(checked)/float(total):0.0f;
+	msg.done = done;
+	msg.success = success;
+	msg.message = message;
+	backupProgressPub_.publish(msg);
 }
 
 bool CoreWrapper::setModeLocalizationCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
 {
+	UScopeMutex lock(rtabmapMutex_);
 	NODELET_INFO("rtabmap: Set localization mode");
+	localizationMapsLatched_ = false;
 	rtabmap::ParametersMap parameters;
 	parameters.insert(rtabmap::ParametersPair(rtabmap::Parameters::kMemIncrementalMemory(), "false"));
 	ros::NodeHandle & nh = getNodeHandle();
@@ -3036,7 +4191,9 @@ bool CoreWrapper::setModeLocalizationCallback(std_srvs::Empty::Request&, std_srv
 
 bool CoreWrapper::setModeMappingCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
 {
+	UScopeMutex lock(rtabmapMutex_);
 	NODELET_INFO("rtabmap: Set mapping mode");
+	localizationMapsLatched_ = false;
 	rtabmap::ParametersMap parameters;
 	parameters.insert(rtabmap::ParametersPair(rtabmap::Parameters::kMemIncrementalMemory(), "true"));
 	ros::NodeHandle & nh = getNodeHandle();
@@ -3073,26 +4230,73 @@ bool CoreWrapper::setLogError(std_srvs::Empty::Request&, std_srvs::Empty::Respon
 
 bool CoreWrapper::getNodeDataCallback(rtabmap_ros::GetNodeData::Request& req, rtabmap_ros::GetNodeData::Response& res)
 {
-	NODELET_INFO("rtabmap: Getting node data (%d node(s), images=%s scan=%s grid=%s user_data=%s)...",
+	UScopeMutex lock(rtabmapMutex_);
+	bool images = req.images;
+	bool scan = req.scan;
+	bool grid = req.grid;
+	bool userData = req.user_data;
+	bool words = true;
+	bool globalDescriptors = true;
+	if(req.fields)
+	{
+		images = req.fields & (rtabmap_ros::GetNodeData::Request::FIELD_IMAGE | rtabmap_ros::GetNodeData::Request::FIELD_DEPTH);
+		scan = req.fields & rtabmap_ros::GetNodeData::Request::FIELD_SCAN;
+		grid = req.fields & rtabmap_ros::GetNodeData::Request::FIELD_GRID;
+		userData = req.fields & rtabmap_ros::GetNodeData::Request::FIELD_USER_DATA;
+		words = req.fields & rtabmap_ros::GetNodeData::Request::FIELD_WORDS;
+		globalDescriptors = req.fields & rtabmap_ros::GetNodeData::Request::FIELD_GLOBAL_DESCRIPTORS;
+	}
+	NODELET_INFO("rtabmap: Getting node data (%d node(s), images=%s scan=%s grid=%s user_data=%s words=%s global_descriptors=%s max_bytes=%d)...",
 			(int)req.ids.size(),
-			req.images?"true":"false",
-			req.scan?"true":"false",
-			req.grid?"true":"false",
-			req.user_data?"true":"false");
+			images?"true":"false",
+			scan?"true":"false",
+			grid?"true":"false",
+			userData?"true":"false",
+			words?"true":"false",
+			globalDescriptors?"true":"false",
+			(int)req.max_bytes);
 
 	if(req.ids.empty() && rtabmap_.getMemory() && rtabmap_.getMemory()->getLastWorkingSignature())
 	{
 		req.ids.push_back(rtabmap_.getMemory()->getLastWorkingSignature()->id());
 	}
+	uint32_t bytes = 0;
 	for(size_t i=0; i<req.ids.size(); ++i)
 	{
 		int id = req.ids[i];
-		Signature s = rtabmap_.getSignatureCopy(id, req.images, req.scan, req.user_data, req.grid, true, true);
+		// compressed data are copied as is (from memory or database)
+		Signature s = rtabmap_.getSignatureCopy(id, images, scan, userData, grid, words, globalDescriptors);
 
 		if(s.id()>0)
 		{
 			NodeData msg;
-			rtabmap_ros::nodeDataToROS(s, msg);
+			rtabmap_ros::nodeDataToROS(s, msg, wordsPacking_);
+			if(req.fields)
+			{
+				if(!(req.fields & rtabmap_ros::GetNodeData::Request::FIELD_IMAGE))
+				{
+					msg.image.clear();
+				}
+				if(!(req.fields & rtabmap_ros::GetNodeData::Request::FIELD_DEPTH))
+				{
+					msg.depth.clear();
+				}
+				if(!(req.fields & rtabmap_ros::GetNodeData::Request::FIELD_GPS))
+				{
+					msg.gps = rtabmap_ros::GPS();
+				}
+			}
+
+			if(req.max_bytes > 0)
+			{
+				uint32_t size = ros::serialization::serializationLength(msg);
+				if(!res.data.empty() && bytes + size > req.max_bytes)
+				{
+					res.remaining_ids.insert(res.remaining_ids.end(), req.ids.begin()+i, req.ids.end());
+					break;
+				}
+				bytes += size;
+			}
 			res.data.push_back(msg);
 		}
 	}
@@ -3109,24 +4313,31 @@ bool CoreWrapper::getMapDataCallback(rtabmap_ros::GetMap::Request& req, rtabmap_
 	std::map<int, Signature> signatures;
 	std::map<int, Transform> poses;
 	std::multimap<int, rtabmap::Link> constraints;
+	Transform mapToOdom;
 
-	rtabmap_.getGraph(
-			poses,
-			constraints,
-			req.optimized,
-			req.global,
-			&signatures,
-			!req.graphOnly,
-			!req.graphOnly,
-			!req.graphOnly,
-			!req.graphOnly);
-
-	//RGB-D SLAM data
+	{
+		UScopeMutex lock(rtabmapMutex_);
+		rtabmap_.getGraph(
+				poses,
+				constraints,
+				req.optimized,
+				req.global,
+				&signatures,
+				!req.graphOnly,
+				!req.graphOnly,
+				!req.graphOnly,
+				!req.graphOnly);
+		mapToOdom = mapToOdom_;
+	}
+
+	//RGB-D SLAM data (signatures are copies, rtabmap doesn't need to be locked)
 	rtabmap_ros::mapDataToROS(poses,
 		constraints,
 		signatures,
-		mapToOdom_,
-		res.data);
+		mapToOdom,
+		res.data,
+		wordsPacking_,
+		graphPacking_);
 
 	res.data.header.stamp = ros::Time::now();
 	res.data.header.frame_id = mapFrameId_;
@@ -3146,26 +4357,152 @@ bool CoreWrapper::getMapData2Callback(rtabmap_ros::GetMap2::Request& req, rtabma
 	std::map<int, Signature> signatures;
 	std::map<int, Transform> poses;
 	std::multimap<int, rtabmap::Link> constraints;
+	Transform mapToOdom;
+
+	bool bbox = req.bbox_min.x < req.bbox_max.x && req.bbox_min.y < req.bbox_max.y;
+	bool bboxZ = bbox && req.bbox_min.z < req.bbox_max.z;
+	bool filtered = req.min_id > 0 ||
+			req.max_id > 0 ||
+			!req.map_ids.empty() ||
+			bbox ||
+			req.max_count > 0 ||
+			req.continuation != 0;
+
+	// a filtered graph is not a keyframe for the delta-encoded topics
+	bool keyFrame = mapDeltaEnabled_ && !req.global && req.optimized && !filtered;
+	unsigned int keyFrameVersion = 0;
+	res.continuation = 0;
+
+	{
+		UScopeMutex lock(rtabmapMutex_);
+		if(!filtered)
+		{
+			rtabmap_.getGraph(
+					poses,
+					constraints,
+					req.optimized,
+					req.global,
+					&signatures,
+					req.with_images,
+					req.with_scans,
+					req.with_user_data,
+					req.with_grids,
+					req.with_words,
+					req.with_global_descriptors);
+		}
+		else
+		{
+			// Filter on the poses, then load data only of the selected nodes
+			std::map<int, Signature> infos;
+			rtabmap_.getGraph(
+					poses,
+					constraints,
+					req.optimized,
+					req.global,
+					req.map_ids.empty()?0:&infos,
+					false, false, false, false, false, false);
+
+			std::set<int> mapIds(req.map_ids.begin(), req.map_ids.end());
+			std::vector<int> ids;
+			std::map<int, Transform> landmarks;
+			for(std::map<int, Transform>::iterator iter=poses.begin(); iter!=poses.end(); ++iter)
+			{
+				const Transform & p = iter->second;
+				if(bbox && (p.x() < req.bbox_min.x || p.x() > req.bbox_max.x ||
+						p.y() < req.bbox_min.y || p.y() > req.bbox_max.y ||
+						(bboxZ && (p.z() < req.bbox_min.z || p.z() > req.bbox_max.z))))
+				{
+					continue;
+				}
+				if(iter->first < 0)
+				{
+					// landmarks are returned with the first page
+					if(req.continuation == 0)
+					{
+						landmarks.insert(*iter);
+					}
+					continue;
+				}
+				if((req.min_id > 0 && iter->first < req.min_id) ||
+				   (req.max_id > 0 && iter->first > req.max_id))
+				{
+					continue;
+				}
+				if(!mapIds.empty())
+				{
+					std::map<int, Signature>::iterator jter = infos.find(iter->first);
+					if(jter == infos.end() || mapIds.find(jter->second.mapId()) == mapIds.end())
+					{
+						continue;
+					}
+				}
+				if(req.continuation != 0 &&
+				   (req.latest_first?iter->first > req.continuation:iter->first < req.continuation))
+				{
+					continue;
+				}
+				ids.push_back(iter->first);
+			}
+			if(req.latest_first)
+			{
+				std::reverse(ids.begin(), ids.end());
+			}
+			if(req.max_count > 0 && (int)ids.size() > req.max_count)
+			{
+				res.continuation = ids[req.max_count];
+				ids.resize(req.max_count);
+			}
 
-	rtabmap_.getGraph(
-			poses,
-			constraints,
-			req.optimized,
-			req.global,
-			&signatures,
-			req.with_images,
-			req.with_scans,
-			req.with_user_data,
-			req.with_grids,
-			req.with_words,
-			req.with_global_descriptors);
-
-	//RGB-D SLAM data
+			std::map<int, Transform> selectedPoses = landmarks;
+			for(size_t i=0; i<ids.size(); ++i)
+			{
+				selectedPoses.insert(*poses.find(ids[i]));
+				Signature s = rtabmap_.getSignatureCopy(ids[i],
+						req.with_images,
+						req.with_scans,
+						req.with_user_data,
+						req.with_grids,
+						req.with_words,
+						req.with_global_descriptors);
+				if(s.id() > 0)
+				{
+					signatures.insert(std::make_pair(s.id(), s));
+				}
+			}
+			poses = selectedPoses;
+
+			std::multimap<int, rtabmap::Link> selectedConstraints;
+			for(std::multimap<int, rtabmap::Link>::iterator iter=constraints.begin(); iter!=constraints.end(); ++iter)
+			{
+				if(poses.find(iter->second.from()) != poses.end() && poses.find(iter->second.to()) != poses.end())
+				{
+					selectedConstraints.insert(*iter);
+				}
+			}
+			constraints = selectedConstraints;
+			NODELET_INFO("rtabmap: Filtered map: %d nodes (continuation=%d)", (int)ids.size(), res.continuation);
+		}
+		mapToOdom = mapToOdom_;
+
+		if(keyFrame && mapDeltaVersion_ > 0)
+		{
+			// keyframe for subscribers of the delta-encoded mapData/mapGraph topics
+			poses = mapDeltaPoses_;
+			constraints = mapDeltaLinks_;
+			keyFrameVersion = mapDeltaVersion_;
+		}
+	}
+
+	//RGB-D SLAM data (signatures are copies, rtabmap doesn't need to be locked)
 	rtabmap_ros::mapDataToROS(poses,
 		constraints,
 		signatures,
-		mapToOdom_,
-		res.data);
+		mapToOdom,
+		res.data,
+		wordsPacking_,
+		graphPacking_);
+	res.data.graph.version = keyFrameVersion;
+	res.data.graph.baseVersion = 0;
 
 	res.data.header.stamp = ros::Time::now();
 	res.data.header.frame_id = mapFrameId_;
@@ -3199,13 +4536,27 @@ bool CoreWrapper::getGridMapCallback(nav_msgs::GetMap::Request  &req, nav_msgs::
 
 bool CoreWrapper::getMapCallback(nav_msgs::GetMap::Request  &req, nav_msgs::GetMap::Response &res)
 {
-	// Make sure grid map cache is up to date (in case there is no subscriber on map topics)
-	std::map<int, Transform> poses = rtabmap_.getLocalOptimizedPoses();
-	mapsManager_.updateMapCaches(poses, rtabmap_.getMemory(), true, false);
-
-	// create the grid map
 	float xMin=0.0f, yMin=0.0f, gridCellSize = 0.05f;
-	cv::Mat pixels = mapsManager_.getGridMap(xMin, yMin, gridCellSize);
+	cv::Mat pixels;
+	MapSnapshot::ConstPtr snapshot = mapSnapshot_.get();
+	if(snapshot.get())
+	{
+		// Without locking rtabmap, only nodes already cached are assembled
+		boost::mutex::scoped_lock mapsLock(mapsMutex_);
+		mapsManager_.updateMapCaches(snapshot->poses(), 0, true, false);
+		pixels = mapsManager_.getGridMap(xMin, yMin, gridCellSize);
+	}
+	else
+	{
+		UScopeMutex lock(rtabmapMutex_);
+		boost::mutex::scoped_lock mapsLock(mapsMutex_);
+		// Make sure grid map cache is up to date (in case there is no subscriber on map topics)
+		std::map<int, Transform> poses = rtabmap_.getLocalOptimizedPoses();
+		mapsManager_.updateMapCaches(poses, rtabmap_.getMemory(), true, false);
+
+		// create the grid map
+		pixels = mapsManager_.getGridMap(xMin, yMin, gridCellSize);
+	}
 
 	if(!pixels.empty())
 	{
@@ -3240,13 +4591,27 @@ bool CoreWrapper::getMapCallback(nav_msgs::GetMap::Request  &req, nav_msgs::GetM
 
 bool CoreWrapper::getProbMapCallback(nav_msgs::GetMap::Request  &req, nav_msgs::GetMap::Response &res)
 {
-	// Make sure grid map cache is up to date (in case there is no subscriber on map topics)
-	std::map<int, Transform> poses = rtabmap_.getLocalOptimizedPoses();
-	mapsManager_.updateMapCaches(poses, rtabmap_.getMemory(), true, false);
-
-	// create the grid map
 	float xMin=0.0f, yMin=0.0f, gridCellSize = 0.05f;
-	cv::Mat pixels = mapsManager_.getGridProbMap(xMin, yMin, gridCellSize);
+	cv::Mat pixels;
+	MapSnapshot::ConstPtr snapshot = mapSnapshot_.get();
+	if(snapshot.get())
+	{
+		// Without locking rtabmap, only nodes already cached are assembled
+		boost::mutex::scoped_lock mapsLock(mapsMutex_);
+		mapsManager_.updateMapCaches(snapshot->poses(), 0, true, false);
+		pixels = mapsManager_.getGridProbMap(xMin, yMin, gridCellSize);
+	}
+	else
+	{
+		UScopeMutex lock(rtabmapMutex_);
+		boost::mutex::scoped_lock mapsLock(mapsMutex_);
+		// Make sure grid map cache is up to date (in case there is no subscriber on map topics)
+		std::map<int, Transform> poses = rtabmap_.getLocalOptimizedPoses();
+		mapsManager_.updateMapCaches(poses, rtabmap_.getMemory(), true, false);
+
+		// create the grid map
+		pixels = mapsManager_.getGridProbMap(xMin, yMin, gridCellSize);
+	}
 
 	if(!pixels.empty())
 	{
@@ -3281,6 +4646,8 @@ bool CoreWrapper::getProbMapCallback(nav_msgs::GetMap::Request  &req, nav_msgs::
 
 bool CoreWrapper::publishMapCallback(rtabmap_ros::PublishMap::Request& req, rtabmap_ros::PublishMap::Response& res)
 {
+	UScopeMutex lock(rtabmapMutex_);
+	boost::mutex::scoped_lock mapsLock(mapsMutex_);
 	NODELET_INFO("rtabmap: Publishing map...");
 
 	ros::Time now = ros::Time::now();
@@ -3314,7 +4681,9 @@ bool CoreWrapper::publishMapCallback(rtabmap_ros::PublishMap::Request& req, rtab
 				constraints,
 				signatures,
 				mapToOdom_,
-				*msg);
+				*msg,
+				wordsPacking_,
+				graphPacking_);
 
 			mapDataPub_.publish(msg);
 		}
@@ -3328,7 +4697,8 @@ bool CoreWrapper::publishMapCallback(rtabmap_ros::PublishMap::Request& req, rtab
 			rtabmap_ros::mapGraphToROS(poses,
 				constraints,
 				mapToOdom_,
-				*msg);
+				*msg,
+				graphPacking_);
 
 			mapGraphPub_.publish(msg);
 		}
@@ -3388,7 +4758,7 @@ bool CoreWrapper::publishMapCallback(rtabmap_ros::PublishMap::Request& req, rtab
 				std::map<int, Transform> filteredPoses(poses.lower_bound(1), poses.end());
 				if((mappingMaxNodes_ > 0 || mappingAltitudeDelta_>0.0) && filteredPoses.size()>1)
 				{
-					std::map<int, Transform> nearestPoses = filterNodesToAssemble(filteredPoses, filteredPoses.rbegin()->second);
+					filteredPoses = filterNodesToAssemble(filteredPoses, filteredPoses.rbegin()->second);
 				}
 				if(signatures.size())
 				{
@@ -3528,6 +4898,7 @@ bool CoreWrapper::publishMapCallback(rtabmap_ros::PublishMap::Request& req, rtab
 
 bool CoreWrapper::getPlanCallback(nav_msgs::GetPlan::Request &req, nav_msgs::GetPlan::Response &res)
 {
+	UScopeMutex lock(rtabmapMutex_);
 	Transform pose = rtabmap_ros::transformFromPoseMsg(req.goal.pose, true);
 	UTimer timer;
 	if(!pose.isNull())
@@ -3602,6 +4973,7 @@ bool CoreWrapper::getPlanCallback(nav_msgs::GetPlan::Request &req, nav_msgs::Get
 
 bool CoreWrapper::getPlanNodesCallback(rtabmap_ros::GetPlan::Request &req, rtabmap_ros::GetPlan::Response &res)
 {
+	UScopeMutex lock(rtabmapMutex_);
 	Transform pose;
 	if(req.goal_node <= 0)
 	{
@@ -3631,6 +5003,36 @@ bool CoreWrapper::getPlanNodesCallback(rtabmap_ros::GetPlan::Request &req, rtabm
 		// To convert back the poses in goal frame
 		coordinateTransform = coordinateTransform.inverse();
 
+		// Plans to a node are cached, start node is the one used by Rtabmap::computePath()
+		int startId = 0;
+		if(req.goal_node > 0 && planCache_.enabled() && rtabmap_.getMemory())
+		{
+			if(rtabmap_.getMemory()->isIncremental())
+			{
+				startId = rtabmap_.getLastLocationId();
+			}
+			else if(!rtabmap_.getLastLocalizationPose().isNull())
+			{
+				updateNodesIndex();
+				startId = nodesIndex_.nearest(rtabmap_.getLastLocalizationPose(), rtabmap_.getLocalRadius());
+				if(startId == 0)
+				{
+					// farther than the local radius
+					startId = rtabmap::graph::findNearestNode(rtabmap_.getLocalOptimizedPoses(), rtabmap_.getLastLocalizationPose());
+				}
+			}
+			const PlanCache::Plan * plan = startId>0?planCache_.get(startId, req.goal_node, planGraphVersion_, rtabmap_.getLocalOptimizedPoses()):0;
+			if(plan)
+			{
+				res.plan = plan->msg;
+				res.plan.header.frame_id = mapFrameId_;
+				res.plan.header.stamp = ros::Time::now();
+				NODELET_INFO("Planning: Cached path %d -> %d (%d nodes, %lu hits, %lu repairs, %lu misses)",
+						startId, req.goal_node, (int)plan->path.size(), planCache_.hits(), planCache_.repairs(), planCache_.misses());
+				return true;
+			}
+		}
+
 		if((req.goal_node > 0 && rtabmap_.computePath(req.goal_node, req.tolerance)) ||
 		   (req.goal_node <= 0 && rtabmap_.computePath(pose, req.tolerance)))
 		{
@@ -3670,6 +5072,15 @@ bool CoreWrapper::getPlanNodesCallback(rtabmap_ros::GetPlan::Request &req, rtabm
 					rtabmap_ros::transformToPoseMsg(coordinateTransform*p, res.plan.poses[res.plan.poses.size()-1]);
 					res.plan.nodeIds[res.plan.nodeIds.size()-1] = 0;
 				}
+				if(startId > 0)
+				{
+					// coordinateTransform is identity when planning to a node
+					PlanCache::Plan plan;
+					plan.path = poses;
+					plan.transformToGoal = rtabmap_.getPathTransformToGoal();
+					plan.msg = res.plan;
+					planCache_.add(startId, req.goal_node, planGraphVersion_, plan);
+				}
 
 				// Just output the path on screen
 				std::stringstream stream;
@@ -3691,6 +5102,7 @@ bool CoreWrapper::getPlanNodesCallback(rtabmap_ros::GetPlan::Request &req, rtabm
 
 bool CoreWrapper::setGoalCallback(rtabmap_ros::SetGoal::Request& req, rtabmap_ros::SetGoal::Response& res)
 {
+	UScopeMutex lock(rtabmapMutex_);
 	double planningTime = 0.0;
 	goalCommonCallback(req.node_id, req.node_label, req.frame_id, Transform(), ros::Time::now(), &planningTime);
 	const std::vector<std::pair<int, Transform> > & path = rtabmap_.getPath();
@@ -3707,6 +5119,7 @@ bool CoreWrapper::setGoalCallback(rtabmap_ros::SetGoal::Request& req, rtabmap_ro
 
 bool CoreWrapper::cancelGoalCallback(std_srvs::Empty::Request& req, std_srvs::Empty::Response& res)
 {
+	UScopeMutex lock(rtabmapMutex_);
 	if(rtabmap_.getPath().size())
 	{
 		NODELET_WARN("Goal cancelled!");
@@ -3732,6 +5145,7 @@ bool CoreWrapper::cancelGoalCallback(std_srvs::Empty::Request& req, std_srvs::Em
 
 bool CoreWrapper::setLabelCallback(rtabmap_ros::SetLabel::Request& req, rtabmap_ros::SetLabel::Response& res)
 {
+	UScopeMutex lock(rtabmapMutex_);
 	if(rtabmap_.labelLocation(req.node_id, req.node_label))
 	{
 		if(req.node_id > 0)
@@ -3742,6 +5156,7 @@ bool CoreWrapper::setLabelCallback(rtabmap_ros::SetLabel::Request& req, rtabmap_
 		{
 			NODELET_INFO("Set label \"%s\" to last node", req.node_label.c_str());
 		}
+		updateMapSnapshot();
 	}
 	else
 	{
@@ -3759,6 +5174,15 @@ bool CoreWrapper::setLabelCallback(rtabmap_ros::SetLabel::Request& req, rtabmap_
 
 bool CoreWrapper::listLabelsCallback(rtabmap_ros::ListLabels::Request& req, rtabmap_ros::ListLabels::Response& res)
 {
+	MapSnapshot::ConstPtr snapshot = mapSnapshot_.get();
+	if(snapshot.get())
+	{
+		res.ids = uKeys(snapshot->labels());
+		res.labels = uValues(snapshot->labels());
+		NODELET_INFO("List labels service: %d labels found.", (int)res.labels.size());
+		return true;
+	}
+	UScopeMutex lock(rtabmapMutex_);
 	if(rtabmap_.getMemory())
 	{
 		std::map<int, std::string> labels = rtabmap_.getMemory()->getAllLabels();
@@ -3771,26 +5195,165 @@ bool CoreWrapper::listLabelsCallback(rtabmap_ros::ListLabels::Request& req, rtab
 
 bool CoreWrapper::addLinkCallback(rtabmap_ros::AddLink::Request& req, rtabmap_ros::AddLink::Response&)
 {
+	UScopeMutex lock(rtabmapMutex_);
 	if(rtabmap_.getMemory())
 	{
 		ROS_INFO("Adding external link %d -> %d", req.link.fromId, req.link.toId);
-		rtabmap_.addLink(linkFromROS(req.link));
+		if(rtabmap_.addLink(linkFromROS(req.link)))
+		{
+			++planGraphVersion_;
+			updateMapSnapshot();
+		}
 		return true;
 	}
 	return false;
 }
 
+bool CoreWrapper::addLinksCallback(rtabmap_ros::AddLinks::Request& req, rtabmap_ros::AddLinks::Response& res)
+{
+	UScopeMutex lock(rtabmapMutex_);
+	if(!rtabmap_.getMemory())
+	{
+		return false;
+	}
+	res.accepted.resize(req.links.size(), false);
+
+	// Validate all links first, rejecting those that cannot be added
+	// to the current graph and duplicates in the batch
+	const std::map<int, Transform> & optimizedPoses = rtabmap_.getLocalOptimizedPoses();
+	std::set<std::pair<int, int> > pairs;
+	std::vector<rtabmap::Link> links(req.links.size());
+	int valid = 0;
+	for(size_t i=0; i<req.links.size(); ++i)
+	{
+		const rtabmap_ros::Link & msg = req.links[i];
+		std::pair<int, int> pair(std::min(msg.fromId, msg.toId), std::max(msg.fromId, msg.toId));
+		if(msg.fromId == msg.toId ||
+		   optimizedPoses.find(msg.fromId) == optimizedPoses.end() ||
+		   optimizedPoses.find(msg.toId) == optimizedPoses.end())
+		{
+			NODELET_WARN("Add links: link %d -> %d rejected, both nodes should be in the current graph.", msg.fromId, msg.toId);
+			continue;
+		}
+		if(!pairs.insert(pair).second)
+		{
+			NODELET_WARN("Add links: link %d -> %d rejected, already in the request.", msg.fromId, msg.toId);
+			continue;
+		}
+		links[i] = linkFromROS(msg);
+		bool informationValid = true;
+		for(int j=0; j<6 && informationValid; ++j)
+		{
+			double v = links[i].information().at<double>(j,j);
+			informationValid = uIsFinite(v) && v > 0.0;
+		}
+		if(links[i].transform().isNull() || !informationValid)
+		{
+			NODELET_WARN("Add links: link %d -> %d rejected, null transform or invalid information matrix.", msg.fromId, msg.toId);
+			links[i] = rtabmap::Link();
+			continue;
+		}
+		++valid;
+	}
+
+	int added = 0;
+	for(size_t i=0; i<links.size(); ++i)
+	{
+		if(links[i].from() != 0 && rtabmap_.addLink(links[i]))
+		{
+			res.accepted[i] = true;
+			++added;
+		}
+	}
+	NODELET_INFO("Add links: %d/%d links added (%d valid)", added, (int)req.links.size(), valid);
+
+	if(added)
+	{
+		nodesIndexOutdated_ = true;
+		++planGraphVersion_;
+		mapToOdomMutex_.lock();
+		mapToOdom_ = rtabmap_.getMapCorrection();
+		mapToOdomSnapshot_.set(mapToOdom_, ros::Time::now().toSec());
+		mapToOdomMutex_.unlock();
+		updateMapSnapshot();
+
+		// single republish of the maps with the graph optimized after the last link
+		boost::mutex::scoped_lock mapsLock(mapsMutex_);
+		if(mapsManager_.hasSubscribers())
+		{
+			const std::map<int, Transform> & poses = rtabmap_.getLocalOptimizedPoses();
+			std::map<int, Transform> filteredPoses(poses.lower_bound(1), poses.end());
+			// the caches should follow the re-optimized poses before publishing,
+			// the returned poses are filtered like the caches
+			filteredPoses = mapsManager_.updateMapCaches(
+					filteredPoses,
+					rtabmap_.getMemory(),
+					false,
+					false);
+			mapsManager_.publishMaps(filteredPoses, ros::Time::now(), mapFrameId_);
+		}
+	}
+	return true;
+}
+
+static std::map<int, Transform> nodesInRadius(
+		const NodesSpatialIndex & index,
+		const Transform & lastLocalizationPose,
+		float localRadius,
+		const rtabmap_ros::GetNodesInRadius::Request & req)
+{
+	Transform position;
+	if(req.node_id != 0)
+	{
+		std::map<int, Transform>::const_iterator iter = index.poses().find(req.node_id);
+		if(iter != index.poses().end())
+		{
+			position = iter->second;
+		}
+	}
+	else if(req.x == 0.0f && req.y == 0.0f && req.z == 0.0f)
+	{
+		position = lastLocalizationPose;
+	}
+	else
+	{
+		position = Transform(req.x, req.y, req.z, 0,0,0);
+	}
+
+	std::map<int, Transform> poses;
+	if(!position.isNull())
+	{
+		poses = index.radiusSearch(position, req.radius<=0.0f?localRadius:req.radius);
+	}
+	return poses;
+}
+
+void CoreWrapper::updateNodesIndex()
+{
+	// rtabmapMutex_ should be locked
+	if(nodesIndexOutdated_)
+	{
+		// lazily refresh the index, only nodes moved by the last optimization are re-indexed
+		int changes = nodesIndex_.update(rtabmap_.getLocalOptimizedPoses());
+		UDEBUG("Updated nodes spatial index (%d changes, %d nodes)", changes, (int)nodesIndex_.size());
+		nodesIndexOutdated_ = false;
+	}
+}
+
 bool CoreWrapper::getNodesInRadiusCallback(rtabmap_ros::GetNodesInRadius::Request& req, rtabmap_ros::GetNodesInRadius::Response& res)
 {
 	ROS_INFO("Get nodes in radius (%f): node_id=%d pose=(%f,%f,%f)", req.radius, req.node_id, req.x, req.y, req.z);
 	std::map<int, Transform> poses;
-	if(req.node_id != 0 || (req.x == 0.0f && req.y == 0.0f && req.z == 0.0f))
+	MapSnapshot::ConstPtr snapshot = mapSnapshot_.get();
+	if(snapshot.get())
 	{
-		poses = rtabmap_.getNodesInRadius(req.node_id, req.radius);
+		poses = nodesInRadius(snapshot->nodesIndex(), snapshot->lastLocalizationPose(), snapshot->localRadius(), req);
 	}
 	else
 	{
-		poses = rtabmap_.getNodesInRadius(Transform(req.x, req.y, req.z, 0,0,0), req.radius);
+		UScopeMutex lock(rtabmapMutex_);
+		updateNodesIndex();
+		poses = nodesInRadius(nodesIndex_, rtabmap_.getLastLocalizationPose(), rtabmap_.getLocalRadius(), req);
 	}
 
 	//Optimized graph
@@ -3809,6 +5372,79 @@ bool CoreWrapper::getNodesInRadiusCallback(rtabmap_ros::GetNodesInRadius::Reques
 	return true;
 }
 
+bool CoreWrapper::getNodesByDescriptorCallback(rtabmap_ros::GetNodesByDescriptor::Request& req, rtabmap_ros::GetNodesByDescriptor::Response& res)
+{
+	UScopeMutex lock(rtabmapMutex_);
+	UTimer timer;
+	if(descriptorIndexOutdated_)
+	{
+		// nodes transferred out of the graph are removed, those retrieved
+		// (or from a loaded map) are added with their descriptor from memory
+		const std::map<int, Transform> & poses = rtabmap_.getLocalOptimizedPoses();
+		std::vector<int> removed;
+		for(std::map<int, int>::const_iterator iter=descriptorIndex_.ids().begin(); iter!=descriptorIndex_.ids().end(); ++iter)
+		{
+			if(poses.find(iter->first) == poses.end())
+			{
+				removed.push_back(iter->first);
+			}
+		}
+		for(size_t i=0; i<removed.size(); ++i)
+		{
+			descriptorIndex_.remove(removed[i]);
+		}
+		int added = 0;
+		for(std::map<int, Transform>::const_iterator iter=poses.lower_bound(1); iter!=poses.end(); ++iter)
+		{
+			if(!descriptorIndex_.contains(iter->first) && nodesWithoutDescriptor_.find(iter->first) == nodesWithoutDescriptor_.end())
+			{
+				Signature s = rtabmap_.getSignatureCopy(iter->first, false, false, false, false, false, true);
+				if(!s.sensorData().globalDescriptors().empty() &&
+				   descriptorIndex_.add(iter->first, s.sensorData().globalDescriptors().front().data()))
+				{
+					++added;
+				}
+				else
+				{
+					nodesWithoutDescriptor_.insert(iter->first);
+				}
+			}
+		}
+		UDEBUG("Updated descriptor index (%d added, %d removed, %d nodes)", added, (int)removed.size(), (int)descriptorIndex_.size());
+		descriptorIndexOutdated_ = false;
+	}
+
+	cv::Mat descriptor;
+	if(req.node_id > 0)
+	{
+		descriptor = descriptorIndex_.descriptor(req.node_id);
+		if(descriptor.empty())
+		{
+			NODELET_WARN("Get nodes by descriptor: node %d has no global descriptor in the graph.", req.node_id);
+			return true;
+		}
+	}
+	else
+	{
+		descriptor = rtabmap_ros::globalDescriptorFromROS(req.descriptor).data();
+	}
+
+	// query node is excluded
+	std::vector<std::pair<int, float> > nearest = descriptorIndex_.knnSearch(descriptor, req.node_id>0?req.k+1:req.k, req.ef>0?req.ef:64);
+	res.ids.reserve(nearest.size());
+	res.distances.reserve(nearest.size());
+	for(size_t i=0; i<nearest.size() && (int)res.ids.size()<req.k; ++i)
+	{
+		if(nearest[i].first != req.node_id)
+		{
+			res.ids.push_back(nearest[i].first);
+			res.distances.push_back(nearest[i].second);
+		}
+	}
+	NODELET_DEBUG("Get nodes by descriptor: %d nodes found (index=%d nodes, %fs)", (int)res.ids.size(), (int)descriptorIndex_.size(), timer.ticks());
+	return true;
+}
+
 void CoreWrapper::publishStats(const ros::Time & stamp)
 {
 	UDEBUG("Publishing stats...");
@@ -3825,40 +5461,80 @@ void CoreWrapper::publishStats(const ros::Time & stamp)
 		infoPub_.publish(msg);
 	}
 
-	if(mapDataPub_.getNumSubscribers())
+	if(!isLocalizationLightweight() && (mapDataPub_.getNumSubscribers() || mapDataGridsPub_.getNumSubscribers() || mapGraphPub_.getNumSubscribers()))
 	{
-		rtabmap_ros::MapDataPtr msg(new rtabmap_ros::MapData);
-		msg->header.stamp = stamp;
-		msg->header.frame_id = mapFrameId_;
-
-		std::map<int, Signature> signatures;
-		if(stats.getLastSignatureData().id() > 0)
+		// same graph for both topics, so that they share the same delta version
+		rtabmap_ros::MapGraphPtr graphMsg(new rtabmap_ros::MapGraph);
+		graphMsg->header.stamp = stamp;
+		graphMsg->header.frame_id = mapFrameId_;
+		if(mapDeltaEnabled_)
 		{
-			signatures.insert(std::make_pair(stats.getLastSignatureData().id(), stats.getLastSignatureData()));
+			unsigned int baseVersion = mapDeltaVersion_;
+			if(mapDeltaPoses_.empty() ||
+			   (mapDeltaKeyFrameInterval_ > 0 && (mapDeltaVersion_+1) % mapDeltaKeyFrameInterval_ == 0))
+			{
+				// keyframe
+				mapDeltaPoses_.clear();
+				mapDeltaLinks_.clear();
+				baseVersion = 0;
+			}
+			rtabmap_ros::mapGraphDeltaToROS(
+				stats.poses(),
+				stats.constraints(),
+				stats.mapCorrection(),
+				mapDeltaPoses_,
+				mapDeltaLinks_,
+				mapDeltaLinearUpdate_,
+				mapDeltaAngularUpdate_,
+				*graphMsg,
+				graphPacking_);
+			graphMsg->version = ++mapDeltaVersion_;
+			graphMsg->baseVersion = baseVersion;
+		}
+		else
+		{
+			rtabmap_ros::mapGraphToROS(
+				stats.poses(),
+				stats.constraints(),
+				stats.mapCorrection(),
+				*graphMsg,
+				graphPacking_);
 		}
-		rtabmap_ros::mapDataToROS(
-			stats.poses(),
-			stats.constraints(),
-			signatures,
-			stats.mapCorrection(),
-			*msg);
-
-		mapDataPub_.publish(msg);
-	}
 
-	if(mapGraphPub_.getNumSubscribers())
-	{
-		rtabmap_ros::MapGraphPtr msg(new rtabmap_ros::MapGraph);
-		msg->header.stamp = stamp;
-		msg->header.frame_id = mapFrameId_;
+		if(mapDataPub_.getNumSubscribers())
+		{
+			rtabmap_ros::MapDataPtr msg(new rtabmap_ros::MapData);
+			msg->header.stamp = stamp;
+			msg->header.frame_id = mapFrameId_;
+			msg->graph = *graphMsg;
+			if(stats.getLastSignatureData().id() > 0)
+			{
+				msg->nodes.resize(1);
+				rtabmap_ros::nodeDataToROS(stats.getLastSignatureData(), msg->nodes[0], wordsPacking_);
+			}
+			mapDataPub_.publish(msg);
+		}
 
-		rtabmap_ros::mapGraphToROS(
-			stats.poses(),
-			stats.constraints(),
-			stats.mapCorrection(),
-			*msg);
+		if(mapDataGridsPub_.getNumSubscribers())
+		{
+			// for remote map building (map_builder), only the local grid of the new node
+			rtabmap_ros::MapDataPtr msg(new rtabmap_ros::MapData);
+			msg->header.stamp = stamp;
+			msg->header.frame_id = mapFrameId_;
+			msg->graph = *graphMsg;
+			const SensorData & data = stats.getLastSignatureData().sensorData();
+			if(stats.getLastSignatureData().id() > 0 && data.gridCellSize() > 0.0f)
+			{
+				msg->nodes.resize(1);
+				rtabmap_ros::nodeLocalGridToROS(stats.getLastSignatureData(), msg->nodes[0]);
+			}
+			mapDataGridsPub_.publish(msg);
+		}
 
-		mapGraphPub_.publish(msg);
+		if(mapGraphPub_.getNumSubscribers())
+		{
+			mapGraphPub_.publish(graphMsg);
+		}
 	}
 
 	if(localGridObstacle_.getNumSubscribers() && !stats.getLastSignatureData().sensorData().gridObstacleCellsRaw().empty())
@@ -4091,6 +5767,7 @@ void CoreWrapper::publishCurrentGoal(const ros::Time & stamp)
 void CoreWrapper::goalDoneCb(const actionlib::SimpleClientGoalState& state,
              const move_base_msgs::MoveBaseResultConstPtr& result)
 {
+	UScopeMutex lock(rtabmapMutex_);
 	bool ignore = false;
 	if(!currentMetricGoal_.isNull())
 	{
@@ -4194,21 +5871,36 @@ void CoreWrapper::publishGlobalPath(const ros::Time & stamp)
 			// transform the global path in the goal referential
 			Transform t = pose * rtabmap_.getPath().at(rtabmap_.getPathCurrentGoalIndex()).second.inverse();
 
-			nav_msgs::Path path;
-			rtabmap_ros::Path pathNodes;
+			// Messages of the previous update are reused if the path has the
+			// same nodes, only poses that changed are converted again
+			const std::vector<std::pair<int, Transform> > & globalPath = rtabmap_.getPath();
+			nav_msgs::Path & path = globalPathMsg_;
+			rtabmap_ros::Path & pathNodes = globalPathNodesMsg_;
+			bool samePath = globalPathPoses_.size() == globalPath.size();
+			for(size_t i=0; samePath && i<globalPath.size(); ++i)
+			{
+				samePath = pathNodes.nodeIds[i] == globalPath[i].first;
+			}
+			if(!samePath)
+			{
+				globalPathPoses_ = std::vector<Transform>(globalPath.size());
+			}
 			path.header.frame_id = pathNodes.header.frame_id = mapFrameId_;
 			path.header.stamp = pathNodes.header.stamp = stamp;
-			path.poses.resize(rtabmap_.getPath().size());
-			pathNodes.nodeIds.resize(rtabmap_.getPath().size());
-			pathNodes.poses.resize(rtabmap_.getPath().size());
-			int oi = 0;
-			for(std::vector<std::pair<int, Transform> >::const_iterator iter=rtabmap_.getPath().begin(); iter!=rtabmap_.getPath().end(); ++iter)
+			path.poses.resize(globalPath.size());
+			pathNodes.nodeIds.resize(globalPath.size());
+			pathNodes.poses.resize(globalPath.size());
+			for(size_t oi=0; oi<globalPath.size(); ++oi)
 			{
 				path.poses[oi].header = path.header;
-				rtabmap_ros::transformToPoseMsg(t*iter->second, path.poses[oi].pose);
-				pathNodes.poses[oi] = path.poses[oi].pose;
-				pathNodes.nodeIds[oi] = iter->first;
-				++oi;
+				Transform p = t*globalPath[oi].second;
+				if(globalPathPoses_[oi].isNull() || memcmp(globalPathPoses_[oi].data(), p.data(), 12*sizeof(float)) != 0)
+				{
+					globalPathPoses_[oi] = p;
+					rtabmap_ros::transformToPoseMsg(p, path.poses[oi].pose);
+					pathNodes.poses[oi] = path.poses[oi].pose;
+					pathNodes.nodeIds[oi] = globalPath[oi].first;
+				}
 			}
 			Transform goalLocalTransform = Transform::getIdentity();
 			if(!goalFrameId_.empty() && goalFrameId_.compare(frameId_) != 0)
@@ -4243,12 +5935,65 @@ void CoreWrapper::publishGlobalPath(const ros::Time & stamp)
 	}
 }
 
+void CoreWrapper::updateMapSnapshot()
+{
+	// rtabmapMutex_ should be locked
+	if(queryThreads_ > 0)
+	{
+		UTimer timer;
+		mapToOdomMutex_.lock();
+		Transform mapToOdom = mapToOdom_;
+		mapToOdomMutex_.unlock();
+		mapSnapshot_.set(MapSnapshot::create(
+				mapSnapshot_.get(),
+				rtabmap_,
+				mapToOdom,
+				nodesIndex_.cellSize(),
+				ros::Time::now().toSec()));
+		UDEBUG("Map snapshot updated (%fs)", timer.ticks());
+	}
+}
+
+bool CoreWrapper::getCloudChunksCallback(rtabmap_ros::GetCloudChunks::Request& req, rtabmap_ros::GetCloudChunks::Response& res)
+{
+	UScopeMutex lock(rtabmapMutex_);
+	boost::mutex::scoped_lock mapsLock(mapsMutex_);
+	std::map<int, Transform> poses = rtabmap_.getLocalOptimizedPoses();
+	if((mappingMaxNodes_ > 0 || mappingAltitudeDelta_>0.0) && poses.size()>1)
+	{
+		poses = filterNodesToAssemble(poses, poses.rbegin()->second);
+	}
+
+	// Make sure local grids are cached (in case there is no subscriber on map topics)
+	poses = mapsManager_.updateMapCaches(poses, rtabmap_.getMemory(), true, false);
+
+	res.version = mapsManager_.getCloudChunks(
+			poses,
+			req.level,
+			cv::Point3f(req.roi_min.x, req.roi_min.y, req.roi_min.z),
+			cv::Point3f(req.roi_max.x, req.roi_max.y, req.roi_max.z),
+			req.since_version,
+			res.chunks);
+
+	ros::Time now = ros::Time::now();
+	for(size_t i=0; i<res.chunks.size(); ++i)
+	{
+		res.chunks[i].header.frame_id = mapFrameId_;
+		res.chunks[i].header.stamp = now;
+		res.chunks[i].cloud.header = res.chunks[i].header;
+	}
+	NODELET_INFO("Sending %d cloud chunks (level=%d, version=%d) on service request", (int)res.chunks.size(), (int)req.level, (int)res.version);
+	return true;
+}
+
 #ifdef WITH_OCTOMAP_MSGS
 #ifdef RTABMAP_OCTOMAP
 bool CoreWrapper::octomapBinaryCallback(
 		octomap_msgs::GetOctomap::Request  &req,
 		octomap_msgs::GetOctomap::Response &res)
 {
+	UScopeMutex lock(rtabmapMutex_);
+	boost::mutex::scoped_lock mapsLock(mapsMutex_);
 	NODELET_INFO("Sending binary map data on service request");
 	res.map.header.frame_id = mapFrameId_;
 	res.map.header.stamp = ros::Time::now();
@@ -4261,8 +6006,10 @@ bool CoreWrapper::octomapBinaryCallback(
 
 	mapsManager_.updateMapCaches(poses, rtabmap_.getMemory(), false, true);
 
-	const rtabmap::OctoMap * octomap = mapsManager_.getOctomap();
-	bool success = octomap->octree()->size() && octomap_msgs::binaryMapToMsg(*octomap->octree(), res.map);
+	// cached until the octomap changes
+	std_msgs::Header header = res.map.header;
+	bool success = mapsManager_.getOctomapMsg(false, res.map);
+	res.map.header = header;
 	return success;
 }
 
@@ -4274,6 +6021,25 @@ bool CoreWrapper::octomapFullCallback(
 	res.map.header.frame_id = mapFrameId_;
 	res.map.header.stamp = ros::Time::now();
 
+	MapSnapshot::ConstPtr snapshot = mapSnapshot_.get();
+	if(snapshot.get())
+	{
+		// Without locking rtabmap, only nodes already cached are assembled
+		std::map<int, Transform> poses = snapshot->poses();
+		if((mappingMaxNodes_ > 0 || mappingAltitudeDelta_>0.0) && poses.size()>1)
+		{
+			poses = filterNodesToAssemble(poses, poses.rbegin()->second);
+		}
+		boost::mutex::scoped_lock mapsLock(mapsMutex_);
+		mapsManager_.updateMapCaches(poses, 0, false, true);
+		std_msgs::Header header = res.map.header;
+		bool success = mapsManager_.getOctomapMsg(true, res.map);
+		res.map.header = header;
+		return success;
+	}
+
+	UScopeMutex lock(rtabmapMutex_);
+	boost::mutex::scoped_lock mapsLock(mapsMutex_);
 	std::map<int, Transform> poses = rtabmap_.getLocalOptimizedPoses();
 	if((mappingMaxNodes_ > 0 || mappingAltitudeDelta_>0.0) && poses.size()>1)
 	{
@@ -4282,8 +6048,10 @@ bool CoreWrapper::octomapFullCallback(
 
 	mapsManager_.updateMapCaches(poses, rtabmap_.getMemory(), false, true);
 
-	const rtabmap::OctoMap * octomap = mapsManager_.getOctomap();
-	bool success = octomap->octree()->size() && octomap_msgs::fullMapToMsg(*octomap->octree(), res.map);
+	// cached until the octomap changes
+	std_msgs::Header header = res.map.header;
+	bool success = mapsManager_.getOctomapMsg(true, res.map);
+	res.map.header = header;
 	return success;
 }
 #endif
@@ -26,7 +26,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 #include <sensor_msgs/Image.h>
+#include <sensor_msgs/CompressedImage.h>
 #include <sensor_msgs/image_encodings.h>
 #include <sensor_msgs/PointCloud2.h>
 #include <sensor_msgs/LaserScan.h>
@@ -37,11 +39,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <pcl_conversions/pcl_conversions.h>
 #include <nav_msgs/Odometry.h>
 #include <cv_bridge/cv_bridge.h>
+#include <opencv2/highgui/highgui.hpp>
 #include <image_transport/image_transport.h>
 #include <tf2_ros/transform_broadcaster.h>
 #include <std_srvs/Empty.h>
 #include <rtabmap_ros/MsgConversion.h>
 #include <rtabmap_ros/SetGoal.h>
+#include <rtabmap_ros/Info.h>
 #include <rtabmap/utilite/ULogger.h>
 #include <rtabmap/utilite/UStl.h>
 #include <rtabmap/utilite/UThread.h>
@@ -50,6 +54,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/core/util3d.h>
 #include <rtabmap/core/DBReader.h>
 #include <rtabmap/core/OdometryEvent.h>
+#include <boost/thread.hpp>
+#include <deque>
 #include <cmath>
 
 #ifndef _WIN32
@@ -121,6 +127,271 @@ bool resumeCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
 	return true;
 }
 
+// Latest stamp acknowledged by the downstream node (closed-loop playback)
+ros::Time lastAck;
+void infoAckCallback(const rtabmap_ros::InfoConstPtr & msg)
+{
+	lastAck = std::max(lastAck, msg->header.stamp);
+}
+void odomAckCallback(const nav_msgs::OdometryConstPtr & msg)
+{
+	lastAck = std::max(lastAck, msg->header.stamp);
+}
+
+// Advertise an image topic. With passthrough, the compressed topic is published
+// from the database bytes instead of re-encoded by image_transport.
+image_transport::Publisher advertiseImage(
+		image_transport::ImageTransport & it,
+		ros::NodeHandle & nh,
+		const std::string & topic,
+		bool passthrough,
+		ros::Publisher & compressedPub)
+{
+	if(passthrough)
+	{
+		std::vector<std::string> disabledPlugins(1, "image_transport/compressed");
+		nh.setParam(topic + "/disable_pub_plugins", disabledPlugins);
+		compressedPub = nh.advertise<sensor_msgs::CompressedImage>(topic + "/compressed", 1);
+	}
+	return it.advertise(topic, 1);
+}
+
+// Wrap the jpg/png bytes from the database without decoding them. Falls back
+// to encode the raw image if the bytes are not in a known format.
+bool toCompressedImageMsg(
+		const cv::Mat & bytes,
+		const cv::Mat & raw,
+		const std::string & frameId,
+		const ros::Time & stamp,
+		sensor_msgs::CompressedImage & msg)
+{
+	std::string format;
+	if(!bytes.empty() && bytes.type() == CV_8UC1 && bytes.total() >= 4)
+	{
+		const unsigned char * ptr = bytes.data;
+		if(ptr[0] == 0xFF && ptr[1] == 0xD8)
+		{
+			format = "jpeg";
+		}
+		else if(ptr[0] == 0x89 && ptr[1] == 'P' && ptr[2] == 'N' && ptr[3] == 'G')
+		{
+			format = "png";
+		}
+		if(!format.empty())
+		{
+			msg.data.assign(ptr, ptr+bytes.total());
+		}
+	}
+
+	if(format.empty())
+	{
+		if(raw.empty() || (raw.type() != CV_8UC1 && raw.type() != CV_8UC3))
+		{
+			return false;
+		}
+		format = "jpeg";
+		cv::imencode(".jpg", raw, msg.data);
+	}
+
+	if(raw.type() == CV_8UC1)
+	{
+		msg.format = "mono8; " + format + " compressed mono8";
+	}
+	else if(raw.type() == CV_8UC3)
+	{
+		msg.format = "bgr8; " + format + " compressed bgr8";
+	}
+	else
+	{
+		// let the subscriber guess the encoding from the decoded image
+		msg.format = format;
+	}
+	msg.header.frame_id = frameId;
+	msg.header.stamp = stamp;
+	return true;
+}
+
+// A frame read from the database, with its image messages prepared in advance
+struct Frame
+{
+	Frame() : ready(false) {}
+	rtabmap::SensorData data;
+	rtabmap::CameraInfo cameraInfo;
+	sensor_msgs::ImagePtr imageMsg;
+	sensor_msgs::ImagePtr depthOrRightMsg;
+	bool ready;
+};
+typedef boost::shared_ptr<Frame> FramePtr;
+
+/**
+ * Reads ahead up to "size" frames in a thread, while "decoders" threads
+ * uncompress them and create their image messages in parallel. Frames
+ * are returned in database order.
+ */
+class FramePrefetcher
+{
+public:
+	FramePrefetcher(rtabmap::DBReader * reader, int size, int decoders, const std::string & cameraFrameId) :
+		reader_(reader),
+		size_(size),
+		cameraFrameId_(cameraFrameId),
+		stop_(false),
+		imageWanted_(true),
+		depthOrRightWanted_(true)
+	{
+		threads_.create_thread(boost::bind(&FramePrefetcher::readLoop, this));
+		for(int i=0; i<decoders; ++i)
+		{
+			threads_.create_thread(boost::bind(&FramePrefetcher::decodeLoop, this));
+		}
+	}
+	~FramePrefetcher()
+	{
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			stop_ = true;
+		}
+		condition_.notify_all();
+		threads_.join_all();
+	}
+
+	// Image messages are only created in advance for outputs having subscribers
+	void setOutputs(bool image, bool depthOrRight)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		imageWanted_ = image;
+		depthOrRightWanted_ = depthOrRight;
+	}
+
+	// Blocking, the returned frame has a null id at the end of the database
+	FramePtr take()
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		while(!stop_ && (frames_.empty() || !frames_.front()->ready))
+		{
+			condition_.wait(lock);
+		}
+		FramePtr frame;
+		if(!frames_.empty())
+		{
+			frame = frames_.front();
+			frames_.pop_front();
+		}
+		else
+		{
+			frame.reset(new Frame);
+		}
+		condition_.notify_all();
+		return frame;
+	}
+
+private:
+	void readLoop()
+	{
+		while(true)
+		{
+			{
+				boost::mutex::scoped_lock lock(mutex_);
+				while(!stop_ && (int)frames_.size() >= size_)
+				{
+					condition_.wait(lock);
+				}
+				if(stop_)
+				{
+					return;
+				}
+			}
+
+			FramePtr frame(new Frame);
+			frame->data = reader_->takeImage(&frame->cameraInfo);
+
+			boost::mutex::scoped_lock lock(mutex_);
+			frames_.push_back(frame);
+			if(frame->data.id() == 0)
+			{
+				// end of the database
+				frame->ready = true;
+				condition_.notify_all();
+				return;
+			}
+			decodeQueue_.push_back(frame);
+			condition_.notify_all();
+		}
+	}
+
+	void decodeLoop()
+	{
+		while(true)
+		{
+			FramePtr frame;
+			bool image, depthOrRight;
+			{
+				boost::mutex::scoped_lock lock(mutex_);
+				while(!stop_ && decodeQueue_.empty())
+				{
+					condition_.wait(lock);
+				}
+				if(stop_)
+				{
+					return;
+				}
+				frame = decodeQueue_.front();
+				decodeQueue_.pop_front();
+				image = imageWanted_;
+				depthOrRight = depthOrRightWanted_;
+			}
+
+			decode(*frame, image, depthOrRight);
+
+			boost::mutex::scoped_lock lock(mutex_);
+			frame->ready = true;
+			condition_.notify_all();
+		}
+	}
+
+	void decode(Frame & frame, bool image, bool depthOrRight)
+	{
+		// no-op for data already uncompressed by the reader
+		frame.data.uncompressData();
+
+		ros::Time time(frame.data.stamp());
+		if(image && !frame.data.imageRaw().empty())
+		{
+			cv_bridge::CvImage img;
+			img.encoding = frame.data.imageRaw().channels() == 1?sensor_msgs::image_encodings::MONO8:sensor_msgs::image_encodings::BGR8;
+			img.image = frame.data.imageRaw();
+			frame.imageMsg = img.toImageMsg();
+			frame.imageMsg->header.frame_id = cameraFrameId_;
+			frame.imageMsg->header.stamp = time;
+		}
+		const cv::Mat & depthOrRightRaw = frame.data.depthOrRightRaw();
+		if(depthOrRight && !depthOrRightRaw.empty() &&
+			(depthOrRightRaw.type() == CV_32FC1 || depthOrRightRaw.type() == CV_16UC1 || depthOrRightRaw.type() == CV_8UC1))
+		{
+			cv_bridge::CvImage img;
+			img.encoding = depthOrRightRaw.type() == CV_32FC1?sensor_msgs::image_encodings::TYPE_32FC1:
+						   depthOrRightRaw.type() == CV_16UC1?sensor_msgs::image_encodings::TYPE_16UC1:
+						   sensor_msgs::image_encodings::MONO8;
+			img.image = depthOrRightRaw;
+			frame.depthOrRightMsg = img.toImageMsg();
+			frame.depthOrRightMsg->header.frame_id = cameraFrameId_;
+			frame.depthOrRightMsg->header.stamp = time;
+		}
+	}
+
+	rtabmap::DBReader * reader_;
+	int size_;
+	std::string cameraFrameId_;
+	bool stop_;
+	bool imageWanted_;
+	bool depthOrRightWanted_;
+	std::deque<FramePtr> frames_;
+	std::deque<FramePtr> decodeQueue_;
+	boost::mutex mutex_;
+	boost::condition_variable condition_;
+	boost::thread_group threads_;
+};
+
 int main(int argc, char** argv)
 {
 	ros::init(argc, argv, "data_player");
@@ -150,6 +421,13 @@ int main(int argc, char** argv)
 	bool publishTf = true;
 	int startId = 0;
 	bool useDbStamps = true;
+	int prefetch = 0;
+	int decoders = 2;
+	std::string ackTopic = "";
+	std::string ackType = "info";
+	double ackTimeout = 5.0;
+	bool ackTimeoutAbort = true;
+	bool compressedPassthrough = false;
 
 	pnh.param("frame_id", frameId, frameId);
 	pnh.param("odom_frame_id", odomFrameId, odomFrameId);
@@ -159,6 +437,13 @@ int main(int argc, char** argv)
 	pnh.param("database", databasePath, databasePath);
 	pnh.param("publish_tf", publishTf, publishTf);
 	pnh.param("start_id", startId, startId);
+	pnh.param("prefetch", prefetch, prefetch); // number of frames read ahead in background (0=disabled)
+	pnh.param("decoders", decoders, decoders); // threads decoding prefetched frames
+	pnh.param("ack_topic", ackTopic, ackTopic); // if set, wait for this topic before publishing the next frame (rate is ignored)
+	pnh.param("ack_type", ackType, ackType); // "info" (rtabmap_ros/Info) or "odom" (nav_msgs/Odometry)
+	pnh.param("ack_timeout", ackTimeout, ackTimeout); // seconds, 0=wait forever
+	pnh.param("ack_timeout_abort", ackTimeoutAbort, ackTimeoutAbort); // stop playback on a missing acknowledgement, otherwise publish the next frame
+	pnh.param("compressed_passthrough", compressedPassthrough, compressedPassthrough); // publish "image/compressed" topics from the database bytes
 
 	// A general 360 lidar with 0.5 deg increment
 	double scanAngleMin, scanAngleMax, scanAngleIncrement, scanRangeMin, scanRangeMax;
@@ -175,6 +460,24 @@ int main(int argc, char** argv)
 	ROS_INFO("rate = %f", rate);
 	ROS_INFO("publish_tf = %s", publishTf?"true":"false");
 	ROS_INFO("start_id = %d", startId);
+	ROS_INFO("prefetch = %d", prefetch);
+	if(prefetch > 0)
+	{
+		ROS_INFO("decoders = %d", decoders);
+	}
+	ROS_INFO("compressed_passthrough = %s", compressedPassthrough?"true":"false");
+	ROS_INFO("ack_topic = %s", ackTopic.c_str());
+	if(!ackTopic.empty())
+	{
+		ROS_INFO("ack_type = %s", ackType.c_str());
+		ROS_INFO("ack_timeout = %f", ackTimeout);
+		ROS_INFO("ack_timeout_abort = %s", ackTimeoutAbort?"true":"false");
+		if(ackType.compare("info") != 0 && ackType.compare("odom") != 0)
+		{
+			ROS_ERROR("Parameter \"ack_type\" should be \"info\" or \"odom\" (value=%s).", ackType.c_str());
+			return -1;
+		}
+	}
 	ROS_INFO("Publish clock (--clock): %s", publishClock?"true":"false");
 
 	if(databasePath.empty())
@@ -189,7 +492,10 @@ int main(int argc, char** argv)
 	}
 	ROS_INFO("database = %s", databasePath.c_str());
 
-	rtabmap::DBReader reader(databasePath, -rate, false, false, false, startId);
+	// With prefetching, frames are read as fast as possible and the rate is applied on publishing.
+	// In closed-loop playback, the rate is given by the acknowledgements.
+	bool closedLoop = !ackTopic.empty();
+	rtabmap::DBReader reader(databasePath, prefetch>0||closedLoop?0.0f:-rate, false, false, false, startId);
 	if(!reader.init())
 	{
 		ROS_ERROR("Cannot open database \"%s\".", databasePath.c_str());
@@ -199,6 +505,19 @@ int main(int argc, char** argv)
 	ros::ServiceServer pauseSrv = pnh.advertiseService("pause", pauseCallback);
 	ros::ServiceServer resumeSrv = pnh.advertiseService("resume", resumeCallback);
 
+	ros::Subscriber ackSub;
+	if(closedLoop)
+	{
+		if(ackType.compare("odom") == 0)
+		{
+			ackSub = nh.subscribe(ackTopic, 10, odomAckCallback);
+		}
+		else
+		{
+			ackSub = nh.subscribe(ackTopic, 10, infoAckCallback);
+		}
+	}
+
 	image_transport::ImageTransport it(nh);
 	image_transport::Publisher imagePub;
 	image_transport::Publisher rgbPub;
@@ -209,6 +528,10 @@ int main(int argc, char** argv)
 	ros::Publisher depthCamInfoPub;
 	ros::Publisher leftCamInfoPub;
 	ros::Publisher rightCamInfoPub;
+	ros::Publisher imageCompressedPub;
+	ros::Publisher rgbCompressedPub;
+	ros::Publisher leftCompressedPub;
+	ros::Publisher rightCompressedPub;
 	ros::Publisher odometryPub;
 	ros::Publisher scanPub;
 	ros::Publisher scanCloudPub;
@@ -222,19 +545,59 @@ int main(int argc, char** argv)
 		clockPub = nh.advertise<rosgraph_msgs::Clock>("/clock", 1);
 	}
 
+	boost::shared_ptr<FramePrefetcher> prefetcher;
+	if(prefetch > 0)
+	{
+		prefetcher.reset(new FramePrefetcher(&reader, prefetch, std::max(1, decoders), cameraFrameId));
+	}
+	FramePtr frame;
+
 	UTimer timer;
 	rtabmap::CameraInfo cameraInfo;
-	rtabmap::SensorData data = reader.takeImage(&cameraInfo);
+	rtabmap::SensorData data;
+	if(prefetcher.get())
+	{
+		frame = prefetcher->take();
+		data = frame->data;
+		cameraInfo = frame->cameraInfo;
+	}
+	else
+	{
+		data = reader.takeImage(&cameraInfo);
+	}
 	rtabmap::OdometryInfo odomInfo;
 	odomInfo.reg.covariance = cameraInfo.odomCovariance;
 	rtabmap::OdometryEvent odom(data, cameraInfo.odomPose, odomInfo);
 	double acquisitionTime = timer.ticks();
+	ros::WallTime startWallTime;
+	double startStamp = -1.0;
+	int framesPublished = 0;
+	int framesNotAcknowledged = 0;
+	bool aborted = false;
 	while(ros::ok() && odom.data().id())
 	{
 		ROS_INFO("Reading sensor data %d...", odom.data().id());
 
 		ros::Time time(odom.data().stamp());
 
+		if(prefetcher.get() && !closedLoop && rate > 0.0)
+		{
+			// follow the database stamps
+			if(startStamp < 0.0)
+			{
+				startWallTime = ros::WallTime::now();
+				startStamp = odom.data().stamp();
+			}
+			else
+			{
+				double delay = (odom.data().stamp() - startStamp)/rate - (ros::WallTime::now() - startWallTime).toSec();
+				if(delay > 0.0)
+				{
+					ros::WallDuration(delay).sleep();
+				}
+			}
+		}
+
 		if(publishClock)
 		{
 			rosgraph_msgs::Clock msg;
@@ -285,7 +648,7 @@ int main(int argc, char** argv)
 
 				type=0;
 
-				if(rgbPub.getTopic().empty()) rgbPub = it.advertise("rgb/image", 1);
+				if(rgbPub.getTopic().empty()) rgbPub = advertiseImage(it, nh, "rgb/image", compressedPassthrough, rgbCompressedPub);
 				if(depthPub.getTopic().empty()) depthPub = it.advertise("depth_registered/image", 1);
 				if(rgbCamInfoPub.getTopic().empty()) rgbCamInfoPub = nh.advertise<sensor_msgs::CameraInfo>("rgb/camera_info", 1);
 				if(depthCamInfoPub.getTopic().empty()) depthCamInfoPub = nh.advertise<sensor_msgs::CameraInfo>("depth_registered/camera_info", 1);
@@ -313,15 +676,23 @@ int main(int argc, char** argv)
 
 			type=1;
 
-			if(leftPub.getTopic().empty()) leftPub = it.advertise("left/image", 1);
-			if(rightPub.getTopic().empty()) rightPub = it.advertise("right/image", 1);
+			if(leftPub.getTopic().empty()) leftPub = advertiseImage(it, nh, "left/image", compressedPassthrough, leftCompressedPub);
+			if(rightPub.getTopic().empty()) rightPub = advertiseImage(it, nh, "right/image", compressedPassthrough, rightCompressedPub);
 			if(leftCamInfoPub.getTopic().empty()) leftCamInfoPub = nh.advertise<sensor_msgs::CameraInfo>("left/camera_info", 1);
 			if(rightCamInfoPub.getTopic().empty()) rightCamInfoPub = nh.advertise<sensor_msgs::CameraInfo>("right/camera_info", 1);
 
 		}
 		else
 		{
-			if(imagePub.getTopic().empty()) imagePub = it.advertise("image", 1);
+			if(imagePub.getTopic().empty()) imagePub = advertiseImage(it, nh, "image", compressedPassthrough, imageCompressedPub);
+		}
+
+		if(prefetcher.get())
+		{
+			// skip conversions of the next frames for outputs nobody reads
+			prefetcher->setOutputs(
+					imagePub.getNumSubscribers() || rgbPub.getNumSubscribers() || leftPub.getNumSubscribers(),
+					depthPub.getNumSubscribers() || rightPub.getNumSubscribers());
 		}
 
 		camInfoA.height = odom.data().imageRaw().rows;
@@ -485,19 +856,27 @@ int main(int argc, char** argv)
 
 		if(imagePub.getNumSubscribers() || rgbPub.getNumSubscribers() || leftPub.getNumSubscribers())
 		{
-			cv_bridge::CvImage img;
-			if(odom.data().imageRaw().channels() == 1)
+			sensor_msgs::ImagePtr imageRosMsg;
+			if(frame.get() && frame->imageMsg.get())
 			{
-				img.encoding = sensor_msgs::image_encodings::MONO8;
+				imageRosMsg = frame->imageMsg;
 			}
 			else
 			{
-				img.encoding = sensor_msgs::image_encodings::BGR8;
+				cv_bridge::CvImage img;
+				if(odom.data().imageRaw().channels() == 1)
+				{
+					img.encoding = sensor_msgs::image_encodings::MONO8;
+				}
+				else
+				{
+					img.encoding = sensor_msgs::image_encodings::BGR8;
+				}
+				img.image = odom.data().imageRaw();
+				imageRosMsg = img.toImageMsg();
+				imageRosMsg->header.frame_id = cameraFrameId;
+				imageRosMsg->header.stamp = time;
 			}
-			img.image = odom.data().imageRaw();
-			sensor_msgs::ImagePtr imageRosMsg = img.toImageMsg();
-			imageRosMsg->header.frame_id = cameraFrameId;
-			imageRosMsg->header.stamp = time;
 
 			if(imagePub.getNumSubscribers())
 			{
@@ -514,21 +893,57 @@ int main(int argc, char** argv)
 			}
 		}
 
+		if(compressedPassthrough)
+		{
+			sensor_msgs::CompressedImage compressedMsg;
+			if((imageCompressedPub.getNumSubscribers() ||
+				(rgbCompressedPub.getNumSubscribers() && type == 0) ||
+				(leftCompressedPub.getNumSubscribers() && type == 1)) &&
+				toCompressedImageMsg(odom.data().imageCompressed(), odom.data().imageRaw(), cameraFrameId, time, compressedMsg))
+			{
+				if(imageCompressedPub.getNumSubscribers())
+				{
+					imageCompressedPub.publish(compressedMsg);
+				}
+				if(rgbCompressedPub.getNumSubscribers() && type == 0)
+				{
+					rgbCompressedPub.publish(compressedMsg);
+				}
+				if(leftCompressedPub.getNumSubscribers() && type == 1)
+				{
+					leftCompressedPub.publish(compressedMsg);
+				}
+			}
+			if(rightCompressedPub.getNumSubscribers() && type == 1 &&
+				toCompressedImageMsg(odom.data().depthOrRightCompressed(), odom.data().rightRaw(), cameraFrameId, time, compressedMsg))
+			{
+				rightCompressedPub.publish(compressedMsg);
+			}
+		}
+
 		if(depthPub.getNumSubscribers() && !odom.data().depthRaw().empty() && type==0)
 		{
-			cv_bridge::CvImage img;
-			if(odom.data().depthRaw().type() == CV_32FC1)
+			sensor_msgs::ImagePtr imageRosMsg;
+			if(frame.get() && frame->depthOrRightMsg.get())
 			{
-				img.encoding = sensor_msgs::image_encodings::TYPE_32FC1;
+				imageRosMsg = frame->depthOrRightMsg;
 			}
 			else
 			{
-				img.encoding = sensor_msgs::image_encodings::TYPE_16UC1;
+				cv_bridge::CvImage img;
+				if(odom.data().depthRaw().type() == CV_32FC1)
+				{
+					img.encoding = sensor_msgs::image_encodings::TYPE_32FC1;
+				}
+				else
+				{
+					img.encoding = sensor_msgs::image_encodings::TYPE_16UC1;
+				}
+				img.image = odom.data().depthRaw();
+				imageRosMsg = img.toImageMsg();
+				imageRosMsg->header.frame_id = cameraFrameId;
+				imageRosMsg->header.stamp = time;
 			}
-			img.image = odom.data().depthRaw();
-			sensor_msgs::ImagePtr imageRosMsg = img.toImageMsg();
-			imageRosMsg->header.frame_id = cameraFrameId;
-			imageRosMsg->header.stamp = time;
 
 			depthPub.publish(imageRosMsg);
 			depthCamInfoPub.publish(camInfoB);
@@ -536,12 +951,20 @@ int main(int argc, char** argv)
 
 		if(rightPub.getNumSubscribers() && !odom.data().rightRaw().empty() && type==1)
 		{
-			cv_bridge::CvImage img;
-			img.encoding = sensor_msgs::image_encodings::MONO8;
-			img.image = odom.data().rightRaw();
-			sensor_msgs::ImagePtr imageRosMsg = img.toImageMsg();
-			imageRosMsg->header.frame_id = cameraFrameId;
-			imageRosMsg->header.stamp = time;
+			sensor_msgs::ImagePtr imageRosMsg;
+			if(frame.get() && frame->depthOrRightMsg.get())
+			{
+				imageRosMsg = frame->depthOrRightMsg;
+			}
+			else
+			{
+				cv_bridge::CvImage img;
+				img.encoding = sensor_msgs::image_encodings::MONO8;
+				img.image = odom.data().rightRaw();
+				imageRosMsg = img.toImageMsg();
+				imageRosMsg->header.frame_id = cameraFrameId;
+				imageRosMsg->header.stamp = time;
+			}
 
 			rightPub.publish(imageRosMsg);
 			rightCamInfoPub.publish(camInfoB);
@@ -637,6 +1060,40 @@ int main(int argc, char** argv)
 
 		ros::spinOnce();
 
+		++framesPublished;
+		if(closedLoop)
+		{
+			// wait until the downstream node has processed this frame
+			ros::WallTime waitStart = ros::WallTime::now();
+			while(ros::ok() && lastAck < time)
+			{
+				if(ackTimeout > 0.0 && (ros::WallTime::now() - waitStart).toSec() > ackTimeout)
+				{
+					++framesNotAcknowledged;
+					if(ackTimeoutAbort)
+					{
+						ROS_ERROR("No acknowledgement received on \"%s\" for frame %d (stamp=%f) after %f sec, "
+								"stopping playback (\"ack_timeout_abort\" is true).",
+								ackSub.getTopic().c_str(), odom.data().id(), time.toSec(), ackTimeout);
+						aborted = true;
+					}
+					else
+					{
+						ROS_WARN("No acknowledgement received on \"%s\" for frame %d (stamp=%f) after %f sec, "
+								"publishing next frame (%d frames not acknowledged so far).",
+								ackSub.getTopic().c_str(), odom.data().id(), time.toSec(), ackTimeout, framesNotAcknowledged);
+					}
+					break;
+				}
+				ros::getGlobalCallbackQueue()->callAvailable(ros::WallDuration(0.01));
+			}
+			if(aborted)
+			{
+				break;
+			}
+		}
+
+		bool wasPaused = false;
 		while(ros::ok())
 		{
 #ifndef _WIN32
@@ -657,19 +1114,46 @@ int main(int argc, char** argv)
 			{
 				break;
 			}
+			wasPaused = true;
 
 			uSleep(100);
 			ros::spinOnce();
 		}
+		if(wasPaused)
+		{
+			// restart timing from the next frame
+			startStamp = -1.0;
+		}
 
 		timer.restart();
 		cameraInfo = rtabmap::CameraInfo();
-		data = reader.takeImage(&cameraInfo);
+		if(prefetcher.get())
+		{
+			frame = prefetcher->take();
+			data = frame->data;
+			cameraInfo = frame->cameraInfo;
+		}
+		else
+		{
+			data = reader.takeImage(&cameraInfo);
+		}
 		odomInfo.reg.covariance = cameraInfo.odomCovariance;
 		odom = rtabmap::OdometryEvent(data, cameraInfo.odomPose, odomInfo);
 		acquisitionTime = timer.ticks();
 	}
 
+	if(closedLoop)
+	{
+		if(framesNotAcknowledged)
+		{
+			ROS_WARN("Closed-loop playback: %d/%d frames not acknowledged on \"%s\" within %f sec%s.",
+					framesNotAcknowledged, framesPublished, ackSub.getTopic().c_str(), ackTimeout, aborted?", playback stopped":"");
+		}
+		else
+		{
+			ROS_INFO("Closed-loop playback: %d frames acknowledged on \"%s\".", framesPublished, ackSub.getTopic().c_str());
+		}
+	}
 
-	return 0;
+	return aborted?1:0;
 }
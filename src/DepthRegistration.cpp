@@ -0,0 +1,258 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "rtabmap_ros/DepthRegistration.h"
+#include <rtabmap/utilite/ULogger.h>
+#include <algorithm>
+#include <cstring>
+
+namespace rtabmap_ros {
+
+// z-buffers are merged after projection, don't use more than this
+static const int kMaxStripes = 8;
+
+class DepthProjectBody : public cv::ParallelLoopBody
+{
+public:
+	DepthProjectBody(
+			const cv::Mat & depth,
+			std::vector<cv::Mat> & zBuffers,
+			const float * rays,
+			const rtabmap::CameraModel & rgbModel,
+			const rtabmap::Transform & t) :
+		depth_(depth),
+		zBuffers_(zBuffers),
+		rays_(rays),
+		fx_(rgbModel.fx()),
+		fy_(rgbModel.fy()),
+		cx_(rgbModel.cx()),
+		cy_(rgbModel.cy()),
+		width_(rgbModel.imageWidth()),
+		height_(rgbModel.imageHeight()),
+		tx_(t.x()),
+		ty_(t.y()),
+		tz_(t.z()),
+		rowsPerStripe_((depth.rows + (int)zBuffers.size() - 1)/(int)zBuffers.size())
+	{}
+
+	virtual void operator()(const cv::Range & range) const
+	{
+		for(int s=range.start; s<range.end; ++s)
+		{
+			cv::Mat & zBuffer = zBuffers_[s];
+			zBuffer.setTo(0.0f);
+			int end = std::min(depth_.rows, (s+1)*rowsPerStripe_);
+			for(int v=s*rowsPerStripe_; v<end; ++v)
+			{
+				const float * ray = rays_ + v*depth_.cols*3;
+				if(depth_.type() == CV_16UC1)
+				{
+					const unsigned short * in = depth_.ptr<unsigned short>(v);
+					for(int u=0; u<depth_.cols; ++u, ray+=3)
+					{
+						if(in[u])
+						{
+							project(zBuffer, ray, float(in[u])*0.001f);
+						}
+					}
+				}
+				else
+				{
+					const float * in = depth_.ptr<float>(v);
+					for(int u=0; u<depth_.cols; ++u, ray+=3)
+					{
+						if(in[u] > 0.0f)
+						{
+							project(zBuffer, ray, in[u]);
+						}
+					}
+				}
+			}
+		}
+	}
+
+private:
+	inline void project(cv::Mat & zBuffer, const float * ray, float z) const
+	{
+		float Z = z*ray[2] + tz_;
+		if(Z <= 0.0f)
+		{
+			return;
+		}
+		float invZ = 1.0f/Z;
+		int u = int(fx_*(z*ray[0] + tx_)*invZ + cx_ + 0.5f);
+		int v = int(fy_*(z*ray[1] + ty_)*invZ + cy_ + 0.5f);
+		if(u >= 0 && u < width_ && v >= 0 && v < height_)
+		{
+			float & d = zBuffer.at<float>(v, u);
+			if(d == 0.0f || Z < d)
+			{
+				d = Z;
+			}
+		}
+	}
+
+private:
+	const cv::Mat & depth_;
+	std::vector<cv::Mat> & zBuffers_;
+	const float * rays_;
+	float fx_, fy_, cx_, cy_;
+	int width_, height_;
+	float tx_, ty_, tz_;
+	int rowsPerStripe_;
+};
+
+class DepthMergeBody : public cv::ParallelLoopBody
+{
+public:
+	DepthMergeBody(
+			const std::vector<cv::Mat> & zBuffers,
+			cv::Mat & output,
+			float depthScale) :
+		zBuffers_(zBuffers),
+		output_(output),
+		depthScale_(depthScale)
+	{}
+
+	virtual void operator()(const cv::Range & range) const
+	{
+		for(int v=range.start; v<range.end; ++v)
+		{
+			for(int u=0; u<output_.cols; ++u)
+			{
+				float z = 0.0f;
+				for(size_t s=0; s<zBuffers_.size(); ++s)
+				{
+					float d = zBuffers_[s].ptr<float>(v)[u];
+					if(d > 0.0f && (z == 0.0f || d < z))
+					{
+						z = d;
+					}
+				}
+				z *= depthScale_;
+				if(output_.type() == CV_16UC1)
+				{
+					float d = z*1000.0f + 0.5f;
+					output_.ptr<unsigned short>(v)[u] = d<65535.0f?(unsigned short)d:0;
+				}
+				else
+				{
+					output_.ptr<float>(v)[u] = z;
+				}
+			}
+		}
+	}
+
+private:
+	const std::vector<cv::Mat> & zBuffers_;
+	cv::Mat & output_;
+	float depthScale_;
+};
+
+DepthRegistration::DepthRegistration()
+{
+}
+
+bool DepthRegistration::update(
+		const rtabmap::CameraModel & depthModel,
+		const rtabmap::CameraModel & rgbModel,
+		const rtabmap::Transform & rgbToDepth)
+{
+	if(!depthModel.isValidForProjection() || !rgbModel.isValidForProjection() ||
+	   depthModel.imageWidth() <= 0 || rgbModel.imageWidth() <= 0 ||
+	   rgbToDepth.isNull())
+	{
+		// not valid until the next update with valid models
+		rays_.clear();
+		zBuffers_.clear();
+		return false;
+	}
+	if(isValid() &&
+	   memcmp(rgbToDepth.data(), rgbToDepth_.data(), 12*sizeof(float)) == 0 &&
+	   depthModel.imageSize() == depthModel_.imageSize() &&
+	   depthModel.fx() == depthModel_.fx() && depthModel.fy() == depthModel_.fy() &&
+	   depthModel.cx() == depthModel_.cx() && depthModel.cy() == depthModel_.cy() &&
+	   rgbModel.imageSize() == rgbModel_.imageSize() &&
+	   rgbModel.fx() == rgbModel_.fx() && rgbModel.fy() == rgbModel_.fy() &&
+	   rgbModel.cx() == rgbModel_.cx() && rgbModel.cy() == rgbModel_.cy())
+	{
+		return false;
+	}
+	depthModel_ = depthModel;
+	rgbModel_ = rgbModel;
+	rgbToDepth_ = rgbToDepth.clone();
+
+	int width = depthModel.imageWidth();
+	int height = depthModel.imageHeight();
+	rays_.resize(width*height*3);
+	float * ray = rays_.data();
+	for(int v=0; v<height; ++v)
+	{
+		float y = (float(v) - depthModel.cy())/depthModel.fy();
+		for(int u=0; u<width; ++u, ray+=3)
+		{
+			float x = (float(u) - depthModel.cx())/depthModel.fx();
+			ray[0] = rgbToDepth.r11()*x + rgbToDepth.r12()*y + rgbToDepth.r13();
+			ray[1] = rgbToDepth.r21()*x + rgbToDepth.r22()*y + rgbToDepth.r23();
+			ray[2] = rgbToDepth.r31()*x + rgbToDepth.r32()*y + rgbToDepth.r33();
+		}
+	}
+	zBuffers_.clear();
+	buffers_.clear();
+	UINFO("Depth registration %dx%d -> %dx%d, rgb_T_depth=%s",
+			width, height, rgbModel.imageWidth(), rgbModel.imageHeight(), rgbToDepth.prettyPrint().c_str());
+	return true;
+}
+
+cv::Mat DepthRegistration::registerDepth(const cv::Mat & depth, float depthScale)
+{
+	if(!isValid() ||
+	   (depth.type() != CV_16UC1 && depth.type() != CV_32FC1) ||
+	   depth.size() != depthModel_.imageSize())
+	{
+		return cv::Mat();
+	}
+
+	int stripes = std::max(1, std::min(kMaxStripes, std::min(cv::getNumThreads(), depth.rows)));
+	if((int)zBuffers_.size() != stripes)
+	{
+		zBuffers_.resize(stripes);
+		for(int i=0; i<stripes; ++i)
+		{
+			zBuffers_[i] = cv::Mat(rgbModel_.imageSize(), CV_32FC1);
+		}
+	}
+	cv::parallel_for_(cv::Range(0, stripes),
+			DepthProjectBody(depth, zBuffers_, rays_.data(), rgbModel_, rgbToDepth_));
+
+	cv::Mat output = buffers_.acquire(rgbModel_.imageSize(), depth.type());
+	cv::parallel_for_(cv::Range(0, output.rows), DepthMergeBody(zBuffers_, output, depthScale));
+	return output;
+}
+
+}
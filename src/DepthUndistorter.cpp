@@ -0,0 +1,194 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "rtabmap_ros/DepthUndistorter.h"
+#include <rtabmap/core/clams/discrete_depth_distortion_model.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UConversion.h>
+
+namespace rtabmap_ros {
+
+// CLAMS frustums are not trained farther than this distance
+static const float kMaxDepth = 10.0f;
+
+class DepthUndistortBody : public cv::ParallelLoopBody
+{
+public:
+	DepthUndistortBody(
+			const cv::Mat & depth,
+			cv::Mat & output,
+			const float * table,
+			int binWidth,
+			int binHeight,
+			int binsX,
+			float samplingStep,
+			int samples) :
+		depth_(depth),
+		output_(output),
+		table_(table),
+		binWidth_(binWidth),
+		binHeight_(binHeight),
+		binsX_(binsX),
+		invStep_(1.0f/samplingStep),
+		samples_(samples)
+	{}
+
+	virtual void operator()(const cv::Range & range) const
+	{
+		for(int v=range.start; v<range.end; ++v)
+		{
+			const float * row = table_ + (v/binHeight_)*binsX_*samples_;
+			if(depth_.type() == CV_16UC1)
+			{
+				const unsigned short * in = depth_.ptr<unsigned short>(v);
+				unsigned short * out = output_.ptr<unsigned short>(v);
+				for(int u=0; u<depth_.cols; ++u)
+				{
+					float z = float(in[u])*0.001f;
+					float d = z*multiplier(row + (u/binWidth_)*samples_, z)*1000.0f + 0.5f;
+					out[u] = d<65535.0f?(unsigned short)d:0;
+				}
+			}
+			else
+			{
+				const float * in = depth_.ptr<float>(v);
+				float * out = output_.ptr<float>(v);
+				for(int u=0; u<depth_.cols; ++u)
+				{
+					float z = in[u];
+					out[u] = z>0.0f?z*multiplier(row + (u/binWidth_)*samples_, z):z;
+				}
+			}
+		}
+	}
+
+private:
+	inline float multiplier(const float * samples, float z) const
+	{
+		float s = z*invStep_;
+		int i = int(s);
+		if(i >= samples_-1)
+		{
+			return samples[samples_-1];
+		}
+		float a = s - float(i);
+		return samples[i] + a*(samples[i+1]-samples[i]);
+	}
+
+private:
+	const cv::Mat & depth_;
+	cv::Mat & output_;
+	const float * table_;
+	int binWidth_;
+	int binHeight_;
+	int binsX_;
+	float invStep_;
+	int samples_;
+};
+
+DepthUndistorter::DepthUndistorter() :
+	width_(0),
+	height_(0),
+	binWidth_(1),
+	binHeight_(1),
+	binsX_(0),
+	samplingStep_(0.01f),
+	samples_(0)
+{
+}
+
+bool DepthUndistorter::load(const std::string & path, float samplingStep)
+{
+	UASSERT(samplingStep > 0.0f);
+	table_.clear();
+	buffers_.clear();
+
+	clams::DiscreteDepthDistortionModel model;
+	model.load(path);
+	if(!model.isValid())
+	{
+		return false;
+	}
+
+	width_ = model.getWidth();
+	height_ = model.getHeight();
+	binWidth_ = model.getBinWidth();
+	binHeight_ = model.getBinHeight();
+	binsX_ = width_/binWidth_;
+	int binsY = height_/binHeight_;
+	samplingStep_ = samplingStep;
+	samples_ = int(kMaxDepth/samplingStep)+1;
+
+	// The multipliers of the model are not public, sample them by
+	// undistorting images of constant depth (one pixel per frustum
+	// is enough, all pixels of a frustum share the same multipliers).
+	table_.resize(binsX_*binsY*samples_, 1.0f);
+	cv::Mat image(height_, width_, CV_32FC1);
+	for(int s=1; s<samples_; ++s)
+	{
+		float z = float(s)*samplingStep;
+		image.setTo(cv::Scalar(z));
+		model.undistort(image);
+		for(int by=0; by<binsY; ++by)
+		{
+			for(int bx=0; bx<binsX_; ++bx)
+			{
+				table_[(by*binsX_+bx)*samples_ + s] = image.at<float>(by*binHeight_, bx*binWidth_)/z;
+			}
+		}
+	}
+	// depth 0 is invalid, use the multiplier of the first sample
+	for(size_t f=0; f<table_.size(); f+=samples_)
+	{
+		table_[f] = samples_>1?table_[f+1]:1.0f;
+	}
+	UINFO("Depth distortion model %dx%d loaded (%dx%d frustums, %d samples)",
+			width_, height_, binsX_, binsY, samples_);
+	return true;
+}
+
+void DepthUndistorter::undistort(const cv::Mat & depth, cv::Mat & output) const
+{
+	UASSERT(isValid());
+	UASSERT(depth.type() == CV_16UC1 || depth.type() == CV_32FC1);
+	UASSERT_MSG(depth.cols == width_ && depth.rows == height_,
+			uFormat("Depth image size (%dx%d) and distortion model size (%dx%d) don't match!",
+					depth.cols, depth.rows, width_, height_).c_str());
+	UASSERT(output.size() == depth.size() && output.type() == depth.type());
+	cv::parallel_for_(cv::Range(0, depth.rows),
+			DepthUndistortBody(depth, output, table_.data(), binWidth_, binHeight_, binsX_, samplingStep_, samples_));
+}
+
+cv::Mat DepthUndistorter::undistort(const cv::Mat & depth)
+{
+	cv::Mat output = buffers_.acquire(depth.size(), depth.type());
+	undistort(depth, output);
+	return output;
+}
+
+}
@@ -0,0 +1,325 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "rtabmap_ros/DescriptorIndex.h"
+#include <rtabmap/utilite/ULogger.h>
+#include <algorithm>
+#include <queue>
+#include <cmath>
+
+namespace rtabmap_ros {
+
+DescriptorIndex::DescriptorIndex(int maxLinks, int efConstruction) :
+	maxLinks_(maxLinks),
+	efConstruction_(efConstruction),
+	levelMult_(1.0/log(double(std::max(2, maxLinks)))),
+	dim_(0),
+	entry_(-1),
+	maxLayer_(-1),
+	seed_(1),
+	visitedTag_(0)
+{
+	UASSERT(maxLinks_ >= 2 && efConstruction_ >= 1);
+}
+
+void DescriptorIndex::clear()
+{
+	dim_ = 0;
+	data_.clear();
+	nodes_.clear();
+	idToIndex_.clear();
+	entry_ = -1;
+	maxLayer_ = -1;
+	visited_.clear();
+	visitedTag_ = 0;
+}
+
+cv::Mat DescriptorIndex::toFloat(const cv::Mat & descriptor) const
+{
+	cv::Mat d;
+	if(descriptor.type() == CV_32FC1 && descriptor.isContinuous())
+	{
+		d = descriptor;
+	}
+	else
+	{
+		descriptor.convertTo(d, CV_32F);
+		d = d.reshape(1, 1);
+	}
+	return d;
+}
+
+bool DescriptorIndex::add(int id, const cv::Mat & descriptor)
+{
+	if(descriptor.empty())
+	{
+		return false;
+	}
+	cv::Mat d = toFloat(descriptor);
+	if(dim_ != 0 && (int)d.total() != dim_)
+	{
+		UWARN("Descriptor of node %d has size %d, index has size %d, ignored.", id, (int)d.total(), dim_);
+		return false;
+	}
+
+	// done before setting dim_, as removing may rebuild (and clear) the index
+	remove(id);
+	if(dim_ == 0)
+	{
+		dim_ = (int)d.total();
+	}
+	int index = (int)nodes_.size();
+	data_.insert(data_.end(), d.ptr<float>(), d.ptr<float>()+dim_);
+	Node node;
+	node.id = id;
+	node.deleted = false;
+	// random layer with exponentially decaying probability
+	seed_ = seed_*1103515245u + 12345u;
+	double r = (double((seed_>>8) & 0xFFFFFF) + 1.0) / double(0x1000000);
+	int layer = int(-log(r)*levelMult_);
+	node.links.resize(layer+1);
+	nodes_.push_back(node);
+	idToIndex_.insert(std::make_pair(id, index));
+	insert(index);
+	return true;
+}
+
+void DescriptorIndex::remove(int id)
+{
+	std::map<int, int>::iterator iter = idToIndex_.find(id);
+	if(iter != idToIndex_.end())
+	{
+		nodes_[iter->second].deleted = true;
+		idToIndex_.erase(iter);
+		if(nodes_.size() > 2*idToIndex_.size()+16)
+		{
+			rebuild();
+		}
+	}
+}
+
+cv::Mat DescriptorIndex::descriptor(int id) const
+{
+	std::map<int, int>::const_iterator iter = idToIndex_.find(id);
+	if(iter == idToIndex_.end())
+	{
+		return cv::Mat();
+	}
+	return cv::Mat(1, dim_, CV_32FC1, (void*)&data_[iter->second*dim_]).clone();
+}
+
+float DescriptorIndex::distance(const float * a, int b) const
+{
+	const float * p = &data_[b*dim_];
+	float sum = 0.0f;
+	for(int i=0; i<dim_; ++i)
+	{
+		float d = a[i] - p[i];
+		sum += d*d;
+	}
+	return sum;
+}
+
+std::vector<DescriptorIndex::Candidate> DescriptorIndex::searchLayer(const float * query, int entry, int ef, int layer)
+{
+	if(visited_.size() < nodes_.size())
+	{
+		visited_.resize(nodes_.size(), 0);
+	}
+	if(++visitedTag_ == 0)
+	{
+		std::fill(visited_.begin(), visited_.end(), 0);
+		visitedTag_ = 1;
+	}
+
+	// closest first in candidates, farthest first in results
+	std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate> > candidates;
+	std::priority_queue<Candidate> results;
+	Candidate first(distance(query, entry), entry);
+	candidates.push(first);
+	results.push(first);
+	visited_[entry] = visitedTag_;
+	while(!candidates.empty())
+	{
+		Candidate c = candidates.top();
+		if(c.first > results.top().first && (int)results.size() >= ef)
+		{
+			break;
+		}
+		candidates.pop();
+		const std::vector<int> & links = nodes_[c.second].links[layer];
+		for(size_t i=0; i<links.size(); ++i)
+		{
+			int n = links[i];
+			if(visited_[n] == visitedTag_)
+			{
+				continue;
+			}
+			visited_[n] = visitedTag_;
+			float d = distance(query, n);
+			if((int)results.size() < ef || d < results.top().first)
+			{
+				candidates.push(Candidate(d, n));
+				results.push(Candidate(d, n));
+				if((int)results.size() > ef)
+				{
+					results.pop();
+				}
+			}
+		}
+	}
+	std::vector<Candidate> out(results.size());
+	for(int i=(int)out.size()-1; i>=0; --i)
+	{
+		out[i] = results.top();
+		results.pop();
+	}
+	return out;
+}
+
+std::vector<int> DescriptorIndex::selectNeighbors(const std::vector<Candidate> & candidates, int maxLinks) const
+{
+	// heuristic of the paper: keep a candidate only if it is closer to the
+	// query than to the neighbors already selected (diversity of directions)
+	std::vector<int> selected;
+	for(size_t i=0; i<candidates.size() && (int)selected.size() < maxLinks; ++i)
+	{
+		bool keep = true;
+		const float * c = &data_[candidates[i].second*dim_];
+		for(size_t j=0; j<selected.size() && keep; ++j)
+		{
+			keep = distance(c, selected[j]) >= candidates[i].first;
+		}
+		if(keep)
+		{
+			selected.push_back(candidates[i].second);
+		}
+	}
+	return selected;
+}
+
+void DescriptorIndex::insert(int index)
+{
+	Node & node = nodes_[index];
+	int layer = (int)node.links.size()-1;
+	if(entry_ < 0)
+	{
+		entry_ = index;
+		maxLayer_ = layer;
+		return;
+	}
+
+	const float * query = &data_[index*dim_];
+	int entry = entry_;
+	for(int l=maxLayer_; l>layer; --l)
+	{
+		entry = searchLayer(query, entry, 1, l).front().second;
+	}
+	for(int l=std::min(layer, maxLayer_); l>=0; --l)
+	{
+		std::vector<Candidate> candidates = searchLayer(query, entry, efConstruction_, l);
+		int maxLinks = l==0?maxLinks_*2:maxLinks_;
+		nodes_[index].links[l] = selectNeighbors(candidates, maxLinks);
+		const std::vector<int> & neighbors = nodes_[index].links[l];
+		for(size_t i=0; i<neighbors.size(); ++i)
+		{
+			std::vector<int> & links = nodes_[neighbors[i]].links[l];
+			links.push_back(index);
+			if((int)links.size() > maxLinks)
+			{
+				// shrink the links of the neighbor
+				const float * n = &data_[neighbors[i]*dim_];
+				std::vector<Candidate> linkCandidates(links.size());
+				for(size_t j=0; j<links.size(); ++j)
+				{
+					linkCandidates[j] = Candidate(distance(n, links[j]), links[j]);
+				}
+				std::sort(linkCandidates.begin(), linkCandidates.end());
+				links = selectNeighbors(linkCandidates, maxLinks);
+			}
+		}
+		entry = candidates.front().second;
+	}
+	if(layer > maxLayer_)
+	{
+		entry_ = index;
+		maxLayer_ = layer;
+	}
+}
+
+std::vector<std::pair<int, float> > DescriptorIndex::knnSearch(const cv::Mat & descriptor, int k, int ef)
+{
+	std::vector<std::pair<int, float> > out;
+	if(entry_ < 0 || k <= 0 || descriptor.empty())
+	{
+		return out;
+	}
+	cv::Mat d = toFloat(descriptor);
+	if((int)d.total() != dim_)
+	{
+		UWARN("Query descriptor has size %d, index has size %d.", (int)d.total(), dim_);
+		return out;
+	}
+	const float * query = d.ptr<float>();
+	int entry = entry_;
+	for(int l=maxLayer_; l>0; --l)
+	{
+		entry = searchLayer(query, entry, 1, l).front().second;
+	}
+	// deleted nodes are explored but not returned
+	std::vector<Candidate> candidates = searchLayer(query, entry, std::max(ef, k), 0);
+	for(size_t i=0; i<candidates.size() && (int)out.size()<k; ++i)
+	{
+		if(!nodes_[candidates[i].second].deleted)
+		{
+			out.push_back(std::make_pair(nodes_[candidates[i].second].id, candidates[i].first));
+		}
+	}
+	return out;
+}
+
+void DescriptorIndex::rebuild()
+{
+	std::vector<float> data;
+	std::vector<int> ids;
+	data.reserve(idToIndex_.size()*dim_);
+	for(std::map<int, int>::iterator iter=idToIndex_.begin(); iter!=idToIndex_.end(); ++iter)
+	{
+		data.insert(data.end(), data_.begin()+iter->second*dim_, data_.begin()+(iter->second+1)*dim_);
+		ids.push_back(iter->first);
+	}
+	int dim = dim_;
+	UDEBUG("Rebuilding descriptor index (%d nodes, %d deleted)", (int)ids.size(), (int)(nodes_.size()-ids.size()));
+	clear();
+	for(size_t i=0; i<ids.size(); ++i)
+	{
+		add(ids[i], cv::Mat(1, dim, CV_32FC1, &data[i*dim]));
+	}
+}
+
+}
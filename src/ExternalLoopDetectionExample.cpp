@@ -91,6 +91,7 @@ void mapDataCallback(const rtabmap_ros::MapDataConstPtr & mapDataMsg, const rtab
 	std::map<int, rtabmap::Transform> poses;
 	std::multimap<int, rtabmap::Link> links;
 	std::map<int, rtabmap::Signature> signatures;
+	// copied, the data is kept in localData
 	rtabmap_ros::mapDataFromROS(*mapDataMsg, poses, links, signatures, mapToOdom);
 
 	if(!signatures.empty() &&
@@ -28,6 +28,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap_ros/GuiWrapper.h"
 #include <QApplication>
 #include <QDir>
+#include <QEvent>
+
+#include <algorithm>
 
 #include <std_srvs/Empty.h>
 #include <std_msgs/Empty.h>
@@ -50,6 +53,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "rtabmap_ros/MsgConversion.h"
 #include "rtabmap_ros/GetMap.h"
+#include "rtabmap_ros/GetMap2.h"
+#include "rtabmap_ros/GetNodeData.h"
 #include "rtabmap_ros/SetGoal.h"
 #include "rtabmap_ros/SetLabel.h"
 #include "rtabmap_ros/PreferencesDialogROS.h"
@@ -62,6 +67,26 @@ float max3( const float& a, const float& b, const float& c)
 
 namespace rtabmap_ros {
 
+static const QEvent::Type kOdomHandoffEvent = QEvent::Type(QEvent::registerEventType());
+
+// Receives in the Qt thread the notifications that a new odometry is pending
+class OdometryHandoff : public QObject
+{
+public:
+	OdometryHandoff(GuiWrapper * gui) : gui_(gui) {}
+	virtual bool event(QEvent * e)
+	{
+		if(e->type() == kOdomHandoffEvent)
+		{
+			gui_->processPendingOdometry();
+			return true;
+		}
+		return QObject::event(e);
+	}
+private:
+	GuiWrapper * gui_;
+};
+
 GuiWrapper::GuiWrapper(int & argc, char** argv) :
 		CommonDataSubscriber(true),
 		mainWindow_(0),
@@ -72,7 +97,18 @@ GuiWrapper::GuiWrapper(int & argc, char** argv) :
 		odomSensorSync_(false),
 		maxOdomUpdateRate_(10),
 		cameraNodeName_(""),
-		lastOdomInfoUpdateTime_(0)
+		lastOdomInfoUpdateTime_(0),
+		graphVersion_(0),
+		infoMapThread_(0),
+		infoMapStop_(false),
+		odomLatestOnly_(true),
+		odomHandoff_(0),
+		pendingOdomIgnoreData_(false),
+		pendingOdomPosted_(false),
+		skippedOdom_(0),
+		mapDownloadChunkSize_(50),
+		mapDownloadThread_(0),
+		mapDownloadCancel_(false)
 {
 	ros::NodeHandle nh;
 	ros::NodeHandle pnh("~");
@@ -111,6 +147,8 @@ GuiWrapper::GuiWrapper(int & argc, char** argv) :
 	pnh.param("wait_for_transform_duration",  waitForTransformDuration_, waitForTransformDuration_);
 	pnh.param("odom_sensor_sync", odomSensorSync_, odomSensorSync_);
 	pnh.param("max_odom_update_rate", maxOdomUpdateRate_, maxOdomUpdateRate_);
+	pnh.param("odom_latest_only", odomLatestOnly_, odomLatestOnly_); // skip odometry frames received while the GUI is busy
+	pnh.param("map_download_chunk_size", mapDownloadChunkSize_, mapDownloadChunkSize_); // 0=download the whole map in one request
 	pnh.param("camera_node_name", cameraNodeName_, cameraNodeName_); // used to pause the rtabmap_ros/camera when pausing the process
 	pnh.param("init_cache_path", initCachePath, initCachePath);
 	if(initCachePath.size())
@@ -148,6 +186,9 @@ GuiWrapper::GuiWrapper(int & argc, char** argv) :
 	UEventsManager::addHandler(this);
 	UEventsManager::addHandler(mainWindow_);
 
+	odomHandoff_ = new OdometryHandoff(this);
+	infoMapThread_ = new boost::thread(boost::bind(&GuiWrapper::infoMapThread, this));
+
 	infoTopic_.subscribe(nh, "info", 1);
 	mapDataTopic_.subscribe(nh, "mapData", 1);
 	infoMapSync_ = new message_filters::Synchronizer<MyInfoMapSyncPolicy>(
@@ -164,6 +205,7 @@ GuiWrapper::GuiWrapper(int & argc, char** argv) :
 			pathTopic_);
 	goalPathSync_->registerCallback(boost::bind(&GuiWrapper::goalPathCallback, this, _1, _2));
 	goalReachedTopic_ = nh.subscribe("goal_reached", 1, &GuiWrapper::goalReachedCallback, this);
+	cancelMapDownloadSrv_ = pnh.advertiseService("cancel_map_download", &GuiWrapper::cancelMapDownloadCallback, this);
 
 	setupCallbacks(nh, pnh, ros::this_node::getName()); // do it at the end
 }
@@ -172,13 +214,63 @@ GuiWrapper::~GuiWrapper()
 {
 	UDEBUG("");
 
+	stopMapDownload();
+
+	{
+		boost::mutex::scoped_lock lock(infoMapMutex_);
+		infoMapStop_ = true;
+	}
+	infoMapCondition_.notify_one();
+	infoMapThread_->join();
+	delete infoMapThread_;
+
 	delete infoMapSync_;
+	delete odomHandoff_;
 	delete mainWindow_;
 }
 
 void GuiWrapper::infoMapCallback(
 		const rtabmap_ros::InfoConstPtr & infoMsg,
 		const rtabmap_ros::MapDataConstPtr & mapMsg)
+{
+	// all map updates are kept (graph may be delta-encoded), they are
+	// converted by infoMapThread() to not delay odometry callbacks
+	{
+		boost::mutex::scoped_lock lock(infoMapMutex_);
+		infoMapQueue_.push_back(std::make_pair(infoMsg, mapMsg));
+		if(infoMapQueue_.size() > 10)
+		{
+			ROS_WARN_THROTTLE(5, "rtabmapviz: %d map updates waiting to be processed", (int)infoMapQueue_.size());
+		}
+	}
+	infoMapCondition_.notify_one();
+}
+
+void GuiWrapper::infoMapThread()
+{
+	while(true)
+	{
+		std::pair<rtabmap_ros::InfoConstPtr, rtabmap_ros::MapDataConstPtr> msgs;
+		{
+			boost::mutex::scoped_lock lock(infoMapMutex_);
+			while(!infoMapStop_ && infoMapQueue_.empty())
+			{
+				infoMapCondition_.wait(lock);
+			}
+			if(infoMapStop_)
+			{
+				return;
+			}
+			msgs = infoMapQueue_.front();
+			infoMapQueue_.pop_front();
+		}
+		processInfoMap(msgs.first, msgs.second);
+	}
+}
+
+void GuiWrapper::processInfoMap(
+		const rtabmap_ros::InfoConstPtr & infoMsg,
+		const rtabmap_ros::MapDataConstPtr & mapMsg)
 {
 	//ROS_INFO("rtabmapviz: RTAB-Map info ex received!");
 
@@ -194,19 +286,103 @@ void GuiWrapper::infoMapCallback(
 	std::map<int, Signature> signatures;
 	std::multimap<int, rtabmap::Link> links;
 
-	rtabmap_ros::mapDataFromROS(*mapMsg, poses, links, signatures, mapToOdom);
+	if(mapMsg->graph.version > 0)
+	{
+		// delta-encoded graph
+		if(!rtabmap_ros::mapGraphDeltaFromROS(mapMsg->graph, graphPoses_, graphLinks_, mapToOdom, graphVersion_))
+		{
+			ROS_WARN("rtabmapviz: Missed map version(s) (received %d based on %d, current=%d), requesting the full graph...",
+					(int)mapMsg->graph.version, (int)mapMsg->graph.baseVersion, (int)graphVersion_);
+			rtabmap_ros::GetMap2 getMapSrv;
+			getMapSrv.request.global = false;
+			getMapSrv.request.optimized = true;
+			if(!ros::service::call("get_map_data2", getMapSrv))
+			{
+				ROS_WARN("Can't call \"get_map_data2\" service");
+			}
+			else
+			{
+				rtabmap_ros::mapGraphDeltaFromROS(getMapSrv.response.data.graph, graphPoses_, graphLinks_, mapToOdom, graphVersion_);
+			}
+		}
+		poses = graphPoses_;
+		links = graphLinks_;
+		for(unsigned int i=0; i<mapMsg->nodes.size(); ++i)
+		{
+			// copied, signatures are cached by the GUI for the session
+			signatures.insert(std::make_pair(mapMsg->nodes[i].id, rtabmap_ros::nodeDataFromROS(mapMsg->nodes[i])));
+		}
+	}
+	else
+	{
+		rtabmap_ros::mapDataFromROS(*mapMsg, poses, links, signatures, mapToOdom);
+	}
 
 	stat.setMapCorrection(mapToOdom);
 	stat.setPoses(poses);
 	if(signatures.size())
 	{
-		stat.setLastSignatureData(signatures.rbegin()->second);
+		// decompress here instead of in the Qt thread
+		Signature & s = signatures.rbegin()->second;
+		s.sensorData().uncompressData();
+		stat.setLastSignatureData(s);
 	}
 	stat.setConstraints(links);
 
 	this->post(new RtabmapEvent(stat));
 }
 
+void GuiWrapper::handOffOdometry(const rtabmap::OdometryEvent & odomEvent, bool ignoreData)
+{
+	if(!odomLatestOnly_)
+	{
+		QMetaObject::invokeMethod(mainWindow_, "processOdometry", Q_ARG(rtabmap::OdometryEvent, odomEvent), Q_ARG(bool, ignoreData));
+		return;
+	}
+
+	bool notify = false;
+	{
+		boost::mutex::scoped_lock lock(pendingOdomMutex_);
+		if(pendingOdom_.get())
+		{
+			// the GUI didn't process the previous one yet, replace it
+			++skippedOdom_;
+		}
+		pendingOdom_.reset(new rtabmap::OdometryEvent(odomEvent));
+		pendingOdomIgnoreData_ = ignoreData;
+		if(!pendingOdomPosted_)
+		{
+			pendingOdomPosted_ = true;
+			notify = true;
+		}
+	}
+	if(notify)
+	{
+		QCoreApplication::postEvent(odomHandoff_, new QEvent(kOdomHandoffEvent));
+	}
+}
+
+void GuiWrapper::processPendingOdometry()
+{
+	boost::shared_ptr<rtabmap::OdometryEvent> odom;
+	bool ignoreData;
+	{
+		boost::mutex::scoped_lock lock(pendingOdomMutex_);
+		odom.swap(pendingOdom_);
+		ignoreData = pendingOdomIgnoreData_;
+		pendingOdomPosted_ = false;
+		if(skippedOdom_)
+		{
+			ROS_DEBUG("rtabmapviz: skipped %d odometry updates (GUI busy)", skippedOdom_);
+			skippedOdom_ = 0;
+		}
+	}
+	if(odom.get())
+	{
+		QMetaObject::invokeMethod(mainWindow_, "processOdometry", Qt::DirectConnection, Q_ARG(rtabmap::OdometryEvent, *odom), Q_ARG(bool, ignoreData));
+	}
+}
+
 void GuiWrapper::goalPathCallback(
 		const rtabmap_ros::GoalConstPtr & goalMsg,
 		const nav_msgs::PathConstPtr & pathMsg)
@@ -242,6 +418,107 @@ void GuiWrapper::processRequestedMap(const rtabmap_ros::MapData & map)
 	QMetaObject::invokeMethod(mainWindow_, "processRtabmapEvent3DMap", Q_ARG(rtabmap::RtabmapEvent3DMap, e));
 }
 
+void GuiWrapper::downloadMap(bool global, bool optimized)
+{
+	// Get the graph first...
+	rtabmap_ros::GetMap getMapSrv;
+	getMapSrv.request.global = global;
+	getMapSrv.request.optimized = optimized;
+	getMapSrv.request.graphOnly = true;
+	if(!ros::service::call("get_map_data", getMapSrv))
+	{
+		ROS_WARN("Can't call \"get_map_data\" service");
+		this->post(new RtabmapEvent3DMap(1)); // service error
+		return;
+	}
+
+	std::map<int, Signature> signatures;
+	std::map<int, Transform> poses;
+	std::multimap<int, rtabmap::Link> constraints;
+	Transform mapToOdom;
+	rtabmap_ros::mapDataFromROS(getMapSrv.response.data, poses, constraints, signatures, mapToOdom);
+	QMetaObject::invokeMethod(mainWindow_, "processRtabmapEvent3DMap", Q_ARG(rtabmap::RtabmapEvent3DMap, RtabmapEvent3DMap(signatures, poses, constraints)));
+	if(poses.empty())
+	{
+		return;
+	}
+
+	// ...then the node data in chunks, nearest nodes from the current pose first
+	const Transform & currentPose = poses.rbegin()->second;
+	std::vector<std::pair<float, int> > ids;
+	ids.reserve(poses.size());
+	for(std::map<int, Transform>::iterator iter=poses.begin(); iter!=poses.end(); ++iter)
+	{
+		if(iter->first > 0)
+		{
+			ids.push_back(std::make_pair(currentPose.getDistanceSquared(iter->second), iter->first));
+		}
+	}
+	std::sort(ids.begin(), ids.end());
+
+	ROS_INFO("rtabmapviz: Downloading data of %d nodes by chunks of %d...", (int)ids.size(), mapDownloadChunkSize_);
+	int received = 0;
+	for(size_t i=0; i<ids.size(); i+=mapDownloadChunkSize_)
+	{
+		{
+			boost::mutex::scoped_lock lock(mapDownloadMutex_);
+			if(mapDownloadCancel_)
+			{
+				ROS_WARN("rtabmapviz: Map download cancelled (%d/%d nodes received)", received, (int)ids.size());
+				return;
+			}
+		}
+
+		rtabmap_ros::GetNodeData getNodeDataSrv;
+		for(size_t j=i; j<i+mapDownloadChunkSize_ && j<ids.size(); ++j)
+		{
+			getNodeDataSrv.request.ids.push_back(ids[j].second);
+		}
+		getNodeDataSrv.request.images = true;
+		getNodeDataSrv.request.scan = true;
+		getNodeDataSrv.request.grid = true;
+		getNodeDataSrv.request.user_data = true;
+		if(!ros::service::call("get_node_data", getNodeDataSrv))
+		{
+			// nodes may have been transferred to long-term memory in the meantime
+			ROS_WARN("Can't call \"get_node_data\" service or no data returned for %d nodes", (int)getNodeDataSrv.request.ids.size());
+			continue;
+		}
+
+		signatures.clear();
+		for(size_t j=0; j<getNodeDataSrv.response.data.size(); ++j)
+		{
+			signatures.insert(std::make_pair(getNodeDataSrv.response.data[j].id, rtabmap_ros::nodeDataFromROS(getNodeDataSrv.response.data[j])));
+		}
+		received += signatures.size();
+		QMetaObject::invokeMethod(mainWindow_, "processRtabmapEvent3DMap", Q_ARG(rtabmap::RtabmapEvent3DMap, RtabmapEvent3DMap(signatures, poses, constraints)));
+	}
+	ROS_INFO("rtabmapviz: Map download done (%d/%d nodes received)", received, (int)ids.size());
+}
+
+void GuiWrapper::stopMapDownload()
+{
+	if(mapDownloadThread_)
+	{
+		{
+			boost::mutex::scoped_lock lock(mapDownloadMutex_);
+			mapDownloadCancel_ = true;
+		}
+		mapDownloadThread_->join();
+		delete mapDownloadThread_;
+		mapDownloadThread_ = 0;
+	}
+	boost::mutex::scoped_lock lock(mapDownloadMutex_);
+	mapDownloadCancel_ = false;
+}
+
+bool GuiWrapper::cancelMapDownloadCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
+{
+	boost::mutex::scoped_lock lock(mapDownloadMutex_);
+	mapDownloadCancel_ = true;
+	return true;
+}
+
 bool GuiWrapper::handleEvent(UEvent * anEvent)
 {
 	if(anEvent->getClassName().compare("ParamEvent") == 0)
@@ -340,6 +617,18 @@ bool GuiWrapper::handleEvent(UEvent * anEvent)
 			UASSERT(cmdEvent->value2().isBool());
 			UASSERT(cmdEvent->value3().isBool());
 
+			// cancel the download in progress, if any
+			stopMapDownload();
+
+			if(mapDownloadChunkSize_ > 0 && !cmdEvent->value3().toBool())
+			{
+				// download the map progressively in background
+				mapDownloadThread_ = new boost::thread(boost::bind(&GuiWrapper::downloadMap, this,
+						cmdEvent->value1().toBool(),
+						cmdEvent->value2().toBool()));
+				return false;
+			}
+
 			rtabmap_ros::GetMap getMapSrv;
 			getMapSrv.request.global = cmdEvent->value1().toBool();
 			getMapSrv.request.optimized = cmdEvent->value2().toBool();
@@ -594,7 +883,7 @@ void GuiWrapper::commonDepthCallback(
 		odomMsg.get()?rtabmap_ros::transformFromPoseMsg(odomMsg->pose.pose):odomT,
 		info);
 
-	QMetaObject::invokeMethod(mainWindow_, "processOdometry", Q_ARG(rtabmap::OdometryEvent, odomEvent), Q_ARG(bool, ignoreData));
+	handOffOdometry(odomEvent, ignoreData);
 }
 
 void GuiWrapper::commonStereoCallback(
@@ -774,7 +1063,7 @@ void GuiWrapper::commonStereoCallback(
 		odomMsg.get()?rtabmap_ros::transformFromPoseMsg(odomMsg->pose.pose):odomT,
 		info);
 
-	QMetaObject::invokeMethod(mainWindow_, "processOdometry", Q_ARG(rtabmap::OdometryEvent, odomEvent), Q_ARG(bool, ignoreData));
+	handOffOdometry(odomEvent, ignoreData);
 }
 
 void GuiWrapper::commonLaserScanCallback(
@@ -921,7 +1210,7 @@ void GuiWrapper::commonLaserScanCallback(
 		odomMsg.get()?rtabmap_ros::transformFromPoseMsg(odomMsg->pose.pose):odomT,
 		info);
 
-	QMetaObject::invokeMethod(mainWindow_, "processOdometry", Q_ARG(rtabmap::OdometryEvent, odomEvent), Q_ARG(bool, ignoreData));
+	handOffOdometry(odomEvent, ignoreData);
 }
 
 void GuiWrapper::commonOdomCallback(
@@ -993,7 +1282,7 @@ void GuiWrapper::commonOdomCallback(
 		odomMsg.get()?rtabmap_ros::transformFromPoseMsg(odomMsg->pose.pose):odomT,
 		info);
 
-	QMetaObject::invokeMethod(mainWindow_, "processOdometry", Q_ARG(rtabmap::OdometryEvent, odomEvent), Q_ARG(bool, ignoreData));
+	handOffOdometry(odomEvent, ignoreData);
 }
 
 }
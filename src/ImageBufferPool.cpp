@@ -0,0 +1,172 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "rtabmap_ros/ImageBufferPool.h"
+#include <sensor_msgs/image_encodings.h>
+#include <rtabmap/utilite/ULogger.h>
+
+namespace rtabmap_ros {
+
+static std::string encoding(int type)
+{
+	switch(type)
+	{
+	case CV_8UC1:
+		return sensor_msgs::image_encodings::MONO8;
+	case CV_8UC3:
+		return sensor_msgs::image_encodings::BGR8;
+	case CV_16UC1:
+		return sensor_msgs::image_encodings::TYPE_16UC1;
+	case CV_32FC1:
+		return sensor_msgs::image_encodings::TYPE_32FC1;
+	}
+	UFATAL("Image type %d not supported", type);
+	return "";
+}
+
+static int cvType(const std::string & encoding)
+{
+	if(encoding.compare(sensor_msgs::image_encodings::MONO8) == 0)
+	{
+		return CV_8UC1;
+	}
+	if(encoding.compare(sensor_msgs::image_encodings::BGR8) == 0)
+	{
+		return CV_8UC3;
+	}
+	if(encoding.compare(sensor_msgs::image_encodings::TYPE_16UC1) == 0)
+	{
+		return CV_16UC1;
+	}
+	UASSERT_MSG(encoding.compare(sensor_msgs::image_encodings::TYPE_32FC1) == 0, encoding.c_str());
+	return CV_32FC1;
+}
+
+ImageBufferPool::ImageBufferPool(size_t size) :
+	size_(size),
+	allocations_(0),
+	exhausted_(0)
+{
+}
+
+void ImageBufferPool::setSize(size_t size)
+{
+	size_ = size;
+	if(buffers_.size() > size_)
+	{
+		// buffers still used by subscribers are released by them
+		buffers_.resize(size_);
+	}
+}
+
+sensor_msgs::ImagePtr ImageBufferPool::acquire(int width, int height, int type)
+{
+	UASSERT(width > 0 && height > 0);
+	sensor_msgs::ImagePtr image;
+	for(size_t i=0; i<buffers_.size(); ++i)
+	{
+		// only the pool refers to it
+		if(buffers_[i].unique())
+		{
+			image = buffers_[i];
+			break;
+		}
+	}
+	if(image.get() == 0)
+	{
+		image.reset(new sensor_msgs::Image);
+		if(buffers_.size() < size_)
+		{
+			buffers_.push_back(image);
+			++allocations_;
+		}
+		else
+		{
+			++exhausted_;
+		}
+	}
+
+	image->width = width;
+	image->height = height;
+	image->encoding = encoding(type);
+	image->is_bigendian = 0;
+	image->step = width * CV_ELEM_SIZE(type);
+	// no reallocation if the size doesn't change
+	image->data.resize(image->step * height);
+	return image;
+}
+
+cv::Mat ImageBufferPool::toCvMat(sensor_msgs::Image & image)
+{
+	return cv::Mat(image.height, image.width, cvType(image.encoding), image.data.empty()?0:&image.data[0], image.step);
+}
+
+MatBufferPool::MatBufferPool(size_t size) :
+	size_(size)
+{
+	UASSERT(size_ > 0);
+}
+
+cv::Mat MatBufferPool::acquire(const cv::Size & size, int type)
+{
+	int unusedIndex = -1;
+	for(size_t i=0; i<buffers_.size(); ++i)
+	{
+		// only referenced by the pool?
+#if CV_MAJOR_VERSION > 2
+		bool unused = buffers_[i].u && buffers_[i].u->refcount == 1;
+#else
+		bool unused = buffers_[i].refcount && *buffers_[i].refcount == 1;
+#endif
+		if(unused)
+		{
+			if(buffers_[i].size() == size && buffers_[i].type() == type)
+			{
+				return buffers_[i];
+			}
+			unusedIndex = i;
+		}
+	}
+	cv::Mat buffer(size, type);
+	if(buffers_.size() < size_)
+	{
+		buffers_.push_back(buffer);
+	}
+	else if(unusedIndex >= 0)
+	{
+		buffers_[unusedIndex] = buffer;
+	}
+	else
+	{
+		buffers_.erase(buffers_.begin());
+		buffers_.push_back(buffer);
+	}
+	return buffer;
+}
+
+}
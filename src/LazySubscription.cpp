@@ -0,0 +1,124 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "rtabmap_ros/LazySubscription.h"
+#include <boost/bind.hpp>
+
+namespace rtabmap_ros {
+
+LazySubscription::LazySubscription() :
+	enabled_(false),
+	started_(false),
+	subscribed_(false)
+{
+}
+
+void LazySubscription::init(
+		ros::NodeHandle & pnh,
+		const std::string & name,
+		const boost::function<void()> & subscribe,
+		const boost::function<void()> & unsubscribe)
+{
+	name_ = name;
+	subscribe_ = subscribe;
+	unsubscribe_ = unsubscribe;
+	pnh.param("lazy_subscription", enabled_, enabled_);
+	ROS_INFO("%s: lazy_subscription = %s", name.c_str(), enabled_?"true":"false");
+}
+
+bool LazySubscription::subscribed() const
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	return subscribed_;
+}
+
+ros::SubscriberStatusCallback LazySubscription::connectCallback()
+{
+	return boost::bind(&LazySubscription::connectCallbackImpl, this, _1);
+}
+
+image_transport::SubscriberStatusCallback LazySubscription::imageConnectCallback()
+{
+	return boost::bind(&LazySubscription::imageConnectCallbackImpl, this, _1);
+}
+
+void LazySubscription::addOutput(const ros::Publisher & pub)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	outputs_.push_back(pub);
+}
+
+void LazySubscription::addOutput(const image_transport::Publisher & pub)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	imageOutputs_.push_back(pub);
+}
+
+void LazySubscription::start()
+{
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		started_ = true;
+	}
+	update();
+}
+
+void LazySubscription::update()
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	if(!started_)
+	{
+		// outputs are still being advertised
+		return;
+	}
+
+	bool required = !enabled_;
+	for(size_t i=0; i<outputs_.size() && !required; ++i)
+	{
+		required = outputs_[i].getNumSubscribers() > 0;
+	}
+	for(size_t i=0; i<imageOutputs_.size() && !required; ++i)
+	{
+		required = imageOutputs_[i].getNumSubscribers() > 0;
+	}
+
+	if(required && !subscribed_)
+	{
+		ROS_INFO_COND(enabled_, "%s: outputs subscribed, subscribing to inputs", name_.c_str());
+		subscribe_();
+		subscribed_ = true;
+	}
+	else if(!required && subscribed_)
+	{
+		ROS_INFO("%s: no more output subscribers, unsubscribing from inputs", name_.c_str());
+		unsubscribe_();
+		subscribed_ = false;
+	}
+}
+
+}
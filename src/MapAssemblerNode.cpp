@@ -27,6 +27,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <ros/ros.h>
 #include "rtabmap_ros/MapData.h"
+#include "rtabmap_ros/GetMap2.h"
 #include "rtabmap_ros/MsgConversion.h"
 #include "rtabmap_ros/MapsManager.h"
 #include <rtabmap/core/util3d_transforms.h>
@@ -39,10 +40,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/utilite/UStl.h>
 #include <rtabmap/utilite/UTimer.h>
 #include <rtabmap/utilite/UFile.h>
+#include <rtabmap/utilite/UDirectory.h>
+#include <rtabmap/utilite/UConversion.h>
+#include <ros/serialization.h>
 #include <pcl_ros/transforms.h>
 #include <pcl_conversions/pcl_conversions.h>
 #include <nav_msgs/OccupancyGrid.h>
 #include <std_srvs/Empty.h>
+#include <fstream>
 
 using namespace rtabmap;
 
@@ -51,7 +56,10 @@ class MapAssembler
 
 public:
 	MapAssembler(int & argc, char** argv) :
-		localGridsRegenerated_(false)
+		graphVersion_(0),
+		localGridsRegenerated_(false),
+		nodeCacheMaxMemory_(0.0),
+		residentBytes_(0)
 	{
 		ros::NodeHandle pnh("~");
 		ros::NodeHandle nh;
@@ -59,6 +67,8 @@ public:
 		std::string configPath;
 		pnh.param("config_path", configPath, configPath);
 		pnh.param("regenerate_local_grids", localGridsRegenerated_, localGridsRegenerated_);
+		pnh.param("node_cache_path", nodeCachePath_, nodeCachePath_); // directory where node data is spilled (empty=all in memory)
+		pnh.param("node_cache_max_memory", nodeCacheMaxMemory_, nodeCacheMaxMemory_); // MB of node data kept in memory
 
 		//parameters
 		rtabmap::ParametersMap parameters;
@@ -163,6 +173,20 @@ public:
 		}
 
 		ROS_INFO("%s: regenerate_local_grids          = %s", ros::this_node::getName().c_str(), localGridsRegenerated_?"true":"false");
+		if(!nodeCachePath_.empty())
+		{
+			nodeCachePath_ = uReplaceChar(nodeCachePath_, '~', UDirectory::homeDir());
+			if(!UDirectory::exists(nodeCachePath_) && !UDirectory::makeDir(nodeCachePath_))
+			{
+				ROS_ERROR("%s: Cannot create directory \"%s\", node data will be kept in memory.", ros::this_node::getName().c_str(), nodeCachePath_.c_str());
+				nodeCachePath_.clear();
+			}
+			else
+			{
+				ROS_INFO("%s: node_cache_path                 = %s", ros::this_node::getName().c_str(), nodeCachePath_.c_str());
+				ROS_INFO("%s: node_cache_max_memory           = %f MB", ros::this_node::getName().c_str(), nodeCacheMaxMemory_);
+			}
+		}
 		mapsManager_.init(nh, pnh, ros::this_node::getName(), false);
 		mapsManager_.backwardCompatibilityParameters(pnh, parameters);
 		mapsManager_.setParameters(parameters);
@@ -175,6 +199,7 @@ public:
 
 	~MapAssembler()
 	{
+		clearNodes();
 	}
 
 	void mapDataReceivedCallback(const rtabmap_ros::MapDataConstPtr & msg)
@@ -184,19 +209,92 @@ public:
 		std::map<int, Transform> poses;
 		std::multimap<int, Link> constraints;
 		Transform mapOdom;
-		rtabmap_ros::mapGraphFromROS(msg->graph, poses, constraints, mapOdom);
+		if(msg->graph.version > 0)
+		{
+			// delta-encoded graph
+			if(!rtabmap_ros::mapGraphDeltaFromROS(msg->graph, graphPoses_, graphLinks_, mapOdom, graphVersion_))
+			{
+				ROS_WARN("map_assembler: Missed map version(s) (received %d based on %d, current=%d), requesting the full graph...",
+						(int)msg->graph.version, (int)msg->graph.baseVersion, (int)graphVersion_);
+				rtabmap_ros::GetMap2 getMapSrv;
+				getMapSrv.request.global = false;
+				getMapSrv.request.optimized = true;
+				if(!ros::service::call("get_map_data2", getMapSrv))
+				{
+					ROS_WARN("Can't call \"get_map_data2\" service");
+				}
+				else
+				{
+					rtabmap_ros::mapGraphDeltaFromROS(getMapSrv.response.data.graph, graphPoses_, graphLinks_, mapOdom, graphVersion_);
+				}
+			}
+			poses = graphPoses_;
+			constraints = graphLinks_;
+		}
+		else if(!rtabmap_ros::mapGraphFromROS(msg->graph, poses, constraints, mapOdom))
+		{
+			return;
+		}
 		for(unsigned int i=0; i<msg->nodes.size(); ++i)
 		{
+			int id = msg->nodes[i].id;
+			if(id > 0)
+			{
+				std::pair<double, size_t> version(msg->nodes[i].stamp, nodeContentSize(msg->nodes[i]));
+				std::map<int, std::pair<double, size_t> >::iterator versionIter = nodeVersions_.find(id);
+				if(versionIter != nodeVersions_.end())
+				{
+					if(versionIter->second == version)
+					{
+						// already known
+						continue;
+					}
+					// the node has been updated
+					removeNode(id);
+				}
+				nodeVersions_[id] = version;
+			}
 			if(msg->nodes[i].image.size() ||
 			   msg->nodes[i].depth.size() ||
 			   msg->nodes[i].laserScan.size())
 			{
+				// copied: nodes_ is kept for the session, referencing msg would
+				// keep all the other nodes of the message alive
 				Signature data = rtabmap_ros::nodeDataFromROS(msg->nodes[i]);
 				if(localGridsRegenerated_)
 				{
 					data.sensorData().setOccupancyGrid(cv::Mat(), cv::Mat(), cv::Mat(), 0, cv::Point3f());
 				}
-				uInsert(nodes_, std::make_pair(msg->nodes[i].id, data));
+				uInsert(nodes_, std::make_pair(id, data));
+
+				size_t bytes = 0;
+				if(!nodeCachePath_.empty() && id > 0 && saveNode(msg->nodes[i], bytes))
+				{
+					residentNodeBytes_.insert(std::make_pair(id, bytes));
+					residentBytes_ += bytes;
+				}
+			}
+		}
+
+		if(!spilledNodes_.empty() && mapsManager_.hasSubscribers())
+		{
+			// reload data of the nodes whose local grid is not cached
+			// same nodes than those that will be assembled
+			std::map<int, Transform> requiredPoses = mapsManager_.getFilteredPoses(poses);
+			for(std::map<int, Transform>::const_iterator iter=requiredPoses.lower_bound(1); iter!=requiredPoses.end(); ++iter)
+			{
+				if(spilledNodes_.find(iter->first) != spilledNodes_.end() && !mapsManager_.isGridCached(iter->first))
+				{
+					Signature data;
+					size_t bytes = 0;
+					if(loadNode(iter->first, data, bytes))
+					{
+						uInsert(nodes_, std::make_pair(iter->first, data));
+						residentNodeBytes_.insert(std::make_pair(iter->first, bytes));
+						residentBytes_ += bytes;
+						spilledNodes_.erase(iter->first);
+					}
+				}
 			}
 		}
 
@@ -220,6 +318,11 @@ public:
 
 		mapsManager_.publishMaps(poses, msg->header.stamp, msg->header.frame_id);
 
+		if(!nodeCachePath_.empty())
+		{
+			limitNodeMemory(poses.size()?poses.rbegin()->first:0);
+		}
+
 		ROS_INFO("map_assembler: Publishing data = %fs", timer.ticks());
 	}
 
@@ -227,18 +330,149 @@ public:
 	{
 		ROS_INFO("map_assembler: reset!");
 		mapsManager_.clear();
+		clearNodes();
+		graphPoses_.clear();
+		graphLinks_.clear();
+		graphVersion_ = 0;
 		return true;
 	}
 
 private:
+	static size_t nodeContentSize(const rtabmap_ros::NodeData & node)
+	{
+		return node.image.size() +
+				node.depth.size() +
+				node.laserScan.size() +
+				node.grid_ground.size() +
+				node.grid_obstacles.size() +
+				node.grid_empty_cells.size();
+	}
+
+	void removeNode(int id)
+	{
+		nodes_.erase(id);
+		std::map<int, size_t>::iterator iter = residentNodeBytes_.find(id);
+		if(iter != residentNodeBytes_.end())
+		{
+			residentBytes_ -= iter->second;
+			residentNodeBytes_.erase(iter);
+			UFile::erase(nodeFilePath(id));
+		}
+		else if(spilledNodes_.erase(id))
+		{
+			UFile::erase(nodeFilePath(id));
+		}
+	}
+
+	void clearNodes()
+	{
+		for(std::map<int, size_t>::iterator iter=residentNodeBytes_.begin(); iter!=residentNodeBytes_.end(); ++iter)
+		{
+			UFile::erase(nodeFilePath(iter->first));
+		}
+		for(std::set<int>::iterator iter=spilledNodes_.begin(); iter!=spilledNodes_.end(); ++iter)
+		{
+			UFile::erase(nodeFilePath(*iter));
+		}
+		nodes_.clear();
+		nodeVersions_.clear();
+		residentNodeBytes_.clear();
+		residentBytes_ = 0;
+		spilledNodes_.clear();
+	}
+
+	std::string nodeFilePath(int id) const
+	{
+		return nodeCachePath_ + "/" + uNumber2Str(id) + ".node";
+	}
+
+	bool saveNode(const rtabmap_ros::NodeData & node, size_t & bytes) const
+	{
+		uint32_t size = ros::serialization::serializationLength(node);
+		std::vector<uint8_t> buffer(size);
+		ros::serialization::OStream stream(&buffer[0], size);
+		ros::serialization::serialize(stream, node);
+
+		std::ofstream file(nodeFilePath(node.id).c_str(), std::ios::out | std::ios::binary);
+		if(!file.write((const char*)&buffer[0], size))
+		{
+			ROS_ERROR("map_assembler: Cannot save node %d in \"%s\", it will be kept in memory.", node.id, nodeCachePath_.c_str());
+			return false;
+		}
+		bytes = size;
+		return true;
+	}
+
+	bool loadNode(int id, Signature & data, size_t & bytes) const
+	{
+		std::ifstream file(nodeFilePath(id).c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+		std::streamsize size = file.tellg();
+		if(!file.is_open() || size <= 0)
+		{
+			ROS_ERROR("map_assembler: Cannot load node %d from \"%s\".", id, nodeCachePath_.c_str());
+			return false;
+		}
+		std::vector<uint8_t> buffer(size);
+		file.seekg(0, std::ios::beg);
+		if(!file.read((char*)&buffer[0], size))
+		{
+			ROS_ERROR("map_assembler: Cannot load node %d from \"%s\".", id, nodeCachePath_.c_str());
+			return false;
+		}
+
+		boost::shared_ptr<rtabmap_ros::NodeData> node(new rtabmap_ros::NodeData);
+		ros::serialization::IStream stream(&buffer[0], size);
+		ros::serialization::deserialize(stream, *node);
+		data = rtabmap_ros::nodeDataFromROS(*node, node);
+		if(localGridsRegenerated_)
+		{
+			data.sensorData().setOccupancyGrid(cv::Mat(), cv::Mat(), cv::Mat(), 0, cv::Point3f());
+		}
+		bytes = size;
+		return true;
+	}
+
+	// Drop from memory the data of the oldest nodes (already on disk) over
+	// node_cache_max_memory, except the latest one.
+	void limitNodeMemory(int latestId)
+	{
+		size_t maxBytes = nodeCacheMaxMemory_ * 1024.0 * 1024.0;
+		std::map<int, size_t>::iterator iter = residentNodeBytes_.begin();
+		while(iter != residentNodeBytes_.end() && residentBytes_ > maxBytes)
+		{
+			if(iter->first == latestId)
+			{
+				++iter;
+				continue;
+			}
+			nodes_.erase(iter->first);
+			spilledNodes_.insert(iter->first);
+			residentBytes_ -= iter->second;
+			residentNodeBytes_.erase(iter++);
+		}
+	}
+
 	MapsManager mapsManager_;
 	std::map<int, Signature> nodes_;
+	std::map<int, std::pair<double, size_t> > nodeVersions_; // stamp and content size of received nodes
+
+	// graph received with delta encoding
+	std::map<int, Transform> graphPoses_;
+	std::multimap<int, Link> graphLinks_;
+	unsigned int graphVersion_;
 
 	ros::Subscriber mapDataTopic_;
 
 	ros::ServiceServer resetService_;
 
 	bool localGridsRegenerated_;
+
+	// node data spilled on disk
+	std::string nodeCachePath_;
+	double nodeCacheMaxMemory_;
+	std::map<int, size_t> residentNodeBytes_; // nodes in memory also saved on disk
+	size_t residentBytes_;
+	std::set<int> spilledNodes_;
 };
 
 
@@ -0,0 +1,448 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/**
+ * Offline map export: open a database and regenerate its grid map,
+ * OctoMap and assembled clouds with MapsManager, without ROS master and
+ * without replaying the nodes through ROS messages.
+ */
+
+#include "rtabmap_ros/MapsManager.h"
+#include <rtabmap/core/Rtabmap.h>
+#include <rtabmap/core/Memory.h>
+#include <rtabmap/core/DBDriver.h>
+#include <rtabmap/core/OccupancyGrid.h>
+#include <rtabmap/core/util3d_mapping.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UFile.h>
+#include <rtabmap/utilite/UDirectory.h>
+#include <rtabmap/utilite/UConversion.h>
+#include <rtabmap/utilite/UStl.h>
+#include <rtabmap/utilite/UTimer.h>
+#ifdef WITH_OCTOMAP_MSGS
+#ifdef RTABMAP_OCTOMAP
+#include <rtabmap/core/OctoMap.h>
+#endif
+#endif
+#include <pcl/io/pcd_io.h>
+#include <pcl/io/ply_io.h>
+#include <opencv2/highgui/highgui.hpp>
+#include <boost/thread/thread.hpp>
+#include <fstream>
+#include <stdio.h>
+
+using namespace rtabmap;
+
+void showUsage()
+{
+	printf("\nUsage:\n"
+			"rosrun rtabmap_ros map_export [options] \"map.db\"\n"
+			"  Regenerate the maps of a database on all cores and save them, no\n"
+			"  roscore is needed. RTAB-Map parameters can be set like\n"
+			"  \"--Grid/CellSize 0.1\", parameters not set are those of the database.\n"
+			"Options:\n"
+			"  --output \"dir\"       Output directory (default: current directory).\n"
+			"  --name \"prefix\"      Output files prefix (default: database name).\n"
+			"  --config \"file.ini\"  RTAB-Map parameters to use.\n"
+			"  --no_grid            Don't export the grid map (PGM/YAML).\n"
+			"  --no_octomap         Don't export the OctoMap (.bt/.ot).\n"
+			"  --no_cloud           Don't export the assembled cloud.\n"
+			"  --ply                Save the cloud in PLY instead of PCD.\n"
+			"  --tile_size #        Split grid and cloud in tiles of # meters (0=no tiles, default).\n"
+			"  --regenerate         Regenerate local grids from sensor data instead\n"
+			"                       of using those saved in the database.\n"
+			"  --batch_size #       With --regenerate, nodes loaded at the same time (default 500).\n\n");
+	exit(1);
+}
+
+// map_server format
+bool saveGrid(const std::string & prefix, const cv::Mat & map8S, float xMin, float yMin, float cellSize)
+{
+	std::string name = UFile::getName(prefix);
+	if(!cv::imwrite(prefix + ".pgm", util3d::convertMap2Image8U(map8S, true)))
+	{
+		return false;
+	}
+	std::ofstream file((prefix + ".yaml").c_str());
+	if(!file.is_open())
+	{
+		return false;
+	}
+	file << "image: " << name << ".pgm\n";
+	file << "resolution: " << cellSize << "\n";
+	file << "origin: [" << xMin << ", " << yMin << ", 0.0]\n";
+	file << "negate: 0\n";
+	file << "occupied_thresh: 0.65\n";
+	file << "free_thresh: 0.196\n";
+	return true;
+}
+
+// Tiles of the grid are written in parallel, tiles with only unknown cells are skipped
+class GridTilesBody : public cv::ParallelLoopBody
+{
+public:
+	GridTilesBody(const std::string & prefix, const cv::Mat & map8S, float xMin, float yMin, float cellSize, int tileCells) :
+		prefix_(prefix),
+		map_(map8S),
+		xMin_(xMin),
+		yMin_(yMin),
+		cellSize_(cellSize),
+		tileCells_(tileCells),
+		tilesX_((map8S.cols+tileCells-1)/tileCells)
+	{}
+	virtual void operator()(const cv::Range & range) const
+	{
+		for(int i=range.start; i<range.end; ++i)
+		{
+			int tx = i%tilesX_;
+			int ty = i/tilesX_;
+			cv::Rect roi(tx*tileCells_, ty*tileCells_, tileCells_, tileCells_);
+			roi &= cv::Rect(0, 0, map_.cols, map_.rows);
+			cv::Mat tile = map_(roi);
+			if(cv::countNonZero(tile != -1) == 0)
+			{
+				continue;
+			}
+			std::string path = uFormat("%s_%d_%d", prefix_.c_str(), tx, ty);
+			if(!saveGrid(path, tile, xMin_+roi.x*cellSize_, yMin_+roi.y*cellSize_, cellSize_))
+			{
+				printf("Failed to save \"%s\"!\n", path.c_str());
+			}
+		}
+	}
+private:
+	const std::string & prefix_;
+	const cv::Mat & map_;
+	float xMin_;
+	float yMin_;
+	float cellSize_;
+	int tileCells_;
+	int tilesX_;
+};
+
+void saveCloud(const std::string & path, const pcl::PointCloud<pcl::PointXYZRGB> & cloud, bool ply)
+{
+	int ret = ply?pcl::io::savePLYFileBinary(path, cloud):pcl::io::savePCDFileBinary(path, cloud);
+	if(ret != 0)
+	{
+		printf("Failed to save \"%s\"!\n", path.c_str());
+	}
+}
+
+// Cloud tiles are aligned on the grid tiles: tile (x,y) of the cloud covers
+// the same area than tile (x,y) of the grid, its origin being (xMin,yMin)
+void exportClouds(
+		MapsManager * mapsManager,
+		const std::map<int, Transform> * poses,
+		const std::string & prefix,
+		bool ply,
+		float xMin,
+		float yMin,
+		float tileSize)
+{
+	UTimer timer;
+	pcl::PointCloud<pcl::PointXYZRGB> ground, obstacles;
+	mapsManager->getAssembledClouds(*poses, ground, obstacles);
+	pcl::PointCloud<pcl::PointXYZRGB> cloud = ground;
+	cloud += obstacles;
+	std::string ext = ply?".ply":".pcd";
+	if(tileSize > 0.0f)
+	{
+		std::map<std::pair<int, int>, pcl::PointCloud<pcl::PointXYZRGB> > tiles;
+		for(size_t i=0; i<cloud.size(); ++i)
+		{
+			const pcl::PointXYZRGB & pt = cloud.at(i);
+			tiles[std::make_pair(int(floor((pt.x-xMin)/tileSize)), int(floor((pt.y-yMin)/tileSize)))].push_back(pt);
+		}
+		for(std::map<std::pair<int, int>, pcl::PointCloud<pcl::PointXYZRGB> >::iterator iter=tiles.begin(); iter!=tiles.end(); ++iter)
+		{
+			saveCloud(uFormat("%s_cloud_%d_%d%s", prefix.c_str(), iter->first.first, iter->first.second, ext.c_str()), iter->second, ply);
+		}
+		printf("Cloud: %d points saved in %d tiles (%fs)\n", (int)cloud.size(), (int)tiles.size(), timer.ticks());
+	}
+	else if(!cloud.empty())
+	{
+		saveCloud(prefix + "_cloud" + ext, cloud, ply);
+		printf("Cloud: %d points saved in \"%s_cloud%s\" (%fs)\n", (int)cloud.size(), prefix.c_str(), ext.c_str(), timer.ticks());
+	}
+	else
+	{
+		printf("Cloud: empty, not saved.\n");
+	}
+}
+
+int main(int argc, char * argv[])
+{
+	ULogger::setType(ULogger::kTypeConsole);
+	ULogger::setLevel(ULogger::kWarning);
+
+	if(argc < 2)
+	{
+		showUsage();
+	}
+
+	std::string outputDir = ".";
+	std::string name;
+	std::string configPath;
+	bool exportGrid = true;
+	bool exportOctomap = true;
+	bool exportCloud = true;
+	bool ply = false;
+	float tileSize = 0.0f;
+	bool regenerate = false;
+	int batchSize = 500;
+	for(int i=1; i<argc-1; ++i)
+	{
+		if(strcmp(argv[i], "--output") == 0 && i+1 < argc-1)
+		{
+			outputDir = argv[++i];
+		}
+		else if(strcmp(argv[i], "--name") == 0 && i+1 < argc-1)
+		{
+			name = argv[++i];
+		}
+		else if(strcmp(argv[i], "--config") == 0 && i+1 < argc-1)
+		{
+			configPath = argv[++i];
+		}
+		else if(strcmp(argv[i], "--no_grid") == 0)
+		{
+			exportGrid = false;
+		}
+		else if(strcmp(argv[i], "--no_octomap") == 0)
+		{
+			exportOctomap = false;
+		}
+		else if(strcmp(argv[i], "--no_cloud") == 0)
+		{
+			exportCloud = false;
+		}
+		else if(strcmp(argv[i], "--ply") == 0)
+		{
+			ply = true;
+		}
+		else if(strcmp(argv[i], "--tile_size") == 0 && i+1 < argc-1)
+		{
+			tileSize = uStr2Float(argv[++i]);
+		}
+		else if(strcmp(argv[i], "--regenerate") == 0)
+		{
+			regenerate = true;
+		}
+		else if(strcmp(argv[i], "--batch_size") == 0 && i+1 < argc-1)
+		{
+			batchSize = std::max(1, atoi(argv[++i]));
+		}
+		else if(strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0)
+		{
+			showUsage();
+		}
+	}
+	std::string databasePath = argv[argc-1];
+	if(!UFile::exists(databasePath))
+	{
+		printf("Database \"%s\" doesn't exist!\n", databasePath.c_str());
+		showUsage();
+	}
+	if(name.empty())
+	{
+		name = UFile::getName(databasePath);
+		if(UFile::getExtension(name).compare("db") == 0)
+		{
+			name = name.substr(0, name.size()-3);
+		}
+	}
+	if(!UDirectory::exists(outputDir) && !UDirectory::makeDir(outputDir))
+	{
+		printf("Cannot create output directory \"%s\"!\n", outputDir.c_str());
+		return 1;
+	}
+	std::string prefix = outputDir + "/" + name;
+
+	// Parameters: database, then config file, then arguments
+	ParametersMap parameters;
+	DBDriver * driver = DBDriver::create();
+	if(driver->openConnection(databasePath))
+	{
+		parameters = driver->getLastParameters();
+	}
+	delete driver;
+	if(!configPath.empty())
+	{
+		if(UFile::exists(configPath))
+		{
+			ParametersMap configParameters;
+			Parameters::readINI(configPath.c_str(), configParameters);
+			uInsert(parameters, configParameters);
+		}
+		else
+		{
+			printf("Config file \"%s\" not found!\n", configPath.c_str());
+		}
+	}
+	uInsert(parameters, Parameters::parseArguments(argc, argv));
+	uInsert(parameters, ParametersPair(Parameters::kRtabmapWorkingDirectory(), UDirectory::homeDir()));
+	// read-only
+	uInsert(parameters, ParametersPair(Parameters::kMemIncrementalMemory(), "false"));
+
+	UTimer timer;
+	Rtabmap rtabmap;
+	rtabmap.init(parameters, databasePath);
+
+	std::map<int, Transform> poses;
+	std::multimap<int, Link> links;
+	rtabmap.getGraph(poses, links, true, true);
+	poses.erase(poses.begin(), poses.lower_bound(1)); // no landmarks
+	printf("Loaded graph of %d nodes (%fs)\n", (int)poses.size(), timer.ticks());
+	if(poses.empty())
+	{
+		printf("The map is empty!\n");
+		rtabmap.close(false);
+		return 1;
+	}
+
+	MapsManager mapsManager;
+	mapsManager.setParameters(parameters);
+	mapsManager.setParallelUpdate(true);
+
+	// Local grids are generated/uncompressed in parallel by updateMapCaches()
+	bool updateOctomap = exportOctomap;
+#ifndef WITH_OCTOMAP_MSGS
+	updateOctomap = false;
+#endif
+#ifndef RTABMAP_OCTOMAP
+	updateOctomap = false;
+#endif
+	if(regenerate)
+	{
+		// Load raw data by batches to bound memory
+		std::map<int, Transform> added;
+		for(std::map<int, Transform>::iterator iter=poses.begin(); iter!=poses.end();)
+		{
+			std::map<int, Signature> signatures;
+			for(int i=0; i<batchSize && iter!=poses.end(); ++i, ++iter)
+			{
+				Signature s(rtabmap.getMemory()->getNodeData(iter->first, true, true, false, false));
+				s.setPose(iter->second);
+				signatures.insert(std::make_pair(iter->first, s));
+				added.insert(*iter);
+			}
+			mapsManager.updateMapCaches(added, 0, true, updateOctomap && iter==poses.end(), signatures);
+			printf("Regenerated local grids %d/%d (%fs)\n", (int)added.size(), (int)poses.size(), timer.elapsed());
+		}
+	}
+	else
+	{
+		mapsManager.updateMapCaches(poses, rtabmap.getMemory(), true, updateOctomap);
+	}
+	printf("Map caches updated (%fs)\n", timer.ticks());
+
+	// Raw data is not needed anymore
+	rtabmap.close(false);
+
+	// the grid is assembled first, the cloud tiles are aligned on its tiles
+	float xMin = 0.0f, yMin = 0.0f, cellSize = 0.0f;
+	cv::Mat map;
+	if(exportGrid || (exportCloud && tileSize > 0.0f))
+	{
+		map = mapsManager.getGridMap(xMin, yMin, cellSize);
+	}
+	int tileCells = 0;
+	float cloudTileSize = tileSize;
+	if(!map.empty() && tileSize > 0.0f)
+	{
+		tileCells = std::max(1, int(tileSize/cellSize+0.5f));
+		cloudTileSize = float(tileCells)*cellSize;
+	}
+	else
+	{
+		xMin = yMin = 0.0f;
+	}
+
+	boost::thread * cloudThread = 0;
+	if(exportCloud)
+	{
+		cloudThread = new boost::thread(boost::bind(&exportClouds, &mapsManager, &poses, boost::cref(prefix), ply, xMin, yMin, cloudTileSize));
+	}
+
+	if(exportGrid)
+	{
+		if(map.empty())
+		{
+			printf("Grid: empty, not saved.\n");
+		}
+		else if(tileSize > 0.0f)
+		{
+			int tilesX = (map.cols+tileCells-1)/tileCells;
+			int tilesY = (map.rows+tileCells-1)/tileCells;
+			std::string gridPrefix = prefix + "_grid";
+			cv::parallel_for_(cv::Range(0, tilesX*tilesY), GridTilesBody(gridPrefix, map, xMin, yMin, cellSize, tileCells));
+			printf("Grid: %dx%d cells saved in tiles of %d cells (%fs)\n", map.cols, map.rows, tileCells, timer.ticks());
+		}
+		else if(saveGrid(prefix + "_grid", map, xMin, yMin, cellSize))
+		{
+			printf("Grid: %dx%d cells saved in \"%s_grid.pgm\" (%fs)\n", map.cols, map.rows, prefix.c_str(), timer.ticks());
+		}
+		else
+		{
+			printf("Failed to save \"%s_grid.pgm\"!\n", prefix.c_str());
+		}
+	}
+
+#ifdef WITH_OCTOMAP_MSGS
+#ifdef RTABMAP_OCTOMAP
+	if(updateOctomap)
+	{
+		const OctoMap * octomap = mapsManager.getOctomap();
+		if(octomap && octomap->octree()->size())
+		{
+			bool ok = octomap->octree()->writeBinaryConst(prefix + ".bt");
+			ok = octomap->octree()->write(prefix + ".ot") && ok;
+			printf("OctoMap: %d nodes saved in \"%s.bt\" and \"%s.ot\"%s (%fs)\n",
+					(int)octomap->octree()->size(), prefix.c_str(), prefix.c_str(), ok?"":" (failed!)", timer.ticks());
+		}
+		else
+		{
+			printf("OctoMap: empty, not saved.\n");
+		}
+	}
+#endif
+#endif
+	if(exportOctomap && !updateOctomap)
+	{
+		printf("OctoMap: not exported, rtabmap_ros is built without octomap.\n");
+	}
+
+	if(cloudThread)
+	{
+		cloudThread->join();
+		delete cloudThread;
+	}
+
+	return 0;
+}
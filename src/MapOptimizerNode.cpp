@@ -53,7 +53,12 @@ public:
 		globalOptimization_(true),
 		optimizeFromLastNode_(false),
 		mapToOdom_(rtabmap::Transform::getIdentity()),
-		transformThread_(0)
+		transformThread_(0),
+		incremental_(false),
+		optimizationThread_(0),
+		newLoopClosures_(false),
+		cacheGeneration_(0),
+		stopOptimization_(false)
 	{
 		ros::NodeHandle nh;
 		ros::NodeHandle pnh("~");
@@ -75,7 +80,12 @@ public:
 		pnh.param("robust", robust, robust);
 		pnh.param("slam_2d", slam2d, slam2d);
 		pnh.param("strategy", strategy, strategy);
-
+		pnh.param("incremental", incremental_, incremental_);
+		if(incremental_ && !globalOptimization_)
+		{
+			ROS_WARN("map_optimizer: \"incremental\" requires \"global_optimization\", incremental mode disabled.");
+			incremental_ = false;
+		}
 
 		UASSERT(iterations > 0);
 
@@ -105,10 +115,26 @@ public:
 			ROS_INFO("map_optimizer: tf_delay = %f", tfDelay);
 			transformThread_ = new boost::thread(boost::bind(&MapOptimizer::publishLoop, this, tfDelay));
 		}
+
+		if(incremental_)
+		{
+			ROS_INFO("map_optimizer: incremental = true");
+			optimizationThread_ = new boost::thread(boost::bind(&MapOptimizer::optimizationLoop, this));
+		}
 	}
 
 	~MapOptimizer()
 	{
+		if(optimizationThread_)
+		{
+			{
+				boost::mutex::scoped_lock lock(dataMutex_);
+				stopOptimization_ = true;
+			}
+			dataCondition_.notify_one();
+			optimizationThread_->join();
+			delete optimizationThread_;
+		}
 		if(transformThread_)
 		{
 			transformThread_->join();
@@ -140,14 +166,39 @@ public:
 	{
 		// save new poses and constraints
 		// Assuming that nodes/constraints are all linked together
-		UASSERT(msg->graph.posesId.size() == msg->graph.poses.size());
+		std::vector<int> unpackedPosesId;
+		std::vector<geometry_msgs::Pose> unpackedPoses;
+		std::vector<rtabmap_ros::Link> unpackedLinks;
+		const std::vector<int> * posesId = &msg->graph.posesId;
+		const std::vector<rtabmap_ros::Link> * linksMsg = &msg->graph.links;
+		if(rtabmap_ros::mapGraphIsPacked(msg->graph))
+		{
+			if(!rtabmap_ros::mapGraphUnpack(msg->graph, unpackedPosesId, unpackedPoses, unpackedLinks))
+			{
+				return;
+			}
+			posesId = &unpackedPosesId;
+			linksMsg = &unpackedLinks;
+		}
+		else
+		{
+			UASSERT(msg->graph.posesId.size() == msg->graph.poses.size());
+		}
+
+		// In incremental mode, the cache is shared with the optimization thread
+		boost::mutex::scoped_lock lock(dataMutex_, boost::defer_lock);
+		if(incremental_)
+		{
+			lock.lock();
+		}
 
 		bool dataChanged = false;
+		bool loopClosureAdded = false;
 
 		std::multimap<int, Link> newConstraints;
-		for(unsigned int i=0; i<msg->graph.links.size(); ++i)
+		for(unsigned int i=0; i<linksMsg->size(); ++i)
 		{
-			Link link = rtabmap_ros::linkFromROS(msg->graph.links[i]);
+			Link link = rtabmap_ros::linkFromROS(linksMsg->at(i));
 			newConstraints.insert(std::make_pair(link.from(), link));
 
 			bool edgeAlreadyAdded = false;
@@ -169,6 +220,10 @@ public:
 			if(!edgeAlreadyAdded)
 			{
 				cachedConstraints_.insert(std::make_pair(link.from(), link));
+				if(link.type() != Link::kNeighbor && link.type() != Link::kNeighborMerged)
+				{
+					loopClosureAdded = true;
+				}
 			}
 		}
 
@@ -193,6 +248,18 @@ public:
 			ROS_WARN("Graph data has changed! Reset cache...");
 			cachedConstraints_ = newConstraints;
 			cachedNodeInfos_ = newNodeInfos;
+			lastOptimizedPoses_.clear();
+			++cacheGeneration_;
+		}
+
+		if(incremental_)
+		{
+			// the optimization thread will take the latest data
+			latestMapData_ = msg;
+			newLoopClosures_ = newLoopClosures_ || loopClosureAdded || dataChanged;
+			lock.unlock();
+			dataCondition_.notify_one();
+			return;
 		}
 
 		//match poses in the graph
@@ -206,16 +273,16 @@ public:
 		else
 		{
 			constraints = newConstraints;
-			for(unsigned int i=0; i<msg->graph.posesId.size(); ++i)
+			for(unsigned int i=0; i<posesId->size(); ++i)
 			{
-				std::map<int, Signature>::iterator iter = cachedNodeInfos_.find(msg->graph.posesId[i]);
+				std::map<int, Signature>::iterator iter = cachedNodeInfos_.find(posesId->at(i));
 				if(iter != cachedNodeInfos_.end())
 				{
 					nodeInfos.insert(*iter);
 				}
 				else
 				{
-					ROS_ERROR("Odometry pose of node %d not found in cache!", msg->graph.posesId[i]);
+					ROS_ERROR("Odometry pose of node %d not found in cache!", posesId->at(i));
 					return;
 				}
 			}
@@ -261,55 +328,178 @@ public:
 					  (int)poses.size(), (int)constraints.size());
 			}
 
-			rtabmap_ros::MapData outputDataMsg;
-			rtabmap_ros::MapGraph outputGraphMsg;
-			rtabmap_ros::mapGraphToROS(optimizedPoses,
-					linksOut,
-					mapCorrection,
-					outputGraphMsg);
+			publishOptimizedGraph(*msg, optimizedPoses, linksOut, mapCorrection, posesOut, cachedNodeInfos_);
 
-			if(mapGraphPub_.getNumSubscribers())
-			{
-				outputGraphMsg.header = msg->header;
-				mapGraphPub_.publish(outputGraphMsg);
-			}
+			ROS_INFO("Time graph optimization = %f s", timer.ticks());
+		}
+	}
 
-			if(mapDataPub_.getNumSubscribers())
+	void publishOptimizedGraph(
+			const rtabmap_ros::MapData & msg,
+			const std::map<int, Transform> & optimizedPoses,
+			const std::multimap<int, Link> & linksOut,
+			const Transform & mapCorrection,
+			const std::map<int, Transform> & posesOut,
+			const std::map<int, Signature> & nodeInfos)
+	{
+		rtabmap_ros::MapData outputDataMsg;
+		rtabmap_ros::MapGraph outputGraphMsg;
+		rtabmap_ros::mapGraphToROS(optimizedPoses,
+				linksOut,
+				mapCorrection,
+				outputGraphMsg);
+
+		if(mapGraphPub_.getNumSubscribers())
+		{
+			outputGraphMsg.header = msg.header;
+			mapGraphPub_.publish(outputGraphMsg);
+		}
+
+		if(mapDataPub_.getNumSubscribers())
+		{
+			outputDataMsg.header = msg.header;
+			outputDataMsg.graph = outputGraphMsg;
+			outputDataMsg.nodes = msg.nodes;
+			if(posesOut.size() > msg.nodes.size())
 			{
-				outputDataMsg.header = msg->header;
-				outputDataMsg.graph = outputGraphMsg;
-				outputDataMsg.nodes = msg->nodes;
-				if(posesOut.size() > msg->nodes.size())
+				std::set<int> addedNodes;
+				for(unsigned int i=0; i<msg.nodes.size(); ++i)
 				{
-					std::set<int> addedNodes;
-					for(unsigned int i=0; i<msg->nodes.size(); ++i)
-					{
-						addedNodes.insert(msg->nodes[i].id);
-					}
-					std::list<int> toAdd;
-					for(std::map<int, Transform>::iterator iter=posesOut.begin(); iter!=posesOut.end(); ++iter)
+					addedNodes.insert(msg.nodes[i].id);
+				}
+				std::list<int> toAdd;
+				for(std::map<int, Transform>::iterator iter=posesOut.begin(); iter!=posesOut.end(); ++iter)
+				{
+					if(addedNodes.find(iter->first) == addedNodes.end())
 					{
-						if(addedNodes.find(iter->first) == addedNodes.end())
-						{
-							toAdd.push_back(iter->first);
-						}
+						toAdd.push_back(iter->first);
 					}
-					if(toAdd.size())
+				}
+				if(toAdd.size())
+				{
+					int oi = outputDataMsg.nodes.size();
+					outputDataMsg.nodes.resize(outputDataMsg.nodes.size()+toAdd.size());
+					for(std::list<int>::iterator iter=toAdd.begin(); iter!=toAdd.end(); ++iter)
 					{
-						int oi = outputDataMsg.nodes.size();
-						outputDataMsg.nodes.resize(outputDataMsg.nodes.size()+toAdd.size());
-						for(std::list<int>::iterator iter=toAdd.begin(); iter!=toAdd.end(); ++iter)
-						{
-							UASSERT(cachedNodeInfos_.find(*iter) != cachedNodeInfos_.end());
-							rtabmap_ros::nodeDataToROS(cachedNodeInfos_.at(*iter), outputDataMsg.nodes[oi]);
-							++oi;
-						}
+						UASSERT(nodeInfos.find(*iter) != nodeInfos.end());
+						rtabmap_ros::nodeDataToROS(nodeInfos.at(*iter), outputDataMsg.nodes[oi]);
+						++oi;
 					}
 				}
-				mapDataPub_.publish(outputDataMsg);
 			}
+			mapDataPub_.publish(outputDataMsg);
+		}
+	}
 
-			ROS_INFO("Time graph optimization = %f s", timer.ticks());
+	void optimizationLoop()
+	{
+		while(true)
+		{
+			rtabmap_ros::MapDataConstPtr msg;
+			std::map<int, Transform> poses;
+			std::multimap<int, Link> constraints;
+			std::map<int, Signature> nodeInfos;
+			std::map<int, Transform> guess;
+			bool optimize;
+			int generation;
+			{
+				boost::mutex::scoped_lock lock(dataMutex_);
+				while(!stopOptimization_ && !latestMapData_.get())
+				{
+					dataCondition_.wait(lock);
+				}
+				if(stopOptimization_)
+				{
+					return;
+				}
+				msg = latestMapData_;
+				latestMapData_.reset();
+				optimize = newLoopClosures_;
+				newLoopClosures_ = false;
+
+				constraints = cachedConstraints_;
+				nodeInfos = cachedNodeInfos_;
+				guess = lastOptimizedPoses_;
+				generation = cacheGeneration_;
+
+				if(!mapDataPub_.getNumSubscribers() && !mapGraphPub_.getNumSubscribers() && !transformThread_)
+				{
+					// nobody needs the result, keep the loop closures for later
+					newLoopClosures_ = optimize;
+					continue;
+				}
+			}
+
+			UTimer timer;
+			mapToOdomMutex_.lock();
+			Transform mapCorrection = mapToOdom_;
+			mapToOdomMutex_.unlock();
+
+			// Warm start: previous solution for known nodes, new nodes
+			// follow odometry from the latest correction
+			for(std::map<int, Signature>::iterator iter=nodeInfos.begin(); iter!=nodeInfos.end(); ++iter)
+			{
+				std::map<int, Transform>::iterator jter = guess.find(iter->first);
+				if(jter != guess.end())
+				{
+					poses.insert(*jter);
+				}
+				else
+				{
+					poses.insert(std::make_pair(iter->first, mapCorrection * iter->second.getPose()));
+				}
+			}
+
+			std::map<int, Transform> optimizedPoses;
+			std::map<int, rtabmap::Transform> posesOut;
+			std::multimap<int, rtabmap::Link> linksOut;
+			if(poses.size() > 1 && constraints.size() > 0)
+			{
+				int fromId = optimizeFromLastNode_?poses.rbegin()->first:poses.begin()->first;
+				optimizer_->getConnectedGraph(
+						fromId,
+						poses,
+						constraints,
+						posesOut,
+						linksOut);
+				if(optimize || guess.empty())
+				{
+					optimizedPoses = optimizer_->optimize(fromId, posesOut, linksOut);
+				}
+				else
+				{
+					// no new loop closures, new nodes just follow odometry
+					optimizedPoses = posesOut;
+				}
+				if(!optimizedPoses.empty())
+				{
+					int lastId = posesOut.rbegin()->first;
+					mapCorrection = optimizedPoses.at(lastId) * nodeInfos.at(lastId).getPose().inverse();
+					mapToOdomMutex_.lock();
+					mapToOdom_ = mapCorrection;
+					mapToOdomMutex_.unlock();
+				}
+			}
+			else if(poses.size() == 1 && constraints.size() == 0)
+			{
+				optimizedPoses = poses;
+			}
+
+			{
+				boost::mutex::scoped_lock lock(dataMutex_);
+				// don't keep a solution computed on a cache reset in the meantime
+				if(generation == cacheGeneration_)
+				{
+					lastOptimizedPoses_ = optimizedPoses;
+				}
+			}
+
+			if(mapDataPub_.getNumSubscribers() || mapGraphPub_.getNumSubscribers())
+			{
+				publishOptimizedGraph(*msg, optimizedPoses, linksOut, mapCorrection, posesOut, nodeInfos);
+			}
+
+			ROS_INFO("Time graph %s = %f s", optimize?"optimization":"update", timer.ticks());
 		}
 	}
 
@@ -333,6 +523,16 @@ private:
 
 	tf2_ros::TransformBroadcaster tfBroadcaster_;
 	boost::thread* transformThread_;
+
+	bool incremental_;
+	boost::thread* optimizationThread_;
+	boost::mutex dataMutex_;
+	boost::condition_variable dataCondition_;
+	rtabmap_ros::MapDataConstPtr latestMapData_;
+	std::map<int, Transform> lastOptimizedPoses_;
+	bool newLoopClosures_;
+	int cacheGeneration_;
+	bool stopOptimization_;
 };
 
 
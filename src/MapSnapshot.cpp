@@ -0,0 +1,156 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "rtabmap_ros/MapSnapshot.h"
+#include <rtabmap/core/Rtabmap.h>
+#include <rtabmap/core/Memory.h>
+#include <cstring>
+
+namespace rtabmap_ros {
+
+static bool sameTransform(const rtabmap::Transform & a, const rtabmap::Transform & b)
+{
+	if(a.isNull() || b.isNull())
+	{
+		return a.isNull() == b.isNull();
+	}
+	return memcmp(a.data(), b.data(), 12*sizeof(float)) == 0;
+}
+
+static bool samePoses(const std::map<int, rtabmap::Transform> & a, const std::map<int, rtabmap::Transform> & b)
+{
+	if(a.size() != b.size())
+	{
+		return false;
+	}
+	std::map<int, rtabmap::Transform>::const_iterator iterA = a.begin();
+	std::map<int, rtabmap::Transform>::const_iterator iterB = b.begin();
+	for(; iterA!=a.end(); ++iterA, ++iterB)
+	{
+		if(iterA->first != iterB->first || !sameTransform(iterA->second, iterB->second))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Links can be refined (e.g., by proximity detection) without changing their ids
+static bool sameLinks(const std::multimap<int, rtabmap::Link> & a, const std::multimap<int, rtabmap::Link> & b)
+{
+	if(a.size() != b.size())
+	{
+		return false;
+	}
+	std::multimap<int, rtabmap::Link>::const_iterator iterA = a.begin();
+	std::multimap<int, rtabmap::Link>::const_iterator iterB = b.begin();
+	for(; iterA!=a.end(); ++iterA, ++iterB)
+	{
+		if(iterA->second.from() != iterB->second.from() ||
+		   iterA->second.to() != iterB->second.to() ||
+		   iterA->second.type() != iterB->second.type() ||
+		   !sameTransform(iterA->second.transform(), iterB->second.transform()) ||
+		   iterA->second.infMatrix().size() != iterB->second.infMatrix().size() ||
+		   (!iterA->second.infMatrix().empty() &&
+		    cv::norm(iterA->second.infMatrix(), iterB->second.infMatrix(), cv::NORM_INF) != 0.0))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+MapSnapshot::MapSnapshot() :
+	version_(0),
+	stamp_(0.0),
+	localRadius_(0.0f)
+{
+}
+
+MapSnapshot::ConstPtr MapSnapshot::create(
+		const ConstPtr & previous,
+		const rtabmap::Rtabmap & rtabmap,
+		const rtabmap::Transform & mapToOdom,
+		float indexCellSize,
+		double stamp)
+{
+	boost::shared_ptr<MapSnapshot> snapshot(new MapSnapshot);
+	snapshot->version_ = previous.get()?previous->version_+1:1;
+	snapshot->stamp_ = stamp;
+	snapshot->mapToOdom_ = mapToOdom;
+	snapshot->lastLocalizationPose_ = rtabmap.getLastLocalizationPose();
+	snapshot->localRadius_ = rtabmap.getLocalRadius();
+
+	// Poses: the previous index is kept as is if no node was added, moved
+	// or removed, otherwise a copy is updated incrementally
+	const std::map<int, rtabmap::Transform> & poses = rtabmap.getLocalOptimizedPoses();
+	if(previous.get() && previous->nodesIndex_->cellSize() == indexCellSize)
+	{
+		if(samePoses(previous->nodesIndex_->poses(), poses))
+		{
+			snapshot->nodesIndex_ = previous->nodesIndex_;
+		}
+		else
+		{
+			boost::shared_ptr<NodesSpatialIndex> index(new NodesSpatialIndex(*previous->nodesIndex_));
+			index->update(poses);
+			snapshot->nodesIndex_ = index;
+		}
+	}
+	else
+	{
+		boost::shared_ptr<NodesSpatialIndex> index(new NodesSpatialIndex(indexCellSize));
+		index->update(poses);
+		snapshot->nodesIndex_ = index;
+	}
+
+	const std::multimap<int, rtabmap::Link> & links = rtabmap.getLocalConstraints();
+	if(previous.get() && sameLinks(*previous->links_, links))
+	{
+		snapshot->links_ = previous->links_;
+	}
+	else
+	{
+		snapshot->links_.reset(new std::multimap<int, rtabmap::Link>(links));
+	}
+
+	static const std::map<int, std::string> kNoLabels;
+	const std::map<int, std::string> & labels = rtabmap.getMemory()?rtabmap.getMemory()->getAllLabels():kNoLabels;
+	if(previous.get() && *previous->labels_ == labels)
+	{
+		snapshot->labels_ = previous->labels_;
+	}
+	else
+	{
+		snapshot->labels_.reset(new std::map<int, std::string>(labels));
+	}
+
+	return snapshot;
+}
+
+}
@@ -38,9 +38,20 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/core/Graph.h>
 #include <rtabmap/core/Version.h>
 #include <rtabmap/core/OccupancyGrid.h>
+#include <rtabmap/core/Compression.h>
 
 #include <pcl/search/kdtree.h>
 
+#include <boost/thread.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <nav_msgs/OccupancyGrid.h>
 #include <ros/ros.h>
 
@@ -63,17 +74,42 @@ MapsManager::MapsManager() :
 		mapFilterRadius_(0.0),
 		mapFilterAngle_(30.0), // degrees
 		mapCacheCleanup_(true),
+		mapCacheMaxMemory_(0.0),
 		alwaysUpdateMap_(false),
 		scanEmptyRayTracing_(true),
+		mapParallelUpdate_(false),
 		assembledObstacles_(new pcl::PointCloud<pcl::PointXYZRGB>),
 		assembledGround_(new pcl::PointCloud<pcl::PointXYZRGB>),
+		cloudChunkSize_(0.0),
+		cloudChunkLevels_(3),
+		cloudChunkVersion_(0),
+		cacheAccessCount_(0),
+		cacheHits_(0),
+		cacheCompressedHits_(0),
+		cacheMisses_(0),
+		cacheEvictions_(0),
 		occupancyGrid_(new OccupancyGrid),
 		gridUpdated_(true),
+		gridMapTileSize_(0),
+		gridMapTileMaxRatio_(0.5),
+		gridMapSubscribers_(0),
+		octoMapProjSubscribers_(0),
 		octomap_(new OctoMap),
 		octomapTreeDepth_(16),
 		octomapUpdated_(true),
+		octomapAsync_(false),
+		octomapVersion_(1),
+		octomapThread_(0),
+		octomapThreadRunning_(false),
+		octomapJobPending_(false),
+		octomapJobRunning_(false),
+		octomapJobUpdate_(false),
+		outputsMutex_(0),
 		latching_(true)
 {
+	outputSchedules_[kOutputGrids].priority = 0;
+	outputSchedules_[kOutputClouds].priority = 1;
+	outputSchedules_[kOutputOctomap].priority = 2;
 }
 
 void MapsManager::init(ros::NodeHandle & nh, ros::NodeHandle & pnh, const std::string & name, bool usePublicNamespace)
@@ -82,6 +118,9 @@ void MapsManager::init(ros::NodeHandle & nh, ros::NodeHandle & pnh, const std::s
 	pnh.param("map_filter_radius", mapFilterRadius_, mapFilterRadius_);
 	pnh.param("map_filter_angle", mapFilterAngle_, mapFilterAngle_);
 	pnh.param("map_cleanup", mapCacheCleanup_, mapCacheCleanup_);
+	pnh.param("map_cache_max_memory", mapCacheMaxMemory_, mapCacheMaxMemory_);
+	pnh.param("grid_map_tile_size", gridMapTileSize_, gridMapTileSize_);
+	pnh.param("grid_map_tile_max_ratio", gridMapTileMaxRatio_, gridMapTileMaxRatio_);
 
 	if(pnh.hasParam("map_negative_poses_ignored"))
 	{
@@ -106,6 +145,7 @@ void MapsManager::init(ros::NodeHandle & nh, ros::NodeHandle & pnh, const std::s
 		}
 	}
 	pnh.param("map_empty_ray_tracing", scanEmptyRayTracing_, scanEmptyRayTracing_);
+	pnh.param("map_parallel_update", mapParallelUpdate_, mapParallelUpdate_);
 
 	if(pnh.hasParam("scan_output_voxelized"))
 	{
@@ -119,15 +159,50 @@ void MapsManager::init(ros::NodeHandle & nh, ros::NodeHandle & pnh, const std::s
 	pnh.param("cloud_output_voxelized", cloudOutputVoxelized_, cloudOutputVoxelized_);
 	pnh.param("cloud_subtract_filtering", cloudSubtractFiltering_, cloudSubtractFiltering_);
 	pnh.param("cloud_subtract_filtering_min_neighbors", cloudSubtractFilteringMinNeighbors_, cloudSubtractFilteringMinNeighbors_);
+	pnh.param("cloud_chunk_size", cloudChunkSize_, cloudChunkSize_);
+	pnh.param("cloud_chunk_levels", cloudChunkLevels_, cloudChunkLevels_);
+	if(cloudChunkSize_ > 0.0 && !cloudOutputVoxelized_)
+	{
+		ROS_WARN("cloud_chunk_size is set but cloud_output_voxelized is false, chunks are not published.");
+		cloudChunkSize_ = 0.0;
+	}
+	if(cloudChunkLevels_ < 1)
+	{
+		cloudChunkLevels_ = 1;
+	}
 
 	ROS_INFO("%s(maps): map_filter_radius          = %f", name.c_str(), mapFilterRadius_);
 	ROS_INFO("%s(maps): map_filter_angle           = %f", name.c_str(), mapFilterAngle_);
 	ROS_INFO("%s(maps): map_cleanup                = %s", name.c_str(), mapCacheCleanup_?"true":"false");
+	ROS_INFO("%s(maps): map_cache_max_memory       = %f MB", name.c_str(), mapCacheMaxMemory_);
+	ROS_INFO("%s(maps): grid_map_tile_size         = %d", name.c_str(), gridMapTileSize_);
+	ROS_INFO("%s(maps): grid_map_tile_max_ratio    = %f", name.c_str(), gridMapTileMaxRatio_);
 	ROS_INFO("%s(maps): map_always_update          = %s", name.c_str(), alwaysUpdateMap_?"true":"false");
 	ROS_INFO("%s(maps): map_empty_ray_tracing      = %s", name.c_str(), scanEmptyRayTracing_?"true":"false");
+	ROS_INFO("%s(maps): map_parallel_update        = %s", name.c_str(), mapParallelUpdate_?"true":"false");
 	ROS_INFO("%s(maps): cloud_output_voxelized     = %s", name.c_str(), cloudOutputVoxelized_?"true":"false");
 	ROS_INFO("%s(maps): cloud_subtract_filtering   = %s", name.c_str(), cloudSubtractFiltering_?"true":"false");
 	ROS_INFO("%s(maps): cloud_subtract_filtering_min_neighbors = %d", name.c_str(), cloudSubtractFilteringMinNeighbors_);
+	ROS_INFO("%s(maps): cloud_chunk_size           = %f", name.c_str(), cloudChunkSize_);
+	ROS_INFO("%s(maps): cloud_chunk_levels         = %d", name.c_str(), cloudChunkLevels_);
+
+	const char * outputNames[kOutputCount] = {"grid_map", "cloud_map", "octomap"};
+	for(int i=0; i<kOutputCount; ++i)
+	{
+		pnh.param(uFormat("%s_max_rate", outputNames[i]), outputSchedules_[i].maxRate, outputSchedules_[i].maxRate);
+		pnh.param(uFormat("%s_priority", outputNames[i]), outputSchedules_[i].priority, outputSchedules_[i].priority);
+		ROS_INFO("%s(maps): %s_max_rate/priority = %f Hz / %d", name.c_str(), outputNames[i], outputSchedules_[i].maxRate, outputSchedules_[i].priority);
+	}
+	double maxRate = 0.0;
+	for(int i=0; i<kOutputCount; ++i)
+	{
+		maxRate = std::max(maxRate, outputSchedules_[i].maxRate);
+	}
+	if(maxRate > 0.0)
+	{
+		// skipped outputs are published when due even if no map update comes after
+		outputsFlushTimer_ = nh.createWallTimer(ros::WallDuration(1.0/maxRate), &MapsManager::flushPendingOutputs, this);
+	}
 
 #ifdef WITH_OCTOMAP_MSGS
 #ifdef RTABMAP_OCTOMAP
@@ -143,6 +218,8 @@ void MapsManager::init(ros::NodeHandle & nh, ros::NodeHandle & pnh, const std::s
 		octomapTreeDepth_ = 16;
 	}
 	ROS_INFO("%s(maps): octomap_tree_depth         = %d", name.c_str(), octomapTreeDepth_);
+	pnh.param("octomap_async", octomapAsync_, octomapAsync_);
+	ROS_INFO("%s(maps): octomap_async              = %s", name.c_str(), octomapAsync_?"true":"false");
 #endif
 #endif
 
@@ -164,6 +241,10 @@ void MapsManager::init(ros::NodeHandle & nh, ros::NodeHandle & pnh, const std::s
 	latched_.clear();
 	gridMapPub_ = nht->advertise<nav_msgs::OccupancyGrid>("grid_map", 1, latching_);
 	latched_.insert(std::make_pair((void*)&gridMapPub_, false));
+	if(gridMapTileSize_ > 0)
+	{
+		gridMapUpdatesPub_ = nht->advertise<map_msgs::OccupancyGridUpdate>("grid_map_updates", 10);
+	}
 	gridProbMapPub_ = nht->advertise<nav_msgs::OccupancyGrid>("grid_prob_map", 1, latching_);
 	latched_.insert(std::make_pair((void*)&gridProbMapPub_, false));
 	cloudMapPub_ = nht->advertise<sensor_msgs::PointCloud2>("cloud_map", 1, latching_);
@@ -173,6 +254,17 @@ void MapsManager::init(ros::NodeHandle & nh, ros::NodeHandle & pnh, const std::s
 	cloudGroundPub_ = nht->advertise<sensor_msgs::PointCloud2>("cloud_ground", 1, latching_);
 	latched_.insert(std::make_pair((void*)&cloudGroundPub_, false));
 
+	cloudChunkPubs_.clear();
+	cloudChunkSubscribers_.clear();
+	if(cloudChunkSize_ > 0.0)
+	{
+		for(int i=0; i<cloudChunkLevels_; ++i)
+		{
+			cloudChunkPubs_.push_back(nht->advertise<rtabmap_ros::CloudChunk>(uFormat("cloud_map_chunks_lod%d", i), 100));
+			cloudChunkSubscribers_.push_back(0);
+		}
+	}
+
 	// deprecated
 	projMapPub_ = nht->advertise<nav_msgs::OccupancyGrid>("proj_map", 1, latching_);
 	latched_.insert(std::make_pair((void*)&projMapPub_, false));
@@ -197,11 +289,34 @@ void MapsManager::init(ros::NodeHandle & nh, ros::NodeHandle & pnh, const std::s
 	latched_.insert(std::make_pair((void*)&octoMapEmptySpace_, false));
 	octoMapProj_ = nht->advertise<nav_msgs::OccupancyGrid>("octomap_grid", 1, latching_);
 	latched_.insert(std::make_pair((void*)&octoMapProj_, false));
+	if(gridMapTileSize_ > 0)
+	{
+		octoMapProjUpdatesPub_ = nht->advertise<map_msgs::OccupancyGridUpdate>("octomap_grid_updates", 10);
+	}
+
+	if(octomapAsync_ && octomapThread_ == 0)
+	{
+		octomapThreadRunning_ = true;
+		octomapThread_ = new boost::thread(boost::bind(&MapsManager::octomapLoop, this));
+	}
 #endif
 #endif
 }
 
 MapsManager::~MapsManager() {
+	outputsFlushTimer_.stop();
+	if(octomapThread_)
+	{
+		{
+			boost::mutex::scoped_lock lock(octomapJobMutex_);
+			octomapThreadRunning_ = false;
+		}
+		octomapJobCondition_.notify_all();
+		octomapThread_->join();
+		delete octomapThread_;
+		octomapThread_ = 0;
+	}
+
 	clear();
 
 	delete occupancyGrid_;
@@ -320,12 +435,18 @@ void MapsManager::setParameters(const rtabmap::ParametersMap & parameters)
 
 #ifdef WITH_OCTOMAP_MSGS
 #ifdef RTABMAP_OCTOMAP
+	boost::mutex::scoped_lock lock(octomapMutex_);
 	if(octomap_)
 	{
 		delete octomap_;
 		octomap_ = 0;
 	}
 	octomap_ = new OctoMap(parameters_);
+	++octomapVersion_;
+	{
+		boost::mutex::scoped_lock jobLock(octomapJobMutex_);
+		octomapSentNodes_.clear();
+	}
 #endif
 #endif
 }
@@ -342,46 +463,94 @@ void MapsManager::set2DMap(
 	//update cache in case the map should be updated
 	if(memory)
 	{
+		std::vector<rtabmap::SensorData> uncached;
 		for(std::map<int, rtabmap::Transform>::const_iterator iter=poses.lower_bound(1); iter!=poses.end(); ++iter)
 		{
 			std::map<int, std::pair< std::pair<cv::Mat, cv::Mat>, cv::Mat> >::iterator jter = gridMaps_.find(iter->first);
-			if(!uContains(gridMaps_, iter->first))
+			if(jter != gridMaps_.end())
 			{
-				rtabmap::SensorData data;
-				data = memory->getNodeData(iter->first, false, false, false, true);
-				if(data.gridCellSize() == 0.0f)
-				{
-					ROS_WARN("Local occupancy grid doesn't exist for node %d", iter->first);
-				}
-				else
-				{
-					cv::Mat ground, obstacles, emptyCells;
-					data.uncompressData(
-							0,
-							0,
-							0,
-							0,
-							&ground,
-							&obstacles,
-							&emptyCells);
-
-					uInsert(gridMaps_, std::make_pair(iter->first, std::make_pair(std::make_pair(ground, obstacles), emptyCells)));
-					uInsert(gridMapsViewpoints_, std::make_pair(iter->first, data.gridViewPoint()));
-					occupancyGrid_->addToCache(iter->first, ground, obstacles, emptyCells);
-				}
+				occupancyGrid_->addToCache(iter->first, jter->second.first.first, jter->second.first.second, jter->second.second);
 			}
-			else
+			else if(!uContains(gridMapsCompressed_, iter->first))
 			{
-				occupancyGrid_->addToCache(iter->first, jter->second.first.first, jter->second.first.second, jter->second.second);
+				uncached.push_back(memory->getNodeData(iter->first, false, false, false, true));
 			}
+			// evicted grids are given back to the occupancy grid only if it is regenerated
+		}
+		uncompressLocalGrids(uncached);
+		addToGridCache(uncached);
+	}
+}
+
+static void uncompressLocalGridsRange(std::vector<rtabmap::SensorData> * data, size_t from, size_t to)
+{
+	for(size_t i=from; i<to; ++i)
+	{
+		cv::Mat ground, obstacles, emptyCells;
+		data->at(i).uncompressData(0, 0, 0, 0, &ground, &obstacles, &emptyCells);
+	}
+}
+
+void MapsManager::uncompressLocalGrids(std::vector<rtabmap::SensorData> & data)
+{
+	size_t threads = std::min<size_t>(boost::thread::hardware_concurrency(), data.size()/10);
+	if(threads > 1)
+	{
+		boost::thread_group group;
+		size_t step = data.size() / threads;
+		for(size_t i=0; i<threads; ++i)
+		{
+			size_t from = i*step;
+			size_t to = i==threads-1?data.size():from+step;
+			group.create_thread(boost::bind(&uncompressLocalGridsRange, &data, from, to));
+		}
+		group.join_all();
+	}
+	else
+	{
+		uncompressLocalGridsRange(&data, 0, data.size());
+	}
+}
+
+void MapsManager::addToGridCache(const std::vector<rtabmap::SensorData> & data)
+{
+	for(size_t i=0; i<data.size(); ++i)
+	{
+		int id = data[i].id();
+		if(data[i].gridCellSize() == 0.0f)
+		{
+			ROS_WARN("Local occupancy grid doesn't exist for node %d", id);
+		}
+		else if(!uContains(gridMaps_, id))
+		{
+			const cv::Mat & ground = data[i].gridGroundCellsRaw();
+			const cv::Mat & obstacles = data[i].gridObstacleCellsRaw();
+			const cv::Mat & emptyCells = data[i].gridEmptyCellsRaw();
+			uInsert(gridMaps_, std::make_pair(id, std::make_pair(std::make_pair(ground, obstacles), emptyCells)));
+			uInsert(gridMapsViewpoints_, std::make_pair(id, data[i].gridViewPoint()));
+			gridMapsCompressed_.erase(id);
+			occupancyGrid_->addToCache(id, ground, obstacles, emptyCells);
 		}
 	}
 }
 
+const rtabmap::OctoMap * MapsManager::getOctomap() const
+{
+	UASSERT_MSG(octomapThread_ == 0, "getOctomap() cannot be used with octomap_async, use getOctomapMsg() instead.");
+	return octomap_;
+}
+
 void MapsManager::clear()
 {
+	pendingPoses_.clear();
+	for(int i=0; i<kOutputCount; ++i)
+	{
+		outputSchedules_[i].pending = false;
+	}
 	gridMaps_.clear();
 	gridMapsViewpoints_.clear();
+	gridMapsCompressed_.clear();
+	gridMapsAccess_.clear();
 	assembledGround_->clear();
 	assembledObstacles_->clear();
 	assembledGroundPoses_.clear();
@@ -390,12 +559,16 @@ void MapsManager::clear()
 	assembledObstacleIndex_.release();
 	groundClouds_.clear();
 	obstacleClouds_.clear();
+	groundVoxels_.clear();
+	obstacleVoxels_.clear();
+	// removed chunks are republished empty on next update
+	updateCloudChunkVersions(cloudChunksUnpublished_);
 	occupancyGrid_->clear();
-#ifdef WITH_OCTOMAP_MSGS
-#ifdef RTABMAP_OCTOMAP
-	octomap_->clear();
-#endif
-#endif
+	gridMapPublished_ = nav_msgs::OccupancyGrid();
+	gridMapPublishedPoses_.clear();
+	octoMapProjPublished_ = nav_msgs::OccupancyGrid();
+	octoMapProjPublishedPoses_.clear();
+	clearOctomap();
 	for(std::map<void*, bool>::iterator iter=latched_.begin(); iter!=latched_.end(); ++iter)
 	{
 		iter->second = false;
@@ -418,18 +591,133 @@ bool MapsManager::hasSubscribers() const
 			octoMapObstacleCloud_.getNumSubscribers() != 0 ||
 			octoMapGroundCloud_.getNumSubscribers() != 0 ||
 			octoMapEmptySpace_.getNumSubscribers() != 0 ||
-			octoMapProj_.getNumSubscribers() != 0;
+			octoMapProj_.getNumSubscribers() != 0 ||
+			hasCloudChunkSubscribers();
+}
+
+bool MapsManager::hasUnlatchedSubscribers() const
+{
+	for(std::map<void*, bool>::const_iterator iter=latched_.begin(); iter!=latched_.end(); ++iter)
+	{
+		if(!iter->second && ((ros::Publisher*)iter->first)->getNumSubscribers())
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool MapsManager::isGridCached(int id) const
+{
+	return uContains(gridMaps_, id) || uContains(gridMapsCompressed_, id);
+}
+
+bool MapsManager::hasCloudChunkSubscribers() const
+{
+	for(size_t i=0; i<cloudChunkPubs_.size(); ++i)
+	{
+		if(cloudChunkPubs_[i].getNumSubscribers())
+		{
+			return true;
+		}
+	}
+	return false;
 }
 
-std::map<int, Transform> MapsManager::getFilteredPoses(const std::map<int, Transform> & poses)
+std::map<int, Transform> MapsManager::getFilteredPoses(const std::map<int, Transform> & poses) const
 {
+	// process only nodes (exclude landmarks)
+	std::map<int, Transform> nodes(poses.lower_bound(0), poses.end());
 	if(mapFilterRadius_ > 0.0)
 	{
 		// filter nodes
 		double angle = mapFilterAngle_ == 0.0?CV_PI+0.1:mapFilterAngle_*CV_PI/180.0;
-		return rtabmap::graph::radiusPosesFiltering(poses, mapFilterRadius_, angle);
+		std::map<int, Transform> filteredPoses = rtabmap::graph::radiusPosesFiltering(nodes, mapFilterRadius_, angle);
+		if(nodes.find(0) != nodes.end())
+		{
+			// make sure to keep latest data
+			filteredPoses.insert(*nodes.find(0));
+		}
+		return filteredPoses;
+	}
+	return nodes;
+}
+
+// Local grid of a node to be uncompressed or generated
+struct LocalGridJob
+{
+	LocalGridJob(int id, const Transform & pose, const SensorData & data) :
+		id(id), pose(pose), data(data) {}
+	int id;
+	Transform pose;
+	SensorData data;
+	cv::Mat ground;
+	cv::Mat obstacles;
+	cv::Mat emptyCells;
+	cv::Point3f viewPoint;
+};
+
+static void createLocalGridsRange(OccupancyGrid * occupancyGrid, std::vector<LocalGridJob> * jobs, size_t offset, size_t step)
+{
+	// interleaved: generation time varies a lot between nodes
+	for(size_t i=offset; i<jobs->size(); i+=step)
+	{
+		LocalGridJob & job = jobs->at(i);
+		cv::Mat rgb, depth;
+		LaserScan scan;
+		bool generateGrid = job.data.gridCellSize() == 0.0f;
+		job.data.uncompressData(
+				occupancyGrid->isGridFromDepth() && generateGrid?&rgb:0,
+				occupancyGrid->isGridFromDepth() && generateGrid?&depth:0,
+				!occupancyGrid->isGridFromDepth() && generateGrid?&scan:0,
+				0,
+				generateGrid?0:&job.ground,
+				generateGrid?0:&job.obstacles,
+				generateGrid?0:&job.emptyCells);
+
+		if(generateGrid)
+		{
+			Signature tmp(job.data);
+			tmp.setPose(job.pose);
+			occupancyGrid->createLocalMap(tmp, job.ground, job.obstacles, job.emptyCells, job.viewPoint);
+		}
+		else
+		{
+			job.viewPoint = job.data.gridViewPoint();
+		}
+		job.data = SensorData(); // free raw data
 	}
-	return std::map<int, Transform>();
+}
+
+// Uncompress/generate local grids in parallel (createLocalMap() only reads
+// the grid parameters), then merge the results in the caches.
+static void createLocalGrids(
+		OccupancyGrid * occupancyGrid,
+		std::vector<LocalGridJob> & jobs,
+		std::map<int, std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> > & gridMaps,
+		std::map<int, cv::Point3f> & gridMapsViewpoints)
+{
+	size_t threads = std::min<size_t>(boost::thread::hardware_concurrency(), jobs.size());
+	if(threads > 1)
+	{
+		boost::thread_group group;
+		for(size_t i=0; i<threads; ++i)
+		{
+			group.create_thread(boost::bind(&createLocalGridsRange, occupancyGrid, &jobs, i, threads));
+		}
+		group.join_all();
+	}
+	else
+	{
+		createLocalGridsRange(occupancyGrid, &jobs, 0, 1);
+	}
+
+	for(size_t i=0; i<jobs.size(); ++i)
+	{
+		uInsert(gridMaps, std::make_pair(jobs[i].id, std::make_pair(std::make_pair(jobs[i].ground, jobs[i].obstacles), jobs[i].emptyCells)));
+		uInsert(gridMapsViewpoints, std::make_pair(jobs[i].id, jobs[i].viewPoint));
+	}
+	jobs.clear();
 }
 
 std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
@@ -461,7 +749,8 @@ std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
 				cloudMapPub_.getNumSubscribers() != 0 ||
 				cloudObstaclesPub_.getNumSubscribers() != 0 ||
 				cloudGroundPub_.getNumSubscribers() != 0 ||
-				scanMapPub_.getNumSubscribers() != 0;
+				scanMapPub_.getNumSubscribers() != 0 ||
+				hasCloudChunkSubscribers();
 	}
 
 #ifndef WITH_OCTOMAP_MSGS
@@ -477,7 +766,7 @@ std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
 
 	UDEBUG("Updating map caches...");
 
-	if(!memory && signatures.size() == 0)
+	if(!memory && signatures.size() == 0 && gridMaps_.empty())
 	{
 		ROS_ERROR("Memory and signatures should not be both null!?");
 		return std::map<int, rtabmap::Transform>();
@@ -498,22 +787,7 @@ std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
 	// update cache
 	if(updateGridCache)
 	{
-		// filter nodes
-		if(mapFilterRadius_ > 0.0)
-		{
-			UDEBUG("Filter nodes...");
-			double angle = mapFilterAngle_ == 0.0?CV_PI+0.1:mapFilterAngle_*CV_PI/180.0;
-			filteredPoses = rtabmap::graph::radiusPosesFiltering(poses, mapFilterRadius_, angle);
-			if(poses.find(0) != poses.end())
-			{
-				// make sure to keep latest data
-				filteredPoses.insert(*poses.find(0));
-			}
-		}
-		else
-		{
-			filteredPoses = poses;
-		}
+		filteredPoses = getFilteredPoses(poses);
 
 		if(!alwaysUpdateMap_)
 		{
@@ -531,9 +805,10 @@ std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
 			}
 #ifdef WITH_OCTOMAP_MSGS
 #ifdef RTABMAP_OCTOMAP
-			if(updateOctomap && octomap_->addedNodes().size() < 5)
+			size_t octomapNodes = octomapAsync_?octomapSentNodes_.size():octomap_->addedNodes().size();
+			if(updateOctomap && octomapNodes < 5)
 			{
-				ROS_WARN("Many clouds should be added to octomap (~%d), this may take a while to update the map(s)...", int(filteredPoses.size()-octomap_->addedNodes().size()));
+				ROS_WARN("Many clouds should be added to octomap (~%d), this may take a while to update the map(s)...", int(filteredPoses.size()-octomapNodes));
 				longUpdate = true;
 			}
 #endif
@@ -542,14 +817,29 @@ std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
 
 		bool occupancySavedInDB = memory && uStrNumCmp(memory->getDatabaseVersion(), "0.11.10")>=0?true:false;
 
+		// Local grids of new nodes are uncompressed/generated in parallel by
+		// batches (to limit memory usage of raw data kept in the jobs)
+		std::vector<LocalGridJob> jobs;
+		size_t jobsBatchSize = 20*std::max(1u, boost::thread::hardware_concurrency());
 		for(std::map<int, rtabmap::Transform>::iterator iter=filteredPoses.begin(); iter!=filteredPoses.end(); ++iter)
 		{
 			if(!iter->second.isNull())
 			{
 				rtabmap::SensorData data;
-				if(updateGridCache && (iter->first == 0 || !uContains(gridMaps_, iter->first)))
+				// evicted grids are not restored, they are uncompressed only when used
+				bool cached = iter->first > 0 && isGridCached(iter->first);
+				if(updateGridCache && cached)
+				{
+					gridMapsAccess_[iter->first] = ++cacheAccessCount_;
+					++(uContains(gridMaps_, iter->first)?cacheHits_:cacheCompressedHits_);
+				}
+				if(updateGridCache && (iter->first == 0 || !cached))
 				{
 					ROS_DEBUG("Data required for %d", iter->first);
+					if(iter->first > 0)
+					{
+						++cacheMisses_;
+					}
 					std::map<int, rtabmap::Signature>::const_iterator findIter = signatures.find(iter->first);
 					if(findIter != signatures.end())
 					{
@@ -559,14 +849,18 @@ std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
 					{
 						data = memory->getNodeData(iter->first, occupancyGrid_->isGridFromDepth() && !occupancySavedInDB, !occupancyGrid_->isGridFromDepth() && !occupancySavedInDB, false, true);
 					}
+					else
+					{
+						// data not provided, don't cache an empty grid for this node
+						ROS_DEBUG("Data of node %d not provided, skipping it", iter->first);
+						continue;
+					}
 
 					ROS_DEBUG("Adding grid map %d to cache...", iter->first);
 					cv::Point3f viewPoint;
 					cv::Mat ground, obstacles, emptyCells;
 					if(iter->first > 0)
 					{
-						cv::Mat rgb, depth;
-						LaserScan scan;
 						bool generateGrid = data.gridCellSize() == 0.0f;
 						static bool warningShown = false;
 						if(occupancySavedInDB && generateGrid && !warningShown)
@@ -588,28 +882,10 @@ std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
 							// try reload again
 							data = memory->getNodeData(iter->first, occupancyGrid_->isGridFromDepth(), !occupancyGrid_->isGridFromDepth(), false, false);
 						}
-						data.uncompressData(
-								occupancyGrid_->isGridFromDepth() && generateGrid?&rgb:0,
-								occupancyGrid_->isGridFromDepth() && generateGrid?&depth:0,
-								!occupancyGrid_->isGridFromDepth() && generateGrid?&scan:0,
-								0,
-								generateGrid?0:&ground,
-								generateGrid?0:&obstacles,
-								generateGrid?0:&emptyCells);
-
-						if(generateGrid)
-						{
-							Signature tmp(data);
-							tmp.setPose(iter->second);
-							occupancyGrid_->createLocalMap(tmp, ground, obstacles, emptyCells, viewPoint);
-							uInsert(gridMaps_, std::make_pair(iter->first, std::make_pair(std::make_pair(ground, obstacles), emptyCells)));
-							uInsert(gridMapsViewpoints_, std::make_pair(iter->first, viewPoint));
-						}
-						else
+						jobs.push_back(LocalGridJob(iter->first, iter->second, data));
+						if(jobs.size() >= jobsBatchSize)
 						{
-							viewPoint = data.gridViewPoint();
-							uInsert(gridMaps_, std::make_pair(iter->first, std::make_pair(std::make_pair(ground, obstacles), emptyCells)));
-							uInsert(gridMapsViewpoints_, std::make_pair(iter->first, viewPoint));
+							createLocalGrids(occupancyGrid_, jobs, gridMaps_, gridMapsViewpoints_);
 						}
 					}
 					else
@@ -662,7 +938,33 @@ std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
 						}
 					}
 				}
+			}
+			else
+			{
+				ROS_ERROR("Pose null for node %d", iter->first);
+			}
+		}
+		if(!jobs.empty())
+		{
+			createLocalGrids(occupancyGrid_, jobs, gridMaps_, gridMapsViewpoints_);
+		}
 
+		// Evicted grids given back to the occupancy grid for this update
+		std::set<int> restoredGrids;
+		if(updateGrid && occupancyGridRegenerationRequired(filteredPoses))
+		{
+			for(std::map<int, std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> >::iterator iter=gridMapsCompressed_.begin(); iter!=gridMapsCompressed_.end(); ++iter)
+			{
+				if(uContains(filteredPoses, iter->first))
+				{
+					restoredGrids.insert(iter->first);
+				}
+			}
+		}
+		for(std::map<int, rtabmap::Transform>::iterator iter=filteredPoses.begin(); iter!=filteredPoses.end(); ++iter)
+		{
+			if(!iter->second.isNull())
+			{
 				if(updateGrid &&
 						(iter->first == 0 ||
 						  occupancyGrid_->addedNodes().find(iter->first) == occupancyGrid_->addedNodes().end()))
@@ -675,13 +977,18 @@ std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
 							occupancyGrid_->addToCache(iter->first, mter->second.first.first, mter->second.first.second, mter->second.second);
 						}
 					}
+					else if(uContains(gridMapsCompressed_, iter->first))
+					{
+						restoredGrids.insert(iter->first);
+					}
 				}
 
 #ifdef WITH_OCTOMAP_MSGS
 #ifdef RTABMAP_OCTOMAP
 				if(updateOctomap &&
 						(iter->first == 0 ||
-						  octomap_->addedNodes().find(iter->first) == octomap_->addedNodes().end()))
+						 (octomapAsync_ && octomapSentNodes_.find(iter->first) == octomapSentNodes_.end()) ||
+						 (!octomapAsync_ && octomap_->addedNodes().find(iter->first) == octomap_->addedNodes().end())))
 				{
 					std::map<int, std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> >::iterator mter = gridMaps_.find(iter->first);
 					std::map<int, cv::Point3f>::iterator pter = gridMapsViewpoints_.find(iter->first);
@@ -691,7 +998,19 @@ std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
 						   (mter->second.first.second.empty() || mter->second.first.second.channels() > 2) &&
 						   (mter->second.second.empty() || mter->second.second.channels() > 2))
 						{
-							octomap_->addToCache(iter->first, mter->second.first.first, mter->second.first.second, mter->second.second, pter->second);
+							if(octomapAsync_)
+							{
+								// added by octomapThread_
+								boost::mutex::scoped_lock lock(octomapJobMutex_);
+								uInsert(octomapJobGrids_, *mter);
+								uInsert(octomapJobViewpoints_, *pter);
+								octomapSentNodes_.insert(iter->first);
+							}
+							else
+							{
+								boost::mutex::scoped_lock lock(octomapMutex_);
+								octomap_->addToCache(iter->first, mter->second.first.first, mter->second.first.second, mter->second.second, pter->second);
+							}
 						}
 						else if(!mter->second.first.first.empty() && !mter->second.first.second.empty() && !mter->second.second.empty())
 						{
@@ -705,27 +1024,53 @@ std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
 #endif
 #endif
 			}
+		}
+
+		boost::thread * octomapThread = 0;
+		if(updateOctomap && octomapAsync_)
+		{
+			{
+				boost::mutex::scoped_lock lock(octomapJobMutex_);
+				octomapJobPoses_ = filteredPoses;
+				octomapJobUpdate_ = true;
+				octomapJobPending_ = true;
+			}
+			octomapJobCondition_.notify_all();
+		}
+		else if(updateOctomap)
+		{
+			if(mapParallelUpdate_ && updateGrid)
+			{
+				octomapThread = new boost::thread(boost::bind(&MapsManager::updateOctomapCache, this, boost::cref(filteredPoses)));
+			}
 			else
 			{
-				ROS_ERROR("Pose null for node %d", iter->first);
+				updateOctomapCache(filteredPoses);
 			}
 		}
 
 		if(updateGrid)
 		{
+			for(std::set<int>::iterator iter=restoredGrids.begin(); iter!=restoredGrids.end(); ++iter)
+			{
+				std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> grid;
+				if(getGridMap(*iter, grid))
+				{
+					occupancyGrid_->addToCache(*iter, grid.first.first, grid.first.second, grid.second);
+				}
+			}
 			gridUpdated_ = occupancyGrid_->update(filteredPoses);
+			for(std::set<int>::iterator iter=restoredGrids.begin(); iter!=restoredGrids.end(); ++iter)
+			{
+				occupancyGrid_->addToCache(*iter, cv::Mat(), cv::Mat(), cv::Mat());
+			}
 		}
 
-#ifdef WITH_OCTOMAP_MSGS
-#ifdef RTABMAP_OCTOMAP
-		if(updateOctomap)
+		if(octomapThread)
 		{
-			UTimer time;
-			octomapUpdated_ = octomap_->update(filteredPoses);
-			ROS_INFO("Octomap update time = %fs", time.ticks());
+			octomapThread->join();
+			delete octomapThread;
 		}
-#endif
-#endif
 		for(std::map<int, std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> >::iterator iter=gridMaps_.begin();
 			iter!=gridMaps_.end();)
 		{
@@ -739,6 +1084,30 @@ std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
 				++iter;
 			}
 		}
+		for(std::map<int, std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> >::iterator iter=gridMapsCompressed_.begin();
+			iter!=gridMapsCompressed_.end();)
+		{
+			if(!uContains(poses, iter->first))
+			{
+				gridMapsViewpoints_.erase(iter->first);
+				gridMapsCompressed_.erase(iter++);
+			}
+			else
+			{
+				++iter;
+			}
+		}
+		for(std::map<int, unsigned long>::iterator iter=gridMapsAccess_.begin(); iter!=gridMapsAccess_.end();)
+		{
+			if(!uContains(poses, iter->first))
+			{
+				gridMapsAccess_.erase(iter++);
+			}
+			else
+			{
+				++iter;
+			}
+		}
 
 		for(std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::iterator iter=groundClouds_.begin();
 			iter!=groundClouds_.end();)
@@ -775,48 +1144,1203 @@ std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
 	return filteredPoses;
 }
 
-pcl::PointCloud<pcl::PointXYZRGB>::Ptr subtractFiltering(
-		const pcl::PointCloud<pcl::PointXYZRGB>::Ptr & cloud,
-		const rtabmap::FlannIndex & substractCloudIndex,
-		float radiusSearch,
-		int minNeighborsInRadius)
+bool MapsManager::getGridMap(int id, std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> & grid)
 {
-	UASSERT(minNeighborsInRadius > 0);
-	UASSERT(substractCloudIndex.indexedFeatures());
-
-	pcl::PointCloud<pcl::PointXYZRGB>::Ptr output(new pcl::PointCloud<pcl::PointXYZRGB>);
-	output->resize(cloud->size());
-	int oi = 0; // output iterator
-	for(unsigned int i=0; i<cloud->size(); ++i)
+	std::map<int, std::pair< std::pair<cv::Mat, cv::Mat>, cv::Mat> >::iterator iter = gridMaps_.find(id);
+	if(iter != gridMaps_.end())
 	{
-		std::vector<std::vector<size_t> > kIndices;
-		std::vector<std::vector<float> > kDistances;
-		cv::Mat pt = (cv::Mat_<float>(1, 3) << cloud->at(i).x, cloud->at(i).y, cloud->at(i).z);
-		substractCloudIndex.radiusSearch(pt, kIndices, kDistances, radiusSearch, minNeighborsInRadius, 32, 0, false);
-		if(kIndices.size() == 1 && kIndices[0].size() < minNeighborsInRadius)
+		grid = iter->second;
+		if(id > 0)
 		{
-			output->at(oi++) = cloud->at(i);
+			++cacheHits_;
 		}
 	}
-	output->resize(oi);
-	return output;
+	else
+	{
+		iter = gridMapsCompressed_.find(id);
+		if(iter == gridMapsCompressed_.end())
+		{
+			return false;
+		}
+		grid = std::make_pair(std::make_pair(
+				rtabmap::uncompressData(iter->second.first.first),
+				rtabmap::uncompressData(iter->second.first.second)),
+				rtabmap::uncompressData(iter->second.second));
+		++cacheCompressedHits_;
+	}
+	gridMapsAccess_[id] = ++cacheAccessCount_;
+	return true;
 }
 
-void MapsManager::publishMaps(
-		const std::map<int, rtabmap::Transform> & poses,
-		const ros::Time & stamp,
-		const std::string & mapFrameId)
+bool MapsManager::occupancyGridRegenerationRequired(const std::map<int, rtabmap::Transform> & poses) const
 {
-	ROS_DEBUG("Publishing maps... poses=%d", (int)poses.size());
-
-	// publish maps
-	if(cloudMapPub_.getNumSubscribers() ||
-	   scanMapPub_.getNumSubscribers() ||
-	   cloudObstaclesPub_.getNumSubscribers() ||
-	   cloudGroundPub_.getNumSubscribers())
+	// Same check than rtabmap::OccupancyGrid::update(): the map is
+	// regenerated from its cache if a node moved or none of its nodes is
+	// in the new graph.
+	const std::map<int, Transform> & addedNodes = occupancyGrid_->addedNodes();
+	bool graphChanged = !addedNodes.empty();
+	float updateErrorSqrd = occupancyGrid_->getUpdateError()*occupancyGrid_->getUpdateError();
+	for(std::map<int, Transform>::const_iterator iter=addedNodes.begin(); iter!=addedNodes.end(); ++iter)
 	{
-		// generate the assembled cloud!
-		UTimer time;
+		std::map<int, Transform>::const_iterator jter = poses.find(iter->first);
+		if(jter != poses.end())
+		{
+			graphChanged = false;
+			if(iter->second.getDistanceSquared(jter->second) > updateErrorSqrd)
+			{
+				return true;
+			}
+		}
+	}
+	return graphChanged;
+}
+
+static size_t matBytes(const cv::Mat & m)
+{
+	return m.total()*m.elemSize();
+}
+
+void MapsManager::limitCacheMemory()
+{
+	if(mapCacheMaxMemory_ <= 0.0)
+	{
+		return;
+	}
+	reduceCacheMemory(size_t(mapCacheMaxMemory_*1048576.0));
+}
+
+void MapsManager::reduceCacheMemory(size_t maxBytes)
+{
+	// Memory used per node (local grids + local clouds)
+	size_t totalBytes = 0;
+	size_t compressedBytes = 0;
+	std::map<int, size_t> nodeBytes;
+	for(std::map<int, std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> >::iterator iter=gridMaps_.begin(); iter!=gridMaps_.end(); ++iter)
+	{
+		nodeBytes[iter->first] += matBytes(iter->second.first.first) + matBytes(iter->second.first.second) + matBytes(iter->second.second);
+	}
+	for(std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::iterator iter=groundClouds_.begin();iter!=groundClouds_.end();++iter)
+	{
+		nodeBytes[iter->first] += iter->second->points.size()*sizeof(pcl::PointXYZRGB);
+	}
+	for(std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::iterator iter=obstacleClouds_.begin();iter!=obstacleClouds_.end();++iter)
+	{
+		nodeBytes[iter->first] += iter->second->points.size()*sizeof(pcl::PointXYZRGB);
+	}
+	for(std::map<int, size_t>::iterator iter=nodeBytes.begin(); iter!=nodeBytes.end(); ++iter)
+	{
+		totalBytes += iter->second;
+	}
+	for(std::map<int, std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> >::iterator iter=gridMapsCompressed_.begin(); iter!=gridMapsCompressed_.end(); ++iter)
+	{
+		compressedBytes += matBytes(iter->second.first.first) + matBytes(iter->second.first.second) + matBytes(iter->second.second);
+	}
+
+	// Compressed copies cannot be released (they would have to be
+	// regenerated from the database), only the uncompressed data is bounded.
+	if(totalBytes > maxBytes)
+	{
+		// oldest first, nodes never accessed are the most recent ones
+		std::vector<std::pair<unsigned long, int> > lru;
+		lru.reserve(nodeBytes.size());
+		for(std::map<int, size_t>::iterator iter=nodeBytes.begin(); iter!=nodeBytes.end(); ++iter)
+		{
+			if(iter->first > 0)
+			{
+				std::map<int, unsigned long>::iterator jter = gridMapsAccess_.find(iter->first);
+				lru.push_back(std::make_pair(jter!=gridMapsAccess_.end()?jter->second:cacheAccessCount_+1, iter->first));
+			}
+		}
+		std::sort(lru.begin(), lru.end());
+
+		for(size_t i=0; i<lru.size() && totalBytes > maxBytes; ++i)
+		{
+			int id = lru[i].second;
+			std::map<int, std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> >::iterator iter = gridMaps_.find(id);
+			if(iter != gridMaps_.end())
+			{
+				std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> compressed(std::make_pair(
+						rtabmap::compressData2(iter->second.first.first),
+						rtabmap::compressData2(iter->second.first.second)),
+						rtabmap::compressData2(iter->second.second));
+				compressedBytes += matBytes(compressed.first.first) + matBytes(compressed.first.second) + matBytes(compressed.second);
+				uInsert(gridMapsCompressed_, std::make_pair(id, compressed));
+				gridMaps_.erase(iter);
+				// release the references kept by the occupancy grid cache
+				occupancyGrid_->addToCache(id, cv::Mat(), cv::Mat(), cv::Mat());
+			}
+			// clouds are regenerated from the local grids if needed
+			groundClouds_.erase(id);
+			obstacleClouds_.erase(id);
+			totalBytes -= nodeBytes.at(id);
+			++cacheEvictions_;
+		}
+	}
+
+	unsigned long lookups = cacheHits_ + cacheCompressedHits_ + cacheMisses_;
+	ROS_INFO_THROTTLE(60, "MapsManager: cache memory %ld MB (%d nodes) + %ld MB compressed (%d nodes) / %f MB, "
+			"hits=%.1f%% compressed hits=%.1f%% misses=%.1f%%, evictions=%ld",
+			totalBytes/1048576, (int)nodeBytes.size(),
+			compressedBytes/1048576, (int)gridMapsCompressed_.size(),
+			float(maxBytes)/1048576.0f,
+			lookups?float(cacheHits_)/float(lookups)*100.0f:0.0f,
+			lookups?float(cacheCompressedHits_)/float(lookups)*100.0f:0.0f,
+			lookups?float(cacheMisses_)/float(lookups)*100.0f:0.0f,
+			cacheEvictions_);
+}
+
+static unsigned long cloudBytes(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr & cloud)
+{
+	return cloud.get()?cloud->points.capacity()*sizeof(pcl::PointXYZRGB):0;
+}
+
+void MapsManager::getMemoryUsage(std::map<std::string, unsigned long> & usage, unsigned long & evictable)
+{
+	unsigned long bytes = 0;
+	for(std::map<int, std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> >::iterator iter=gridMaps_.begin(); iter!=gridMaps_.end(); ++iter)
+	{
+		bytes += matBytes(iter->second.first.first) + matBytes(iter->second.first.second) + matBytes(iter->second.second);
+	}
+	bytes += gridMapsViewpoints_.size()*(sizeof(int)+sizeof(cv::Point3f)) + gridMapsAccess_.size()*(sizeof(int)+sizeof(unsigned long));
+	usage["GridMaps"] = bytes;
+	evictable = bytes;
+
+	bytes = 0;
+	for(std::map<int, std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> >::iterator iter=gridMapsCompressed_.begin(); iter!=gridMapsCompressed_.end(); ++iter)
+	{
+		bytes += matBytes(iter->second.first.first) + matBytes(iter->second.first.second) + matBytes(iter->second.second);
+	}
+	usage["GridMapsCompressed"] = bytes;
+
+	bytes = 0;
+	for(std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::iterator iter=groundClouds_.begin();iter!=groundClouds_.end();++iter)
+	{
+		bytes += sizeof(int) + cloudBytes(iter->second);
+	}
+	usage["GroundClouds"] = bytes;
+	evictable += bytes;
+
+	bytes = 0;
+	for(std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::iterator iter=obstacleClouds_.begin();iter!=obstacleClouds_.end();++iter)
+	{
+		bytes += sizeof(int) + cloudBytes(iter->second);
+	}
+	usage["ObstacleClouds"] = bytes;
+	evictable += bytes;
+
+	usage["AssembledGround"] = cloudBytes(assembledGround_) +
+			assembledGroundPoses_.size() * (sizeof(int)+sizeof(Transform)) +
+			assembledGroundIndex_.indexedFeatures()*assembledGroundIndex_.featuresDim() * sizeof(float);
+	usage["AssembledObstacles"] = cloudBytes(assembledObstacles_) +
+			assembledObstaclePoses_.size() * (sizeof(int)+sizeof(Transform)) +
+			assembledObstacleIndex_.indexedFeatures()*assembledObstacleIndex_.featuresDim() * sizeof(float);
+	usage["Voxels"] = groundVoxels_.memoryUsage() + obstacleVoxels_.memoryUsage();
+	usage["GridMap"] = matBytes(gridMap_) + gridMapPublished_.data.capacity() + octoMapProjPublished_.data.capacity();
+	usage["OccupancyGrid"] = occupancyGrid_->getMemoryUsed();
+
+#ifdef WITH_OCTOMAP_MSGS
+#ifdef RTABMAP_OCTOMAP
+	{
+		boost::mutex::scoped_lock lock(octomapMutex_);
+		usage["Octomap"] = octomap_->octree()->memoryUsage();
+	}
+	{
+		boost::mutex::scoped_lock lock(octomapOutputsMutex_);
+		bytes = octomapOutputs_.occupied.data.capacity() +
+				octomapOutputs_.frontier.data.capacity() +
+				octomapOutputs_.obstacles.data.capacity() +
+				octomapOutputs_.ground.data.capacity() +
+				octomapOutputs_.empty.data.capacity() +
+				octomapOutputs_.projection.data.capacity() +
+				octomapOutputs_.binary.data.capacity() +
+				octomapOutputs_.full.data.capacity();
+		usage["OctomapOutputs"] = bytes;
+	}
+#endif
+#endif
+}
+
+/*
+ * Cache file: a header, a table of nodes, then the raw data of the local
+ * grids and clouds. All data offsets are 8-bytes aligned from the beginning
+ * of the file, so that the file can be memory-mapped and only the nodes of
+ * the current graph are read. Raw structures are written, the file is only
+ * valid for the same build (checked by the version and the sizes).
+ */
+static const char kCacheMagic[8] = {'R','T','M','C','A','C','H','E'};
+static const uint32_t kCacheVersion = 1;
+
+struct CacheFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t nodes;
+	uint32_t nodeSize;
+	uint32_t pointSize;
+	uint64_t gridParameters; // hash of Grid/ parameters
+	uint64_t databaseStamp;
+	float cellSize;
+	uint32_t reserved;
+};
+
+struct CacheFileNode
+{
+	int32_t id;
+	float viewpoint[3];
+	int32_t matRows[3]; // ground, obstacles, empty cells
+	int32_t matCols[3];
+	int32_t matTypes[3];
+	uint32_t cloudSizes[2]; // ground, obstacles
+	uint64_t matOffsets[3];
+	uint64_t cloudOffsets[2];
+};
+
+static uint64_t hashGridParameters(const ParametersMap & parameters)
+{
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ULL;
+	for(ParametersMap::const_iterator iter=parameters.begin(); iter!=parameters.end(); ++iter)
+	{
+		if(iter->first.compare(0, 5, "Grid/") == 0)
+		{
+			std::string str = iter->first + "=" + iter->second + ";";
+			for(size_t i=0; i<str.size(); ++i)
+			{
+				hash ^= (unsigned char)str[i];
+				hash *= 1099511628211ULL;
+			}
+		}
+	}
+	return hash;
+}
+
+static uint64_t align8(uint64_t offset)
+{
+	return (offset + 7) & ~uint64_t(7);
+}
+
+bool MapsManager::saveCacheFile(const std::string & path, unsigned long long databaseStamp) const
+{
+	UTimer timer;
+	// nodes with a local grid (local clouds without grid are regenerated)
+	std::vector<CacheFileNode> nodes;
+	std::vector<std::vector<cv::Mat> > mats;
+	std::vector<std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> > clouds;
+	std::map<int, std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> >::const_iterator first = gridMaps_.upper_bound(0);
+	uint64_t offset = align8(sizeof(CacheFileHeader) + std::distance(first, gridMaps_.end())*sizeof(CacheFileNode));
+	for(std::map<int, std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> >::const_iterator iter=first; iter!=gridMaps_.end(); ++iter)
+	{
+		CacheFileNode node;
+		memset(&node, 0, sizeof(CacheFileNode));
+		node.id = iter->first;
+		std::map<int, cv::Point3f>::const_iterator jter = gridMapsViewpoints_.find(iter->first);
+		if(jter != gridMapsViewpoints_.end())
+		{
+			node.viewpoint[0] = jter->second.x;
+			node.viewpoint[1] = jter->second.y;
+			node.viewpoint[2] = jter->second.z;
+		}
+		std::vector<cv::Mat> nodeMats(3);
+		nodeMats[0] = iter->second.first.first.isContinuous()?iter->second.first.first:iter->second.first.first.clone();
+		nodeMats[1] = iter->second.first.second.isContinuous()?iter->second.first.second:iter->second.first.second.clone();
+		nodeMats[2] = iter->second.second.isContinuous()?iter->second.second:iter->second.second.clone();
+		for(int i=0; i<3; ++i)
+		{
+			node.matRows[i] = nodeMats[i].rows;
+			node.matCols[i] = nodeMats[i].cols;
+			node.matTypes[i] = nodeMats[i].type();
+			node.matOffsets[i] = offset;
+			offset = align8(offset + matBytes(nodeMats[i]));
+		}
+		std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> nodeClouds(2);
+		std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr>::const_iterator kter = groundClouds_.find(iter->first);
+		if(kter != groundClouds_.end())
+		{
+			nodeClouds[0] = kter->second;
+		}
+		kter = obstacleClouds_.find(iter->first);
+		if(kter != obstacleClouds_.end())
+		{
+			nodeClouds[1] = kter->second;
+		}
+		for(int i=0; i<2; ++i)
+		{
+			node.cloudSizes[i] = nodeClouds[i].get()?nodeClouds[i]->size():0;
+			node.cloudOffsets[i] = offset;
+			offset = align8(offset + node.cloudSizes[i]*sizeof(pcl::PointXYZRGB));
+		}
+		nodes.push_back(node);
+		mats.push_back(nodeMats);
+		clouds.push_back(nodeClouds);
+	}
+
+	std::string tmpPath = path + ".tmp";
+	std::ofstream file(tmpPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if(!file.is_open())
+	{
+		ROS_ERROR("MapsManager: Cannot open \"%s\" to save the maps cache.", tmpPath.c_str());
+		return false;
+	}
+	CacheFileHeader header;
+	memset(&header, 0, sizeof(CacheFileHeader));
+	memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+	header.version = kCacheVersion;
+	header.nodes = nodes.size();
+	header.nodeSize = sizeof(CacheFileNode);
+	header.pointSize = sizeof(pcl::PointXYZRGB);
+	header.gridParameters = hashGridParameters(parameters_);
+	header.databaseStamp = databaseStamp;
+	header.cellSize = occupancyGrid_->getCellSize();
+	file.write((const char*)&header, sizeof(CacheFileHeader));
+	if(!nodes.empty())
+	{
+		file.write((const char*)&nodes[0], nodes.size()*sizeof(CacheFileNode));
+	}
+
+	static const char padding[8] = {0};
+	for(size_t i=0; i<nodes.size() && file.good(); ++i)
+	{
+		for(int j=0; j<3; ++j)
+		{
+			file.write(padding, nodes[i].matOffsets[j] - file.tellp());
+			file.write((const char*)mats[i][j].data, matBytes(mats[i][j]));
+		}
+		for(int j=0; j<2; ++j)
+		{
+			file.write(padding, nodes[i].cloudOffsets[j] - file.tellp());
+			if(nodes[i].cloudSizes[j])
+			{
+				file.write((const char*)&clouds[i][j]->points[0], nodes[i].cloudSizes[j]*sizeof(pcl::PointXYZRGB));
+			}
+		}
+	}
+	bool success = file.good();
+	file.close();
+	if(!success || rename(tmpPath.c_str(), path.c_str()) != 0)
+	{
+		ROS_ERROR("MapsManager: Failed to write the maps cache \"%s\".", path.c_str());
+		unlink(tmpPath.c_str());
+		return false;
+	}
+	ROS_INFO("MapsManager: Saved maps cache of %d nodes to \"%s\" (%ld MB, %fs).",
+			(int)nodes.size(), path.c_str(), (long)(offset/1048576), timer.ticks());
+	return true;
+}
+
+int MapsManager::loadCacheFile(const std::string & path, const std::set<int> & ids, unsigned long long databaseStamp)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if(fd < 0)
+	{
+		return 0;
+	}
+	UTimer timer;
+	struct stat st;
+	void * mapped = MAP_FAILED;
+	if(fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(CacheFileHeader))
+	{
+		mapped = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	if(mapped == MAP_FAILED)
+	{
+		ROS_WARN("MapsManager: Cannot read the maps cache \"%s\", it is ignored.", path.c_str());
+		return 0;
+	}
+	const unsigned char * data = (const unsigned char *)mapped;
+	uint64_t size = st.st_size;
+
+	int loaded = 0;
+	int stale = 0;
+	const CacheFileHeader * header = (const CacheFileHeader *)data;
+	if(memcmp(header->magic, kCacheMagic, sizeof(kCacheMagic)) != 0 ||
+	   header->version != kCacheVersion ||
+	   header->nodeSize != sizeof(CacheFileNode) ||
+	   header->pointSize != sizeof(pcl::PointXYZRGB) ||
+	   sizeof(CacheFileHeader) + uint64_t(header->nodes)*sizeof(CacheFileNode) > size)
+	{
+		ROS_WARN("MapsManager: Maps cache \"%s\" has not a compatible format, it is ignored.", path.c_str());
+	}
+	else if(header->gridParameters != hashGridParameters(parameters_) || header->cellSize != occupancyGrid_->getCellSize())
+	{
+		ROS_WARN("MapsManager: Grid parameters changed since maps cache \"%s\" has been saved, it is ignored.", path.c_str());
+	}
+	else if(header->databaseStamp != databaseStamp)
+	{
+		ROS_WARN("MapsManager: Database changed since maps cache \"%s\" has been saved, it is ignored.", path.c_str());
+	}
+	else
+	{
+		const CacheFileNode * nodes = (const CacheFileNode *)(data + sizeof(CacheFileHeader));
+		for(uint32_t n=0; n<header->nodes; ++n)
+		{
+			const CacheFileNode & node = nodes[n];
+			if(ids.find(node.id) == ids.end() || uContains(gridMaps_, node.id))
+			{
+				++stale;
+				continue;
+			}
+			bool valid = true;
+			for(int i=0; i<3 && valid; ++i)
+			{
+				valid = node.matRows[i] >= 0 && node.matCols[i] >= 0 &&
+						node.matOffsets[i] + uint64_t(node.matRows[i])*node.matCols[i]*CV_ELEM_SIZE(node.matTypes[i]) <= size;
+			}
+			for(int i=0; i<2 && valid; ++i)
+			{
+				valid = node.cloudOffsets[i] + uint64_t(node.cloudSizes[i])*sizeof(pcl::PointXYZRGB) <= size;
+			}
+			if(!valid)
+			{
+				ROS_WARN("MapsManager: Maps cache \"%s\" is truncated, remaining nodes are ignored.", path.c_str());
+				break;
+			}
+
+			// copy, the file is unmapped afterwards
+			cv::Mat mats[3];
+			for(int i=0; i<3; ++i)
+			{
+				if(node.matRows[i] > 0 && node.matCols[i] > 0)
+				{
+					mats[i] = cv::Mat(node.matRows[i], node.matCols[i], node.matTypes[i], (void*)(data + node.matOffsets[i])).clone();
+				}
+			}
+			uInsert(gridMaps_, std::make_pair(node.id, std::make_pair(std::make_pair(mats[0], mats[1]), mats[2])));
+			uInsert(gridMapsViewpoints_, std::make_pair(node.id, cv::Point3f(node.viewpoint[0], node.viewpoint[1], node.viewpoint[2])));
+			for(int i=0; i<2; ++i)
+			{
+				if(node.cloudSizes[i])
+				{
+					pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGB>);
+					cloud->resize(node.cloudSizes[i]);
+					memcpy(&cloud->points[0], data + node.cloudOffsets[i], node.cloudSizes[i]*sizeof(pcl::PointXYZRGB));
+					uInsert(i==0?groundClouds_:obstacleClouds_, std::make_pair(node.id, cloud));
+				}
+			}
+			++loaded;
+		}
+		ROS_INFO("MapsManager: Loaded %d nodes from maps cache \"%s\" (%d stale or already cached, %fs).",
+				loaded, path.c_str(), stale, timer.ticks());
+	}
+	munmap(mapped, size);
+	return loaded;
+}
+
+void MapsManager::updateOctomapCache(const std::map<int, rtabmap::Transform> & poses)
+{
+#ifdef WITH_OCTOMAP_MSGS
+#ifdef RTABMAP_OCTOMAP
+	UTimer time;
+	boost::mutex::scoped_lock lock(octomapMutex_);
+	octomapUpdated_ = octomap_->update(poses);
+	if(octomapUpdated_)
+	{
+		++octomapVersion_;
+	}
+	ROS_INFO("Octomap update time = %fs", time.ticks());
+#endif
+#endif
+}
+
+void MapsManager::octomapLoop()
+{
+#ifdef WITH_OCTOMAP_MSGS
+#ifdef RTABMAP_OCTOMAP
+	ROS_DEBUG("Octomap thread started");
+	while(true)
+	{
+		std::map<int, std::pair< std::pair<cv::Mat, cv::Mat>, cv::Mat> > grids;
+		std::map<int, cv::Point3f> viewpoints;
+		std::map<int, rtabmap::Transform> poses;
+		bool update;
+		{
+			boost::mutex::scoped_lock lock(octomapJobMutex_);
+			while(octomapThreadRunning_ && !octomapJobPending_)
+			{
+				octomapJobCondition_.wait(lock);
+			}
+			if(!octomapThreadRunning_)
+			{
+				break;
+			}
+			grids.swap(octomapJobGrids_);
+			viewpoints.swap(octomapJobViewpoints_);
+			poses.swap(octomapJobPoses_);
+			update = octomapJobUpdate_;
+			octomapJobUpdate_ = false;
+			octomapJobPending_ = false;
+			octomapJobRunning_ = true;
+		}
+
+		{
+			boost::mutex::scoped_lock lock(octomapMutex_);
+			UTimer time;
+			for(std::map<int, std::pair< std::pair<cv::Mat, cv::Mat>, cv::Mat> >::iterator iter=grids.begin(); iter!=grids.end(); ++iter)
+			{
+				octomap_->addToCache(iter->first, iter->second.first.first, iter->second.first.second, iter->second.second, viewpoints.at(iter->first));
+			}
+			if(update)
+			{
+				if(octomap_->update(poses))
+				{
+					++octomapVersion_;
+				}
+				ROS_INFO("Octomap update time = %fs (async)", time.ticks());
+			}
+
+			// outputs for current subscribers, they will be published on next publishMaps()
+			generateOctomapOutputs(
+					octoMapCloud_.getNumSubscribers() ||
+					octoMapFrontierCloud_.getNumSubscribers() ||
+					octoMapObstacleCloud_.getNumSubscribers() ||
+					octoMapGroundCloud_.getNumSubscribers() ||
+					octoMapEmptySpace_.getNumSubscribers(),
+					octoMapProj_.getNumSubscribers() != 0,
+					octoMapPubBin_.getNumSubscribers() != 0,
+					octoMapPubFull_.getNumSubscribers() != 0);
+		}
+
+		{
+			boost::mutex::scoped_lock lock(octomapJobMutex_);
+			octomapJobRunning_ = false;
+		}
+		octomapJobCondition_.notify_all();
+	}
+	ROS_DEBUG("Octomap thread stopped");
+#endif
+#endif
+}
+
+void MapsManager::clearOctomap()
+{
+#ifdef WITH_OCTOMAP_MSGS
+#ifdef RTABMAP_OCTOMAP
+	{
+		// cancel pending job
+		boost::mutex::scoped_lock lock(octomapJobMutex_);
+		octomapJobGrids_.clear();
+		octomapJobViewpoints_.clear();
+		octomapJobPoses_.clear();
+		octomapJobUpdate_ = false;
+		octomapSentNodes_.clear();
+	}
+	boost::mutex::scoped_lock lock(octomapMutex_);
+	octomap_->clear();
+	++octomapVersion_;
+#endif
+#endif
+}
+
+void MapsManager::generateOctomapOutputs(bool clouds, bool projection, bool binary, bool full)
+{
+#ifdef WITH_OCTOMAP_MSGS
+#ifdef RTABMAP_OCTOMAP
+	OctomapOutputs outputs;
+	{
+		boost::mutex::scoped_lock lock(octomapOutputsMutex_);
+		if(octomapOutputs_.version == octomapVersion_)
+		{
+			clouds = clouds && !octomapOutputs_.hasClouds;
+			projection = projection && !octomapOutputs_.hasProjection;
+			binary = binary && !octomapOutputs_.hasBinary;
+			full = full && !octomapOutputs_.hasFull;
+			if(!clouds && !projection && !binary && !full)
+			{
+				return;
+			}
+			outputs = octomapOutputs_;
+		}
+	}
+	outputs.version = octomapVersion_;
+
+	UTimer time;
+	if(binary)
+	{
+		outputs.hasBinary = octomap_msgs::binaryMapToMsg(*octomap_->octree(), outputs.binary);
+	}
+	if(full)
+	{
+		outputs.hasFull = octomap_msgs::fullMapToMsg(*octomap_->octree(), outputs.full);
+	}
+	if(clouds)
+	{
+		pcl::IndicesPtr obstacleIndices(new std::vector<int>);
+		pcl::IndicesPtr frontierIndices(new std::vector<int>);
+		pcl::IndicesPtr emptyIndices(new std::vector<int>);
+		pcl::IndicesPtr groundIndices(new std::vector<int>);
+		pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud = octomap_->createCloud(octomapTreeDepth_, obstacleIndices.get(), emptyIndices.get(), groundIndices.get(), true, frontierIndices.get(),0);
+
+		pcl::PointCloud<pcl::PointXYZRGB> cloudOccupiedSpace;
+		pcl::IndicesPtr indices = util3d::concatenate(obstacleIndices, groundIndices);
+		pcl::copyPointCloud(*cloud, *indices, cloudOccupiedSpace);
+		pcl::toROSMsg(cloudOccupiedSpace, outputs.occupied);
+
+		pcl::PointCloud<pcl::PointXYZRGB> cloudFrontier;
+		pcl::copyPointCloud(*cloud, *frontierIndices, cloudFrontier);
+		pcl::toROSMsg(cloudFrontier, outputs.frontier);
+
+		pcl::PointCloud<pcl::PointXYZRGB> cloudObstacles;
+		pcl::copyPointCloud(*cloud, *obstacleIndices, cloudObstacles);
+		pcl::toROSMsg(cloudObstacles, outputs.obstacles);
+
+		pcl::PointCloud<pcl::PointXYZRGB> cloudGround;
+		pcl::copyPointCloud(*cloud, *groundIndices, cloudGround);
+		pcl::toROSMsg(cloudGround, outputs.ground);
+
+		pcl::PointCloud<pcl::PointXYZRGB> cloudEmptySpace;
+		pcl::copyPointCloud(*cloud, *emptyIndices, cloudEmptySpace);
+		pcl::toROSMsg(cloudEmptySpace, outputs.empty);
+		outputs.hasClouds = true;
+	}
+	if(projection)
+	{
+		// create the projection map
+		float xMin=0.0f, yMin=0.0f, gridCellSize = 0.05f;
+		cv::Mat pixels = octomap_->createProjectionMap(xMin, yMin, gridCellSize, occupancyGrid_->getMinMapSize(), octomapTreeDepth_);
+
+		nav_msgs::OccupancyGrid & map = outputs.projection;
+		map = nav_msgs::OccupancyGrid();
+		if(!pixels.empty())
+		{
+			//init
+			map.info.resolution = gridCellSize;
+			map.info.origin.position.x = 0.0;
+			map.info.origin.position.y = 0.0;
+			map.info.origin.position.z = 0.0;
+			map.info.origin.orientation.x = 0.0;
+			map.info.origin.orientation.y = 0.0;
+			map.info.origin.orientation.z = 0.0;
+			map.info.origin.orientation.w = 1.0;
+
+			map.info.width = pixels.cols;
+			map.info.height = pixels.rows;
+			map.info.origin.position.x = xMin;
+			map.info.origin.position.y = yMin;
+			map.data.resize(map.info.width * map.info.height);
+
+			memcpy(map.data.data(), pixels.data, map.info.width * map.info.height);
+		}
+		else if(octomap_->addedNodes().size())
+		{
+			ROS_WARN("Octomap projection map is empty! (octomap nodes=%d). "
+					"Make sure you activated \"%s\" and \"%s\" to true. "
+					"See \"$ rosrun rtabmap_ros rtabmap --params | grep Grid\" for more info.",
+					(int)octomap_->octree()->size(),
+					Parameters::kGrid3D().c_str(), Parameters::kGridFromDepth().c_str());
+		}
+		outputs.hasProjection = true;
+	}
+	ROS_DEBUG("Octomap outputs generated (version %ld, %fs)", outputs.version, time.ticks());
+
+	boost::mutex::scoped_lock lock(octomapOutputsMutex_);
+	octomapOutputs_ = outputs;
+#endif
+#endif
+}
+
+#ifdef WITH_OCTOMAP_MSGS
+bool MapsManager::getOctomapMsg(bool full, octomap_msgs::Octomap & msg)
+{
+#ifdef RTABMAP_OCTOMAP
+	if(octomapAsync_)
+	{
+		boost::mutex::scoped_lock lock(octomapJobMutex_);
+		while(octomapThreadRunning_ && (octomapJobPending_ || octomapJobRunning_))
+		{
+			octomapJobCondition_.wait(lock);
+		}
+	}
+	boost::mutex::scoped_lock lock(octomapMutex_);
+	if(octomap_->octree()->size() == 0)
+	{
+		return false;
+	}
+	generateOctomapOutputs(false, false, !full, full);
+	boost::mutex::scoped_lock outputsLock(octomapOutputsMutex_);
+	msg = full?octomapOutputs_.full:octomapOutputs_.binary;
+	return full?octomapOutputs_.hasFull:octomapOutputs_.hasBinary;
+#else
+	return false;
+#endif
+}
+#endif
+
+void MapsManager::loadUncachedSignatures(
+		const std::map<int, rtabmap::Transform> & poses,
+		const rtabmap::Memory * memory,
+		std::map<int, rtabmap::Signature> & signatures) const
+{
+	if(!memory || !this->hasSubscribers())
+	{
+		return;
+	}
+
+	// the nodes that updateMapCaches() will assemble
+	std::map<int, rtabmap::Transform> filteredPoses = getFilteredPoses(poses);
+
+	bool occupancySavedInDB = uStrNumCmp(memory->getDatabaseVersion(), "0.11.10")>=0?true:false;
+	for(std::map<int, rtabmap::Transform>::iterator iter=filteredPoses.lower_bound(1); iter!=filteredPoses.end(); ++iter)
+	{
+		if(!iter->second.isNull() && !uContains(gridMaps_, iter->first) && !uContains(signatures, iter->first))
+		{
+			rtabmap::SensorData data = memory->getNodeData(iter->first, occupancyGrid_->isGridFromDepth() && !occupancySavedInDB, !occupancyGrid_->isGridFromDepth() && !occupancySavedInDB, false, true);
+			if(occupancySavedInDB && data.gridCellSize() == 0.0f)
+			{
+				// old node without occupancy grid, get raw data to regenerate it
+				data = memory->getNodeData(iter->first, occupancyGrid_->isGridFromDepth(), !occupancyGrid_->isGridFromDepth(), false, false);
+			}
+			signatures.insert(std::make_pair(iter->first, rtabmap::Signature(data)));
+		}
+	}
+}
+
+pcl::PointCloud<pcl::PointXYZRGB>::Ptr subtractFiltering(
+		const pcl::PointCloud<pcl::PointXYZRGB>::Ptr & cloud,
+		const rtabmap::FlannIndex & substractCloudIndex,
+		float radiusSearch,
+		int minNeighborsInRadius)
+{
+	UASSERT(minNeighborsInRadius > 0);
+	UASSERT(substractCloudIndex.indexedFeatures());
+
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr output(new pcl::PointCloud<pcl::PointXYZRGB>);
+	output->resize(cloud->size());
+	int oi = 0; // output iterator
+	for(unsigned int i=0; i<cloud->size(); ++i)
+	{
+		std::vector<std::vector<size_t> > kIndices;
+		std::vector<std::vector<float> > kDistances;
+		cv::Mat pt = (cv::Mat_<float>(1, 3) << cloud->at(i).x, cloud->at(i).y, cloud->at(i).z);
+		substractCloudIndex.radiusSearch(pt, kIndices, kDistances, radiusSearch, minNeighborsInRadius, 32, 0, false);
+		if(kIndices.size() == 1 && kIndices[0].size() < minNeighborsInRadius)
+		{
+			output->at(oi++) = cloud->at(i);
+		}
+	}
+	output->resize(oi);
+	return output;
+}
+
+void MapsManager::publishMaps(
+		const std::map<int, rtabmap::Transform> & poses,
+		const ros::Time & stamp,
+		const std::string & mapFrameId)
+{
+	ROS_DEBUG("Publishing maps... poses=%d", (int)poses.size());
+
+	// outputs due for this update, by priority (empty poses clear the maps, never skipped)
+	ros::WallTime now = ros::WallTime::now();
+	std::multimap<int, int> outputs;
+	bool skipped = false;
+	for(int i=0; i<kOutputCount; ++i)
+	{
+		if(isOutputDue(i, poses.empty(), now))
+		{
+			outputs.insert(std::make_pair(outputSchedules_[i].priority, i));
+		}
+		else
+		{
+			updateOutputSubscribers(i, false);
+			skipped = true;
+		}
+	}
+	if(skipped)
+	{
+		pendingPoses_ = poses;
+		pendingStamp_ = stamp;
+		pendingMapFrameId_ = mapFrameId;
+	}
+	else
+	{
+		pendingPoses_.clear();
+	}
+
+	if(mapParallelUpdate_ && outputs.size() > 1)
+	{
+		// clouds, octomap and grid outputs don't share any cache, generate them
+		// concurrently, the first priority in this thread
+		std::vector<boost::thread*> threads;
+		for(std::multimap<int, int>::iterator iter=++outputs.begin(); iter!=outputs.end(); ++iter)
+		{
+			threads.push_back(new boost::thread(boost::bind(&MapsManager::publishOutput, this, iter->second, boost::cref(poses), boost::cref(stamp), boost::cref(mapFrameId))));
+		}
+		publishOutput(outputs.begin()->second, poses, stamp, mapFrameId);
+		for(size_t i=0; i<threads.size(); ++i)
+		{
+			threads[i]->join();
+			delete threads[i];
+		}
+	}
+	else
+	{
+		for(std::multimap<int, int>::iterator iter=outputs.begin(); iter!=outputs.end(); ++iter)
+		{
+			publishOutput(iter->second, poses, stamp, mapFrameId);
+		}
+	}
+
+	if(outputSchedules_[kOutputGrids].maxRate > 0.0 ||
+	   outputSchedules_[kOutputClouds].maxRate > 0.0 ||
+	   outputSchedules_[kOutputOctomap].maxRate > 0.0)
+	{
+		ROS_INFO_THROTTLE(60, "MapsManager: outputs published/skipped/coalesced: grid=%lu/%lu/%lu cloud=%lu/%lu/%lu octomap=%lu/%lu/%lu",
+				outputSchedules_[kOutputGrids].published, outputSchedules_[kOutputGrids].skipped, outputSchedules_[kOutputGrids].coalesced,
+				outputSchedules_[kOutputClouds].published, outputSchedules_[kOutputClouds].skipped, outputSchedules_[kOutputClouds].coalesced,
+				outputSchedules_[kOutputOctomap].published, outputSchedules_[kOutputOctomap].skipped, outputSchedules_[kOutputOctomap].coalesced);
+	}
+
+	if(!this->hasSubscribers() && mapCacheCleanup_)
+	{
+		if(!gridMaps_.empty())
+		{
+			size_t totalBytes = 0;
+			for(std::map<int, std::pair< std::pair<cv::Mat, cv::Mat>, cv::Mat> >::iterator iter=gridMaps_.begin(); iter!=gridMaps_.end(); ++iter)
+			{
+				totalBytes+= sizeof(int)+
+						iter->second.first.first.total()*iter->second.first.first.elemSize() +
+						iter->second.first.second.total()*iter->second.first.second.elemSize() +
+						iter->second.second.total()*iter->second.second.elemSize();
+			}
+			totalBytes += gridMapsViewpoints_.size()*sizeof(int) + gridMapsViewpoints_.size() * sizeof(cv::Point3f);
+			ROS_INFO("MapsManager: cleanup %ld grid maps (~%ld MB)...", gridMaps_.size(), totalBytes/1048576);
+		}
+		gridMaps_.clear();
+		gridMapsViewpoints_.clear();
+		gridMapsCompressed_.clear();
+		gridMapsAccess_.clear();
+	}
+
+	limitCacheMemory();
+}
+
+bool MapsManager::hasOutputSubscribers(int output) const
+{
+	if(output == kOutputGrids)
+	{
+		return gridMapPub_.getNumSubscribers() != 0 ||
+				gridProbMapPub_.getNumSubscribers() != 0 ||
+				projMapPub_.getNumSubscribers() != 0;
+	}
+	else if(output == kOutputClouds)
+	{
+		return cloudMapPub_.getNumSubscribers() != 0 ||
+				cloudObstaclesPub_.getNumSubscribers() != 0 ||
+				cloudGroundPub_.getNumSubscribers() != 0 ||
+				scanMapPub_.getNumSubscribers() != 0 ||
+				hasCloudChunkSubscribers();
+	}
+	return octoMapPubBin_.getNumSubscribers() != 0 ||
+			octoMapPubFull_.getNumSubscribers() != 0 ||
+			octoMapCloud_.getNumSubscribers() != 0 ||
+			octoMapFrontierCloud_.getNumSubscribers() != 0 ||
+			octoMapObstacleCloud_.getNumSubscribers() != 0 ||
+			octoMapGroundCloud_.getNumSubscribers() != 0 ||
+			octoMapEmptySpace_.getNumSubscribers() != 0 ||
+			octoMapProj_.getNumSubscribers() != 0;
+}
+
+bool MapsManager::isOutputDue(int output, bool force, const ros::WallTime & now)
+{
+	OutputSchedule & schedule = outputSchedules_[output];
+	if(!hasOutputSubscribers(output))
+	{
+		// nothing generated, don't delay the first subscriber
+		schedule.pending = false;
+		return true;
+	}
+	if(!force &&
+	   schedule.maxRate > 0.0 &&
+	   !schedule.last.isZero() &&
+	   (now - schedule.last).toSec() < 1.0/schedule.maxRate)
+	{
+		++schedule.skipped;
+		schedule.pending = true;
+		return false;
+	}
+	if(schedule.pending)
+	{
+		++schedule.coalesced;
+		schedule.pending = false;
+	}
+	++schedule.published;
+	schedule.last = now;
+	return true;
+}
+
+void MapsManager::publishOutput(
+		int output,
+		const std::map<int, rtabmap::Transform> & poses,
+		const ros::Time & stamp,
+		const std::string & mapFrameId)
+{
+	if(output == kOutputGrids)
+	{
+		publishGrids(poses, stamp, mapFrameId);
+	}
+	else if(output == kOutputClouds)
+	{
+		publishClouds(poses, stamp, mapFrameId);
+	}
+	else
+	{
+		publishOctomap(poses, stamp, mapFrameId);
+	}
+}
+
+void MapsManager::flushPendingOutputs(const ros::WallTimerEvent & event)
+{
+	if(outputsMutex_)
+	{
+		outputsMutex_->lock();
+	}
+	ros::WallTime now = ros::WallTime::now();
+	bool pending = false;
+	for(int i=0; i<kOutputCount; ++i)
+	{
+		if(outputSchedules_[i].pending)
+		{
+			if(isOutputDue(i, false, now))
+			{
+				ROS_DEBUG("MapsManager: flushing skipped output %d", i);
+				publishOutput(i, pendingPoses_, pendingStamp_, pendingMapFrameId_);
+			}
+			else
+			{
+				pending = true;
+			}
+		}
+	}
+	if(!pending)
+	{
+		pendingPoses_.clear();
+	}
+	if(outputsMutex_)
+	{
+		outputsMutex_->unlock();
+	}
+}
+
+void MapsManager::updateOutputSubscribers(int output, bool published)
+{
+	if(output == kOutputGrids)
+	{
+		if(gridMapPub_.getNumSubscribers() == 0)
+		{
+			latched_.at(&gridMapPub_) = false;
+			gridMapPublished_ = nav_msgs::OccupancyGrid();
+			gridMapPublishedPoses_.clear();
+		}
+		// set when grid_map is actually published, see publishGrids()
+		gridMapSubscribers_ = std::min(gridMapSubscribers_, gridMapPub_.getNumSubscribers());
+		if(projMapPub_.getNumSubscribers() == 0)
+		{
+			latched_.at(&projMapPub_) = false;
+		}
+		if(gridProbMapPub_.getNumSubscribers() == 0)
+		{
+			latched_.at(&gridProbMapPub_) = false;
+		}
+	}
+	else if(output == kOutputClouds)
+	{
+		for(size_t i=0; i<cloudChunkPubs_.size(); ++i)
+		{
+			cloudChunkSubscribers_[i] = published?cloudChunkPubs_[i].getNumSubscribers():std::min(cloudChunkSubscribers_[i], cloudChunkPubs_[i].getNumSubscribers());
+		}
+		if(cloudMapPub_.getNumSubscribers() == 0)
+		{
+			latched_.at(&cloudMapPub_) = false;
+		}
+		if(scanMapPub_.getNumSubscribers() == 0)
+		{
+			latched_.at(&scanMapPub_) = false;
+		}
+		if(cloudGroundPub_.getNumSubscribers() == 0)
+		{
+			latched_.at(&cloudGroundPub_) = false;
+		}
+		if(cloudObstaclesPub_.getNumSubscribers() == 0)
+		{
+			latched_.at(&cloudObstaclesPub_) = false;
+		}
+	}
+	else
+	{
+#ifdef WITH_OCTOMAP_MSGS
+#ifdef RTABMAP_OCTOMAP
+		if(octoMapPubBin_.getNumSubscribers() == 0)
+		{
+			latched_.at(&octoMapPubBin_) = false;
+		}
+		if(octoMapPubFull_.getNumSubscribers() == 0)
+		{
+			latched_.at(&octoMapPubFull_) = false;
+		}
+		if(octoMapCloud_.getNumSubscribers() == 0)
+		{
+			latched_.at(&octoMapCloud_) = false;
+		}
+		if(octoMapFrontierCloud_.getNumSubscribers() == 0)
+		{
+			latched_.at(&octoMapFrontierCloud_) = false;
+		}
+		if(octoMapObstacleCloud_.getNumSubscribers() == 0)
+		{
+			latched_.at(&octoMapObstacleCloud_) = false;
+		}
+		if(octoMapGroundCloud_.getNumSubscribers() == 0)
+		{
+			latched_.at(&octoMapGroundCloud_) = false;
+		}
+		if(octoMapEmptySpace_.getNumSubscribers() == 0)
+		{
+			latched_.at(&octoMapEmptySpace_) = false;
+		}
+		if(octoMapProj_.getNumSubscribers() == 0)
+		{
+			latched_.at(&octoMapProj_) = false;
+			octoMapProjPublished_ = nav_msgs::OccupancyGrid();
+			octoMapProjPublishedPoses_.clear();
+		}
+		// set when octomap_grid is actually published, see publishOctomap()
+		octoMapProjSubscribers_ = std::min(octoMapProjSubscribers_, octoMapProj_.getNumSubscribers());
+#endif
+#endif
+	}
+}
+
+int MapsManager::updateVoxelCloud(
+		const std::map<int, rtabmap::Transform> & poses,
+		bool ground)
+{
+	VoxelCloudMap & voxels = ground?groundVoxels_:obstacleVoxels_;
+	std::map<int, Transform> & assembledPoses = ground?assembledGroundPoses_:assembledObstaclePoses_;
+	std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr > & localClouds = ground?groundClouds_:obstacleClouds_;
+
+	int chunkSize = cloudChunkSize_>0.0?std::max(1, int(cloudChunkSize_/occupancyGrid_->getCellSize()+0.5)):0;
+	if(voxels.voxelSize() != occupancyGrid_->getCellSize() || voxels.chunkSize() != chunkSize)
+	{
+		voxels.setVoxelSize(occupancyGrid_->getCellSize());
+		voxels.setChunkSize(chunkSize);
+		assembledPoses.clear();
+	}
+	float updateErrorSqr = occupancyGrid_->getUpdateError()*occupancyGrid_->getUpdateError();
+	int changes = 0;
+
+	// removed and moved nodes
+	int moved = 0;
+	for(std::map<int, Transform>::iterator iter=assembledPoses.begin(); iter!=assembledPoses.end();)
+	{
+		std::map<int, Transform>::const_iterator jter = poses.find(iter->first);
+		std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::iterator kter = localClouds.find(iter->first);
+		if(jter == poses.end())
+		{
+			voxels.removeNode(iter->first);
+			assembledPoses.erase(iter++);
+			++changes;
+		}
+		else if(jter->second.getDistanceSquared(iter->second) > updateErrorSqr)
+		{
+			if(kter != localClouds.end())
+			{
+				// same points (already subtracted), re-inserted at the new pose
+				voxels.addNode(iter->first, *util3d::transformPointCloud(kter->second, jter->second));
+				iter->second = jter->second;
+				++iter;
+			}
+			else
+			{
+				// cloud not cached anymore, it will be regenerated from the local grid
+				voxels.removeNode(iter->first);
+				assembledPoses.erase(iter++);
+			}
+			++moved;
+			++changes;
+		}
+		else
+		{
+			++iter;
+		}
+	}
+	if(voxels.contains(0) && poses.find(0) == poses.end())
+	{
+		voxels.removeNode(0);
+		++changes;
+	}
+	if(moved)
+	{
+		ROS_INFO("Graph has changed, %d %s clouds moved", moved, ground?"ground":"obstacle");
+	}
+
+	// new nodes (latest node 0 is always updated)
+	for(std::map<int, Transform>::const_iterator iter = poses.begin(); iter!=poses.end(); ++iter)
+	{
+		if(iter->first < 0 || (iter->first > 0 && assembledPoses.find(iter->first) != assembledPoses.end()))
+		{
+			continue;
+		}
+		if(iter->first > 0)
+		{
+			assembledPoses.insert(*iter);
+		}
+		std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> grid;
+		if(!getGridMap(iter->first, grid))
+		{
+			continue;
+		}
+		const cv::Mat & cells = ground?grid.first.first:grid.first.second;
+		if(cells.cols)
+		{
+			pcl::PointCloud<pcl::PointXYZRGB>::Ptr transformed = util3d::laserScanToPointCloudRGB(
+					LaserScan::backwardCompatibility(cells),
+					iter->second,
+					ground?0:255,
+					ground?255:0,
+					0);
+			pcl::PointCloud<pcl::PointXYZRGB>::Ptr subtractedCloud = transformed;
+			if(cloudSubtractFiltering_ && !voxels.empty())
+			{
+				subtractedCloud = voxels.subtract(*transformed, occupancyGrid_->getCellSize(), cloudSubtractFilteringMinNeighbors_);
+				UDEBUG("Adding %s %d pts=%d/%d", ground?"ground":"obstacle", iter->first, (int)subtractedCloud->size(), (int)transformed->size());
+			}
+			voxels.addNode(iter->first, *subtractedCloud);
+			if(iter->first>0)
+			{
+				localClouds.insert(std::make_pair(iter->first, util3d::transformPointCloud(subtractedCloud, iter->second.inverse())));
+			}
+			++changes;
+		}
+	}
+	return changes;
+}
+
+void MapsManager::getAssembledClouds(
+		const std::map<int, rtabmap::Transform> & poses,
+		pcl::PointCloud<pcl::PointXYZRGB> & ground,
+		pcl::PointCloud<pcl::PointXYZRGB> & obstacles)
+{
+	UASSERT(occupancyGrid_->getCellSize() > 0.0);
+	updateVoxelCloud(poses, true);
+	groundVoxels_.getCloud(ground);
+	updateVoxelCloud(poses, false);
+	obstacleVoxels_.getCloud(obstacles);
+}
+
+void MapsManager::publishClouds(
+		const std::map<int, rtabmap::Transform> & poses,
+		const ros::Time & stamp,
+		const std::string & mapFrameId)
+{
+	// publish maps
+	bool updateChunks = hasCloudChunkSubscribers();
+	if(cloudMapPub_.getNumSubscribers() ||
+	   scanMapPub_.getNumSubscribers() ||
+	   cloudObstaclesPub_.getNumSubscribers() ||
+	   cloudGroundPub_.getNumSubscribers() ||
+	   updateChunks)
+	{
+		// generate the assembled cloud!
+		UTimer time;
 
 		if(scanMapPub_.getNumSubscribers())
 		{
@@ -835,268 +2359,292 @@ void MapsManager::publishMaps(
 			}
 		}
 
-		// detect if the graph has changed, if so, recreate the clouds
-		bool graphGroundOptimized = false;
-		bool graphObstacleOptimized = false;
 		bool updateGround = cloudMapPub_.getNumSubscribers() ||
 				   scanMapPub_.getNumSubscribers() ||
 				   cloudGroundPub_.getNumSubscribers();
 		bool updateObstacles = cloudMapPub_.getNumSubscribers() ||
 				   scanMapPub_.getNumSubscribers() ||
 				   cloudObstaclesPub_.getNumSubscribers();
-		bool graphGroundChanged = updateGround;
-		bool graphObstacleChanged = updateObstacles;
-		float updateErrorSqr = occupancyGrid_->getUpdateError()*occupancyGrid_->getUpdateError();
-		for(std::map<int, Transform>::const_iterator iter=poses.lower_bound(1); iter!=poses.end(); ++iter)
+		int countObstacles = 0;
+		int countGrounds = 0;
+		if(cloudOutputVoxelized_)
 		{
-			std::map<int, Transform>::const_iterator jter;
-			if(updateGround)
+			// incremental: only new, moved and removed nodes are updated
+			UASSERT(occupancyGrid_->getCellSize() > 0.0);
+			if(updateGround || updateChunks)
 			{
-				jter = assembledGroundPoses_.find(iter->first);
-				if(jter != assembledGroundPoses_.end())
+				countGrounds = updateVoxelCloud(poses, true);
+				if(updateGround && (countGrounds || assembledGround_->empty()))
 				{
-					graphGroundChanged = false;
-					UASSERT(!iter->second.isNull() && !jter->second.isNull());
-					if(iter->second.getDistanceSquared(jter->second) > updateErrorSqr)
-					{
-						graphGroundOptimized = true;
-					}
+					groundVoxels_.getCloud(*assembledGround_);
 				}
 			}
-			if(updateObstacles)
+			if(updateObstacles || updateChunks)
 			{
-				jter = assembledObstaclePoses_.find(iter->first);
-				if(jter != assembledObstaclePoses_.end())
+				countObstacles = updateVoxelCloud(poses, false);
+				if(updateObstacles && (countObstacles || assembledObstacles_->empty()))
 				{
-					graphObstacleChanged = false;
-					UASSERT(!iter->second.isNull() && !jter->second.isNull());
-					if(iter->second.getDistanceSquared(jter->second) > updateErrorSqr)
-					{
-						graphObstacleOptimized = true;
-					}
+					obstacleVoxels_.getCloud(*assembledObstacles_);
 				}
 			}
+			if(updateChunks)
+			{
+				std::set<unsigned long long> dirtyChunks;
+				dirtyChunks.swap(cloudChunksUnpublished_);
+				updateCloudChunkVersions(dirtyChunks);
+				publishCloudChunks(dirtyChunks, stamp, mapFrameId);
+			}
 		}
-		int countObstacles = 0;
-		int countGrounds = 0;
-		int previousIndexedGroundSize = assembledGroundIndex_.indexedFeatures();
-		int previousIndexedObstacleSize = assembledObstacleIndex_.indexedFeatures();
-		if(graphGroundOptimized || graphGroundChanged)
-		{
-			int previousSize = assembledGround_->size();
-			assembledGround_->clear();
-			assembledGround_->reserve(previousSize);
-			assembledGroundPoses_.clear();
-			assembledGroundIndex_.release();
-		}
-		if(graphObstacleOptimized || graphObstacleChanged )
-		{
-			int previousSize = assembledObstacles_->size();
-			assembledObstacles_->clear();
-			assembledObstacles_->reserve(previousSize);
-			assembledObstaclePoses_.clear();
-			assembledObstacleIndex_.release();
-		}
-
-		if(graphGroundOptimized || graphObstacleOptimized)
+		else
 		{
-			ROS_INFO("Graph has changed, updating clouds...");
-			UTimer t;
-			cv::Mat tmpGroundPts;
-			cv::Mat tmpObstaclePts;
-			for(std::map<int, Transform>::const_iterator iter = poses.lower_bound(1); iter!=poses.end(); ++iter)
+			// detect if the graph has changed, if so, recreate the clouds
+			bool graphGroundOptimized = false;
+			bool graphObstacleOptimized = false;
+			bool graphGroundChanged = updateGround;
+			bool graphObstacleChanged = updateObstacles;
+			float updateErrorSqr = occupancyGrid_->getUpdateError()*occupancyGrid_->getUpdateError();
+			for(std::map<int, Transform>::const_iterator iter=poses.lower_bound(1); iter!=poses.end(); ++iter)
 			{
-				if(updateGround  &&
-				   (graphGroundOptimized || assembledGroundPoses_.find(iter->first) == assembledGroundPoses_.end()))
+				std::map<int, Transform>::const_iterator jter;
+				if(updateGround)
 				{
-					std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::iterator kter=groundClouds_.find(iter->first);
-					if(kter != groundClouds_.end() && kter->second->size())
+					jter = assembledGroundPoses_.find(iter->first);
+					if(jter != assembledGroundPoses_.end())
 					{
-						assembledGroundPoses_.insert(*iter);
-						pcl::PointCloud<pcl::PointXYZRGB>::Ptr transformed = util3d::transformPointCloud(kter->second, iter->second);
-						*assembledGround_+=*transformed;
-						if(cloudSubtractFiltering_)
+						graphGroundChanged = false;
+						UASSERT(!iter->second.isNull() && !jter->second.isNull());
+						if(iter->second.getDistanceSquared(jter->second) > updateErrorSqr)
 						{
-							for(unsigned int i=0; i<transformed->size(); ++i)
-							{
-								if(tmpGroundPts.empty())
-								{
-									tmpGroundPts = (cv::Mat_<float>(1, 3) << transformed->at(i).x, transformed->at(i).y, transformed->at(i).z);
-									tmpGroundPts.reserve(previousIndexedGroundSize>0?previousIndexedGroundSize:100);
-								}
-								else
-								{
-									cv::Mat pt = (cv::Mat_<float>(1, 3) << transformed->at(i).x, transformed->at(i).y, transformed->at(i).z);
-									tmpGroundPts.push_back(pt);
-								}
-							}
+							graphGroundOptimized = true;
 						}
-						++countGrounds;
 					}
 				}
-				if(updateObstacles  &&
-				   (graphObstacleOptimized || assembledObstaclePoses_.find(iter->first) == assembledObstaclePoses_.end()))
+				if(updateObstacles)
 				{
-					std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::iterator kter=obstacleClouds_.find(iter->first);
-					if(kter != obstacleClouds_.end() && kter->second->size())
+					jter = assembledObstaclePoses_.find(iter->first);
+					if(jter != assembledObstaclePoses_.end())
 					{
-						assembledObstaclePoses_.insert(*iter);
-						pcl::PointCloud<pcl::PointXYZRGB>::Ptr transformed = util3d::transformPointCloud(kter->second, iter->second);
-						*assembledObstacles_+=*transformed;
-						if(cloudSubtractFiltering_)
+						graphObstacleChanged = false;
+						UASSERT(!iter->second.isNull() && !jter->second.isNull());
+						if(iter->second.getDistanceSquared(jter->second) > updateErrorSqr)
 						{
-							for(unsigned int i=0; i<transformed->size(); ++i)
-							{
-								if(tmpObstaclePts.empty())
-								{
-									tmpObstaclePts = (cv::Mat_<float>(1, 3) << transformed->at(i).x, transformed->at(i).y, transformed->at(i).z);
-									tmpObstaclePts.reserve(previousIndexedObstacleSize>0?previousIndexedObstacleSize:100);
-								}
-								else
-								{
-									cv::Mat pt = (cv::Mat_<float>(1, 3) << transformed->at(i).x, transformed->at(i).y, transformed->at(i).z);
-									tmpObstaclePts.push_back(pt);
-								}
-							}
+							graphObstacleOptimized = true;
 						}
-						++countObstacles;
-					}
-					else
-					{
-						std::map<int, std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> >::iterator jter = gridMaps_.find(iter->first);
 					}
 				}
 			}
-			double addingPointsTime = t.ticks();
-
-			if(graphGroundOptimized && !tmpGroundPts.empty())
+			int previousIndexedGroundSize = assembledGroundIndex_.indexedFeatures();
+			int previousIndexedObstacleSize = assembledObstacleIndex_.indexedFeatures();
+			if(graphGroundOptimized || graphGroundChanged)
 			{
-				assembledGroundIndex_.buildKDTreeSingleIndex(tmpGroundPts, 15);
+				int previousSize = assembledGround_->size();
+				assembledGround_->clear();
+				assembledGround_->reserve(previousSize);
+				assembledGroundPoses_.clear();
+				assembledGroundIndex_.release();
 			}
-			if(graphObstacleOptimized && !tmpObstaclePts.empty())
+			if(graphObstacleOptimized || graphObstacleChanged )
 			{
-				assembledObstacleIndex_.buildKDTreeSingleIndex(tmpObstaclePts, 15);
+				int previousSize = assembledObstacles_->size();
+				assembledObstacles_->clear();
+				assembledObstacles_->reserve(previousSize);
+				assembledObstaclePoses_.clear();
+				assembledObstacleIndex_.release();
 			}
-			double indexingTime = t.ticks();
-			ROS_INFO("Graph optimized! Time recreating clouds (%d ground, %d obstacles) = %f s (indexing %fs)", countGrounds, countObstacles, addingPointsTime+indexingTime, indexingTime);
-		}
-		else if(graphGroundChanged || graphObstacleChanged)
-		{
-			ROS_WARN("Graph has changed! The whole cloud is regenerated.");
-		}
 
-		for(std::map<int, Transform>::const_iterator iter = poses.begin(); iter!=poses.end(); ++iter)
-		{
-			std::map<int, std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> >::iterator jter = gridMaps_.find(iter->first);
-			if(updateGround  && assembledGroundPoses_.find(iter->first) == assembledGroundPoses_.end())
+			if(graphGroundOptimized || graphObstacleOptimized)
 			{
-				if(iter->first > 0)
-				{
-					assembledGroundPoses_.insert(*iter);
-				}
-				if(jter!=gridMaps_.end() && jter->second.first.first.cols)
+				ROS_INFO("Graph has changed, updating clouds...");
+				UTimer t;
+				cv::Mat tmpGroundPts;
+				cv::Mat tmpObstaclePts;
+				for(std::map<int, Transform>::const_iterator iter = poses.lower_bound(1); iter!=poses.end(); ++iter)
 				{
-					pcl::PointCloud<pcl::PointXYZRGB>::Ptr transformed = util3d::laserScanToPointCloudRGB(LaserScan::backwardCompatibility(jter->second.first.first), iter->second, 0, 255, 0);
-					pcl::PointCloud<pcl::PointXYZRGB>::Ptr subtractedCloud = transformed;
-					if(cloudSubtractFiltering_)
+					if(updateGround  &&
+					   (graphGroundOptimized || assembledGroundPoses_.find(iter->first) == assembledGroundPoses_.end()))
 					{
-						if(assembledGroundIndex_.indexedFeatures())
-						{
-							subtractedCloud = subtractFiltering(transformed, assembledGroundIndex_, occupancyGrid_->getCellSize(), cloudSubtractFilteringMinNeighbors_);
-						}
-						if(subtractedCloud->size())
+						std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::iterator kter=groundClouds_.find(iter->first);
+						if(kter != groundClouds_.end() && kter->second->size())
 						{
-							UDEBUG("Adding ground %d pts=%d/%d (index=%d)", iter->first, subtractedCloud->size(), transformed->size(), assembledGroundIndex_.indexedFeatures());
-							cv::Mat pts(subtractedCloud->size(), 3, CV_32FC1);
-							for(unsigned int i=0; i<subtractedCloud->size(); ++i)
-							{
-								pts.at<float>(i, 0) = subtractedCloud->at(i).x;
-								pts.at<float>(i, 1) = subtractedCloud->at(i).y;
-								pts.at<float>(i, 2) = subtractedCloud->at(i).z;
-							}
-							if(!assembledGroundIndex_.isBuilt())
+							assembledGroundPoses_.insert(*iter);
+							pcl::PointCloud<pcl::PointXYZRGB>::Ptr transformed = util3d::transformPointCloud(kter->second, iter->second);
+							*assembledGround_+=*transformed;
+							if(cloudSubtractFiltering_)
 							{
-								assembledGroundIndex_.buildKDTreeSingleIndex(pts, 15);
-							}
-							else
-							{
-								assembledGroundIndex_.addPoints(pts);
+								for(unsigned int i=0; i<transformed->size(); ++i)
+								{
+									if(tmpGroundPts.empty())
+									{
+										tmpGroundPts = (cv::Mat_<float>(1, 3) << transformed->at(i).x, transformed->at(i).y, transformed->at(i).z);
+										tmpGroundPts.reserve(previousIndexedGroundSize>0?previousIndexedGroundSize:100);
+									}
+									else
+									{
+										cv::Mat pt = (cv::Mat_<float>(1, 3) << transformed->at(i).x, transformed->at(i).y, transformed->at(i).z);
+										tmpGroundPts.push_back(pt);
+									}
+								}
 							}
+							++countGrounds;
 						}
 					}
-					if(iter->first>0)
-					{
-						groundClouds_.insert(std::make_pair(iter->first, util3d::transformPointCloud(subtractedCloud, iter->second.inverse())));
-					}
-					if(subtractedCloud->size())
+					if(updateObstacles  &&
+					   (graphObstacleOptimized || assembledObstaclePoses_.find(iter->first) == assembledObstaclePoses_.end()))
 					{
-						*assembledGround_+=*subtractedCloud;
+						std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::iterator kter=obstacleClouds_.find(iter->first);
+						if(kter != obstacleClouds_.end() && kter->second->size())
+						{
+							assembledObstaclePoses_.insert(*iter);
+							pcl::PointCloud<pcl::PointXYZRGB>::Ptr transformed = util3d::transformPointCloud(kter->second, iter->second);
+							*assembledObstacles_+=*transformed;
+							if(cloudSubtractFiltering_)
+							{
+								for(unsigned int i=0; i<transformed->size(); ++i)
+								{
+									if(tmpObstaclePts.empty())
+									{
+										tmpObstaclePts = (cv::Mat_<float>(1, 3) << transformed->at(i).x, transformed->at(i).y, transformed->at(i).z);
+										tmpObstaclePts.reserve(previousIndexedObstacleSize>0?previousIndexedObstacleSize:100);
+									}
+									else
+									{
+										cv::Mat pt = (cv::Mat_<float>(1, 3) << transformed->at(i).x, transformed->at(i).y, transformed->at(i).z);
+										tmpObstaclePts.push_back(pt);
+									}
+								}
+							}
+							++countObstacles;
+						}
+						else
+						{
+							std::map<int, std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> >::iterator jter = gridMaps_.find(iter->first);
+						}
 					}
-					++countGrounds;
 				}
+				double addingPointsTime = t.ticks();
+
+				if(graphGroundOptimized && !tmpGroundPts.empty())
+				{
+					assembledGroundIndex_.buildKDTreeSingleIndex(tmpGroundPts, 15);
+				}
+				if(graphObstacleOptimized && !tmpObstaclePts.empty())
+				{
+					assembledObstacleIndex_.buildKDTreeSingleIndex(tmpObstaclePts, 15);
+				}
+				double indexingTime = t.ticks();
+				ROS_INFO("Graph optimized! Time recreating clouds (%d ground, %d obstacles) = %f s (indexing %fs)", countGrounds, countObstacles, addingPointsTime+indexingTime, indexingTime);
+			}
+			else if(graphGroundChanged || graphObstacleChanged)
+			{
+				ROS_WARN("Graph has changed! The whole cloud is regenerated.");
 			}
-			if(updateObstacles  && assembledObstaclePoses_.find(iter->first) == assembledObstaclePoses_.end())
+
+			for(std::map<int, Transform>::const_iterator iter = poses.begin(); iter!=poses.end(); ++iter)
 			{
-				if(iter->first > 0)
+				std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> grid;
+				bool hasGrid = false;
+				if((updateGround && assembledGroundPoses_.find(iter->first) == assembledGroundPoses_.end()) ||
+				   (updateObstacles && assembledObstaclePoses_.find(iter->first) == assembledObstaclePoses_.end()))
 				{
-					assembledObstaclePoses_.insert(*iter);
+					hasGrid = getGridMap(iter->first, grid);
 				}
-				if(jter!=gridMaps_.end() && jter->second.first.second.cols)
+				if(updateGround  && assembledGroundPoses_.find(iter->first) == assembledGroundPoses_.end())
 				{
-					pcl::PointCloud<pcl::PointXYZRGB>::Ptr transformed = util3d::laserScanToPointCloudRGB(LaserScan::backwardCompatibility(jter->second.first.second), iter->second, 255, 0, 0);
-					pcl::PointCloud<pcl::PointXYZRGB>::Ptr subtractedCloud = transformed;
-					if(cloudSubtractFiltering_)
+					if(iter->first > 0)
 					{
-						if(assembledObstacleIndex_.indexedFeatures())
-						{
-							subtractedCloud = subtractFiltering(transformed, assembledObstacleIndex_, occupancyGrid_->getCellSize(), cloudSubtractFilteringMinNeighbors_);
-						}
-						if(subtractedCloud->size())
+						assembledGroundPoses_.insert(*iter);
+					}
+					if(hasGrid && grid.first.first.cols)
+					{
+						pcl::PointCloud<pcl::PointXYZRGB>::Ptr transformed = util3d::laserScanToPointCloudRGB(LaserScan::backwardCompatibility(grid.first.first), iter->second, 0, 255, 0);
+						pcl::PointCloud<pcl::PointXYZRGB>::Ptr subtractedCloud = transformed;
+						if(cloudSubtractFiltering_)
 						{
-							UDEBUG("Adding obstacle %d pts=%d/%d (index=%d)", iter->first, subtractedCloud->size(), transformed->size(), assembledObstacleIndex_.indexedFeatures());
-							cv::Mat pts(subtractedCloud->size(), 3, CV_32FC1);
-							for(unsigned int i=0; i<subtractedCloud->size(); ++i)
+							if(assembledGroundIndex_.indexedFeatures())
 							{
-								pts.at<float>(i, 0) = subtractedCloud->at(i).x;
-								pts.at<float>(i, 1) = subtractedCloud->at(i).y;
-								pts.at<float>(i, 2) = subtractedCloud->at(i).z;
+								subtractedCloud = subtractFiltering(transformed, assembledGroundIndex_, occupancyGrid_->getCellSize(), cloudSubtractFilteringMinNeighbors_);
 							}
-							if(!assembledObstacleIndex_.isBuilt())
+							if(subtractedCloud->size())
 							{
-								assembledObstacleIndex_.buildKDTreeSingleIndex(pts, 15);
-							}
-							else
-							{
-								assembledObstacleIndex_.addPoints(pts);
+								UDEBUG("Adding ground %d pts=%d/%d (index=%d)", iter->first, subtractedCloud->size(), transformed->size(), assembledGroundIndex_.indexedFeatures());
+								cv::Mat pts(subtractedCloud->size(), 3, CV_32FC1);
+								for(unsigned int i=0; i<subtractedCloud->size(); ++i)
+								{
+									pts.at<float>(i, 0) = subtractedCloud->at(i).x;
+									pts.at<float>(i, 1) = subtractedCloud->at(i).y;
+									pts.at<float>(i, 2) = subtractedCloud->at(i).z;
+								}
+								if(!assembledGroundIndex_.isBuilt())
+								{
+									assembledGroundIndex_.buildKDTreeSingleIndex(pts, 15);
+								}
+								else
+								{
+									assembledGroundIndex_.addPoints(pts);
+								}
 							}
 						}
+						if(iter->first>0)
+						{
+							groundClouds_.insert(std::make_pair(iter->first, util3d::transformPointCloud(subtractedCloud, iter->second.inverse())));
+						}
+						if(subtractedCloud->size())
+						{
+							*assembledGround_+=*subtractedCloud;
+						}
+						++countGrounds;
 					}
-					if(iter->first>0)
+				}
+				if(updateObstacles  && assembledObstaclePoses_.find(iter->first) == assembledObstaclePoses_.end())
+				{
+					if(iter->first > 0)
 					{
-						obstacleClouds_.insert(std::make_pair(iter->first, util3d::transformPointCloud(subtractedCloud, iter->second.inverse())));
+						assembledObstaclePoses_.insert(*iter);
 					}
-					if(subtractedCloud->size())
+					if(hasGrid && grid.first.second.cols)
 					{
-						*assembledObstacles_+=*subtractedCloud;
+						pcl::PointCloud<pcl::PointXYZRGB>::Ptr transformed = util3d::laserScanToPointCloudRGB(LaserScan::backwardCompatibility(grid.first.second), iter->second, 255, 0, 0);
+						pcl::PointCloud<pcl::PointXYZRGB>::Ptr subtractedCloud = transformed;
+						if(cloudSubtractFiltering_)
+						{
+							if(assembledObstacleIndex_.indexedFeatures())
+							{
+								subtractedCloud = subtractFiltering(transformed, assembledObstacleIndex_, occupancyGrid_->getCellSize(), cloudSubtractFilteringMinNeighbors_);
+							}
+							if(subtractedCloud->size())
+							{
+								UDEBUG("Adding obstacle %d pts=%d/%d (index=%d)", iter->first, subtractedCloud->size(), transformed->size(), assembledObstacleIndex_.indexedFeatures());
+								cv::Mat pts(subtractedCloud->size(), 3, CV_32FC1);
+								for(unsigned int i=0; i<subtractedCloud->size(); ++i)
+								{
+									pts.at<float>(i, 0) = subtractedCloud->at(i).x;
+									pts.at<float>(i, 1) = subtractedCloud->at(i).y;
+									pts.at<float>(i, 2) = subtractedCloud->at(i).z;
+								}
+								if(!assembledObstacleIndex_.isBuilt())
+								{
+									assembledObstacleIndex_.buildKDTreeSingleIndex(pts, 15);
+								}
+								else
+								{
+									assembledObstacleIndex_.addPoints(pts);
+								}
+							}
+						}
+						if(iter->first>0)
+						{
+							obstacleClouds_.insert(std::make_pair(iter->first, util3d::transformPointCloud(subtractedCloud, iter->second.inverse())));
+						}
+						if(subtractedCloud->size())
+						{
+							*assembledObstacles_+=*subtractedCloud;
+						}
+						++countObstacles;
 					}
-					++countObstacles;
 				}
 			}
 		}
 
-		if(cloudOutputVoxelized_)
-		{
-			UASSERT(occupancyGrid_->getCellSize() > 0.0);
-			if(countGrounds && assembledGround_->size())
-			{
-				assembledGround_ = util3d::voxelize(assembledGround_, occupancyGrid_->getCellSize());
-			}
-			if(countObstacles && assembledObstacles_->size())
-			{
-				assembledObstacles_ = util3d::voxelize(assembledObstacles_, occupancyGrid_->getCellSize());
-			}
-		}
-
 		ROS_INFO("Assembled %d obstacle and %d ground clouds (%d points, %fs)",
 				countObstacles, countGrounds, (int)(assembledGround_->size() + assembledObstacles_->size()), time.ticks());
 
@@ -1178,161 +2726,257 @@ void MapsManager::publishMaps(
 		assembledObstacleIndex_.release();
 		groundClouds_.clear();
 		obstacleClouds_.clear();
+		groundVoxels_.clear();
+		obstacleVoxels_.clear();
+		updateCloudChunkVersions(cloudChunksUnpublished_);
 	}
-	if(cloudMapPub_.getNumSubscribers() == 0)
+	updateOutputSubscribers(kOutputClouds, true);
+}
+
+void MapsManager::updateCloudChunkVersions(std::set<unsigned long long> & dirtyChunks)
+{
+	std::set<unsigned long long> changedChunks;
+	groundVoxels_.popDirtyChunks(changedChunks);
+	obstacleVoxels_.popDirtyChunks(changedChunks);
+	if(!changedChunks.empty())
 	{
-		latched_.at(&cloudMapPub_) = false;
+		++cloudChunkVersion_;
+		for(std::set<unsigned long long>::const_iterator iter=changedChunks.begin(); iter!=changedChunks.end(); ++iter)
+		{
+			cloudChunkVersions_[*iter] = cloudChunkVersion_;
+		}
+		dirtyChunks.insert(changedChunks.begin(), changedChunks.end());
 	}
-	if(scanMapPub_.getNumSubscribers() == 0)
+}
+
+void MapsManager::getCloudChunk(
+		unsigned long long chunk,
+		int level,
+		rtabmap_ros::CloudChunk & msg) const
+{
+	int x,y,z;
+	VoxelCloudMap::keyToIndex(chunk, x, y, z);
+	msg.x = x;
+	msg.y = y;
+	msg.z = z;
+	msg.size = obstacleVoxels_.chunkSize()?obstacleVoxels_.chunkLength():groundVoxels_.chunkLength();
+	msg.level = level;
+	msg.voxel_size = obstacleVoxels_.voxelSize() * float(1<<level);
+	std::map<unsigned long long, unsigned int>::const_iterator iter = cloudChunkVersions_.find(chunk);
+	msg.version = iter!=cloudChunkVersions_.end()?iter->second:0;
+
+	pcl::PointCloud<pcl::PointXYZRGB> cloud;
+	obstacleVoxels_.getChunkCloud(chunk, level, cloud);
+	groundVoxels_.getChunkCloud(chunk, level, cloud);
+	pcl::toROSMsg(cloud, msg.cloud);
+	msg.cloud.header = msg.header;
+}
+
+void MapsManager::publishCloudChunks(
+		const std::set<unsigned long long> & dirtyChunks,
+		const ros::Time & stamp,
+		const std::string & mapFrameId)
+{
+	UTimer timer;
+	int published = 0;
+	for(size_t i=0; i<cloudChunkPubs_.size(); ++i)
 	{
-		latched_.at(&scanMapPub_) = false;
+		if(cloudChunkPubs_[i].getNumSubscribers() == 0)
+		{
+			continue;
+		}
+
+		// New subscribers need all chunks
+		std::set<unsigned long long> allChunks;
+		const std::set<unsigned long long> * chunks = &dirtyChunks;
+		if(cloudChunkPubs_[i].getNumSubscribers() > cloudChunkSubscribers_[i])
+		{
+			for(std::map<unsigned long long, unsigned int>::const_iterator iter=cloudChunkVersions_.begin(); iter!=cloudChunkVersions_.end(); ++iter)
+			{
+				if(groundVoxels_.chunks().find(iter->first) != groundVoxels_.chunks().end() ||
+				   obstacleVoxels_.chunks().find(iter->first) != obstacleVoxels_.chunks().end())
+				{
+					allChunks.insert(iter->first);
+				}
+			}
+			allChunks.insert(dirtyChunks.begin(), dirtyChunks.end());
+			chunks = &allChunks;
+		}
+
+		for(std::set<unsigned long long>::const_iterator iter=chunks->begin(); iter!=chunks->end(); ++iter)
+		{
+			rtabmap_ros::CloudChunk::Ptr msg(new rtabmap_ros::CloudChunk);
+			msg->header.stamp = stamp;
+			msg->header.frame_id = mapFrameId;
+			getCloudChunk(*iter, i, *msg);
+			cloudChunkPubs_[i].publish(msg);
+			++published;
+		}
 	}
-	if(cloudGroundPub_.getNumSubscribers() == 0)
+	if(published)
 	{
-		latched_.at(&cloudGroundPub_) = false;
+		ROS_INFO("Published %d cloud chunks (%d changed, version=%d, %fs)",
+				published, (int)dirtyChunks.size(), (int)cloudChunkVersion_, timer.ticks());
 	}
-	if(cloudObstaclesPub_.getNumSubscribers() == 0)
+}
+
+unsigned int MapsManager::getCloudChunks(
+		const std::map<int, rtabmap::Transform> & poses,
+		int level,
+		const cv::Point3f & roiMin,
+		const cv::Point3f & roiMax,
+		unsigned int sinceVersion,
+		std::vector<rtabmap_ros::CloudChunk> & chunks)
+{
+	if(cloudChunkSize_ <= 0.0)
 	{
-		latched_.at(&cloudObstaclesPub_) = false;
+		ROS_WARN("Cloud chunks are disabled, set cloud_chunk_size.");
+		return 0;
 	}
 
-#ifdef WITH_OCTOMAP_MSGS
-#ifdef RTABMAP_OCTOMAP
-	if( octomapUpdated_ ||
-		!latching_ ||
-		(octoMapPubBin_.getNumSubscribers() && !latched_.at(&octoMapPubBin_)) ||
-		(octoMapPubFull_.getNumSubscribers() && !latched_.at(&octoMapPubFull_)) ||
-		(octoMapCloud_.getNumSubscribers() && !latched_.at(&octoMapCloud_)) ||
-		(octoMapFrontierCloud_.getNumSubscribers() && !latched_.at(&octoMapFrontierCloud_)) ||
-		(octoMapObstacleCloud_.getNumSubscribers() && !latched_.at(&octoMapObstacleCloud_)) ||
-		(octoMapGroundCloud_.getNumSubscribers() && !latched_.at(&octoMapGroundCloud_)) ||
-		(octoMapEmptySpace_.getNumSubscribers() && !latched_.at(&octoMapEmptySpace_)) ||
-		(octoMapProj_.getNumSubscribers() && !latched_.at(&octoMapProj_)))
-	{
-		if(octoMapPubBin_.getNumSubscribers())
-		{
-			octomap_msgs::Octomap msg;
-			octomap_msgs::binaryMapToMsg(*octomap_->octree(), msg);
-			msg.header.frame_id = mapFrameId;
-			msg.header.stamp = stamp;
-			octoMapPubBin_.publish(msg);
-			latched_.at(&octoMapPubBin_) = true;
+	if(level < 0 || level >= cloudChunkLevels_)
+	{
+		ROS_WARN("Cloud chunks level %d is not in [0, %d] (cloud_chunk_levels), clamped.", level, cloudChunkLevels_-1);
+		level = level<0?0:cloudChunkLevels_-1;
+	}
+
+	updateVoxelCloud(poses, true);
+	updateVoxelCloud(poses, false);
+	// chunks versioned here are still published on the next update
+	updateCloudChunkVersions(cloudChunksUnpublished_);
+
+	bool roi = roiMin.x < roiMax.x && roiMin.y < roiMax.y && roiMin.z < roiMax.z;
+	float size = obstacleVoxels_.chunkLength();
+	for(std::map<unsigned long long, unsigned int>::const_iterator iter=cloudChunkVersions_.begin(); iter!=cloudChunkVersions_.end(); ++iter)
+	{
+		if(iter->second <= sinceVersion)
+		{
+			continue;
 		}
-		if(octoMapPubFull_.getNumSubscribers())
+		if(sinceVersion == 0 &&
+		   groundVoxels_.chunks().find(iter->first) == groundVoxels_.chunks().end() &&
+		   obstacleVoxels_.chunks().find(iter->first) == obstacleVoxels_.chunks().end())
 		{
-			octomap_msgs::Octomap msg;
-			octomap_msgs::fullMapToMsg(*octomap_->octree(), msg);
-			msg.header.frame_id = mapFrameId;
-			msg.header.stamp = stamp;
-			octoMapPubFull_.publish(msg);
-			latched_.at(&octoMapPubFull_) = true;
+			// removed chunks are only useful for incremental requests
+			continue;
+		}
+		if(roi)
+		{
+			int x,y,z;
+			VoxelCloudMap::keyToIndex(iter->first, x, y, z);
+			if(float(x+1)*size < roiMin.x || float(x)*size > roiMax.x ||
+			   float(y+1)*size < roiMin.y || float(y)*size > roiMax.y ||
+			   float(z+1)*size < roiMin.z || float(z)*size > roiMax.z)
+			{
+				continue;
+			}
 		}
-		if(octoMapCloud_.getNumSubscribers() ||
+		chunks.resize(chunks.size()+1);
+		getCloudChunk(iter->first, level, chunks.back());
+	}
+	return cloudChunkVersion_;
+}
+
+void MapsManager::publishOctomap(
+		const std::map<int, rtabmap::Transform> & poses,
+		const ros::Time & stamp,
+		const std::string & mapFrameId)
+{
+#ifdef WITH_OCTOMAP_MSGS
+#ifdef RTABMAP_OCTOMAP
+	bool clouds = octoMapCloud_.getNumSubscribers() ||
 			octoMapFrontierCloud_.getNumSubscribers() ||
 			octoMapObstacleCloud_.getNumSubscribers() ||
 			octoMapGroundCloud_.getNumSubscribers() ||
-			octoMapEmptySpace_.getNumSubscribers())
+			octoMapEmptySpace_.getNumSubscribers();
+	bool projection = octoMapProj_.getNumSubscribers() != 0;
+	bool binary = octoMapPubBin_.getNumSubscribers() != 0;
+	bool full = octoMapPubFull_.getNumSubscribers() != 0;
+	if(octomapAsync_)
+	{
+		// Outputs of a new subscriber are missing, ask the octomap thread to generate them
+		bool missing;
+		{
+			boost::mutex::scoped_lock lock(octomapOutputsMutex_);
+			missing = (clouds && !octomapOutputs_.hasClouds) ||
+					(projection && !octomapOutputs_.hasProjection) ||
+					(binary && !octomapOutputs_.hasBinary) ||
+					(full && !octomapOutputs_.hasFull);
+		}
+		if(missing)
 		{
-			sensor_msgs::PointCloud2 msg;
-			pcl::IndicesPtr obstacleIndices(new std::vector<int>);
-			pcl::IndicesPtr frontierIndices(new std::vector<int>);
-			pcl::IndicesPtr emptyIndices(new std::vector<int>);
-			pcl::IndicesPtr groundIndices(new std::vector<int>);
-			pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud = octomap_->createCloud(octomapTreeDepth_, obstacleIndices.get(), emptyIndices.get(), groundIndices.get(), true, frontierIndices.get(),0);
-
-			if(octoMapCloud_.getNumSubscribers())
-			{
-				pcl::PointCloud<pcl::PointXYZRGB> cloudOccupiedSpace;
-				pcl::IndicesPtr indices = util3d::concatenate(obstacleIndices, groundIndices);
-				pcl::copyPointCloud(*cloud, *indices, cloudOccupiedSpace);
-				pcl::toROSMsg(cloudOccupiedSpace, msg);
-				msg.header.frame_id = mapFrameId;
-				msg.header.stamp = stamp;
-				octoMapCloud_.publish(msg);
-				latched_.at(&octoMapCloud_) = true;
-			}
-			if(octoMapFrontierCloud_.getNumSubscribers())
-			{
-				pcl::PointCloud<pcl::PointXYZRGB> cloudFrontier;
-				pcl::copyPointCloud(*cloud, *frontierIndices, cloudFrontier);
-				pcl::toROSMsg(cloudFrontier, msg);
-				msg.header.frame_id = mapFrameId;
-				msg.header.stamp = stamp;
-				octoMapFrontierCloud_.publish(msg);
-				latched_.at(&octoMapFrontierCloud_) = true;
-			}
-			if(octoMapObstacleCloud_.getNumSubscribers())
-			{
-				pcl::PointCloud<pcl::PointXYZRGB> cloudObstacles;
-				pcl::copyPointCloud(*cloud, *obstacleIndices, cloudObstacles);
-				pcl::toROSMsg(cloudObstacles, msg);
-				msg.header.frame_id = mapFrameId;
-				msg.header.stamp = stamp;
-				octoMapObstacleCloud_.publish(msg);
-				latched_.at(&octoMapObstacleCloud_) = true;
-			}
-			if(octoMapGroundCloud_.getNumSubscribers())
 			{
-				pcl::PointCloud<pcl::PointXYZRGB> cloudGround;
-				pcl::copyPointCloud(*cloud, *groundIndices, cloudGround);
-				pcl::toROSMsg(cloudGround, msg);
-				msg.header.frame_id = mapFrameId;
-				msg.header.stamp = stamp;
-				octoMapGroundCloud_.publish(msg);
-				latched_.at(&octoMapGroundCloud_) = true;
+				boost::mutex::scoped_lock lock(octomapJobMutex_);
+				octomapJobPending_ = true;
 			}
-			if(octoMapEmptySpace_.getNumSubscribers())
+			octomapJobCondition_.notify_all();
+		}
+	}
+	else if(clouds || projection || binary || full)
+	{
+		boost::mutex::scoped_lock lock(octomapMutex_);
+		generateOctomapOutputs(clouds, projection, binary, full);
+	}
+
+	{
+		// publish outputs not already published (or not latched)
+		boost::mutex::scoped_lock lock(octomapOutputsMutex_);
+		const OctomapOutputs & outputs = octomapOutputs_;
+		ros::Publisher * cloudPubs[5] = {&octoMapCloud_, &octoMapFrontierCloud_, &octoMapObstacleCloud_, &octoMapGroundCloud_, &octoMapEmptySpace_};
+		const sensor_msgs::PointCloud2 * cloudMsgs[5] = {&outputs.occupied, &outputs.frontier, &outputs.obstacles, &outputs.ground, &outputs.empty};
+		for(int i=0; i<5; ++i)
+		{
+			ros::Publisher & pub = *cloudPubs[i];
+			if(outputs.hasClouds && pub.getNumSubscribers() &&
+			   (!latching_ || !latched_.at(&pub) || octomapPublishedVersions_[&pub] != outputs.version))
 			{
-				pcl::PointCloud<pcl::PointXYZRGB> cloudEmptySpace;
-				pcl::copyPointCloud(*cloud, *emptyIndices, cloudEmptySpace);
-				pcl::toROSMsg(cloudEmptySpace, msg);
+				sensor_msgs::PointCloud2 msg = *cloudMsgs[i];
 				msg.header.frame_id = mapFrameId;
 				msg.header.stamp = stamp;
-				octoMapEmptySpace_.publish(msg);
-				latched_.at(&octoMapEmptySpace_) = true;
+				pub.publish(msg);
+				latched_.at(&pub) = true;
+				octomapPublishedVersions_[&pub] = outputs.version;
 			}
 		}
-		if(octoMapProj_.getNumSubscribers())
+		if(outputs.hasProjection && octoMapProj_.getNumSubscribers() && !outputs.projection.data.empty() &&
+		   (!latching_ || !latched_.at(&octoMapProj_) || octomapPublishedVersions_[&octoMapProj_] != outputs.version ||
+		    (gridMapTileSize_ > 0 && octoMapProj_.getNumSubscribers() > octoMapProjSubscribers_)))
 		{
-			// create the projection map
-			float xMin=0.0f, yMin=0.0f, gridCellSize = 0.05f;
-			cv::Mat pixels = octomap_->createProjectionMap(xMin, yMin, gridCellSize, occupancyGrid_->getMinMapSize(), octomapTreeDepth_);
-
-			if(!pixels.empty())
+			nav_msgs::OccupancyGrid map = outputs.projection;
+			map.header.frame_id = mapFrameId;
+			map.header.stamp = stamp;
+			if(!publishGridTiles(map, poses, octoMapProj_, octoMapProjUpdatesPub_, octoMapProjSubscribers_, octoMapProjPublished_, octoMapProjPublishedPoses_))
 			{
-				//init
-				nav_msgs::OccupancyGrid map;
-				map.info.resolution = gridCellSize;
-				map.info.origin.position.x = 0.0;
-				map.info.origin.position.y = 0.0;
-				map.info.origin.position.z = 0.0;
-				map.info.origin.orientation.x = 0.0;
-				map.info.origin.orientation.y = 0.0;
-				map.info.origin.orientation.z = 0.0;
-				map.info.origin.orientation.w = 1.0;
-
-				map.info.width = pixels.cols;
-				map.info.height = pixels.rows;
-				map.info.origin.position.x = xMin;
-				map.info.origin.position.y = yMin;
-				map.data.resize(map.info.width * map.info.height);
-
-				memcpy(map.data.data(), pixels.data, map.info.width * map.info.height);
-
-				map.header.frame_id = mapFrameId;
-				map.header.stamp = stamp;
-
 				octoMapProj_.publish(map);
-				latched_.at(&octoMapProj_) = true;
-			}
-			else if(poses.size())
-			{
-				ROS_WARN("Octomap projection map is empty! (poses=%d octomap nodes=%d). "
-						"Make sure you activated \"%s\" and \"%s\" to true. "
-						"See \"$ rosrun rtabmap_ros rtabmap --params | grep Grid\" for more info.",
-						(int)poses.size(), (int)octomap_->octree()->size(),
-						Parameters::kGrid3D().c_str(), Parameters::kGridFromDepth().c_str());
+				if(gridMapTileSize_ > 0)
+				{
+					octoMapProjPublished_ = map;
+					octoMapProjPublishedPoses_ = poses;
+				}
 			}
+			latched_.at(&octoMapProj_) = true;
+			octomapPublishedVersions_[&octoMapProj_] = outputs.version;
+			octoMapProjSubscribers_ = octoMapProj_.getNumSubscribers();
+		}
+		if(outputs.hasBinary && octoMapPubBin_.getNumSubscribers() &&
+		   (!latching_ || !latched_.at(&octoMapPubBin_) || octomapPublishedVersions_[&octoMapPubBin_] != outputs.version))
+		{
+			octomap_msgs::Octomap msg = outputs.binary;
+			msg.header.frame_id = mapFrameId;
+			msg.header.stamp = stamp;
+			octoMapPubBin_.publish(msg);
+			latched_.at(&octoMapPubBin_) = true;
+			octomapPublishedVersions_[&octoMapPubBin_] = outputs.version;
+		}
+		if(outputs.hasFull && octoMapPubFull_.getNumSubscribers() &&
+		   (!latching_ || !latched_.at(&octoMapPubFull_) || octomapPublishedVersions_[&octoMapPubFull_] != outputs.version))
+		{
+			octomap_msgs::Octomap msg = outputs.full;
+			msg.header.frame_id = mapFrameId;
+			msg.header.stamp = stamp;
+			octoMapPubFull_.publish(msg);
+			latched_.at(&octoMapPubFull_) = true;
+			octomapPublishedVersions_[&octoMapPubFull_] = outputs.version;
 		}
 	}
 
@@ -1346,54 +2990,35 @@ void MapsManager::publishMaps(
 		octoMapEmptySpace_.getNumSubscribers() == 0 &&
 		octoMapProj_.getNumSubscribers() == 0)
 	{
-		if(octomap_->octree()->getNumLeafNodes()>0)
 		{
-			ROS_INFO("MapsManager: cleanup octomap (%ld leaf nodes, ~%ld MB)...",
-					octomap_->octree()->getNumLeafNodes(),
-					octomap_->octree()->memoryUsage()/1048576);
+			boost::mutex::scoped_lock lock(octomapMutex_);
+			if(octomap_->octree()->getNumLeafNodes()>0)
+			{
+				ROS_INFO("MapsManager: cleanup octomap (%ld leaf nodes, ~%ld MB)...",
+						octomap_->octree()->getNumLeafNodes(),
+						octomap_->octree()->memoryUsage()/1048576);
+			}
 		}
-		octomap_->clear();
+		clearOctomap();
+		boost::mutex::scoped_lock lock(octomapOutputsMutex_);
+		octomapOutputs_ = OctomapOutputs();
 	}
 
-	if(octoMapPubBin_.getNumSubscribers() == 0)
-	{
-		latched_.at(&octoMapPubBin_) = false;
-	}
-	if(octoMapPubFull_.getNumSubscribers() == 0)
-	{
-		latched_.at(&octoMapPubFull_) = false;
-	}
-	if(octoMapCloud_.getNumSubscribers() == 0)
-	{
-		latched_.at(&octoMapCloud_) = false;
-	}
-	if(octoMapFrontierCloud_.getNumSubscribers() == 0)
-	{
-		latched_.at(&octoMapFrontierCloud_) = false;
-	}
-	if(octoMapObstacleCloud_.getNumSubscribers() == 0)
-	{
-		latched_.at(&octoMapObstacleCloud_) = false;
-	}
-	if(octoMapGroundCloud_.getNumSubscribers() == 0)
-	{
-		latched_.at(&octoMapGroundCloud_) = false;
-	}
-	if(octoMapEmptySpace_.getNumSubscribers() == 0)
-	{
-		latched_.at(&octoMapEmptySpace_) = false;
-	}
-	if(octoMapProj_.getNumSubscribers() == 0)
-	{
-		latched_.at(&octoMapProj_) = false;
-	}
+	updateOutputSubscribers(kOutputOctomap, true);
 
 #endif
 #endif
+}
 
+void MapsManager::publishGrids(
+		const std::map<int, rtabmap::Transform> & poses,
+		const ros::Time & stamp,
+		const std::string & mapFrameId)
+{
 	if( gridUpdated_ ||
 		!latching_ ||
 		(gridMapPub_.getNumSubscribers() && !latched_.at(&gridMapPub_)) ||
+		(gridMapTileSize_ > 0 && gridMapPub_.getNumSubscribers() > gridMapSubscribers_) ||
 		(projMapPub_.getNumSubscribers() && !latched_.at(&projMapPub_)) ||
 		(gridProbMapPub_.getNumSubscribers() && !latched_.at(&gridProbMapPub_)))
 	{
@@ -1486,8 +3111,17 @@ void MapsManager::publishMaps(
 
 				if(gridMapPub_.getNumSubscribers())
 				{
-					gridMapPub_.publish(map);
+					if(!publishGridTiles(map, poses, gridMapPub_, gridMapUpdatesPub_, gridMapSubscribers_, gridMapPublished_, gridMapPublishedPoses_))
+					{
+						gridMapPub_.publish(map);
+						if(gridMapTileSize_ > 0)
+						{
+							gridMapPublished_ = map;
+							gridMapPublishedPoses_ = poses;
+						}
+					}
 					latched_.at(&gridMapPub_) = true;
+					gridMapSubscribers_ = gridMapPub_.getNumSubscribers();
 				}
 				if(projMapPub_.getNumSubscribers())
 				{
@@ -1502,37 +3136,118 @@ void MapsManager::publishMaps(
 		}
 	}
 
-	if(gridMapPub_.getNumSubscribers() == 0)
+	updateOutputSubscribers(kOutputGrids, true);
+}
+
+bool MapsManager::publishGridTiles(
+		const nav_msgs::OccupancyGrid & map,
+		const std::map<int, rtabmap::Transform> & poses,
+		const ros::Publisher & gridPub,
+		const ros::Publisher & updatesPub,
+		uint32_t previousSubscribers,
+		nav_msgs::OccupancyGrid & last,
+		std::map<int, rtabmap::Transform> & lastPoses)
+{
+	if(gridMapTileSize_ <= 0 ||
+	   updatesPub.getNumSubscribers() == 0 ||
+	   gridPub.getNumSubscribers() > previousSubscribers) // new subscribers need the full grid
+	{
+		return false;
+	}
+
+	if(last.data.empty() ||
+	   last.info.width != map.info.width ||
+	   last.info.height != map.info.height ||
+	   last.info.resolution != map.info.resolution ||
+	   last.info.origin.position.x != map.info.origin.position.x ||
+	   last.info.origin.position.y != map.info.origin.position.y)
+	{
+		return false;
+	}
+
+	// After a global correction most of the grid has moved, send it all
+	for(std::map<int, Transform>::const_iterator iter=poses.begin(); iter!=poses.end(); ++iter)
 	{
-		latched_.at(&gridMapPub_) = false;
+		std::map<int, Transform>::const_iterator jter = lastPoses.find(iter->first);
+		if(jter != lastPoses.end() &&
+		   iter->second.getDistance(jter->second) > map.info.resolution)
+		{
+			ROS_DEBUG("Graph has changed (node %d moved), publishing full %s", iter->first, gridPub.getTopic().c_str());
+			return false;
+		}
 	}
-	if(projMapPub_.getNumSubscribers() == 0)
+
+	const int width = map.info.width;
+	const int height = map.info.height;
+	const int tile = gridMapTileSize_;
+	const int tilesX = (width + tile - 1) / tile;
+	const int tilesY = (height + tile - 1) / tile;
+	std::vector<unsigned char> dirty(tilesX*tilesY, 0);
+	int dirtyCount = 0;
+	for(int ty=0; ty<tilesY; ++ty)
 	{
-		latched_.at(&projMapPub_) = false;
+		int y1 = std::min((ty+1)*tile, height);
+		for(int tx=0; tx<tilesX; ++tx)
+		{
+			int x0 = tx*tile;
+			int x1 = std::min(x0+tile, width);
+			for(int y=ty*tile; y<y1; ++y)
+			{
+				if(memcmp(&map.data[y*width+x0], &last.data[y*width+x0], x1-x0) != 0)
+				{
+					dirty[ty*tilesX+tx] = 1;
+					++dirtyCount;
+					break;
+				}
+			}
+		}
 	}
-	if(gridProbMapPub_.getNumSubscribers() == 0)
+
+	if(dirtyCount > int(gridMapTileMaxRatio_*double(tilesX*tilesY)))
 	{
-		latched_.at(&gridProbMapPub_) = false;
+		return false;
 	}
 
-	if(!this->hasSubscribers() && mapCacheCleanup_)
+	// Merge consecutive dirty tiles of the same tile row in one patch
+	int patches = 0;
+	for(int ty=0; ty<tilesY; ++ty)
 	{
-		if(!gridMaps_.empty())
+		int tx=0;
+		while(tx<tilesX)
 		{
-			size_t totalBytes = 0;
-			for(std::map<int, std::pair< std::pair<cv::Mat, cv::Mat>, cv::Mat> >::iterator iter=gridMaps_.begin(); iter!=gridMaps_.end(); ++iter)
+			if(!dirty[ty*tilesX+tx])
 			{
-				totalBytes+= sizeof(int)+
-						iter->second.first.first.total()*iter->second.first.first.elemSize() +
-						iter->second.first.second.total()*iter->second.first.second.elemSize() +
-						iter->second.second.total()*iter->second.second.elemSize();
+				++tx;
+				continue;
 			}
-			totalBytes += gridMapsViewpoints_.size()*sizeof(int) + gridMapsViewpoints_.size() * sizeof(cv::Point3f);
-			ROS_INFO("MapsManager: cleanup %ld grid maps (~%ld MB)...", gridMaps_.size(), totalBytes/1048576);
+			int start = tx;
+			while(tx<tilesX && dirty[ty*tilesX+tx])
+			{
+				++tx;
+			}
+
+			map_msgs::OccupancyGridUpdate update;
+			update.header = map.header;
+			update.x = start*tile;
+			update.y = ty*tile;
+			update.width = std::min(tx*tile, width) - update.x;
+			update.height = std::min((ty+1)*tile, height) - update.y;
+			update.data.resize(update.width * update.height);
+			for(unsigned int y=0; y<update.height; ++y)
+			{
+				int index = (update.y+y)*width + update.x;
+				memcpy(&update.data[y*update.width], &map.data[index], update.width);
+				memcpy(&last.data[index], &map.data[index], update.width);
+			}
+			updatesPub.publish(update);
+			++patches;
 		}
-		gridMaps_.clear();
-		gridMapsViewpoints_.clear();
 	}
+	last.header = map.header;
+	lastPoses = poses;
+
+	ROS_DEBUG("Published %d/%d tiles of %s in %d patches", dirtyCount, tilesX*tilesY, gridPub.getTopic().c_str(), patches);
+	return true;
 }
 
 cv::Mat MapsManager::getGridMap(
@@ -0,0 +1,336 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "rtabmap_ros/MessageSynchronizer.h"
+#include <rtabmap/utilite/ULogger.h>
+
+namespace rtabmap_ros {
+
+MessageSynchronizer::MessageSynchronizer() :
+		queueSize_(10),
+		approxSync_(true),
+		maxInterval_(0.0),
+		readyFront_(0),
+		readySize_(0),
+		nonEmpty_(0),
+		candidateStart_(0.0),
+		candidateEnd_(0.0),
+		pivot_(-1),
+		pivotTime_(0.0)
+{
+}
+
+void MessageSynchronizer::init(int topics, int queueSize, bool approxSync, double maxInterval)
+{
+	UASSERT(topics >= 1);
+	queues_.resize(topics);
+	matches_.resize(topics);
+	queueSize_ = queueSize>0?queueSize:1;
+	approxSync_ = approxSync;
+	maxInterval_ = maxInterval;
+	ready_.assign(queueSize_, std::vector<Entry>(topics));
+	candidate_.reserve(topics);
+	clear();
+}
+
+void MessageSynchronizer::clear()
+{
+	for(size_t i=0; i<queues_.size(); ++i)
+	{
+		queues_[i] = Queue();
+	}
+	for(size_t i=0; i<ready_.size(); ++i)
+	{
+		ready_[i].assign(ready_[i].size(), Entry());
+	}
+	readyFront_ = 0;
+	readySize_ = 0;
+	nonEmpty_ = 0;
+	candidate_.clear();
+	pivot_ = -1;
+}
+
+bool MessageSynchronizer::add(int topic, double stamp, const MessagePtr & msg)
+{
+	UASSERT(topic >= 0 && topic < (int)queues_.size());
+	Queue & queue = queues_[topic];
+	if(stamp <= queue.lastStamp)
+	{
+		// out of order or duplicated
+		return false;
+	}
+	queue.lastStamp = stamp;
+	queue.msgs.push_back(Entry(stamp, msg));
+
+	if(!approxSync_)
+	{
+		bool full = (int)queue.msgs.size() > queueSize_;
+		if(full)
+		{
+			queue.msgs.pop_front();
+		}
+		exactProcess();
+		return !full;
+	}
+
+	if(queue.msgs.size() == 1 && ++nonEmpty_ == (int)queues_.size())
+	{
+		approxProcess();
+	}
+	if((int)(queue.msgs.size() + queue.past.size()) > queueSize_)
+	{
+		// Cancel the candidate search and drop the oldest message of the topic
+		nonEmpty_ = 0;
+		for(size_t i=0; i<queues_.size(); ++i)
+		{
+			recover(i);
+		}
+		UASSERT(queue.msgs.size() > 1);
+		queue.msgs.pop_front();
+		queue.dropped = true;
+		if(pivot_ >= 0)
+		{
+			candidate_.clear();
+			pivot_ = -1;
+			approxProcess();
+		}
+		return false;
+	}
+	return true;
+}
+
+bool MessageSynchronizer::pop(std::vector<MessagePtr> & msgs, std::vector<double> & stamps)
+{
+	if(readySize_ == 0)
+	{
+		return false;
+	}
+	std::vector<Entry> & set = ready_[readyFront_];
+	msgs.resize(set.size());
+	stamps.resize(set.size());
+	for(size_t i=0; i<set.size(); ++i)
+	{
+		msgs[i] = set[i].msg;
+		stamps[i] = set[i].stamp;
+		set[i].msg.reset(); // the slot is reused
+	}
+	readyFront_ = (readyFront_+1) % ready_.size();
+	--readySize_;
+	return true;
+}
+
+std::vector<MessageSynchronizer::Entry> & MessageSynchronizer::pushReady()
+{
+	UASSERT(!ready_.empty());
+	if(readySize_ == ready_.size())
+	{
+		UWARN("Synchronized sets are not taken fast enough, dropping the oldest one.");
+		readyFront_ = (readyFront_+1) % ready_.size();
+		--readySize_;
+	}
+	std::vector<Entry> & set = ready_[(readyFront_+readySize_) % ready_.size()];
+	++readySize_;
+	return set;
+}
+
+void MessageSynchronizer::exactProcess()
+{
+	// Oldest stamp received on all topics, older messages cannot be matched anymore
+	bool found = true;
+	while(found)
+	{
+		found = false;
+		const std::deque<Entry> & first = queues_[0].msgs;
+		for(size_t j=0; j<first.size() && !found; ++j)
+		{
+			matches_[0] = j;
+			found = true;
+			for(size_t i=1; i<queues_.size() && found; ++i)
+			{
+				found = false;
+				const std::deque<Entry> & msgs = queues_[i].msgs;
+				for(size_t k=0; k<msgs.size() && msgs[k].stamp <= first[j].stamp && !found; ++k)
+				{
+					if(msgs[k].stamp == first[j].stamp)
+					{
+						matches_[i] = k;
+						found = true;
+					}
+				}
+			}
+		}
+		if(found)
+		{
+			std::vector<Entry> & set = pushReady();
+			for(size_t i=0; i<queues_.size(); ++i)
+			{
+				std::deque<Entry> & msgs = queues_[i].msgs;
+				set[i] = msgs[matches_[i]];
+				msgs.erase(msgs.begin(), msgs.begin()+matches_[i]+1);
+			}
+		}
+	}
+}
+
+void MessageSynchronizer::approxProcess()
+{
+	while(nonEmpty_ == (int)queues_.size())
+	{
+		int start = 0;
+		int end = 0;
+		double startTime = queues_[0].msgs.front().stamp;
+		double endTime = startTime;
+		for(size_t i=1; i<queues_.size(); ++i)
+		{
+			double stamp = queues_[i].msgs.front().stamp;
+			if(stamp < startTime)
+			{
+				startTime = stamp;
+				start = i;
+			}
+			if(stamp >= endTime)
+			{
+				endTime = stamp;
+				end = i;
+			}
+		}
+		for(size_t i=0; i<queues_.size(); ++i)
+		{
+			if((int)i != end)
+			{
+				queues_[i].dropped = false;
+			}
+		}
+
+		if(pivot_ < 0)
+		{
+			if((maxInterval_ > 0.0 && endTime - startTime > maxInterval_) ||
+			   queues_[end].dropped)
+			{
+				// the oldest message cannot be in a set
+				deleteFront(start);
+				continue;
+			}
+			makeCandidate();
+			candidateStart_ = startTime;
+			candidateEnd_ = endTime;
+			pivot_ = end;
+			pivotTime_ = endTime;
+		}
+		else if(endTime - candidateEnd_ < startTime - candidateStart_)
+		{
+			// smaller interval than the current candidate
+			makeCandidate();
+			candidateStart_ = startTime;
+			candidateEnd_ = endTime;
+		}
+		moveFrontToPast(start);
+
+		if(start == pivot_ ||
+		   endTime - candidateEnd_ >= pivotTime_ - candidateStart_)
+		{
+			// all messages after the pivot have been tried or they can
+			// only make sets with larger intervals
+			publishCandidate();
+		}
+	}
+}
+
+void MessageSynchronizer::recover(int topic)
+{
+	Queue & queue = queues_[topic];
+	while(!queue.past.empty())
+	{
+		queue.msgs.push_front(queue.past.back());
+		queue.past.pop_back();
+	}
+	if(!queue.msgs.empty())
+	{
+		++nonEmpty_;
+	}
+}
+
+void MessageSynchronizer::deleteFront(int topic)
+{
+	Queue & queue = queues_[topic];
+	queue.msgs.pop_front();
+	if(queue.msgs.empty())
+	{
+		--nonEmpty_;
+	}
+}
+
+void MessageSynchronizer::moveFrontToPast(int topic)
+{
+	Queue & queue = queues_[topic];
+	queue.past.push_back(queue.msgs.front());
+	queue.msgs.pop_front();
+	if(queue.msgs.empty())
+	{
+		--nonEmpty_;
+	}
+}
+
+void MessageSynchronizer::makeCandidate()
+{
+	candidate_.resize(queues_.size());
+	for(size_t i=0; i<queues_.size(); ++i)
+	{
+		candidate_[i] = queues_[i].msgs.front();
+		// older messages cannot make a better candidate
+		queues_[i].past.clear();
+	}
+}
+
+void MessageSynchronizer::publishCandidate()
+{
+	// same size, copied without allocation
+	pushReady() = candidate_;
+	candidate_.clear();
+	pivot_ = -1;
+
+	// Recover the messages moved out during the search, without the ones of the candidate
+	nonEmpty_ = 0;
+	for(size_t i=0; i<queues_.size(); ++i)
+	{
+		Queue & queue = queues_[i];
+		while(!queue.past.empty())
+		{
+			queue.msgs.push_front(queue.past.back());
+			queue.past.pop_back();
+		}
+		UASSERT(!queue.msgs.empty());
+		queue.msgs.pop_front();
+		if(!queue.msgs.empty())
+		{
+			++nonEmpty_;
+		}
+	}
+}
+
+} /* namespace rtabmap_ros */
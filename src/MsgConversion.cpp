@@ -26,15 +26,22 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "rtabmap_ros/MsgConversion.h"
+#include "rtabmap_ros/StaticTransformCache.h"
+#include "rtabmap_ros/ImageBufferPool.h"
 
 #include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/core/core.hpp>
 #include <zlib.h>
+#include <limits>
+#include <boost/thread.hpp>
 #include <ros/ros.h>
 #include <rtabmap/core/util3d.h>
 #include <rtabmap/core/util3d_transforms.h>
 #include <rtabmap/core/util3d_filtering.h>
 #include <rtabmap/core/Compression.h>
 #include <rtabmap/utilite/UStl.h>
+#include <rtabmap/utilite/UConversion.h>
 #include <rtabmap/utilite/ULogger.h>
 #include <pcl_conversions/pcl_conversions.h>
 #include <eigen_conversions/eigen_msg.h>
@@ -154,14 +161,14 @@ void toCvCopy(const rtabmap_ros::RGBDImage & image, cv_bridge::CvImagePtr & rgb,
 	{
 		cv_bridge::CvImagePtr ptr = boost::make_shared<cv_bridge::CvImage>();
 		ptr->header = image.depth_compressed.header;
-		ptr->image = rtabmap::uncompressImage(image.depth_compressed.data);
+		ptr->image = depthFromCompressedMsg(image.depth_compressed);
 		ROS_ASSERT(ptr->image.empty() || ptr->image.type() == CV_32FC1 || ptr->image.type() == CV_16UC1);
 		ptr->encoding = ptr->image.empty()?"":ptr->image.type() == CV_32FC1?sensor_msgs::image_encodings::TYPE_32FC1:sensor_msgs::image_encodings::TYPE_16UC1;
 		depth = ptr;
 	}
 }
 
-void toCvShare(const rtabmap_ros::RGBDImageConstPtr & image, cv_bridge::CvImageConstPtr & rgb, cv_bridge::CvImageConstPtr & depth)
+static void rgbToCvShare(const rtabmap_ros::RGBDImageConstPtr & image, cv_bridge::CvImageConstPtr & rgb)
 {
 	if(!image->rgb.data.empty())
 	{
@@ -175,7 +182,10 @@ void toCvShare(const rtabmap_ros::RGBDImageConstPtr & image, cv_bridge::CvImageC
 		rgb = cv_bridge::toCvCopy(image->rgb_compressed);
 #endif
 	}
+}
 
+static void depthToCvShare(const rtabmap_ros::RGBDImageConstPtr & image, cv_bridge::CvImageConstPtr & depth)
+{
 	if(!image->depth.data.empty())
 	{
 		depth = cv_bridge::toCvShare(image->depth, image);
@@ -194,7 +204,7 @@ void toCvShare(const rtabmap_ros::RGBDImageConstPtr & image, cv_bridge::CvImageC
 		{
 			cv_bridge::CvImagePtr ptr = boost::make_shared<cv_bridge::CvImage>();
 			ptr->header = image->depth_compressed.header;
-			ptr->image = rtabmap::uncompressImage(image->depth_compressed.data);
+			ptr->image = depthFromCompressedMsg(image->depth_compressed);
 			ROS_ASSERT(ptr->image.empty() || ptr->image.type() == CV_32FC1 || ptr->image.type() == CV_16UC1);
 			ptr->encoding = ptr->image.empty()?"":ptr->image.type() == CV_32FC1?sensor_msgs::image_encodings::TYPE_32FC1:sensor_msgs::image_encodings::TYPE_16UC1;
 			depth = ptr;
@@ -202,6 +212,92 @@ void toCvShare(const rtabmap_ros::RGBDImageConstPtr & image, cv_bridge::CvImageC
 	}
 }
 
+// Decode job j: rgb of image j/2 if j is even, otherwise its depth
+class RGBDImagesDecoder : public cv::ParallelLoopBody
+{
+public:
+	RGBDImagesDecoder(
+			const std::vector<rtabmap_ros::RGBDImageConstPtr> & images,
+			const std::vector<int> & jobs,
+			std::vector<cv_bridge::CvImageConstPtr> & rgbs,
+			std::vector<cv_bridge::CvImageConstPtr> & depths) :
+		images_(images),
+		jobs_(jobs),
+		rgbs_(rgbs),
+		depths_(depths)
+	{}
+	virtual void operator()(const cv::Range & range) const
+	{
+		for(int i=range.start; i<range.end; ++i)
+		{
+			int j = jobs_[i];
+			if(j%2 == 0)
+			{
+				rgbToCvShare(images_[j/2], rgbs_[j/2]);
+			}
+			else
+			{
+				depthToCvShare(images_[j/2], depths_[j/2]);
+			}
+		}
+	}
+private:
+	const std::vector<rtabmap_ros::RGBDImageConstPtr> & images_;
+	const std::vector<int> & jobs_;
+	std::vector<cv_bridge::CvImageConstPtr> & rgbs_;
+	std::vector<cv_bridge::CvImageConstPtr> & depths_;
+};
+
+void toCvShare(const rtabmap_ros::RGBDImageConstPtr & image, cv_bridge::CvImageConstPtr & rgb, cv_bridge::CvImageConstPtr & depth)
+{
+	std::vector<cv_bridge::CvImageConstPtr> rgbs(1);
+	std::vector<cv_bridge::CvImageConstPtr> depths(1);
+	toCvShare(std::vector<rtabmap_ros::RGBDImageConstPtr>(1, image), rgbs, depths);
+	rgb = rgbs[0];
+	depth = depths[0];
+}
+
+void toCvShare(
+		const std::vector<rtabmap_ros::RGBDImageConstPtr> & images,
+		std::vector<cv_bridge::CvImageConstPtr> & rgbs,
+		std::vector<cv_bridge::CvImageConstPtr> & depths)
+{
+	rgbs.resize(images.size());
+	depths.resize(images.size());
+
+	// Raw images are shared directly, compressed images are decoded in parallel
+	std::vector<int> jobs;
+	for(size_t i=0; i<images.size(); ++i)
+	{
+		if(images[i]->rgb.data.empty() && !images[i]->rgb_compressed.data.empty())
+		{
+			jobs.push_back(i*2);
+		}
+		else
+		{
+			rgbToCvShare(images[i], rgbs[i]);
+		}
+		if(images[i]->depth.data.empty() && !images[i]->depth_compressed.data.empty())
+		{
+			jobs.push_back(i*2+1);
+		}
+		else
+		{
+			depthToCvShare(images[i], depths[i]);
+		}
+	}
+
+	RGBDImagesDecoder decoder(images, jobs, rgbs, depths);
+	if(jobs.size() > 1)
+	{
+		cv::parallel_for_(cv::Range(0, jobs.size()), decoder);
+	}
+	else
+	{
+		decoder(cv::Range(0, jobs.size()));
+	}
+}
+
 void rgbdImageToROS(const rtabmap::SensorData & data, rtabmap_ros::RGBDImage & msg, const std::string & sensorFrameId)
 {
 	std_msgs::Header header;
@@ -423,14 +519,269 @@ rtabmap::SensorData rgbdImageFromROS(const rtabmap_ros::RGBDImageConstPtr & imag
 	return data;
 }
 
+// RVL depth codec (A. D. Wilson, "Fast Lossless Depth Image Compression", 2017):
+// runs of zeros/non-zeros, then zigzag deltas between consecutive valid
+// pixels, all coded with variable-length nibbles packed in 32 bits words.
+// Header: magic, version, endianness mark, rows, cols. Words are saved in
+// the byte order of the encoder, the mark rejects data from another order.
+// Zero runs are split every kRVLMaxZeros pixels, so that a pixel count
+// larger than kRVLMaxPixelsPerNibble per nibble of data cannot be valid,
+// the declared size is checked against it before allocating the image.
+static const char kRVLMagic[4] = {'R','V','L','D'};
+static const unsigned int kRVLVersion = 1;
+static const unsigned int kRVLEndianness = 0x01020304;
+static const size_t kRVLHeaderWords = 5;
+static const unsigned int kRVLMaxZeros = 511; // 3 nibbles
+static const unsigned long long kRVLMaxPixelsPerNibble = (kRVLMaxZeros+1)/2; // zeros + non-zeros counts are 2 nibbles at least
+
+class RVLEncoder
+{
+public:
+	RVLEncoder(std::vector<unsigned int> & words) : words_(words), word_(0), nibbles_(0) {}
+	void encode(unsigned int value)
+	{
+		do
+		{
+			unsigned int nibble = value & 0x7;
+			value >>= 3;
+			if(value)
+			{
+				nibble |= 0x8;
+			}
+			word_ = (word_ << 4) | nibble;
+			if(++nibbles_ == 8)
+			{
+				words_.push_back(word_);
+				nibbles_ = 0;
+				word_ = 0;
+			}
+		}
+		while(value);
+	}
+	void flush()
+	{
+		if(nibbles_)
+		{
+			words_.push_back(word_ << 4 * (8 - nibbles_));
+			nibbles_ = 0;
+			word_ = 0;
+		}
+	}
+private:
+	std::vector<unsigned int> & words_;
+	unsigned int word_;
+	int nibbles_;
+};
+
+class RVLDecoder
+{
+public:
+	RVLDecoder(const unsigned int * words, size_t size) : words_(words), end_(words+size), word_(0), nibbles_(0) {}
+	bool decode(unsigned int & value)
+	{
+		value = 0;
+		int bits = 29;
+		unsigned int nibble;
+		do
+		{
+			if(bits < 0)
+			{
+				// more than 30 bits, not a valid value
+				return false;
+			}
+			if(!nibbles_)
+			{
+				if(words_ == end_)
+				{
+					return false;
+				}
+				word_ = *words_++;
+				nibbles_ = 8;
+			}
+			nibble = word_ & 0xf0000000;
+			value |= (nibble << 1) >> bits;
+			word_ <<= 4;
+			--nibbles_;
+			bits -= 3;
+		}
+		while(nibble & 0x80000000);
+		return true;
+	}
+private:
+	const unsigned int * words_;
+	const unsigned int * end_;
+	unsigned int word_;
+	int nibbles_;
+};
+
+std::vector<unsigned char> compressDepthRVL(const cv::Mat & depth)
+{
+	std::vector<unsigned char> bytes;
+	if(depth.empty())
+	{
+		return bytes;
+	}
+	UASSERT_MSG(depth.type() == CV_16UC1, "RVL compression supports only 16UC1 depth images");
+
+	std::vector<unsigned int> words;
+	words.reserve(kRVLHeaderWords + depth.total()/4);
+	unsigned int magic;
+	memcpy(&magic, kRVLMagic, sizeof(magic));
+	words.push_back(magic);
+	words.push_back(kRVLVersion);
+	words.push_back(kRVLEndianness);
+	words.push_back(depth.rows);
+	words.push_back(depth.cols);
+
+	RVLEncoder encoder(words);
+	int previous = 0;
+	for(int y=0; y<depth.rows; ++y)
+	{
+		const unsigned short * p = depth.ptr<unsigned short>(y);
+		const unsigned short * end = p + depth.cols;
+		// runs stop at the end of each row
+		while(p != end)
+		{
+			unsigned int zeros = 0;
+			for(; p != end && *p == 0 && zeros < kRVLMaxZeros; ++p, ++zeros);
+			encoder.encode(zeros);
+			unsigned int nonzeros = 0;
+			for(const unsigned short * q=p; q != end && *q != 0; ++q, ++nonzeros);
+			encoder.encode(nonzeros);
+			for(unsigned int i=0; i<nonzeros; ++i, ++p)
+			{
+				int delta = int(*p) - previous;
+				encoder.encode((unsigned int)((delta << 1) ^ (delta >> 31)));
+				previous = *p;
+			}
+		}
+	}
+	encoder.flush();
+
+	bytes.resize(words.size()*sizeof(unsigned int));
+	memcpy(&bytes[0], &words[0], bytes.size());
+	return bytes;
+}
+
+cv::Mat uncompressDepthRVL(const std::vector<unsigned char> & bytes)
+{
+	size_t size = bytes.size() / sizeof(unsigned int);
+	if(size < kRVLHeaderWords)
+	{
+		if(!bytes.empty())
+		{
+			UERROR("Invalid RVL depth image (%d bytes, header is %d bytes)", (int)bytes.size(), int(kRVLHeaderWords*sizeof(unsigned int)));
+		}
+		return cv::Mat();
+	}
+	std::vector<unsigned int> words(size);
+	memcpy(&words[0], &bytes[0], size*sizeof(unsigned int));
+	if(memcmp(&words[0], kRVLMagic, sizeof(kRVLMagic)) != 0)
+	{
+		UERROR("Invalid RVL depth image (wrong magic number)");
+		return cv::Mat();
+	}
+	if(words[2] != kRVLEndianness)
+	{
+		UERROR("RVL depth image has been compressed on a machine with a different byte order, it cannot be decoded");
+		return cv::Mat();
+	}
+	if(words[1] != kRVLVersion)
+	{
+		UERROR("RVL depth image version %u is not supported (version %u expected)", words[1], kRVLVersion);
+		return cv::Mat();
+	}
+	int rows = words[3];
+	int cols = words[4];
+	if(rows <= 0 || cols <= 0)
+	{
+		UERROR("Invalid RVL depth image (%dx%d)", cols, rows);
+		return cv::Mat();
+	}
+	if((unsigned long long)rows * (unsigned long long)cols > (unsigned long long)(size-kRVLHeaderWords) * 8ull * kRVLMaxPixelsPerNibble)
+	{
+		UERROR("Corrupted RVL depth image (%dx%d declared for %d bytes of data)", cols, rows, int((size-kRVLHeaderWords)*sizeof(unsigned int)));
+		return cv::Mat();
+	}
+
+	cv::Mat depth(rows, cols, CV_16UC1);
+	unsigned short * p = depth.ptr<unsigned short>();
+	unsigned short * end = p + depth.total();
+	RVLDecoder decoder(&words[0]+kRVLHeaderWords, size-kRVLHeaderWords);
+	int previous = 0;
+	while(p != end)
+	{
+		unsigned int zeros, nonzeros;
+		if(!decoder.decode(zeros) || zeros > (unsigned int)(end-p))
+		{
+			break;
+		}
+		for(; zeros; --zeros)
+		{
+			*p++ = 0;
+		}
+		if(!decoder.decode(nonzeros) || nonzeros > (unsigned int)(end-p))
+		{
+			break;
+		}
+		for(; nonzeros; --nonzeros)
+		{
+			unsigned int positive;
+			if(!decoder.decode(positive))
+			{
+				break;
+			}
+			int delta = int(positive >> 1) ^ -int(positive & 1);
+			previous += delta;
+			*p++ = (unsigned short)previous;
+		}
+	}
+	if(p != end)
+	{
+		UERROR("Corrupted RVL depth image (%dx%d, %d pixels decoded)", cols, rows, int(p - depth.ptr<unsigned short>()));
+		return cv::Mat();
+	}
+	return depth;
+}
+
+void depthToCompressedMsg(const cv::Mat & depth, const std::string & format, sensor_msgs::CompressedImage & msg)
+{
+	if(format.compare("rvl") == 0 && depth.type() == CV_16UC1)
+	{
+		msg.data = compressDepthRVL(depth);
+		msg.format = "rvl";
+	}
+	else
+	{
+		if(format.compare("png") != 0 && format.compare("rvl") != 0)
+		{
+			ROS_WARN("Unknown depth compression format \"%s\", png is used.", format.c_str());
+		}
+		msg.data = rtabmap::compressImage(depth, ".png");
+		msg.format = "png";
+	}
+}
+
+cv::Mat depthFromCompressedMsg(const sensor_msgs::CompressedImage & msg)
+{
+	if(msg.format.compare("rvl") == 0)
+	{
+		return uncompressDepthRVL(msg.data);
+	}
+	return rtabmap::uncompressImage(msg.data);
+}
+
 void compressedMatToBytes(const cv::Mat & compressed, std::vector<unsigned char> & bytes)
 {
 	UASSERT(compressed.empty() || compressed.type() == CV_8UC1);
-	bytes.clear();
 	if(!compressed.empty())
 	{
-		bytes.resize(compressed.cols * compressed.rows);
-		memcpy(bytes.data(), compressed.data, bytes.size());
+		// single pass copy, resize() would zero-fill the buffer before
+		bytes.assign(compressed.data, compressed.data + compressed.total());
+	}
+	else
+	{
+		bytes.clear();
 	}
 }
 
@@ -448,6 +799,125 @@ cv::Mat compressedMatFromBytes(const std::vector<unsigned char> & bytes, bool co
 	return out;
 }
 
+#if CV_MAJOR_VERSION > 2
+// Allocator of matrices referencing the buffer of a message: the buffer is
+// never freed by OpenCV, only the reference on its owner is released when
+// the last matrix using it is destroyed.
+class SharedBufferAllocator : public cv::MatAllocator
+{
+public:
+	static SharedBufferAllocator * instance()
+	{
+		static SharedBufferAllocator allocator;
+		return &allocator;
+	}
+
+	cv::Mat wrap(const std::vector<unsigned char> & bytes, const boost::shared_ptr<const void> & owner) const
+	{
+		cv::UMatData * u = new cv::UMatData(this);
+		u->data = u->origdata = (uchar*)&bytes[0];
+		u->size = bytes.size();
+		u->flags |= cv::UMatData::USER_ALLOCATED;
+		u->userdata = new boost::shared_ptr<const void>(owner);
+
+		cv::Mat m(1, (int)bytes.size(), CV_8UC1, u->data);
+		m.u = u;
+		u->currAllocator = this;
+		u->refcount = 1;
+		return m;
+	}
+
+	// New allocations (e.g., clone()) use the default allocator
+#if CV_MAJOR_VERSION > 3
+	cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, cv::AccessFlag flags, cv::UMatUsageFlags usage) const
+#else
+	cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, int flags, cv::UMatUsageFlags usage) const
+#endif
+	{
+		return cv::Mat::getDefaultAllocator()->allocate(dims, sizes, type, data, step, flags, usage);
+	}
+#if CV_MAJOR_VERSION > 3
+	bool allocate(cv::UMatData* data, cv::AccessFlag accessflags, cv::UMatUsageFlags usage) const
+#else
+	bool allocate(cv::UMatData* data, int accessflags, cv::UMatUsageFlags usage) const
+#endif
+	{
+		return cv::Mat::getDefaultAllocator()->allocate(data, accessflags, usage);
+	}
+	void deallocate(cv::UMatData* u) const
+	{
+		if(u)
+		{
+			UASSERT(u->urefcount == 0 && u->refcount == 0);
+			delete (boost::shared_ptr<const void>*)u->userdata;
+			delete u;
+		}
+	}
+};
+#endif
+
+cv::Mat compressedMatFromBytes(const std::vector<unsigned char> & bytes, const boost::shared_ptr<const void> & owner)
+{
+	cv::Mat out;
+	if(bytes.size())
+	{
+#if CV_MAJOR_VERSION > 2
+		if(owner.get())
+		{
+			out = SharedBufferAllocator::instance()->wrap(bytes, owner);
+		}
+		else
+#endif
+		{
+			out = compressedMatFromBytes(bytes, true);
+		}
+	}
+	return out;
+}
+
+cv::Mat compressedRgbForSensorData(const rtabmap_ros::RGBDImageConstPtr & image)
+{
+	if(image.get() == 0 || image->rgb_compressed.data.empty())
+	{
+		return cv::Mat();
+	}
+	// "jpg", "png" or "bgr8; jpeg compressed bgr8" formats, 16 bits
+	// and non-bgr color images are decoded
+	std::string format = uToLowerCase(image->rgb_compressed.format);
+	std::string encoding;
+	size_t sep = format.find(';');
+	if(sep != std::string::npos)
+	{
+		encoding = format.substr(0, sep);
+		format = format.substr(sep+1);
+	}
+	bool compatible = format.find("jpeg") != std::string::npos ||
+			format.find("jpg") != std::string::npos ||
+			format.find("png") != std::string::npos;
+	if(compatible && !encoding.empty())
+	{
+		compatible = encoding.compare(sensor_msgs::image_encodings::BGR8) == 0 ||
+				encoding.compare(sensor_msgs::image_encodings::MONO8) == 0;
+	}
+	if(compatible && format.find("16") != std::string::npos)
+	{
+		compatible = false;
+	}
+	return compatible?compressedMatFromBytes(image->rgb_compressed.data, image):cv::Mat();
+}
+
+cv::Mat compressedDepthForSensorData(const rtabmap_ros::RGBDImageConstPtr & image)
+{
+	if(image.get() &&
+	   !image->depth_compressed.data.empty() &&
+	   image->depth_compressed.format.compare("png") == 0)
+	{
+		// from depthToCompressedMsg(), already rtabmap::compressImage()'s format
+		return compressedMatFromBytes(image->depth_compressed.data, image);
+	}
+	return cv::Mat();
+}
+
 void infoFromROS(const rtabmap_ros::Info & info, rtabmap::Statistics & stat)
 {
 	stat.setExtended(true); // Extended
@@ -608,6 +1078,91 @@ void keypointsToROS(const std::vector<cv::KeyPoint> & kpts, std::vector<rtabmap_
 	}
 }
 
+// Packed keypoint: x, y, size, angle, response (float32), octave, class_id (int32)
+#define KEYPOINT_PACKED_SIZE 28
+
+void keypointsToBytes(const std::vector<cv::KeyPoint> & kpts, std::vector<unsigned char> & bytes, bool compress)
+{
+	bytes.clear();
+	if(kpts.empty())
+	{
+		return;
+	}
+	std::vector<unsigned char> packed(kpts.size()*KEYPOINT_PACKED_SIZE);
+	if(sizeof(cv::KeyPoint) == KEYPOINT_PACKED_SIZE)
+	{
+		// same memory layout, single copy
+		memcpy(&packed[0], &kpts[0], packed.size());
+	}
+	else
+	{
+		unsigned char * p = &packed[0];
+		for(size_t i=0; i<kpts.size(); ++i, p+=KEYPOINT_PACKED_SIZE)
+		{
+			const cv::KeyPoint & kpt = kpts[i];
+			memcpy(p, &kpt.pt.x, 4);
+			memcpy(p+4, &kpt.pt.y, 4);
+			memcpy(p+8, &kpt.size, 4);
+			memcpy(p+12, &kpt.angle, 4);
+			memcpy(p+16, &kpt.response, 4);
+			memcpy(p+20, &kpt.octave, 4);
+			memcpy(p+24, &kpt.class_id, 4);
+		}
+	}
+	if(compress)
+	{
+		bytes = rtabmap::compressData(cv::Mat(1, (int)packed.size(), CV_8UC1, &packed[0]));
+	}
+	else
+	{
+		bytes.swap(packed);
+	}
+}
+
+std::vector<cv::KeyPoint> keypointsFromBytes(const std::vector<unsigned char> & bytes, bool compressed)
+{
+	std::vector<cv::KeyPoint> kpts;
+	cv::Mat uncompressed;
+	const unsigned char * data = bytes.empty()?0:&bytes[0];
+	size_t size = bytes.size();
+	if(compressed && size)
+	{
+		uncompressed = rtabmap::uncompressData(bytes);
+		data = uncompressed.data;
+		size = uncompressed.total()*uncompressed.elemSize();
+	}
+	if(size % KEYPOINT_PACKED_SIZE != 0)
+	{
+		ROS_ERROR("Packed keypoints size (%d) is not a multiple of %d!", (int)size, KEYPOINT_PACKED_SIZE);
+		return kpts;
+	}
+	kpts.resize(size/KEYPOINT_PACKED_SIZE);
+	if(kpts.empty())
+	{
+		return kpts;
+	}
+	if(sizeof(cv::KeyPoint) == KEYPOINT_PACKED_SIZE)
+	{
+		memcpy(&kpts[0], data, size);
+	}
+	else
+	{
+		const unsigned char * p = data;
+		for(size_t i=0; i<kpts.size(); ++i, p+=KEYPOINT_PACKED_SIZE)
+		{
+			cv::KeyPoint & kpt = kpts[i];
+			memcpy(&kpt.pt.x, p, 4);
+			memcpy(&kpt.pt.y, p+4, 4);
+			memcpy(&kpt.size, p+8, 4);
+			memcpy(&kpt.angle, p+12, 4);
+			memcpy(&kpt.response, p+16, 4);
+			memcpy(&kpt.octave, p+20, 4);
+			memcpy(&kpt.class_id, p+24, 4);
+		}
+	}
+	return kpts;
+}
+
 rtabmap::GlobalDescriptor globalDescriptorFromROS(const rtabmap_ros::GlobalDescriptor & msg)
 {
 	return rtabmap::GlobalDescriptor(msg.type, rtabmap::uncompressData(msg.data), rtabmap::uncompressData(msg.info));
@@ -777,6 +1332,50 @@ void points3fToROS(const std::vector<cv::Point3f> & pts, std::vector<rtabmap_ros
 	}
 }
 
+void points3fToBytes(const std::vector<cv::Point3f> & pts, std::vector<unsigned char> & bytes, bool compress)
+{
+	bytes.clear();
+	if(pts.empty())
+	{
+		return;
+	}
+	// cv::Point3f is 3 contiguous floats
+	if(compress)
+	{
+		bytes = rtabmap::compressData(cv::Mat(1, (int)pts.size()*3, CV_32FC1, (void*)&pts[0]));
+	}
+	else
+	{
+		bytes.resize(pts.size()*sizeof(cv::Point3f));
+		memcpy(&bytes[0], &pts[0], bytes.size());
+	}
+}
+
+std::vector<cv::Point3f> points3fFromBytes(const std::vector<unsigned char> & bytes, bool compressed)
+{
+	std::vector<cv::Point3f> pts;
+	cv::Mat uncompressed;
+	const unsigned char * data = bytes.empty()?0:&bytes[0];
+	size_t size = bytes.size();
+	if(compressed && size)
+	{
+		uncompressed = rtabmap::uncompressData(bytes);
+		data = uncompressed.data;
+		size = uncompressed.total()*uncompressed.elemSize();
+	}
+	if(size % sizeof(cv::Point3f) != 0)
+	{
+		ROS_ERROR("Packed 3D points size (%d) is not a multiple of %d!", (int)size, (int)sizeof(cv::Point3f));
+		return pts;
+	}
+	pts.resize(size/sizeof(cv::Point3f));
+	if(!pts.empty())
+	{
+		memcpy(&pts[0], data, size);
+	}
+	return pts;
+}
+
 rtabmap::CameraModel cameraModelFromROS(
 		const sensor_msgs::CameraInfo & camInfo,
 		const rtabmap::Transform & localTransform)
@@ -945,7 +1544,8 @@ void mapDataFromROS(
 		std::map<int, rtabmap::Transform> & poses,
 		std::multimap<int, rtabmap::Link> & links,
 		std::map<int, rtabmap::Signature> & signatures,
-		rtabmap::Transform & mapToOdom)
+		rtabmap::Transform & mapToOdom,
+		const boost::shared_ptr<const void> & owner)
 {
 	//optimized graph
 	mapGraphFromROS(msg.graph, poses, links, mapToOdom);
@@ -953,54 +1553,108 @@ void mapDataFromROS(
 	//Data
 	for(unsigned int i=0; i<msg.nodes.size(); ++i)
 	{
-		signatures.insert(std::make_pair(msg.nodes[i].id, nodeDataFromROS(msg.nodes[i])));
+		signatures.insert(std::make_pair(msg.nodes[i].id, nodeDataFromROS(msg.nodes[i], owner)));
+	}
+}
+void nodesDataToROS(
+		const std::vector<const rtabmap::Signature *> & signatures,
+		size_t from,
+		size_t to,
+		std::vector<rtabmap_ros::NodeData> & msgs,
+		int wordsPacking)
+{
+	for(size_t i=from; i<to; ++i)
+	{
+		nodeDataToROS(*signatures[i], msgs[i], wordsPacking);
 	}
 }
+
 void mapDataToROS(
 		const std::map<int, rtabmap::Transform> & poses,
 		const std::multimap<int, rtabmap::Link> & links,
 		const std::map<int, rtabmap::Signature> & signatures,
 		const rtabmap::Transform & mapToOdom,
-		rtabmap_ros::MapData & msg)
+		rtabmap_ros::MapData & msg,
+		int wordsPacking,
+		int graphPacking)
 {
 	//Optimized graph
-	mapGraphToROS(poses, links, mapToOdom, msg.graph);
+	mapGraphToROS(poses, links, mapToOdom, msg.graph, graphPacking);
 
 	//Data
 	msg.nodes.resize(signatures.size());
+	std::vector<const rtabmap::Signature *> signaturesPtr(signatures.size());
 	int index=0;
 	for(std::multimap<int, rtabmap::Signature>::const_iterator iter = signatures.begin();
 		iter!=signatures.end();
 		++iter)
 	{
-		nodeDataToROS(iter->second, msg.nodes[index++]);
+		signaturesPtr[index++] = &iter->second;
+	}
+
+	// Each thread fills its own range of the pre-sized nodes array
+	unsigned int threads = std::min(boost::thread::hardware_concurrency(), (unsigned int)signaturesPtr.size()/10);
+	if(threads > 1)
+	{
+		boost::thread_group group;
+		size_t step = signaturesPtr.size() / threads;
+		for(unsigned int i=0; i<threads; ++i)
+		{
+			size_t from = i*step;
+			size_t to = i==threads-1?signaturesPtr.size():from+step;
+			group.create_thread(boost::bind(&nodesDataToROS, boost::cref(signaturesPtr), from, to, boost::ref(msg.nodes), wordsPacking));
+		}
+		group.join_all();
+	}
+	else
+	{
+		nodesDataToROS(signaturesPtr, 0, signaturesPtr.size(), msg.nodes, wordsPacking);
 	}
 }
 
-void mapGraphFromROS(
+bool mapGraphFromROS(
 		const rtabmap_ros::MapGraph & msg,
 		std::map<int, rtabmap::Transform> & poses,
 		std::multimap<int, rtabmap::Link> & links,
 		rtabmap::Transform & mapToOdom)
 {
-	//optimized graph
-	UASSERT(msg.posesId.size() == msg.poses.size());
-	for(unsigned int i=0; i<msg.posesId.size(); ++i)
+	std::vector<int> unpackedPosesId;
+	std::vector<geometry_msgs::Pose> unpackedPoses;
+	std::vector<rtabmap_ros::Link> unpackedLinks;
+	const std::vector<int> * posesId = &msg.posesId;
+	const std::vector<geometry_msgs::Pose> * posesMsg = &msg.poses;
+	const std::vector<rtabmap_ros::Link> * linksMsg = &msg.links;
+	if(mapGraphIsPacked(msg))
 	{
-		poses.insert(std::make_pair(msg.posesId[i], rtabmap_ros::transformFromPoseMsg(msg.poses[i])));
+		if(!mapGraphUnpack(msg, unpackedPosesId, unpackedPoses, unpackedLinks))
+		{
+			ROS_ERROR("Packed graph is malformed, it is ignored.");
+			return false;
+		}
+		posesId = &unpackedPosesId;
+		posesMsg = &unpackedPoses;
+		linksMsg = &unpackedLinks;
 	}
-	for(unsigned int i=0; i<msg.links.size(); ++i)
+
+	//optimized graph
+	UASSERT(posesId->size() == posesMsg->size());
+	for(unsigned int i=0; i<posesId->size(); ++i)
+	{
+		poses.insert(std::make_pair(posesId->at(i), rtabmap_ros::transformFromPoseMsg(posesMsg->at(i))));
+	}
+	for(unsigned int i=0; i<linksMsg->size(); ++i)
 	{
-		rtabmap::Transform t = rtabmap_ros::transformFromGeometryMsg(msg.links[i].transform);
-		links.insert(std::make_pair(msg.links[i].fromId, linkFromROS(msg.links[i])));
+		links.insert(std::make_pair(linksMsg->at(i).fromId, linkFromROS(linksMsg->at(i))));
 	}
 	mapToOdom = transformFromGeometryMsg(msg.mapToOdom);
+	return true;
 }
 void mapGraphToROS(
 		const std::map<int, rtabmap::Transform> & poses,
 		const std::multimap<int, rtabmap::Link> & links,
 		const rtabmap::Transform & mapToOdom,
-		rtabmap_ros::MapGraph & msg)
+		rtabmap_ros::MapGraph & msg,
+		int graphPacking)
 {
 	//Optimized graph
 	msg.posesId.resize(poses.size());
@@ -1025,9 +1679,499 @@ void mapGraphToROS(
 	}
 
 	transformToGeometryMsg(mapToOdom, msg.mapToOdom);
+
+	if(graphPacking > 0)
+	{
+		mapGraphPack(msg, graphPacking > 1);
+	}
+}
+
+// Zigzag varint, small deltas (consecutive ids) take a single byte
+static void packVarint(int value, std::vector<unsigned char> & bytes)
+{
+	unsigned int v = ((unsigned int)value << 1) ^ (unsigned int)(value >> 31);
+	while(v >= 0x80)
+	{
+		bytes.push_back((unsigned char)(v | 0x80));
+		v >>= 7;
+	}
+	bytes.push_back((unsigned char)v);
+}
+
+static void packFloats(const float * values, int count, std::vector<unsigned char> & bytes)
+{
+	size_t size = bytes.size();
+	bytes.resize(size + count*sizeof(float));
+	memcpy(&bytes[size], values, count*sizeof(float));
+}
+
+// Sequential reader over a packed buffer, ok() is false after reading past the end
+class PackedReader
+{
+public:
+	PackedReader(const unsigned char * data, size_t size) : p_(data), end_(data+size), ok_(true) {}
+	bool ok() const {return ok_;}
+	bool atEnd() const {return p_ == end_;}
+	int varint()
+	{
+		unsigned int v = 0;
+		for(int shift=0; ok_ && shift<35; shift+=7)
+		{
+			if(p_ >= end_)
+			{
+				ok_ = false;
+				break;
+			}
+			unsigned char b = *p_++;
+			v |= (unsigned int)(b & 0x7F) << shift;
+			if(!(b & 0x80))
+			{
+				return (int)(v >> 1) ^ -(int)(v & 1);
+			}
+		}
+		ok_ = false;
+		return 0;
+	}
+	void read(void * values, size_t size)
+	{
+		if(ok_ && size_t(end_ - p_) >= size)
+		{
+			memcpy(values, p_, size);
+			p_ += size;
+		}
+		else
+		{
+			ok_ = false;
+			memset(values, 0, size);
+		}
+	}
+private:
+	const unsigned char * p_;
+	const unsigned char * end_;
+	bool ok_;
+};
+
+static void packTransform(const geometry_msgs::Vector3 & t, const geometry_msgs::Quaternion & q, std::vector<unsigned char> & bytes)
+{
+	float v[7] = {(float)t.x, (float)t.y, (float)t.z, (float)q.x, (float)q.y, (float)q.z, (float)q.w};
+	packFloats(v, 7, bytes);
+}
+
+static void unpackTransform(PackedReader & reader, geometry_msgs::Vector3 & t, geometry_msgs::Quaternion & q)
+{
+	float v[7];
+	reader.read(v, sizeof(v));
+	t.x = v[0]; t.y = v[1]; t.z = v[2];
+	q.x = v[3]; q.y = v[4]; q.z = v[5]; q.w = v[6];
+}
+
+static void finalizePacked(std::vector<unsigned char> & packed, std::vector<unsigned char> & bytes, bool compress)
+{
+	if(compress && !packed.empty())
+	{
+		bytes = rtabmap::compressData(cv::Mat(1, (int)packed.size(), CV_8UC1, &packed[0]));
+	}
+	else
+	{
+		bytes.swap(packed);
+	}
 }
 
-rtabmap::Signature nodeDataFromROS(const rtabmap_ros::NodeData & msg)
+void mapGraphPack(rtabmap_ros::MapGraph & msg, bool compress)
+{
+	UASSERT(msg.posesId.size() == msg.poses.size());
+	msg.posesPacked.clear();
+	msg.linksPacked.clear();
+	msg.packedCompressed = compress;
+
+	if(!msg.poses.empty())
+	{
+		std::vector<unsigned char> packed;
+		packed.reserve(sizeof(unsigned int) + 3*sizeof(double) + msg.poses.size()*(2+7*sizeof(float)));
+		unsigned int count = msg.poses.size();
+		double ref[3] = {msg.poses[0].position.x, msg.poses[0].position.y, msg.poses[0].position.z};
+		packed.resize(sizeof(count) + sizeof(ref));
+		memcpy(&packed[0], &count, sizeof(count));
+		memcpy(&packed[sizeof(count)], ref, sizeof(ref));
+		int previousId = 0;
+		for(size_t i=0; i<msg.poses.size(); ++i)
+		{
+			packVarint(msg.posesId[i] - previousId, packed);
+			previousId = msg.posesId[i];
+			geometry_msgs::Vector3 t;
+			t.x = msg.poses[i].position.x - ref[0];
+			t.y = msg.poses[i].position.y - ref[1];
+			t.z = msg.poses[i].position.z - ref[2];
+			packTransform(t, msg.poses[i].orientation, packed);
+		}
+		finalizePacked(packed, msg.posesPacked, compress);
+	}
+
+	if(!msg.links.empty())
+	{
+		std::vector<unsigned char> packed;
+		packed.reserve(sizeof(unsigned int) + msg.links.size()*(4+13*sizeof(float)));
+		unsigned int count = msg.links.size();
+		packed.resize(sizeof(count));
+		memcpy(&packed[0], &count, sizeof(count));
+		int previousFrom = 0;
+		for(size_t i=0; i<msg.links.size(); ++i)
+		{
+			const rtabmap_ros::Link & link = msg.links[i];
+			packVarint(link.fromId - previousFrom, packed);
+			packVarint(link.toId - link.fromId, packed);
+			previousFrom = link.fromId;
+
+			bool diagonal = true;
+			for(int r=0; r<6 && diagonal; ++r)
+			{
+				for(int c=0; c<6 && diagonal; ++c)
+				{
+					diagonal = r==c || link.information[r*6+c] == 0.0;
+				}
+			}
+			packed.push_back((unsigned char)((link.type & 0x7F) | (diagonal?0x80:0)));
+			packTransform(link.transform.translation, link.transform.rotation, packed);
+
+			float info[21];
+			int n = 0;
+			for(int r=0; r<6; ++r)
+			{
+				for(int c=r; c<(diagonal?r+1:6); ++c)
+				{
+					info[n++] = (float)link.information[r*6+c];
+				}
+			}
+			packFloats(info, n, packed);
+		}
+		finalizePacked(packed, msg.linksPacked, compress);
+	}
+
+	msg.posesId.clear();
+	msg.poses.clear();
+	msg.links.clear();
+}
+
+bool mapGraphIsPacked(const rtabmap_ros::MapGraph & msg)
+{
+	return !msg.posesPacked.empty() || !msg.linksPacked.empty();
+}
+
+bool mapGraphUnpack(
+		const rtabmap_ros::MapGraph & msg,
+		std::vector<int> & posesId,
+		std::vector<geometry_msgs::Pose> & poses,
+		std::vector<rtabmap_ros::Link> & links)
+{
+	posesId.clear();
+	poses.clear();
+	links.clear();
+
+	if(!msg.posesPacked.empty())
+	{
+		cv::Mat uncompressed;
+		const unsigned char * data = &msg.posesPacked[0];
+		size_t size = msg.posesPacked.size();
+		if(msg.packedCompressed)
+		{
+			uncompressed = rtabmap::uncompressData(msg.posesPacked);
+			data = uncompressed.data;
+			size = uncompressed.total()*uncompressed.elemSize();
+		}
+		PackedReader reader(data, size);
+		unsigned int count = 0;
+		double ref[3];
+		reader.read(&count, sizeof(count));
+		reader.read(ref, sizeof(ref));
+		if(reader.ok() && count <= size)
+		{
+			posesId.resize(count);
+			poses.resize(count);
+			int id = 0;
+			for(unsigned int i=0; i<count && reader.ok(); ++i)
+			{
+				id += reader.varint();
+				posesId[i] = id;
+				geometry_msgs::Vector3 t;
+				unpackTransform(reader, t, poses[i].orientation);
+				poses[i].position.x = t.x + ref[0];
+				poses[i].position.y = t.y + ref[1];
+				poses[i].position.z = t.z + ref[2];
+			}
+		}
+		if(!reader.ok() || !reader.atEnd())
+		{
+			ROS_ERROR("Packed poses of the graph are malformed (%d bytes)!", (int)size);
+			posesId.clear();
+			poses.clear();
+			return false;
+		}
+	}
+
+	if(!msg.linksPacked.empty())
+	{
+		cv::Mat uncompressed;
+		const unsigned char * data = &msg.linksPacked[0];
+		size_t size = msg.linksPacked.size();
+		if(msg.packedCompressed)
+		{
+			uncompressed = rtabmap::uncompressData(msg.linksPacked);
+			data = uncompressed.data;
+			size = uncompressed.total()*uncompressed.elemSize();
+		}
+		PackedReader reader(data, size);
+		unsigned int count = 0;
+		reader.read(&count, sizeof(count));
+		if(reader.ok() && count <= size)
+		{
+			links.resize(count);
+			int from = 0;
+			for(unsigned int i=0; i<count && reader.ok(); ++i)
+			{
+				rtabmap_ros::Link & link = links[i];
+				from += reader.varint();
+				link.fromId = from;
+				link.toId = from + reader.varint();
+				unsigned char type = 0;
+				reader.read(&type, 1);
+				bool diagonal = (type & 0x80) != 0;
+				link.type = type & 0x7F;
+				unpackTransform(reader, link.transform.translation, link.transform.rotation);
+
+				float info[21];
+				reader.read(info, (diagonal?6:21)*sizeof(float));
+				int n = 0;
+				for(int r=0; r<6; ++r)
+				{
+					for(int c=0; c<6; ++c)
+					{
+						if(diagonal)
+						{
+							link.information[r*6+c] = r==c?info[r]:0.0;
+						}
+						else if(c >= r)
+						{
+							link.information[r*6+c] = info[n++];
+						}
+						else
+						{
+							// symmetric
+							link.information[r*6+c] = link.information[c*6+r];
+						}
+					}
+				}
+			}
+		}
+		if(!reader.ok() || !reader.atEnd())
+		{
+			ROS_ERROR("Packed links of the graph are malformed (%d bytes)!", (int)size);
+			links.clear();
+			return false;
+		}
+	}
+	return true;
+}
+
+// Links can be refined (e.g., by proximity detection) without changing their
+// ids: a refined link is sent as removed then added again
+bool graphContainsLink(const std::multimap<int, rtabmap::Link> & links, const rtabmap::Link & link)
+{
+	for(std::multimap<int, rtabmap::Link>::const_iterator iter=links.find(link.from());
+		iter!=links.end() && iter->first == link.from();
+		++iter)
+	{
+		const rtabmap::Link & other = iter->second;
+		if(other.to() == link.to() &&
+		   other.type() == link.type() &&
+		   other.transform().isNull() == link.transform().isNull() &&
+		   (link.transform().isNull() || memcmp(other.transform().data(), link.transform().data(), 12*sizeof(float)) == 0) &&
+		   other.infMatrix().size() == link.infMatrix().size() &&
+		   (link.infMatrix().empty() || cv::norm(other.infMatrix(), link.infMatrix(), cv::NORM_INF) == 0.0))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void mapGraphDeltaToROS(
+		const std::map<int, rtabmap::Transform> & poses,
+		const std::multimap<int, rtabmap::Link> & links,
+		const rtabmap::Transform & mapToOdom,
+		std::map<int, rtabmap::Transform> & referencePoses,
+		std::multimap<int, rtabmap::Link> & referenceLinks,
+		float linearUpdate,
+		float angularUpdate,
+		rtabmap_ros::MapGraph & msg,
+		int graphPacking)
+{
+	msg.posesId.clear();
+	msg.poses.clear();
+	msg.links.clear();
+	msg.removedPosesId.clear();
+	msg.removedLinks.clear();
+
+	// removed poses, with their links
+	for(std::map<int, rtabmap::Transform>::iterator iter=referencePoses.begin(); iter!=referencePoses.end();)
+	{
+		if(poses.find(iter->first) == poses.end())
+		{
+			msg.removedPosesId.push_back(iter->first);
+			referencePoses.erase(iter++);
+		}
+		else
+		{
+			++iter;
+		}
+	}
+	std::set<int> removedIds(msg.removedPosesId.begin(), msg.removedPosesId.end());
+	for(std::multimap<int, rtabmap::Link>::iterator iter=referenceLinks.begin(); iter!=referenceLinks.end();)
+	{
+		if(removedIds.find(iter->second.from()) != removedIds.end() ||
+		   removedIds.find(iter->second.to()) != removedIds.end())
+		{
+			referenceLinks.erase(iter++);
+		}
+		else if(!graphContainsLink(links, iter->second))
+		{
+			msg.removedLinks.resize(msg.removedLinks.size()+1);
+			linkToROS(iter->second, msg.removedLinks.back());
+			referenceLinks.erase(iter++);
+		}
+		else
+		{
+			++iter;
+		}
+	}
+
+	// new or moved poses
+	for(std::map<int, rtabmap::Transform>::const_iterator iter = poses.begin(); iter != poses.end(); ++iter)
+	{
+		std::map<int, rtabmap::Transform>::iterator jter = referencePoses.find(iter->first);
+		bool changed = jter == referencePoses.end();
+		if(!changed)
+		{
+			rtabmap::Transform t = jter->second.inverse() * iter->second;
+			float roll, pitch, yaw;
+			t.getEulerAngles(roll, pitch, yaw);
+			changed = t.getNorm() > linearUpdate ||
+					fabs(roll) > angularUpdate ||
+					fabs(pitch) > angularUpdate ||
+					fabs(yaw) > angularUpdate;
+		}
+		if(changed)
+		{
+			msg.posesId.push_back(iter->first);
+			msg.poses.resize(msg.poses.size()+1);
+			transformToPoseMsg(iter->second, msg.poses.back());
+			uInsert(referencePoses, *iter);
+		}
+	}
+
+	// new links
+	for(std::multimap<int, rtabmap::Link>::const_iterator iter = links.begin(); iter!=links.end(); ++iter)
+	{
+		if(!graphContainsLink(referenceLinks, iter->second))
+		{
+			msg.links.resize(msg.links.size()+1);
+			linkToROS(iter->second, msg.links.back());
+			referenceLinks.insert(*iter);
+		}
+	}
+
+	transformToGeometryMsg(mapToOdom, msg.mapToOdom);
+
+	if(graphPacking > 0)
+	{
+		mapGraphPack(msg, graphPacking > 1);
+	}
+}
+
+bool mapGraphDeltaFromROS(
+		const rtabmap_ros::MapGraph & msg,
+		std::map<int, rtabmap::Transform> & poses,
+		std::multimap<int, rtabmap::Link> & links,
+		rtabmap::Transform & mapToOdom,
+		unsigned int & version)
+{
+	if(msg.baseVersion == 0)
+	{
+		// full graph
+		std::map<int, rtabmap::Transform> fullPoses;
+		std::multimap<int, rtabmap::Link> fullLinks;
+		if(!mapGraphFromROS(msg, fullPoses, fullLinks, mapToOdom))
+		{
+			return false;
+		}
+		poses.swap(fullPoses);
+		links.swap(fullLinks);
+		version = msg.version;
+		return true;
+	}
+	if(msg.baseVersion != version)
+	{
+		return false;
+	}
+
+	std::vector<int> unpackedPosesId;
+	std::vector<geometry_msgs::Pose> unpackedPoses;
+	std::vector<rtabmap_ros::Link> unpackedLinks;
+	const std::vector<int> * posesId = &msg.posesId;
+	const std::vector<geometry_msgs::Pose> * posesMsg = &msg.poses;
+	const std::vector<rtabmap_ros::Link> * linksMsg = &msg.links;
+	if(mapGraphIsPacked(msg))
+	{
+		// unpacked before anything is applied
+		if(!mapGraphUnpack(msg, unpackedPosesId, unpackedPoses, unpackedLinks))
+		{
+			ROS_ERROR("Packed graph delta is malformed, it is ignored.");
+			return false;
+		}
+		posesId = &unpackedPosesId;
+		posesMsg = &unpackedPoses;
+		linksMsg = &unpackedLinks;
+	}
+
+	std::set<int> removedIds(msg.removedPosesId.begin(), msg.removedPosesId.end());
+	for(std::set<int>::iterator iter=removedIds.begin(); iter!=removedIds.end(); ++iter)
+	{
+		poses.erase(*iter);
+	}
+	for(std::multimap<int, rtabmap::Link>::iterator iter=links.begin(); iter!=links.end();)
+	{
+		bool removed = removedIds.find(iter->second.from()) != removedIds.end() ||
+				removedIds.find(iter->second.to()) != removedIds.end();
+		for(unsigned int i=0; !removed && i<msg.removedLinks.size(); ++i)
+		{
+			removed = msg.removedLinks[i].fromId == iter->second.from() &&
+					msg.removedLinks[i].toId == iter->second.to() &&
+					msg.removedLinks[i].type == iter->second.type();
+		}
+		if(removed)
+		{
+			links.erase(iter++);
+		}
+		else
+		{
+			++iter;
+		}
+	}
+
+	UASSERT(posesId->size() == posesMsg->size());
+	for(unsigned int i=0; i<posesId->size(); ++i)
+	{
+		uInsert(poses, std::make_pair(posesId->at(i), rtabmap_ros::transformFromPoseMsg(posesMsg->at(i))));
+	}
+	for(unsigned int i=0; i<linksMsg->size(); ++i)
+	{
+		links.insert(std::make_pair(linksMsg->at(i).fromId, linkFromROS(linksMsg->at(i))));
+	}
+	mapToOdom = transformFromGeometryMsg(msg.mapToOdom);
+	version = msg.version;
+	return true;
+}
+
+rtabmap::Signature nodeDataFromROS(const rtabmap_ros::NodeData & msg, const boost::shared_ptr<const void> & owner)
 {
 	//Features stuff...
 	std::multimap<int, int> words;
@@ -1035,11 +2179,29 @@ rtabmap::Signature nodeDataFromROS(const rtabmap_ros::NodeData & msg)
 	std::vector<cv::Point3f> words3D;
 	cv::Mat wordsDescriptors = rtabmap::uncompressData(msg.wordDescriptors);
 
-	if(!msg.wordKpts.empty() && msg.wordKpts.size() != msg.wordIds.size())
+	if(!msg.wordKptsPacked.empty())
+	{
+		wordsKpts = keypointsFromBytes(msg.wordKptsPacked, msg.wordsPackedCompressed);
+		if(wordsKpts.size() != msg.wordIds.size())
+		{
+			ROS_ERROR("Word IDs and packed 2D keypoints should be the same size (%d, %d)!", (int)msg.wordIds.size(), (int)wordsKpts.size());
+			wordsKpts.clear();
+		}
+	}
+	else if(!msg.wordKpts.empty() && msg.wordKpts.size() != msg.wordIds.size())
 	{
 		ROS_ERROR("Word IDs and 2D keypoints should be the same size (%d, %d)!", (int)msg.wordIds.size(), (int)msg.wordKpts.size());
 	}
-	if(!msg.wordPts.empty() && msg.wordPts.size() != msg.wordIds.size())
+	if(!msg.wordPtsPacked.empty())
+	{
+		words3D = points3fFromBytes(msg.wordPtsPacked, msg.wordsPackedCompressed);
+		if(words3D.size() != msg.wordIds.size())
+		{
+			ROS_ERROR("Word IDs and packed 3D points should be the same size (%d, %d)!", (int)msg.wordIds.size(), (int)words3D.size());
+			words3D.clear();
+		}
+	}
+	else if(!msg.wordPts.empty() && msg.wordPts.size() != msg.wordIds.size())
 	{
 		ROS_ERROR("Word IDs and 3D points should be the same size (%d, %d)!", (int)msg.wordIds.size(), (int)msg.wordPts.size());
 	}
@@ -1052,12 +2214,12 @@ rtabmap::Signature nodeDataFromROS(const rtabmap_ros::NodeData & msg)
 	for(unsigned int i=0; i<msg.wordIds.size(); ++i)
 	{
 		words.insert(std::make_pair(msg.wordIds.at(i), words.size())); // ID to index
-		if(msg.wordIds.size() == msg.wordKpts.size())
+		if(msg.wordKptsPacked.empty() && msg.wordIds.size() == msg.wordKpts.size())
 		{
 			cv::KeyPoint pt = keypointFromROS(msg.wordKpts.at(i));
 			wordsKpts.push_back(pt);
 		}
-		if(msg.wordIds.size() == msg.wordPts.size())
+		if(msg.wordPtsPacked.empty() && msg.wordIds.size() == msg.wordPts.size())
 		{
 			words3D.push_back(point3fFromROS(msg.wordPts[i]));
 		}
@@ -1126,44 +2288,58 @@ rtabmap::Signature nodeDataFromROS(const rtabmap_ros::NodeData & msg)
 			transformFromPoseMsg(msg.groundTruthPose),
 			stereoModel.isValidForProjection()?
 				rtabmap::SensorData(
-					rtabmap::LaserScan(compressedMatFromBytes(msg.laserScan),
+					rtabmap::LaserScan(compressedMatFromBytes(msg.laserScan, owner),
 							msg.laserScanMaxPts,
 							msg.laserScanMaxRange,
 							(rtabmap::LaserScan::Format)msg.laserScanFormat,
 							transformFromGeometryMsg(msg.laserScanLocalTransform)),
-					compressedMatFromBytes(msg.image),
-					compressedMatFromBytes(msg.depth),
+					compressedMatFromBytes(msg.image, owner),
+					compressedMatFromBytes(msg.depth, owner),
 					stereoModel,
 					msg.id,
 					msg.stamp,
-					compressedMatFromBytes(msg.userData)):
+					compressedMatFromBytes(msg.userData, owner)):
 				rtabmap::SensorData(
-					rtabmap::LaserScan(compressedMatFromBytes(msg.laserScan),
+					rtabmap::LaserScan(compressedMatFromBytes(msg.laserScan, owner),
 							msg.laserScanMaxPts,
 							msg.laserScanMaxRange,
 							(rtabmap::LaserScan::Format)msg.laserScanFormat,
 							transformFromGeometryMsg(msg.laserScanLocalTransform)),
-					compressedMatFromBytes(msg.image),
-					compressedMatFromBytes(msg.depth),
+					compressedMatFromBytes(msg.image, owner),
+					compressedMatFromBytes(msg.depth, owner),
 					models,
 					msg.id,
 					msg.stamp,
-					compressedMatFromBytes(msg.userData)));
+					compressedMatFromBytes(msg.userData, owner)));
 	s.setWords(words, wordsKpts, words3D, wordsDescriptors);
 	s.sensorData().setGlobalDescriptors(rtabmap_ros::globalDescriptorsFromROS(msg.globalDescriptors));
 	s.sensorData().setEnvSensors(rtabmap_ros::envSensorsFromROS(msg.env_sensors));
 	s.sensorData().setOccupancyGrid(
-			compressedMatFromBytes(msg.grid_ground),
-			compressedMatFromBytes(msg.grid_obstacles),
-			compressedMatFromBytes(msg.grid_empty_cells),
+			compressedMatFromBytes(msg.grid_ground, owner),
+			compressedMatFromBytes(msg.grid_obstacles, owner),
+			compressedMatFromBytes(msg.grid_empty_cells, owner),
 			msg.grid_cell_size,
 			point3fFromROS(msg.grid_view_point));
 	s.sensorData().setGPS(rtabmap::GPS(msg.gps.stamp, msg.gps.longitude, msg.gps.latitude, msg.gps.altitude, msg.gps.error, msg.gps.bearing));
 	return s;
 }
-void nodeDataToROS(const rtabmap::Signature & signature, rtabmap_ros::NodeData & msg)
+void stripNodeDataToLocalGrid(rtabmap_ros::NodeData & msg)
+{
+	msg.image.clear();
+	msg.depth.clear();
+	msg.laserScan.clear();
+	msg.userData.clear();
+	msg.wordIds.clear();
+	msg.wordKpts.clear();
+	msg.wordPts.clear();
+	msg.wordKptsPacked.clear();
+	msg.wordPtsPacked.clear();
+	msg.wordDescriptors.clear();
+	msg.globalDescriptors.clear();
+}
+
+static void nodeInfoToROS(const rtabmap::Signature & signature, rtabmap_ros::NodeData & msg)
 {
-	// add data
 	msg.id = signature.id();
 	msg.mapId = signature.mapId();
 	msg.weight = signature.getWeight();
@@ -1177,60 +2353,85 @@ void nodeDataToROS(const rtabmap::Signature & signature, rtabmap_ros::NodeData &
 	msg.gps.altitude = signature.sensorData().gps().altitude();
 	msg.gps.error = signature.sensorData().gps().error();
 	msg.gps.bearing = signature.sensorData().gps().bearing();
+}
+
+static void nodeGridAndModelsToROS(const rtabmap::SensorData & data, rtabmap_ros::NodeData & msg)
+{
+	compressedMatToBytes(data.gridGroundCellsCompressed(), msg.grid_ground);
+	compressedMatToBytes(data.gridObstacleCellsCompressed(), msg.grid_obstacles);
+	compressedMatToBytes(data.gridEmptyCellsCompressed(), msg.grid_empty_cells);
+	point3fToROS(data.gridViewPoint(), msg.grid_view_point);
+	msg.grid_cell_size = data.gridCellSize();
+	msg.baseline = 0;
+	if(data.cameraModels().size())
+	{
+		msg.fx.resize(data.cameraModels().size());
+		msg.fy.resize(data.cameraModels().size());
+		msg.cx.resize(data.cameraModels().size());
+		msg.cy.resize(data.cameraModels().size());
+		msg.width.resize(data.cameraModels().size());
+		msg.height.resize(data.cameraModels().size());
+		msg.localTransform.resize(data.cameraModels().size());
+		for(unsigned int i=0; i<data.cameraModels().size(); ++i)
+		{
+			msg.fx[i] = data.cameraModels()[i].fx();
+			msg.fy[i] = data.cameraModels()[i].fy();
+			msg.cx[i] = data.cameraModels()[i].cx();
+			msg.cy[i] = data.cameraModels()[i].cy();
+			msg.width[i] = data.cameraModels()[i].imageWidth();
+			msg.height[i] = data.cameraModels()[i].imageHeight();
+			transformToGeometryMsg(data.cameraModels()[i].localTransform(), msg.localTransform[i]);
+		}
+	}
+	else if(data.stereoCameraModel().isValidForProjection())
+	{
+		msg.fx.push_back(data.stereoCameraModel().left().fx());
+		msg.fy.push_back(data.stereoCameraModel().left().fy());
+		msg.cx.push_back(data.stereoCameraModel().left().cx());
+		msg.cy.push_back(data.stereoCameraModel().left().cy());
+		msg.width.push_back(data.stereoCameraModel().left().imageWidth());
+		msg.height.push_back(data.stereoCameraModel().left().imageHeight());
+		msg.baseline = data.stereoCameraModel().baseline();
+		msg.localTransform.resize(1);
+		transformToGeometryMsg(data.stereoCameraModel().left().localTransform(), msg.localTransform[0]);
+	}
+}
+
+void nodeLocalGridToROS(const rtabmap::Signature & signature, rtabmap_ros::NodeData & msg)
+{
+	nodeInfoToROS(signature, msg);
+	nodeGridAndModelsToROS(signature.sensorData(), msg);
+}
+
+void nodeDataToROS(const rtabmap::Signature & signature, rtabmap_ros::NodeData & msg, int wordsPacking)
+{
+	// add data
+	nodeInfoToROS(signature, msg);
 	compressedMatToBytes(signature.sensorData().imageCompressed(), msg.image);
 	compressedMatToBytes(signature.sensorData().depthOrRightCompressed(), msg.depth);
 	compressedMatToBytes(signature.sensorData().laserScanCompressed().data(), msg.laserScan);
 	compressedMatToBytes(signature.sensorData().userDataCompressed(), msg.userData);
-	compressedMatToBytes(signature.sensorData().gridGroundCellsCompressed(), msg.grid_ground);
-	compressedMatToBytes(signature.sensorData().gridObstacleCellsCompressed(), msg.grid_obstacles);
-	compressedMatToBytes(signature.sensorData().gridEmptyCellsCompressed(), msg.grid_empty_cells);
-	point3fToROS(signature.sensorData().gridViewPoint(), msg.grid_view_point);
-	msg.grid_cell_size = signature.sensorData().gridCellSize();
 	msg.laserScanMaxPts = signature.sensorData().laserScanCompressed().maxPoints();
 	msg.laserScanMaxRange = signature.sensorData().laserScanCompressed().rangeMax();
 	msg.laserScanFormat = signature.sensorData().laserScanCompressed().format();
 	transformToGeometryMsg(signature.sensorData().laserScanCompressed().localTransform(), msg.laserScanLocalTransform);
-	msg.baseline = 0;
-	if(signature.sensorData().cameraModels().size())
-	{
-		msg.fx.resize(signature.sensorData().cameraModels().size());
-		msg.fy.resize(signature.sensorData().cameraModels().size());
-		msg.cx.resize(signature.sensorData().cameraModels().size());
-		msg.cy.resize(signature.sensorData().cameraModels().size());
-		msg.width.resize(signature.sensorData().cameraModels().size());
-		msg.height.resize(signature.sensorData().cameraModels().size());
-		msg.localTransform.resize(signature.sensorData().cameraModels().size());
-		for(unsigned int i=0; i<signature.sensorData().cameraModels().size(); ++i)
-		{
-			msg.fx[i] = signature.sensorData().cameraModels()[i].fx();
-			msg.fy[i] = signature.sensorData().cameraModels()[i].fy();
-			msg.cx[i] = signature.sensorData().cameraModels()[i].cx();
-			msg.cy[i] = signature.sensorData().cameraModels()[i].cy();
-			msg.width[i] = signature.sensorData().cameraModels()[i].imageWidth();
-			msg.height[i] = signature.sensorData().cameraModels()[i].imageHeight();
-			transformToGeometryMsg(signature.sensorData().cameraModels()[i].localTransform(), msg.localTransform[i]);
-		}
-	}
-	else if(signature.sensorData().stereoCameraModel().isValidForProjection())
-	{
-		msg.fx.push_back(signature.sensorData().stereoCameraModel().left().fx());
-		msg.fy.push_back(signature.sensorData().stereoCameraModel().left().fy());
-		msg.cx.push_back(signature.sensorData().stereoCameraModel().left().cx());
-		msg.cy.push_back(signature.sensorData().stereoCameraModel().left().cy());
-		msg.width.push_back(signature.sensorData().stereoCameraModel().left().imageWidth());
-		msg.height.push_back(signature.sensorData().stereoCameraModel().left().imageHeight());
-		msg.baseline = signature.sensorData().stereoCameraModel().baseline();
-		msg.localTransform.resize(1);
-		transformToGeometryMsg(signature.sensorData().stereoCameraModel().left().localTransform(), msg.localTransform[0]);
-	}
+	nodeGridAndModelsToROS(signature.sensorData(), msg);
 
 	//Features stuff...
 	msg.wordIds = uKeys(signature.getWords());
+	msg.wordsPackedCompressed = wordsPacking == 2;
 	if(!signature.getWordsKpts().empty())
 	{
 		if(msg.wordIds.size() == signature.getWordsKpts().size())
 		{
-			msg.wordKpts.resize(signature.getWordsKpts().size());
+			if(wordsPacking > 0)
+			{
+				keypointsToBytes(signature.getWordsKpts(), msg.wordKptsPacked, msg.wordsPackedCompressed);
+			}
+			else
+			{
+				msg.wordKpts.resize(signature.getWordsKpts().size());
+			}
 		}
 		else
 		{
@@ -1244,7 +2445,14 @@ void nodeDataToROS(const rtabmap::Signature & signature, rtabmap_ros::NodeData &
 	{
 		if(msg.wordIds.size() == signature.getWords3().size())
 		{
-			msg.wordPts.resize(signature.getWords3().size());
+			if(wordsPacking > 0)
+			{
+				points3fToBytes(signature.getWords3(), msg.wordPtsPacked, msg.wordsPackedCompressed);
+			}
+			else
+			{
+				msg.wordPts.resize(signature.getWords3().size());
+			}
 		}
 		else
 		{
@@ -1635,8 +2843,14 @@ rtabmap::Transform getTransform(
 		tf::TransformListener & listener,
 		double waitForTransform)
 {
+	// Static transform already known?
+	rtabmap::Transform transform = StaticTransformCache::lookup(fromFrameId, toFrameId, listener);
+	if(!transform.isNull())
+	{
+		return transform;
+	}
+
 	// TF ready?
-	rtabmap::Transform transform;
 	try
 	{
 		if(waitForTransform > 0.0 && !stamp.isZero())
@@ -1699,6 +2913,93 @@ rtabmap::Transform getTransform(
 	return transform;
 }
 
+// Type of an image once converted to mono8 or bgr8
+static int mosaicImageType(const std::string & encoding)
+{
+	if(encoding.compare(sensor_msgs::image_encodings::TYPE_8UC1)==0 ||
+	   encoding.compare(sensor_msgs::image_encodings::MONO8) == 0 ||
+	   encoding.compare(sensor_msgs::image_encodings::MONO16) == 0)
+	{
+		return CV_8UC1;
+	}
+	return CV_8UC3;
+}
+
+// Mosaic images are kept in a small pool and reused only when
+// not referenced anymore (e.g., by a SensorData still being processed).
+static cv::Mat getMosaicBuffer(int rows, int cols, int type)
+{
+	static boost::mutex mutex;
+	static MatBufferPool pool(8);
+
+	boost::mutex::scoped_lock lock(mutex);
+	return pool.acquire(cv::Size(cols, rows), type);
+}
+
+static void imageToMosaic(const cv_bridge::CvImageConstPtr & image, cv::Mat dst)
+{
+	const std::string & encoding = image->encoding;
+	if(encoding.compare(sensor_msgs::image_encodings::TYPE_8UC1)==0 ||
+	   encoding.compare(sensor_msgs::image_encodings::MONO8) == 0 ||
+	   encoding.compare(sensor_msgs::image_encodings::BGR8) == 0)
+	{
+		image->image.copyTo(dst);
+	}
+	else if(encoding.compare(sensor_msgs::image_encodings::RGB8) == 0)
+	{
+		cv::cvtColor(image->image, dst, cv::COLOR_RGB2BGR);
+	}
+	else if(encoding.compare(sensor_msgs::image_encodings::BGRA8) == 0)
+	{
+		cv::cvtColor(image->image, dst, cv::COLOR_BGRA2BGR);
+	}
+	else if(encoding.compare(sensor_msgs::image_encodings::RGBA8) == 0)
+	{
+		cv::cvtColor(image->image, dst, cv::COLOR_RGBA2BGR);
+	}
+	else
+	{
+		cv_bridge::cvtColor(image, dst.channels()==1?"mono8":"bgr8")->image.copyTo(dst);
+	}
+}
+
+class MosaicAssembler : public cv::ParallelLoopBody
+{
+public:
+	MosaicAssembler(
+			const std::vector<cv_bridge::CvImageConstPtr> & imageMsgs,
+			const std::vector<cv_bridge::CvImageConstPtr> & depthMsgs,
+			const cv::Mat & rgb,
+			const cv::Mat & depth) :
+		imageMsgs_(imageMsgs),
+		depthMsgs_(depthMsgs),
+		rgb_(rgb),
+		depth_(depth)
+	{}
+	virtual void operator()(const cv::Range & range) const
+	{
+		for(int i=range.start; i<range.end; ++i)
+		{
+			if(!imageMsgs_.empty())
+			{
+				int width = imageMsgs_[i]->image.cols;
+				imageToMosaic(imageMsgs_[i], cv::Mat(rgb_, cv::Rect(i*width, 0, width, rgb_.rows)));
+			}
+			if(!depthMsgs_.empty())
+			{
+				int width = depthMsgs_[i]->image.cols;
+				cv::Mat dst(depth_, cv::Rect(i*width, 0, width, depth_.rows));
+				depthMsgs_[i]->image.copyTo(dst);
+			}
+		}
+	}
+private:
+	const std::vector<cv_bridge::CvImageConstPtr> & imageMsgs_;
+	const std::vector<cv_bridge::CvImageConstPtr> & depthMsgs_;
+	cv::Mat rgb_;
+	cv::Mat depth_;
+};
+
 bool convertRGBDMsgs(
 		const std::vector<cv_bridge::CvImageConstPtr> & imageMsgs,
 		const std::vector<cv_bridge::CvImageConstPtr> & depthMsgs,
@@ -1824,57 +3125,19 @@ bool convertRGBDMsgs(
 
 		if(!imageMsgs.empty())
 		{
-			cv_bridge::CvImageConstPtr ptrImage = imageMsgs[i];
-			if(imageMsgs[i]->encoding.compare(sensor_msgs::image_encodings::TYPE_8UC1)==0 ||
-			   imageMsgs[i]->encoding.compare(sensor_msgs::image_encodings::MONO8) == 0 ||
-			   imageMsgs[i]->encoding.compare(sensor_msgs::image_encodings::BGR8) == 0)
-			{
-				// do nothing
-			}
-			else if(imageMsgs[i]->encoding.compare(sensor_msgs::image_encodings::MONO16) == 0)
-			{
-				ptrImage = cv_bridge::cvtColor(imageMsgs[i], "mono8");
-			}
-			else
-			{
-				ptrImage = cv_bridge::cvtColor(imageMsgs[i], "bgr8");
-			}
-
-			// initialize
-			if(rgb.empty())
-			{
-				rgb = cv::Mat(imageHeight, imageWidth*cameraCount, ptrImage->image.type());
-			}
-			if(ptrImage->image.type() == rgb.type())
-			{
-				ptrImage->image.copyTo(cv::Mat(rgb, cv::Rect(i*imageWidth, 0, imageWidth, imageHeight)));
-			}
-			else
+			// all images are converted to mono8 or bgr8
+			int type = mosaicImageType(imageMsgs[i]->encoding);
+			if(i>0 && type != mosaicImageType(imageMsgs[0]->encoding))
 			{
 				ROS_ERROR("Some RGB images are not the same type!");
 				return false;
 			}
 		}
 
-		if(!depthMsgs.empty())
+		if(!depthMsgs.empty() && depthMsgs[i]->image.type() != depthMsgs[0]->image.type())
 		{
-			cv_bridge::CvImageConstPtr ptrDepth = depthMsgs[i];
-			cv::Mat subDepth = ptrDepth->image;
-
-			if(depth.empty())
-			{
-				depth = cv::Mat(depthHeight, depthWidth*cameraCount, subDepth.type());
-			}
-
-			if(subDepth.type() == depth.type())
-			{
-				subDepth.copyTo(cv::Mat(depth, cv::Rect(i*depthWidth, 0, depthWidth, depthHeight)));
-			}
-			else
-			{
-				ROS_ERROR("Some Depth images are not the same type!");
-				return false;
-			}
+			ROS_ERROR("Some Depth images are not the same type!");
+			return false;
 		}
 
 		cameraModels.push_back(rtabmap_ros::cameraModelFromROS(cameraInfoMsgs[i], localTransform));
@@ -1893,6 +3156,43 @@ bool convertRGBDMsgs(
 			localDescriptors->push_back(localDescriptorsMsgs[i]);
 		}
 	}
+
+	// Assemble the images side by side, each camera is converted directly in its mosaic region
+	if(!imageMsgs.empty())
+	{
+		int type = mosaicImageType(imageMsgs[0]->encoding);
+		if(rgb.empty())
+		{
+			rgb = getMosaicBuffer(imageHeight, imageWidth*cameraCount, type);
+		}
+		else if(rgb.type() != type || rgb.cols != imageWidth*cameraCount || rgb.rows != imageHeight)
+		{
+			ROS_ERROR("Some RGB images are not the same type!");
+			return false;
+		}
+	}
+	if(!depthMsgs.empty())
+	{
+		int type = depthMsgs[0]->image.type();
+		if(depth.empty())
+		{
+			depth = getMosaicBuffer(depthHeight, depthWidth*cameraCount, type);
+		}
+		else if(depth.type() != type || depth.cols != depthWidth*cameraCount || depth.rows != depthHeight)
+		{
+			ROS_ERROR("Some Depth images are not the same type!");
+			return false;
+		}
+	}
+	MosaicAssembler assembler(imageMsgs, depthMsgs, rgb, depth);
+	if(cameraCount > 1)
+	{
+		cv::parallel_for_(cv::Range(0, cameraCount), assembler);
+	}
+	else
+	{
+		assembler(cv::Range(0, cameraCount));
+	}
 	return true;
 }
 
@@ -2053,6 +3353,440 @@ bool convertStereoMsg(
 	return true;
 }
 
+namespace {
+struct RayTableKey
+{
+	RayTableKey(const sensor_msgs::LaserScan & msg) :
+		angleMin(msg.angle_min),
+		angleIncrement(msg.angle_increment),
+		size(msg.ranges.size())
+	{}
+	bool operator<(const RayTableKey & k) const
+	{
+		if(angleMin != k.angleMin) return angleMin < k.angleMin;
+		if(angleIncrement != k.angleIncrement) return angleIncrement < k.angleIncrement;
+		return size < k.size;
+	}
+	float angleMin;
+	float angleIncrement;
+	size_t size;
+};
+
+// cos/sin of each beam
+boost::shared_ptr<const std::vector<float> > rayTable(const sensor_msgs::LaserScan & msg)
+{
+	static boost::mutex mutex;
+	static std::map<RayTableKey, boost::shared_ptr<const std::vector<float> > > tables;
+
+	RayTableKey key(msg);
+	boost::mutex::scoped_lock lock(mutex);
+	std::map<RayTableKey, boost::shared_ptr<const std::vector<float> > >::iterator iter = tables.find(key);
+	if(iter != tables.end())
+	{
+		return iter->second;
+	}
+	if(tables.size() >= 16)
+	{
+		// the layout should not change, but don't grow forever if it does
+		tables.clear();
+	}
+	boost::shared_ptr<std::vector<float> > table(new std::vector<float>(msg.ranges.size()*2));
+	for(size_t i=0; i<msg.ranges.size(); ++i)
+	{
+		// same computation than laser_geometry
+		double angle = msg.angle_min + (double)i*msg.angle_increment;
+		(*table)[i*2] = (float)cos(angle);
+		(*table)[i*2+1] = (float)sin(angle);
+	}
+	tables.insert(std::make_pair(key, table));
+	return table;
+}
+}
+
+cv::Mat laserScan2dFromLaserScanMsg(
+		const sensor_msgs::LaserScan & msg,
+		const rtabmap::Transform & transform,
+		int downsamplingStep,
+		float rangeMin,
+		float rangeMax)
+{
+	if(msg.ranges.empty())
+	{
+		return cv::Mat();
+	}
+	boost::shared_ptr<const std::vector<float> > table = rayTable(msg);
+	const float * cs = &(*table)[0];
+	bool hasIntensity = msg.intensities.size() == msg.ranges.size();
+	bool hasTransform = !transform.isNull() && !transform.isIdentity();
+	if(downsamplingStep < 1)
+	{
+		downsamplingStep = 1;
+	}
+	float rangeMinSqr = rangeMin*rangeMin;
+	float rangeMaxSqr = rangeMax*rangeMax;
+
+	cv::Mat output(1, msg.ranges.size()/downsamplingStep + 1, hasIntensity?CV_32FC3:CV_32FC2);
+	float * out = output.ptr<float>();
+	int channels = output.channels();
+	int oi = 0;
+	int valid = 0;
+	for(size_t i=0; i<msg.ranges.size(); ++i)
+	{
+		float r = msg.ranges[i];
+		if(!(r < msg.range_max && r >= msg.range_min))
+		{
+			continue; // also NaN
+		}
+		if(valid++ % downsamplingStep != 0)
+		{
+			continue;
+		}
+		float x = r*cs[i*2];
+		float y = r*cs[i*2+1];
+		float rSqr = r*r;
+		if((rangeMin > 0.0f && rSqr < rangeMinSqr) ||
+		   (rangeMax > 0.0f && rSqr > rangeMaxSqr))
+		{
+			continue;
+		}
+		if(hasTransform)
+		{
+			float tx = transform.r11()*x + transform.r12()*y + transform.x();
+			y = transform.r21()*x + transform.r22()*y + transform.y();
+			x = tx;
+		}
+		float * ptr = out + oi*channels;
+		ptr[0] = x;
+		ptr[1] = y;
+		if(hasIntensity)
+		{
+			ptr[2] = msg.intensities[i];
+		}
+		++oi;
+	}
+	if(oi == 0)
+	{
+		return cv::Mat();
+	}
+	return output.colRange(0, oi);
+}
+
+namespace {
+struct DepthRayTableKey
+{
+	DepthRayTableKey(const rtabmap::CameraModel & model, int decimation, int cols, int rows) :
+		fx(model.fx()),
+		fy(model.fy()),
+		cx(model.cx()),
+		cy(model.cy()),
+		decimation(decimation),
+		cols(cols),
+		rows(rows)
+	{}
+	bool operator<(const DepthRayTableKey & k) const
+	{
+		if(fx != k.fx) return fx < k.fx;
+		if(fy != k.fy) return fy < k.fy;
+		if(cx != k.cx) return cx < k.cx;
+		if(cy != k.cy) return cy < k.cy;
+		if(decimation != k.decimation) return decimation < k.decimation;
+		if(cols != k.cols) return cols < k.cols;
+		return rows < k.rows;
+	}
+	double fx;
+	double fy;
+	double cx;
+	double cy;
+	int decimation;
+	int cols;
+	int rows;
+};
+
+// The rays are separable: (u-cx)/fx for each column, then (v-cy)/fy for each row
+boost::shared_ptr<const std::vector<float> > depthRayTable(const rtabmap::CameraModel & model, int decimation, int cols, int rows)
+{
+	static boost::mutex mutex;
+	static std::map<DepthRayTableKey, boost::shared_ptr<const std::vector<float> > > tables;
+
+	DepthRayTableKey key(model, decimation, cols, rows);
+	boost::mutex::scoped_lock lock(mutex);
+	std::map<DepthRayTableKey, boost::shared_ptr<const std::vector<float> > >::iterator iter = tables.find(key);
+	if(iter != tables.end())
+	{
+		return iter->second;
+	}
+	if(tables.size() >= 16)
+	{
+		// the calibration should not change, but don't grow forever if it does
+		tables.clear();
+	}
+	boost::shared_ptr<std::vector<float> > table(new std::vector<float>(cols + rows));
+	for(int u=0; u<cols; ++u)
+	{
+		(*table)[u] = (float(u*decimation) - float(model.cx())) / float(model.fx());
+	}
+	for(int v=0; v<rows; ++v)
+	{
+		(*table)[cols+v] = (float(v*decimation) - float(model.cy())) / float(model.fy());
+	}
+	tables.insert(std::make_pair(key, table));
+	return table;
+}
+
+// Project a range of rows, valid points of each row are written from the
+// beginning of the row in the output buffer
+class DepthToCloudBody : public cv::ParallelLoopBody
+{
+public:
+	DepthToCloudBody(
+			const cv::Mat & depth,
+			const cv::Mat & image,
+			const float * rays,
+			int decimation,
+			int cols,
+			float minDepth,
+			float maxDepth,
+			bool filterNaNs,
+			unsigned char * out,
+			int pointStep,
+			std::vector<int> & rowSizes,
+			const float * transform = 0) :
+		depth_(depth),
+		image_(image),
+		raysX_(rays),
+		raysY_(rays+cols),
+		decimation_(decimation),
+		cols_(cols),
+		minDepth_(minDepth),
+		maxDepth_(maxDepth),
+		filterNaNs_(filterNaNs),
+		out_(out),
+		pointStep_(pointStep),
+		rowSizes_(rowSizes),
+		transform_(transform)
+	{}
+
+	virtual void operator()(const cv::Range & range) const
+	{
+		const float bad = std::numeric_limits<float>::quiet_NaN();
+		const bool isMM = depth_.type() == CV_16UC1;
+		const bool hasImage = !image_.empty();
+		const bool isMono = hasImage && image_.channels() == 1;
+		for(int v=range.start; v<range.end; ++v)
+		{
+			const int h = v*decimation_;
+			const float ry = raysY_[v];
+			unsigned char * row = out_ + size_t(v)*cols_*pointStep_;
+			const unsigned short * depthMM = isMM?depth_.ptr<unsigned short>(h):0;
+			const float * depthM = isMM?0:depth_.ptr<float>(h);
+			const unsigned char * pixels = hasImage?image_.ptr<unsigned char>(h):0;
+			int oi = 0;
+			for(int u=0; u<cols_; ++u)
+			{
+				const int w = u*decimation_;
+				float z = isMM?float(depthMM[w])*0.001f:depthM[w];
+				// false for NaN too
+				bool valid = z > 0.0f && z >= minDepth_ && (maxDepth_ <= 0.0f || z <= maxDepth_);
+				if(!valid && filterNaNs_)
+				{
+					continue;
+				}
+				float * pt = (float*)(row + oi*pointStep_);
+				if(valid && transform_)
+				{
+					// 3x4 row-major
+					const float x = raysX_[u]*z;
+					const float y = ry*z;
+					const float * t = transform_;
+					pt[0] = t[0]*x + t[1]*y + t[2]*z + t[3];
+					pt[1] = t[4]*x + t[5]*y + t[6]*z + t[7];
+					pt[2] = t[8]*x + t[9]*y + t[10]*z + t[11];
+				}
+				else if(valid)
+				{
+					pt[0] = raysX_[u]*z;
+					pt[1] = ry*z;
+					pt[2] = z;
+				}
+				else
+				{
+					pt[0] = pt[1] = pt[2] = bad;
+				}
+				if(hasImage)
+				{
+					// same rgb value packing than pcl::PointXYZRGB
+					unsigned int rgb;
+					if(isMono)
+					{
+						unsigned int g = pixels[w];
+						rgb = (g << 16) | (g << 8) | g;
+					}
+					else
+					{
+						const unsigned char * bgr = pixels + w*3;
+						rgb = ((unsigned int)bgr[2] << 16) | ((unsigned int)bgr[1] << 8) | (unsigned int)bgr[0];
+					}
+					memcpy(pt+3, &rgb, sizeof(unsigned int));
+				}
+				++oi;
+			}
+			rowSizes_[v] = oi;
+		}
+	}
+
+private:
+	const cv::Mat & depth_;
+	const cv::Mat & image_;
+	const float * raysX_;
+	const float * raysY_;
+	int decimation_;
+	int cols_;
+	float minDepth_;
+	float maxDepth_;
+	bool filterNaNs_;
+	unsigned char * out_;
+	int pointStep_;
+	std::vector<int> & rowSizes_;
+	const float * transform_;
+};
+}
+
+void depthToPointCloud2Msg(
+		const cv::Mat & depth,
+		const rtabmap::CameraModel & model,
+		int decimation,
+		float minDepth,
+		float maxDepth,
+		bool filterNaNs,
+		sensor_msgs::PointCloud2 & msg,
+		const cv::Mat & image)
+{
+	UASSERT(depth.type() == CV_16UC1 || depth.type() == CV_32FC1);
+	UASSERT(image.empty() || ((image.type() == CV_8UC1 || image.type() == CV_8UC3) && image.size() == depth.size()));
+	if(decimation < 1)
+	{
+		decimation = 1;
+	}
+	int cols = depth.cols/decimation;
+	int rows = depth.rows/decimation;
+
+	// x y z (rgb at offset 12) in 16 bytes. This is the pcl::PointXYZ
+	// layout, not the pcl::PointXYZRGB one (32 bytes, rgb at offset 16):
+	// the fields are described so that pcl::fromROSMsg() maps them.
+	const char * names[] = {"x", "y", "z", "rgb"};
+	msg.fields.resize(image.empty()?3:4);
+	for(size_t i=0; i<msg.fields.size(); ++i)
+	{
+		msg.fields[i].name = names[i];
+		msg.fields[i].offset = i*4;
+		msg.fields[i].datatype = sensor_msgs::PointField::FLOAT32;
+		msg.fields[i].count = 1;
+	}
+	msg.is_bigendian = false;
+	msg.point_step = 16;
+	msg.data.resize(size_t(cols)*size_t(rows)*msg.point_step);
+
+	std::vector<int> rowSizes(rows, 0);
+	if(rows > 0 && cols > 0)
+	{
+		boost::shared_ptr<const std::vector<float> > rays = depthRayTable(model, decimation, cols, rows);
+		cv::parallel_for_(cv::Range(0, rows), DepthToCloudBody(
+				depth,
+				image,
+				&(*rays)[0],
+				decimation,
+				cols,
+				minDepth,
+				maxDepth,
+				filterNaNs,
+				msg.data.data(),
+				msg.point_step,
+				rowSizes));
+	}
+
+	if(filterNaNs)
+	{
+		// make rows contiguous
+		size_t size = 0;
+		for(int v=0; v<rows; ++v)
+		{
+			if(rowSizes[v] && size != size_t(v)*cols)
+			{
+				memmove(msg.data.data() + size*msg.point_step,
+						msg.data.data() + size_t(v)*cols*msg.point_step,
+						rowSizes[v]*msg.point_step);
+			}
+			size += rowSizes[v];
+		}
+		msg.data.resize(size*msg.point_step);
+		msg.height = 1;
+		msg.width = size;
+		msg.is_dense = true;
+	}
+	else
+	{
+		msg.height = rows;
+		msg.width = cols;
+		msg.is_dense = false;
+	}
+	msg.row_step = msg.width*msg.point_step;
+}
+
+void depthToPointCloud(
+		const cv::Mat & depth,
+		const rtabmap::CameraModel & model,
+		int decimation,
+		float minDepth,
+		float maxDepth,
+		pcl::PointCloud<pcl::PointXYZ> & cloud,
+		const rtabmap::Transform & transform)
+{
+	UASSERT(depth.type() == CV_16UC1 || depth.type() == CV_32FC1);
+	if(decimation < 1)
+	{
+		decimation = 1;
+	}
+	int cols = depth.cols/decimation;
+	int rows = depth.rows/decimation;
+
+	// pcl::PointXYZ has the same 16 bytes layout than the PointCloud2 kernel
+	// output without image (only x,y,z are written, at offsets 0,4,8)
+	cloud.resize(size_t(cols)*size_t(rows));
+	std::vector<int> rowSizes(rows, 0);
+	if(rows > 0 && cols > 0)
+	{
+		boost::shared_ptr<const std::vector<float> > rays = depthRayTable(model, decimation, cols, rows);
+		cv::parallel_for_(cv::Range(0, rows), DepthToCloudBody(
+				depth,
+				cv::Mat(),
+				&(*rays)[0],
+				decimation,
+				cols,
+				minDepth,
+				maxDepth,
+				true,
+				(unsigned char *)cloud.points.data(),
+				sizeof(pcl::PointXYZ),
+				rowSizes,
+				transform.isNull() || transform.isIdentity()?0:transform.data()));
+	}
+
+	// make rows contiguous
+	size_t size = 0;
+	for(int v=0; v<rows; ++v)
+	{
+		if(rowSizes[v] && size != size_t(v)*cols)
+		{
+			memmove(&cloud.points[size], &cloud.points[size_t(v)*cols], rowSizes[v]*sizeof(pcl::PointXYZ));
+		}
+		size += rowSizes[v];
+	}
+	cloud.resize(size);
+	cloud.height = 1;
+	cloud.width = size;
+	cloud.is_dense = true;
+}
+
 bool convertScanMsg(
 		const sensor_msgs::LaserScan & scan2dMsg,
 		const std::string & frameId,
@@ -2086,10 +3820,15 @@ bool convertScanMsg(
 		return false;
 	}
 
-	//transform in frameId_ frame
+	// Without motion to compensate, project directly in laser frame
+	bool deskewing = !odomFrameId.empty() && (scan2dMsg.time_increment != 0.0f || outputInFrameId);
 	sensor_msgs::PointCloud2 scanOut;
-	laser_geometry::LaserProjection projection;
-	projection.transformLaserScanToPointCloud(odomFrameId.empty()?frameId:odomFrameId, scan2dMsg, scanOut, listener);
+	if(deskewing)
+	{
+		//transform in frameId_ frame
+		laser_geometry::LaserProjection projection;
+		projection.transformLaserScanToPointCloud(odomFrameId, scan2dMsg, scanOut, listener);
+	}
 
 	//transform back in laser frame
 	rtabmap::Transform laserToOdom = getTransform(
@@ -2130,6 +3869,8 @@ bool convertScanMsg(
 		laserToOdom *= scanLocalTransform;
 	}
 
+	rtabmap::LaserScan::Format format;
+	cv::Mat data;
 	bool hasIntensity = false;
 	for(unsigned int i=0; i<scanOut.fields.size(); ++i)
 	{
@@ -2153,9 +3894,13 @@ bool convertScanMsg(
 		}
 	}
 
-	rtabmap::LaserScan::Format format;
-	cv::Mat data;
-	if(hasIntensity)
+	if(!deskewing)
+	{
+		// laserToOdom is the identity in that case, unless outputInFrameId is set
+		data = laserScan2dFromLaserScanMsg(scan2dMsg, outputInFrameId?scanLocalTransform:rtabmap::Transform());
+		format = scan2dMsg.intensities.size() == scan2dMsg.ranges.size()?rtabmap::LaserScan::kXYI:rtabmap::LaserScan::kXY;
+	}
+	else if(hasIntensity)
 	{
 		pcl::PointCloud<pcl::PointXYZI>::Ptr pclScan(new pcl::PointCloud<pcl::PointXYZI>);
 		pcl::fromROSMsg(scanOut, *pclScan);
@@ -2193,6 +3938,137 @@ bool convertScanMsg(
 	return true;
 }
 
+rtabmap::LaserScan laserScanFromPointCloud2(
+		const sensor_msgs::PointCloud2 & msg,
+		const rtabmap::Transform & localTransform,
+		int maxPoints,
+		float maxRange,
+		float rangeMin,
+		float rangeMax)
+{
+	if(msg.data.size() < (size_t)msg.row_step*msg.height || msg.row_step < (size_t)msg.width*msg.point_step)
+	{
+		ROS_ERROR("Malformed scan cloud (data=%d bytes, row_step=%d, height=%d, width=%d, point_step=%d), it is ignored.",
+				(int)msg.data.size(), msg.row_step, msg.height, msg.width, msg.point_step);
+		return rtabmap::LaserScan();
+	}
+
+	int x=-1, y=-1, z=-1, intensity=-1, rgb=-1, nx=-1, ny=-1, nz=-1;
+	bool supported = !msg.is_bigendian;
+	for(size_t i=0; i<msg.fields.size() && supported; ++i)
+	{
+		const sensor_msgs::PointField & field = msg.fields[i];
+		int * offset = 0;
+		if(field.name.compare("x") == 0) offset = &x;
+		else if(field.name.compare("y") == 0) offset = &y;
+		else if(field.name.compare("z") == 0) offset = &z;
+		else if(field.name.compare("intensity") == 0) offset = &intensity;
+		else if(field.name.compare("rgb") == 0 || field.name.compare("rgba") == 0) offset = &rgb;
+		else if(field.name.compare("normal_x") == 0) offset = &nx;
+		else if(field.name.compare("normal_y") == 0) offset = &ny;
+		else if(field.name.compare("normal_z") == 0) offset = &nz;
+		if(offset)
+		{
+			if(field.datatype == sensor_msgs::PointField::FLOAT32 || (offset == &rgb && field.datatype == sensor_msgs::PointField::UINT32))
+			{
+				if(field.offset + sizeof(float) > msg.point_step)
+				{
+					ROS_ERROR("Malformed scan cloud, field \"%s\" (offset=%d) is outside the point (point_step=%d), it is ignored.",
+							field.name.c_str(), field.offset, msg.point_step);
+					return rtabmap::LaserScan();
+				}
+				*offset = field.offset;
+			}
+			else if(offset == &x || offset == &y || offset == &z || offset == &rgb)
+			{
+				supported = false;
+			}
+			else if(offset == &intensity)
+			{
+				static bool warningShown = false;
+				if(!warningShown)
+				{
+					ROS_WARN("The input scan cloud has an \"intensity\" field "
+							"but the datatype (%d) is not supported. Intensity will be ignored. "
+							"This message is only shown once.", field.datatype);
+					warningShown = true;
+				}
+			}
+			// normals with int types are ignored
+		}
+	}
+	if(!supported || x<0 || y<0 || z<0)
+	{
+		rtabmap::LaserScan scan = rtabmap::util3d::laserScanFromPointCloud(msg);
+		scan = rtabmap::LaserScan(scan, maxPoints, maxRange, localTransform);
+		if(rangeMin > 0.0f || rangeMax > 0.0f)
+		{
+			scan = rtabmap::util3d::rangeFiltering(scan, rangeMin, rangeMax);
+		}
+		return scan;
+	}
+
+	bool hasNormals = nx>=0 && ny>=0 && nz>=0;
+	bool hasIntensity = intensity>=0;
+	bool hasRGB = !hasIntensity && rgb>=0;
+	rtabmap::LaserScan::Format format =
+			hasIntensity?(hasNormals?rtabmap::LaserScan::kXYZINormal:rtabmap::LaserScan::kXYZI):
+			hasRGB?(hasNormals?rtabmap::LaserScan::kXYZRGBNormal:rtabmap::LaserScan::kXYZRGB):
+			(hasNormals?rtabmap::LaserScan::kXYZNormal:rtabmap::LaserScan::kXYZ);
+	int channels = rtabmap::LaserScan::channels(format);
+	int fourth = hasIntensity?intensity:hasRGB?rgb:-1;
+
+	float rangeMinSqr = rangeMin*rangeMin;
+	float rangeMaxSqr = rangeMax*rangeMax;
+	cv::Mat data(1, msg.width*msg.height, CV_32FC(channels));
+	float * out = data.ptr<float>();
+	int count = 0;
+	for(unsigned int row=0; row<msg.height; ++row)
+	{
+		const unsigned char * p = &msg.data[row*msg.row_step];
+		for(unsigned int col=0; col<msg.width; ++col, p+=msg.point_step)
+		{
+			float v[3];
+			memcpy(&v[0], p+x, sizeof(float));
+			memcpy(&v[1], p+y, sizeof(float));
+			memcpy(&v[2], p+z, sizeof(float));
+			if(!uIsFinite(v[0]) || !uIsFinite(v[1]) || !uIsFinite(v[2]))
+			{
+				continue;
+			}
+			if(rangeMin > 0.0f || rangeMax > 0.0f)
+			{
+				float r = v[0]*v[0] + v[1]*v[1] + v[2]*v[2];
+				if((rangeMin > 0.0f && r < rangeMinSqr) || (rangeMax > 0.0f && r > rangeMaxSqr))
+				{
+					continue;
+				}
+			}
+			float * o = out + count*channels;
+			o[0] = v[0];
+			o[1] = v[1];
+			o[2] = v[2];
+			int c = 3;
+			if(fourth >= 0)
+			{
+				memcpy(&o[c++], p+fourth, sizeof(float));
+			}
+			if(hasNormals)
+			{
+				memcpy(&o[c], p+nx, sizeof(float));
+				memcpy(&o[c+1], p+ny, sizeof(float));
+				memcpy(&o[c+2], p+nz, sizeof(float));
+			}
+			++count;
+		}
+	}
+	if(count == 0)
+	{
+		return rtabmap::LaserScan();
+	}
+	return rtabmap::LaserScan(cv::Mat(data, cv::Range::all(), cv::Range(0, count)), maxPoints, maxRange, format, localTransform);
+}
+
 bool convertScan3dMsg(
 		const sensor_msgs::PointCloud2 & scan3dMsg,
 		const std::string & frameId,
@@ -2234,8 +4110,63 @@ bool convertScan3dMsg(
 			scanLocalTransform = sensorT * scanLocalTransform;
 		}
 	}
-	scan = rtabmap::util3d::laserScanFromPointCloud(scan3dMsg);
-	scan = rtabmap::LaserScan(scan, maxPoints, maxRange, scanLocalTransform);
+	scan = laserScanFromPointCloud2(scan3dMsg, scanLocalTransform, maxPoints, maxRange);
+	return true;
+}
+
+XmlRpc::XmlRpcValue getParameterTree(const ros::NodeHandle & nh)
+{
+	XmlRpc::XmlRpcValue tree;
+	if(!ros::param::get(nh.getNamespace(), tree) || tree.getType() != XmlRpc::XmlRpcValue::TypeStruct)
+	{
+		tree = XmlRpc::XmlRpcValue();
+		tree.begin(); // make it an empty struct
+	}
+	return tree;
+}
+
+bool getParameterFromTree(
+		XmlRpc::XmlRpcValue & tree,
+		const std::string & key,
+		std::string & value,
+		XmlRpc::XmlRpcValue::Type * type)
+{
+	XmlRpc::XmlRpcValue * v = &tree;
+	std::list<std::string> names = uSplit(key, '/');
+	for(std::list<std::string>::iterator iter=names.begin(); iter!=names.end(); ++iter)
+	{
+		if(iter->empty())
+		{
+			continue;
+		}
+		if(v->getType() != XmlRpc::XmlRpcValue::TypeStruct || !v->hasMember(*iter))
+		{
+			return false;
+		}
+		v = &(*v)[*iter];
+	}
+
+	switch(v->getType())
+	{
+	case XmlRpc::XmlRpcValue::TypeString:
+		value = static_cast<std::string>(*v);
+		break;
+	case XmlRpc::XmlRpcValue::TypeBoolean:
+		value = uBool2Str(static_cast<bool>(*v));
+		break;
+	case XmlRpc::XmlRpcValue::TypeDouble:
+		value = uNumber2Str(static_cast<double>(*v));
+		break;
+	case XmlRpc::XmlRpcValue::TypeInt:
+		value = uNumber2Str(double(static_cast<int>(*v)));
+		break;
+	default:
+		return false;
+	}
+	if(type)
+	{
+		*type = v->getType();
+	}
 	return true;
 }
 
@@ -0,0 +1,733 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <ros/ros.h>
+#include <rtabmap_ros/MsgConversion.h>
+#include <rtabmap_ros/RGBDImage.h>
+#include <sensor_msgs/point_cloud2_iterator.h>
+#include <tf/transform_listener.h>
+#include <cv_bridge/cv_bridge.h>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <rtabmap/core/Signature.h>
+#include <rtabmap/core/Compression.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UTimer.h>
+#include <rtabmap/utilite/UConversion.h>
+
+#include <boost/function.hpp>
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "AllocationCounter.h"
+
+void showUsage()
+{
+	printf("\nUsage:\n"
+			"rosrun rtabmap_ros msg_conversion_benchmark [options]\n"
+			"  Call the rtabmap_ros::MsgConversion hot paths on synthetic inputs of\n"
+			"  realistic sizes (1-6 cameras from VGA to 1080p, png/rvl depth compression,\n"
+			"  2D/3D scans, 1k-50k nodes graphs), then print a JSON report (calls/s, MB/s, allocations\n"
+			"  per call). A roscore should be running (a TF listener is used, it\n"
+			"  is filled with static transforms without TF topics).\n"
+			"Options:\n"
+			"  --iterations #       Calls per case (default 20), after one warm-up call.\n"
+			"  --filter \"text\"      Only run cases with this text in their name.\n"
+			"  --output \"file\"      Write the JSON report to this file instead of stdout.\n\n");
+	exit(1);
+}
+
+static const ros::Time kStamp(1000, 0);
+static const std::string kFrameId = "base_link";
+
+struct Result
+{
+	std::string name;
+	size_t inputBytes;
+	std::vector<float> ms;
+	unsigned long allocations;
+	unsigned long allocatedBytes;
+};
+
+class Benchmark
+{
+public:
+	Benchmark(int iterations, const std::string & filter) :
+		iterations_(iterations),
+		filter_(filter)
+	{}
+
+	bool enabled(const std::string & name) const
+	{
+		return filter_.empty() || name.find(filter_) != std::string::npos;
+	}
+
+	// inputBytes: size of the data converted in a call, to compute MB/s
+	void measure(const std::string & name, size_t inputBytes, const boost::function<void()> & call)
+	{
+		if(!enabled(name))
+		{
+			return;
+		}
+		Result result;
+		result.name = name;
+		result.inputBytes = inputBytes;
+		result.ms.reserve(iterations_);
+
+		// warm-up: caches and reused buffers of the conversions are initialized
+		call();
+
+		UTimer timer;
+		unsigned long allocationsStart = g_allocations;
+		unsigned long allocatedBytesStart = g_allocatedBytes;
+		for(int i=0; i<iterations_; ++i)
+		{
+			timer.restart();
+			call();
+			result.ms.push_back(timer.ticks()*1000.0f);
+		}
+		result.allocations = g_allocations - allocationsStart;
+		result.allocatedBytes = g_allocatedBytes - allocatedBytesStart;
+		results_.push_back(result);
+		fprintf(stderr, "%s: %f ms\n", name.c_str(), mean(result.ms));
+	}
+
+	void writeJson(FILE * f) const
+	{
+		fprintf(f, "{\n");
+		fprintf(f, "  \"iterations\": %d,\n", iterations_);
+		fprintf(f, "  \"cases\": [\n");
+		for(size_t i=0; i<results_.size(); ++i)
+		{
+			const Result & r = results_[i];
+			std::vector<float> v = r.ms;
+			std::sort(v.begin(), v.end());
+			double meanMs = mean(v);
+			fprintf(f, "    {\"name\": \"%s\", \"input_bytes\": %lu, \"mean_ms\": %f, \"p50_ms\": %f, \"p99_ms\": %f, "
+					"\"calls_per_second\": %f, \"mb_per_second\": %f, \"allocations_per_call\": %f, \"allocated_bytes_per_call\": %f}%s\n",
+					r.name.c_str(),
+					(unsigned long)r.inputBytes,
+					meanMs,
+					percentile(v, 0.5),
+					percentile(v, 0.99),
+					meanMs>0.0?1000.0/meanMs:0.0,
+					meanMs>0.0?double(r.inputBytes)/(1024.0*1024.0)/(meanMs/1000.0):0.0,
+					v.empty()?0.0:double(r.allocations)/double(v.size()),
+					v.empty()?0.0:double(r.allocatedBytes)/double(v.size()),
+					i+1<results_.size()?",":"");
+		}
+		fprintf(f, "  ]\n}\n");
+	}
+
+private:
+	static double mean(const std::vector<float> & v)
+	{
+		double sum = 0.0;
+		for(size_t i=0; i<v.size(); ++i)
+		{
+			sum += v[i];
+		}
+		return v.empty()?0.0:sum/double(v.size());
+	}
+	static float percentile(const std::vector<float> & sorted, double p)
+	{
+		if(sorted.empty())
+		{
+			return 0.0f;
+		}
+		size_t i = std::min(sorted.size()-1, (size_t)(p*double(sorted.size()-1)+0.5));
+		return sorted[i];
+	}
+
+private:
+	int iterations_;
+	std::string filter_;
+	std::vector<Result> results_;
+};
+
+// Synthetic inputs
+
+struct Resolution
+{
+	const char * name;
+	int width;
+	int height;
+};
+static const Resolution kResolutions[] = {{"vga", 640, 480}, {"720p", 1280, 720}, {"1080p", 1920, 1080}};
+static const int kResolutionsCount = sizeof(kResolutions)/sizeof(Resolution);
+
+// Smooth random image (compresses like a real image, unlike noise)
+cv::Mat syntheticImage(int width, int height, int type, double low, double high)
+{
+	cv::Mat small(std::max(1, height/16), std::max(1, width/16), type);
+	cv::randu(small, cv::Scalar::all(low), cv::Scalar::all(high));
+	cv::Mat image;
+	cv::resize(small, image, cv::Size(width, height), 0, 0, cv::INTER_LINEAR);
+	return image;
+}
+
+sensor_msgs::CameraInfo syntheticCameraInfo(int width, int height, const std::string & frameId, double baseline = 0.0)
+{
+	sensor_msgs::CameraInfo info;
+	info.header.stamp = kStamp;
+	info.header.frame_id = frameId;
+	info.width = width;
+	info.height = height;
+	info.distortion_model = "plumb_bob";
+	info.D.resize(5, 0.0);
+	double f = double(width)*0.8;
+	double cx = double(width)/2.0 - 0.5;
+	double cy = double(height)/2.0 - 0.5;
+	info.K[0] = f; info.K[2] = cx; info.K[4] = f; info.K[5] = cy; info.K[8] = 1.0;
+	info.R[0] = 1.0; info.R[4] = 1.0; info.R[8] = 1.0;
+	info.P[0] = f; info.P[2] = cx; info.P[3] = -f*baseline; info.P[5] = f; info.P[6] = cy; info.P[10] = 1.0;
+	return info;
+}
+
+cv_bridge::CvImageConstPtr syntheticCvImage(const cv::Mat & image, const std::string & encoding, const std::string & frameId)
+{
+	std_msgs::Header header;
+	header.stamp = kStamp;
+	header.frame_id = frameId;
+	return boost::make_shared<cv_bridge::CvImage>(header, encoding, image);
+}
+
+void addStaticTransform(tf::TransformListener & listener, const std::string & frameId, double x, double y, double z)
+{
+	listener.setTransform(tf::StampedTransform(
+			tf::Transform(tf::Quaternion(0, 0, 0, 1), tf::Vector3(x, y, z)),
+			kStamp,
+			kFrameId,
+			frameId));
+}
+
+sensor_msgs::LaserScan syntheticScan(int beams)
+{
+	sensor_msgs::LaserScan scan;
+	scan.header.stamp = kStamp;
+	scan.header.frame_id = "laser";
+	scan.angle_min = -M_PI;
+	scan.angle_increment = 2.0*M_PI/double(beams);
+	scan.angle_max = scan.angle_min + scan.angle_increment*double(beams-1);
+	scan.range_min = 0.1f;
+	scan.range_max = 30.0f;
+	cv::Mat ranges(1, beams, CV_32FC1);
+	cv::randu(ranges, cv::Scalar(0.5), cv::Scalar(20.0));
+	scan.ranges.assign((const float*)ranges.data, (const float*)ranges.data + beams);
+	// some beams without echo
+	for(int i=0; i<beams; i+=17)
+	{
+		scan.ranges[i] = std::numeric_limits<float>::infinity();
+	}
+	return scan;
+}
+
+sensor_msgs::PointCloud2 syntheticCloud(int rings, int columns)
+{
+	sensor_msgs::PointCloud2 cloud;
+	cloud.header.stamp = kStamp;
+	cloud.header.frame_id = "lidar";
+	sensor_msgs::PointCloud2Modifier modifier(cloud);
+	modifier.setPointCloud2Fields(4,
+			"x", 1, sensor_msgs::PointField::FLOAT32,
+			"y", 1, sensor_msgs::PointField::FLOAT32,
+			"z", 1, sensor_msgs::PointField::FLOAT32,
+			"intensity", 1, sensor_msgs::PointField::FLOAT32);
+	modifier.resize(rings*columns);
+	cv::Mat ranges(1, rings*columns, CV_32FC1);
+	cv::randu(ranges, cv::Scalar(0.5), cv::Scalar(50.0));
+	sensor_msgs::PointCloud2Iterator<float> iterX(cloud, "x");
+	sensor_msgs::PointCloud2Iterator<float> iterY(cloud, "y");
+	sensor_msgs::PointCloud2Iterator<float> iterZ(cloud, "z");
+	sensor_msgs::PointCloud2Iterator<float> iterI(cloud, "intensity");
+	for(int r=0; r<rings; ++r)
+	{
+		float elevation = -0.26f + 0.52f*float(r)/float(std::max(1, rings-1));
+		for(int c=0; c<columns; ++c, ++iterX, ++iterY, ++iterZ, ++iterI)
+		{
+			float range = ranges.at<float>(r*columns+c);
+			float azimuth = 2.0f*float(M_PI)*float(c)/float(columns);
+			if(c % 23 == 0)
+			{
+				// no echo
+				range = std::numeric_limits<float>::quiet_NaN();
+			}
+			*iterX = range*cos(elevation)*cos(azimuth);
+			*iterY = range*cos(elevation)*sin(azimuth);
+			*iterZ = range*sin(elevation);
+			*iterI = float(c%256);
+		}
+	}
+	return cloud;
+}
+
+std::vector<cv::KeyPoint> syntheticKeypoints(int count, int width, int height)
+{
+	std::vector<cv::KeyPoint> kpts(count);
+	for(int i=0; i<count; ++i)
+	{
+		kpts[i] = cv::KeyPoint(float(i*7919%width), float(i*104729%height), 31.0f, float(i%360), 0.001f*float(i%100), i%8, -1);
+	}
+	return kpts;
+}
+
+rtabmap::Signature syntheticNode(int id, int width, int height, int words)
+{
+	cv::Mat rgb = syntheticImage(width, height, CV_8UC3, 0, 255);
+	cv::Mat depth = syntheticImage(width, height, CV_16UC1, 500, 5000);
+	sensor_msgs::CameraInfo info = syntheticCameraInfo(width, height, "camera");
+	rtabmap::CameraModel model = rtabmap_ros::cameraModelFromROS(info, rtabmap::Transform(0,0,0.5,-M_PI/2,0,-M_PI/2));
+
+	cv::Mat scan(1, 1440, CV_32FC2);
+	cv::randu(scan, cv::Scalar::all(-20.0), cv::Scalar::all(20.0));
+
+	rtabmap::Signature s(
+			id,
+			1,
+			0,
+			kStamp.toSec()+double(id),
+			"",
+			rtabmap::Transform(float(id)*0.1f, 0, 0, 0, 0, 0),
+			rtabmap::Transform(),
+			rtabmap::SensorData(
+					rtabmap::LaserScan(rtabmap::compressData2(scan), 1440, 30.0f, rtabmap::LaserScan::kXY, rtabmap::Transform::getIdentity()),
+					rtabmap::compressImage2(rgb, ".jpg"),
+					rtabmap::compressImage2(depth, ".png"),
+					model,
+					id,
+					kStamp.toSec()+double(id)));
+
+	std::multimap<int, int> wordIds;
+	std::vector<cv::KeyPoint> kpts = syntheticKeypoints(words, width, height);
+	std::vector<cv::Point3f> pts(words);
+	cv::Mat descriptors(words, 32, CV_8UC1);
+	cv::randu(descriptors, cv::Scalar(0), cv::Scalar(255));
+	for(int i=0; i<words; ++i)
+	{
+		wordIds.insert(std::make_pair(id*words+i, i));
+		pts[i] = cv::Point3f(float(i%100)*0.05f, float(i%37)*0.05f, 1.0f + float(i%11)*0.2f);
+	}
+	s.setWords(wordIds, kpts, pts, descriptors);
+	return s;
+}
+
+void syntheticGraph(int nodes, std::map<int, rtabmap::Transform> & poses, std::multimap<int, rtabmap::Link> & links)
+{
+	cv::Mat information = cv::Mat::eye(6, 6, CV_64FC1)*100.0;
+	for(int i=1; i<=nodes; ++i)
+	{
+		// square loops of 200 nodes
+		float a = float(i%200)/200.0f*2.0f*float(M_PI);
+		poses.insert(std::make_pair(i, rtabmap::Transform(10.0f*cos(a), 10.0f*sin(a), 0.0f, 0.0f, 0.0f, a+float(M_PI)/2.0f)));
+		if(i>1)
+		{
+			links.insert(std::make_pair(i-1, rtabmap::Link(i-1, i, rtabmap::Link::kNeighbor, poses.at(i-1).inverse()*poses.at(i), information)));
+		}
+		if(i>200 && i%10 == 0)
+		{
+			links.insert(std::make_pair(i, rtabmap::Link(i, i-200, rtabmap::Link::kGlobalClosure, rtabmap::Transform::getIdentity(), information)));
+		}
+	}
+}
+
+// Calls as done by the nodes, outputs are not reused between calls
+
+void callRgbdImageFromROS(const rtabmap_ros::RGBDImageConstPtr & msg)
+{
+	rtabmap::SensorData data = rtabmap_ros::rgbdImageFromROS(msg);
+	UASSERT(!data.imageRaw().empty());
+}
+
+void callConvertRGBDMsgs(
+		const std::vector<cv_bridge::CvImageConstPtr> & images,
+		const std::vector<cv_bridge::CvImageConstPtr> & depths,
+		const std::vector<sensor_msgs::CameraInfo> & infos,
+		tf::TransformListener * listener)
+{
+	cv::Mat rgb;
+	cv::Mat depth;
+	std::vector<rtabmap::CameraModel> models;
+	bool ok = rtabmap_ros::convertRGBDMsgs(images, depths, infos, kFrameId, "", ros::Time(), rgb, depth, models, *listener, 0.0);
+	UASSERT(ok);
+}
+
+void callConvertStereoMsg(
+		const cv_bridge::CvImageConstPtr & left,
+		const cv_bridge::CvImageConstPtr & right,
+		const sensor_msgs::CameraInfo & leftInfo,
+		const sensor_msgs::CameraInfo & rightInfo,
+		tf::TransformListener * listener)
+{
+	cv::Mat leftOut;
+	cv::Mat rightOut;
+	rtabmap::StereoCameraModel model;
+	bool ok = rtabmap_ros::convertStereoMsg(left, right, leftInfo, rightInfo, kFrameId, "", ros::Time(), leftOut, rightOut, model, *listener, 0.0, true);
+	UASSERT(ok);
+}
+
+void callDepthToCompressedMsg(const cv::Mat & depth, const std::string & format)
+{
+	sensor_msgs::CompressedImage msg;
+	rtabmap_ros::depthToCompressedMsg(depth, format, msg);
+	UASSERT(!msg.data.empty());
+}
+
+void callDepthFromCompressedMsg(const sensor_msgs::CompressedImage & msg)
+{
+	cv::Mat depth = rtabmap_ros::depthFromCompressedMsg(msg);
+	UASSERT(!depth.empty());
+}
+
+void callConvertScanMsg(const sensor_msgs::LaserScan & msg, tf::TransformListener * listener)
+{
+	rtabmap::LaserScan scan;
+	bool ok = rtabmap_ros::convertScanMsg(msg, kFrameId, "", ros::Time(), scan, *listener, 0.0);
+	UASSERT(ok);
+}
+
+void callConvertScan3dMsg(const sensor_msgs::PointCloud2 & msg, tf::TransformListener * listener)
+{
+	rtabmap::LaserScan scan;
+	bool ok = rtabmap_ros::convertScan3dMsg(msg, kFrameId, "", ros::Time(), scan, *listener, 0.0);
+	UASSERT(ok);
+}
+
+void callNodeDataToROS(const rtabmap::Signature & s, int wordsPacking)
+{
+	rtabmap_ros::NodeData msg;
+	rtabmap_ros::nodeDataToROS(s, msg, wordsPacking);
+}
+
+void callNodeDataFromROS(const rtabmap_ros::NodeDataConstPtr & msg)
+{
+	rtabmap::Signature s = rtabmap_ros::nodeDataFromROS(*msg, msg);
+	UASSERT(s.id() == msg->id);
+}
+
+void callKeypointsToROS(const std::vector<cv::KeyPoint> & kpts)
+{
+	std::vector<rtabmap_ros::KeyPoint> msg;
+	rtabmap_ros::keypointsToROS(kpts, msg);
+}
+
+void callMapDataToROS(
+		const std::map<int, rtabmap::Transform> & poses,
+		const std::multimap<int, rtabmap::Link> & links,
+		const std::map<int, rtabmap::Signature> & signatures,
+		int graphPacking)
+{
+	rtabmap_ros::MapData msg;
+	rtabmap_ros::mapDataToROS(poses, links, signatures, rtabmap::Transform::getIdentity(), msg, 0, graphPacking);
+}
+
+void callMapGraphFromROS(const rtabmap_ros::MapGraph & msg)
+{
+	std::map<int, rtabmap::Transform> poses;
+	std::multimap<int, rtabmap::Link> links;
+	rtabmap::Transform mapToOdom;
+	rtabmap_ros::mapGraphFromROS(msg, poses, links, mapToOdom);
+}
+
+int main(int argc, char * argv[])
+{
+	ULogger::setType(ULogger::kTypeConsole);
+	ULogger::setLevel(ULogger::kWarning);
+
+	int iterations = 20;
+	std::string filter;
+	std::string outputPath;
+	for(int i=1; i<argc; ++i)
+	{
+		if(strcmp(argv[i], "--iterations") == 0 && i+1 < argc)
+		{
+			iterations = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "--filter") == 0 && i+1 < argc)
+		{
+			filter = argv[++i];
+		}
+		else if(strcmp(argv[i], "--output") == 0 && i+1 < argc)
+		{
+			outputPath = argv[++i];
+		}
+		else if(strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0)
+		{
+			showUsage();
+		}
+	}
+	if(iterations <= 0)
+	{
+		printf("--iterations should be > 0.\n");
+		showUsage();
+	}
+
+	ros::init(argc, argv, "msg_conversion_benchmark", ros::init_options::AnonymousName);
+	tf::TransformListener listener;
+	addStaticTransform(listener, "laser", 0.2, 0, 0.3);
+	addStaticTransform(listener, "lidar", 0, 0, 0.8);
+	addStaticTransform(listener, "stereo_camera", 0.1, 0, 0.5);
+
+	Benchmark benchmark(iterations, filter);
+
+	// RGB-D, single camera in a RGBDImage message
+	for(int r=0; r<kResolutionsCount; ++r)
+	{
+		const Resolution & res = kResolutions[r];
+		std::string name = uFormat("rgbdImageFromROS/%s", res.name);
+		if(!benchmark.enabled(name))
+		{
+			continue;
+		}
+		rtabmap_ros::RGBDImagePtr msg(new rtabmap_ros::RGBDImage);
+		msg->header.stamp = kStamp;
+		msg->header.frame_id = "camera";
+		syntheticCvImage(syntheticImage(res.width, res.height, CV_8UC3, 0, 255), "bgr8", "camera")->toImageMsg(msg->rgb);
+		syntheticCvImage(syntheticImage(res.width, res.height, CV_16UC1, 500, 5000), "16UC1", "camera")->toImageMsg(msg->depth);
+		msg->rgb_camera_info = syntheticCameraInfo(res.width, res.height, "camera");
+		msg->depth_camera_info = msg->rgb_camera_info;
+		benchmark.measure(name, msg->rgb.data.size()+msg->depth.data.size(),
+				boost::bind(&callRgbdImageFromROS, rtabmap_ros::RGBDImageConstPtr(msg)));
+	}
+
+	// RGB-D, 1 to 6 cameras
+	int cameraCounts[] = {1, 2, 6};
+	for(int c=0; c<3; ++c)
+	{
+		for(int r=0; r<kResolutionsCount; ++r)
+		{
+			const Resolution & res = kResolutions[r];
+			std::string name = uFormat("convertRGBDMsgs/%dcam/%s", cameraCounts[c], res.name);
+			if(!benchmark.enabled(name))
+			{
+				continue;
+			}
+			std::vector<cv_bridge::CvImageConstPtr> images;
+			std::vector<cv_bridge::CvImageConstPtr> depths;
+			std::vector<sensor_msgs::CameraInfo> infos;
+			size_t bytes = 0;
+			for(int i=0; i<cameraCounts[c]; ++i)
+			{
+				std::string frameId = uFormat("camera%d", i);
+				addStaticTransform(listener, frameId, 0, 0.1*i, 0.5);
+				images.push_back(syntheticCvImage(syntheticImage(res.width, res.height, CV_8UC3, 0, 255), "bgr8", frameId));
+				depths.push_back(syntheticCvImage(syntheticImage(res.width, res.height, CV_16UC1, 500, 5000), "16UC1", frameId));
+				infos.push_back(syntheticCameraInfo(res.width, res.height, frameId));
+				bytes += images.back()->image.total()*images.back()->image.elemSize() +
+						depths.back()->image.total()*depths.back()->image.elemSize();
+			}
+			benchmark.measure(name, bytes,
+					boost::bind(&callConvertRGBDMsgs, boost::cref(images), boost::cref(depths), boost::cref(infos), &listener));
+		}
+	}
+
+	// Stereo
+	for(int r=0; r<kResolutionsCount; ++r)
+	{
+		const Resolution & res = kResolutions[r];
+		std::string name = uFormat("convertStereoMsg/%s", res.name);
+		if(!benchmark.enabled(name))
+		{
+			continue;
+		}
+		cv_bridge::CvImageConstPtr left = syntheticCvImage(syntheticImage(res.width, res.height, CV_8UC1, 0, 255), "mono8", "stereo_camera");
+		cv_bridge::CvImageConstPtr right = syntheticCvImage(syntheticImage(res.width, res.height, CV_8UC1, 0, 255), "mono8", "stereo_camera");
+		sensor_msgs::CameraInfo leftInfo = syntheticCameraInfo(res.width, res.height, "stereo_camera");
+		sensor_msgs::CameraInfo rightInfo = syntheticCameraInfo(res.width, res.height, "stereo_camera", 0.12);
+		benchmark.measure(name, 2*left->image.total(),
+				boost::bind(&callConvertStereoMsg, left, right, boost::cref(leftInfo), boost::cref(rightInfo), &listener));
+	}
+
+	// Depth compression (RGBDImage depth_compressed), RVL against PNG
+	const char * depthFormats[] = {"png", "rvl"};
+	for(int r=0; r<kResolutionsCount; ++r)
+	{
+		const Resolution & res = kResolutions[r];
+		cv::Mat depth;
+		for(int f=0; f<2; ++f)
+		{
+			std::string encodeName = uFormat("depthToCompressedMsg/%s/%s", depthFormats[f], res.name);
+			std::string decodeName = uFormat("depthFromCompressedMsg/%s/%s", depthFormats[f], res.name);
+			if(!benchmark.enabled(encodeName) && !benchmark.enabled(decodeName))
+			{
+				continue;
+			}
+			if(depth.empty())
+			{
+				// depth with invalid pixels like a real camera
+				depth = syntheticImage(res.width, res.height, CV_16UC1, 500, 5000);
+				cv::Mat holes = syntheticImage(res.width, res.height, CV_8UC1, 0, 255);
+				depth.setTo(0, holes < 64);
+			}
+			sensor_msgs::CompressedImage msg;
+			rtabmap_ros::depthToCompressedMsg(depth, depthFormats[f], msg);
+			fprintf(stderr, "depth %s/%s: %d bytes (%.1f%% of raw)\n", depthFormats[f], res.name,
+					(int)msg.data.size(), 100.0*double(msg.data.size())/double(depth.total()*depth.elemSize()));
+			benchmark.measure(encodeName, depth.total()*depth.elemSize(),
+					boost::bind(&callDepthToCompressedMsg, boost::cref(depth), std::string(depthFormats[f])));
+			benchmark.measure(decodeName, depth.total()*depth.elemSize(),
+					boost::bind(&callDepthFromCompressedMsg, msg));
+		}
+	}
+
+	// 2D scans
+	int beams[] = {360, 1081, 4000};
+	for(int i=0; i<3; ++i)
+	{
+		std::string name = uFormat("convertScanMsg/%dbeams", beams[i]);
+		if(!benchmark.enabled(name))
+		{
+			continue;
+		}
+		sensor_msgs::LaserScan scan = syntheticScan(beams[i]);
+		benchmark.measure(name, scan.ranges.size()*sizeof(float),
+				boost::bind(&callConvertScanMsg, boost::cref(scan), &listener));
+	}
+
+	// 3D scans: VLP-16, 64 and 128 rings lidars
+	int rings[] = {16, 64, 128};
+	int columns[] = {1800, 1024, 1024};
+	for(int i=0; i<3; ++i)
+	{
+		std::string name = uFormat("convertScan3dMsg/%dx%d", rings[i], columns[i]);
+		if(!benchmark.enabled(name))
+		{
+			continue;
+		}
+		sensor_msgs::PointCloud2 cloud = syntheticCloud(rings[i], columns[i]);
+		benchmark.measure(name, cloud.data.size(),
+				boost::bind(&callConvertScan3dMsg, boost::cref(cloud), &listener));
+	}
+
+	// Nodes
+	for(int r=0; r<kResolutionsCount; ++r)
+	{
+		const Resolution & res = kResolutions[r];
+		bool enabled = false;
+		for(int wordsPacking=0; wordsPacking<=2 && !enabled; ++wordsPacking)
+		{
+			enabled = benchmark.enabled(uFormat("nodeDataToROS/%s/words_packing=%d", res.name, wordsPacking)) ||
+					benchmark.enabled(uFormat("nodeDataFromROS/%s/words_packing=%d", res.name, wordsPacking));
+		}
+		if(!enabled)
+		{
+			continue;
+		}
+		rtabmap::Signature s = syntheticNode(1, res.width, res.height, 1000);
+		for(int wordsPacking=0; wordsPacking<=2; ++wordsPacking)
+		{
+			rtabmap_ros::NodeDataPtr msg(new rtabmap_ros::NodeData);
+			rtabmap_ros::nodeDataToROS(s, *msg, wordsPacking);
+			size_t bytes = ros::serialization::serializationLength(*msg);
+			benchmark.measure(uFormat("nodeDataToROS/%s/words_packing=%d", res.name, wordsPacking), bytes,
+					boost::bind(&callNodeDataToROS, boost::cref(s), wordsPacking));
+			benchmark.measure(uFormat("nodeDataFromROS/%s/words_packing=%d", res.name, wordsPacking), bytes,
+					boost::bind(&callNodeDataFromROS, rtabmap_ros::NodeDataConstPtr(msg)));
+		}
+	}
+
+	// Features
+	int keypointCounts[] = {1000, 5000, 20000};
+	for(int i=0; i<3; ++i)
+	{
+		std::string name = uFormat("keypointsToROS/%d", keypointCounts[i]);
+		if(!benchmark.enabled(name))
+		{
+			continue;
+		}
+		std::vector<cv::KeyPoint> kpts = syntheticKeypoints(keypointCounts[i], 640, 480);
+		benchmark.measure(name, kpts.size()*sizeof(cv::KeyPoint),
+				boost::bind(&callKeypointsToROS, boost::cref(kpts)));
+	}
+
+	// Graphs
+	int graphSizes[] = {1000, 10000, 50000};
+	for(int i=0; i<3; ++i)
+	{
+		std::map<int, rtabmap::Transform> poses;
+		std::multimap<int, rtabmap::Link> links;
+		std::map<int, rtabmap::Signature> signatures;
+		syntheticGraph(graphSizes[i], poses, links);
+		for(int graphPacking=0; graphPacking<=2; ++graphPacking)
+		{
+			rtabmap_ros::MapGraph msg;
+			rtabmap_ros::mapGraphToROS(poses, links, rtabmap::Transform::getIdentity(), msg, graphPacking);
+			size_t bytes = ros::serialization::serializationLength(msg);
+			benchmark.measure(uFormat("mapDataToROS/%dnodes/graph_packing=%d", graphSizes[i], graphPacking), bytes,
+					boost::bind(&callMapDataToROS, boost::cref(poses), boost::cref(links), boost::cref(signatures), graphPacking));
+			benchmark.measure(uFormat("mapGraphFromROS/%dnodes/graph_packing=%d", graphSizes[i], graphPacking), bytes,
+					boost::bind(&callMapGraphFromROS, boost::cref(msg)));
+		}
+	}
+	if(benchmark.enabled("mapDataToROS/100nodes_vga"))
+	{
+		// graph with data, like get_map_data service
+		std::map<int, rtabmap::Transform> poses;
+		std::multimap<int, rtabmap::Link> links;
+		std::map<int, rtabmap::Signature> signatures;
+		syntheticGraph(100, poses, links);
+		size_t bytes = 0;
+		for(std::map<int, rtabmap::Transform>::iterator iter=poses.begin(); iter!=poses.end(); ++iter)
+		{
+			signatures.insert(std::make_pair(iter->first, syntheticNode(iter->first, 640, 480, 500)));
+			rtabmap_ros::NodeData msg;
+			rtabmap_ros::nodeDataToROS(signatures.at(iter->first), msg);
+			bytes += ros::serialization::serializationLength(msg);
+		}
+		benchmark.measure("mapDataToROS/100nodes_vga", bytes,
+				boost::bind(&callMapDataToROS, boost::cref(poses), boost::cref(links), boost::cref(signatures), 0));
+	}
+
+	FILE * f = stdout;
+	if(!outputPath.empty())
+	{
+		f = fopen(outputPath.c_str(), "w");
+		if(f == 0)
+		{
+			printf("Cannot open \"%s\" for writing.\n", outputPath.c_str());
+			return -1;
+		}
+	}
+	benchmark.writeJson(f);
+	if(f != stdout)
+	{
+		fclose(f);
+	}
+
+	return 0;
+}
@@ -0,0 +1,223 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "rtabmap_ros/NodeletDiagnostics.h"
+#include <rtabmap/utilite/UConversion.h>
+#include <algorithm>
+#include <boost/bind.hpp>
+
+namespace rtabmap_ros {
+
+void DiagnosticsPublisher::start(ros::NodeHandle & nh, double period, const StatusCallback & callback)
+{
+	callback_ = callback;
+	pub_ = nh.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+	lastTime_ = ros::WallTime::now();
+	timer_ = nh.createWallTimer(ros::WallDuration(period), &DiagnosticsPublisher::timerCallback, this);
+}
+
+void DiagnosticsPublisher::stop()
+{
+	timer_.stop();
+}
+
+void DiagnosticsPublisher::timerCallback(const ros::WallTimerEvent &)
+{
+	ros::WallTime now = ros::WallTime::now();
+	double period = (now - lastTime_).toSec();
+	lastTime_ = now;
+
+	diagnostic_msgs::DiagnosticArray diagnostics;
+	diagnostics.header.stamp = ros::Time::now();
+	diagnostics.status.resize(1);
+	callback_(diagnostics.status[0], period);
+	pub_.publish(diagnostics);
+}
+
+NodeletDiagnostics::NodeletDiagnostics() :
+	period_(0.0),
+	inputs_(0),
+	outputs_(0),
+	dropped_(0),
+	lost_(0),
+	latencySum_(0.0),
+	latencyMax_(0.0),
+	processingTimeMax_(0.0),
+	processingTimes_(200),
+	lastSeq_(0),
+	totalDropped_(0)
+{
+}
+
+void NodeletDiagnostics::init(ros::NodeHandle & nh, ros::NodeHandle & pnh, const std::string & name)
+{
+	name_ = name;
+	period_ = 1.0;
+	pnh.param("diagnostics_period", period_, period_);
+	ROS_INFO("%s: diagnostics_period = %f s", name.c_str(), period_);
+
+	if(period_ > 0.0)
+	{
+		publisher_.start(nh, period_, boost::bind(&NodeletDiagnostics::fillStatus, this, _1, _2));
+	}
+}
+
+void NodeletDiagnostics::tickInput(const std_msgs::Header & header)
+{
+	if(!enabled())
+	{
+		return;
+	}
+	boost::mutex::scoped_lock lock(mutex_);
+	++inputs_;
+	// seq is not always set by the publishers, and restarts from 0 if the publisher restarts
+	if(lastSeq_ > 0 && header.seq > lastSeq_+1)
+	{
+		lost_ += header.seq - lastSeq_ - 1;
+	}
+	lastSeq_ = header.seq;
+}
+
+void NodeletDiagnostics::tickInput()
+{
+	if(!enabled())
+	{
+		return;
+	}
+	boost::mutex::scoped_lock lock(mutex_);
+	++inputs_;
+}
+
+void NodeletDiagnostics::tickDrop(unsigned int count)
+{
+	if(!enabled())
+	{
+		return;
+	}
+	boost::mutex::scoped_lock lock(mutex_);
+	dropped_ += count;
+}
+
+void NodeletDiagnostics::tickOutput(const ros::Time & inputStamp)
+{
+	if(!enabled())
+	{
+		return;
+	}
+	double latency = inputStamp.isZero()?0.0:(ros::Time::now() - inputStamp).toSec();
+	boost::mutex::scoped_lock lock(mutex_);
+	++outputs_;
+	latencySum_ += latency;
+	latencyMax_ = std::max(latencyMax_, latency);
+}
+
+void NodeletDiagnostics::addProcessingTime(double seconds)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	processingTimes_.add(float(seconds));
+	processingTimeMax_ = std::max(processingTimeMax_, seconds);
+}
+
+void NodeletDiagnostics::fillStatus(diagnostic_msgs::DiagnosticStatus & status, double period)
+{
+	static const float ratios[] = {0.5f, 0.95f, 0.99f};
+
+	status.name = name_ + ": Performance";
+	status.hardware_id = name_;
+
+	boost::mutex::scoped_lock lock(mutex_);
+	std::vector<float> times = processingTimes_.percentiles(ratios, 3);
+	totalDropped_ += dropped_ + lost_;
+
+	diagnostic_msgs::KeyValue value;
+	value.key = "Input rate (Hz)";
+	value.value = uNumber2Str(period>0.0?double(inputs_)/period:0.0);
+	status.values.push_back(value);
+	value.key = "Output rate (Hz)";
+	value.value = uNumber2Str(period>0.0?double(outputs_)/period:0.0);
+	status.values.push_back(value);
+	value.key = "Dropped";
+	value.value = uNumber2Str((unsigned int)dropped_);
+	status.values.push_back(value);
+	value.key = "Lost before callback";
+	value.value = uNumber2Str((unsigned int)lost_);
+	status.values.push_back(value);
+	value.key = "Dropped total";
+	value.value = uNumber2Str((unsigned int)totalDropped_);
+	status.values.push_back(value);
+	value.key = "Processing time p50 (ms)";
+	value.value = uNumber2Str(times[0]*1000.0f);
+	status.values.push_back(value);
+	value.key = "Processing time p95 (ms)";
+	value.value = uNumber2Str(times[1]*1000.0f);
+	status.values.push_back(value);
+	value.key = "Processing time p99 (ms)";
+	value.value = uNumber2Str(times[2]*1000.0f);
+	status.values.push_back(value);
+	value.key = "Processing time max (ms)";
+	value.value = uNumber2Str(processingTimeMax_*1000.0);
+	status.values.push_back(value);
+	value.key = "Latency mean (s)";
+	value.value = uNumber2Str(outputs_?latencySum_/double(outputs_):0.0);
+	status.values.push_back(value);
+	value.key = "Latency max (s)";
+	value.value = uNumber2Str(latencyMax_);
+	status.values.push_back(value);
+
+	if(inputs_ == 0)
+	{
+		status.level = diagnostic_msgs::DiagnosticStatus::OK;
+		status.message = "No input";
+	}
+	else if(dropped_ + lost_ > 0)
+	{
+		status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+		status.message = uFormat("%d inputs dropped in the last %f s", (int)(dropped_ + lost_), period);
+	}
+	else if(times[1] > period/double(inputs_))
+	{
+		// the next inputs will be dropped
+		status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+		status.message = "Processing time is higher than the input period";
+	}
+	else
+	{
+		status.level = diagnostic_msgs::DiagnosticStatus::OK;
+		status.message = "OK";
+	}
+
+	inputs_ = 0;
+	outputs_ = 0;
+	dropped_ = 0;
+	lost_ = 0;
+	latencySum_ = 0.0;
+	latencyMax_ = 0.0;
+	processingTimeMax_ = 0.0;
+}
+
+}
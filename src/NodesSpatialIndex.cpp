@@ -0,0 +1,207 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rtabmap_ros/NodesSpatialIndex.h"
+#include <rtabmap/utilite/ULogger.h>
+#include <cmath>
+#include <algorithm>
+
+namespace rtabmap_ros {
+
+NodesSpatialIndex::NodesSpatialIndex(float cellSize) :
+		cellSize_(cellSize)
+{
+	UASSERT(cellSize_ > 0.0f);
+}
+
+void NodesSpatialIndex::clear()
+{
+	poses_.clear();
+	cells_.clear();
+}
+
+int NodesSpatialIndex::update(const std::map<int, rtabmap::Transform> & poses)
+{
+	int changes = 0;
+	std::map<int, rtabmap::Transform>::iterator iter = poses_.begin();
+	std::map<int, rtabmap::Transform>::const_iterator jter = poses.begin();
+	// both maps are sorted by id
+	while(iter != poses_.end() || jter != poses.end())
+	{
+		if(jter == poses.end() || (iter != poses_.end() && iter->first < jter->first))
+		{
+			// removed
+			remove(iter->first, iter->second);
+			poses_.erase(iter++);
+			++changes;
+		}
+		else if(iter == poses_.end() || jter->first < iter->first)
+		{
+			// added
+			if(!jter->second.isNull())
+			{
+				insert(jter->first, jter->second);
+				poses_.insert(iter, *jter);
+				++changes;
+			}
+			++jter;
+		}
+		else
+		{
+			if(jter->second.isNull())
+			{
+				remove(iter->first, iter->second);
+				poses_.erase(iter++);
+				++changes;
+			}
+			else
+			{
+				if(iter->second.x() != jter->second.x() ||
+				   iter->second.y() != jter->second.y() ||
+				   iter->second.z() != jter->second.z())
+				{
+					// moved
+					CellKey oldKey = key(iter->second);
+					CellKey newKey = key(jter->second);
+					if(oldKey < newKey || newKey < oldKey)
+					{
+						remove(iter->first, iter->second);
+						insert(jter->first, jter->second);
+					}
+					++changes;
+				}
+				iter->second = jter->second;
+				++iter;
+			}
+			++jter;
+		}
+	}
+	return changes;
+}
+
+std::map<int, rtabmap::Transform> NodesSpatialIndex::radiusSearch(
+		const rtabmap::Transform & position,
+		float radius,
+		int ignoredId) const
+{
+	std::map<int, rtabmap::Transform> output;
+	if(radius <= 0.0f || poses_.empty())
+	{
+		return output;
+	}
+	CellKey minKey = key(rtabmap::Transform(position.x()-radius, position.y()-radius, position.z()-radius, 0,0,0));
+	CellKey maxKey = key(rtabmap::Transform(position.x()+radius, position.y()+radius, position.z()+radius, 0,0,0));
+	float radiusSqr = radius*radius;
+	for(int x=minKey.x; x<=maxKey.x; ++x)
+	{
+		for(int y=minKey.y; y<=maxKey.y; ++y)
+		{
+			// z is ordered last in the key, iterate the cells of this column
+			std::map<CellKey, std::vector<int> >::const_iterator iter = cells_.lower_bound(CellKey(x, y, minKey.z));
+			for(; iter!=cells_.end() && iter->first.x == x && iter->first.y == y && iter->first.z <= maxKey.z; ++iter)
+			{
+				for(size_t i=0; i<iter->second.size(); ++i)
+				{
+					int id = iter->second[i];
+					if(id != ignoredId)
+					{
+						const rtabmap::Transform & pose = poses_.at(id);
+						if(pose.getDistanceSquared(position) < radiusSqr)
+						{
+							output.insert(std::make_pair(id, pose));
+						}
+					}
+				}
+			}
+		}
+	}
+	return output;
+}
+
+int NodesSpatialIndex::nearest(const rtabmap::Transform & position, float maxRadius) const
+{
+	// increase search radius until a node is found
+	float radius = cellSize_;
+	while(!poses_.empty())
+	{
+		float searchRadius = std::min(radius, maxRadius);
+		std::map<int, rtabmap::Transform> nodes = radiusSearch(position, searchRadius);
+		if(!nodes.empty())
+		{
+			int nearestId = 0;
+			float nearestDistSqr = 0.0f;
+			for(std::map<int, rtabmap::Transform>::iterator iter=nodes.begin(); iter!=nodes.end(); ++iter)
+			{
+				float d = iter->second.getDistanceSquared(position);
+				if(nearestId == 0 || d < nearestDistSqr)
+				{
+					nearestId = iter->first;
+					nearestDistSqr = d;
+				}
+			}
+			return nearestId;
+		}
+		if(searchRadius >= maxRadius)
+		{
+			break;
+		}
+		radius *= 2.0f;
+	}
+	return 0;
+}
+
+NodesSpatialIndex::CellKey NodesSpatialIndex::key(const rtabmap::Transform & t) const
+{
+	return CellKey(
+			(int)std::floor(t.x()/cellSize_),
+			(int)std::floor(t.y()/cellSize_),
+			(int)std::floor(t.z()/cellSize_));
+}
+
+void NodesSpatialIndex::insert(int id, const rtabmap::Transform & pose)
+{
+	cells_[key(pose)].push_back(id);
+}
+
+void NodesSpatialIndex::remove(int id, const rtabmap::Transform & pose)
+{
+	std::map<CellKey, std::vector<int> >::iterator iter = cells_.find(key(pose));
+	if(iter != cells_.end())
+	{
+		std::vector<int>::iterator jter = std::find(iter->second.begin(), iter->second.end(), id);
+		if(jter != iter->second.end())
+		{
+			iter->second.erase(jter);
+		}
+		if(iter->second.empty())
+		{
+			cells_.erase(iter);
+		}
+	}
+}
+
+}
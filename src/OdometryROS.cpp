@@ -35,6 +35,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <pcl_conversions/pcl_conversions.h>
 
 #include <cv_bridge/cv_bridge.h>
+#include <opencv2/imgproc/imgproc.hpp>
 
 #include <rtabmap/core/odometry/OdometryF2M.h>
 #include <rtabmap/core/odometry/OdometryF2F.h>
@@ -42,13 +43,18 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/core/util3d_transforms.h>
 #include <rtabmap/core/Memory.h>
 #include <rtabmap/core/Signature.h>
+#include <rtabmap/core/Features2d.h>
+#include <rtabmap/core/util2d.h>
 #include "rtabmap_ros/MsgConversion.h"
+#include "rtabmap_ros/StaticTransformCache.h"
+#include "rtabmap_ros/SensorDataHandoff.h"
 #include "rtabmap_ros/OdomInfo.h"
 #include "rtabmap/utilite/UConversion.h"
 #include "rtabmap/utilite/ULogger.h"
 #include "rtabmap/utilite/UStl.h"
 #include "rtabmap/utilite/UFile.h"
 #include "rtabmap/utilite/UMath.h"
+#include "rtabmap/utilite/UTimer.h"
 
 #define BAD_COVARIANCE 9999
 
@@ -72,6 +78,7 @@ OdometryROS::OdometryROS(bool stereoParams, bool visParams, bool icpParams) :
 	waitForTransform_(true),
 	waitForTransformDuration_(0.1), // 100 ms
 	publishNullWhenLost_(true),
+	tfStaticCache_(0),
 	paused_(false),
 	resetCountdown_(0),
 	resetCurrentCount_(0),
@@ -83,7 +90,24 @@ OdometryROS::OdometryROS(bool stereoParams, bool visParams, bool icpParams) :
 	maxUpdateRate_(0.0),
 	odomStrategy_(Parameters::defaultOdomStrategy()),
 	waitIMUToinit_(false),
-	imuProcessed_(false)
+	imuProcessed_(false),
+	pipelineDepth_(0),
+	pipelineFeatures_(0),
+	pipelineThread_(0),
+	pipelineRunning_(false),
+	auxThread_(0),
+	auxRunning_(false),
+	adaptiveFrameDropping_(false),
+	minUpdateRate_(1.0),
+	processingTime_(0.0),
+	minLatency_(-1.0),
+	minLatencyPrevious_(-1.0),
+	minLatencyWindowStamp_(0.0),
+	lastAdmittedStamp_(0.0),
+	framesDropped_(0),
+	framesDroppedTotal_(0),
+	effectiveRate_(0.0f),
+	guessOdoms_(100)
 {
 
 }
@@ -96,6 +120,27 @@ OdometryROS::~OdometryROS()
 		warningThread_->join();
 		delete warningThread_;
 	}
+	if(pipelineThread_)
+	{
+		{
+			boost::mutex::scoped_lock lock(pipelineMutex_);
+			pipelineRunning_ = false;
+		}
+		pipelineCondition_.notify_all();
+		pipelineThread_->join();
+		delete pipelineThread_;
+	}
+	delete pipelineFeatures_;
+	if(auxThread_)
+	{
+		{
+			boost::mutex::scoped_lock lock(auxMutex_);
+			auxRunning_ = false;
+		}
+		auxCondition_.notify_all();
+		auxThread_->join();
+		delete auxThread_;
+	}
 	ros::NodeHandle & pnh = getPrivateNodeHandle();
 	if(pnh.ok())
 	{
@@ -106,10 +151,12 @@ OdometryROS::~OdometryROS()
 	}
 
 	delete odometry_;
+	delete tfStaticCache_;
 }
 
 void OdometryROS::onInit()
 {
+	UTimer initTimer;
 	ros::NodeHandle & nh = getNodeHandle();
 	ros::NodeHandle & pnh = getPrivateNodeHandle();
 
@@ -120,6 +167,7 @@ void OdometryROS::onInit()
 	odomLocalScanMap_ = nh.advertise<sensor_msgs::PointCloud2>("odom_local_scan_map", 1);
 	odomLastFrame_ = nh.advertise<sensor_msgs::PointCloud2>("odom_last_frame", 1);
 	odomRgbdImagePub_ = nh.advertise<rtabmap_ros::RGBDImage>("odom_rgbd_image", 1);
+	diagnostics_.init(nh, pnh, getName());
 
 	Transform initialPose = Transform::getIdentity();
 	std::string initialPoseStr;
@@ -133,6 +181,12 @@ void OdometryROS::onInit()
 	}
 	pnh.param("wait_for_transform", waitForTransform_, waitForTransform_);
 	pnh.param("wait_for_transform_duration",  waitForTransformDuration_, waitForTransformDuration_);
+	bool tfStaticCache = false;
+	pnh.param("tf_static_cache", tfStaticCache, tfStaticCache);
+	if(tfStaticCache)
+	{
+		tfStaticCache_ = new StaticTransformCache(nh, tfListener_);
+	}
 	pnh.param("initial_pose", initialPoseStr, initialPoseStr); // "x y z roll pitch yaw"
 	pnh.param("ground_truth_frame_id", groundTruthFrameId_, groundTruthFrameId_);
 	pnh.param("ground_truth_base_frame_id", groundTruthBaseFrameId_, frameId_);
@@ -153,11 +207,20 @@ void OdometryROS::onInit()
 	pnh.param("guess_min_translation", guessMinTranslation_, guessMinTranslation_);
 	pnh.param("guess_min_rotation", guessMinRotation_, guessMinRotation_);
 	pnh.param("guess_min_time", guessMinTime_, guessMinTime_);
+	bool guessFromOdomTopic = false;
+	pnh.param("guess_from_odom_topic", guessFromOdomTopic, guessFromOdomTopic);
 
 	pnh.param("expected_update_rate", expectedUpdateRate_, expectedUpdateRate_); // expected sensor rate
 	pnh.param("max_update_rate", maxUpdateRate_, maxUpdateRate_);
 
 	pnh.param("wait_imu_to_init", waitIMUToinit_, waitIMUToinit_);
+	pnh.param("pipeline_depth", pipelineDepth_, pipelineDepth_);
+	bool pipelineFeatures = true;
+	pnh.param("pipeline_features", pipelineFeatures, pipelineFeatures);
+	bool publishAuxAsync = false;
+	pnh.param("publish_aux_async", publishAuxAsync, publishAuxAsync);
+	pnh.param("adaptive_frame_dropping", adaptiveFrameDropping_, adaptiveFrameDropping_);
+	pnh.param("min_update_rate", minUpdateRate_, minUpdateRate_);
 
 	if(publishTf_ && !guessFrameId_.empty() && guessFrameId_.compare(odomFrameId_) == 0)
 	{
@@ -171,6 +234,7 @@ void OdometryROS::onInit()
 	NODELET_INFO("Odometry: publish_tf             = %s", publishTf_?"true":"false");
 	NODELET_INFO("Odometry: wait_for_transform     = %s", waitForTransform_?"true":"false");
 	NODELET_INFO("Odometry: wait_for_transform_duration  = %f", waitForTransformDuration_);
+	NODELET_INFO("Odometry: tf_static_cache        = %s", tfStaticCache?"true":"false");
 	NODELET_INFO("Odometry: initial_pose           = %s", initialPose.prettyPrint().c_str());
 	NODELET_INFO("Odometry: ground_truth_frame_id  = %s", groundTruthFrameId_.c_str());
 	NODELET_INFO("Odometry: ground_truth_base_frame_id = %s", groundTruthBaseFrameId_.c_str());
@@ -180,9 +244,14 @@ void OdometryROS::onInit()
 	NODELET_INFO("Odometry: guess_min_translation  = %f", guessMinTranslation_);
 	NODELET_INFO("Odometry: guess_min_rotation     = %f", guessMinRotation_);
 	NODELET_INFO("Odometry: guess_min_time         = %f", guessMinTime_);
+	NODELET_INFO("Odometry: guess_from_odom_topic  = %s", guessFromOdomTopic?"true":"false");
 	NODELET_INFO("Odometry: expected_update_rate   = %f Hz", expectedUpdateRate_);
 	NODELET_INFO("Odometry: max_update_rate        = %f Hz", maxUpdateRate_);
 	NODELET_INFO("Odometry: wait_imu_to_init       = %s", waitIMUToinit_?"true":"false");
+	NODELET_INFO("Odometry: pipeline_depth         = %d", pipelineDepth_);
+	NODELET_INFO("Odometry: publish_aux_async      = %s", publishAuxAsync?"true":"false");
+	NODELET_INFO("Odometry: adaptive_frame_dropping = %s", adaptiveFrameDropping_?"true":"false");
+	NODELET_INFO("Odometry: min_update_rate        = %f Hz", minUpdateRate_);
 
 	configPath = uReplaceChar(configPath, '~', UDirectory::homeDir());
 	if(configPath.size() && configPath.at(0) != '/')
@@ -244,32 +313,17 @@ void OdometryROS::onInit()
 			NODELET_ERROR( "Config file \"%s\" not found!", configPath.c_str());
 		}
 	}
+	// all private parameters are fetched at once instead of requesting the master for each parameter
+	UTimer paramTimer;
+	XmlRpc::XmlRpcValue paramTree = rtabmap_ros::getParameterTree(pnh);
 	for(rtabmap::ParametersMap::iterator iter=parameters_.begin(); iter!=parameters_.end(); ++iter)
 	{
 		std::string vStr;
-		bool vBool;
-		int vInt;
-		double vDouble;
-		if(pnh.getParam(iter->first, vStr))
+		if(rtabmap_ros::getParameterFromTree(paramTree, iter->first, vStr))
 		{
 			NODELET_INFO( "Setting odometry parameter \"%s\"=\"%s\"", iter->first.c_str(), vStr.c_str());
 			iter->second = vStr;
 		}
-		else if(pnh.getParam(iter->first, vBool))
-		{
-			NODELET_INFO( "Setting odometry parameter \"%s\"=\"%s\"", iter->first.c_str(), uBool2Str(vBool).c_str());
-			iter->second = uBool2Str(vBool);
-		}
-		else if(pnh.getParam(iter->first, vDouble))
-		{
-			NODELET_INFO( "Setting odometry parameter \"%s\"=\"%s\"", iter->first.c_str(), uNumber2Str(vDouble).c_str());
-			iter->second = uNumber2Str(vDouble);
-		}
-		else if(pnh.getParam(iter->first, vInt))
-		{
-			NODELET_INFO( "Setting odometry parameter \"%s\"=\"%s\"", iter->first.c_str(), uNumber2Str(vInt).c_str());
-			iter->second = uNumber2Str(vInt);
-		}
 
 		if(iter->first.compare(Parameters::kVisMinInliers()) == 0 && atoi(iter->second.c_str()) < 8)
 		{
@@ -307,7 +361,8 @@ void OdometryROS::onInit()
 		++iter)
 	{
 		std::string vStr;
-		if(pnh.getParam(iter->first, vStr))
+		XmlRpc::XmlRpcValue::Type type;
+		if(rtabmap_ros::getParameterFromTree(paramTree, iter->first, vStr, &type) && type == XmlRpc::XmlRpcValue::TypeString)
 		{
 			if(iter->second.first && parameters_.find(iter->second.second) != parameters_.end())
 			{
@@ -332,6 +387,8 @@ void OdometryROS::onInit()
 		}
 	}
 
+	double paramTime = paramTimer.ticks();
+
 	Parameters::parse(parameters_, Parameters::kOdomResetCountdown(), resetCountdown_);
 	parameters_.at(Parameters::kOdomResetCountdown()) = "0"; // use modified reset countdown here
 
@@ -363,7 +420,33 @@ void OdometryROS::onInit()
 		NODELET_INFO("odometry: Subscribing to IMU topic %s", imuSub_.getTopic().c_str());
 	}
 
+	if(guessFromOdomTopic && !guessFrameId_.empty())
+	{
+		guessOdomSub_ = nh.subscribe("guess_odom", 100, &OdometryROS::callbackGuessOdom, this);
+		NODELET_INFO("odometry: Subscribing to guess odometry topic %s", guessOdomSub_.getTopic().c_str());
+	}
+
+	if(publishAuxAsync)
+	{
+		auxRunning_ = true;
+		auxThread_ = new boost::thread(boost::bind(&OdometryROS::auxLoop, this));
+	}
+
+	if(pipelineDepth_ > 0)
+	{
+		if(pipelineFeatures)
+		{
+			createFeatureExtractor();
+		}
+		NODELET_INFO("Odometry: pipeline_features      = %s", pipelineFeatures_?"true":"false");
+
+		pipelineRunning_ = true;
+		pipelineThread_ = new boost::thread(boost::bind(&OdometryROS::pipelineLoop, this));
+	}
+
 	onOdomInit();
+
+	NODELET_INFO("Odometry: initialized in %f s (parameters read in %f s)", initTimer.ticks(), paramTime);
 }
 
 void OdometryROS::startWarningThread(const std::string & subscribedTopicsMsg, bool approxSync)
@@ -393,8 +476,18 @@ void OdometryROS::warningLoop(const std::string & subscribedTopicsMsg, bool appr
 
 Transform OdometryROS::getTransform(const std::string & fromFrameId, const std::string & toFrameId, const ros::Time & stamp) const
 {
-	// TF ready?
+	// Static transform already known?
 	Transform transform;
+	if(tfStaticCache_)
+	{
+		transform = tfStaticCache_->lookup(fromFrameId, toFrameId);
+	}
+	if(!transform.isNull())
+	{
+		return transform;
+	}
+
+	// TF ready?
 	try
 	{
 		if(waitForTransform_ && !stamp.isZero() && waitForTransformDuration_ > 0.0)
@@ -420,6 +513,71 @@ Transform OdometryROS::getTransform(const std::string & fromFrameId, const std::
 	return transform;
 }
 
+void OdometryROS::callbackGuessOdom(const nav_msgs::OdometryConstPtr& msg)
+{
+	if(msg->header.frame_id.compare(guessFrameId_) != 0)
+	{
+		NODELET_WARN_THROTTLE(5.0, "odometry: Received guess odometry in frame \"%s\" but "
+				"\"guess_frame_id\" is \"%s\", ignoring it.", msg->header.frame_id.c_str(), guessFrameId_.c_str());
+		return;
+	}
+
+	Transform pose = rtabmap_ros::transformFromPoseMsg(msg->pose.pose);
+	if(pose.isNull())
+	{
+		return;
+	}
+	if(!msg->child_frame_id.empty() && msg->child_frame_id.compare(frameId_) != 0)
+	{
+		// normally static, so looked up here instead of in the odometry thread
+		Transform childToBase = getTransform(msg->child_frame_id, frameId_, msg->header.stamp);
+		if(childToBase.isNull())
+		{
+			return;
+		}
+		pose *= childToBase;
+	}
+
+	boost::mutex::scoped_lock lock(guessOdomsMutex_);
+	guessOdoms_.push(msg->header.stamp.toSec(), pose);
+}
+
+Transform OdometryROS::lookupGuess(const ros::Time & stamp)
+{
+	double t = stamp.toSec();
+	boost::mutex::scoped_lock lock(guessOdomsMutex_);
+	if(guessOdoms_.empty())
+	{
+		return Transform();
+	}
+	size_t before, after;
+	if(guessOdoms_.bracket(t, before, after))
+	{
+		if(before == after)
+		{
+			return guessOdoms_.value(before);
+		}
+		double ratio = (t - guessOdoms_.stamp(before)) / (guessOdoms_.stamp(after) - guessOdoms_.stamp(before));
+		return guessOdoms_.value(before).interpolate((float)ratio, guessOdoms_.value(after));
+	}
+	if(guessOdoms_.size() >= 2 &&
+	   t > guessOdoms_.lastStamp() &&
+	   t - guessOdoms_.lastStamp() <= waitForTransformDuration_)
+	{
+		// guess odometry slightly behind the frame, extrapolate with the last velocity
+		size_t last = guessOdoms_.size()-1;
+		double dt = guessOdoms_.lastStamp() - guessOdoms_.stamp(last-1);
+		if(dt > 0.0)
+		{
+			const Transform & lastPose = guessOdoms_.value(last);
+			Transform delta = guessOdoms_.value(last-1).inverse() * lastPose;
+			double ratio = (t - guessOdoms_.lastStamp()) / dt;
+			return lastPose * Transform::getIdentity().interpolate((float)ratio, delta);
+		}
+	}
+	return Transform();
+}
+
 void OdometryROS::callbackIMU(const sensor_msgs::ImuConstPtr& msg)
 {
 	if(!this->isPaused())
@@ -445,31 +603,285 @@ void OdometryROS::callbackIMU(const sensor_msgs::ImuConstPtr& msg)
 				cv::Mat(3,3,CV_64FC1,(void*)msg->linear_acceleration_covariance.data()).clone(),
 				localTransform);
 
-		imus_.insert(std::make_pair(stamp, imu));
+		SensorData data;
+		std_msgs::Header header;
+		{
+			boost::mutex::scoped_lock lock(processMutex_);
+			unsigned long overflows = imus_.overflows();
+			imus_.push(stamp, imu);
+			if(imus_.overflows() != overflows)
+			{
+				NODELET_WARN_THROTTLE(5.0, "odometry: IMU buffer is full (%d), oldest IMU "
+						"measurements are dropped without being processed (%ld dropped so far).",
+						(int)imus_.capacity(), imus_.overflows());
+			}
 
-		if(bufferedData_.first.isValid() && stamp > bufferedData_.first.stamp())
+			if(bufferedData_.first.isValid() && stamp > bufferedData_.first.stamp())
+			{
+				data = bufferedData_.first;
+				header = bufferedData_.second;
+				bufferedData_.first = SensorData();
+			}
+		}
+		if(data.isValid())
 		{
-			SensorData data = bufferedData_.first;
-			bufferedData_.first = SensorData();
-			processData(data, bufferedData_.second);
+			processData(data, header);
 		}
 
-		if(imus_.size() > 1000)
+	}
+}
+
+void OdometryROS::processData(SensorData & data, const std_msgs::Header & header)
+{
+	// IMU-only updates are not counted in diagnostics
+	bool sensorFrame = !data.imageRaw().empty() || !data.laserScanRaw().isEmpty();
+	if(sensorFrame)
+	{
+		diagnostics_.tickInput(header);
+	}
+
+	if(dropFrame(data, header))
+	{
+		diagnostics_.tickDrop();
+		return;
+	}
+
+	if(pipelineThread_ == 0)
+	{
+		ros::WallTime start = ros::WallTime::now();
+		processDataImpl(data, header);
+		if(sensorFrame)
 		{
-			imus_.erase(imus_.begin());
+			diagnostics_.addProcessingTime((ros::WallTime::now() - start).toSec());
 		}
+		return;
+	}
+
+	// Done here so that it overlaps registration of the previous frames
+	extractFeatures(data);
+
+	boost::mutex::scoped_lock lock(pipelineMutex_);
+	if(adaptiveFrameDropping_)
+	{
+		// keep the freshest frames instead of waiting
+		while((int)pipelineQueue_.size() >= pipelineDepth_)
+		{
+			pipelineQueue_.pop_front();
+			diagnostics_.tickDrop();
+			boost::mutex::scoped_lock dropLock(frameDropMutex_);
+			++framesDropped_;
+			++framesDroppedTotal_;
+		}
+	}
+	while(pipelineRunning_ && (int)pipelineQueue_.size() >= pipelineDepth_)
+	{
+		pipelineCondition_.wait(lock);
+	}
+	if(pipelineRunning_)
+	{
+		pipelineQueue_.push_back(std::make_pair(data, header));
+		pipelineCondition_.notify_all();
 	}
 }
 
-void OdometryROS::processData(SensorData & data, const std_msgs::Header & header)
+bool OdometryROS::dropFrame(const SensorData & data, const std_msgs::Header & header)
+{
+	if(!adaptiveFrameDropping_ || (data.imageRaw().empty() && data.laserScanRaw().isEmpty()))
+	{
+		return false;
+	}
+
+	boost::mutex::scoped_lock lock(frameDropMutex_);
+	double stamp = header.stamp.toSec();
+	double latency = (ros::Time::now() - header.stamp).toSec();
+	const double latencyWindow = 5.0; // s
+	if(minLatencyWindowStamp_ <= 0.0 || stamp < minLatencyWindowStamp_ || stamp - minLatencyWindowStamp_ > latencyWindow)
+	{
+		minLatencyPrevious_ = minLatency_;
+		minLatency_ = latency;
+		minLatencyWindowStamp_ = stamp;
+	}
+	else if(latency < minLatency_)
+	{
+		minLatency_ = latency;
+	}
+	double baseline = minLatencyPrevious_ >= 0.0 && minLatencyPrevious_ < minLatency_?minLatencyPrevious_:minLatency_;
+	if(lastAdmittedStamp_ <= 0.0 || processingTime_ <= 0.0 || stamp <= lastAdmittedStamp_)
+	{
+		// not initialized or invalid stamp (rejected later)
+		lastAdmittedStamp_ = stamp;
+		return false;
+	}
+
+	double elapsed = stamp - lastAdmittedStamp_;
+	if(minUpdateRate_ > 0.0 && elapsed >= 1.0/minUpdateRate_)
+	{
+		lastAdmittedStamp_ = stamp;
+		return false;
+	}
+
+	// Frames arriving faster than they can be processed, or waiting
+	// longer than a processing time in queues (newer frames are behind)
+	if(elapsed < processingTime_ || latency - baseline > processingTime_)
+	{
+		++framesDropped_;
+		++framesDroppedTotal_;
+		NODELET_WARN_THROTTLE(5.0, "Odometry: dropping frames to keep up (processing time=%fs, "
+				"late by %fs, %lu dropped so far)", processingTime_, latency - baseline, framesDroppedTotal_);
+		return true;
+	}
+	lastAdmittedStamp_ = stamp;
+	return false;
+}
+
+void OdometryROS::pipelineLoop()
+{
+	while(true)
+	{
+		std::pair<SensorData, std_msgs::Header> frame;
+		{
+			boost::mutex::scoped_lock lock(pipelineMutex_);
+			while(pipelineRunning_ && pipelineQueue_.empty())
+			{
+				pipelineCondition_.wait(lock);
+			}
+			if(!pipelineRunning_)
+			{
+				break;
+			}
+			// frames are processed in the order they have been received
+			frame = pipelineQueue_.front();
+			pipelineQueue_.pop_front();
+			pipelineCondition_.notify_all();
+		}
+		ros::WallTime start = ros::WallTime::now();
+		processDataImpl(frame.first, frame.second);
+		if(!frame.first.imageRaw().empty() || !frame.first.laserScanRaw().isEmpty())
+		{
+			diagnostics_.addProcessingTime((ros::WallTime::now() - start).toSec());
+		}
+	}
+}
+
+bool OdometryROS::createFeatureExtractor()
+{
+	if(pipelineFeatures_ == 0)
+	{
+		int corType = Parameters::defaultVisCorType();
+		Parameters::parse(this->parameters(), Parameters::kVisCorType(), corType);
+		if(visParams_ && corType == 0 &&
+		   (odomStrategy_ == Odometry::kTypeF2M || odomStrategy_ == Odometry::kTypeF2F))
+		{
+			// Same features than those RegistrationVis would extract itself
+			pipelineFeaturesParameters_ = parameters_;
+			const char * visToKp[][2] = {
+					{"Vis/FeatureType", "Kp/DetectorStrategy"},
+					{"Vis/MaxFeatures", "Kp/MaxFeatures"},
+					{"Vis/MaxDepth", "Kp/MaxDepth"},
+					{"Vis/MinDepth", "Kp/MinDepth"},
+					{"Vis/RoiRatios", "Kp/RoiRatios"},
+					{"Vis/SubPixEps", "Kp/SubPixEps"},
+					{"Vis/SubPixIterations", "Kp/SubPixIterations"},
+					{"Vis/SubPixWinSize", "Kp/SubPixWinSize"},
+					{"Vis/GridRows", "Kp/GridRows"},
+					{"Vis/GridCols", "Kp/GridCols"}};
+			for(unsigned int i=0; i<sizeof(visToKp)/sizeof(visToKp[0]); ++i)
+			{
+				ParametersMap::const_iterator iter = parameters_.find(visToKp[i][0]);
+				if(iter != parameters_.end())
+				{
+					uInsert(pipelineFeaturesParameters_, ParametersPair(visToKp[i][1], iter->second));
+				}
+			}
+			pipelineFeatures_ = Feature2D::create(pipelineFeaturesParameters_);
+		}
+	}
+	return pipelineFeatures_ != 0;
+}
+
+void OdometryROS::extractFeatures(SensorData & data) const
 {
+	if(pipelineFeatures_ == 0 || data.imageRaw().empty() || !data.keypoints().empty())
+	{
+		return;
+	}
+
+	UTimer timer;
+	cv::Mat image;
+	if(data.imageRaw().channels() > 1)
+	{
+		cv::cvtColor(data.imageRaw(), image, cv::COLOR_BGR2GRAY);
+	}
+	else
+	{
+		image = data.imageRaw();
+	}
+
+	// Extract on the image Odometry will actually use, the keypoints
+	// are scaled back to full resolution below as Odometry scales them
+	// down again when Odom/ImageDecimation > 1.
+	int decimation = Parameters::defaultOdomImageDecimation();
+	Parameters::parse(pipelineFeaturesParameters_, Parameters::kOdomImageDecimation(), decimation);
+	if(decimation > 1)
+	{
+		if(image.rows % decimation == 0 && image.cols % decimation == 0)
+		{
+			image = util2d::decimate(image, decimation);
+		}
+		else
+		{
+			decimation = 1;
+		}
+	}
+
+	cv::Mat depthMask;
+	bool depthAsMask = Parameters::defaultVisDepthAsMask();
+	Parameters::parse(pipelineFeaturesParameters_, Parameters::kVisDepthAsMask(), depthAsMask);
+	if(depthAsMask && !data.depthRaw().empty())
+	{
+		const cv::Mat & depth = data.depthRaw();
+		if(depth.rows > image.rows && depth.rows % image.rows == 0 && depth.cols % image.cols == 0)
+		{
+			depthMask = util2d::decimate(depth, depth.rows/image.rows);
+		}
+		else if(image.rows % depth.rows == 0 && image.cols % depth.cols == 0)
+		{
+			depthMask = depth;
+			if(image.rows != depthMask.rows)
+			{
+				depthMask = util2d::interpolate(depthMask, image.rows/depthMask.rows, 0.1f);
+			}
+		}
+	}
+
+	std::vector<cv::KeyPoint> keypoints = pipelineFeatures_->generateKeypoints(image, depthMask);
+	cv::Mat descriptors = pipelineFeatures_->generateDescriptors(image, keypoints);
+	if(decimation > 1)
+	{
+		int log2value = (int)(log(double(decimation))/log(2.0));
+		for(unsigned int i=0; i<keypoints.size(); ++i)
+		{
+			keypoints[i].pt.x *= decimation;
+			keypoints[i].pt.y *= decimation;
+			keypoints[i].size *= decimation;
+			keypoints[i].octave += log2value;
+		}
+	}
+	std::vector<cv::Point3f> keypoints3D = pipelineFeatures_->generateKeypoints3D(data, keypoints);
+	data.setFeatures(keypoints, keypoints3D, descriptors);
+	UDEBUG("Extracted %d features (%fs)", (int)keypoints.size(), timer.ticks());
+}
+
+void OdometryROS::processDataImpl(SensorData & data, const std_msgs::Header & header)
+{
+	boost::mutex::scoped_lock lock(processMutex_);
 	if((waitIMUToinit_ && !imuProcessed_) && odometry_->framesProcessed() == 0 && odometry_->getPose().isIdentity() && imus_.empty())
 	{
 		NODELET_WARN("odometry: waiting imu (%s) to initialize orientation (wait_imu_to_init=true)", imuSub_.getTopic().c_str());
 		return;
 	}
 
-	if(waitIMUToinit_ && (imus_.empty() || imus_.rbegin()->first < header.stamp.toSec()))
+	if(waitIMUToinit_ && (imus_.empty() || imus_.lastStamp() < header.stamp.toSec()))
 	{
 		//NODELET_WARN("No imu received with higher stamp than last image (%f)! Buffering this image until we get more imu msgs...", stamp.toSec());
 
@@ -479,26 +891,26 @@ void OdometryROS::processData(SensorData & data, const std_msgs::Header & header
 			NODELET_ERROR("Overwriting previous data! Make sure IMU is "
 					"published faster than data rate. (last image stamp "
 					"buffered=%f and new one is %f, last imu stamp received=%f)",
-					bufferedData_.first.stamp(), data.stamp(), imus_.empty()?0:imus_.rbegin()->first);
+					bufferedData_.first.stamp(), data.stamp(), imus_.empty()?0:imus_.lastStamp());
 		}
 		bufferedData_.first = data;
 		bufferedData_.second = header;
 		return;
 	}
 	// process all imu data up to current image stamp (or just after so that underlying odom approach can do interpolation of imu at image stamp)
-	std::map<double, rtabmap::IMU>::iterator iterEnd = imus_.lower_bound(header.stamp.toSec());
-	if(iterEnd!= imus_.end())
+	size_t imuEnd = imus_.lowerBound(header.stamp.toSec());
+	if(imuEnd < imus_.size())
 	{
-		++iterEnd;
+		++imuEnd;
 	}
-	for(std::map<double, rtabmap::IMU>::iterator iter=imus_.begin(); iter!=iterEnd;)
+	for(size_t i=0; i<imuEnd; ++i)
 	{
-		//NODELET_WARN("img callback: process imu   %f", iter->first);
-		SensorData dataIMU(iter->second, 0, iter->first);
+		//NODELET_WARN("img callback: process imu   %f", imus_.stamp(i));
+		SensorData dataIMU(imus_.value(i), 0, imus_.stamp(i));
 		odometry_->process(dataIMU);
-		imus_.erase(iter++);
 		imuProcessed_ = true;
 	}
+	imus_.popFront(imuEnd);
 
 	//NODELET_WARN("img callback: process image %f", stamp.toSec());
 
@@ -561,7 +973,14 @@ void OdometryROS::processData(SensorData & data, const std_msgs::Header & header
 	Transform guessCurrentPose;
 	if(!guessFrameId_.empty())
 	{
-		guessCurrentPose = this->getTransform(guessFrameId_, frameId_, header.stamp);
+		if(!guessOdomSub_.getTopic().empty())
+		{
+			guessCurrentPose = lookupGuess(header.stamp);
+		}
+		if(guessCurrentPose.isNull())
+		{
+			guessCurrentPose = this->getTransform(guessFrameId_, frameId_, header.stamp);
+		}
 
 		Transform previousPose = guessPreviousPose_;
 		if(guessPreviousPose_.isNull())
@@ -624,6 +1043,23 @@ void OdometryROS::processData(SensorData & data, const std_msgs::Header & header
 		data.setGroundTruth(groundTruth);
 	}
 	rtabmap::Transform pose = odometry_->process(data, guess_, &info);
+	std::vector<cv::Point3f> lastFrameWords3;
+	int framesDropped = 0;
+	float effectiveRate = 0.0f;
+	if(!data.imageRaw().empty() || !data.laserScanRaw().isEmpty())
+	{
+		boost::mutex::scoped_lock lock(frameDropMutex_);
+		double processingTime = (ros::WallTime::now()-time).toSec();
+		processingTime_ = processingTime_>0.0?0.9*processingTime_ + 0.1*processingTime:processingTime;
+		if(previousStamp_ > 0.0 && header.stamp.toSec() > previousStamp_)
+		{
+			float rate = 1.0f/float(header.stamp.toSec() - previousStamp_);
+			effectiveRate_ = effectiveRate_>0.0f?0.9f*effectiveRate_ + 0.1f*rate:rate;
+		}
+		framesDropped = framesDropped_;
+		framesDropped_ = 0;
+		effectiveRate = effectiveRate_;
+	}
 	if(!pose.isNull())
 	{
 		guess_.setNull();
@@ -705,103 +1141,21 @@ void OdometryROS::processData(SensorData & data, const std_msgs::Header & header
 			if(setTwist || publishNullWhenLost_)
 			{
 				odomPub_.publish(odom);
+				diagnostics_.tickOutput(header.stamp);
 			}
 		}
 
-		// local map / reference frame
-		if(odomLocalMap_.getNumSubscribers() && !info.localMap.empty())
-		{
-			pcl::PointCloud<pcl::PointXYZRGB> cloud;
-			for(std::map<int, cv::Point3f>::const_iterator iter=info.localMap.begin(); iter!=info.localMap.end(); ++iter)
-			{
-				bool inlier = info.words.find(iter->first) != info.words.end();
-				pcl::PointXYZRGB pt;
-				pt.r = inlier?0:255;
-				pt.g = 255;
-				pt.x = iter->second.x;
-				pt.y = iter->second.y;
-				pt.z = iter->second.z;
-				cloud.push_back(pt);
-			}
-			sensor_msgs::PointCloud2 cloudMsg;
-			pcl::toROSMsg(cloud, cloudMsg);
-			cloudMsg.header.stamp = header.stamp; // use corresponding time stamp to image
-			cloudMsg.header.frame_id = odomFrameId_;
-			odomLocalMap_.publish(cloudMsg);
-		}
-
+		// words of the last frame, only available until the next update
 		if(odomLastFrame_.getNumSubscribers())
 		{
-			// check which type of Odometry is using
 			if(odometry_->getType() == Odometry::kTypeF2M) // If it's Frame to Map Odometry
 			{
-				const std::vector<cv::Point3f> & words3  = ((OdometryF2M*)odometry_)->getLastFrame().getWords3();
-				if(words3.size())
-				{
-					pcl::PointCloud<pcl::PointXYZ> cloud;
-					for(std::vector<cv::Point3f>::const_iterator iter=words3.begin(); iter!=words3.end(); ++iter)
-					{
-						// transform to odom frame
-						cv::Point3f pt = util3d::transformPoint(*iter, pose);
-						cloud.push_back(pcl::PointXYZ(pt.x, pt.y, pt.z));
-					}
-
-					sensor_msgs::PointCloud2 cloudMsg;
-					pcl::toROSMsg(cloud, cloudMsg);
-					cloudMsg.header.stamp = header.stamp; // use corresponding time stamp to image
-					cloudMsg.header.frame_id = odomFrameId_;
-					odomLastFrame_.publish(cloudMsg);
-				}
+				lastFrameWords3 = ((OdometryF2M*)odometry_)->getLastFrame().getWords3();
 			}
 			else if(odometry_->getType() == Odometry::kTypeF2F) // if Using Frame to Frame Odometry
 			{
-				const Signature & refFrame = ((OdometryF2F*)odometry_)->getRefFrame();
-
-				if(refFrame.getWords3().size())
-				{
-					pcl::PointCloud<pcl::PointXYZ> cloud;
-					for(std::vector<cv::Point3f>::const_iterator iter=refFrame.getWords3().begin(); iter!=refFrame.getWords3().end(); ++iter)
-					{
-						// transform to odom frame
-						cv::Point3f pt = util3d::transformPoint(*iter, pose);
-						cloud.push_back(pcl::PointXYZ(pt.x, pt.y, pt.z));
-					}
-					sensor_msgs::PointCloud2 cloudMsg;
-					pcl::toROSMsg(cloud, cloudMsg);
-					cloudMsg.header.stamp = header.stamp; // use corresponding time stamp to image
-					cloudMsg.header.frame_id = odomFrameId_;
-					odomLastFrame_.publish(cloudMsg);
-				}
-			}
-		}
-
-		if(odomLocalScanMap_.getNumSubscribers() && !info.localScanMap.isEmpty())
-		{
-			sensor_msgs::PointCloud2 cloudMsg;
-			if(info.localScanMap.hasNormals() && info.localScanMap.hasIntensity())
-			{
-				pcl::PointCloud<pcl::PointXYZINormal>::Ptr cloud = util3d::laserScanToPointCloudINormal(info.localScanMap, info.localScanMap.localTransform());
-				pcl::toROSMsg(*cloud, cloudMsg);
-			}
-			else if(info.localScanMap.hasNormals())
-			{
-				pcl::PointCloud<pcl::PointNormal>::Ptr cloud = util3d::laserScanToPointCloudNormal(info.localScanMap, info.localScanMap.localTransform());
-				pcl::toROSMsg(*cloud, cloudMsg);
-			}
-			else if(info.localScanMap.hasIntensity())
-			{
-				pcl::PointCloud<pcl::PointXYZI>::Ptr cloud = util3d::laserScanToPointCloudI(info.localScanMap, info.localScanMap.localTransform());
-				pcl::toROSMsg(*cloud, cloudMsg);
+				lastFrameWords3 = ((OdometryF2F*)odometry_)->getRefFrame().getWords3();
 			}
-			else
-			{
-				pcl::PointCloud<pcl::PointXYZ>::Ptr cloud = util3d::laserScanToPointCloud(info.localScanMap, info.localScanMap.localTransform());
-				pcl::toROSMsg(*cloud, cloudMsg);
-			}
-
-			cloudMsg.header.stamp = header.stamp; // use corresponding time stamp to image
-			cloudMsg.header.frame_id = odomFrameId_;
-			odomLocalScanMap_.publish(cloudMsg);
 		}
 	}
 	else if(data.imageRaw().empty() && data.laserScanRaw().isEmpty() && !data.imu().empty())
@@ -832,6 +1186,7 @@ void OdometryROS::processData(SensorData & data, const std_msgs::Header & header
 
 		//publish the message
 		odomPub_.publish(odom);
+		diagnostics_.tickOutput(header.stamp);
 	}
 
 	if(pose.isNull() && resetCurrentCount_ > 0)
@@ -858,10 +1213,67 @@ void OdometryROS::processData(SensorData & data, const std_msgs::Header & header
 		}
 	}
 
+	// odom info is published with odom, subscribers use it to interpret the pose
+	publishOdomInfo(info, header, framesDropped, effectiveRate);
+
+	if(odomLocalMap_.getNumSubscribers() ||
+	   odomLastFrame_.getNumSubscribers() ||
+	   odomLocalScanMap_.getNumSubscribers() ||
+	   (!data.imageRaw().empty() && odomRgbdImagePub_.getNumSubscribers()))
+	{
+		if(auxThread_)
+		{
+			// only the latest frame is kept, the odometry doesn't wait
+			boost::mutex::scoped_lock lock(auxMutex_);
+			auxFrame_.info = info;
+			auxFrame_.data = data;
+			auxFrame_.header = header;
+			auxFrame_.pose = pose;
+			auxFrame_.lastFrameWords3 = lastFrameWords3;
+			auxFrame_.valid = true;
+			auxCondition_.notify_one();
+		}
+		else
+		{
+			publishAuxiliaryOutputs(info, data, header, pose, lastFrameWords3);
+		}
+	}
+
+	postProcessData(data, header, pose, info);
+
+	if(!data.imageRaw().empty() || !data.laserScanRaw().isEmpty())
+	{
+		if(visParams_)
+		{
+			if(icpParams_)
+			{
+				NODELET_INFO( "Odom: quality=%d, ratio=%f, std dev=%fm|%frad, update time=%fs", info.reg.inliers, info.reg.icpInliersRatio, pose.isNull()?0.0f:std::sqrt(info.reg.covariance.at<double>(0,0)), pose.isNull()?0.0f:std::sqrt(info.reg.covariance.at<double>(5,5)), (ros::WallTime::now()-time).toSec());
+			}
+			else
+			{
+				NODELET_INFO( "Odom: quality=%d, std dev=%fm|%frad, update time=%fs", info.reg.inliers, pose.isNull()?0.0f:std::sqrt(info.reg.covariance.at<double>(0,0)), pose.isNull()?0.0f:std::sqrt(info.reg.covariance.at<double>(5,5)), (ros::WallTime::now()-time).toSec());
+			}
+		}
+		else // if(icpParams_)
+		{
+			NODELET_INFO( "Odom: ratio=%f, std dev=%fm|%frad, update time=%fs", info.reg.icpInliersRatio, pose.isNull()?0.0f:std::sqrt(info.reg.covariance.at<double>(0,0)), pose.isNull()?0.0f:std::sqrt(info.reg.covariance.at<double>(5,5)), (ros::WallTime::now()-time).toSec());
+		}
+		previousStamp_ = header.stamp.toSec();
+	}
+}
+
+void OdometryROS::publishOdomInfo(
+		const rtabmap::OdometryInfo & info,
+		const std_msgs::Header & header,
+		int framesDropped,
+		float effectiveRate)
+{
 	if(odomInfoPub_.getNumSubscribers() || odomInfoLitePub_.getNumSubscribers())
 	{
 		rtabmap_ros::OdomInfo infoMsg;
 		odomInfoToROS(info, infoMsg);
+		infoMsg.framesDropped = framesDropped;
+		infoMsg.effectiveRate = effectiveRate;
 		infoMsg.header.stamp = header.stamp; // use corresponding time stamp to image
 		infoMsg.header.frame_id = odomFrameId_;
 		odomInfoPub_.publish(infoMsg);
@@ -878,8 +1290,101 @@ void OdometryROS::processData(SensorData & data, const std_msgs::Header & header
 		infoMsg.localScanMap.clear();
 		odomInfoLitePub_.publish(infoMsg);
 	}
+}
+
+void OdometryROS::publishAuxiliaryOutputs(
+		const rtabmap::OdometryInfo & info,
+		const SensorData & data,
+		const std_msgs::Header & header,
+		const Transform & pose,
+		const std::vector<cv::Point3f> & lastFrameWords3)
+{
+	if(!pose.isNull())
+	{
+		// local map / reference frame
+		if(odomLocalMap_.getNumSubscribers() && !info.localMap.empty())
+		{
+			pcl::PointCloud<pcl::PointXYZRGB> cloud;
+			for(std::map<int, cv::Point3f>::const_iterator iter=info.localMap.begin(); iter!=info.localMap.end(); ++iter)
+			{
+				bool inlier = info.words.find(iter->first) != info.words.end();
+				pcl::PointXYZRGB pt;
+				pt.r = inlier?0:255;
+				pt.g = 255;
+				pt.x = iter->second.x;
+				pt.y = iter->second.y;
+				pt.z = iter->second.z;
+				cloud.push_back(pt);
+			}
+			sensor_msgs::PointCloud2 cloudMsg;
+			pcl::toROSMsg(cloud, cloudMsg);
+			cloudMsg.header.stamp = header.stamp; // use corresponding time stamp to image
+			cloudMsg.header.frame_id = odomFrameId_;
+			odomLocalMap_.publish(cloudMsg);
+		}
+
+		if(odomLastFrame_.getNumSubscribers() && lastFrameWords3.size())
+		{
+			pcl::PointCloud<pcl::PointXYZ> cloud;
+			for(std::vector<cv::Point3f>::const_iterator iter=lastFrameWords3.begin(); iter!=lastFrameWords3.end(); ++iter)
+			{
+				// transform to odom frame
+				cv::Point3f pt = util3d::transformPoint(*iter, pose);
+				cloud.push_back(pcl::PointXYZ(pt.x, pt.y, pt.z));
+			}
+
+			sensor_msgs::PointCloud2 cloudMsg;
+			pcl::toROSMsg(cloud, cloudMsg);
+			cloudMsg.header.stamp = header.stamp; // use corresponding time stamp to image
+			cloudMsg.header.frame_id = odomFrameId_;
+			odomLastFrame_.publish(cloudMsg);
+		}
+
+		if(odomLocalScanMap_.getNumSubscribers() && !info.localScanMap.isEmpty())
+		{
+			sensor_msgs::PointCloud2 cloudMsg;
+			if(info.localScanMap.hasNormals() && info.localScanMap.hasIntensity())
+			{
+				pcl::PointCloud<pcl::PointXYZINormal>::Ptr cloud = util3d::laserScanToPointCloudINormal(info.localScanMap, info.localScanMap.localTransform());
+				pcl::toROSMsg(*cloud, cloudMsg);
+			}
+			else if(info.localScanMap.hasNormals())
+			{
+				pcl::PointCloud<pcl::PointNormal>::Ptr cloud = util3d::laserScanToPointCloudNormal(info.localScanMap, info.localScanMap.localTransform());
+				pcl::toROSMsg(*cloud, cloudMsg);
+			}
+			else if(info.localScanMap.hasIntensity())
+			{
+				pcl::PointCloud<pcl::PointXYZI>::Ptr cloud = util3d::laserScanToPointCloudI(info.localScanMap, info.localScanMap.localTransform());
+				pcl::toROSMsg(*cloud, cloudMsg);
+			}
+			else
+			{
+				pcl::PointCloud<pcl::PointXYZ>::Ptr cloud = util3d::laserScanToPointCloud(info.localScanMap, info.localScanMap.localTransform());
+				pcl::toROSMsg(*cloud, cloudMsg);
+			}
+
+			cloudMsg.header.stamp = header.stamp; // use corresponding time stamp to image
+			cloudMsg.header.frame_id = odomFrameId_;
+			odomLocalScanMap_.publish(cloudMsg);
+		}
+	}
 
-	if(!data.imageRaw().empty() && odomRgbdImagePub_.getNumSubscribers())
+	uint32_t rgbdImageSubscribers = data.imageRaw().empty()?0:odomRgbdImagePub_.getNumSubscribers();
+	if(rgbdImageSubscribers &&
+	   data.cameraModels().size() == 1 &&
+	   SensorDataHandoff::instance().consumers(odomRgbdImagePub_.getTopic(), frameId_) == (int)rgbdImageSubscribers)
+	{
+		// All subscribers are in this process, the data is handed off
+		// directly, only the headers are published to trigger them.
+		SensorDataHandoff::instance().put(odomRgbdImagePub_.getTopic(), header.stamp, boost::shared_ptr<const SensorData>(new SensorData(data)));
+		rtabmap_ros::RGBDImagePtr msg(new rtabmap_ros::RGBDImage);
+		msg->header = header;
+		msg->rgb_camera_info.header = header;
+		msg->depth_camera_info.header = header;
+		odomRgbdImagePub_.publish(msg);
+	}
+	else if(rgbdImageSubscribers)
 	{
 		if(!header.frame_id.empty())
 		{
@@ -893,27 +1398,26 @@ void OdometryROS::processData(SensorData & data, const std_msgs::Header & header
 			ROS_WARN("Sensor frame not set, cannot convert SensorData to RGBDImage");
 		}
 	}
+}
 
-	postProcessData(data, header);
-
-	if(!data.imageRaw().empty() || !data.laserScanRaw().isEmpty())
+void OdometryROS::auxLoop()
+{
+	while(true)
 	{
-		if(visParams_)
+		AuxFrame frame;
 		{
-			if(icpParams_)
+			boost::mutex::scoped_lock lock(auxMutex_);
+			while(auxRunning_ && !auxFrame_.valid)
 			{
-				NODELET_INFO( "Odom: quality=%d, ratio=%f, std dev=%fm|%frad, update time=%fs", info.reg.inliers, info.reg.icpInliersRatio, pose.isNull()?0.0f:std::sqrt(info.reg.covariance.at<double>(0,0)), pose.isNull()?0.0f:std::sqrt(info.reg.covariance.at<double>(5,5)), (ros::WallTime::now()-time).toSec());
+				auxCondition_.wait(lock);
 			}
-			else
+			if(!auxRunning_)
 			{
-				NODELET_INFO( "Odom: quality=%d, std dev=%fm|%frad, update time=%fs", info.reg.inliers, pose.isNull()?0.0f:std::sqrt(info.reg.covariance.at<double>(0,0)), pose.isNull()?0.0f:std::sqrt(info.reg.covariance.at<double>(5,5)), (ros::WallTime::now()-time).toSec());
+				break;
 			}
+			std::swap(frame, auxFrame_);
 		}
-		else // if(icpParams_)
-		{
-			NODELET_INFO( "Odom: ratio=%f, std dev=%fm|%frad, update time=%fs", info.reg.icpInliersRatio, pose.isNull()?0.0f:std::sqrt(info.reg.covariance.at<double>(0,0)), pose.isNull()?0.0f:std::sqrt(info.reg.covariance.at<double>(5,5)), (ros::WallTime::now()-time).toSec());
-		}
-		previousStamp_ = header.stamp.toSec();
+		publishAuxiliaryOutputs(frame.info, frame.data, frame.header, frame.pose, frame.lastFrameWords3);
 	}
 }
 
@@ -934,6 +1438,22 @@ bool OdometryROS::resetToPose(rtabmap_ros::ResetPose::Request& req, rtabmap_ros:
 
 void OdometryROS::reset(const Transform & pose)
 {
+	{
+		// frames received before the reset are not processed
+		boost::mutex::scoped_lock lock(pipelineMutex_);
+		pipelineQueue_.clear();
+		pipelineCondition_.notify_all();
+	}
+	{
+		boost::mutex::scoped_lock lock(frameDropMutex_);
+		lastAdmittedStamp_ = 0.0;
+		minLatency_ = -1.0;
+		minLatencyPrevious_ = -1.0;
+		minLatencyWindowStamp_ = 0.0;
+		framesDropped_ = 0;
+		effectiveRate_ = 0.0f;
+	}
+	boost::mutex::scoped_lock lock(processMutex_);
 	odometry_->reset(pose);
 	guess_.setNull();
 	guessPreviousPose_.setNull();
@@ -0,0 +1,148 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "rtabmap_ros/PlanCache.h"
+#include "rtabmap_ros/MsgConversion.h"
+#include <rtabmap/utilite/ULogger.h>
+#include <cmath>
+
+namespace rtabmap_ros {
+
+PlanCache::PlanCache(int maxPlans, float maxRepairRatio) :
+		maxPlans_(maxPlans),
+		maxRepairRatio_(maxRepairRatio),
+		useCount_(0),
+		hits_(0),
+		repairs_(0),
+		misses_(0)
+{
+}
+
+void PlanCache::setMaxPlans(int maxPlans)
+{
+	maxPlans_ = maxPlans;
+	while((int)plans_.size() > (maxPlans_>0?maxPlans_:0))
+	{
+		std::map<std::pair<int, int>, Entry>::iterator oldest = plans_.begin();
+		for(std::map<std::pair<int, int>, Entry>::iterator iter=plans_.begin(); iter!=plans_.end(); ++iter)
+		{
+			if(iter->second.lastUsed < oldest->second.lastUsed)
+			{
+				oldest = iter;
+			}
+		}
+		plans_.erase(oldest);
+	}
+}
+
+void PlanCache::clear()
+{
+	plans_.clear();
+}
+
+const PlanCache::Plan * PlanCache::get(int startId, int goalId, unsigned long graphVersion, const std::map<int, rtabmap::Transform> & poses)
+{
+	if(!enabled())
+	{
+		return 0;
+	}
+	std::map<std::pair<int, int>, Entry>::iterator iter = plans_.find(std::make_pair(startId, goalId));
+	if(iter == plans_.end())
+	{
+		++misses_;
+		return 0;
+	}
+	if(iter->second.graphVersion != graphVersion || !repair(iter->second.plan, poses))
+	{
+		plans_.erase(iter);
+		++misses_;
+		return 0;
+	}
+	iter->second.lastUsed = ++useCount_;
+	++hits_;
+	return &iter->second.plan;
+}
+
+void PlanCache::add(int startId, int goalId, unsigned long graphVersion, const Plan & plan)
+{
+	if(!enabled())
+	{
+		return;
+	}
+	Entry & entry = plans_[std::make_pair(startId, goalId)];
+	entry.plan = plan;
+	entry.graphVersion = graphVersion;
+	entry.lastUsed = ++useCount_;
+	setMaxPlans(maxPlans_);
+}
+
+bool PlanCache::repair(Plan & plan, const std::map<int, rtabmap::Transform> & poses)
+{
+	// find the moved nodes before changing anything
+	std::vector<size_t> moved;
+	for(size_t i=0; i<plan.path.size(); ++i)
+	{
+		std::map<int, rtabmap::Transform>::const_iterator iter = poses.find(plan.path[i].first);
+		if(iter == poses.end())
+		{
+			return false;
+		}
+		// yaw difference normalized in [-pi,pi] (no false move around +-pi)
+		float dTheta = iter->second.theta() - plan.path[i].second.theta();
+		dTheta = std::atan2(std::sin(dTheta), std::cos(dTheta));
+		if(iter->second.getDistanceSquared(plan.path[i].second) > 0.0001f || // 1 cm
+		   std::fabs(dTheta) > 0.01f)
+		{
+			moved.push_back(i);
+		}
+	}
+	if(moved.empty())
+	{
+		return true;
+	}
+	if(float(moved.size()) > maxRepairRatio_ * float(plan.path.size()))
+	{
+		return false;
+	}
+
+	UASSERT(plan.msg.poses.size() >= plan.path.size());
+	for(size_t i=0; i<moved.size(); ++i)
+	{
+		size_t index = moved[i];
+		plan.path[index].second = poses.find(plan.path[index].first)->second;
+		rtabmap_ros::transformToPoseMsg(plan.path[index].second, plan.msg.poses[index]);
+	}
+	if(moved.back() == plan.path.size()-1 && plan.msg.poses.size() > plan.path.size())
+	{
+		rtabmap_ros::transformToPoseMsg(plan.path.back().second*plan.transformToGoal, plan.msg.poses.back());
+	}
+	++repairs_;
+	return true;
+}
+
+}
@@ -103,7 +103,7 @@ public:
         std::map<int, rtabmap::Transform> poses;
         std::multimap<int, rtabmap::Link> links;
         rtabmap::Transform mapToOdom;
-        rtabmap_ros::mapDataFromROS(*msg, poses, links, signatures, mapToOdom);
+        rtabmap_ros::mapDataFromROS(*msg, poses, links, signatures, mapToOdom, msg);
 
         // handle the case where we can receive only latest data, or if all data are published
         for(std::map<int, rtabmap::Signature>::iterator iter=signatures.begin(); iter!=signatures.end(); ++iter)
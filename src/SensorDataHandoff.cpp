@@ -0,0 +1,95 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "rtabmap_ros/SensorDataHandoff.h"
+
+namespace rtabmap_ros {
+
+// enough to cover the synchronization queues of the consumers
+static const size_t kMaxDataPerTopic = 10;
+
+SensorDataHandoff & SensorDataHandoff::instance()
+{
+	static SensorDataHandoff handoff;
+	return handoff;
+}
+
+void SensorDataHandoff::addConsumer(const std::string & topic, const std::string & frameId)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	++consumers_[std::make_pair(topic, frameId)];
+}
+
+void SensorDataHandoff::removeConsumer(const std::string & topic, const std::string & frameId)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	std::map<std::pair<std::string, std::string>, int>::iterator iter = consumers_.find(std::make_pair(topic, frameId));
+	if(iter != consumers_.end() && --iter->second <= 0)
+	{
+		consumers_.erase(iter);
+		data_.erase(topic);
+	}
+}
+
+int SensorDataHandoff::consumers(const std::string & topic, const std::string & frameId) const
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	std::map<std::pair<std::string, std::string>, int>::const_iterator iter = consumers_.find(std::make_pair(topic, frameId));
+	return iter!=consumers_.end()?iter->second:0;
+}
+
+void SensorDataHandoff::put(const std::string & topic, const ros::Time & stamp, const boost::shared_ptr<const rtabmap::SensorData> & data)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	std::list<std::pair<ros::Time, boost::shared_ptr<const rtabmap::SensorData> > > & queue = data_[topic];
+	queue.push_back(std::make_pair(stamp, data));
+	while(queue.size() > kMaxDataPerTopic)
+	{
+		queue.pop_front();
+	}
+}
+
+boost::shared_ptr<const rtabmap::SensorData> SensorDataHandoff::get(const std::string & topic, const ros::Time & stamp) const
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	std::map<std::string, std::list<std::pair<ros::Time, boost::shared_ptr<const rtabmap::SensorData> > > >::const_iterator iter = data_.find(topic);
+	if(iter != data_.end())
+	{
+		// most recent first
+		for(std::list<std::pair<ros::Time, boost::shared_ptr<const rtabmap::SensorData> > >::const_reverse_iterator jter=iter->second.rbegin(); jter!=iter->second.rend(); ++jter)
+		{
+			if(jter->first == stamp)
+			{
+				return jter->second;
+			}
+		}
+	}
+	return boost::shared_ptr<const rtabmap::SensorData>();
+}
+
+}
@@ -0,0 +1,160 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rtabmap_ros/StaticTransformCache.h"
+#include "rtabmap_ros/MsgConversion.h"
+#include <rtabmap/utilite/ULogger.h>
+#include <set>
+
+namespace rtabmap_ros {
+
+static std::string stripSlash(const std::string & frameId)
+{
+	if(!frameId.empty() && frameId[0] == '/')
+	{
+		return frameId.substr(1);
+	}
+	return frameId;
+}
+
+// Caches of the nodelets of this process, by listener
+static boost::mutex g_cachesMutex;
+static std::map<const tf::TransformListener *, StaticTransformCache *> g_caches;
+
+StaticTransformCache::StaticTransformCache(ros::NodeHandle & nh, const tf::TransformListener & listener) :
+	listener_(listener)
+{
+	{
+		boost::mutex::scoped_lock lock(g_cachesMutex);
+		UASSERT_MSG(g_caches.find(&listener) == g_caches.end(), "A static transforms cache already exists for this listener");
+		g_caches.insert(std::make_pair(&listener, this));
+	}
+	sub_ = nh.subscribe("/tf_static", 100, &StaticTransformCache::callback, this);
+	ROS_INFO("Static transforms cache enabled (listening on %s)", sub_.getTopic().c_str());
+}
+
+StaticTransformCache::~StaticTransformCache()
+{
+	// waits for the callback in progress
+	sub_.shutdown();
+	boost::mutex::scoped_lock lock(g_cachesMutex);
+	g_caches.erase(&listener_);
+}
+
+rtabmap::Transform StaticTransformCache::lookup(
+		const std::string & targetFrame,
+		const std::string & sourceFrame,
+		const tf::TransformListener & listener)
+{
+	boost::mutex::scoped_lock lock(g_cachesMutex);
+	std::map<const tf::TransformListener *, StaticTransformCache *>::iterator iter = g_caches.find(&listener);
+	if(iter == g_caches.end())
+	{
+		return rtabmap::Transform();
+	}
+	return iter->second->lookup(targetFrame, sourceFrame);
+}
+
+void StaticTransformCache::callback(const tf2_msgs::TFMessageConstPtr & msg)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	for(size_t i=0; i<msg->transforms.size(); ++i)
+	{
+		staticParents_[stripSlash(msg->transforms[i].child_frame_id)] = stripSlash(msg->transforms[i].header.frame_id);
+	}
+	// a static transform may have been republished with a different value
+	transforms_.clear();
+}
+
+bool StaticTransformCache::isStatic(const std::string & targetFrame, const std::string & sourceFrame) const
+{
+	// frames from source to the root of its static tree
+	std::set<std::string> sourceChain;
+	std::string frame = sourceFrame;
+	sourceChain.insert(frame);
+	for(std::map<std::string, std::string>::const_iterator iter=staticParents_.find(frame);
+		iter!=staticParents_.end() && sourceChain.size() <= staticParents_.size();
+		iter=staticParents_.find(frame))
+	{
+		frame = iter->second;
+		sourceChain.insert(frame);
+	}
+
+	// the target should reach one of them through static transforms
+	frame = targetFrame;
+	size_t depth = 0;
+	while(sourceChain.find(frame) == sourceChain.end())
+	{
+		std::map<std::string, std::string>::const_iterator iter=staticParents_.find(frame);
+		if(iter == staticParents_.end() || ++depth > staticParents_.size())
+		{
+			return false;
+		}
+		frame = iter->second;
+	}
+	return true;
+}
+
+rtabmap::Transform StaticTransformCache::lookup(
+		const std::string & targetFrame,
+		const std::string & sourceFrame)
+{
+	rtabmap::Transform transform;
+	std::pair<std::string, std::string> key(stripSlash(targetFrame), stripSlash(sourceFrame));
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		std::map<std::pair<std::string, std::string>, rtabmap::Transform>::iterator iter = transforms_.find(key);
+		if(iter != transforms_.end())
+		{
+			return iter->second;
+		}
+		if(!isStatic(key.first, key.second))
+		{
+			return transform;
+		}
+	}
+
+	// static: the latest transform is valid at any time
+	try
+	{
+		tf::StampedTransform tmp;
+		listener_.lookupTransform(targetFrame, sourceFrame, ros::Time(0), tmp);
+		transform = rtabmap_ros::transformFromTF(tmp);
+	}
+	catch(tf::TransformException & ex)
+	{
+		// not yet received by the listener, fall back on the normal lookup
+		UDEBUG("(getting static transform %s -> %s) %s", targetFrame.c_str(), sourceFrame.c_str(), ex.what());
+		return transform;
+	}
+
+	boost::mutex::scoped_lock lock(mutex_);
+	transforms_.insert(std::make_pair(key, transform));
+	return transform;
+}
+
+}
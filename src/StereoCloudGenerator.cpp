@@ -0,0 +1,240 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "rtabmap_ros/StereoCloudGenerator.h"
+#include <rtabmap/core/util2d.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UStl.h>
+#include <rtabmap/utilite/UConversion.h>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <limits>
+
+namespace rtabmap_ros {
+
+class StereoStripeBody : public cv::ParallelLoopBody
+{
+public:
+	StereoStripeBody(
+			const cv::Mat & leftGray,
+			const cv::Mat & left,
+			const cv::Mat & right,
+			const cv::Rect & roi,
+			int searchOffset,
+			const rtabmap::ParametersMap & parameters,
+			const rtabmap::StereoCameraModel & model,
+			float maxDepth,
+			float minDepth,
+			int overlap,
+			int stripes,
+			pcl::PointCloud<pcl::PointXYZRGB> & cloud,
+			std::vector<std::vector<int> > & indices) :
+		leftGray_(leftGray),
+		left_(left),
+		right_(right),
+		roi_(roi),
+		searchOffset_(searchOffset),
+		parameters_(parameters),
+		fx_(model.left().fx()),
+		fy_(model.left().fy()),
+		cx_(model.left().cx()),
+		cy_(model.left().cy()),
+		fxBaseline_(model.left().fx()*model.baseline()),
+		maxDepth_(maxDepth),
+		minDepth_(minDepth),
+		overlap_(overlap),
+		rowsPerStripe_((roi.height + stripes - 1)/stripes),
+		cloud_(cloud),
+		indices_(indices)
+	{}
+
+	virtual void operator()(const cv::Range & range) const
+	{
+		const float bad = std::numeric_limits<float>::quiet_NaN();
+		for(int s=range.start; s<range.end; ++s)
+		{
+			std::vector<int> & indices = indices_[s];
+			indices.clear();
+			int y0 = roi_.y + s*rowsPerStripe_;
+			int y1 = std::min(roi_.y + roi_.height, y0 + rowsPerStripe_);
+			if(y0 >= y1)
+			{
+				continue;
+			}
+			// match with the neighborhood of the stripe, the disparity search
+			// range on the left of the roi is kept for its first columns
+			int my0 = std::max(0, y0 - overlap_);
+			int my1 = std::min(leftGray_.rows, y1 + overlap_);
+			cv::Rect matchRoi(roi_.x - searchOffset_, my0, roi_.width + searchOffset_, my1 - my0);
+			cv::Mat disparity = rtabmap::util2d::disparityFromStereoImages(
+					cv::Mat(leftGray_, matchRoi),
+					cv::Mat(right_, matchRoi),
+					parameters_);
+			UASSERT(disparity.type() == CV_16SC1 || disparity.type() == CV_32FC1);
+
+			for(int v=y0; v<y1; ++v)
+			{
+				int dv = v - my0;
+				pcl::PointXYZRGB * pt = &cloud_.at(0, v - roi_.y);
+				for(int u=roi_.x; u<roi_.x + roi_.width; ++u, ++pt)
+				{
+					int du = u - matchRoi.x;
+					float d = disparity.type() == CV_16SC1?
+							float(disparity.at<short>(dv, du))/16.0f:
+							disparity.at<float>(dv, du);
+					float z = d > 0.0f?fxBaseline_/d:0.0f;
+					if(z > 0.0f && (maxDepth_ <= 0.0f || z <= maxDepth_) && z >= minDepth_)
+					{
+						pt->x = (float(u) - cx_)*z/fx_;
+						pt->y = (float(v) - cy_)*z/fy_;
+						pt->z = z;
+						if(left_.channels() == 3)
+						{
+							const unsigned char * bgr = left_.ptr<unsigned char>(v) + u*3;
+							pt->b = bgr[0];
+							pt->g = bgr[1];
+							pt->r = bgr[2];
+						}
+						else
+						{
+							pt->r = pt->g = pt->b = left_.at<unsigned char>(v, u);
+						}
+						indices.push_back((v - roi_.y)*roi_.width + (u - roi_.x));
+					}
+					else
+					{
+						pt->x = pt->y = pt->z = bad;
+					}
+				}
+			}
+		}
+	}
+
+private:
+	const cv::Mat & leftGray_;
+	const cv::Mat & left_;
+	const cv::Mat & right_;
+	cv::Rect roi_;
+	int searchOffset_;
+	const rtabmap::ParametersMap & parameters_;
+	float fx_, fy_, cx_, cy_, fxBaseline_;
+	float maxDepth_, minDepth_;
+	int overlap_;
+	int rowsPerStripe_;
+	pcl::PointCloud<pcl::PointXYZRGB> & cloud_;
+	std::vector<std::vector<int> > & indices_;
+};
+
+StereoCloudGenerator::StereoCloudGenerator() :
+	stripes_(4),
+	overlap_(8),
+	maxDisparity_(128),
+	cloud_(new pcl::PointCloud<pcl::PointXYZRGB>)
+{
+	setParameters(rtabmap::Parameters::getDefaultParameters("StereoBM"));
+}
+
+void StereoCloudGenerator::setParameters(const rtabmap::ParametersMap & stereoParameters)
+{
+	parameters_ = stereoParameters;
+	int blockSize = uStr2Int(uValue(parameters_, rtabmap::Parameters::kStereoBMBlockSize(), std::string("15")));
+	int minDisparity = uStr2Int(uValue(parameters_, rtabmap::Parameters::kStereoBMMinDisparity(), std::string("0")));
+	int numDisparities = uStr2Int(uValue(parameters_, rtabmap::Parameters::kStereoBMNumDisparities(), std::string("128")));
+	overlap_ = blockSize/2 + 1;
+	maxDisparity_ = std::max(0, minDisparity + numDisparities);
+}
+
+pcl::PointCloud<pcl::PointXYZRGB>::Ptr StereoCloudGenerator::generate(
+		const cv::Mat & left,
+		const cv::Mat & right,
+		const rtabmap::StereoCameraModel & model,
+		int decimation,
+		float maxDepth,
+		float minDepth,
+		const std::vector<float> & roiRatios,
+		std::vector<int> & indices)
+{
+	UASSERT(!left.empty() && left.size() == right.size());
+	UASSERT(left.type() == CV_8UC1 || left.type() == CV_8UC3);
+	UASSERT(right.type() == CV_8UC1);
+
+	rtabmap::StereoCameraModel stereoModel = model;
+	cv::Mat leftImage = left;
+	cv::Mat rightImage = right;
+	if(decimation > 1)
+	{
+		// match at the output resolution instead of decimating the cloud afterwards
+		cv::Size size(left.cols/decimation, left.rows/decimation);
+		cv::resize(left, leftBuffer_, size, 0, 0, cv::INTER_AREA);
+		cv::resize(right, rightBuffer_, size, 0, 0, cv::INTER_AREA);
+		leftImage = leftBuffer_;
+		rightImage = rightBuffer_;
+		stereoModel.scale(1.0/double(decimation));
+	}
+	cv::Mat leftGray = leftImage;
+	if(leftImage.channels() == 3)
+	{
+		cv::cvtColor(leftImage, leftGrayBuffer_, cv::COLOR_BGR2GRAY);
+		leftGray = leftGrayBuffer_;
+	}
+
+	cv::Rect roi(0, 0, leftImage.cols, leftImage.rows);
+	if(roiRatios.size() == 4)
+	{
+		roi = rtabmap::util2d::computeRoi(leftImage, roiRatios);
+	}
+	// the disparity search range left of the roi is needed by its first columns
+	int searchOffset = std::min(roi.x, maxDisparity_);
+
+	if(cloud_->width != (unsigned int)roi.width || cloud_->height != (unsigned int)roi.height || !cloud_.unique())
+	{
+		if(!cloud_.unique())
+		{
+			// previous cloud still used downstream
+			cloud_.reset(new pcl::PointCloud<pcl::PointXYZRGB>);
+		}
+		cloud_->resize(roi.width*roi.height);
+		cloud_->width = roi.width;
+		cloud_->height = roi.height;
+	}
+	cloud_->is_dense = false;
+
+	int stripes = std::max(1, std::min(stripes_, roi.height/std::max(1, overlap_)));
+	stripeIndices_.resize(stripes);
+	cv::parallel_for_(cv::Range(0, stripes),
+			StereoStripeBody(leftGray, leftImage, rightImage, roi, searchOffset, parameters_,
+					stereoModel, maxDepth, minDepth, overlap_, stripes, *cloud_, stripeIndices_));
+
+	indices.clear();
+	for(int s=0; s<stripes; ++s)
+	{
+		indices.insert(indices.end(), stripeIndices_[s].begin(), stripeIndices_[s].end());
+	}
+	return cloud_;
+}
+
+}
@@ -0,0 +1,136 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "rtabmap_ros/StereoRectifier.h"
+#include "rtabmap_ros/MsgConversion.h"
+#include <rtabmap/utilite/ULogger.h>
+#include <opencv2/imgproc/imgproc.hpp>
+
+namespace rtabmap_ros {
+
+StereoRectifier::StereoRectifier() :
+	valid_(false)
+{
+}
+
+bool StereoRectifier::sameCalibration(
+		const sensor_msgs::CameraInfo & leftCamInfo,
+		const sensor_msgs::CameraInfo & rightCamInfo,
+		const rtabmap::Transform & stereoTransform) const
+{
+	const sensor_msgs::CameraInfo * infos[2] = {&leftCamInfo, &rightCamInfo};
+	const sensor_msgs::CameraInfo * cached[2] = {&leftCamInfo_, &rightCamInfo_};
+	for(int i=0; i<2; ++i)
+	{
+		if(infos[i]->width != cached[i]->width ||
+		   infos[i]->height != cached[i]->height ||
+		   infos[i]->distortion_model != cached[i]->distortion_model ||
+		   infos[i]->D != cached[i]->D ||
+		   infos[i]->K != cached[i]->K ||
+		   infos[i]->R != cached[i]->R ||
+		   infos[i]->P != cached[i]->P)
+		{
+			return false;
+		}
+	}
+	if(stereoTransform.isNull() != stereoTransform_.isNull())
+	{
+		return false;
+	}
+	return stereoTransform.isNull() || stereoTransform == stereoTransform_;
+}
+
+bool StereoRectifier::update(
+		const sensor_msgs::CameraInfo & leftCamInfo,
+		const sensor_msgs::CameraInfo & rightCamInfo,
+		const rtabmap::Transform & localTransform,
+		const rtabmap::Transform & stereoTransform)
+{
+	if(!leftMap1_.empty() && sameCalibration(leftCamInfo, rightCamInfo, stereoTransform))
+	{
+		if(valid_)
+		{
+			rectifiedModel_.setLocalTransform(localTransform);
+		}
+		return valid_;
+	}
+
+	leftCamInfo_ = leftCamInfo;
+	rightCamInfo_ = rightCamInfo;
+	stereoTransform_ = stereoTransform;
+	leftBuffers_.clear();
+	rightBuffers_.clear();
+
+	rtabmap::StereoCameraModel model = stereoCameraModelFromROS(leftCamInfo, rightCamInfo, localTransform, stereoTransform);
+	valid_ = model.isValidForRectification();
+	if(valid_)
+	{
+		UINFO("Computing stereo rectification maps (%dx%d)", model.left().imageWidth(), model.left().imageHeight());
+		// same maps than rtabmap::CameraModel::initRectificationMap()
+		cv::initUndistortRectifyMap(
+				model.left().K_raw(), model.left().D_raw(), model.left().R(), model.left().P(),
+				model.left().imageSize(), CV_16SC2, leftMap1_, leftMap2_);
+		cv::initUndistortRectifyMap(
+				model.right().K_raw(), model.right().D_raw(), model.right().R(), model.right().P(),
+				model.right().imageSize(), CV_16SC2, rightMap1_, rightMap2_);
+		rectifiedModel_ = rtabmap::StereoCameraModel(
+				model.left().fx(),
+				model.left().fy(),
+				model.left().cx(),
+				model.left().cy(),
+				model.baseline(),
+				localTransform,
+				model.left().imageSize());
+	}
+	else
+	{
+		// remember that this calibration is invalid
+		leftMap1_ = cv::Mat(1, 1, CV_16SC2);
+	}
+	return valid_;
+}
+
+void StereoRectifier::rectify(
+		const cv::Mat & left,
+		const cv::Mat & right,
+		cv::Mat & leftRectified,
+		cv::Mat & rightRectified)
+{
+	UASSERT(valid_);
+	UASSERT(left.size() == rectifiedModel_.left().imageSize() && right.size() == rectifiedModel_.right().imageSize());
+
+	// cv::remap() already splits the image between threads
+	cv::Mat leftOut = leftBuffers_.acquire(left.size(), left.type());
+	cv::remap(left, leftOut, leftMap1_, leftMap2_, cv::INTER_LINEAR);
+	cv::Mat rightOut = rightBuffers_.acquire(right.size(), right.type());
+	cv::remap(right, rightOut, rightMap1_, rightMap2_, cv::INTER_LINEAR);
+	leftRectified = leftOut;
+	rightRectified = rightOut;
+}
+
+}
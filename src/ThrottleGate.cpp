@@ -0,0 +1,145 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "rtabmap_ros/ThrottleGate.h"
+#include <algorithm>
+
+namespace rtabmap_ros {
+
+// Stamps of frames captured at a fixed rate jitter, a frame
+// slightly early is still forwarded
+static const double kPeriodTolerance = 0.9;
+// Weight of a new processing time in the filtered value
+static const double kProcessingTimeAlpha = 0.3;
+
+ThrottleGate::ThrottleGate() :
+	rate_(0.0),
+	margin_(1.1),
+	readyTimeout_(1.0),
+	processingTime_(0.0),
+	waitingReady_(false)
+{
+}
+
+void ThrottleGate::init(ros::NodeHandle & nh, ros::NodeHandle & pnh, const std::string & name)
+{
+	pnh.param("rate", rate_, rate_);
+	pnh.param("feedback", feedback_, feedback_);
+	pnh.param("feedback_margin", margin_, margin_);
+	pnh.param("ready_timeout", readyTimeout_, readyTimeout_);
+
+	if(feedback_.compare("odom_info") == 0)
+	{
+		feedbackSub_ = nh.subscribe("odom_info", 1, &ThrottleGate::odomInfoCallback, this);
+	}
+	else if(feedback_.compare("info") == 0)
+	{
+		feedbackSub_ = nh.subscribe("info", 1, &ThrottleGate::infoCallback, this);
+	}
+	else if(feedback_.compare("ready") == 0)
+	{
+		feedbackSub_ = nh.subscribe("ready", 1, &ThrottleGate::readyCallback, this);
+	}
+	else if(!feedback_.empty())
+	{
+		ROS_ERROR("%s: Unknown feedback \"%s\" (\"odom_info\", \"info\" or \"ready\"), throttling only at fixed rate.", name.c_str(), feedback_.c_str());
+		feedback_.clear();
+	}
+
+	ROS_INFO("%s: feedback=%s", name.c_str(), feedback_.c_str());
+	if(!feedback_.empty())
+	{
+		ROS_INFO("%s: feedback topic=%s", name.c_str(), feedbackSub_.getTopic().c_str());
+		ROS_INFO("%s: feedback_margin=%f", name.c_str(), margin_);
+		ROS_INFO("%s: ready_timeout=%f s", name.c_str(), readyTimeout_);
+	}
+}
+
+bool ThrottleGate::acceptImpl(const ros::Time & stamp) const
+{
+	if(waitingReady_ && (ros::WallTime::now() - lastForwardTime_).toSec() < readyTimeout_)
+	{
+		return false;
+	}
+	if(lastForwardStamp_.isZero())
+	{
+		return true;
+	}
+	double period = std::max(rate_>0.0?1.0/rate_:0.0, processingTime_*margin_);
+	return (stamp - lastForwardStamp_).toSec() >= period*kPeriodTolerance;
+}
+
+bool ThrottleGate::accept(const ros::Time & stamp) const
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	return acceptImpl(stamp);
+}
+
+bool ThrottleGate::forward(const ros::Time & stamp)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	if(!acceptImpl(stamp))
+	{
+		return false;
+	}
+	lastForwardStamp_ = stamp;
+	lastForwardTime_ = ros::WallTime::now();
+	waitingReady_ = feedback_.compare("ready") == 0;
+	return true;
+}
+
+void ThrottleGate::processingTime(double seconds)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	processingTime_ = processingTime_ == 0.0?seconds:(1.0-kProcessingTimeAlpha)*processingTime_ + kProcessingTimeAlpha*seconds;
+}
+
+void ThrottleGate::odomInfoCallback(const rtabmap_ros::OdomInfoConstPtr & msg)
+{
+	processingTime(msg->timeEstimation);
+}
+
+void ThrottleGate::infoCallback(const rtabmap_ros::InfoConstPtr & msg)
+{
+	for(size_t i=0; i<msg->statsKeys.size() && i<msg->statsValues.size(); ++i)
+	{
+		if(msg->statsKeys[i].compare("Timing/Total/ms") == 0)
+		{
+			processingTime(msg->statsValues[i]/1000.0);
+			break;
+		}
+	}
+}
+
+void ThrottleGate::readyCallback(const std_msgs::EmptyConstPtr &)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	waitingReady_ = false;
+}
+
+}
@@ -0,0 +1,226 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "rtabmap_ros/UserDataLayer.h"
+#include "rtabmap_ros/MsgConversion.h"
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UStl.h>
+
+namespace rtabmap_ros {
+
+UserDataLayer::UserDataLayer(float poseUpdateThreshold) :
+		poseUpdateThreshold_(poseUpdateThreshold)
+{
+	cloud_.height = 1;
+	cloud_.width = 0;
+	cloud_.is_bigendian = false;
+	cloud_.is_dense = true;
+	cloud_.point_step = 4*sizeof(float);
+	cloud_.row_step = 0;
+	const char * names[4] = {"x", "y", "z", "rgb"};
+	cloud_.fields.resize(4);
+	for(int i=0; i<4; ++i)
+	{
+		cloud_.fields[i].name = names[i];
+		cloud_.fields[i].offset = i*sizeof(float);
+		cloud_.fields[i].datatype = sensor_msgs::PointField::FLOAT32;
+		cloud_.fields[i].count = 1;
+	}
+}
+
+void UserDataLayer::clear()
+{
+	values_.clear();
+	nodeStamps_.clear();
+	samples_.clear();
+	cloud_.width = 0;
+	cloud_.row_step = 0;
+	cloud_.data.clear();
+}
+
+void UserDataLayer::update(const rtabmap_ros::MapDataConstPtr & msg)
+{
+	rtabmap::Transform mapToOdom;
+	std::map<int, rtabmap::Transform> poses;
+	std::multimap<int, rtabmap::Link> links;
+	std::map<int, rtabmap::Signature> signatures;
+	rtabmap_ros::mapDataFromROS(*msg, poses, links, signatures, mapToOdom, msg);
+
+	// handle the case where we can receive only latest data, or if all data are published
+	bool added = false;
+	for(std::map<int, rtabmap::Signature>::iterator iter=signatures.begin(); iter!=signatures.end(); ++iter)
+	{
+		nodeStamps_.insert(std::make_pair(iter->second.getStamp(), iter->first));
+
+		double stamp = 0.0;
+		float value = 0.0f;
+		if(extractValue(iter->second, stamp, value) && values_.insert(std::make_pair(stamp, value)).second)
+		{
+			added = true;
+		}
+	}
+	bool recreate = added && updateScale(values_);
+
+	// for the logic below, we should keep only stamps for
+	// nodes still in the graph (in case nodes are ignored when not moving)
+	std::map<double, int> nodeStamps;
+	for(std::map<double, int>::iterator iter=nodeStamps_.begin(); iter!=nodeStamps_.end(); ++iter)
+	{
+		if(poses.find(iter->second) != poses.end())
+		{
+			nodeStamps.insert(*iter);
+		}
+	}
+
+	bool relayout = false;
+	std::vector<Sample*> dirty;
+	for(std::map<double, float>::iterator iter=values_.begin(); iter!=values_.end(); ++iter)
+	{
+		std::pair<std::map<double, Sample>::iterator, bool> inserted = samples_.insert(std::make_pair(iter->first, Sample()));
+		Sample & sample = inserted.first->second;
+		bool changed = inserted.second || recreate;
+		if(changed)
+		{
+			size_t previousSize = sample.points.size();
+			sample.points.clear();
+			createPoints(iter->second, sample.points);
+			if(sample.offset >= 0 && previousSize != sample.points.size())
+			{
+				relayout = true;
+			}
+		}
+
+		// The value may be taken between two nodes, interpolate its position.
+		double stamp = iter->first;
+		std::map<double, int>::iterator previousNode = nodeStamps.lower_bound(stamp); // lower bound of the stamp
+		if(previousNode!=nodeStamps.end() && previousNode->first > stamp && previousNode != nodeStamps.begin())
+		{
+			--previousNode;
+		}
+		std::map<double, int>::iterator nextNode = nodeStamps.upper_bound(stamp); // upper bound of the stamp
+
+		if(previousNode != nodeStamps.end() &&
+		   nextNode != nodeStamps.end() &&
+		   previousNode->second != nextNode->second)
+		{
+			const rtabmap::Transform & poseA = poses.at(previousNode->second);
+			const rtabmap::Transform & poseB = poses.at(nextNode->second);
+			if(changed ||
+			   sample.nodeA != previousNode->second ||
+			   sample.nodeB != nextNode->second ||
+			   sample.poseA.isNull() ||
+			   poseA.getDistance(sample.poseA) > poseUpdateThreshold_ ||
+			   poseB.getDistance(sample.poseB) > poseUpdateThreshold_)
+			{
+				double stampA = previousNode->first;
+				double stampB = nextNode->first;
+				UASSERT(stamp>=stampA && stamp <=stampB);
+
+				rtabmap::Transform v = poseA.inverse() * poseB;
+				double ratio = (stamp-stampA)/(stampB-stampA);
+
+				v.x()*=ratio;
+				v.y()*=ratio;
+				v.z()*=ratio;
+
+				sample.anchor = (poseA*v).translation(); // rip off the rotation
+				sample.nodeA = previousNode->second;
+				sample.nodeB = nextNode->second;
+				sample.poseA = poseA;
+				sample.poseB = poseB;
+				dirty.push_back(&sample);
+			}
+		}
+		else if(!sample.anchor.isNull())
+		{
+			// not shown anymore
+			sample.anchor.setNull();
+			sample.nodeA = sample.nodeB = 0;
+			sample.poseA.setNull();
+			sample.poseB.setNull();
+			if(sample.offset >= 0)
+			{
+				relayout = true;
+			}
+		}
+	}
+
+	// Samples keep their place in the cloud, new ones are appended
+	int size = cloud_.width;
+	if(relayout)
+	{
+		size = 0;
+		dirty.clear();
+	}
+	for(std::map<double, Sample>::iterator iter=samples_.begin(); iter!=samples_.end(); ++iter)
+	{
+		Sample & sample = iter->second;
+		if(sample.anchor.isNull())
+		{
+			sample.offset = -1;
+		}
+		else if(relayout || sample.offset < 0)
+		{
+			sample.offset = size;
+			size += sample.points.size();
+			if(relayout)
+			{
+				dirty.push_back(&sample);
+			}
+		}
+	}
+
+	cloud_.header = msg->header;
+	cloud_.width = size;
+	cloud_.row_step = cloud_.width * cloud_.point_step;
+	cloud_.data.resize(cloud_.row_step);
+	for(size_t i=0; i<dirty.size(); ++i)
+	{
+		UASSERT(dirty[i]->offset >= 0);
+		writeSample(*dirty[i]);
+	}
+	UDEBUG("Updated %d/%d samples (%d points)", (int)dirty.size(), (int)samples_.size(), (int)cloud_.width);
+}
+
+void UserDataLayer::writeSample(const Sample & sample)
+{
+	float x = sample.anchor.x();
+	float y = sample.anchor.y();
+	float z = sample.anchor.z();
+	for(size_t i=0; i<sample.points.size(); ++i)
+	{
+		const pcl::PointXYZRGB & pt = sample.points.at(i);
+		float * ptr = (float*)&cloud_.data[(sample.offset+i)*cloud_.point_step];
+		ptr[0] = pt.x + x;
+		ptr[1] = pt.y + y;
+		ptr[2] = pt.z + z;
+		ptr[3] = pt.rgb;
+	}
+}
+
+}
@@ -0,0 +1,350 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rtabmap_ros/VoxelCloudMap.h"
+#include <rtabmap/utilite/ULogger.h>
+#include <cmath>
+
+namespace rtabmap_ros {
+
+// 21 bits per axis
+#define VOXEL_KEY_OFFSET 1048576
+
+VoxelCloudMap::VoxelCloudMap(float voxelSize) :
+		voxelSize_(voxelSize),
+		chunkSize_(0)
+{
+	UASSERT(voxelSize_ > 0.0f);
+}
+
+void VoxelCloudMap::setVoxelSize(float voxelSize)
+{
+	UASSERT(voxelSize > 0.0f);
+	if(voxelSize != voxelSize_)
+	{
+		voxelSize_ = voxelSize;
+		clear();
+	}
+}
+
+void VoxelCloudMap::setChunkSize(int voxels)
+{
+	UASSERT(voxels >= 0);
+	if(voxels != chunkSize_)
+	{
+		chunkSize_ = voxels;
+		clear();
+	}
+}
+
+void VoxelCloudMap::clear()
+{
+	voxels_.clear();
+	nodes_.clear();
+	// chunks already published should be cleared by the clients
+	for(boost::unordered_map<unsigned long long, boost::unordered_set<unsigned long long> >::iterator iter=chunks_.begin(); iter!=chunks_.end(); ++iter)
+	{
+		dirtyChunks_.insert(iter->first);
+	}
+	chunks_.clear();
+}
+
+size_t VoxelCloudMap::memoryUsage() const
+{
+	// hash node: key + value + next pointer, plus one bucket pointer
+	size_t bytes = voxels_.size()*(sizeof(unsigned long long)+sizeof(Voxel)+2*sizeof(void*));
+	for(std::map<int, std::vector<std::pair<unsigned long long, Voxel> > >::const_iterator iter=nodes_.begin(); iter!=nodes_.end(); ++iter)
+	{
+		bytes += sizeof(int) + sizeof(iter->second) + iter->second.capacity()*sizeof(std::pair<unsigned long long, Voxel>);
+	}
+	for(boost::unordered_map<unsigned long long, boost::unordered_set<unsigned long long> >::const_iterator iter=chunks_.begin(); iter!=chunks_.end(); ++iter)
+	{
+		bytes += sizeof(unsigned long long) + sizeof(iter->second) + iter->second.size()*(sizeof(unsigned long long)+2*sizeof(void*));
+	}
+	return bytes;
+}
+
+void VoxelCloudMap::popDirtyChunks(std::set<unsigned long long> & chunks)
+{
+	chunks.insert(dirtyChunks_.begin(), dirtyChunks_.end());
+	dirtyChunks_.clear();
+}
+
+unsigned long long VoxelCloudMap::key(int x, int y, int z)
+{
+	return  ((unsigned long long)((x + VOXEL_KEY_OFFSET) & 0x1FFFFF) << 42) |
+			((unsigned long long)((y + VOXEL_KEY_OFFSET) & 0x1FFFFF) << 21) |
+			((unsigned long long)((z + VOXEL_KEY_OFFSET) & 0x1FFFFF));
+}
+
+void VoxelCloudMap::keyToIndex(unsigned long long key, int & x, int & y, int & z)
+{
+	x = int((key >> 42) & 0x1FFFFF) - VOXEL_KEY_OFFSET;
+	y = int((key >> 21) & 0x1FFFFF) - VOXEL_KEY_OFFSET;
+	z = int(key & 0x1FFFFF) - VOXEL_KEY_OFFSET;
+}
+
+unsigned long long VoxelCloudMap::chunkKey(unsigned long long voxelKey) const
+{
+	UASSERT(chunkSize_ > 0);
+	int x,y,z;
+	keyToIndex(voxelKey, x, y, z);
+	// floor division for negative indices
+	return key(
+			x>=0?x/chunkSize_:(x+1)/chunkSize_-1,
+			y>=0?y/chunkSize_:(y+1)/chunkSize_-1,
+			z>=0?z/chunkSize_:(z+1)/chunkSize_-1);
+}
+
+unsigned long long VoxelCloudMap::key(float x, float y, float z) const
+{
+	return key(
+			(int)std::floor(x/voxelSize_),
+			(int)std::floor(y/voxelSize_),
+			(int)std::floor(z/voxelSize_));
+}
+
+void VoxelCloudMap::addNode(int id, const pcl::PointCloud<pcl::PointXYZRGB> & cloud)
+{
+	removeNode(id);
+
+	// accumulate points of the node per voxel first
+	boost::unordered_map<unsigned long long, Voxel> contributions;
+	for(size_t i=0; i<cloud.size(); ++i)
+	{
+		const pcl::PointXYZRGB & pt = cloud.at(i);
+		if(!pcl::isFinite(pt))
+		{
+			continue;
+		}
+		Voxel & v = contributions[key(pt.x, pt.y, pt.z)];
+		v.x += pt.x;
+		v.y += pt.y;
+		v.z += pt.z;
+		v.r += pt.r;
+		v.g += pt.g;
+		v.b += pt.b;
+		++v.count;
+	}
+
+	std::vector<std::pair<unsigned long long, Voxel> > & node = nodes_[id];
+	node.reserve(contributions.size());
+	for(boost::unordered_map<unsigned long long, Voxel>::iterator iter=contributions.begin(); iter!=contributions.end(); ++iter)
+	{
+		Voxel & v = voxels_[iter->first];
+		if(chunkSize_ > 0)
+		{
+			unsigned long long chunk = chunkKey(iter->first);
+			if(v.count == 0)
+			{
+				chunks_[chunk].insert(iter->first);
+			}
+			dirtyChunks_.insert(chunk);
+		}
+		v.x += iter->second.x;
+		v.y += iter->second.y;
+		v.z += iter->second.z;
+		v.r += iter->second.r;
+		v.g += iter->second.g;
+		v.b += iter->second.b;
+		v.count += iter->second.count;
+		node.push_back(*iter);
+	}
+}
+
+bool VoxelCloudMap::removeNode(int id)
+{
+	std::map<int, std::vector<std::pair<unsigned long long, Voxel> > >::iterator iter = nodes_.find(id);
+	if(iter == nodes_.end())
+	{
+		return false;
+	}
+	for(size_t i=0; i<iter->second.size(); ++i)
+	{
+		boost::unordered_map<unsigned long long, Voxel>::iterator jter = voxels_.find(iter->second[i].first);
+		UASSERT(jter != voxels_.end());
+		const Voxel & c = iter->second[i].second;
+		Voxel & v = jter->second;
+		v.count -= c.count;
+		if(chunkSize_ > 0)
+		{
+			unsigned long long chunk = chunkKey(jter->first);
+			if(v.count <= 0)
+			{
+				boost::unordered_map<unsigned long long, boost::unordered_set<unsigned long long> >::iterator kter = chunks_.find(chunk);
+				UASSERT(kter != chunks_.end());
+				kter->second.erase(jter->first);
+				if(kter->second.empty())
+				{
+					chunks_.erase(kter);
+				}
+			}
+			dirtyChunks_.insert(chunk);
+		}
+		if(v.count <= 0)
+		{
+			voxels_.erase(jter);
+		}
+		else
+		{
+			v.x -= c.x;
+			v.y -= c.y;
+			v.z -= c.z;
+			v.r -= c.r;
+			v.g -= c.g;
+			v.b -= c.b;
+		}
+	}
+	nodes_.erase(iter);
+	return true;
+}
+
+pcl::PointCloud<pcl::PointXYZRGB>::Ptr VoxelCloudMap::subtract(
+		const pcl::PointCloud<pcl::PointXYZRGB> & cloud,
+		float radius,
+		int minNeighbors) const
+{
+	UASSERT(minNeighbors > 0);
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr output(new pcl::PointCloud<pcl::PointXYZRGB>);
+	output->resize(cloud.size());
+	int oi = 0; // output iterator
+	float radiusSqr = radius*radius;
+	int range = (int)std::ceil(radius/voxelSize_);
+	for(size_t i=0; i<cloud.size(); ++i)
+	{
+		const pcl::PointXYZRGB & pt = cloud.at(i);
+		int x = (int)std::floor(pt.x/voxelSize_);
+		int y = (int)std::floor(pt.y/voxelSize_);
+		int z = (int)std::floor(pt.z/voxelSize_);
+		int neighbors = 0;
+		for(int dx=-range; dx<=range && neighbors<minNeighbors; ++dx)
+		{
+			for(int dy=-range; dy<=range && neighbors<minNeighbors; ++dy)
+			{
+				for(int dz=-range; dz<=range && neighbors<minNeighbors; ++dz)
+				{
+					boost::unordered_map<unsigned long long, Voxel>::const_iterator iter = voxels_.find(key(x+dx, y+dy, z+dz));
+					if(iter != voxels_.end())
+					{
+						const Voxel & v = iter->second;
+						float vx = float(v.x/v.count) - pt.x;
+						float vy = float(v.y/v.count) - pt.y;
+						float vz = float(v.z/v.count) - pt.z;
+						if(vx*vx + vy*vy + vz*vz <= radiusSqr)
+						{
+							neighbors += v.count;
+						}
+					}
+				}
+			}
+		}
+		if(neighbors < minNeighbors)
+		{
+			output->at(oi++) = pt;
+		}
+	}
+	output->resize(oi);
+	return output;
+}
+
+void VoxelCloudMap::getCloud(pcl::PointCloud<pcl::PointXYZRGB> & cloud) const
+{
+	cloud.resize(voxels_.size());
+	size_t oi = 0;
+	for(boost::unordered_map<unsigned long long, Voxel>::const_iterator iter=voxels_.begin(); iter!=voxels_.end(); ++iter)
+	{
+		const Voxel & v = iter->second;
+		pcl::PointXYZRGB & pt = cloud.at(oi++);
+		pt.x = float(v.x/v.count);
+		pt.y = float(v.y/v.count);
+		pt.z = float(v.z/v.count);
+		pt.r = (unsigned char)(v.r/v.count);
+		pt.g = (unsigned char)(v.g/v.count);
+		pt.b = (unsigned char)(v.b/v.count);
+	}
+	cloud.is_dense = true;
+}
+
+void VoxelCloudMap::getChunkCloud(
+		unsigned long long chunk,
+		int level,
+		pcl::PointCloud<pcl::PointXYZRGB> & cloud) const
+{
+	UASSERT(level >= 0);
+	boost::unordered_map<unsigned long long, boost::unordered_set<unsigned long long> >::const_iterator iter = chunks_.find(chunk);
+	if(iter == chunks_.end())
+	{
+		return;
+	}
+
+	// Merge voxels in cells of 2^level voxels per side. The centroid of a
+	// cell is the mean of its voxel centroids, so that all surfaces keep
+	// the same weight whatever their number of points.
+	int factor = 1 << level;
+	boost::unordered_map<unsigned long long, Voxel> cells;
+	for(boost::unordered_set<unsigned long long>::const_iterator jter=iter->second.begin(); jter!=iter->second.end(); ++jter)
+	{
+		boost::unordered_map<unsigned long long, Voxel>::const_iterator kter = voxels_.find(*jter);
+		UASSERT(kter != voxels_.end());
+		const Voxel & v = kter->second;
+		unsigned long long cellKey = *jter;
+		if(factor > 1)
+		{
+			int x,y,z;
+			keyToIndex(*jter, x, y, z);
+			cellKey = key(
+					x>=0?x/factor:(x+1)/factor-1,
+					y>=0?y/factor:(y+1)/factor-1,
+					z>=0?z/factor:(z+1)/factor-1);
+		}
+		Voxel & c = cells[cellKey];
+		c.x += v.x/v.count;
+		c.y += v.y/v.count;
+		c.z += v.z/v.count;
+		c.r += v.r/v.count;
+		c.g += v.g/v.count;
+		c.b += v.b/v.count;
+		++c.count;
+	}
+
+	size_t oi = cloud.size();
+	cloud.resize(oi + cells.size());
+	for(boost::unordered_map<unsigned long long, Voxel>::const_iterator jter=cells.begin(); jter!=cells.end(); ++jter)
+	{
+		const Voxel & c = jter->second;
+		pcl::PointXYZRGB & pt = cloud.at(oi++);
+		pt.x = float(c.x/c.count);
+		pt.y = float(c.y/c.count);
+		pt.z = float(c.z/c.count);
+		pt.r = (unsigned char)(c.r/c.count);
+		pt.g = (unsigned char)(c.g/c.count);
+		pt.b = (unsigned char)(c.b/c.count);
+	}
+	cloud.is_dense = true;
+}
+
+}
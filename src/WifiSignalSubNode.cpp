@@ -31,16 +31,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <rtabmap/utilite/UStl.h>
 #include <rtabmap/utilite/ULogger.h>
-#include <rtabmap/core/util3d_transforms.h>
 
 #include <rtabmap_ros/MapData.h>
 #include <rtabmap_ros/MsgConversion.h>
+#include <rtabmap_ros/UserDataLayer.h>
 
 #include <sensor_msgs/PointCloud2.h>
 
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
-#include <pcl_conversions/pcl_conversions.h>
 
 bool hueSymbol = false;
 int min_dbm = -100;
@@ -116,32 +115,17 @@ void HSVtoRGB( float *r, float *g, float *b, float h, float s, float v )
 	}
 }
 
-ros::Publisher wifiSignalCloudPub;
-std::map<double, int> wifiLevels;
-std::map<double, int> nodeStamps_;
-
-void mapDataCallback(const rtabmap_ros::MapDataConstPtr & mapDataMsg)
+class WifiSignalLayer : public rtabmap_ros::UserDataLayer
 {
-	ROS_INFO("Received map data!");
-
-	rtabmap::Transform mapToOdom;
-	std::map<int, rtabmap::Transform> poses;
-	std::multimap<int, rtabmap::Link> links;
-	std::map<int, rtabmap::Signature> signatures;
-	rtabmap_ros::mapDataFromROS(*mapDataMsg, poses, links, signatures, mapToOdom);
-
-	// handle the case where we can receive only latest data, or if all data are published
-	for(std::map<int, rtabmap::Signature>::iterator iter=signatures.begin(); iter!=signatures.end(); ++iter)
+protected:
+	virtual bool extractValue(const rtabmap::Signature & node, double & stamp, float & value) const
 	{
-		int id = iter->first;
-		rtabmap::Signature & node = iter->second;
-
-		nodeStamps_.insert(std::make_pair(node.getStamp(), node.id()));
-
 		if(node.sensorData().envSensors().find(rtabmap::EnvSensor::kWifiSignalStrength) != node.sensorData().envSensors().end())
 		{
 			rtabmap::EnvSensor sensor = node.sensorData().envSensors().at(rtabmap::EnvSensor::kWifiSignalStrength);
-			wifiLevels.insert(std::make_pair(sensor.stamp()>0.0?sensor.stamp():iter->second.getStamp(), sensor.value()));
+			stamp = sensor.stamp()>0.0?sensor.stamp():node.getStamp();
+			value = sensor.value();
+			return true;
 		}
 		else if(!node.sensorData().userDataCompressed().empty())
 		{
@@ -151,154 +135,109 @@ void mapDataCallback(const rtabmap_ros::MapDataConstPtr & mapDataMsg)
 			if(data.type() == CV_64FC1 && data.rows == 1 && data.cols == 2)
 			{
 				// format [int level, double stamp], see wifi_signal_pub_node.cpp
-				int level = data.at<double>(0);
-				double stamp = data.at<double>(1);
-				wifiLevels.insert(std::make_pair(stamp, level));
+				value = int(data.at<double>(0));
+				stamp = data.at<double>(1);
+				return true;
 			}
 			else if(!data.empty())
 			{
 				ROS_ERROR("Wrong user data format for wifi signal.");
 			}
 		}
+		return false;
 	}
 
-	// for the logic below, we should keep only stamps for
-	// nodes still in the graph (in case nodes are ignored when not moving)
-	std::map<double, int> nodeStamps;
-	for(std::map<double, int>::iterator iter=nodeStamps_.begin(); iter!=nodeStamps_.end(); ++iter)
-	{
-		std::map<int, rtabmap::Transform>::const_iterator jter = poses.find(iter->second);
-		if(jter != poses.end())
-		{
-			nodeStamps.insert(*iter);
-		}
-	}
-
-	if(wifiLevels.size() == 0)
+	virtual bool updateScale(const std::map<double, float> & values)
 	{
-		ROS_WARN("No wifi signal detected yet in user data of map data");
-	}
-
-	//============================
-	// Add WIFI symbols
-	//============================
-
-	pcl::PointCloud<pcl::PointXYZRGB>::Ptr assembledWifiSignals(new pcl::PointCloud<pcl::PointXYZRGB>);
-	int id = 0;
-	float min=0,max=0;
-	for(std::map<double, int>::iterator iter=wifiLevels.begin(); iter!=wifiLevels.end(); ++iter, ++id)
-	{
-		if(min == 0.0f || min > iter->second)
+		float min=0,max=0;
+		for(std::map<double, float>::const_iterator iter=values.begin(); iter!=values.end(); ++iter)
 		{
-			min = iter->second;
+			if(min == 0.0f || min > iter->second)
+			{
+				min = iter->second;
+			}
+			if(max == 0.0f || max < iter->second)
+			{
+				max = iter->second;
+			}
 		}
-		if(max == 0.0f || max < iter->second)
+		ROS_INFO("Min/Max dBm = %f %f", min, max);
+		if(autoScale && min<0 && min < max && (min_dbm != int(min) || max_dbm != int(max)))
 		{
-			max = iter->second;
+			min_dbm = min;
+			max_dbm = max;
+			return true;
 		}
+		return false;
 	}
-	ROS_INFO("Min/Max dBm = %f %f", min, max);
-	if(autoScale && min<0 && min < max)
-	{
-		min_dbm = min;
-		max_dbm = max;
-	}
-	for(std::map<double, int>::iterator iter=wifiLevels.begin(); iter!=wifiLevels.end(); ++iter, ++id)
+
+	virtual void createPoints(float value, pcl::PointCloud<pcl::PointXYZRGB> & cloud) const
 	{
-		// The Wifi value may be taken between two nodes, interpolate its position.
-		double stampWifi = iter->first;
-		std::map<double, int>::iterator previousNode = nodeStamps.lower_bound(stampWifi); // lower bound of the stamp
-		if(previousNode!=nodeStamps.end() && previousNode->first > stampWifi && previousNode != nodeStamps.begin())
+		if(hueSymbol)
 		{
-			--previousNode;
+			// scale between red -> yellow -> green
+			int quality = dBm2Quality(value)*120/100;
+			float r,g,b;
+			HSVtoRGB(&r,&g,&b,quality,1,1);
+			pcl::PointXYZRGB anchor;
+			anchor.r = r*255;
+			anchor.g = g*255;
+			anchor.b = b*255;
+			cloud.push_back(anchor);
 		}
-		std::map<double, int>::iterator nextNode = nodeStamps.upper_bound(stampWifi); // upper bound of the stamp
-
-		if(previousNode != nodeStamps.end() &&
-		   nextNode != nodeStamps.end() &&
-		   previousNode->second != nextNode->second &&
-		   uContains(poses, previousNode->second) && uContains(poses, nextNode->second))
+		else
 		{
-			rtabmap::Transform poseA = poses.at(previousNode->second);
-			rtabmap::Transform poseB = poses.at(nextNode->second);
-			double stampA = previousNode->first;
-			double stampB = nextNode->first;
-			UASSERT(stampWifi>=stampA && stampWifi <=stampB);
 
-			rtabmap::Transform v = poseA.inverse() * poseB;
-			double ratio = (stampWifi-stampA)/(stampB-stampA);
-
-			v.x()*=ratio;
-			v.y()*=ratio;
-			v.z()*=ratio;
-
-			rtabmap::Transform wifiPose = (poseA*v).translation(); // rip off the rotation
-
-			pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGB>);
-			if(hueSymbol)
+			// Make a line with points
+			int quality = dBm2Quality(value)/10;
+			for(int i=0; i<10; ++i)
 			{
-				// scale between red -> yellow -> green
-				int quality = dBm2Quality(iter->second)*120/100;
-				float r,g,b;
-				HSVtoRGB(&r,&g,&b,quality,1,1);
-				pcl::PointXYZRGB anchor;
-				anchor.r = r*255;
-				anchor.g = g*255;
-				anchor.b = b*255;
-				cloud->push_back(anchor);
-			}
-			else
-			{
-
-				// Make a line with points
-				int quality = dBm2Quality(iter->second)/10;
-				for(int i=0; i<10; ++i)
+				// 2 cm between each points
+				// the number of points depends on the dBm (which varies from -30 (near) to -80 (far))
+				pcl::PointXYZRGB pt;
+				pt.z = float(i+1)*0.02f;
+				if(i<quality)
 				{
-					// 2 cm between each points
-					// the number of points depends on the dBm (which varies from -30 (near) to -80 (far))
-					pcl::PointXYZRGB pt;
-					pt.z = float(i+1)*0.02f;
-					if(i<quality)
+					// green
+					pt.g = 255;
+					if(i<7)
 					{
-						// green
-						pt.g = 255;
-						if(i<7)
-						{
-							// yellow
-							pt.r = 255;
-						}
+						// yellow
+						pt.r = 255;
 					}
-					else
-					{
-						// gray
-						pt.r = pt.g = pt.b = 100;
-					}
-					cloud->push_back(pt);
 				}
-				pcl::PointXYZRGB anchor;
-				anchor.r = 255;
-				cloud->push_back(anchor);
+				else
+				{
+					// gray
+					pt.r = pt.g = pt.b = 100;
+				}
+				cloud.push_back(pt);
 			}
+			pcl::PointXYZRGB anchor;
+			anchor.r = 255;
+			cloud.push_back(anchor);
+		}
+	}
+};
 
-			cloud = rtabmap::util3d::transformPointCloud(cloud, wifiPose);
+ros::Publisher wifiSignalCloudPub;
+WifiSignalLayer wifiSignalLayer;
 
-			if(assembledWifiSignals->size() == 0)
-			{
-				*assembledWifiSignals = *cloud;
-			}
-			else
-			{
-				*assembledWifiSignals += *cloud;
-			}
-		}
+void mapDataCallback(const rtabmap_ros::MapDataConstPtr & mapDataMsg)
+{
+	ROS_INFO("Received map data!");
+
+	// only the signals of which the poses changed are updated
+	wifiSignalLayer.update(mapDataMsg);
+
+	if(wifiSignalLayer.values().size() == 0)
+	{
+		ROS_WARN("No wifi signal detected yet in user data of map data");
 	}
 
-	if(assembledWifiSignals->size())
+	if(wifiSignalLayer.cloud().width)
 	{
-		sensor_msgs::PointCloud2 cloudMsg;
-		pcl::toROSMsg(*assembledWifiSignals, cloudMsg);
-		cloudMsg.header = mapDataMsg->header;
-		wifiSignalCloudPub.publish(cloudMsg);
+		wifiSignalCloudPub.publish(wifiSignalLayer.cloud());
 	}
 }
 
@@ -37,12 +37,15 @@
  *********************************************************************/
 
 /*
- * Modified: added "layered_costmap_->updateMap(0,0,0);" below
+ * Modified: added "layered_costmap_->updateMap(0,0,0);" below,
+ *           map updates are bounded and accumulated until the next costmap update
  */
 
 #include "static_layer.h"
 #include <costmap_2d/costmap_math.h>
 #include <pluginlib/class_list_macros.h>
+#include <algorithm>
+#include <cstring>
 
 PLUGINLIB_EXPORT_CLASS(rtabmap_ros::StaticLayer, costmap_2d::Layer)
 
@@ -82,6 +85,7 @@ void StaticLayer::onInitialize()
 
   lethal_threshold_ = std::max(std::min(temp_lethal_threshold, 100), 0);
   unknown_cost_value_ = temp_unknown_cost_value;
+  updateInterpretationTable();
   //we'll subscribe to the latched topic that the map server uses
   ROS_INFO("Requesting the map...");
   map_sub_ = g_nh.subscribe(map_topic, 1, &StaticLayer::incomingMap, this);
@@ -147,6 +151,36 @@ unsigned char StaticLayer::interpretValue(unsigned char value)
   return scale * LETHAL_OBSTACLE;
 }
 
+void StaticLayer::updateInterpretationTable()
+{
+  for (int i = 0; i < 256; ++i)
+  {
+    interpretation_table_[i] = interpretValue((unsigned char)i);
+  }
+}
+
+void StaticLayer::addDirtyRegion(unsigned int x, unsigned int y, unsigned int width, unsigned int height)
+{
+  if (has_updated_data_)
+  {
+    // several patches can be received between two costmap updates
+    unsigned int x1 = std::max(x_ + width_, x + width);
+    unsigned int y1 = std::max(y_ + height_, y + height);
+    x_ = std::min(x_, x);
+    y_ = std::min(y_, y);
+    width_ = x1 - x_;
+    height_ = y1 - y_;
+  }
+  else
+  {
+    x_ = x;
+    y_ = y;
+    width_ = width;
+    height_ = height;
+  }
+  has_updated_data_ = true;
+}
+
 void StaticLayer::incomingMap(const nav_msgs::OccupancyGridConstPtr& new_map)
 {
   unsigned int size_x = new_map->info.width, size_y = new_map->info.height;
@@ -154,6 +188,7 @@ void StaticLayer::incomingMap(const nav_msgs::OccupancyGridConstPtr& new_map)
   ROS_DEBUG("Received a %d X %d map at %f m/pix", size_x, size_y, new_map->info.resolution);
 
   // resize costmap if size, resolution or origin do not match
+  bool resized = false;
   Costmap2D* master = layered_costmap_->getCostmap();
   if (master->getSizeInCellsX() != size_x ||
       master->getSizeInCellsY() != size_y ||
@@ -165,51 +200,110 @@ void StaticLayer::incomingMap(const nav_msgs::OccupancyGridConstPtr& new_map)
     ROS_INFO("Resizing costmap to %d X %d at %f m/pix", size_x, size_y, new_map->info.resolution);
     layered_costmap_->resizeMap(size_x, size_y, new_map->info.resolution, new_map->info.origin.position.x,
                                 new_map->info.origin.position.y, true);
+    resized = true;
   }else if(size_x_ != size_x || size_y_ != size_y ||
       resolution_ != new_map->info.resolution ||
       origin_x_ != new_map->info.origin.position.x ||
       origin_y_ != new_map->info.origin.position.y){
     matchSize();
+    resized = true;
   }
 
-  unsigned int index = 0;
-
-  //initialize the costmap with static data
-  for (unsigned int i = 0; i < size_y; ++i)
+  const unsigned char* data = (const unsigned char*)new_map->data.data();
+  if (resized || !map_received_)
   {
-    for (unsigned int j = 0; j < size_x; ++j)
+    //initialize the costmap with static data
+    for (unsigned int i = 0; i < size_x * size_y; ++i)
     {
-      unsigned char value = new_map->data[index];
-      costmap_[index] = interpretValue(value);
-      ++index;
+      costmap_[i] = interpretation_table_[data[i]];
     }
+    addDirtyRegion(0, 0, size_x_, size_y_);
   }
-  x_ = y_ = 0;
-  width_ = size_x_;
-  height_ = size_y_;
+  else
+  {
+    // only copy the rows that changed and keep the bounds of the changes
+    const unsigned char* last_data = last_map_.get() ? (const unsigned char*)last_map_->data.data() : 0;
+    unsigned int min_x = size_x, min_y = size_y, max_x = 0, max_y = 0;
+    for (unsigned int i = 0; i < size_y; ++i)
+    {
+      const unsigned char* row = data + i * size_x;
+      unsigned char* costmap_row = costmap_ + i * size_x;
+      if (last_data && memcmp(row, last_data + i * size_x, size_x) == 0)
+      {
+        continue;
+      }
+      unsigned int first = size_x, last = 0;
+      for (unsigned int j = 0; j < size_x; ++j)
+      {
+        unsigned char cost = interpretation_table_[row[j]];
+        if (costmap_row[j] != cost)
+        {
+          costmap_row[j] = cost;
+          first = std::min(first, j);
+          last = j;
+        }
+      }
+      if (first <= last)
+      {
+        min_x = std::min(min_x, first);
+        max_x = std::max(max_x, last);
+        min_y = std::min(min_y, i);
+        max_y = i;
+      }
+    }
+    if (min_x > max_x || min_y > max_y)
+    {
+      ROS_DEBUG("Received map is the same than the current one, no costmap update required.");
+      last_map_ = new_map;
+      return;
+    }
+    addDirtyRegion(min_x, min_y, max_x - min_x + 1, max_y - min_y + 1);
+  }
+  last_map_ = new_map;
   map_received_ = true;
-  has_updated_data_ = true;
 
   layered_costmap_->updateMap(0,0,0);
 }
 
 void StaticLayer::incomingUpdate(const map_msgs::OccupancyGridUpdateConstPtr& update)
 {
-    unsigned int di = 0;
+    if (update->x < 0 || update->y < 0 ||
+        update->x + update->width > size_x_ || update->y + update->height > size_y_ ||
+        update->data.size() != update->width * update->height)
+    {
+      ROS_WARN("Ignoring map update (%d,%d %dx%d) outside the %dx%d static map",
+          update->x, update->y, update->width, update->height, size_x_, size_y_);
+      return;
+    }
+
+    // only the cells (projected columns) that changed in the patch expand the bounds
+    const unsigned char* data = (const unsigned char*)update->data.data();
+    unsigned int min_x = update->width, min_y = update->height, max_x = 0, max_y = 0;
     for (unsigned int y = 0; y < update->height ; y++)
     {
-        unsigned int index_base = (update->y + y) * size_x_;
+        const unsigned char* row = data + y * update->width;
+        unsigned char* costmap_row = costmap_ + (update->y + y) * size_x_ + update->x;
         for (unsigned int x = 0; x < update->width ; x++)
         {
-            unsigned int index = index_base + x + update->x;
-            costmap_[index] = interpretValue( update->data[di++] );
+            unsigned char cost = interpretation_table_[row[x]];
+            if (costmap_row[x] != cost)
+            {
+                costmap_row[x] = cost;
+                min_x = std::min(min_x, x);
+                max_x = std::max(max_x, x);
+                min_y = std::min(min_y, y);
+                max_y = y;
+            }
         }
     }
-    x_ = update->x;
-    y_ = update->y;
-    width_ = update->width;
-    height_ = update->height;
-    has_updated_data_ = true;
+    // the costmap doesn't match the last full map anymore
+    last_map_.reset();
+    if (min_x > max_x || min_y > max_y)
+    {
+      ROS_DEBUG("Received map update doesn't change the costmap.");
+      return;
+    }
+    addDirtyRegion(update->x + min_x, update->y + min_y, max_x - min_x + 1, max_y - min_y + 1);
 
     layered_costmap_->updateMap(0,0,0);
 }
@@ -255,12 +349,41 @@ void StaticLayer::updateBounds(double robot_x, double robot_y, double robot_yaw,
 
 void StaticLayer::updateCosts(costmap_2d::Costmap2D& master_grid, int min_i, int min_j, int max_i, int max_j)
 {
-  if (!map_received_)
+  if (!map_received_ || !enabled_)
     return;
-  if (!use_maximum_)
-    updateWithTrueOverwrite(master_grid, min_i, min_j, max_i, max_j);
-  else
-    updateWithMax(master_grid, min_i, min_j, max_i, max_j);
+
+  // same as updateWithTrueOverwrite() and updateWithMax(), one row at a time
+  min_i = std::max(min_i, 0);
+  min_j = std::max(min_j, 0);
+  max_i = std::min(max_i, (int)size_x_);
+  max_j = std::min(max_j, (int)size_y_);
+  if (min_i >= max_i || min_j >= max_j)
+    return;
+
+  unsigned char* master_array = master_grid.getCharMap();
+  unsigned int span = master_grid.getSizeInCellsX();
+  unsigned int width = max_i - min_i;
+  for (int j = min_j; j < max_j; ++j)
+  {
+    const unsigned char* row = costmap_ + j * size_x_ + min_i;
+    unsigned char* master_row = master_array + j * span + min_i;
+    if (!use_maximum_)
+    {
+      memcpy(master_row, row, width);
+    }
+    else
+    {
+      for (unsigned int i = 0; i < width; ++i)
+      {
+        unsigned char cost = row[i];
+        unsigned char old_cost = master_row[i];
+        if (cost != NO_INFORMATION && (old_cost == NO_INFORMATION || old_cost < cost))
+        {
+          master_row[i] = cost;
+        }
+      }
+    }
+  }
 }
 
 }  // namespace rtabmap_ros
@@ -78,6 +78,8 @@ private:
   void reconfigureCB(costmap_2d::GenericPluginConfig &config, uint32_t level);
 
   unsigned char interpretValue(unsigned char value);
+  void updateInterpretationTable();
+  void addDirtyRegion(unsigned int x, unsigned int y, unsigned int width, unsigned int height);
 
   std::string global_frame_; ///< @brief The global frame for the costmap
   bool subscribe_to_updates_;
@@ -90,6 +92,8 @@ private:
   ros::Subscriber map_sub_, map_update_sub_;
 
   unsigned char lethal_threshold_, unknown_cost_value_;
+  unsigned char interpretation_table_[256]; ///< @brief interpretValue() for all occupancy values
+  nav_msgs::OccupancyGridConstPtr last_map_; ///< @brief Last map copied as is in the costmap, used to find changed rows
 
   mutable boost::recursive_mutex lock_;
   dynamic_reconfigure::Server<costmap_2d::GenericPluginConfig> *dsrv_;
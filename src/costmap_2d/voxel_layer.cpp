@@ -42,6 +42,8 @@
 #include <pcl_conversions/pcl_conversions.h>
 
 #define VOXEL_BITS 16
+// number of points raytraced per task in the parallel raytracing
+#define RAYTRACE_CHUNK 4096
 PLUGINLIB_EXPORT_CLASS(rtabmap_ros::VoxelLayer, costmap_2d::Layer)
 
 using costmap_2d::NO_INFORMATION;
@@ -51,6 +53,46 @@ using costmap_2d::FREE_SPACE;
 using costmap_2d::ObservationBuffer;
 using costmap_2d::Observation;
 
+namespace
+{
+
+inline bool bitsBelowThreshold(unsigned int n, unsigned int bit_threshold)
+{
+  return (unsigned int)__builtin_popcount(n) <= bit_threshold;
+}
+
+// Same as voxel_grid's ClearVoxelInMap but safe to call from several threads:
+// the column bits are cleared atomically and the column is only flagged as touched,
+// the 2D costmap is updated afterwards from the final state of the column.
+class ClearVoxelConcurrent
+{
+public:
+  ClearVoxelConcurrent(uint32_t* data, uint32_t* touched_columns) :
+      data_(data), touched_columns_(touched_columns)
+  {
+  }
+
+  inline void operator()(unsigned int offset, uint32_t z_mask)
+  {
+    if (__atomic_load_n(&data_[offset], __ATOMIC_RELAXED) & z_mask)
+    {
+      __sync_fetch_and_and(&data_[offset], ~z_mask);
+    }
+    uint32_t bit = 1u << (offset & 31);
+    uint32_t* word = &touched_columns_[offset >> 5];
+    if ((__atomic_load_n(word, __ATOMIC_RELAXED) & bit) == 0)
+    {
+      __sync_fetch_and_or(word, bit);
+    }
+  }
+
+private:
+  uint32_t* data_;
+  uint32_t* touched_columns_;
+};
+
+}  // namespace
+
 
 namespace rtabmap_ros
 {
@@ -64,6 +106,14 @@ void VoxelLayer::onInitialize()
   ros::NodeHandle pnh("~/" + costmap_name);
 
   private_nh.param("publish_voxel_map", publish_voxel_, false);
+  // Number of threads used to raytrace clearing observations (1 = sequential)
+  private_nh.param("raytrace_threads", raytrace_threads_, 1);
+  if (raytrace_threads_ <= 0)
+  {
+    raytrace_threads_ = std::max(1, (int)boost::thread::hardware_concurrency());
+  }
+  // Skip rays of an observation ending in a voxel already reached by another ray of the same observation
+  private_nh.param("raytrace_skip_duplicates", raytrace_skip_duplicates_, false);
   // param from parent costmap group
   pnh.param("robot_base_frame", robot_base_frame_, std::string("base_link"));
 
@@ -144,9 +194,16 @@ void VoxelLayer::updateBounds(double robot_x, double robot_y, double robot_yaw,
   current_ = current;
 
   // raytrace freespace
-  for (unsigned int i = 0; i < clearing_observations.size(); ++i)
+  if (raytrace_threads_ > 1 || raytrace_skip_duplicates_)
   {
-    raytraceFreespace(clearing_observations[i], min_x, min_y, max_x, max_y);
+    raytraceFreespaceParallel(clearing_observations, min_x, min_y, max_x, max_y);
+  }
+  else
+  {
+    for (unsigned int i = 0; i < clearing_observations.size(); ++i)
+    {
+      raytraceFreespace(clearing_observations[i], min_x, min_y, max_x, max_y);
+    }
   }
 
   // place the new obstacles into a priority queue... each with a priority of zero to begin with
@@ -265,6 +322,61 @@ void VoxelLayer::clearNonLethal(double wx, double wy, double w_size_x, double w_
   }
 }
 
+bool VoxelLayer::clipRay(double ox, double oy, double oz, double& wpx, double& wpy, double& wpz,
+                         double& point_x, double& point_y, double& point_z)
+{
+  double map_end_x = origin_x_ + getSizeInMetersX();
+  double map_end_y = origin_y_ + getSizeInMetersY();
+  double map_end_z = origin_z_ + size_z_ * z_resolution_;
+
+  double distance = dist(ox, oy, oz, wpx, wpy, wpz);
+  double scaling_fact = 1.0, scaling_fact_z = 1.0;
+  scaling_fact = std::max(std::min(scaling_fact, (distance - 2 * resolution_) / distance), 0.0);
+  scaling_fact_z = std::max(std::min(scaling_fact_z, (distance - 2 * z_resolution_) / distance), 0.0);
+  wpx = scaling_fact * (wpx - ox) + ox;
+  wpy = scaling_fact * (wpy - oy) + oy;
+  wpz = scaling_fact_z * (wpz - oz) + oz;
+
+  double a = wpx - ox;
+  double b = wpy - oy;
+  double c = wpz - oz;
+  double t = 1.0;
+
+  // the minimum value to raytrace from is the origin
+  if (wpz < origin_z_)
+  {
+    t = std::min(t, (origin_z_ - oz) / c);
+  }
+  if (wpx < origin_x_)
+  {
+    t = std::min(t, (origin_x_ - ox) / a);
+  }
+  if (wpy < origin_y_)
+  {
+    t = std::min(t, (origin_y_ - oy) / b);
+  }
+
+  // the maximum value to raytrace to is the end of the map
+  if (wpx > map_end_x)
+  {
+    t = std::min(t, (map_end_x - ox) / a);
+  }
+  if (wpy > map_end_y)
+  {
+    t = std::min(t, (map_end_y - oy) / b);
+  }
+  if (wpz > map_end_z)
+  {
+    t = std::min(t, (map_end_z - oz) / c);
+  }
+
+  wpx = ox + a * t;
+  wpy = oy + b * t;
+  wpz = oz + c * t;
+
+  return worldToMap3DFloat(wpx, wpy, wpz, point_x, point_y, point_z);
+}
+
 void VoxelLayer::raytraceFreespace(const Observation& clearing_observation, double* min_x, double* min_y,
                                            double* max_x, double* max_y)
 {
@@ -293,11 +405,6 @@ void VoxelLayer::raytraceFreespace(const Observation& clearing_observation, doub
     clearing_endpoints_.points.reserve(clearing_observation_cloud_size);
   }
 
-  // we can pre-compute the enpoints of the map outside of the inner loop... we'll need these later
-  double map_end_x = origin_x_ + getSizeInMetersX();
-  double map_end_y = origin_y_ + getSizeInMetersY();
-  double map_end_z = origin_z_ + size_z_ * z_resolution_;
-
 #ifdef COSTMAP_2D_POINTCLOUD2
     sensor_msgs::PointCloud2ConstIterator<float> iter_x(*(clearing_observation.cloud_), "x");
     sensor_msgs::PointCloud2ConstIterator<float> iter_y(*(clearing_observation.cloud_), "y");
@@ -316,53 +423,8 @@ void VoxelLayer::raytraceFreespace(const Observation& clearing_observation, doub
         double wpz = point_it->z;
 #endif
 
-    double distance = dist(ox, oy, oz, wpx, wpy, wpz);
-    double scaling_fact = 1.0, scaling_fact_z = 1.0;
-    scaling_fact = std::max(std::min(scaling_fact, (distance - 2 * resolution_) / distance), 0.0);
-    scaling_fact_z = std::max(std::min(scaling_fact_z, (distance - 2 * z_resolution_) / distance), 0.0);
-    wpx = scaling_fact * (wpx - ox) + ox;
-    wpy = scaling_fact * (wpy - oy) + oy;
-    wpz = scaling_fact_z * (wpz - oz) + oz;
-
-    double a = wpx - ox;
-    double b = wpy - oy;
-    double c = wpz - oz;
-    double t = 1.0;
-
-    // the minimum value to raytrace from is the origin
-    if (wpz < origin_z_)
-    {
-      t = std::min(t, (origin_z_ - oz) / c);
-    }
-    if (wpx < origin_x_)
-    {
-      t = std::min(t, (origin_x_ - ox) / a);
-    }
-    if (wpy < origin_y_)
-    {
-      t = std::min(t, (origin_y_ - oy) / b);
-    }
-
-    // the maximum value to raytrace to is the end of the map
-    if (wpx > map_end_x)
-    {
-      t = std::min(t, (map_end_x - ox) / a);
-    }
-    if (wpy > map_end_y)
-    {
-      t = std::min(t, (map_end_y - oy) / b);
-    }
-    if (wpz > map_end_z)
-    {
-      t = std::min(t, (map_end_z - oz) / c);
-    }
-
-    wpx = ox + a * t;
-    wpy = oy + b * t;
-    wpz = oz + c * t;
-
     double point_x, point_y, point_z;
-    if (worldToMap3DFloat(wpx, wpy, wpz, point_x, point_y, point_z))
+    if (clipRay(ox, oy, oz, wpx, wpy, wpz, point_x, point_y, point_z))
     {
       unsigned int cell_raytrace_range = cellDistance(clearing_observation.raytrace_range_);
 
@@ -398,6 +460,249 @@ void VoxelLayer::raytraceFreespace(const Observation& clearing_observation, doub
   }
 }
 
+void VoxelLayer::raytraceFreespaceParallel(const std::vector<Observation>& clearing_observations,
+                                           double* min_x, double* min_y, double* max_x, double* max_y)
+{
+  unsigned int columns = size_x_ * size_y_;
+  if (columns == 0)
+    return;
+  if (touched_columns_.size() != (columns + 31) / 32)
+  {
+    touched_columns_.assign((columns + 31) / 32, 0);
+  }
+  if (raytrace_skip_duplicates_)
+  {
+    endpoint_grids_.resize(clearing_observations.size());
+    for (unsigned int i = 0; i < endpoint_grids_.size(); ++i)
+    {
+      if (endpoint_grids_[i].size() != (columns + 1) / 2)
+      {
+        endpoint_grids_[i].assign((columns + 1) / 2, 0);
+      }
+    }
+  }
+
+  // split the observations in chunks of points
+  std::vector<RaytraceTask> tasks;
+  for (unsigned int i = 0; i < clearing_observations.size(); ++i)
+  {
+    const Observation& clearing_observation = clearing_observations[i];
+    size_t clearing_observation_cloud_size = clearing_observation.cloud_->height * clearing_observation.cloud_->width;
+    if (clearing_observation_cloud_size == 0)
+      continue;
+
+    double sensor_x, sensor_y, sensor_z;
+    double ox = clearing_observation.origin_.x;
+    double oy = clearing_observation.origin_.y;
+    double oz = clearing_observation.origin_.z;
+
+    if (!worldToMap3DFloat(ox, oy, oz, sensor_x, sensor_y, sensor_z))
+    {
+      ROS_WARN_THROTTLE(
+          1.0,
+          "The origin for the sensor at (%.2f, %.2f, %.2f) is out of map bounds. So, the costmap cannot raytrace for it.",
+          ox, oy, oz);
+      continue;
+    }
+
+    for (size_t begin = 0; begin < clearing_observation_cloud_size; begin += RAYTRACE_CHUNK)
+    {
+      RaytraceTask task;
+      task.observation = &clearing_observation;
+      task.observation_index = i;
+      task.begin = begin;
+      task.end = std::min(begin + RAYTRACE_CHUNK, clearing_observation_cloud_size);
+      task.sensor_x = sensor_x;
+      task.sensor_y = sensor_y;
+      task.sensor_z = sensor_z;
+      task.min_x = *min_x;
+      task.min_y = *min_y;
+      task.max_x = *max_x;
+      task.max_y = *max_y;
+      tasks.push_back(task);
+    }
+  }
+  if (tasks.empty())
+    return;
+
+  bool publish_clearing_points = (clearing_endpoints_pub_.getNumSubscribers() > 0);
+
+  // the calling thread is one of the workers
+  size_t next_task = 0;
+  boost::mutex tasks_mutex;
+  boost::thread_group threads;
+  int extra_threads = std::min(raytrace_threads_, (int)tasks.size()) - 1;
+  for (int i = 0; i < extra_threads; ++i)
+  {
+    threads.create_thread(boost::bind(&VoxelLayer::raytraceWorker, this, &tasks, &next_task, &tasks_mutex,
+                                      publish_clearing_points));
+  }
+  raytraceWorker(&tasks, &next_task, &tasks_mutex, publish_clearing_points);
+  threads.join_all();
+
+  // now that all rays are done, update the costmap cells of the touched columns
+  uint32_t* data = voxel_grid_.getData();
+  for (unsigned int w = 0; w < touched_columns_.size(); ++w)
+  {
+    uint32_t bits = touched_columns_[w];
+    while (bits)
+    {
+      unsigned int offset = w * 32 + __builtin_ctz(bits);
+      bits &= bits - 1;
+
+      uint32_t col = data[offset];
+      unsigned int unknown_bits = uint16_t(col >> 16) ^ uint16_t(col);
+      unsigned int marked_bits = col >> 16;
+      // make sure the number of bits in each is below our thesholds
+      if (bitsBelowThreshold(marked_bits, mark_threshold_))
+      {
+        if (bitsBelowThreshold(unknown_bits, unknown_threshold_))
+        {
+          costmap_[offset] = FREE_SPACE;
+        }
+        else
+        {
+          costmap_[offset] = NO_INFORMATION;
+        }
+      }
+    }
+    touched_columns_[w] = 0;
+  }
+
+  for (unsigned int i = 0; i < tasks.size(); ++i)
+  {
+    const RaytraceTask& task = tasks[i];
+    touch(task.min_x, task.min_y, min_x, min_y, max_x, max_y);
+    touch(task.max_x, task.max_y, min_x, min_y, max_x, max_y);
+
+    // reset the end points seen for the next update
+    if (raytrace_skip_duplicates_)
+    {
+      std::vector<uint32_t>& grid = endpoint_grids_[task.observation_index];
+      for (unsigned int j = 0; j < task.endpoint_words.size(); ++j)
+      {
+        grid[task.endpoint_words[j]] = 0;
+      }
+    }
+  }
+
+  if (publish_clearing_points)
+  {
+    // publish one cloud per observation, like the sequential raytracing
+    for (unsigned int i = 0; i < tasks.size();)
+    {
+      const Observation& clearing_observation = *tasks[i].observation;
+      clearing_endpoints_.points.clear();
+      for (; i < tasks.size() && tasks[i].observation == &clearing_observation; ++i)
+      {
+        clearing_endpoints_.points.insert(clearing_endpoints_.points.end(), tasks[i].endpoints.begin(),
+                                          tasks[i].endpoints.end());
+      }
+
+      clearing_endpoints_.header.frame_id = global_frame_;
+#ifdef COSTMAP_2D_POINTCLOUD2
+      clearing_endpoints_.header.stamp = clearing_observation.cloud_->header.stamp;
+#else
+      clearing_endpoints_.header.stamp = pcl_conversions::fromPCL(clearing_observation.cloud_->header.stamp);
+#endif
+      clearing_endpoints_.header.seq = clearing_observation.cloud_->header.seq;
+
+      clearing_endpoints_pub_.publish(clearing_endpoints_);
+    }
+  }
+}
+
+void VoxelLayer::raytraceWorker(std::vector<RaytraceTask>* tasks, size_t* next_task, boost::mutex* tasks_mutex,
+                                bool publish_clearing_points)
+{
+  while (true)
+  {
+    size_t i;
+    {
+      boost::mutex::scoped_lock lock(*tasks_mutex);
+      if (*next_task >= tasks->size())
+        return;
+      i = (*next_task)++;
+    }
+    raytraceTask(tasks->at(i), publish_clearing_points);
+  }
+}
+
+void VoxelLayer::raytraceTask(RaytraceTask& task, bool publish_clearing_points)
+{
+  const Observation& clearing_observation = *task.observation;
+  double ox = clearing_observation.origin_.x;
+  double oy = clearing_observation.origin_.y;
+  double oz = clearing_observation.origin_.z;
+  unsigned int cell_raytrace_range = cellDistance(clearing_observation.raytrace_range_);
+  ClearVoxelConcurrent clearer(voxel_grid_.getData(), &touched_columns_[0]);
+  uint32_t* endpoint_grid = raytrace_skip_duplicates_ ? &endpoint_grids_[task.observation_index][0] : 0;
+
+  if (publish_clearing_points)
+  {
+    task.endpoints.reserve(task.end - task.begin);
+  }
+
+#ifdef COSTMAP_2D_POINTCLOUD2
+  sensor_msgs::PointCloud2ConstIterator<float> iter_x(*(clearing_observation.cloud_), "x");
+  sensor_msgs::PointCloud2ConstIterator<float> iter_y(*(clearing_observation.cloud_), "y");
+  sensor_msgs::PointCloud2ConstIterator<float> iter_z(*(clearing_observation.cloud_), "z");
+  iter_x += task.begin;
+  iter_y += task.begin;
+  iter_z += task.begin;
+
+  for (size_t j = task.begin; j < task.end; ++j, ++iter_x, ++iter_y, ++iter_z)
+  {
+    double wpx = *iter_x;
+    double wpy = *iter_y;
+    double wpz = *iter_z;
+#else
+  for (size_t j = task.begin; j < task.end; ++j)
+  {
+    const pcl::PointXYZ& point = clearing_observation.cloud_->points[j];
+    double wpx = point.x;
+    double wpy = point.y;
+    double wpz = point.z;
+#endif
+
+    double point_x, point_y, point_z;
+    if (!clipRay(ox, oy, oz, wpx, wpy, wpz, point_x, point_y, point_z))
+      continue;
+
+    if (endpoint_grid)
+    {
+      // rays to the same end voxel from the same sensor cross the same columns, do them once
+      unsigned int column = (unsigned int)point_y * size_x_ + (unsigned int)point_x;
+      unsigned int word = column >> 1;
+      uint32_t bit = 1u << ((column & 1) * VOXEL_BITS + (unsigned int)point_z);
+      if (__atomic_load_n(&endpoint_grid[word], __ATOMIC_RELAXED) & bit)
+        continue;
+      uint32_t previous = __sync_fetch_and_or(&endpoint_grid[word], bit);
+      if (previous & bit)
+        continue;
+      if (previous == 0)
+      {
+        task.endpoint_words.push_back(word);
+      }
+    }
+
+    voxel_grid_.raytraceLine(clearer, task.sensor_x, task.sensor_y, task.sensor_z, point_x, point_y, point_z,
+                             cell_raytrace_range);
+
+    updateRaytraceBounds(ox, oy, wpx, wpy, clearing_observation.raytrace_range_,
+                         &task.min_x, &task.min_y, &task.max_x, &task.max_y);
+
+    if (publish_clearing_points)
+    {
+      geometry_msgs::Point32 point;
+      point.x = wpx;
+      point.y = wpy;
+      point.z = wpz;
+      task.endpoints.push_back(point);
+    }
+  }
+}
+
 void VoxelLayer::updateOrigin(double new_origin_x, double new_origin_y)
 {
   int cell_oz;
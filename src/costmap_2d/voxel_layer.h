@@ -53,6 +53,7 @@
 #include <costmap_2d/VoxelPluginConfig.h>
 #include <costmap_2d/obstacle_layer.h>
 #include <voxel_grid/voxel_grid.h>
+#include <boost/thread/mutex.hpp>
 
 namespace rtabmap_ros
 {
@@ -61,7 +62,9 @@ class VoxelLayer : public costmap_2d::ObstacleLayer
 {
 public:
   VoxelLayer() :
-      voxel_grid_(0, 0, 0)
+      voxel_grid_(0, 0, 0),
+      raytrace_threads_(1),
+      raytrace_skip_duplicates_(false)
   {
     costmap_ = NULL;  // this is the unsigned char* member of parent class's parent class Costmap2D.
   }
@@ -92,6 +95,39 @@ private:
   virtual void raytraceFreespace(const costmap_2d::Observation& clearing_observation, double* min_x, double* min_y,
                                  double* max_x, double* max_y);
 
+  /**
+   * A chunk of rays of one clearing observation, raytraced by one thread.
+   */
+  struct RaytraceTask
+  {
+    const costmap_2d::Observation* observation;
+    size_t observation_index;
+    size_t begin, end;
+    double sensor_x, sensor_y, sensor_z;
+    double min_x, min_y, max_x, max_y;
+    std::vector<geometry_msgs::Point32> endpoints;
+    std::vector<unsigned int> endpoint_words;
+  };
+
+  /**
+   * @brief  Raytrace all clearing observations at once, splitting them in chunks of points
+   * shared between raytrace_threads_ threads. Voxel columns are cleared with atomic
+   * operations and the costmap cells of touched columns are updated once all rays are done.
+   */
+  void raytraceFreespaceParallel(const std::vector<costmap_2d::Observation>& clearing_observations,
+                                 double* min_x, double* min_y, double* max_x, double* max_y);
+  void raytraceWorker(std::vector<RaytraceTask>* tasks, size_t* next_task, boost::mutex* tasks_mutex,
+                      bool publish_clearing_points);
+  void raytraceTask(RaytraceTask& task, bool publish_clearing_points);
+
+  /**
+   * @brief  Shorten the ray from (ox, oy, oz) to (wpx, wpy, wpz) so that it does not clear
+   * the obstacle itself and stays inside the map.
+   * @return false if the resulting end point is outside the map
+   */
+  bool clipRay(double ox, double oy, double oz, double& wpx, double& wpy, double& wpz,
+               double& point_x, double& point_y, double& point_z);
+
   dynamic_reconfigure::Server<costmap_2d::VoxelPluginConfig> *voxel_dsrv_;
 
   bool publish_voxel_;
@@ -103,6 +139,13 @@ private:
   ros::Publisher clearing_endpoints_pub_;
   sensor_msgs::PointCloud clearing_endpoints_;
 
+  int raytrace_threads_;
+  bool raytrace_skip_duplicates_;
+  // one bit per column, set for columns crossed by a ray during the parallel raytracing
+  std::vector<uint32_t> touched_columns_;
+  // for each clearing observation, one bit per voxel (two columns per word) set for already raytraced end points
+  std::vector<std::vector<uint32_t> > endpoint_grids_;
+
   inline bool worldToMap3DFloat(double wx, double wy, double wz, double& mx, double& my, double& mz)
   {
     if (wx < origin_x_ || wy < origin_y_ || wz < origin_z_)
@@ -39,6 +39,7 @@
 /**
  * Modified matlabbe:
  * Added option to choose between unknown, free and marked cells
+ * Added incremental mode publishing only changed tiles
  */
 
 #include <ros/ros.h>
@@ -63,6 +64,154 @@ float g_colors_a[] = {0.5f, 0.1f, 0.5f};
 std::string g_marker_ns;
 V_Cell g_cells;
 int g_cell_type;
+
+// incremental mode
+bool g_incremental = false;
+int g_tile_size = 16;
+bool g_publish_all = true;
+std::vector<uint32_t> g_last_masks;
+costmap_2d::VoxelGrid g_last_geometry;
+
+// Bits of the column set for the voxels of type g_cell_type
+// (marked: 11, unknown: 01 or 10, free: 00).
+inline uint32_t cellMask(uint32_t column, uint32_t z_mask)
+{
+  uint32_t marked_bits = column >> 16;
+  uint32_t unknown_bits = column & 0xFFFF;
+  if (g_cell_type == voxel_grid::MARKED)
+    return marked_bits & unknown_bits & z_mask;
+  else if (g_cell_type == voxel_grid::UNKNOWN)
+    return (marked_bits ^ unknown_bits) & z_mask;
+  return ~(marked_bits | unknown_bits) & z_mask;
+}
+
+bool sameGeometry(const costmap_2d::VoxelGrid& a, const costmap_2d::VoxelGrid& b)
+{
+  return a.header.frame_id == b.header.frame_id &&
+      a.size_x == b.size_x && a.size_y == b.size_y && a.size_z == b.size_z &&
+      a.origin.x == b.origin.x && a.origin.y == b.origin.y && a.origin.z == b.origin.z &&
+      a.resolutions.x == b.resolutions.x && a.resolutions.y == b.resolutions.y && a.resolutions.z == b.resolutions.z;
+}
+
+void initMarker(visualization_msgs::Marker& m, const costmap_2d::VoxelGrid& grid, int id)
+{
+  m.header.frame_id = grid.header.frame_id;
+  m.header.stamp = grid.header.stamp;
+  m.ns = g_marker_ns;
+  m.id = id;
+  m.type = visualization_msgs::Marker::CUBE_LIST;
+  m.action = visualization_msgs::Marker::ADD;
+  m.pose.orientation.w = 1.0;
+  m.scale.x = grid.resolutions.x;
+  m.scale.y = grid.resolutions.y;
+  m.scale.z = grid.resolutions.z;
+  m.color.r = g_colors_r[g_cell_type];
+  m.color.g = g_colors_g[g_cell_type];
+  m.color.b = g_colors_b[g_cell_type];
+  m.color.a = g_colors_a[g_cell_type];
+}
+
+// Publish one CUBE_LIST per tile of g_tile_size x g_tile_size columns, only
+// for tiles in which voxels of the selected type were added or removed.
+void voxelCallbackIncremental(const ros::Publisher& pub, const costmap_2d::VoxelGridConstPtr& grid)
+{
+  ros::WallTime start = ros::WallTime::now();
+
+  const uint32_t* data = &grid->data.front();
+  const uint32_t x_size = grid->size_x;
+  const uint32_t y_size = grid->size_y;
+  const uint32_t z_size = grid->size_z;
+  const uint32_t z_mask = z_size >= 16 ? 0xFFFF : ((1u << z_size) - 1);
+  const uint32_t tiles_x = (x_size + g_tile_size - 1) / g_tile_size;
+  const uint32_t tiles_y = (y_size + g_tile_size - 1) / g_tile_size;
+
+  visualization_msgs::MarkerArray markers;
+  bool publish_all = g_publish_all || g_last_masks.size() != x_size * y_size || !sameGeometry(g_last_geometry, *grid);
+  if (publish_all)
+  {
+    // the grid moved or a new subscriber connected, restart from scratch
+    visualization_msgs::Marker m;
+    m.header = grid->header;
+    m.ns = g_marker_ns;
+    m.action = visualization_msgs::Marker::DELETEALL;
+    markers.markers.push_back(m);
+    g_last_masks.assign(x_size * y_size, 0);
+    g_publish_all = false;
+  }
+
+  uint32_t num_markers = 0;
+  for (uint32_t ty = 0; ty < tiles_y; ++ty)
+  {
+    const uint32_t y_end = std::min((ty + 1) * g_tile_size, y_size);
+    for (uint32_t tx = 0; tx < tiles_x; ++tx)
+    {
+      const uint32_t x_end = std::min((tx + 1) * g_tile_size, x_size);
+
+      // word-level comparison with the last grid
+      bool changed = false;
+      bool empty = true;
+      for (uint32_t y_grid = ty * g_tile_size; y_grid < y_end; ++y_grid)
+      {
+        for (uint32_t x_grid = tx * g_tile_size; x_grid < x_end; ++x_grid)
+        {
+          const uint32_t index = y_grid * x_size + x_grid;
+          const uint32_t mask = cellMask(data[index], z_mask);
+          changed = changed || (mask ^ g_last_masks[index]) != 0;
+          empty = empty && mask == 0;
+          g_last_masks[index] = mask;
+        }
+      }
+      if (!changed || (empty && publish_all))
+      {
+        continue;
+      }
+
+      visualization_msgs::Marker m;
+      initMarker(m, *grid, ty * tiles_x + tx);
+      if (empty)
+      {
+        m.action = visualization_msgs::Marker::DELETE;
+      }
+      else
+      {
+        for (uint32_t y_grid = ty * g_tile_size; y_grid < y_end; ++y_grid)
+        {
+          for (uint32_t x_grid = tx * g_tile_size; x_grid < x_end; ++x_grid)
+          {
+            uint32_t mask = g_last_masks[y_grid * x_size + x_grid];
+            while (mask)
+            {
+              uint32_t z_grid = __builtin_ctz(mask);
+              mask &= mask - 1;
+              geometry_msgs::Point p;
+              p.x = grid->origin.x + (x_grid + 0.5) * grid->resolutions.x;
+              p.y = grid->origin.y + (y_grid + 0.5) * grid->resolutions.y;
+              p.z = grid->origin.z + (z_grid + 0.5) * grid->resolutions.z;
+              m.points.push_back(p);
+            }
+          }
+        }
+        num_markers += m.points.size();
+      }
+      markers.markers.push_back(m);
+    }
+  }
+  g_last_geometry.header = grid->header;
+  g_last_geometry.size_x = x_size;
+  g_last_geometry.size_y = y_size;
+  g_last_geometry.size_z = z_size;
+  g_last_geometry.origin = grid->origin;
+  g_last_geometry.resolutions = grid->resolutions;
+
+  if (!markers.markers.empty())
+  {
+    pub.publish(markers);
+  }
+
+  ros::WallTime end = ros::WallTime::now();
+  ROS_DEBUG("Published %d tiles (%d markers) in %f seconds", (int)markers.markers.size(), num_markers, (end - start).toSec());
+}
+
 void voxelCallback(const ros::Publisher& pub, const costmap_2d::VoxelGridConstPtr& grid)
 {
   if (grid->data.empty())
@@ -71,6 +220,12 @@ void voxelCallback(const ros::Publisher& pub, const costmap_2d::VoxelGridConstPt
     return;
   }
 
+  if (g_incremental)
+  {
+    voxelCallbackIncremental(pub, grid);
+    return;
+  }
+
   ros::WallTime start = ros::WallTime::now();
 
   ROS_DEBUG("Received voxel grid");
@@ -149,7 +304,12 @@ ros::Subscriber sub;
 void connectCb()
 {
 	ros::NodeHandle n;
-	sub = n.subscribe < costmap_2d::VoxelGrid > ("voxel_grid", 1, boost::bind(voxelCallback, pub, _1));
+	// new subscribers need all tiles
+	g_publish_all = true;
+	if(!sub)
+	{
+		sub = n.subscribe < costmap_2d::VoxelGrid > ("voxel_grid", 1, boost::bind(voxelCallback, pub, _1));
+	}
 }
 
 void disconnectCb()
@@ -169,13 +329,27 @@ int main(int argc, char** argv)
   pnh.param("g", g_colors_g[g_cell_type], g_colors_g[g_cell_type]);
   pnh.param("b", g_colors_b[g_cell_type], g_colors_b[g_cell_type]);
   pnh.param("a", g_colors_a[g_cell_type], g_colors_a[g_cell_type]);
+  // Publish only the changed tiles as a MarkerArray on "visualization_marker_array"
+  pnh.param("incremental", g_incremental, g_incremental);
+  pnh.param("tile_size", g_tile_size, g_tile_size);
+  if(g_tile_size <= 0)
+  {
+    g_tile_size = 16;
+  }
 
   ROS_DEBUG("Startup");
 
   ros::SubscriberStatusCallback connect_cb = boost::bind(connectCb);
   ros::SubscriberStatusCallback disconnect_cb = boost::bind(disconnectCb);
 
-  pub = n.advertise < visualization_msgs::Marker > ("visualization_marker", 1, connect_cb, disconnect_cb);
+  if(g_incremental)
+  {
+    pub = n.advertise < visualization_msgs::MarkerArray > ("visualization_marker_array", 1, connect_cb, disconnect_cb);
+  }
+  else
+  {
+    pub = n.advertise < visualization_msgs::Marker > ("visualization_marker", 1, connect_cb, disconnect_cb);
+  }
   g_marker_ns = n.resolveName("voxel_grid");
 
   ros::spin();
@@ -38,7 +38,7 @@ void CommonDataSubscriber::rgbdCallback(
 		const rtabmap_ros::RGBDImageConstPtr& image1Msg)
 {
 	cv_bridge::CvImageConstPtr rgb, depth;
-	rtabmap_ros::toCvShare(image1Msg, rgb, depth);
+	rgbdToCvShare(image1Msg, rgb, depth);
 
 	rtabmap_ros::UserDataConstPtr userDataMsg; // Null
 	nav_msgs::OdometryConstPtr odomMsg; // Null
@@ -63,7 +63,7 @@ void CommonDataSubscriber::rgbdScan2dCallback(
 		const sensor_msgs::LaserScanConstPtr& scanMsg)
 {
 	cv_bridge::CvImageConstPtr rgb, depth;
-	rtabmap_ros::toCvShare(image1Msg, rgb, depth);
+	rgbdToCvShare(image1Msg, rgb, depth);
 
 	rtabmap_ros::UserDataConstPtr userDataMsg; // Null
 	nav_msgs::OdometryConstPtr odomMsg; // Null
@@ -87,7 +87,7 @@ void CommonDataSubscriber::rgbdScan3dCallback(
 		const sensor_msgs::PointCloud2ConstPtr& scan3dMsg)
 {
 	cv_bridge::CvImageConstPtr rgb, depth;
-	rtabmap_ros::toCvShare(image1Msg, rgb, depth);
+	rgbdToCvShare(image1Msg, rgb, depth);
 
 	rtabmap_ros::UserDataConstPtr userDataMsg; // Null
 	nav_msgs::OdometryConstPtr odomMsg; // Null
@@ -111,7 +111,7 @@ void CommonDataSubscriber::rgbdScanDescCallback(
 		const rtabmap_ros::ScanDescriptorConstPtr& scanDescMsg)
 {
 	cv_bridge::CvImageConstPtr rgb, depth;
-	rtabmap_ros::toCvShare(image1Msg, rgb, depth);
+	rgbdToCvShare(image1Msg, rgb, depth);
 
 	rtabmap_ros::UserDataConstPtr userDataMsg; // Null
 	nav_msgs::OdometryConstPtr odomMsg; // Null
@@ -134,7 +134,7 @@ void CommonDataSubscriber::rgbdInfoCallback(
 		const rtabmap_ros::OdomInfoConstPtr& odomInfoMsg)
 {
 	cv_bridge::CvImageConstPtr rgb, depth;
-	rtabmap_ros::toCvShare(image1Msg, rgb, depth);
+	rgbdToCvShare(image1Msg, rgb, depth);
 
 	rtabmap_ros::UserDataConstPtr userDataMsg; // Null
 	nav_msgs::OdometryConstPtr odomMsg; // Null
@@ -160,7 +160,7 @@ void CommonDataSubscriber::rgbdOdomCallback(
 		const rtabmap_ros::RGBDImageConstPtr& image1Msg)
 {
 	cv_bridge::CvImageConstPtr rgb, depth;
-	rtabmap_ros::toCvShare(image1Msg, rgb, depth);
+	rgbdToCvShare(image1Msg, rgb, depth);
 
 	rtabmap_ros::UserDataConstPtr userDataMsg; // Null
 	sensor_msgs::LaserScan scanMsg; // Null
@@ -185,7 +185,7 @@ void CommonDataSubscriber::rgbdOdomScan2dCallback(
 		const sensor_msgs::LaserScanConstPtr& scanMsg)
 {
 	cv_bridge::CvImageConstPtr rgb, depth;
-	rtabmap_ros::toCvShare(image1Msg, rgb, depth);
+	rgbdToCvShare(image1Msg, rgb, depth);
 
 	rtabmap_ros::UserDataConstPtr userDataMsg; // Null
 	sensor_msgs::PointCloud2 scan3dMsg; // Null
@@ -209,7 +209,7 @@ void CommonDataSubscriber::rgbdOdomScan3dCallback(
 		const sensor_msgs::PointCloud2ConstPtr& scan3dMsg)
 {
 	cv_bridge::CvImageConstPtr rgb, depth;
-	rtabmap_ros::toCvShare(image1Msg, rgb, depth);
+	rgbdToCvShare(image1Msg, rgb, depth);
 
 	rtabmap_ros::UserDataConstPtr userDataMsg; // Null
 	sensor_msgs::LaserScan scanMsg; // Null
@@ -233,7 +233,7 @@ void CommonDataSubscriber::rgbdOdomScanDescCallback(
 		const rtabmap_ros::ScanDescriptorConstPtr& scanDescMsg)
 {
 	cv_bridge::CvImageConstPtr rgb, depth;
-	rtabmap_ros::toCvShare(image1Msg, rgb, depth);
+	rgbdToCvShare(image1Msg, rgb, depth);
 
 	rtabmap_ros::UserDataConstPtr userDataMsg; // Null
 	rtabmap_ros::OdomInfoConstPtr odomInfoMsg; // null
@@ -260,7 +260,7 @@ void CommonDataSubscriber::rgbdOdomInfoCallback(
 		const rtabmap_ros::OdomInfoConstPtr& odomInfoMsg)
 {
 	cv_bridge::CvImageConstPtr rgb, depth;
-	rtabmap_ros::toCvShare(image1Msg, rgb, depth);
+	rgbdToCvShare(image1Msg, rgb, depth);
 
 	rtabmap_ros::UserDataConstPtr userDataMsg; // Null
 	sensor_msgs::LaserScan scanMsg; // Null
@@ -286,7 +286,7 @@ void CommonDataSubscriber::rgbdDataCallback(
 		const rtabmap_ros::RGBDImageConstPtr& image1Msg)
 {
 	cv_bridge::CvImageConstPtr rgb, depth;
-	rtabmap_ros::toCvShare(image1Msg, rgb, depth);
+	rgbdToCvShare(image1Msg, rgb, depth);
 
 	nav_msgs::OdometryConstPtr odomMsg; // Null
 	sensor_msgs::LaserScan scanMsg; // Null
@@ -311,7 +311,7 @@ void CommonDataSubscriber::rgbdDataScan2dCallback(
 		const sensor_msgs::LaserScanConstPtr& scanMsg)
 {
 	cv_bridge::CvImageConstPtr rgb, depth;
-	rtabmap_ros::toCvShare(image1Msg, rgb, depth);
+	rgbdToCvShare(image1Msg, rgb, depth);
 
 	nav_msgs::OdometryConstPtr odomMsg; // Null
 	sensor_msgs::PointCloud2 scan3dMsg; // Null
@@ -335,7 +335,7 @@ void CommonDataSubscriber::rgbdDataScan3dCallback(
 		const sensor_msgs::PointCloud2ConstPtr& scan3dMsg)
 {
 	cv_bridge::CvImageConstPtr rgb, depth;
-	rtabmap_ros::toCvShare(image1Msg, rgb, depth);
+	rgbdToCvShare(image1Msg, rgb, depth);
 
 	nav_msgs::OdometryConstPtr odomMsg; // Null
 	sensor_msgs::LaserScan scanMsg; // Null
@@ -359,7 +359,7 @@ void CommonDataSubscriber::rgbdDataScanDescCallback(
 		const rtabmap_ros::ScanDescriptorConstPtr& scanDescMsg)
 {
 	cv_bridge::CvImageConstPtr rgb, depth;
-	rtabmap_ros::toCvShare(image1Msg, rgb, depth);
+	rgbdToCvShare(image1Msg, rgb, depth);
 
 	nav_msgs::OdometryConstPtr odomMsg; // Null
 	rtabmap_ros::OdomInfoConstPtr odomInfoMsg; // null
@@ -386,7 +386,7 @@ void CommonDataSubscriber::rgbdDataInfoCallback(
 		const rtabmap_ros::OdomInfoConstPtr& odomInfoMsg)
 {
 	cv_bridge::CvImageConstPtr rgb, depth;
-	rtabmap_ros::toCvShare(image1Msg, rgb, depth);
+	rgbdToCvShare(image1Msg, rgb, depth);
 
 	nav_msgs::OdometryConstPtr odomMsg; // Null
 	sensor_msgs::LaserScan scanMsg; // Null
@@ -412,7 +412,7 @@ void CommonDataSubscriber::rgbdOdomDataCallback(
 		const rtabmap_ros::RGBDImageConstPtr& image1Msg)
 {
 	cv_bridge::CvImageConstPtr rgb, depth;
-	rtabmap_ros::toCvShare(image1Msg, rgb, depth);
+	rgbdToCvShare(image1Msg, rgb, depth);
 
 	sensor_msgs::LaserScan scanMsg; // Null
 	sensor_msgs::PointCloud2 scan3dMsg; // Null
@@ -437,7 +437,7 @@ void CommonDataSubscriber::rgbdOdomDataScan2dCallback(
 		const sensor_msgs::LaserScanConstPtr& scanMsg)
 {
 	cv_bridge::CvImageConstPtr rgb, depth;
-	rtabmap_ros::toCvShare(image1Msg, rgb, depth);
+	rgbdToCvShare(image1Msg, rgb, depth);
 
 	sensor_msgs::PointCloud2 scan3dMsg; // Null
 	rtabmap_ros::OdomInfoConstPtr odomInfoMsg; // null
@@ -461,7 +461,7 @@ void CommonDataSubscriber::rgbdOdomDataScan3dCallback(
 		const sensor_msgs::PointCloud2ConstPtr& scan3dMsg)
 {
 	cv_bridge::CvImageConstPtr rgb, depth;
-	rtabmap_ros::toCvShare(image1Msg, rgb, depth);
+	rgbdToCvShare(image1Msg, rgb, depth);
 
 	sensor_msgs::LaserScan scanMsg; // Null
 	rtabmap_ros::OdomInfoConstPtr odomInfoMsg; // null
@@ -485,7 +485,7 @@ void CommonDataSubscriber::rgbdOdomDataScanDescCallback(
 		const rtabmap_ros::ScanDescriptorConstPtr& scanDescMsg)
 {
 	cv_bridge::CvImageConstPtr rgb, depth;
-	rtabmap_ros::toCvShare(image1Msg, rgb, depth);
+	rgbdToCvShare(image1Msg, rgb, depth);
 
 	rtabmap_ros::OdomInfoConstPtr odomInfoMsg; // null
 
@@ -512,7 +512,7 @@ void CommonDataSubscriber::rgbdOdomDataInfoCallback(
 		const rtabmap_ros::OdomInfoConstPtr& odomInfoMsg)
 {
 	cv_bridge::CvImageConstPtr rgb, depth;
-	rtabmap_ros::toCvShare(image1Msg, rgb, depth);
+	rgbdToCvShare(image1Msg, rgb, depth);
 
 	sensor_msgs::LaserScan scanMsg; // Null
 	sensor_msgs::PointCloud2 scan3dMsg; // Null
@@ -0,0 +1,251 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <rtabmap_ros/CommonDataSubscriber.h>
+#include <rtabmap/utilite/UConversion.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/core/Compression.h>
+#include <rtabmap_ros/MsgConversion.h>
+#include <cv_bridge/cv_bridge.h>
+
+namespace rtabmap_ros {
+
+template<class M>
+void CommonDataSubscriber::rgbdXCallback(const boost::shared_ptr<M const> & msg, int topic)
+{
+	syncStatsReceived(topic);
+	boost::mutex::scoped_lock lock(rgbdXMutex_);
+	rgbdXSync_.add(topic, msg->header.stamp.toSec(), msg);
+	while(rgbdXSync_.pop(rgbdXMsgs_, rgbdXStamps_))
+	{
+		rgbdXPublish();
+	}
+}
+
+void CommonDataSubscriber::rgbdXPublish()
+{
+	callbackCalled();
+
+	nav_msgs::OdometryConstPtr odomMsg; // Null
+	rtabmap_ros::UserDataConstPtr userDataMsg; // Null
+	rtabmap_ros::OdomInfoConstPtr odomInfoMsg; // Null
+	sensor_msgs::LaserScanConstPtr scan2dMsg;
+	sensor_msgs::PointCloud2ConstPtr scan3dMsg;
+	rtabmap_ros::ScanDescriptorConstPtr scanDescMsg;
+	syncStatsUpdate(&rgbdXStamps_[0], (int)rgbdXStamps_.size());
+
+	for(size_t i=0; i<rgbdXMsgs_.size(); ++i)
+	{
+		const MessageSynchronizer::MessagePtr & msg = rgbdXMsgs_[i];
+		switch(rgbdXTypes_[i])
+		{
+		case kRGBDXImage:
+			rgbdXImages_[i] = boost::static_pointer_cast<rtabmap_ros::RGBDImage const>(msg);
+			break;
+		case kRGBDXOdom:
+			odomMsg = boost::static_pointer_cast<nav_msgs::Odometry const>(msg);
+			break;
+		case kRGBDXUserData:
+			userDataMsg = boost::static_pointer_cast<rtabmap_ros::UserData const>(msg);
+			break;
+		case kRGBDXScan2d:
+			scan2dMsg = boost::static_pointer_cast<sensor_msgs::LaserScan const>(msg);
+			break;
+		case kRGBDXScan3d:
+			scan3dMsg = boost::static_pointer_cast<sensor_msgs::PointCloud2 const>(msg);
+			break;
+		case kRGBDXScanDesc:
+			scanDescMsg = boost::static_pointer_cast<rtabmap_ros::ScanDescriptor const>(msg);
+			break;
+		case kRGBDXOdomInfo:
+			odomInfoMsg = boost::static_pointer_cast<rtabmap_ros::OdomInfo const>(msg);
+			break;
+		}
+	}
+
+	// The vectors keep their capacity between frames
+	rtabmap_ros::toCvShare(rgbdXImages_, rgbdXRgbs_, rgbdXDepths_);
+	rgbdXGlobalDescriptors_.clear();
+	for(int i=0; i<rgbdXCameras_; ++i)
+	{
+		const rtabmap_ros::RGBDImage & image = *rgbdXImages_[i];
+		rgbdXCameraInfos_[i] = image.rgb_camera_info;
+		if(!image.global_descriptor.data.empty())
+		{
+			rgbdXGlobalDescriptors_.push_back(image.global_descriptor);
+		}
+		rgbdXKeyPoints_[i] = image.key_points;
+		rgbdXPoints3d_[i] = image.points;
+		rgbdXDescriptors_[i] = rtabmap::uncompressData(image.descriptors);
+	}
+
+	sensor_msgs::LaserScan scanMsg; // Null
+	sensor_msgs::PointCloud2 scanCloudMsg; // Null
+	const sensor_msgs::LaserScan * scan = &scanMsg;
+	const sensor_msgs::PointCloud2 * scanCloud = &scanCloudMsg;
+	if(scan2dMsg.get())
+	{
+		scan = scan2dMsg.get();
+	}
+	else if(scan3dMsg.get())
+	{
+		scanCloud = scan3dMsg.get();
+	}
+	else if(scanDescMsg.get())
+	{
+		scan = &scanDescMsg->scan;
+		scanCloud = &scanDescMsg->scan_cloud;
+		if(!scanDescMsg->global_descriptor.data.empty())
+		{
+			rgbdXGlobalDescriptors_.push_back(scanDescMsg->global_descriptor);
+		}
+	}
+
+	static const std::vector<cv_bridge::CvImageConstPtr> noDepth;
+	commonDepthCallback(
+			odomMsg,
+			userDataMsg,
+			rgbdXRgbs_,
+			rgbdXDepths_[0].get()?rgbdXDepths_:noDepth,
+			rgbdXCameraInfos_,
+			*scan,
+			*scanCloud,
+			odomInfoMsg,
+			rgbdXGlobalDescriptors_,
+			rgbdXKeyPoints_,
+			rgbdXPoints3d_,
+			rgbdXDescriptors_);
+}
+
+void CommonDataSubscriber::setupRGBDXCallbacks(
+		ros::NodeHandle & nh,
+		ros::NodeHandle & pnh,
+		int rgbdCameras,
+		bool subscribeOdom,
+		bool subscribeUserData,
+		bool subscribeScan2d,
+		bool subscribeScan3d,
+		bool subscribeScanDesc,
+		bool subscribeOdomInfo,
+		int queueSize,
+		bool approxSync,
+		double approxSyncMaxInterval)
+{
+	ROS_INFO("Setup rgbd%d callback", rgbdCameras);
+	UASSERT(rgbdCameras >= 1);
+
+	rgbdXCameras_ = rgbdCameras;
+
+	std::vector<RGBDXType> types(rgbdCameras, kRGBDXImage);
+	if(subscribeOdom)
+	{
+		types.push_back(kRGBDXOdom);
+	}
+	if(subscribeUserData)
+	{
+		types.push_back(kRGBDXUserData);
+	}
+	if(subscribeScanDesc)
+	{
+		subscribedToScanDescriptor_ = true;
+		types.push_back(kRGBDXScanDesc);
+	}
+	else if(subscribeScan2d)
+	{
+		subscribedToScan2d_ = true;
+		types.push_back(kRGBDXScan2d);
+	}
+	else if(subscribeScan3d)
+	{
+		subscribedToScan3d_ = true;
+		types.push_back(kRGBDXScan3d);
+	}
+	if(subscribeOdomInfo)
+	{
+		subscribedToOdomInfo_ = true;
+		types.push_back(kRGBDXOdomInfo);
+	}
+
+	rgbdXTypes_ = types;
+	rgbdXSync_.init((int)types.size(), queueSize, approxSync, approxSyncMaxInterval);
+	rgbdXSubs_.resize(types.size());
+	subscribedTopicsMsg_ = uFormat("\n%s subscribed to (%s sync%s):",
+			name_.c_str(),
+			approxSync?"approx":"exact",
+			approxSync && approxSyncMaxInterval>0.0?uFormat(", max interval %fs", approxSyncMaxInterval).c_str():"");
+	for(size_t i=0; i<types.size(); ++i)
+	{
+		switch(types[i])
+		{
+		case kRGBDXImage:
+			rgbdXSubs_[i] = nh.subscribe<rtabmap_ros::RGBDImage>(uFormat("rgbd_image%d", (int)i), queueSize,
+					boost::bind(&CommonDataSubscriber::rgbdXCallback<rtabmap_ros::RGBDImage>, this, _1, (int)i));
+			break;
+		case kRGBDXOdom:
+			rgbdXSubs_[i] = nh.subscribe<nav_msgs::Odometry>("odom", queueSize,
+					boost::bind(&CommonDataSubscriber::rgbdXCallback<nav_msgs::Odometry>, this, _1, (int)i));
+			break;
+		case kRGBDXUserData:
+			rgbdXSubs_[i] = nh.subscribe<rtabmap_ros::UserData>("user_data", queueSize,
+					boost::bind(&CommonDataSubscriber::rgbdXCallback<rtabmap_ros::UserData>, this, _1, (int)i));
+			break;
+		case kRGBDXScan2d:
+			rgbdXSubs_[i] = nh.subscribe<sensor_msgs::LaserScan>("scan", queueSize,
+					boost::bind(&CommonDataSubscriber::rgbdXCallback<sensor_msgs::LaserScan>, this, _1, (int)i));
+			break;
+		case kRGBDXScan3d:
+			rgbdXSubs_[i] = nh.subscribe<sensor_msgs::PointCloud2>("scan_cloud", queueSize,
+					boost::bind(&CommonDataSubscriber::rgbdXCallback<sensor_msgs::PointCloud2>, this, _1, (int)i));
+			break;
+		case kRGBDXScanDesc:
+			rgbdXSubs_[i] = nh.subscribe<rtabmap_ros::ScanDescriptor>("scan_descriptor", queueSize,
+					boost::bind(&CommonDataSubscriber::rgbdXCallback<rtabmap_ros::ScanDescriptor>, this, _1, (int)i));
+			break;
+		case kRGBDXOdomInfo:
+			rgbdXSubs_[i] = nh.subscribe<rtabmap_ros::OdomInfo>("odom_info", queueSize,
+					boost::bind(&CommonDataSubscriber::rgbdXCallback<rtabmap_ros::OdomInfo>, this, _1, (int)i));
+			break;
+		}
+		syncStatsTopic((int)i, rgbdXSubs_[i].getTopic());
+		subscribedTopicsMsg_ += uFormat("%s\n   %s", i>0?" \\":"", rgbdXSubs_[i].getTopic().c_str());
+	}
+
+	// allocated once, reused for each synchronized frame
+	rgbdXMsgs_.resize(types.size());
+	rgbdXStamps_.resize(types.size());
+	rgbdXImages_.resize(rgbdCameras);
+	rgbdXRgbs_.resize(rgbdCameras);
+	rgbdXDepths_.resize(rgbdCameras);
+	rgbdXCameraInfos_.resize(rgbdCameras);
+	rgbdXGlobalDescriptors_.reserve(rgbdCameras+1);
+	rgbdXKeyPoints_.resize(rgbdCameras);
+	rgbdXPoints3d_.resize(rgbdCameras);
+	rgbdXDescriptors_.resize(rgbdCameras);
+}
+
+} /* namespace rtabmap_ros */
@@ -0,0 +1,168 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <ros/ros.h>
+#include <pluginlib/class_list_macros.h>
+#include <nodelet/nodelet.h>
+#include <image_transport/image_transport.h>
+#include <rtabmap/core/CameraRGB.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UDirectory.h>
+#include <rtabmap/utilite/UFile.h>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <boost/thread.hpp>
+#include "rtabmap_ros/ImageBufferPool.h"
+#include "rtabmap_ros/NodeletDiagnostics.h"
+
+namespace rtabmap_ros
+{
+
+/**
+ * Nodelet version of the "camera" node: captured images are copied once
+ * in a pool of preallocated messages, then published as shared pointers
+ * (no serialization nor copy for nodelets in the same manager).
+ */
+class CameraNodelet : public nodelet::Nodelet
+{
+public:
+	CameraNodelet() :
+		camera_(0),
+		captureThread_(0),
+		frameId_("camera"),
+		pool_(4)
+	{}
+
+	virtual ~CameraNodelet()
+	{
+		if(captureThread_)
+		{
+			captureThread_->interrupt();
+			captureThread_->join();
+			delete captureThread_;
+		}
+		delete camera_;
+	}
+
+private:
+	virtual void onInit()
+	{
+		ros::NodeHandle & nh = getNodeHandle();
+		ros::NodeHandle & pnh = getPrivateNodeHandle();
+
+		int deviceId = 0;
+		double frameRate = 0.0;
+		std::string path;
+		int poolSize = (int)pool_.size();
+		pnh.param("device_id", deviceId, deviceId);
+		pnh.param("frame_rate", frameRate, frameRate);
+		pnh.param("video_or_images_path", path, path);
+		pnh.param("frame_id", frameId_, frameId_);
+		pnh.param("pool_size", poolSize, poolSize);
+		NODELET_INFO("device_id: %d", deviceId);
+		NODELET_INFO("frame_rate: %f", frameRate);
+		NODELET_INFO("video_or_images_path: %s", path.c_str());
+		NODELET_INFO("frame_id: %s", frameId_.c_str());
+		NODELET_INFO("pool_size: %d", poolSize);
+		pool_.setSize(poolSize>0?poolSize:1);
+
+		if(!path.empty() && UDirectory::exists(path))
+		{
+			camera_ = new rtabmap::CameraImages(path, frameRate);
+		}
+		else if(!path.empty() && UFile::exists(path))
+		{
+			camera_ = new rtabmap::CameraVideo(path, false, frameRate);
+		}
+		else
+		{
+			if(!path.empty())
+			{
+				NODELET_ERROR("Path \"%s\" does not exist (or you don't have the permissions to read)... falling back to usb device...", path.c_str());
+			}
+			camera_ = new rtabmap::CameraVideo(deviceId, false, frameRate);
+		}
+
+		image_transport::ImageTransport it(nh);
+		imagePub_ = it.advertise("image", 1);
+		diagnostics_.init(nh, pnh, getName());
+
+		if(camera_->init())
+		{
+			captureThread_ = new boost::thread(boost::bind(&CameraNodelet::captureLoop, this));
+		}
+		else
+		{
+			NODELET_ERROR("Could not initialize the camera!");
+		}
+	}
+
+	void captureLoop()
+	{
+		while(ros::ok() && !boost::this_thread::interruption_requested())
+		{
+			rtabmap::SensorData data = camera_->takeImage();
+			if(data.imageRaw().empty())
+			{
+				NODELET_WARN_THROTTLE(1, "No more images");
+				boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+				continue;
+			}
+			diagnostics_.tickInput();
+			if(imagePub_.getNumSubscribers() == 0)
+			{
+				diagnostics_.tickDrop();
+				continue;
+			}
+
+			ros::Time stamp = data.stamp()>0.0?ros::Time(data.stamp()):ros::Time::now();
+			{
+				NodeletDiagnostics::ScopedTimer timer(diagnostics_);
+				const cv::Mat & image = data.imageRaw();
+				sensor_msgs::ImagePtr msg = pool_.acquire(image.cols, image.rows, image.type());
+				msg->header.frame_id = frameId_;
+				msg->header.stamp = stamp;
+				image.copyTo(ImageBufferPool::toCvMat(*msg));
+				imagePub_.publish(msg);
+			}
+			diagnostics_.tickOutput(stamp);
+		}
+		NODELET_DEBUG("Capture thread stopped (%lu buffers allocated, %lu images out of the pool)",
+				pool_.allocations(), pool_.exhausted());
+	}
+
+private:
+	rtabmap::Camera * camera_;
+	boost::thread * captureThread_;
+	std::string frameId_;
+	ImageBufferPool pool_;
+	image_transport::Publisher imagePub_;
+	NodeletDiagnostics diagnostics_;
+};
+
+PLUGINLIB_EXPORT_CLASS(rtabmap_ros::CameraNodelet, nodelet::Nodelet);
+}
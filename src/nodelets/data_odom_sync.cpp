@@ -38,6 +38,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <sensor_msgs/CameraInfo.h>
 #include <nav_msgs/Odometry.h>
+#include <std_msgs/Float64.h>
+
+#include <rtabmap_ros/MsgConversion.h>
+
+#include <boost/thread/mutex.hpp>
+#include <deque>
 
 namespace rtabmap_ros
 {
@@ -47,13 +53,19 @@ class DataOdomSyncNodelet : public nodelet::Nodelet
 public:
 	//Constructor
 	DataOdomSyncNodelet():
-		sync_(0)
+		queueSize_(10),
+		interpolateOdom_(false),
+		odomBufferSize_(100),
+		maxOldestOdomGap_(0.0),
+		sync_(0),
+		imageSync_(0)
 	{
 	}
 
 	virtual ~DataOdomSyncNodelet()
 	{
 		delete sync_;
+		delete imageSync_;
 	}
 
 private:
@@ -71,16 +83,37 @@ private:
 		image_transport::TransportHints hintsRgb("raw", ros::TransportHints(), rgb_pnh);
 		image_transport::TransportHints hintsDepth("raw", ros::TransportHints(), depth_pnh);
 
-		int queueSize = 10;
-		private_nh.param("queue_size", queueSize, queueSize);
+		private_nh.param("queue_size", queueSize_, queueSize_);
+		private_nh.param("interpolate_odom", interpolateOdom_, interpolateOdom_);
+		private_nh.param("odom_buffer_size", odomBufferSize_, odomBufferSize_);
+		private_nh.param("max_oldest_odom_gap", maxOldestOdomGap_, maxOldestOdomGap_);
+		NODELET_INFO("data_odom_sync: interpolate_odom = %s", interpolateOdom_?"true":"false");
 
-		sync_ = new message_filters::Synchronizer<MySyncPolicy>(MySyncPolicy(queueSize), image_sub_, image_depth_sub_, info_sub_, odom_sub_);
-		sync_->registerCallback(boost::bind(&DataOdomSyncNodelet::callback, this, _1, _2, _3, _4));
+		if(interpolateOdom_)
+		{
+			// Only the images are synchronized, odometry is
+			// interpolated at the image stamp
+			if(odomBufferSize_ < 2)
+			{
+				odomBufferSize_ = 2;
+			}
+			NODELET_INFO("data_odom_sync: odom_buffer_size = %d", odomBufferSize_);
+			NODELET_INFO("data_odom_sync: max_oldest_odom_gap = %f", maxOldestOdomGap_);
+			imageSync_ = new message_filters::Synchronizer<MyImageSyncPolicy>(MyImageSyncPolicy(queueSize_), image_sub_, image_depth_sub_, info_sub_);
+			imageSync_->registerCallback(boost::bind(&DataOdomSyncNodelet::imageCallback, this, _1, _2, _3));
+			odomSub_ = nh.subscribe("odom_in", odomBufferSize_, &DataOdomSyncNodelet::odomCallback, this);
+			gapPub_ = nh.advertise<std_msgs::Float64>("odom_interpolation_gap", 1);
+		}
+		else
+		{
+			sync_ = new message_filters::Synchronizer<MySyncPolicy>(MySyncPolicy(queueSize_), image_sub_, image_depth_sub_, info_sub_, odom_sub_);
+			sync_->registerCallback(boost::bind(&DataOdomSyncNodelet::callback, this, _1, _2, _3, _4));
+			odom_sub_.subscribe(nh, "odom_in", 1);
+		}
 
 		image_sub_.subscribe(rgb_it, rgb_nh.resolveName("image_in"), 1, hintsRgb);
 		image_depth_sub_.subscribe(depth_it, depth_nh.resolveName("image_in"), 1, hintsDepth);
 		info_sub_.subscribe(rgb_nh, "camera_info_in", 1);
-		odom_sub_.subscribe(nh, "odom_in", 1);
 
 		imagePub_ = rgb_it.advertise("image_out", 1);
 		imageDepthPub_ = depth_it.advertise("image_out", 1);
@@ -111,6 +144,151 @@ private:
 		}
 	}
 
+	void imageCallback(const sensor_msgs::ImageConstPtr& image,
+			const sensor_msgs::ImageConstPtr& imageDepth,
+			const sensor_msgs::CameraInfoConstPtr& camInfo)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		PendingFrame frame;
+		frame.image = image;
+		frame.imageDepth = imageDepth;
+		frame.camInfo = camInfo;
+		pendingFrames_.push_back(frame);
+		if((int)pendingFrames_.size() > queueSize_)
+		{
+			// odometry is not received anymore
+			NODELET_WARN_THROTTLE(1.0, "data_odom_sync: No odometry received after image stamp %f, dropping frame.",
+					pendingFrames_.front().image->header.stamp.toSec());
+			pendingFrames_.pop_front();
+		}
+		processPendingFrames();
+	}
+
+	void odomCallback(const nav_msgs::OdometryConstPtr & odom)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		if(!odoms_.empty() && odom->header.stamp <= odoms_.back()->header.stamp)
+		{
+			NODELET_WARN("data_odom_sync: Odometry stamp %f is older than the previous one (%f), clearing odometry buffer.",
+					odom->header.stamp.toSec(), odoms_.back()->header.stamp.toSec());
+			odoms_.clear();
+		}
+		odoms_.push_back(odom);
+		if((int)odoms_.size() > odomBufferSize_)
+		{
+			odoms_.pop_front();
+		}
+		processPendingFrames();
+	}
+
+	// mutex_ should be locked. Frames are published as soon as
+	// odometry after their stamp is received. Frames older than the
+	// odometry buffer are published with the oldest odometry only if
+	// they are at most "max_oldest_odom_gap" sec before it, otherwise
+	// they are dropped.
+	void processPendingFrames()
+	{
+		while(!pendingFrames_.empty() && !odoms_.empty())
+		{
+			const PendingFrame & frame = pendingFrames_.front();
+			const ros::Time & stamp = frame.image->header.stamp;
+			if(stamp > odoms_.back()->header.stamp)
+			{
+				// wait for next odometry
+				break;
+			}
+
+			nav_msgs::OdometryConstPtr odom;
+			double gap = 0.0;
+			if(stamp <= odoms_.front()->header.stamp)
+			{
+				odom = odoms_.front();
+				gap = (odom->header.stamp - stamp).toSec();
+				if(gap > maxOldestOdomGap_)
+				{
+					NODELET_WARN_THROTTLE(1.0, "data_odom_sync: Image stamp %f is older than the odometry "
+							"buffer (%f, gap=%fs > \"max_oldest_odom_gap\"=%fs), dropping frame. You may "
+							"increase \"odom_buffer_size\".",
+							stamp.toSec(), odom->header.stamp.toSec(), gap, maxOldestOdomGap_);
+					pendingFrames_.pop_front();
+					continue;
+				}
+				else if(gap > 0.0)
+				{
+					NODELET_WARN_THROTTLE(1.0, "data_odom_sync: Image stamp %f is older than the odometry "
+							"buffer (%f), using oldest odometry (gap=%fs).",
+							stamp.toSec(), odom->header.stamp.toSec(), gap);
+				}
+			}
+			else
+			{
+				// stamp is in ]front, back]
+				size_t i = odoms_.size()-1;
+				while(odoms_[i-1]->header.stamp >= stamp)
+				{
+					--i;
+				}
+				const nav_msgs::OdometryConstPtr & before = odoms_[i-1];
+				const nav_msgs::OdometryConstPtr & after = odoms_[i];
+				if(after->header.stamp == stamp)
+				{
+					odom = after;
+				}
+				else
+				{
+					gap = (after->header.stamp - before->header.stamp).toSec();
+					odom = interpolateOdom(*before, *after, stamp);
+				}
+			}
+			NODELET_DEBUG("data_odom_sync: image stamp=%f, odometry interpolation gap=%fs", stamp.toSec(), gap);
+			if(gapPub_.getNumSubscribers())
+			{
+				std_msgs::Float64 gapMsg;
+				gapMsg.data = gap;
+				gapPub_.publish(gapMsg);
+			}
+
+			callback(frame.image, frame.imageDepth, frame.camInfo, odom);
+			pendingFrames_.pop_front();
+		}
+	}
+
+	// Pose is interpolated on SE(3) (slerp on rotation), twist linearly. Covariances are from "before".
+	static nav_msgs::OdometryConstPtr interpolateOdom(
+			const nav_msgs::Odometry & before,
+			const nav_msgs::Odometry & after,
+			const ros::Time & stamp)
+	{
+		double ratio = (stamp - before.header.stamp).toSec() / (after.header.stamp - before.header.stamp).toSec();
+		nav_msgs::OdometryPtr odom(new nav_msgs::Odometry(before));
+		odom->header.stamp = stamp;
+		rtabmap::Transform poseBefore = rtabmap_ros::transformFromPoseMsg(before.pose.pose);
+		rtabmap::Transform poseAfter = rtabmap_ros::transformFromPoseMsg(after.pose.pose);
+		if(!poseBefore.isNull() && !poseAfter.isNull())
+		{
+			rtabmap_ros::transformToPoseMsg(poseBefore.interpolate((float)ratio, poseAfter), odom->pose.pose);
+		}
+		odom->twist.twist.linear.x += ratio*(after.twist.twist.linear.x - before.twist.twist.linear.x);
+		odom->twist.twist.linear.y += ratio*(after.twist.twist.linear.y - before.twist.twist.linear.y);
+		odom->twist.twist.linear.z += ratio*(after.twist.twist.linear.z - before.twist.twist.linear.z);
+		odom->twist.twist.angular.x += ratio*(after.twist.twist.angular.x - before.twist.twist.angular.x);
+		odom->twist.twist.angular.y += ratio*(after.twist.twist.angular.y - before.twist.twist.angular.y);
+		odom->twist.twist.angular.z += ratio*(after.twist.twist.angular.z - before.twist.twist.angular.z);
+		return odom;
+	}
+
+	struct PendingFrame
+	{
+		sensor_msgs::ImageConstPtr image;
+		sensor_msgs::ImageConstPtr imageDepth;
+		sensor_msgs::CameraInfoConstPtr camInfo;
+	};
+
+	int queueSize_;
+	bool interpolateOdom_;
+	int odomBufferSize_;
+	double maxOldestOdomGap_;
+
 	image_transport::Publisher imagePub_;
 	image_transport::Publisher imageDepthPub_;
 	ros::Publisher infoPub_;
@@ -123,6 +301,15 @@ private:
 	typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::Image, sensor_msgs::Image, sensor_msgs::CameraInfo, nav_msgs::Odometry> MySyncPolicy;
 	message_filters::Synchronizer<MySyncPolicy> * sync_;
 
+	// interpolate_odom
+	typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::Image, sensor_msgs::Image, sensor_msgs::CameraInfo> MyImageSyncPolicy;
+	message_filters::Synchronizer<MyImageSyncPolicy> * imageSync_;
+	ros::Subscriber odomSub_;
+	ros::Publisher gapPub_;
+	boost::mutex mutex_;
+	std::deque<nav_msgs::OdometryConstPtr> odoms_;
+	std::deque<PendingFrame> pendingFrames_;
+
 };
 
 
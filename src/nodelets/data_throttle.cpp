@@ -33,6 +33,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <message_filters/time_synchronizer.h>
 #include <message_filters/sync_policies/approximate_time.h>
 #include <message_filters/sync_policies/exact_time.h>
+#include <message_filters/pass_through.h>
 
 #include <image_transport/image_transport.h>
 #include <image_transport/subscriber_filter.h>
@@ -43,6 +44,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <rtabmap/core/util2d.h>
 
+#include "rtabmap_ros/ThrottleGate.h"
+#include "rtabmap_ros/NodeletDiagnostics.h"
+
 namespace rtabmap_ros
 {
 
@@ -51,7 +55,6 @@ class DataThrottleNodelet : public nodelet::Nodelet
 public:
 	//Constructor
 	DataThrottleNodelet():
-		rate_(0),
 		approxSync_(0),
 		exactSync_(0),
 		decimation_(1)
@@ -71,8 +74,6 @@ public:
 	}
 
 private:
-	ros::Time last_update_;
-	double rate_;
 	virtual void onInit()
 	{
 		ros::NodeHandle& nh = getNodeHandle();
@@ -89,27 +90,33 @@ private:
 
 		int queueSize = 10;
 		bool approxSync = true;
-		if(private_nh.getParam("max_rate", rate_))
+		double maxRate = 0.0;
+		if(private_nh.getParam("max_rate", maxRate))
 		{
 			NODELET_WARN("\"max_rate\" is now known as \"rate\".");
+			if(!private_nh.hasParam("rate"))
+			{
+				private_nh.setParam("rate", maxRate);
+			}
 		}
-		private_nh.param("rate", rate_, rate_);
+		gate_.init(nh, private_nh, getName());
+		diagnostics_.init(nh, private_nh, getName());
 		private_nh.param("queue_size", queueSize, queueSize);
 		private_nh.param("approx_sync", approxSync, approxSync);
 		private_nh.param("decimation", decimation_, decimation_);
 		ROS_ASSERT(decimation_ >= 1);
-		NODELET_INFO("Rate=%f Hz", rate_);
+		NODELET_INFO("Rate=%f Hz", gate_.rate());
 		NODELET_INFO("Decimation=%d", decimation_);
 		NODELET_INFO("Approximate time sync = %s", approxSync?"true":"false");
 
 		if(approxSync)
 		{
-			approxSync_ = new message_filters::Synchronizer<MyApproxSyncPolicy>(MyApproxSyncPolicy(queueSize), image_sub_, image_depth_sub_, info_sub_);
+			approxSync_ = new message_filters::Synchronizer<MyApproxSyncPolicy>(MyApproxSyncPolicy(queueSize), imagePass_, imageDepthPass_, infoPass_);
 			approxSync_->registerCallback(boost::bind(&DataThrottleNodelet::callback, this, _1, _2, _3));
 		}
 		else
 		{
-			exactSync_ = new message_filters::Synchronizer<MyExactSyncPolicy>(MyExactSyncPolicy(queueSize), image_sub_, image_depth_sub_, info_sub_);
+			exactSync_ = new message_filters::Synchronizer<MyExactSyncPolicy>(MyExactSyncPolicy(queueSize), imagePass_, imageDepthPass_, infoPass_);
 			exactSync_->registerCallback(boost::bind(&DataThrottleNodelet::callback, this, _1, _2, _3));
 		}
 
@@ -117,28 +124,37 @@ private:
 		image_depth_sub_.subscribe(depth_it, depth_nh.resolveName("image_in"), 1, hintsDepth);
 		info_sub_.subscribe(rgb_nh, "camera_info_in", 1);
 
+		// Frames that won't be forwarded are dropped before synchronization
+		image_sub_.registerCallback(boost::bind(&DataThrottleNodelet::gateInput<sensor_msgs::Image>, this, _1, &imagePass_));
+		image_depth_sub_.registerCallback(boost::bind(&DataThrottleNodelet::gateInput<sensor_msgs::Image>, this, _1, &imageDepthPass_));
+		info_sub_.registerCallback(boost::bind(&DataThrottleNodelet::gateInput<sensor_msgs::CameraInfo>, this, _1, &infoPass_));
+
 		imagePub_ = rgb_it.advertise("image_out", 1);
 		imageDepthPub_ = depth_it.advertise("image_out", 1);
 		infoPub_ = rgb_nh.advertise<sensor_msgs::CameraInfo>("camera_info_out", 1);
 	};
 
+	template<class M>
+	void gateInput(const boost::shared_ptr<M const> & msg, message_filters::PassThrough<M> * filter)
+	{
+		if(gate_.accept(msg->header.stamp))
+		{
+			filter->add(msg);
+		}
+	}
+
 	void callback(const sensor_msgs::ImageConstPtr& image,
 			const sensor_msgs::ImageConstPtr& imageDepth,
 			const sensor_msgs::CameraInfoConstPtr& camInfo)
 	{
-		if (rate_ > 0.0)
+		// inputs are already filtered by the gate before synchronization
+		diagnostics_.tickInput();
+		if(!gate_.forward(image->header.stamp))
 		{
-			NODELET_DEBUG("update set to %f", rate_);
-			if ( last_update_ + ros::Duration(1.0/rate_) > ros::Time::now())
-			{
-				NODELET_DEBUG("throttle last update at %f skipping", last_update_.toSec());
-				return;
-			}
+			NODELET_DEBUG("throttle skipping frame %f", image->header.stamp.toSec());
+			return;
 		}
-		else
-			NODELET_DEBUG("rate unset continuing");
-
-		last_update_ = ros::Time::now();
+		NodeletDiagnostics::ScopedTimer timer(diagnostics_);
 
 		double rgbStamp = image->header.stamp.toSec();
 		double depthStamp = imageDepth->header.stamp.toSec();
@@ -201,6 +217,7 @@ private:
 				imageDepthPub_.publish(imageDepth);
 			}
 		}
+		diagnostics_.tickOutput(image->header.stamp);
 
 		if( rgbStamp != image->header.stamp.toSec() ||
 			depthStamp != imageDepth->header.stamp.toSec())
@@ -217,10 +234,14 @@ private:
 	image_transport::Publisher imagePub_;
 	image_transport::Publisher imageDepthPub_;
 	ros::Publisher infoPub_;
+	NodeletDiagnostics diagnostics_;
 
 	image_transport::SubscriberFilter image_sub_;
 	image_transport::SubscriberFilter image_depth_sub_;
 	message_filters::Subscriber<sensor_msgs::CameraInfo> info_sub_;
+	message_filters::PassThrough<sensor_msgs::Image> imagePass_;
+	message_filters::PassThrough<sensor_msgs::Image> imageDepthPass_;
+	message_filters::PassThrough<sensor_msgs::CameraInfo> infoPass_;
 
 	typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::Image, sensor_msgs::Image, sensor_msgs::CameraInfo> MyApproxSyncPolicy;
 	message_filters::Synchronizer<MyApproxSyncPolicy> * approxSync_;
@@ -228,6 +249,7 @@ private:
 	message_filters::Synchronizer<MyExactSyncPolicy> * exactSync_;
 
 	int decimation_;
+	ThrottleGate gate_;
 
 };
 
@@ -36,10 +36,77 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <image_transport/image_transport.h>
 
 #include <cv_bridge/cv_bridge.h>
+#include <opencv2/core/core.hpp>
+
+#include "rtabmap_ros/NodeletDiagnostics.h"
+#include "rtabmap_ros/LazySubscription.h"
+#include "rtabmap_ros/ImageBufferPool.h"
 
 namespace rtabmap_ros
 {
 
+/**
+ * Convert rows of a disparity image to depth (baseline * focal / disparity),
+ * writing the 32FC1 (m) and/or 16UC1 (mm) depth images in the same pass.
+ * Inner loops are branchless so that they can be vectorized.
+ */
+class DisparityToDepthBody : public cv::ParallelLoopBody
+{
+public:
+	DisparityToDepthBody(
+			const cv::Mat & disparity,
+			float baselineFocal,
+			float minDisparity,
+			float maxDisparity,
+			cv::Mat & depth32f, // empty if not required
+			cv::Mat & depth16u) : // empty if not required
+		disparity_(disparity),
+		baselineFocal_(baselineFocal),
+		baselineFocalMM_(baselineFocal*1000.0f),
+		minDisparity_(minDisparity),
+		maxDisparity_(maxDisparity),
+		depth32f_(depth32f),
+		depth16u_(depth16u)
+	{}
+
+	virtual void operator()(const cv::Range & range) const
+	{
+		const int cols = disparity_.cols;
+		for(int i=range.start; i<range.end; ++i)
+		{
+			const float * d = disparity_.ptr<float>(i);
+			if(!depth32f_.empty())
+			{
+				float * out = depth32f_.ptr<float>(i);
+				for(int j=0; j<cols; ++j)
+				{
+					bool valid = d[j] > minDisparity_ && d[j] < maxDisparity_;
+					out[j] = valid?baselineFocal_/d[j]:0.0f;
+				}
+			}
+			if(!depth16u_.empty())
+			{
+				unsigned short * out = depth16u_.ptr<unsigned short>(i);
+				for(int j=0; j<cols; ++j)
+				{
+					bool valid = d[j] > minDisparity_ && d[j] < maxDisparity_;
+					float mm = valid?baselineFocalMM_/d[j]:0.0f;
+					out[j] = (unsigned short)(mm<65535.0f?mm:0.0f);
+				}
+			}
+		}
+	}
+
+private:
+	const cv::Mat & disparity_;
+	float baselineFocal_;
+	float baselineFocalMM_;
+	float minDisparity_;
+	float maxDisparity_;
+	cv::Mat & depth32f_;
+	cv::Mat & depth16u_;
+};
+
 class DisparityToDepth : public nodelet::Nodelet
 {
 public:
@@ -53,14 +120,33 @@ private:
 		ros::NodeHandle & nh = getNodeHandle();
 		ros::NodeHandle & pnh = getPrivateNodeHandle();
 
+		lazy_.init(pnh, getName(),
+				boost::bind(&DisparityToDepth::subscribeInputs, this),
+				boost::bind(&DisparityToDepth::unsubscribeInputs, this));
+
 		image_transport::ImageTransport it(nh);
-		pub32f_ = it.advertise("depth", 1);
-		pub16u_ = it.advertise("depth_raw", 1);
-		sub_ = nh.subscribe("disparity", 1, &DisparityToDepth::callback, this);
+		pub32f_ = it.advertise("depth", 1, lazy_.imageConnectCallback(), lazy_.imageConnectCallback());
+		pub16u_ = it.advertise("depth_raw", 1, lazy_.imageConnectCallback(), lazy_.imageConnectCallback());
+		lazy_.addOutput(pub32f_);
+		lazy_.addOutput(pub16u_);
+		diagnostics_.init(nh, pnh, getName());
+		lazy_.start();
+	}
+
+	void subscribeInputs()
+	{
+		sub_ = getNodeHandle().subscribe("disparity", 1, &DisparityToDepth::callback, this);
+	}
+
+	void unsubscribeInputs()
+	{
+		sub_.shutdown();
 	}
 
 	void callback(const stereo_msgs::DisparityImageConstPtr& disparityMsg)
 	{
+		NodeletDiagnostics::ScopedTimer timer(diagnostics_);
+		diagnostics_.tickInput(disparityMsg->header);
 		if(disparityMsg->image.encoding.compare(sensor_msgs::image_encodings::TYPE_32FC1) !=0)
 		{
 			NODELET_ERROR("Input type must be disparity=32FC1");
@@ -73,60 +159,40 @@ private:
 		if(publish32f || publish16u)
 		{
 			// sensor_msgs::image_encodings::TYPE_32FC1
-			cv::Mat disparity(disparityMsg->image.height, disparityMsg->image.width, CV_32FC1, const_cast<uchar*>(disparityMsg->image.data.data()));
+			cv::Mat disparity(disparityMsg->image.height, disparityMsg->image.width, CV_32FC1, const_cast<uchar*>(disparityMsg->image.data.data()), disparityMsg->image.step);
 
+			// Both depth images are written in one pass directly in the
+			// data of the output messages
+			sensor_msgs::ImagePtr depth32fMsg;
+			sensor_msgs::ImagePtr depth16uMsg;
 			cv::Mat depth32f;
 			cv::Mat depth16u;
 			if(publish32f)
 			{
-				depth32f = cv::Mat::zeros(disparity.rows, disparity.cols, CV_32F);
+				depth32fMsg = pool32f_.acquire(disparity.cols, disparity.rows, CV_32FC1);
+				depth32f = ImageBufferPool::toCvMat(*depth32fMsg);
 			}
 			if(publish16u)
 			{
-				depth16u = cv::Mat::zeros(disparity.rows, disparity.cols, CV_16U);
-			}
-			for (int i = 0; i < disparity.rows; i++)
-			{
-				for (int j = 0; j < disparity.cols; j++)
-				{
-					float disparity_value = disparity.at<float>(i,j);
-					if (disparity_value > disparityMsg->min_disparity && disparity_value < disparityMsg->max_disparity)
-					{
-						// baseline * focal / disparity
-						float depth = disparityMsg->T * disparityMsg->f / disparity_value;
-						if(publish32f)
-						{
-							depth32f.at<float>(i,j) = depth;
-						}
-						if(publish16u)
-						{
-							depth16u.at<unsigned short>(i,j) = (unsigned short)(depth*1000.0f);
-						}
-					}
-				}
+				depth16uMsg = pool16u_.acquire(disparity.cols, disparity.rows, CV_16UC1);
+				depth16u = ImageBufferPool::toCvMat(*depth16uMsg);
 			}
 
+			cv::parallel_for_(cv::Range(0, disparity.rows),
+					DisparityToDepthBody(disparity, disparityMsg->T * disparityMsg->f, disparityMsg->min_disparity, disparityMsg->max_disparity, depth32f, depth16u));
+
 			if(publish32f)
 			{
-				// convert to ROS sensor_msg::Image
-				cv_bridge::CvImage cvDepth(disparityMsg->header, sensor_msgs::image_encodings::TYPE_32FC1, depth32f);
-				sensor_msgs::Image depthMsg;
-				cvDepth.toImageMsg(depthMsg);
-
-				//publish the message
-				pub32f_.publish(depthMsg);
+				depth32fMsg->header = disparityMsg->header;
+				pub32f_.publish(depth32fMsg);
 			}
 
 			if(publish16u)
 			{
-				// convert to ROS sensor_msg::Image
-				cv_bridge::CvImage cvDepth(disparityMsg->header, sensor_msgs::image_encodings::TYPE_16UC1, depth16u);
-				sensor_msgs::Image depthMsg;
-				cvDepth.toImageMsg(depthMsg);
-
-				//publish the message
-				pub16u_.publish(depthMsg);
+				depth16uMsg->header = disparityMsg->header;
+				pub16u_.publish(depth16uMsg);
 			}
+			diagnostics_.tickOutput(disparityMsg->header.stamp);
 		}
 }
 
@@ -134,6 +200,10 @@ private:
 	image_transport::Publisher pub32f_;
 	image_transport::Publisher pub16u_;
 	ros::Subscriber sub_;
+	ImageBufferPool pool32f_; // output messages not referenced anymore by subscribers are reused
+	ImageBufferPool pool16u_;
+	NodeletDiagnostics diagnostics_;
+	LazySubscription lazy_;
 };
 
 PLUGINLIB_EXPORT_CLASS(rtabmap_ros::DisparityToDepth, nodelet::Nodelet);
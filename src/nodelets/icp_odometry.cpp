@@ -50,6 +50,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/utilite/UConversion.h>
 #include <rtabmap/utilite/UStl.h>
 
+#include <boost/thread.hpp>
+#include <list>
+
 using namespace rtabmap;
 
 namespace rtabmap_ros
@@ -70,12 +73,30 @@ public:
 		scanNormalGroundUp_(0.0),
 		plugin_loader_("rtabmap_ros", "rtabmap_ros::PluginInterface"),
 		scanReceived_(false),
-		cloudReceived_(false)
+		cloudReceived_(false),
+		scanPreprocessingThreads_(0),
+		preprocessingRunning_(false),
+		preprocessingNextId_(0),
+		preprocessingNextOutputId_(0)
 	{
 	}
 
 	virtual ~ICPOdometry()
 	{
+		if(!preprocessingThreads_.empty())
+		{
+			{
+				boost::mutex::scoped_lock lock(preprocessingMutex_);
+				preprocessingRunning_ = false;
+			}
+			preprocessingCondition_.notify_all();
+			for(unsigned int i=0; i<preprocessingThreads_.size(); ++i)
+			{
+				preprocessingThreads_[i]->join();
+				delete preprocessingThreads_[i];
+			}
+			preprocessingThreads_.clear();
+		}
 		plugins_.clear();
 	}
 
@@ -94,6 +115,7 @@ private:
 		pnh.param("scan_normal_k",   scanNormalK_, scanNormalK_);
 		pnh.param("scan_normal_radius", scanNormalRadius_, scanNormalRadius_);
 		pnh.param("scan_normal_ground_up", scanNormalGroundUp_, scanNormalGroundUp_);
+		pnh.param("scan_preprocessing_threads", scanPreprocessingThreads_, scanPreprocessingThreads_);
 
 		if (pnh.hasParam("plugins"))
 		{
@@ -139,6 +161,16 @@ private:
 		NODELET_INFO("IcpOdometry: scan_normal_k          = %d", scanNormalK_);
 		NODELET_INFO("IcpOdometry: scan_normal_radius     = %f m", scanNormalRadius_);
 		NODELET_INFO("IcpOdometry: scan_normal_ground_up  = %f", scanNormalGroundUp_);
+		NODELET_INFO("IcpOdometry: scan_preprocessing_threads = %d", scanPreprocessingThreads_);
+
+		if(scanPreprocessingThreads_ > 0)
+		{
+			preprocessingRunning_ = true;
+			for(int i=0; i<scanPreprocessingThreads_; ++i)
+			{
+				preprocessingThreads_.push_back(new boost::thread(boost::bind(&ICPOdometry::preprocessingLoop, this)));
+			}
+		}
 
 		scan_sub_ = nh.subscribe("scan", 1, &ICPOdometry::callbackScan, this);
 		cloud_sub_ = nh.subscribe("scan_cloud", 1, &ICPOdometry::callbackCloud, this);
@@ -297,142 +329,161 @@ private:
 			return;
 		}
 
-		//transform in frameId_ frame
-		sensor_msgs::PointCloud2 scanOut;
-		laser_geometry::LaserProjection projection;
-		projection.transformLaserScanToPointCloud(scanMsg->header.frame_id, *scanMsg, scanOut, this->tfListener());
-
-		bool hasIntensity = false;
-		for(unsigned int i=0; i<scanOut.fields.size(); ++i)
+		LaserScan scan;
+		int maxLaserScans = (int)scanMsg->ranges.size();
+		if(scanVoxelSize_ == 0.0f && scanNormalK_ <= 0 && scanNormalRadius_ <= 0.0f)
+		{
+			// ray tables, downsampling and range filtering in one pass
+			scan = LaserScan(rtabmap_ros::laserScan2dFromLaserScanMsg(
+					*scanMsg,
+					Transform(),
+					scanDownsamplingStep_,
+					scanRangeMin_,
+					scanRangeMax_),
+					0, 0.0f,
+					scanMsg->intensities.size() == scanMsg->ranges.size()?LaserScan::kXYI:LaserScan::kXY);
+			if(scanDownsamplingStep_ > 1)
+			{
+				maxLaserScans /= scanDownsamplingStep_;
+			}
+		}
+		else
 		{
-			if(scanOut.fields[i].name.compare("intensity") == 0)
+			//transform in frameId_ frame
+			sensor_msgs::PointCloud2 scanOut;
+			laser_geometry::LaserProjection projection;
+			projection.transformLaserScanToPointCloud(scanMsg->header.frame_id, *scanMsg, scanOut, this->tfListener());
+
+			bool hasIntensity = false;
+			for(unsigned int i=0; i<scanOut.fields.size(); ++i)
 			{
-				if(scanOut.fields[i].datatype == sensor_msgs::PointField::FLOAT32)
+				if(scanOut.fields[i].name.compare("intensity") == 0)
 				{
-					hasIntensity = true;
-				}
-				else
-				{
-					static bool warningShown = false;
-					if(!warningShown)
+					if(scanOut.fields[i].datatype == sensor_msgs::PointField::FLOAT32)
 					{
-						ROS_WARN("The input scan cloud has an \"intensity\" field "
-								"but the datatype (%d) is not supported. Intensity will be ignored. "
-								"This message is only shown once.", scanOut.fields[i].datatype);
-						warningShown = true;
+						hasIntensity = true;
+					}
+					else
+					{
+						static bool warningShown = false;
+						if(!warningShown)
+						{
+							ROS_WARN("The input scan cloud has an \"intensity\" field "
+									"but the datatype (%d) is not supported. Intensity will be ignored. "
+									"This message is only shown once.", scanOut.fields[i].datatype);
+							warningShown = true;
+						}
 					}
 				}
 			}
-		}
-
-		pcl::PointCloud<pcl::PointXYZI>::Ptr pclScanI(new pcl::PointCloud<pcl::PointXYZI>);
-		pcl::PointCloud<pcl::PointXYZ>::Ptr pclScan(new pcl::PointCloud<pcl::PointXYZ>);
 
-		if(hasIntensity)
-		{
-			pcl::fromROSMsg(scanOut, *pclScanI);
-			pclScanI->is_dense = true;
-		}
-		else
-		{
-			pcl::fromROSMsg(scanOut, *pclScan);
-			pclScan->is_dense = true;
-		}
+			pcl::PointCloud<pcl::PointXYZI>::Ptr pclScanI(new pcl::PointCloud<pcl::PointXYZI>);
+			pcl::PointCloud<pcl::PointXYZ>::Ptr pclScan(new pcl::PointCloud<pcl::PointXYZ>);
 
-		LaserScan scan;
-		int maxLaserScans = (int)scanMsg->ranges.size();
-		if(!pclScan->empty() || !pclScanI->empty())
-		{
-			if(scanDownsamplingStep_ > 1)
+			if(hasIntensity)
 			{
-				if(hasIntensity)
-				{
-					pclScanI = util3d::downsample(pclScanI, scanDownsamplingStep_);
-				}
-				else
-				{
-					pclScan = util3d::downsample(pclScan, scanDownsamplingStep_);
-				}
-				maxLaserScans /= scanDownsamplingStep_;
+				pcl::fromROSMsg(scanOut, *pclScanI);
+				pclScanI->is_dense = true;
 			}
-			if(scanVoxelSize_ > 0.0f)
+			else
 			{
-				float pointsBeforeFiltering;
-				float pointsAfterFiltering;
-				if(hasIntensity)
-				{
-					pointsBeforeFiltering = (float)pclScanI->size();
-					pclScanI = util3d::voxelize(pclScanI, scanVoxelSize_);
-					pointsAfterFiltering = (float)pclScanI->size();
-				}
-				else
-				{
-					pointsBeforeFiltering = (float)pclScan->size();
-					pclScan = util3d::voxelize(pclScan, scanVoxelSize_);
-					pointsAfterFiltering = (float)pclScan->size();
-				}
-				float ratio = pointsAfterFiltering / pointsBeforeFiltering;
-				maxLaserScans = int(float(maxLaserScans) * ratio);
+				pcl::fromROSMsg(scanOut, *pclScan);
+				pclScan->is_dense = true;
 			}
-			if(scanNormalK_ > 0 || scanNormalRadius_>0.0f)
+
+			if(!pclScan->empty() || !pclScanI->empty())
 			{
-				//compute normals
-				pcl::PointCloud<pcl::Normal>::Ptr normals;
-				if(scanVoxelSize_ > 0.0f)
+				if(scanDownsamplingStep_ > 1)
 				{
 					if(hasIntensity)
 					{
-						normals = util3d::computeNormals2D(pclScanI, scanNormalK_, scanNormalRadius_);
+						pclScanI = util3d::downsample(pclScanI, scanDownsamplingStep_);
 					}
 					else
 					{
-						normals = util3d::computeNormals2D(pclScan, scanNormalK_, scanNormalRadius_);
+						pclScan = util3d::downsample(pclScan, scanDownsamplingStep_);
 					}
+					maxLaserScans /= scanDownsamplingStep_;
 				}
-				else
+				if(scanVoxelSize_ > 0.0f)
 				{
+					float pointsBeforeFiltering;
+					float pointsAfterFiltering;
 					if(hasIntensity)
 					{
-						normals = util3d::computeFastOrganizedNormals2D(pclScanI, scanNormalK_, scanNormalRadius_);
+						pointsBeforeFiltering = (float)pclScanI->size();
+						pclScanI = util3d::voxelize(pclScanI, scanVoxelSize_);
+						pointsAfterFiltering = (float)pclScanI->size();
 					}
 					else
 					{
-						normals = util3d::computeFastOrganizedNormals2D(pclScan, scanNormalK_, scanNormalRadius_);
+						pointsBeforeFiltering = (float)pclScan->size();
+						pclScan = util3d::voxelize(pclScan, scanVoxelSize_);
+						pointsAfterFiltering = (float)pclScan->size();
 					}
+					float ratio = pointsAfterFiltering / pointsBeforeFiltering;
+					maxLaserScans = int(float(maxLaserScans) * ratio);
 				}
-				pcl::PointCloud<pcl::PointXYZINormal>::Ptr pclScanINormal;
-				pcl::PointCloud<pcl::PointNormal>::Ptr pclScanNormal;
-				if(hasIntensity)
+				if(scanNormalK_ > 0 || scanNormalRadius_>0.0f)
 				{
-					pclScanINormal.reset(new pcl::PointCloud<pcl::PointXYZINormal>);
-					pcl::concatenateFields(*pclScanI, *normals, *pclScanINormal);
-					scan = util3d::laserScan2dFromPointCloud(*pclScanINormal);
+					//compute normals
+					pcl::PointCloud<pcl::Normal>::Ptr normals;
+					if(scanVoxelSize_ > 0.0f)
+					{
+						if(hasIntensity)
+						{
+							normals = util3d::computeNormals2D(pclScanI, scanNormalK_, scanNormalRadius_);
+						}
+						else
+						{
+							normals = util3d::computeNormals2D(pclScan, scanNormalK_, scanNormalRadius_);
+						}
+					}
+					else
+					{
+						if(hasIntensity)
+						{
+							normals = util3d::computeFastOrganizedNormals2D(pclScanI, scanNormalK_, scanNormalRadius_);
+						}
+						else
+						{
+							normals = util3d::computeFastOrganizedNormals2D(pclScan, scanNormalK_, scanNormalRadius_);
+						}
+					}
+					pcl::PointCloud<pcl::PointXYZINormal>::Ptr pclScanINormal;
+					pcl::PointCloud<pcl::PointNormal>::Ptr pclScanNormal;
+					if(hasIntensity)
+					{
+						pclScanINormal.reset(new pcl::PointCloud<pcl::PointXYZINormal>);
+						pcl::concatenateFields(*pclScanI, *normals, *pclScanINormal);
+						scan = util3d::laserScan2dFromPointCloud(*pclScanINormal);
+					}
+					else
+					{
+						pclScanNormal.reset(new pcl::PointCloud<pcl::PointNormal>);
+						pcl::concatenateFields(*pclScan, *normals, *pclScanNormal);
+						scan = util3d::laserScan2dFromPointCloud(*pclScanNormal);
+					}
 				}
 				else
 				{
-					pclScanNormal.reset(new pcl::PointCloud<pcl::PointNormal>);
-					pcl::concatenateFields(*pclScan, *normals, *pclScanNormal);
-					scan = util3d::laserScan2dFromPointCloud(*pclScanNormal);
+					if(hasIntensity)
+					{
+						scan = util3d::laserScan2dFromPointCloud(*pclScanI);
+					}
+					else
+					{
+						scan = util3d::laserScan2dFromPointCloud(*pclScan);
+					}
 				}
 			}
-			else
+
+			if(scanRangeMin_ > 0 || scanRangeMax_ > 0)
 			{
-				if(hasIntensity)
-				{
-					scan = util3d::laserScan2dFromPointCloud(*pclScanI);
-				}
-				else
-				{
-					scan = util3d::laserScan2dFromPointCloud(*pclScan);
-				}
+				scan = util3d::rangeFiltering(scan, scanRangeMin_, scanRangeMax_);
 			}
 		}
 
-		if(scanRangeMin_ > 0 || scanRangeMax_ > 0)
-		{
-			scan = util3d::rangeFiltering(scan, scanRangeMin_, scanRangeMax_);
-		}
-
 		rtabmap::SensorData data(
 				LaserScan(scan,
 						maxLaserScans,
@@ -493,7 +544,6 @@ private:
 			cloudMsg = *pointCloudMsg;
 		}
 
-		LaserScan scan;
 		bool hasNormals = false;
 		bool hasIntensity = false;
 		for(unsigned int i=0; i<cloudMsg.fields.size(); ++i)
@@ -544,153 +594,258 @@ private:
 		}
 		int maxLaserScans = scanCloudMaxPoints_;
 
-		if(hasNormals && hasIntensity)
+		if(!preprocessingThreads_.empty())
 		{
-			pcl::PointCloud<pcl::PointXYZINormal>::Ptr pclScan(new pcl::PointCloud<pcl::PointXYZINormal>);
-			pcl::fromROSMsg(cloudMsg, *pclScan);
-			if(pclScan->size() && scanDownsamplingStep_ > 1)
+			// Filtering is done by the preprocessing threads, so that it
+			// overlaps the filtering and the registration of the previous clouds
+			boost::mutex::scoped_lock lock(preprocessingMutex_);
+			while(preprocessingRunning_ && (int)preprocessingQueue_.size() >= scanPreprocessingThreads_)
 			{
-				pclScan = util3d::downsample(pclScan, scanDownsamplingStep_);
-				if(pclScan->height>1)
-				{
-					maxLaserScans = pclScan->height * pclScan->width;
-				}
-				else
-				{
-					maxLaserScans /= scanDownsamplingStep_;
-				}
+				preprocessingCondition_.wait(lock);
+			}
+			if(preprocessingRunning_)
+			{
+				preprocessingQueue_.push_back(CloudJob());
+				CloudJob & job = preprocessingQueue_.back();
+				job.id = preprocessingNextId_++;
+				std::swap(job.cloud, cloudMsg);
+				job.hasNormals = hasNormals;
+				job.hasIntensity = hasIntensity;
+				job.localScanTransform = localScanTransform;
+				job.maxLaserScans = maxLaserScans;
+				preprocessingCondition_.notify_all();
 			}
-			scan = util3d::laserScanFromPointCloud(*pclScan);
+			return;
+		}
+
+		LaserScan laserScan = filterCloud(cloudMsg, hasNormals, hasIntensity, localScanTransform, maxLaserScans);
+
+		rtabmap::SensorData data(
+				laserScan,
+				cv::Mat(),
+				cv::Mat(),
+				CameraModel(),
+				0,
+				rtabmap_ros::timestampFromROS(cloudMsg.header.stamp));
+
+		this->processData(data, cloudMsg.header);
+	}
+
+	LaserScan filterCloud(
+			const sensor_msgs::PointCloud2 & cloudMsg,
+			bool hasNormals,
+			bool hasIntensity,
+			const Transform & localScanTransform,
+			int maxLaserScans) const
+	{
+		LaserScan scan;
+		LaserScan laserScan;
+		if(scanDownsamplingStep_ <= 1 && scanVoxelSize_ == 0.0f && (hasNormals || (scanNormalK_ <= 0 && scanNormalRadius_<=0.0f)))
+		{
+			// no filtering requiring PCL, convert directly
+			laserScan = rtabmap_ros::laserScanFromPointCloud2(cloudMsg, localScanTransform, maxLaserScans, 0, scanRangeMin_, scanRangeMax_);
 		}
-		else if(hasNormals)
+		else
 		{
-			pcl::PointCloud<pcl::PointNormal>::Ptr pclScan(new pcl::PointCloud<pcl::PointNormal>);
-			pcl::fromROSMsg(cloudMsg, *pclScan);
-			if(pclScan->size() && scanDownsamplingStep_ > 1)
+			if(hasNormals && hasIntensity)
 			{
-				pclScan = util3d::downsample(pclScan, scanDownsamplingStep_);
-				if(pclScan->height>1)
+				pcl::PointCloud<pcl::PointXYZINormal>::Ptr pclScan(new pcl::PointCloud<pcl::PointXYZINormal>);
+				pcl::fromROSMsg(cloudMsg, *pclScan);
+				if(pclScan->size() && scanDownsamplingStep_ > 1)
 				{
-					maxLaserScans = pclScan->height * pclScan->width;
+					pclScan = util3d::downsample(pclScan, scanDownsamplingStep_);
+					if(pclScan->height>1)
+					{
+						maxLaserScans = pclScan->height * pclScan->width;
+					}
+					else
+					{
+						maxLaserScans /= scanDownsamplingStep_;
+					}
 				}
-				else
+				scan = util3d::laserScanFromPointCloud(*pclScan);
+			}
+			else if(hasNormals)
+			{
+				pcl::PointCloud<pcl::PointNormal>::Ptr pclScan(new pcl::PointCloud<pcl::PointNormal>);
+				pcl::fromROSMsg(cloudMsg, *pclScan);
+				if(pclScan->size() && scanDownsamplingStep_ > 1)
 				{
-					maxLaserScans /= scanDownsamplingStep_;
+					pclScan = util3d::downsample(pclScan, scanDownsamplingStep_);
+					if(pclScan->height>1)
+					{
+						maxLaserScans = pclScan->height * pclScan->width;
+					}
+					else
+					{
+						maxLaserScans /= scanDownsamplingStep_;
+					}
 				}
+				scan = util3d::laserScanFromPointCloud(*pclScan);
 			}
-			scan = util3d::laserScanFromPointCloud(*pclScan);
-		}
-		else if(hasIntensity)
-		{
-			pcl::PointCloud<pcl::PointXYZI>::Ptr pclScan(new pcl::PointCloud<pcl::PointXYZI>);
-			pcl::fromROSMsg(cloudMsg, *pclScan);
-			if(pclScan->size() && scanDownsamplingStep_ > 1)
+			else if(hasIntensity)
 			{
-				pclScan = util3d::downsample(pclScan, scanDownsamplingStep_);
-				if(pclScan->height>1)
+				pcl::PointCloud<pcl::PointXYZI>::Ptr pclScan(new pcl::PointCloud<pcl::PointXYZI>);
+				pcl::fromROSMsg(cloudMsg, *pclScan);
+				if(pclScan->size() && scanDownsamplingStep_ > 1)
+				{
+					pclScan = util3d::downsample(pclScan, scanDownsamplingStep_);
+					if(pclScan->height>1)
+					{
+						maxLaserScans = pclScan->height * pclScan->width;
+					}
+					else
+					{
+						maxLaserScans /= scanDownsamplingStep_;
+					}
+				}
+				if(!pclScan->is_dense)
 				{
-					maxLaserScans = pclScan->height * pclScan->width;
+					pclScan = util3d::removeNaNFromPointCloud(pclScan);
 				}
-				else
+
+				if(pclScan->size())
 				{
-					maxLaserScans /= scanDownsamplingStep_;
+					if(scanVoxelSize_ > 0.0f)
+					{
+						float pointsBeforeFiltering = (float)pclScan->size();
+						pclScan = util3d::voxelize(pclScan, scanVoxelSize_);
+						float ratio = float(pclScan->size()) / pointsBeforeFiltering;
+						maxLaserScans = int(float(maxLaserScans) * ratio);
+					}
+					if(scanNormalK_ > 0 || scanNormalRadius_>0.0f)
+					{
+						//compute normals
+						pcl::PointCloud<pcl::Normal>::Ptr normals = util3d::computeNormals(pclScan, scanNormalK_, scanNormalRadius_);
+						pcl::PointCloud<pcl::PointXYZINormal>::Ptr pclScanNormal(new pcl::PointCloud<pcl::PointXYZINormal>);
+						pcl::concatenateFields(*pclScan, *normals, *pclScanNormal);
+						scan = util3d::laserScanFromPointCloud(*pclScanNormal);
+					}
+					else
+					{
+						scan = util3d::laserScanFromPointCloud(*pclScan);
+					}
 				}
 			}
-			if(!pclScan->is_dense)
-			{
-				pclScan = util3d::removeNaNFromPointCloud(pclScan);
-			}
-
-			if(pclScan->size())
+			else
 			{
-				if(scanVoxelSize_ > 0.0f)
+				pcl::PointCloud<pcl::PointXYZ>::Ptr pclScan(new pcl::PointCloud<pcl::PointXYZ>);
+				pcl::fromROSMsg(cloudMsg, *pclScan);
+				if(pclScan->size() && scanDownsamplingStep_ > 1)
 				{
-					float pointsBeforeFiltering = (float)pclScan->size();
-					pclScan = util3d::voxelize(pclScan, scanVoxelSize_);
-					float ratio = float(pclScan->size()) / pointsBeforeFiltering;
-					maxLaserScans = int(float(maxLaserScans) * ratio);
+					pclScan = util3d::downsample(pclScan, scanDownsamplingStep_);
+					if(pclScan->height>1)
+					{
+						maxLaserScans = pclScan->height * pclScan->width;
+					}
+					else
+					{
+						maxLaserScans /= scanDownsamplingStep_;
+					}
 				}
-				if(scanNormalK_ > 0 || scanNormalRadius_>0.0f)
+				if(!pclScan->is_dense)
 				{
-					//compute normals
-					pcl::PointCloud<pcl::Normal>::Ptr normals = util3d::computeNormals(pclScan, scanNormalK_, scanNormalRadius_);
-					pcl::PointCloud<pcl::PointXYZINormal>::Ptr pclScanNormal(new pcl::PointCloud<pcl::PointXYZINormal>);
-					pcl::concatenateFields(*pclScan, *normals, *pclScanNormal);
-					scan = util3d::laserScanFromPointCloud(*pclScanNormal);
+					pclScan = util3d::removeNaNFromPointCloud(pclScan);
 				}
-				else
+
+				if(pclScan->size())
 				{
-					scan = util3d::laserScanFromPointCloud(*pclScan);
+					if(scanVoxelSize_ > 0.0f)
+					{
+						float pointsBeforeFiltering = (float)pclScan->size();
+						pclScan = util3d::voxelize(pclScan, scanVoxelSize_);
+						float ratio = float(pclScan->size()) / pointsBeforeFiltering;
+						maxLaserScans = int(float(maxLaserScans) * ratio);
+					}
+					if(scanNormalK_ > 0 || scanNormalRadius_>0.0f)
+					{
+						//compute normals
+						pcl::PointCloud<pcl::Normal>::Ptr normals = util3d::computeNormals(pclScan, scanNormalK_, scanNormalRadius_);
+						pcl::PointCloud<pcl::PointNormal>::Ptr pclScanNormal(new pcl::PointCloud<pcl::PointNormal>);
+						pcl::concatenateFields(*pclScan, *normals, *pclScanNormal);
+						scan = util3d::laserScanFromPointCloud(*pclScanNormal);
+					}
+					else
+					{
+						scan = util3d::laserScanFromPointCloud(*pclScan);
+					}
 				}
 			}
+
+			laserScan = LaserScan(scan,
+					maxLaserScans,
+					0,
+					localScanTransform);
+			if(scanRangeMin_ > 0 || scanRangeMax_ > 0)
+			{
+				laserScan = util3d::rangeFiltering(laserScan, scanRangeMin_, scanRangeMax_);
+			}
 		}
-		else
+		if(!laserScan.isEmpty() && laserScan.hasNormals() && !laserScan.is2d() && scanNormalGroundUp_)
 		{
-			pcl::PointCloud<pcl::PointXYZ>::Ptr pclScan(new pcl::PointCloud<pcl::PointXYZ>);
-			pcl::fromROSMsg(cloudMsg, *pclScan);
-			if(pclScan->size() && scanDownsamplingStep_ > 1)
+			laserScan = util3d::adjustNormalsToViewPoint(laserScan, Eigen::Vector3f(0,0,10), (float)scanNormalGroundUp_);
+		}
+
+		return laserScan;
+	}
+
+	void preprocessingLoop()
+	{
+		while(true)
+		{
+			CloudJob job;
 			{
-				pclScan = util3d::downsample(pclScan, scanDownsamplingStep_);
-				if(pclScan->height>1)
+				boost::mutex::scoped_lock lock(preprocessingMutex_);
+				while(preprocessingRunning_ && preprocessingQueue_.empty())
 				{
-					maxLaserScans = pclScan->height * pclScan->width;
+					preprocessingCondition_.wait(lock);
 				}
-				else
+				if(!preprocessingRunning_)
 				{
-					maxLaserScans /= scanDownsamplingStep_;
+					break;
 				}
-			}
-			if(!pclScan->is_dense)
-			{
-				pclScan = util3d::removeNaNFromPointCloud(pclScan);
+				CloudJob & front = preprocessingQueue_.front();
+				job.id = front.id;
+				std::swap(job.cloud, front.cloud);
+				job.hasNormals = front.hasNormals;
+				job.hasIntensity = front.hasIntensity;
+				job.localScanTransform = front.localScanTransform;
+				job.maxLaserScans = front.maxLaserScans;
+				preprocessingQueue_.pop_front();
+				preprocessingCondition_.notify_all();
 			}
 
-			if(pclScan->size())
+			LaserScan laserScan = filterCloud(job.cloud, job.hasNormals, job.hasIntensity, job.localScanTransform, job.maxLaserScans);
+
+			rtabmap::SensorData data(
+					laserScan,
+					cv::Mat(),
+					cv::Mat(),
+					CameraModel(),
+					0,
+					rtabmap_ros::timestampFromROS(job.cloud.header.stamp));
+
+			// clouds are sent to odometry in the order they were received
 			{
-				if(scanVoxelSize_ > 0.0f)
+				boost::mutex::scoped_lock lock(preprocessingMutex_);
+				while(preprocessingRunning_ && preprocessingNextOutputId_ != job.id)
 				{
-					float pointsBeforeFiltering = (float)pclScan->size();
-					pclScan = util3d::voxelize(pclScan, scanVoxelSize_);
-					float ratio = float(pclScan->size()) / pointsBeforeFiltering;
-					maxLaserScans = int(float(maxLaserScans) * ratio);
+					preprocessingCondition_.wait(lock);
 				}
-				if(scanNormalK_ > 0 || scanNormalRadius_>0.0f)
+				if(!preprocessingRunning_)
 				{
-					//compute normals
-					pcl::PointCloud<pcl::Normal>::Ptr normals = util3d::computeNormals(pclScan, scanNormalK_, scanNormalRadius_);
-					pcl::PointCloud<pcl::PointNormal>::Ptr pclScanNormal(new pcl::PointCloud<pcl::PointNormal>);
-					pcl::concatenateFields(*pclScan, *normals, *pclScanNormal);
-					scan = util3d::laserScanFromPointCloud(*pclScanNormal);
-				}
-				else
-				{
-					scan = util3d::laserScanFromPointCloud(*pclScan);
+					break;
 				}
 			}
-		}
-
-		LaserScan laserScan(scan,
-				maxLaserScans,
-				0,
-				localScanTransform);
-		if(scanRangeMin_ > 0 || scanRangeMax_ > 0)
-		{
-			laserScan = util3d::rangeFiltering(laserScan, scanRangeMin_, scanRangeMax_);
-		}
-		if(!laserScan.isEmpty() && laserScan.hasNormals() && !laserScan.is2d() && scanNormalGroundUp_)
-		{
-			laserScan = util3d::adjustNormalsToViewPoint(laserScan, Eigen::Vector3f(0,0,10), (float)scanNormalGroundUp_);
-		}
 
-		rtabmap::SensorData data(
-				laserScan,
-				cv::Mat(),
-				cv::Mat(),
-				CameraModel(),
-				0,
-				rtabmap_ros::timestampFromROS(cloudMsg.header.stamp));
+			this->processData(data, job.cloud.header);
 
-		this->processData(data, cloudMsg.header);
+			{
+				boost::mutex::scoped_lock lock(preprocessingMutex_);
+				++preprocessingNextOutputId_;
+			}
+			preprocessingCondition_.notify_all();
+		}
 	}
 
 protected:
@@ -699,7 +854,7 @@ protected:
 		// flush callbacks
 	}
 
-	void postProcessData(const SensorData & data, const std_msgs::Header & header) const
+	void postProcessData(const SensorData & data, const std_msgs::Header & header, const Transform &, const OdometryInfo &) const
 	{
 		if(filtered_scan_pub_.getNumSubscribers())
 		{
@@ -727,6 +882,26 @@ private:
 	bool scanReceived_ = false;
 	bool cloudReceived_ = false;
 
+	// With scan_preprocessing_threads>0, clouds are filtered on
+	// preprocessingThreads_ and sent to odometry in reception order.
+	struct CloudJob
+	{
+		int id;
+		sensor_msgs::PointCloud2 cloud;
+		bool hasNormals;
+		bool hasIntensity;
+		Transform localScanTransform;
+		int maxLaserScans;
+	};
+	int scanPreprocessingThreads_;
+	std::vector<boost::thread*> preprocessingThreads_;
+	bool preprocessingRunning_;
+	std::list<CloudJob> preprocessingQueue_;
+	int preprocessingNextId_;
+	int preprocessingNextOutputId_;
+	boost::mutex preprocessingMutex_;
+	boost::condition_variable preprocessingCondition_;
+
 };
 
 PLUGINLIB_EXPORT_CLASS(rtabmap_ros::ICPOdometry, nodelet::Nodelet);
@@ -41,7 +41,11 @@ class ImuToTF : public nodelet::Nodelet
 public:
 	ImuToTF() :
 		fixedFrameId_("odom"),
-		waitForTransformDuration_(0.1)
+		waitForTransformDuration_(0.1),
+		staticBaseTransform_(true),
+		hasBaseTransform_(false),
+		publishRate_(0.0),
+		batchSize_(1)
 	{}
 
 	virtual ~ImuToTF()
@@ -57,14 +61,33 @@ private:
 		pnh.param("fixed_frame_id", fixedFrameId_, fixedFrameId_);
 		pnh.param("base_frame_id", baseFrameId_, baseFrameId_);
 		pnh.param("wait_for_transform_duration", waitForTransformDuration_, waitForTransformDuration_);
+		pnh.param("static_base_transform", staticBaseTransform_, staticBaseTransform_);
+		pnh.param("publish_rate", publishRate_, publishRate_);
+		pnh.param("batch_size", batchSize_, batchSize_);
+		if(batchSize_ < 1)
+		{
+			batchSize_ = 1;
+		}
 		NODELET_INFO("fixed_frame_id: %s", fixedFrameId_.c_str());
 		NODELET_INFO("base_frame_id: %s", baseFrameId_.c_str());
+		NODELET_INFO("static_base_transform: %s", staticBaseTransform_?"true":"false");
+		NODELET_INFO("publish_rate: %f Hz (0=all IMU messages)", publishRate_);
+		NODELET_INFO("batch_size: %d", batchSize_);
+		batch_.reserve(batchSize_);
 
 		sub_ = nh.subscribe<sensor_msgs::Imu>("imu/data", 1, &ImuToTF::imuCallback, this);
 	}
 
 	void imuCallback(const sensor_msgs::ImuConstPtr & msg)
 	{
+		if(publishRate_ > 0.0 &&
+		   !lastStamp_.isZero() &&
+		   (msg->header.stamp - lastStamp_).toSec() < 1.0/publishRate_)
+		{
+			// decimated
+			return;
+		}
+
 		tf::Quaternion q;
 		tf::quaternionMsgToTF(msg->orientation, q);
 		tf::StampedTransform st;
@@ -78,16 +101,23 @@ private:
 		{
 			try
 			{
-				std::string errorMsg;
-				if(!tfListener_.waitForTransform(baseFrameId_, msg->header.frame_id, msg->header.stamp, ros::Duration(waitForTransformDuration_), ros::Duration(0.01), &errorMsg))
+				if(!staticBaseTransform_ || !hasBaseTransform_ || baseTransformFrameId_.compare(msg->header.frame_id) != 0)
 				{
-					NODELET_ERROR("Could not get transform from %s to %s after %f seconds (for stamp=%f)! Error=\"%s\".",
-							baseFrameId_.c_str(), msg->header.frame_id.c_str(), 0.1, msg->header.stamp.toSec(), errorMsg.c_str());
-					return;
+					std::string errorMsg;
+					if(!tfListener_.waitForTransform(baseFrameId_, msg->header.frame_id, msg->header.stamp, ros::Duration(waitForTransformDuration_), ros::Duration(0.01), &errorMsg))
+					{
+						NODELET_ERROR("Could not get transform from %s to %s after %f seconds (for stamp=%f)! Error=\"%s\".",
+								baseFrameId_.c_str(), msg->header.frame_id.c_str(), 0.1, msg->header.stamp.toSec(), errorMsg.c_str());
+						return;
+					}
+
+					// the IMU is rigidly mounted on the base, so the transform
+					// is looked up only once if static_base_transform is true
+					tfListener_.lookupTransform(msg->header.frame_id, baseFrameId_, msg->header.stamp, baseTransform_);
+					baseTransformFrameId_ = msg->header.frame_id;
+					hasBaseTransform_ = true;
 				}
-
-				tf::StampedTransform tmp;
-				tfListener_.lookupTransform(msg->header.frame_id, baseFrameId_, msg->header.stamp, tmp);
+				const tf::Transform & tmp = baseTransform_;
 				tf::Transform t = tmp.inverse()*st*tmp;
 				st.setRotation(t.getRotation());
 				st.child_frame_id_ = baseFrameId_;
@@ -104,7 +134,21 @@ private:
 		}
 		st.setOrigin(tf::Vector3(0,0,0));
 
-		pub_.sendTransform(st);
+		lastStamp_ = msg->header.stamp;
+		if(batchSize_ > 1)
+		{
+			// send all transforms of the batch in the same tf message
+			batch_.push_back(st);
+			if((int)batch_.size() >= batchSize_)
+			{
+				pub_.sendTransform(batch_);
+				batch_.clear();
+			}
+		}
+		else
+		{
+			pub_.sendTransform(st);
+		}
 	}
 
 private:
@@ -114,6 +158,14 @@ private:
 	std::string baseFrameId_;
 	tf::TransformListener tfListener_;
 	double waitForTransformDuration_;
+	bool staticBaseTransform_;
+	bool hasBaseTransform_;
+	tf::StampedTransform baseTransform_; // imu frame <- base frame
+	std::string baseTransformFrameId_;
+	double publishRate_;
+	int batchSize_;
+	ros::Time lastStamp_;
+	std::vector<tf::StampedTransform> batch_;
 };
 
 
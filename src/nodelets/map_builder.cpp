@@ -0,0 +1,389 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <ros/ros.h>
+#include <pluginlib/class_list_macros.h>
+#include <nodelet/nodelet.h>
+
+#include <nav_msgs/GetMap.h>
+#include <std_srvs/Empty.h>
+#ifdef WITH_OCTOMAP_MSGS
+#include <octomap_msgs/GetOctomap.h>
+#endif
+
+#include "rtabmap_ros/MapData.h"
+#include "rtabmap_ros/GetMap2.h"
+#include "rtabmap_ros/GetNodeData.h"
+#include "rtabmap_ros/MsgConversion.h"
+#include "rtabmap_ros/MapsManager.h"
+
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UStl.h>
+#include <rtabmap/utilite/UTimer.h>
+#include <rtabmap/utilite/UConversion.h>
+
+#include <boost/thread/mutex.hpp>
+
+using namespace rtabmap;
+
+namespace rtabmap_ros
+{
+
+/**
+ * Build the global maps away from rtabmap (e.g., on a server): only the
+ * graph (delta encoded) and the local grid of each new node are received
+ * (rtabmap's "mapDataGrids" topic), local grids are kept in MapsManager
+ * caches and the grid, octomap and cloud outputs and services are served
+ * from here. Full "mapData" is also accepted, raw data is then dropped.
+ * Local grids missed (e.g., started after rtabmap) are requested with
+ * "get_node_data".
+ */
+class MapBuilder : public nodelet::Nodelet
+{
+public:
+	MapBuilder() :
+		graphVersion_(0),
+		nodeDataMaxBytes_(4*1024*1024)
+	{}
+
+	virtual ~MapBuilder()
+	{}
+
+private:
+	virtual void onInit()
+	{
+		ros::NodeHandle & nh = getNodeHandle();
+		ros::NodeHandle & pnh = getPrivateNodeHandle();
+
+		pnh.param("map_frame_id", mapFrameId_, mapFrameId_);
+		pnh.param("node_data_max_bytes", nodeDataMaxBytes_, nodeDataMaxBytes_);
+		NODELET_INFO("map_builder: node_data_max_bytes = %d", nodeDataMaxBytes_);
+
+		ParametersMap parameters = Parameters::getDefaultParameters("Grid");
+		for(ParametersMap::iterator iter=parameters.begin(); iter!=parameters.end(); ++iter)
+		{
+			std::string vStr;
+			bool vBool;
+			int vInt;
+			double vDouble;
+			if(pnh.getParam(iter->first, vStr))
+			{
+				iter->second = vStr;
+			}
+			else if(pnh.getParam(iter->first, vBool))
+			{
+				iter->second = uBool2Str(vBool);
+			}
+			else if(pnh.getParam(iter->first, vDouble))
+			{
+				iter->second = uNumber2Str(vDouble);
+			}
+			else if(pnh.getParam(iter->first, vInt))
+			{
+				iter->second = uNumber2Str(vInt);
+			}
+			else
+			{
+				continue;
+			}
+			NODELET_INFO("map_builder: Setting parameter \"%s\"=\"%s\"", iter->first.c_str(), iter->second.c_str());
+		}
+
+		mapsManager_.setOutputsMutex(&mutex_);
+		mapsManager_.init(nh, pnh, getName(), true);
+		mapsManager_.backwardCompatibilityParameters(pnh, parameters);
+		mapsManager_.setParameters(parameters);
+
+		mapDataSub_ = nh.subscribe("mapData", 10, &MapBuilder::mapDataCallback, this);
+
+		getMapSrv_ = nh.advertiseService("get_map", &MapBuilder::getMapCallback, this);
+		getProbMapSrv_ = nh.advertiseService("get_prob_map", &MapBuilder::getProbMapCallback, this);
+#ifdef WITH_OCTOMAP_MSGS
+#ifdef RTABMAP_OCTOMAP
+		octomapBinarySrv_ = nh.advertiseService("octomap_binary", &MapBuilder::octomapBinaryCallback, this);
+		octomapFullSrv_ = nh.advertiseService("octomap_full", &MapBuilder::octomapFullCallback, this);
+#endif
+#endif
+		resetSrv_ = pnh.advertiseService("reset", &MapBuilder::resetCallback, this);
+	}
+
+	void mapDataCallback(const rtabmap_ros::MapDataConstPtr & msg)
+	{
+		UTimer timer;
+		boost::mutex::scoped_lock lock(mutex_);
+
+		if(!msg->header.frame_id.empty())
+		{
+			mapFrameId_ = msg->header.frame_id;
+		}
+
+		Transform mapOdom;
+		if(msg->graph.version > 0)
+		{
+			if(!rtabmap_ros::mapGraphDeltaFromROS(msg->graph, poses_, links_, mapOdom, graphVersion_))
+			{
+				NODELET_WARN("map_builder: Missed map version(s) (received %d based on %d, current=%d), requesting the full graph...",
+						(int)msg->graph.version, (int)msg->graph.baseVersion, (int)graphVersion_);
+				rtabmap_ros::GetMap2 getMapSrv;
+				getMapSrv.request.global = false;
+				getMapSrv.request.optimized = true;
+				if(!ros::service::call("get_map_data2", getMapSrv))
+				{
+					NODELET_WARN("map_builder: Can't call \"get_map_data2\" service");
+				}
+				else
+				{
+					rtabmap_ros::mapGraphDeltaFromROS(getMapSrv.response.data.graph, poses_, links_, mapOdom, graphVersion_);
+				}
+			}
+		}
+		else if(!rtabmap_ros::mapGraphFromROS(msg->graph, poses_, links_, mapOdom))
+		{
+			return;
+		}
+
+		for(unsigned int i=0; i<msg->nodes.size(); ++i)
+		{
+			if(!addNode(msg->nodes[i], msg))
+			{
+				// ids are reused: rtabmap has been reset or restarted
+				NODELET_WARN("map_builder: Node %d received with a different stamp than before, "
+						"the graph has been restarted, clearing the maps.", msg->nodes[i].id);
+				clearMaps();
+				addNode(msg->nodes[i], msg);
+			}
+		}
+
+		requestMissingNodes();
+
+		std::map<int, Transform> poses = updateMapCaches(false, false);
+		mapsManager_.publishMaps(poses, msg->header.stamp, mapFrameId_);
+
+		// Only nodes of the graph are kept
+		for(std::map<int, double>::iterator iter=nodeStamps_.begin(); iter!=nodeStamps_.end();)
+		{
+			if(poses_.find(iter->first) == poses_.end())
+			{
+				nodes_.erase(iter->first);
+				nodeStamps_.erase(iter++);
+			}
+			else
+			{
+				++iter;
+			}
+		}
+
+		NODELET_DEBUG("map_builder: nodes=%d time=%fs", (int)nodes_.size(), timer.ticks());
+	}
+
+	/**
+	 * mutex_ should be locked
+	 * @return false if another node with the same id has been received before
+	 */
+	bool addNode(const rtabmap_ros::NodeData & node, const boost::shared_ptr<const void> & owner)
+	{
+		if(node.id <= 0 || node.grid_cell_size <= 0.0f)
+		{
+			return true;
+		}
+		std::map<int, double>::iterator iter = nodeStamps_.find(node.id);
+		if(iter != nodeStamps_.end())
+		{
+			// already received
+			return iter->second == node.stamp;
+		}
+		nodeStamps_.insert(std::make_pair(node.id, node.stamp));
+		if(node.image.size() || node.depth.size() || node.laserScan.size() || node.userData.size() ||
+		   node.wordDescriptors.size() || node.globalDescriptors.size())
+		{
+			// Full node data, keep only the local grid (don't reference the message)
+			rtabmap_ros::NodeData stripped = node;
+			rtabmap_ros::stripNodeDataToLocalGrid(stripped);
+			nodes_.insert(std::make_pair(node.id, rtabmap_ros::nodeDataFromROS(stripped)));
+		}
+		else
+		{
+			nodes_.insert(std::make_pair(node.id, rtabmap_ros::nodeDataFromROS(node, owner)));
+		}
+		return true;
+	}
+
+	// mutex_ should be locked
+	std::map<int, Transform> updateMapCaches(bool updateGrid, bool updateOctomap)
+	{
+		std::map<int, Transform> poses = mapsManager_.updateMapCaches(poses_, 0, updateGrid, updateOctomap, nodes_);
+		// the local grids are now in MapsManager caches
+		for(std::map<int, Signature>::iterator iter=nodes_.begin(); iter!=nodes_.end();)
+		{
+			if(mapsManager_.isGridCached(iter->first))
+			{
+				nodes_.erase(iter++);
+			}
+			else
+			{
+				++iter;
+			}
+		}
+		return poses;
+	}
+
+	// mutex_ should be locked
+	void clearMaps()
+	{
+		mapsManager_.clear();
+		nodes_.clear();
+		nodeStamps_.clear();
+	}
+
+	// Local grids of the graph not received yet (mutex_ should be locked)
+	void requestMissingNodes()
+	{
+		rtabmap_ros::GetNodeData srv;
+		for(std::map<int, Transform>::iterator iter=poses_.lower_bound(1); iter!=poses_.end(); ++iter)
+		{
+			if(nodes_.find(iter->first) == nodes_.end() && !mapsManager_.isGridCached(iter->first))
+			{
+				srv.request.ids.push_back(iter->first);
+			}
+		}
+		if(srv.request.ids.empty())
+		{
+			return;
+		}
+		srv.request.fields = rtabmap_ros::GetNodeData::Request::FIELD_GRID;
+		srv.request.max_bytes = nodeDataMaxBytes_;
+		if(!ros::service::call("get_node_data", srv))
+		{
+			NODELET_WARN_THROTTLE(10, "map_builder: %d local grids missing, can't call \"get_node_data\" service",
+					(int)srv.request.ids.size());
+			return;
+		}
+		for(size_t i=0; i<srv.response.data.size(); ++i)
+		{
+			addNode(srv.response.data[i], boost::shared_ptr<const void>());
+		}
+		NODELET_INFO("map_builder: Received %d missing local grids (%d remaining)",
+				(int)srv.response.data.size(), (int)srv.response.remaining_ids.size());
+	}
+
+	// mutex_ should be locked
+	bool fillMap(const cv::Mat & pixels, float xMin, float yMin, float gridCellSize, nav_msgs::OccupancyGrid & map)
+	{
+		if(pixels.empty())
+		{
+			NODELET_WARN("map_builder: The map is empty!");
+			return false;
+		}
+		map.info.resolution = gridCellSize;
+		map.info.origin.position.x = xMin;
+		map.info.origin.position.y = yMin;
+		map.info.origin.position.z = 0.0;
+		map.info.origin.orientation.w = 1.0;
+		map.info.width = pixels.cols;
+		map.info.height = pixels.rows;
+		map.data.resize(map.info.width * map.info.height);
+		memcpy(map.data.data(), pixels.data, map.info.width * map.info.height);
+		map.header.frame_id = mapFrameId_;
+		map.header.stamp = ros::Time::now();
+		return true;
+	}
+
+	bool getMapCallback(nav_msgs::GetMap::Request & req, nav_msgs::GetMap::Response & res)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		updateMapCaches(true, false);
+		float xMin=0.0f, yMin=0.0f, gridCellSize=0.05f;
+		cv::Mat pixels = mapsManager_.getGridMap(xMin, yMin, gridCellSize);
+		return fillMap(pixels, xMin, yMin, gridCellSize, res.map);
+	}
+
+	bool getProbMapCallback(nav_msgs::GetMap::Request & req, nav_msgs::GetMap::Response & res)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		updateMapCaches(true, false);
+		float xMin=0.0f, yMin=0.0f, gridCellSize=0.05f;
+		cv::Mat pixels = mapsManager_.getGridProbMap(xMin, yMin, gridCellSize);
+		return fillMap(pixels, xMin, yMin, gridCellSize, res.map);
+	}
+
+#ifdef WITH_OCTOMAP_MSGS
+#ifdef RTABMAP_OCTOMAP
+	bool octomapCallback(bool full, octomap_msgs::GetOctomap::Response & res)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		updateMapCaches(false, true);
+		bool success = mapsManager_.getOctomapMsg(full, res.map);
+		res.map.header.frame_id = mapFrameId_;
+		res.map.header.stamp = ros::Time::now();
+		return success;
+	}
+	bool octomapBinaryCallback(octomap_msgs::GetOctomap::Request & req, octomap_msgs::GetOctomap::Response & res)
+	{
+		return octomapCallback(false, res);
+	}
+	bool octomapFullCallback(octomap_msgs::GetOctomap::Request & req, octomap_msgs::GetOctomap::Response & res)
+	{
+		return octomapCallback(true, res);
+	}
+#endif
+#endif
+
+	bool resetCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
+	{
+		NODELET_INFO("map_builder: reset!");
+		boost::mutex::scoped_lock lock(mutex_);
+		clearMaps();
+		poses_.clear();
+		links_.clear();
+		graphVersion_ = 0;
+		return true;
+	}
+
+private:
+	std::string mapFrameId_;
+	MapsManager mapsManager_;
+	boost::mutex mutex_;
+
+	// graph (delta encoding reference) and local grids of the nodes
+	std::map<int, Transform> poses_;
+	std::multimap<int, Link> links_;
+	unsigned int graphVersion_;
+	std::map<int, Signature> nodes_; // not cached yet in mapsManager_
+	std::map<int, double> nodeStamps_; // nodes of the graph received
+	int nodeDataMaxBytes_;
+
+	ros::Subscriber mapDataSub_;
+	ros::ServiceServer getMapSrv_;
+	ros::ServiceServer getProbMapSrv_;
+	ros::ServiceServer octomapBinarySrv_;
+	ros::ServiceServer octomapFullSrv_;
+	ros::ServiceServer resetSrv_;
+};
+
+PLUGINLIB_EXPORT_CLASS(rtabmap_ros::MapBuilder, nodelet::Nodelet);
+}
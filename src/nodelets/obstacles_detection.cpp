@@ -37,27 +37,258 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <tf/transform_listener.h>
 
 #include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/image_encodings.h>
+#include <sensor_msgs/CameraInfo.h>
+
+#include <image_transport/image_transport.h>
+#include <image_transport/subscriber_filter.h>
+
+#include <message_filters/sync_policies/approximate_time.h>
+#include <message_filters/sync_policies/exact_time.h>
+#include <message_filters/subscriber.h>
+
+#include <cv_bridge/cv_bridge.h>
 
 #include <rtabmap_ros/MsgConversion.h>
+#include <rtabmap_ros/NodeletDiagnostics.h>
+#include <rtabmap_ros/LazySubscription.h>
 
 #include "rtabmap/core/OccupancyGrid.h"
+#include "rtabmap/core/util3d_transforms.h"
+#include "rtabmap/core/util3d_filtering.h"
 #include "rtabmap/utilite/UStl.h"
 
+#include <opencv2/core/core.hpp>
+#include <deque>
+#include <limits>
+
 namespace rtabmap_ros
 {
 
+/**
+ * 2.5D elevation grid used by the "height_grid" segmentation engine.
+ * Passes over points (cell of each point, then labels) and over cells
+ * (height steps with the neighbor cells) are done in parallel.
+ */
+class HeightGrid : public cv::ParallelLoopBody
+{
+public:
+	enum Pass {kPointCells, kCellSteps, kPointLabels};
+	enum Label {kNone=0, kGround=1, kObstacle=2, kFlatObstacle=6}; // flat obstacles are obstacles
+
+	HeightGrid(const pcl::PointCloud<pcl::PointXYZ> & cloud,
+			float cellSize, float minX, float minY, int width, int height,
+			float minZ, float maxZ, float maxStep, float maxSlope, float maxGroundHeight, bool flatObstacles) :
+		cloud_(cloud),
+		cellSize_(cellSize),
+		minX_(minX),
+		minY_(minY),
+		width_(width),
+		height_(height),
+		minZ_(minZ),
+		maxZ_(maxZ),
+		maxStep_(maxStep),
+		maxSlope_(maxSlope),
+		maxGroundHeight_(maxGroundHeight),
+		flatObstacles_(flatObstacles),
+		pass_(kPointCells),
+		pointCells_(cloud.size(), -1),
+		labels_(cloud.size(), kNone),
+		cellMin_(width*height, std::numeric_limits<float>::max()),
+		cellMax_(width*height, -std::numeric_limits<float>::max()),
+		cellRaised_(width*height, 0),
+		cellGround_(width*height, 0)
+	{}
+
+	void segment()
+	{
+		pass_ = kPointCells;
+		cv::parallel_for_(cv::Range(0, cloud_.size()), *this);
+		for(size_t i=0; i<pointCells_.size(); ++i)
+		{
+			int c = pointCells_[i];
+			if(c >= 0)
+			{
+				cellMin_[c] = std::min(cellMin_[c], cloud_.at(i).z);
+				cellMax_[c] = std::max(cellMax_[c], cloud_.at(i).z);
+			}
+		}
+
+		pass_ = kCellSteps;
+		cv::parallel_for_(cv::Range(0, height_), *this);
+
+		// Ground is grown from the lowest cells through
+		// cells without height steps with their neighbors
+		float lowest = std::numeric_limits<float>::max();
+		for(size_t c=0; c<cellMin_.size(); ++c)
+		{
+			lowest = std::min(lowest, cellMin_[c]);
+		}
+		float seedHeight = maxGroundHeight_>0.0f?maxGroundHeight_:lowest+maxStep_;
+		std::deque<int> queue;
+		for(size_t c=0; c<cellMin_.size(); ++c)
+		{
+			if(!cellRaised_[c] && cellMin_[c] <= seedHeight)
+			{
+				cellGround_[c] = 1;
+				queue.push_back(c);
+			}
+		}
+		while(!queue.empty())
+		{
+			int c = queue.front();
+			queue.pop_front();
+			int cx = c % width_;
+			int cy = c / width_;
+			for(int y=std::max(0, cy-1); y<=std::min(height_-1, cy+1); ++y)
+			{
+				for(int x=std::max(0, cx-1); x<=std::min(width_-1, cx+1); ++x)
+				{
+					int n = y*width_+x;
+					if(!cellGround_[n] &&
+					   !cellRaised_[n] &&
+					   cellMin_[n] <= cellMax_[n] &&
+					   (maxGroundHeight_<=0.0f || cellMin_[n] <= maxGroundHeight_) &&
+					   std::fabs(cellMin_[n] - cellMin_[c]) <= maxStep_ + maxSlope_*cellSize_*((x!=cx&&y!=cy)?1.41421356f:1.0f))
+					{
+						cellGround_[n] = 1;
+						queue.push_back(n);
+					}
+				}
+			}
+		}
+
+		pass_ = kPointLabels;
+		cv::parallel_for_(cv::Range(0, cloud_.size()), *this);
+	}
+
+	const std::vector<unsigned char> & labels() const {return labels_;}
+
+	virtual void operator()(const cv::Range & range) const
+	{
+		for(int i=range.start; i<range.end; ++i)
+		{
+			if(pass_ == kPointCells)
+			{
+				const pcl::PointXYZ & pt = cloud_.at(i);
+				if(pt.z >= minZ_ && pt.z <= maxZ_)
+				{
+					int x = int((pt.x-minX_)/cellSize_);
+					int y = int((pt.y-minY_)/cellSize_);
+					if(x>=0 && x<width_ && y>=0 && y<height_)
+					{
+						pointCells_[i] = y*width_ + x;
+					}
+				}
+			}
+			else if(pass_ == kCellSteps)
+			{
+				// row i: a cell is raised if its lowest point is higher
+				// than the lowest point of a neighbor by more than
+				// the step and slope allow (e.g. top of a table or a box)
+				for(int cx=0; cx<width_; ++cx)
+				{
+					int c = i*width_+cx;
+					if(cellMin_[c] > cellMax_[c])
+					{
+						continue; // empty
+					}
+					for(int y=std::max(0, i-1); y<=std::min(height_-1, i+1) && !cellRaised_[c]; ++y)
+					{
+						for(int x=std::max(0, cx-1); x<=std::min(width_-1, cx+1); ++x)
+						{
+							int n = y*width_+x;
+							if(n != c && cellMin_[n] <= cellMax_[n] &&
+							   cellMin_[c] - cellMin_[n] > maxStep_ + maxSlope_*cellSize_*((x!=cx&&y!=i)?1.41421356f:1.0f))
+							{
+								cellRaised_[c] = 1;
+								break;
+							}
+						}
+					}
+				}
+			}
+			else
+			{
+				int c = pointCells_[i];
+				if(c < 0)
+				{
+					continue;
+				}
+				float z = cloud_.at(i).z;
+				if(cellGround_[c] && z - cellMin_[c] <= maxStep_)
+				{
+					labels_[i] = kGround;
+				}
+				else if(!cellGround_[c] && cellMax_[c] - cellMin_[c] <= maxStep_)
+				{
+					// flat surface not connected to the ground
+					labels_[i] = flatObstacles_?kFlatObstacle:kGround;
+				}
+				else
+				{
+					labels_[i] = kObstacle;
+				}
+			}
+		}
+	}
+
+private:
+	const pcl::PointCloud<pcl::PointXYZ> & cloud_;
+	float cellSize_;
+	float minX_;
+	float minY_;
+	int width_;
+	int height_;
+	float minZ_;
+	float maxZ_;
+	float maxStep_;
+	float maxSlope_;
+	float maxGroundHeight_;
+	bool flatObstacles_;
+	Pass pass_;
+	// written by cells or points of the range only
+	mutable std::vector<int> pointCells_;
+	mutable std::vector<unsigned char> labels_;
+	std::vector<float> cellMin_;
+	std::vector<float> cellMax_;
+	mutable std::vector<unsigned char> cellRaised_;
+	std::vector<unsigned char> cellGround_;
+};
+
 class ObstaclesDetection : public nodelet::Nodelet
 {
 public:
-	ObstaclesDetection() :
+	ObstaclesDetection(bool depthInput = false) :
+		depthInput_(depthInput),
 		frameId_("base_link"),
 		waitForTransform_(false),
 		mapFrameProjection_(rtabmap::Parameters::defaultGridMapFrameProjection()),
-		warned_(false)
+		heightGrid_(false),
+		heightGridMaxStep_(0.05),
+		cellSize_(rtabmap::Parameters::defaultGridCellSize()),
+		minGroundHeight_(rtabmap::Parameters::defaultGridMinGroundHeight()),
+		maxGroundHeight_(rtabmap::Parameters::defaultGridMaxGroundHeight()),
+		maxObstacleHeight_(rtabmap::Parameters::defaultGridMaxObstacleHeight()),
+		maxGroundAngle_(rtabmap::Parameters::defaultGridMaxGroundAngle()*M_PI/180.0),
+		flatObstacleDetected_(rtabmap::Parameters::defaultGridFlatObstacleDetected()),
+		warned_(false),
+		decimation_(1),
+		minDepth_(0.0),
+		maxDepth_(0.0),
+		voxelSize_(0.0),
+		approxSyncDepth_(0),
+		exactSyncDepth_(0)
 	{}
 
 	virtual ~ObstaclesDetection()
-	{}
+	{
+		if(approxSyncDepth_)
+			delete approxSyncDepth_;
+		if(exactSyncDepth_)
+			delete exactSyncDepth_;
+	}
 
 private:
 
@@ -118,6 +349,22 @@ private:
 		pnh.param("frame_id", frameId_, frameId_);
 		pnh.param("map_frame_id", mapFrameId_, mapFrameId_);
 		pnh.param("wait_for_transform", waitForTransform_, waitForTransform_);
+		std::string segmentationEngine = "normals";
+		pnh.param("segmentation_engine", segmentationEngine, segmentationEngine);
+		pnh.param("height_grid_max_step", heightGridMaxStep_, heightGridMaxStep_);
+		if(segmentationEngine.compare("height_grid") == 0)
+		{
+			heightGrid_ = true;
+		}
+		else if(segmentationEngine.compare("normals") != 0)
+		{
+			NODELET_ERROR("obstacles_detection: Unknown segmentation_engine \"%s\" (\"normals\" or \"height_grid\"), using \"normals\".", segmentationEngine.c_str());
+		}
+		NODELET_INFO("obstacles_detection: segmentation_engine=%s", heightGrid_?"height_grid":"normals");
+		if(heightGrid_)
+		{
+			NODELET_INFO("obstacles_detection: height_grid_max_step=%f m", heightGridMaxStep_);
+		}
 
 		if(pnh.hasParam("optimize_for_close_objects"))
 		{
@@ -228,69 +475,236 @@ private:
 
 		grid_.parseParameters(parameters);
 
-		cloudSub_ = nh.subscribe("cloud", 1, &ObstaclesDetection::callback, this);
+		cellSize_ = uStr2Float(parameters.at(rtabmap::Parameters::kGridCellSize()));
+		minGroundHeight_ = uStr2Float(parameters.at(rtabmap::Parameters::kGridMinGroundHeight()));
+		maxGroundHeight_ = uStr2Float(parameters.at(rtabmap::Parameters::kGridMaxGroundHeight()));
+		maxObstacleHeight_ = uStr2Float(parameters.at(rtabmap::Parameters::kGridMaxObstacleHeight()));
+		maxGroundAngle_ = uStr2Float(parameters.at(rtabmap::Parameters::kGridMaxGroundAngle()))*M_PI/180.0;
+		flatObstacleDetected_ = uStr2Bool(parameters.at(rtabmap::Parameters::kGridFlatObstacleDetected()));
+
+		lazy_.init(pnh, getName(),
+				boost::bind(&ObstaclesDetection::subscribeInputs, this),
+				boost::bind(&ObstaclesDetection::unsubscribeInputs, this));
 
-		groundPub_ = nh.advertise<sensor_msgs::PointCloud2>("ground", 1);
-		obstaclesPub_ = nh.advertise<sensor_msgs::PointCloud2>("obstacles", 1);
-		projObstaclesPub_ = nh.advertise<sensor_msgs::PointCloud2>("proj_obstacles", 1);
+		if(depthInput_)
+		{
+			bool approxSync = true;
+			pnh.param("approx_sync", approxSync, approxSync);
+			pnh.param("decimation", decimation_, decimation_);
+			pnh.param("min_depth", minDepth_, minDepth_);
+			pnh.param("max_depth", maxDepth_, maxDepth_);
+			pnh.param("voxel_size", voxelSize_, voxelSize_);
+			NODELET_INFO("obstacles_detection: depth input, approx_sync=%s decimation=%d min_depth=%f max_depth=%f voxel_size=%f",
+					approxSync?"true":"false", decimation_, minDepth_, maxDepth_, voxelSize_);
+
+			if(approxSync)
+			{
+				approxSyncDepth_ = new message_filters::Synchronizer<MyApproxSyncDepthPolicy>(MyApproxSyncDepthPolicy(queueSize), imageDepthSub_, cameraInfoSub_);
+				approxSyncDepth_->registerCallback(boost::bind(&ObstaclesDetection::depthCallback, this, _1, _2));
+			}
+			else
+			{
+				exactSyncDepth_ = new message_filters::Synchronizer<MyExactSyncDepthPolicy>(MyExactSyncDepthPolicy(queueSize), imageDepthSub_, cameraInfoSub_);
+				exactSyncDepth_->registerCallback(boost::bind(&ObstaclesDetection::depthCallback, this, _1, _2));
+			}
+
+			// optional, the projected cloud in frame_id
+			cloudPub_ = nh.advertise<sensor_msgs::PointCloud2>("cloud", 1, lazy_.connectCallback(), lazy_.connectCallback());
+			lazy_.addOutput(cloudPub_);
+		}
+
+		groundPub_ = nh.advertise<sensor_msgs::PointCloud2>("ground", 1, lazy_.connectCallback(), lazy_.connectCallback());
+		obstaclesPub_ = nh.advertise<sensor_msgs::PointCloud2>("obstacles", 1, lazy_.connectCallback(), lazy_.connectCallback());
+		projObstaclesPub_ = nh.advertise<sensor_msgs::PointCloud2>("proj_obstacles", 1, lazy_.connectCallback(), lazy_.connectCallback());
+		lazy_.addOutput(groundPub_);
+		lazy_.addOutput(obstaclesPub_);
+		lazy_.addOutput(projObstaclesPub_);
+		diagnostics_.init(nh, pnh, getName());
+		lazy_.start();
+	}
+
+	void subscribeInputs()
+	{
+		ros::NodeHandle & nh = getNodeHandle();
+		ros::NodeHandle & pnh = getPrivateNodeHandle();
+		if(depthInput_)
+		{
+			ros::NodeHandle depth_nh(nh, "depth");
+			ros::NodeHandle depth_pnh(pnh, "depth");
+			image_transport::ImageTransport depth_it(depth_nh);
+			image_transport::TransportHints hintsDepth("raw", ros::TransportHints(), depth_pnh);
+			imageDepthSub_.subscribe(depth_it, depth_nh.resolveName("image"), 1, hintsDepth);
+			cameraInfoSub_.subscribe(depth_nh, "camera_info", 1);
+		}
+		else
+		{
+			cloudSub_ = nh.subscribe("cloud", 1, &ObstaclesDetection::callback, this);
+		}
 	}
 
+	void unsubscribeInputs()
+	{
+		if(depthInput_)
+		{
+			imageDepthSub_.unsubscribe();
+			cameraInfoSub_.unsubscribe();
+		}
+		else
+		{
+			cloudSub_.shutdown();
+		}
+	}
 
 
-	void callback(const sensor_msgs::PointCloud2ConstPtr & cloudMsg)
+
+	/**
+	 * Segment ground and obstacles with a 2.5D elevation grid instead
+	 * of normals and clustering. Output is the same than
+	 * OccupancyGrid::segmentCloud(): the cloud is returned in the
+	 * projection frame (roll and pitch of the pose), indices refer to it.
+	 */
+	pcl::PointCloud<pcl::PointXYZ>::Ptr segmentHeightGrid(
+			const pcl::PointCloud<pcl::PointXYZ>::Ptr & inputCloud,
+			const rtabmap::Transform & pose,
+			pcl::IndicesPtr & ground,
+			pcl::IndicesPtr & obstacles,
+			pcl::IndicesPtr & flatObstacles)
 	{
-		ros::WallTime time = ros::WallTime::now();
+		float roll, pitch, yaw;
+		pose.getEulerAngles(roll, pitch, yaw);
+		rtabmap::Transform t = rtabmap::Transform(0,0, mapFrameProjection_?pose.z():0, roll, pitch, 0);
+		pcl::PointCloud<pcl::PointXYZ>::Ptr cloud = rtabmap::util3d::transformPointCloud(inputCloud, t);
+
+		ground.reset(new std::vector<int>);
+		obstacles.reset(new std::vector<int>);
+		if(cloud->empty())
+		{
+			return cloud;
+		}
 
-		if (groundPub_.getNumSubscribers() == 0 && obstaclesPub_.getNumSubscribers() == 0 && projObstaclesPub_.getNumSubscribers() == 0)
+		float minX=cloud->at(0).x, minY=cloud->at(0).y, maxX=minX, maxY=minY;
+		for(size_t i=1; i<cloud->size(); ++i)
 		{
-			// no one wants the results
-			return;
+			const pcl::PointXYZ & pt = cloud->at(i);
+			minX = std::min(minX, pt.x);
+			minY = std::min(minY, pt.y);
+			maxX = std::max(maxX, pt.x);
+			maxY = std::max(maxY, pt.y);
+		}
+		float cellSize = cellSize_;
+		// Bound memory of the grid for very wide clouds
+		const float maxCells = 2048.0f;
+		cellSize = std::max(cellSize, std::max(maxX-minX, maxY-minY)/maxCells);
+		int width = int((maxX-minX)/cellSize)+1;
+		int height = int((maxY-minY)/cellSize)+1;
+
+		HeightGrid grid(*cloud,
+				cellSize, minX, minY, width, height,
+				minGroundHeight_!=0.0f?minGroundHeight_:-std::numeric_limits<float>::max(),
+				maxObstacleHeight_>0.0f?maxObstacleHeight_:std::numeric_limits<float>::max(),
+				heightGridMaxStep_,
+				std::tan(maxGroundAngle_),
+				maxGroundHeight_,
+				flatObstacleDetected_);
+		grid.segment();
+
+		const std::vector<unsigned char> & labels = grid.labels();
+		ground->reserve(labels.size());
+		obstacles->reserve(labels.size());
+		for(size_t i=0; i<labels.size(); ++i)
+		{
+			if(labels[i] == HeightGrid::kGround)
+			{
+				ground->push_back(i);
+			}
+			else if(labels[i] & HeightGrid::kObstacle)
+			{
+				obstacles->push_back(i);
+				if(labels[i] == HeightGrid::kFlatObstacle)
+				{
+					flatObstacles->push_back(i);
+				}
+			}
 		}
+		return cloud;
+	}
 
-		rtabmap::Transform localTransform = rtabmap::Transform::getIdentity();
+	// Transforms frameId_ <- sensorFrame (localTransform) and mapFrameId_ <- frameId_ (pose)
+	bool lookupTransforms(
+			const std::string & sensorFrame,
+			const ros::Time & stamp,
+			rtabmap::Transform & localTransform,
+			rtabmap::Transform & pose)
+	{
+		localTransform = rtabmap::Transform::getIdentity();
 		try
 		{
 			if(waitForTransform_)
 			{
-				if(!tfListener_.waitForTransform(frameId_, cloudMsg->header.frame_id, cloudMsg->header.stamp, ros::Duration(1)))
+				if(!tfListener_.waitForTransform(frameId_, sensorFrame, stamp, ros::Duration(1)))
 				{
-					NODELET_ERROR("Could not get transform from %s to %s after 1 second!", frameId_.c_str(), cloudMsg->header.frame_id.c_str());
-					return;
+					NODELET_ERROR("Could not get transform from %s to %s after 1 second!", frameId_.c_str(), sensorFrame.c_str());
+					return false;
 				}
 			}
 			tf::StampedTransform tmp;
-			tfListener_.lookupTransform(frameId_, cloudMsg->header.frame_id, cloudMsg->header.stamp, tmp);
+			tfListener_.lookupTransform(frameId_, sensorFrame, stamp, tmp);
 			localTransform = rtabmap_ros::transformFromTF(tmp);
 		}
 		catch(tf::TransformException & ex)
 		{
 			NODELET_ERROR("%s",ex.what());
-			return;
+			return false;
 		}
 
-		rtabmap::Transform pose = rtabmap::Transform::getIdentity();
+		pose = rtabmap::Transform::getIdentity();
 		if(!mapFrameId_.empty())
 		{
 			try
 			{
 				if(waitForTransform_)
 				{
-					if(!tfListener_.waitForTransform(mapFrameId_, frameId_, cloudMsg->header.stamp, ros::Duration(1)))
+					if(!tfListener_.waitForTransform(mapFrameId_, frameId_, stamp, ros::Duration(1)))
 					{
 						NODELET_ERROR("Could not get transform from %s to %s after 1 second!", mapFrameId_.c_str(), frameId_.c_str());
-						return;
+						return false;
 					}
 				}
 				tf::StampedTransform tmp;
-				tfListener_.lookupTransform(mapFrameId_, frameId_, cloudMsg->header.stamp, tmp);
+				tfListener_.lookupTransform(mapFrameId_, frameId_, stamp, tmp);
 				pose = rtabmap_ros::transformFromTF(tmp);
 			}
 			catch(tf::TransformException & ex)
 			{
 				NODELET_ERROR("%s",ex.what());
-				return;
+				return false;
 			}
 		}
+		return true;
+	}
+
+	bool hasSubscribers() const
+	{
+		return groundPub_.getNumSubscribers() || obstaclesPub_.getNumSubscribers() || projObstaclesPub_.getNumSubscribers();
+	}
+
+	void callback(const sensor_msgs::PointCloud2ConstPtr & cloudMsg)
+	{
+		ros::WallTime time = ros::WallTime::now();
+		NodeletDiagnostics::ScopedTimer timer(diagnostics_);
+		diagnostics_.tickInput(cloudMsg->header);
+
+		if(!hasSubscribers())
+		{
+			// no one wants the results
+			return;
+		}
+
+		rtabmap::Transform localTransform, pose;
+		if(!lookupTransforms(cloudMsg->header.frame_id, cloudMsg->header.stamp, localTransform, pose))
+		{
+			return;
+		}
 
 		UASSERT_MSG(cloudMsg->data.size() == cloudMsg->row_step*cloudMsg->height,
 				uFormat("data=%d row_step=%d height=%d", cloudMsg->data.size(), cloudMsg->row_step, cloudMsg->height).c_str());
@@ -314,6 +728,102 @@ private:
 			inputCloud->is_dense = true;
 		}
 
+		if(inputCloud->size())
+		{
+			inputCloud = rtabmap::util3d::transformPointCloud(inputCloud, localTransform);
+		}
+		else
+		{
+			ROS_WARN("obstacles_detection: Input cloud is empty! (%d x %d, is_dense=%d)", cloudMsg->width, cloudMsg->height, cloudMsg->is_dense?1:0);
+		}
+
+		segmentAndPublish(inputCloud, localTransform, pose, cloudMsg->header);
+
+		NODELET_DEBUG("Obstacles segmentation time = %f s", (ros::WallTime::now() - time).toSec());
+	}
+
+	/**
+	 * Fused input: the depth image is projected directly in frameId_ (ray
+	 * tables, decimation and depth range in one pass), then voxelized and
+	 * segmented. No intermediate PointCloud2 is created unless "cloud" is subscribed.
+	 */
+	void depthCallback(
+			const sensor_msgs::ImageConstPtr& depth,
+			const sensor_msgs::CameraInfoConstPtr& cameraInfo)
+	{
+		ros::WallTime time = ros::WallTime::now();
+		NodeletDiagnostics::ScopedTimer timer(diagnostics_);
+		diagnostics_.tickInput(depth->header);
+
+		if(depth->encoding.compare(sensor_msgs::image_encodings::TYPE_16UC1)!=0 &&
+		   depth->encoding.compare(sensor_msgs::image_encodings::TYPE_32FC1)!=0 &&
+		   depth->encoding.compare(sensor_msgs::image_encodings::MONO16)!=0)
+		{
+			NODELET_ERROR("Input type depth=32FC1,16UC1,MONO16");
+			return;
+		}
+
+		if(!hasSubscribers() && cloudPub_.getNumSubscribers() == 0)
+		{
+			// no one wants the results
+			return;
+		}
+
+		rtabmap::Transform localTransform, pose;
+		if(!lookupTransforms(depth->header.frame_id, depth->header.stamp, localTransform, pose))
+		{
+			return;
+		}
+
+		cv_bridge::CvImageConstPtr imageDepthPtr = cv_bridge::toCvShare(depth);
+		rtabmap::CameraModel model = rtabmap_ros::cameraModelFromROS(*cameraInfo);
+
+		pcl::PointCloud<pcl::PointXYZ>::Ptr inputCloud(new pcl::PointCloud<pcl::PointXYZ>);
+		rtabmap_ros::depthToPointCloud(
+				imageDepthPtr->image,
+				model,
+				decimation_,
+				minDepth_,
+				maxDepth_,
+				*inputCloud,
+				localTransform);
+		if(inputCloud->size() && voxelSize_ > 0.0)
+		{
+			inputCloud = rtabmap::util3d::voxelize(inputCloud, voxelSize_);
+		}
+
+		if(cloudPub_.getNumSubscribers())
+		{
+			sensor_msgs::PointCloud2 rosCloud;
+			pcl::toROSMsg(*inputCloud, rosCloud);
+			rosCloud.header.stamp = depth->header.stamp;
+			rosCloud.header.frame_id = frameId_;
+			cloudPub_.publish(rosCloud);
+		}
+
+		if(hasSubscribers())
+		{
+			segmentAndPublish(inputCloud, localTransform, pose, depth->header);
+		}
+		else
+		{
+			diagnostics_.tickOutput(depth->header.stamp);
+		}
+
+		NODELET_DEBUG("Obstacles segmentation from depth time = %f s", (ros::WallTime::now() - time).toSec());
+	}
+
+	/**
+	 * inputCloud is in frameId_ frame, ground and obstacles are
+	 * published back in the sensor frame (header), projected
+	 * obstacles in frameId_.
+	 */
+	void segmentAndPublish(
+			const pcl::PointCloud<pcl::PointXYZ>::Ptr & inputCloud,
+			const rtabmap::Transform & localTransform,
+			const rtabmap::Transform & pose,
+			const std_msgs::Header & header)
+	{
 		//Common variables for all strategies
 		pcl::IndicesPtr ground, obstacles;
 		pcl::PointCloud<pcl::PointXYZ>::Ptr obstaclesCloud(new pcl::PointCloud<pcl::PointXYZ>);
@@ -322,17 +832,23 @@ private:
 
 		if(inputCloud->size())
 		{
-			inputCloud = rtabmap::util3d::transformPointCloud(inputCloud, localTransform);
-
 			pcl::IndicesPtr flatObstacles(new std::vector<int>);
-			pcl::PointCloud<pcl::PointXYZ>::Ptr cloud = grid_.segmentCloud<pcl::PointXYZ>(
-					inputCloud,
-					pcl::IndicesPtr(new std::vector<int>),
-					pose,
-					cv::Point3f(localTransform.x(), localTransform.y(), localTransform.z()),
-					ground,
-					obstacles,
-					&flatObstacles);
+			pcl::PointCloud<pcl::PointXYZ>::Ptr cloud;
+			if(heightGrid_)
+			{
+				cloud = segmentHeightGrid(inputCloud, pose, ground, obstacles, flatObstacles);
+			}
+			else
+			{
+				cloud = grid_.segmentCloud<pcl::PointXYZ>(
+						inputCloud,
+						pcl::IndicesPtr(new std::vector<int>),
+						pose,
+						cv::Point3f(localTransform.x(), localTransform.y(), localTransform.z()),
+						ground,
+						obstacles,
+						&flatObstacles);
+			}
 
 			if(cloud->size() && ((ground.get() && ground->size()) || (obstacles.get() && obstacles->size())))
 			{
@@ -346,10 +862,14 @@ private:
 						obstacles.get() && obstacles->size())
 				{
 					// remove flat obstacles from obstacles
-					std::set<int> flatObstaclesSet;
-					if(projObstaclesPub_.getNumSubscribers())
+					std::vector<bool> flatObstaclesMask;
+					if(projObstaclesPub_.getNumSubscribers() && flatObstacles->size())
 					{
-						flatObstaclesSet.insert(flatObstacles->begin(), flatObstacles->end());
+						flatObstaclesMask.resize(cloud->size(), false);
+						for(size_t i=0; i<flatObstacles->size(); ++i)
+						{
+							flatObstaclesMask[flatObstacles->at(i)] = true;
+						}
 					}
 
 					obstaclesCloud->resize(obstacles->size());
@@ -359,8 +879,7 @@ private:
 					for(unsigned int i=0; i<obstacles->size(); ++i)
 					{
 						obstaclesCloud->points[i] = cloud->at(obstacles->at(i));
-						if(flatObstaclesSet.size() == 0 ||
-						   flatObstaclesSet.find(obstacles->at(i))==flatObstaclesSet.end())
+						if(flatObstaclesMask.empty() || !flatObstaclesMask[obstacles->at(i)])
 						{
 							obstaclesCloudWithoutFlatSurfaces->points[oi] = obstaclesCloud->points[i];
 							obstaclesCloudWithoutFlatSurfaces->points[oi].z = 0;
@@ -397,16 +916,12 @@ private:
 				}
 			}
 		}
-		else
-		{
-			ROS_WARN("obstacles_detection: Input cloud is empty! (%d x %d, is_dense=%d)", cloudMsg->width, cloudMsg->height, cloudMsg->is_dense?1:0);
-		}
 
 		if(groundPub_.getNumSubscribers())
 		{
 			sensor_msgs::PointCloud2 rosCloud;
 			pcl::toROSMsg(*groundCloud, rosCloud);
-			rosCloud.header = cloudMsg->header;
+			rosCloud.header = header;
 
 			//publish the message
 			groundPub_.publish(rosCloud);
@@ -416,7 +931,7 @@ private:
 		{
 			sensor_msgs::PointCloud2 rosCloud;
 			pcl::toROSMsg(*obstaclesCloud, rosCloud);
-			rosCloud.header = cloudMsg->header;
+			rosCloud.header = header;
 
 			//publish the message
 			obstaclesPub_.publish(rosCloud);
@@ -426,23 +941,34 @@ private:
 		{
 			sensor_msgs::PointCloud2 rosCloud;
 			pcl::toROSMsg(*obstaclesCloudWithoutFlatSurfaces, rosCloud);
-			rosCloud.header.stamp = cloudMsg->header.stamp;
+			rosCloud.header.stamp = header.stamp;
 			rosCloud.header.frame_id = frameId_;
 
 			//publish the message
 			projObstaclesPub_.publish(rosCloud);
 		}
-
-		NODELET_DEBUG("Obstacles segmentation time = %f s", (ros::WallTime::now() - time).toSec());
+		diagnostics_.tickOutput(header.stamp);
 	}
 
 private:
+	bool depthInput_;
 	std::string frameId_;
 	std::string mapFrameId_;
 	bool waitForTransform_;
 
 	rtabmap::OccupancyGrid grid_;
 	bool mapFrameProjection_;
+
+	// height_grid segmentation engine
+	bool heightGrid_;
+	double heightGridMaxStep_;
+	float cellSize_;
+	float minGroundHeight_;
+	float maxGroundHeight_;
+	float maxObstacleHeight_;
+	float maxGroundAngle_; // rad
+	bool flatObstacleDetected_;
+
 	bool warned_;
 
 	tf::TransformListener tfListener_;
@@ -450,11 +976,39 @@ private:
 	ros::Publisher groundPub_;
 	ros::Publisher obstaclesPub_;
 	ros::Publisher projObstaclesPub_;
+	NodeletDiagnostics diagnostics_;
+	LazySubscription lazy_;
 
 	ros::Subscriber cloudSub_;
+
+	// depth input
+	int decimation_;
+	double minDepth_;
+	double maxDepth_;
+	double voxelSize_;
+	ros::Publisher cloudPub_;
+	image_transport::SubscriberFilter imageDepthSub_;
+	message_filters::Subscriber<sensor_msgs::CameraInfo> cameraInfoSub_;
+	typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::Image, sensor_msgs::CameraInfo> MyApproxSyncDepthPolicy;
+	message_filters::Synchronizer<MyApproxSyncDepthPolicy> * approxSyncDepth_;
+	typedef message_filters::sync_policies::ExactTime<sensor_msgs::Image, sensor_msgs::CameraInfo> MyExactSyncDepthPolicy;
+	message_filters::Synchronizer<MyExactSyncDepthPolicy> * exactSyncDepth_;
+};
+
+/**
+ * Same than obstacles_detection, but from depth + camera_info
+ * instead of a cloud produced by point_cloud_xyz.
+ */
+class DepthObstaclesDetection : public ObstaclesDetection
+{
+public:
+	DepthObstaclesDetection() :
+		ObstaclesDetection(true)
+	{}
 };
 
 PLUGINLIB_EXPORT_CLASS(rtabmap_ros::ObstaclesDetection, nodelet::Nodelet);
+PLUGINLIB_EXPORT_CLASS(rtabmap_ros::DepthObstaclesDetection, nodelet::Nodelet);
 }
 
 
@@ -48,17 +48,122 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <message_filters/sync_policies/exact_time.h>
 
 #include <rtabmap_ros/MsgConversion.h>
+#include <rtabmap_ros/NodeletDiagnostics.h>
+#include <rtabmap_ros/MessageSynchronizer.h>
 #include <rtabmap/utilite/UConversion.h>
 #include <rtabmap/core/util3d_filtering.h>
 
+#include <opencv2/core/core.hpp>
+#include <boost/thread/mutex.hpp>
+#include <cmath>
+
 namespace rtabmap_ros
 {
 
+/**
+ * Transform and copy blocks of points of clouds sharing the same fields
+ * directly in the output buffer. Each block is written at its own
+ * offset, invalid points are skipped and the number of points
+ * written is kept in the block to compact the output afterwards.
+ */
+class CloudsCombiner : public cv::ParallelLoopBody
+{
+public:
+	struct Block
+	{
+		int cloud;
+		size_t begin; // first point index in the cloud
+		size_t end;
+		size_t outIndex; // first point index in the output
+		size_t written;
+	};
+
+	CloudsCombiner(
+			const std::vector<sensor_msgs::PointCloud2ConstPtr> & clouds,
+			const std::vector<rtabmap::Transform> & transforms,
+			int xOffset, int yOffset, int zOffset,
+			int normalOffset, // -1 if no normals
+			std::vector<Block> & blocks,
+			unsigned char * output) :
+		clouds_(clouds),
+		transforms_(transforms),
+		xOffset_(xOffset),
+		yOffset_(yOffset),
+		zOffset_(zOffset),
+		normalOffset_(normalOffset),
+		blocks_(blocks),
+		output_(output)
+	{}
+
+	virtual void operator()(const cv::Range & range) const
+	{
+		for(int b=range.start; b<range.end; ++b)
+		{
+			Block & block = blocks_[b];
+			const sensor_msgs::PointCloud2 & cloud = *clouds_[block.cloud];
+			const rtabmap::Transform & t = transforms_[block.cloud];
+			bool identity = t.isNull() || t.isIdentity();
+			bool filterNaNs = !cloud.is_dense;
+			const size_t step = cloud.point_step;
+			unsigned char * out = output_ + block.outIndex*step;
+			size_t written = 0;
+			for(size_t i=block.begin; i<block.end; ++i)
+			{
+				const unsigned char * in = &cloud.data[(i/cloud.width)*cloud.row_step + (i%cloud.width)*step];
+				float x,y,z;
+				memcpy(&x, in+xOffset_, sizeof(float));
+				memcpy(&y, in+yOffset_, sizeof(float));
+				memcpy(&z, in+zOffset_, sizeof(float));
+				if(filterNaNs && (!std::isfinite(x) || !std::isfinite(y) || !std::isfinite(z)))
+				{
+					continue;
+				}
+				memcpy(out, in, step);
+				if(!identity)
+				{
+					float v[3];
+					v[0] = t.r11()*x + t.r12()*y + t.r13()*z + t.x();
+					v[1] = t.r21()*x + t.r22()*y + t.r23()*z + t.y();
+					v[2] = t.r31()*x + t.r32()*y + t.r33()*z + t.z();
+					memcpy(out+xOffset_, &v[0], sizeof(float));
+					memcpy(out+yOffset_, &v[1], sizeof(float));
+					memcpy(out+zOffset_, &v[2], sizeof(float));
+					if(normalOffset_ >= 0)
+					{
+						float n[3];
+						memcpy(n, in+normalOffset_, 3*sizeof(float));
+						v[0] = t.r11()*n[0] + t.r12()*n[1] + t.r13()*n[2];
+						v[1] = t.r21()*n[0] + t.r22()*n[1] + t.r23()*n[2];
+						v[2] = t.r31()*n[0] + t.r32()*n[1] + t.r33()*n[2];
+						memcpy(out+normalOffset_, v, 3*sizeof(float));
+					}
+				}
+				out += step;
+				++written;
+			}
+			block.written = written;
+		}
+	}
+
+private:
+	const std::vector<sensor_msgs::PointCloud2ConstPtr> & clouds_;
+	const std::vector<rtabmap::Transform> & transforms_;
+	int xOffset_;
+	int yOffset_;
+	int zOffset_;
+	int normalOffset_;
+	std::vector<CloudsCombiner::Block> & blocks_;
+	unsigned char * output_;
+};
+
 /**
  * Nodelet used to merge point clouds from different sensors into a single
  * assembled cloud. If fixed_frame_id is set and approx_sync is true,
  * the clouds are adjusted to include the displacement of the robot
  * in the output cloud.
+ * With count > 4, topics cloud1 to cloudN are synchronized by the nodelet
+ * itself. When all clouds have the same fields, they are transformed in
+ * parallel directly in the output cloud.
  */
 class PointCloudAggregator : public nodelet::Nodelet
 {
@@ -108,12 +213,25 @@ private:
 		pnh.param("count", count, count);
 		pnh.param("wait_for_transform_duration", waitForTransformDuration_, waitForTransformDuration_);
 
-		cloudSub_1_.subscribe(nh, "cloud1", 1);
-		cloudSub_2_.subscribe(nh, "cloud2", 1);
-
 		std::string subscribedTopicsMsg;
-		if(count == 4)
+		if(count > 4)
+		{
+			cloudsSync_.init(count, queueSize, approx);
+			subscribedTopicsMsg = uFormat("\n%s subscribed to (%s sync):",
+					getName().c_str(),
+					approx?"approx":"exact");
+			for(int i=0; i<count; ++i)
+			{
+				cloudSubs_.push_back(nh.subscribe<sensor_msgs::PointCloud2>(
+						uFormat("cloud%d", i+1), 1,
+						boost::bind(&PointCloudAggregator::cloudsX_callback, this, _1, i)));
+				subscribedTopicsMsg += uFormat("\n   %s%s", cloudSubs_.back().getTopic().c_str(), i+1<count?",":"");
+			}
+		}
+		else if(count == 4)
 		{
+			cloudSub_1_.subscribe(nh, "cloud1", 1);
+			cloudSub_2_.subscribe(nh, "cloud2", 1);
 			cloudSub_3_.subscribe(nh, "cloud3", 1);
 			cloudSub_4_.subscribe(nh, "cloud4", 1);
 			if(approx)
@@ -136,6 +254,8 @@ private:
 		}
 		else if(count == 3)
 		{
+			cloudSub_1_.subscribe(nh, "cloud1", 1);
+			cloudSub_2_.subscribe(nh, "cloud2", 1);
 			cloudSub_3_.subscribe(nh, "cloud3", 1);
 			if(approx)
 			{
@@ -156,6 +276,8 @@ private:
 		}
 		else
 		{
+			cloudSub_1_.subscribe(nh, "cloud1", 1);
+			cloudSub_2_.subscribe(nh, "cloud2", 1);
 			if(approx)
 			{
 				approxSync2_ = new message_filters::Synchronizer<ApproxSync2Policy>(ApproxSync2Policy(queueSize), cloudSub_1_, cloudSub_2_);
@@ -174,6 +296,7 @@ private:
 		}
 
 		cloudPub_ = nh.advertise<sensor_msgs::PointCloud2>("combined_cloud", 1);
+		diagnostics_.init(nh, pnh, getName());
 
 		warningThread_ = new boost::thread(boost::bind(&PointCloudAggregator::warningLoop, this, subscribedTopicsMsg, approx));
 		NODELET_INFO("%s", subscribedTopicsMsg.c_str());
@@ -212,12 +335,191 @@ private:
 
 		combineClouds(clouds);
 	}
+	void cloudsX_callback(const sensor_msgs::PointCloud2ConstPtr & cloudMsg, int index)
+	{
+		// Same synchronizer than the RGBD cameras of CommonDataSubscriber
+		std::vector<std::vector<sensor_msgs::PointCloud2ConstPtr> > sets;
+		{
+			boost::mutex::scoped_lock lock(cloudsSyncMutex_);
+			if(!cloudsSync_.add(index, cloudMsg->header.stamp.toSec(), cloudMsg))
+			{
+				diagnostics_.tickDrop();
+			}
+			std::vector<MessageSynchronizer::MessagePtr> msgs;
+			std::vector<double> stamps;
+			while(cloudsSync_.pop(msgs, stamps))
+			{
+				sets.resize(sets.size()+1);
+				for(size_t i=0; i<msgs.size(); ++i)
+				{
+					sets.back().push_back(boost::static_pointer_cast<sensor_msgs::PointCloud2 const>(msgs[i]));
+				}
+			}
+		}
+		for(size_t i=0; i<sets.size(); ++i)
+		{
+			combineClouds(sets[i]);
+		}
+	}
+
+	/**
+	 * Combine clouds having all the same fields without PCL conversions.
+	 * @return false if clouds cannot be combined this way
+	 */
+	bool combineCloudsDirect(
+			const std::vector<sensor_msgs::PointCloud2ConstPtr> & cloudMsgs,
+			const std::string & frameId)
+	{
+		const sensor_msgs::PointCloud2 & ref = *cloudMsgs[0];
+		int xOffset=-1, yOffset=-1, zOffset=-1, normalOffset=-1;
+		for(size_t i=0; i<ref.fields.size(); ++i)
+		{
+			const sensor_msgs::PointField & field = ref.fields[i];
+			if(field.datatype == sensor_msgs::PointField::FLOAT32 && field.count == 1)
+			{
+				if(field.name.compare("x") == 0) xOffset = field.offset;
+				else if(field.name.compare("y") == 0) yOffset = field.offset;
+				else if(field.name.compare("z") == 0) zOffset = field.offset;
+				else if(field.name.compare("normal_x") == 0 &&
+						i+2 < ref.fields.size() &&
+						ref.fields[i+1].name.compare("normal_y") == 0 && ref.fields[i+1].offset == field.offset+4 &&
+						ref.fields[i+2].name.compare("normal_z") == 0 && ref.fields[i+2].offset == field.offset+8)
+				{
+					normalOffset = field.offset;
+				}
+			}
+		}
+		if(xOffset<0 || yOffset<0 || zOffset<0 || ref.is_bigendian)
+		{
+			return false;
+		}
+
+		size_t totalPoints = 0;
+		for(size_t i=0; i<cloudMsgs.size(); ++i)
+		{
+			const sensor_msgs::PointCloud2 & cloud = *cloudMsgs[i];
+			if(cloud.point_step != ref.point_step ||
+			   cloud.is_bigendian != ref.is_bigendian ||
+			   cloud.fields.size() != ref.fields.size())
+			{
+				return false;
+			}
+			for(size_t j=0; j<ref.fields.size(); ++j)
+			{
+				if(cloud.fields[j].name.compare(ref.fields[j].name) != 0 ||
+				   cloud.fields[j].offset != ref.fields[j].offset ||
+				   cloud.fields[j].datatype != ref.fields[j].datatype ||
+				   cloud.fields[j].count != ref.fields[j].count)
+				{
+					return false;
+				}
+			}
+			totalPoints += cloud.width*cloud.height;
+		}
+
+		std::vector<rtabmap::Transform> transforms(cloudMsgs.size());
+		for(size_t i=0; i<cloudMsgs.size(); ++i)
+		{
+			if(frameId.compare(cloudMsgs[i]->header.frame_id) != 0)
+			{
+				transforms[i] = rtabmap_ros::getTransform(
+						frameId, //fromFrame
+						cloudMsgs[i]->header.frame_id, //toFrame
+						cloudMsgs[i]->header.stamp,
+						tfListener_,
+						waitForTransformDuration_);
+				if(transforms[i].isNull())
+				{
+					NODELET_ERROR("Cannot transform cloud from \"%s\" to \"%s\", aborting the aggregation!",
+							cloudMsgs[i]->header.frame_id.c_str(), frameId.c_str());
+					return true;
+				}
+			}
+			if(i>0 &&
+			   !fixedFrameId_.empty() &&
+			   cloudMsgs[0]->header.stamp != cloudMsgs[i]->header.stamp)
+			{
+				// approx sync
+				rtabmap::Transform cloudDisplacement = rtabmap_ros::getTransform(
+						frameId, //sourceTargetFrame
+						fixedFrameId_, //fixedFrame
+						cloudMsgs[i]->header.stamp, //stampSource
+						cloudMsgs[0]->header.stamp, //stampTarget
+						tfListener_,
+						waitForTransformDuration_);
+				if(!cloudDisplacement.isNull())
+				{
+					transforms[i] = transforms[i].isNull()?cloudDisplacement:cloudDisplacement*transforms[i];
+				}
+			}
+		}
+
+		// Split clouds in blocks of similar size to balance the threads
+		const size_t blockSize = 32768;
+		std::vector<CloudsCombiner::Block> blocks;
+		size_t outIndex = 0;
+		for(size_t i=0; i<cloudMsgs.size(); ++i)
+		{
+			size_t points = cloudMsgs[i]->width*cloudMsgs[i]->height;
+			for(size_t begin=0; begin<points; begin+=blockSize)
+			{
+				CloudsCombiner::Block block;
+				block.cloud = i;
+				block.begin = begin;
+				block.end = std::min(begin+blockSize, points);
+				block.outIndex = outIndex;
+				block.written = 0;
+				outIndex += block.end - block.begin;
+				blocks.push_back(block);
+			}
+		}
+
+		sensor_msgs::PointCloud2Ptr output(new sensor_msgs::PointCloud2);
+		output->fields = ref.fields;
+		output->point_step = ref.point_step;
+		output->is_bigendian = ref.is_bigendian;
+		output->data.resize(totalPoints*ref.point_step);
+
+		cv::parallel_for_(cv::Range(0, blocks.size()),
+				CloudsCombiner(cloudMsgs, transforms, xOffset, yOffset, zOffset, normalOffset, blocks, output->data.data()));
+
+		// Compact blocks in which invalid points have been skipped
+		size_t written = 0;
+		for(size_t i=0; i<blocks.size(); ++i)
+		{
+			if(written != blocks[i].outIndex && blocks[i].written)
+			{
+				memmove(&output->data[written*ref.point_step],
+						&output->data[blocks[i].outIndex*ref.point_step],
+						blocks[i].written*ref.point_step);
+			}
+			written += blocks[i].written;
+		}
+		output->data.resize(written*ref.point_step);
+		output->height = 1;
+		output->width = written;
+		output->row_step = output->width * output->point_step;
+		output->is_dense = true;
+		output->header.stamp = cloudMsgs[0]->header.stamp;
+		output->header.frame_id = frameId;
+		cloudPub_.publish(output);
+		diagnostics_.tickOutput(output->header.stamp);
+		return true;
+	}
+
 	void combineClouds(const std::vector<sensor_msgs::PointCloud2ConstPtr> & cloudMsgs)
 	{
+		NodeletDiagnostics::ScopedTimer timer(diagnostics_);
+		diagnostics_.tickInput(cloudMsgs[0]->header);
 		callbackCalled_ = true;
 		ROS_ASSERT(cloudMsgs.size() > 1);
 		if(cloudPub_.getNumSubscribers())
 		{
+			if(combineCloudsDirect(cloudMsgs, frameId_.empty()?cloudMsgs[0]->header.frame_id:frameId_))
+			{
+				return;
+			}
+
 			pcl::PCLPointCloud2::Ptr output(new pcl::PCLPointCloud2);
 
 			std::string frameId = frameId_;
@@ -232,6 +534,11 @@ private:
 				pcl_conversions::toPCL(*cloudMsgs[0], *output);
 				frameId = cloudMsgs[0]->header.frame_id;
 			}
+			if(!output->is_dense)
+			{
+				// remove nans, like for the other clouds
+				output = rtabmap::util3d::removeNaNFromPointCloud(output);
+			}
 
 			for(unsigned int i=1; i<cloudMsgs.size(); ++i)
 			{
@@ -302,6 +609,7 @@ private:
 			rosCloud.header.stamp = cloudMsgs[0]->header.stamp;
 			rosCloud.header.frame_id = frameId;
 			cloudPub_.publish(rosCloud);
+			diagnostics_.tickOutput(rosCloud.header.stamp);
 		}
 	}
 
@@ -344,7 +652,13 @@ private:
 	message_filters::Subscriber<sensor_msgs::PointCloud2> cloudSub_3_;
 	message_filters::Subscriber<sensor_msgs::PointCloud2> cloudSub_4_;
 
+	// more than 4 clouds
+	std::vector<ros::Subscriber> cloudSubs_;
+	MessageSynchronizer cloudsSync_;
+	boost::mutex cloudsSyncMutex_;
+
 	ros::Publisher cloudPub_;
+	NodeletDiagnostics diagnostics_;
 
 	std::string frameId_;
 	std::string fixedFrameId_;
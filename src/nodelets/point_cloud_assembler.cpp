@@ -35,6 +35,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <pcl/io/pcd_io.h>
 #include <pcl/filters/voxel_grid.h>
 #include <pcl/filters/radius_outlier_removal.h>
+#include <pcl/common/io.h>
 
 #include <pcl_ros/transforms.h>
 
@@ -49,8 +50,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <rtabmap_ros/MsgConversion.h>
 #include <rtabmap_ros/OdomInfo.h>
+#include <rtabmap_ros/VoxelCloudMap.h>
+#include <rtabmap_ros/NodeletDiagnostics.h>
 #include <rtabmap/core/util3d.h>
 #include <rtabmap/core/util3d_filtering.h>
+#include <rtabmap/core/util3d_transforms.h>
+
+#include <deque>
 
 namespace rtabmap_ros
 {
@@ -62,6 +68,9 @@ namespace rtabmap_ros
  * If fixed_frame_id is set to "" (empty), the nodelet will subscribe to
  * an odom topic that should have the exact same stamp than to input cloud.
  * The output cloud has the same stamp and frame than the last assembled cloud.
+ * With incremental set (requires voxel_size), the clouds are kept in
+ * a voxel map in fixed_frame_id: only the new cloud is added and the
+ * oldest removed on each update instead of re-assembling the whole window.
  */
 class PointCloudAssembler : public nodelet::Nodelet
 {
@@ -85,8 +94,10 @@ public:
 		noiseRadius_(0),
 		noiseMinNeighbors_(5),
 		removeZ_(false),
+		incremental_(false),
 		fixedFrameId_("odom"),
-		frameId_("")
+		frameId_(""),
+		incrementalId_(0)
 	{}
 
 	virtual ~PointCloudAssembler()
@@ -127,6 +138,7 @@ private:
 		pnh.param("noise_radius", noiseRadius_, noiseRadius_);
 		pnh.param("noise_min_neighbors", noiseMinNeighbors_, noiseMinNeighbors_);
 		pnh.param("remove_z", removeZ_, removeZ_);
+		pnh.param("incremental", incremental_, incremental_);
 		pnh.param("subscribe_odom_info", subscribeOdomInfo, subscribeOdomInfo);
 
 		ROS_INFO("%s: queue_size=%d", getName().c_str(), queueSize);
@@ -145,6 +157,7 @@ private:
 		ROS_INFO("%s: noise_radius=%fm", getName().c_str(), noiseRadius_);
 		ROS_INFO("%s: noise_min_neighbors=%d", getName().c_str(), noiseMinNeighbors_);
 		ROS_INFO("%s: remove_z=%s", getName().c_str(), removeZ_?"true":"false");
+		ROS_INFO("%s: incremental=%s", getName().c_str(), incremental_?"true":"false");
 
 		if(maxClouds_==0 && assemblingTime_ ==0.0)
 		{
@@ -152,6 +165,28 @@ private:
 			exit(-1);
 		}
 
+		if(incremental_)
+		{
+			if(voxelSize_ <= 0.0)
+			{
+				ROS_WARN("%s: incremental assembling requires voxel_size > 0, disabling it.", getName().c_str());
+				incremental_ = false;
+			}
+			else
+			{
+				if(!circularBuffer_)
+				{
+					ROS_INFO("%s: incremental assembling implies circular_buffer=true.", getName().c_str());
+					circularBuffer_ = true;
+				}
+				if(noiseRadius_>0.0 && noiseMinNeighbors_>0)
+				{
+					ROS_WARN("%s: noise_radius is ignored with incremental assembling.", getName().c_str());
+				}
+				voxelMap_.setVoxelSize(voxelSize_);
+			}
+		}
+
 		cloudsSkipped_ = skipClouds_;
 
 		std::string subscribedTopicsMsg;
@@ -192,6 +227,7 @@ private:
 		}
 
 		cloudPub_ = nh.advertise<sensor_msgs::PointCloud2>("assembled_cloud", 1);
+		diagnostics_.init(nh, pnh, getName());
 
 		NODELET_INFO("%s", subscribedTopicsMsg.c_str());
 	}
@@ -210,7 +246,7 @@ private:
 		else
 		{
 			NODELET_WARN("Reseting point cloud assembler as null odometry has been received.");
-			clouds_.clear();
+			clearClouds();
 		}
 	}
 
@@ -236,10 +272,17 @@ private:
 		else
 		{
 			NODELET_WARN("Reseting point cloud assembler as null odometry has been received.");
-			clouds_.clear();
+			clearClouds();
 		}
 	}
 
+	void clearClouds()
+	{
+		clouds_.clear();
+		voxelMap_.clear();
+		window_.clear();
+	}
+
 	sensor_msgs::PointCloud2 removeField(const sensor_msgs::PointCloud2 & input, const std::string & field)
 	{
 		sensor_msgs::PointCloud2 output;
@@ -286,6 +329,8 @@ private:
 
 	void callbackCloud(const sensor_msgs::PointCloud2ConstPtr & cloudMsg)
 	{
+		NodeletDiagnostics::ScopedTimer timer(diagnostics_);
+		diagnostics_.tickInput(cloudMsg->header);
 		if(cloudPub_.getNumSubscribers())
 		{
 			UASSERT_MSG(cloudMsg->data.size() == cloudMsg->row_step*cloudMsg->height,
@@ -305,7 +350,7 @@ private:
 				if(pose.isNull())
 				{
 					ROS_ERROR("Cloud not transform all clouds! Resetting...");
-					clouds_.clear();
+					clearClouds();
 					return;
 				}
 
@@ -351,6 +396,12 @@ private:
 					newCloud = rtabmap::util3d::removeNaNFromPointCloud(newCloud);
 				}
 
+				if(incremental_)
+				{
+					assembleIncremental(cloudMsg, newCloud, pose, isMoving);
+					return;
+				}
+
 				clouds_.push_back(newCloud);
 
 #if PCL_VERSION_COMPARE(>=, 1, 10, 0)
@@ -423,7 +474,7 @@ private:
 						if(t.isNull())
 						{
 							ROS_ERROR("Cloud not transform back assembled clouds in target frame \"%s\"! Resetting...", frameId_.c_str());
-							clouds_.clear();
+							clearClouds();
 							return;
 						}
 					}
@@ -440,6 +491,7 @@ private:
 						rosCloud.header.frame_id = frameId_;
 					}
 					cloudPub_.publish(rosCloud);
+					diagnostics_.tickOutput(rosCloud.header.stamp);
 					if(circularBuffer_)
 					{
 						if(!isMoving)
@@ -457,7 +509,7 @@ private:
 					}
 					else
 					{
-						clouds_.clear();
+						clearClouds();
 						previousPose_.setNull();
 					}
 				}
@@ -477,6 +529,105 @@ private:
 		}
 	}
 
+	void assembleIncremental(
+			const sensor_msgs::PointCloud2ConstPtr & cloudMsg,
+			const pcl::PCLPointCloud2::Ptr & newCloud,
+			const rtabmap::Transform & pose,
+			bool isMoving)
+	{
+		bool hasRgb = false;
+		for(size_t i=0; i<newCloud->fields.size(); ++i)
+		{
+			if(newCloud->fields[i].name.compare("rgb") == 0 || newCloud->fields[i].name.compare("rgba") == 0)
+			{
+				hasRgb = true;
+				break;
+			}
+		}
+		pcl::PointCloud<pcl::PointXYZRGB> cloud;
+		if(hasRgb)
+		{
+			pcl::fromPCLPointCloud2(*newCloud, cloud);
+		}
+		else
+		{
+			pcl::PointCloud<pcl::PointXYZ> cloudXYZ;
+			pcl::fromPCLPointCloud2(*newCloud, cloudXYZ);
+			pcl::copyPointCloud(cloudXYZ, cloud);
+		}
+
+		double stamp = cloudMsg->header.stamp.toSec();
+		int id = ++incrementalId_;
+		voxelMap_.addNode(id, cloud);
+		window_.push_back(std::make_pair(id, stamp));
+
+		rtabmap::Transform t = pose;
+		if(!frameId_.empty())
+		{
+			// transform in target frame_id instead of sensor frame
+			t = rtabmap_ros::getTransform(
+					fixedFrameId_, //fromFrame
+					frameId_, //toFrame
+					cloudMsg->header.stamp,
+					tfListener_,
+					waitForTransformDuration_);
+			if(t.isNull())
+			{
+				ROS_ERROR("Cloud not transform back assembled clouds in target frame \"%s\"! Resetting...", frameId_.c_str());
+				clearClouds();
+				return;
+			}
+		}
+
+		pcl::PointCloud<pcl::PointXYZRGB>::Ptr assembled(new pcl::PointCloud<pcl::PointXYZRGB>);
+		voxelMap_.getCloud(*assembled);
+		assembled = rtabmap::util3d::transformPointCloud(assembled, t.inverse());
+
+		sensor_msgs::PointCloud2 rosCloud;
+		if(hasRgb)
+		{
+			pcl::toROSMsg(*assembled, rosCloud);
+		}
+		else
+		{
+			pcl::PointCloud<pcl::PointXYZ> assembledXYZ;
+			pcl::copyPointCloud(*assembled, assembledXYZ);
+			pcl::toROSMsg(assembledXYZ, rosCloud);
+		}
+
+		if(removeZ_)
+		{
+			rosCloud = removeField(rosCloud, "z");
+		}
+
+		rosCloud.header = cloudMsg->header;
+		if(!frameId_.empty())
+		{
+			rosCloud.header.frame_id = frameId_;
+		}
+		cloudPub_.publish(rosCloud);
+		diagnostics_.tickOutput(rosCloud.header.stamp);
+
+		if(!isMoving)
+		{
+			voxelMap_.removeNode(id);
+			window_.pop_back();
+		}
+		else
+		{
+			previousPose_ = pose;
+			// Remove the oldest clouds out of the window, the next
+			// cloud will be added to a window of max_clouds-1 clouds
+			while(!window_.empty() &&
+				((maxClouds_ > 0 && (int)window_.size() >= maxClouds_) ||
+				 (assemblingTime_ > 0.0 && stamp >= window_.front().second + assemblingTime_)))
+			{
+				voxelMap_.removeNode(window_.front().first);
+				window_.pop_front();
+			}
+		}
+	}
+
 	void warningLoop(const std::string & subscribedTopicsMsg)
 	{
 		ros::Duration r(5.0);
@@ -500,6 +651,7 @@ private:
 
 	ros::Subscriber cloudSub_;
 	ros::Publisher cloudPub_;
+	NodeletDiagnostics diagnostics_;
 
 	typedef message_filters::sync_policies::ExactTime<sensor_msgs::PointCloud2, nav_msgs::Odometry> syncPolicy;
 	typedef message_filters::sync_policies::ExactTime<sensor_msgs::PointCloud2, nav_msgs::Odometry, rtabmap_ros::OdomInfo> syncInfoPolicy;
@@ -523,12 +675,18 @@ private:
 	double noiseRadius_;
 	int noiseMinNeighbors_;
 	bool removeZ_;
+	bool incremental_;
 	std::string fixedFrameId_;
 	std::string frameId_;
 	tf::TransformListener tfListener_;
 	rtabmap::Transform previousPose_;
 
 	std::list<pcl::PCLPointCloud2::Ptr> clouds_;
+
+	// incremental assembling
+	VoxelCloudMap voxelMap_;
+	std::deque<std::pair<int, double> > window_; // <id, stamp>, oldest first
+	int incrementalId_;
 };
 
 PLUGINLIB_EXPORT_CLASS(rtabmap_ros::PointCloudAssembler, nodelet::Nodelet);
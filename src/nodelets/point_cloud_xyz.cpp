@@ -30,6 +30,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <nodelet/nodelet.h>
 
 #include <rtabmap_ros/MsgConversion.h>
+#include <rtabmap_ros/DepthUndistorter.h>
+#include <rtabmap_ros/NodeletDiagnostics.h>
+#include <rtabmap_ros/LazySubscription.h>
 
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
@@ -115,6 +118,19 @@ private:
 		pnh.param("normal_radius", normalRadius_, normalRadius_);
 		pnh.param("filter_nans", filterNaNs_, filterNaNs_);
 		pnh.param("roi_ratios", roiStr, roiStr);
+		std::string depthDistortionModel;
+		pnh.param("depth_distortion_model", depthDistortionModel, depthDistortionModel);
+		if(!depthDistortionModel.empty())
+		{
+			if(depthUndistorter_.load(depthDistortionModel))
+			{
+				NODELET_INFO("point_cloud_xyz: depth images are undistorted with model \"%s\"", depthDistortionModel.c_str());
+			}
+			else
+			{
+				NODELET_ERROR("point_cloud_xyz: Loaded distortion model from \"%s\" is not valid!", depthDistortionModel.c_str());
+			}
+		}
 
 		// Deprecated
 		if(pnh.hasParam("cut_left"))
@@ -184,6 +200,20 @@ private:
 			exactSyncDisparity_->registerCallback(boost::bind(&PointCloudXYZ::callbackDisparity, this, _1, _2));
 		}
 
+		lazy_.init(pnh, getName(),
+				boost::bind(&PointCloudXYZ::subscribeInputs, this),
+				boost::bind(&PointCloudXYZ::unsubscribeInputs, this));
+
+		cloudPub_ = nh.advertise<sensor_msgs::PointCloud2>("cloud", 1, lazy_.connectCallback(), lazy_.connectCallback());
+		lazy_.addOutput(cloudPub_);
+		diagnostics_.init(nh, pnh, getName());
+		lazy_.start();
+	}
+
+	void subscribeInputs()
+	{
+		ros::NodeHandle & nh = getNodeHandle();
+		ros::NodeHandle & pnh = getPrivateNodeHandle();
 		ros::NodeHandle depth_nh(nh, "depth");
 		ros::NodeHandle depth_pnh(pnh, "depth");
 		image_transport::ImageTransport depth_it(depth_nh);
@@ -194,14 +224,22 @@ private:
 
 		disparitySub_.subscribe(nh, "disparity/image", 1);
 		disparityCameraInfoSub_.subscribe(nh, "disparity/camera_info", 1);
+	}
 
-		cloudPub_ = nh.advertise<sensor_msgs::PointCloud2>("cloud", 1);
+	void unsubscribeInputs()
+	{
+		imageDepthSub_.unsubscribe();
+		cameraInfoSub_.unsubscribe();
+		disparitySub_.unsubscribe();
+		disparityCameraInfoSub_.unsubscribe();
 	}
 
 	void callback(
 			  const sensor_msgs::ImageConstPtr& depth,
 			  const sensor_msgs::CameraInfoConstPtr& cameraInfo)
 	{
+		NodeletDiagnostics::ScopedTimer timer(diagnostics_);
+		diagnostics_.tickInput(depth->header);
 		if(depth->encoding.compare(sensor_msgs::image_encodings::TYPE_16UC1)!=0 &&
 		   depth->encoding.compare(sensor_msgs::image_encodings::TYPE_32FC1)!=0 &&
 		   depth->encoding.compare(sensor_msgs::image_encodings::MONO16)!=0)
@@ -215,7 +253,22 @@ private:
 			ros::WallTime time = ros::WallTime::now();
 
 			cv_bridge::CvImageConstPtr imageDepthPtr = cv_bridge::toCvShare(depth);
-			cv::Rect roi = rtabmap::util2d::computeRoi(imageDepthPtr->image, roiRatios_);
+			cv::Mat depthMat = imageDepthPtr->image;
+			if(depthUndistorter_.isValid())
+			{
+				if(depthMat.cols == depthUndistorter_.width() && depthMat.rows == depthUndistorter_.height())
+				{
+					depthMat = depthUndistorter_.undistort(depthMat);
+				}
+				else
+				{
+					NODELET_ERROR("Input depth image size (%dx%d) and distortion model "
+							"size (%dx%d) don't match! Cannot undistort image.",
+							depthMat.cols, depthMat.rows,
+							depthUndistorter_.width(), depthUndistorter_.height());
+				}
+			}
+			cv::Rect roi = rtabmap::util2d::computeRoi(depthMat, roiRatios_);
 
 			image_geometry::PinholeCameraModel model;
 			model.fromCameraInfo(*cameraInfo);
@@ -224,18 +277,37 @@ private:
 			rtabmap::CameraModel m(
 					model.fx(),
 					model.fy(),
-					model.cx()-roiRatios_[0]*double(imageDepthPtr->image.cols),
-					model.cy()-roiRatios_[2]*double(imageDepthPtr->image.rows));
+					model.cx()-roiRatios_[0]*double(depthMat.cols),
+					model.cy()-roiRatios_[2]*double(depthMat.rows));
 
-			pcl::IndicesPtr indices(new std::vector<int>);
-			pclCloud = rtabmap::util3d::cloudFromDepth(
-					cv::Mat(imageDepthPtr->image, roi),
-					m,
-					decimation_,
-					maxDepth_,
-					minDepth_,
-					indices.get());
-			processAndPublish(pclCloud, indices, depth->header);
+			if(!isFilteringPcl())
+			{
+				// project directly in the published message
+				sensor_msgs::PointCloud2 rosCloud;
+				rtabmap_ros::depthToPointCloud2Msg(
+						cv::Mat(depthMat, roi),
+						m,
+						decimation_,
+						minDepth_,
+						maxDepth_,
+						filterNaNs_,
+						rosCloud);
+				rosCloud.header = depth->header;
+				cloudPub_.publish(rosCloud);
+				diagnostics_.tickOutput(rosCloud.header.stamp);
+			}
+			else
+			{
+				pcl::IndicesPtr indices(new std::vector<int>);
+				pclCloud = rtabmap::util3d::cloudFromDepth(
+						cv::Mat(depthMat, roi),
+						m,
+						decimation_,
+						maxDepth_,
+						minDepth_,
+						indices.get());
+				processAndPublish(pclCloud, indices, depth->header);
+			}
 
 			NODELET_DEBUG("point_cloud_xyz from depth time = %f s", (ros::WallTime::now() - time).toSec());
 		}
@@ -245,6 +317,8 @@ private:
 			const stereo_msgs::DisparityImageConstPtr& disparityMsg,
 			const sensor_msgs::CameraInfoConstPtr& cameraInfo)
 	{
+		NodeletDiagnostics::ScopedTimer timer(diagnostics_);
+		diagnostics_.tickInput(disparityMsg->header);
 		if(disparityMsg->image.encoding.compare(sensor_msgs::image_encodings::TYPE_32FC1) !=0 &&
 		   disparityMsg->image.encoding.compare(sensor_msgs::image_encodings::TYPE_16SC1) !=0)
 		{
@@ -286,6 +360,15 @@ private:
 		}
 	}
 
+	// Voxel, noise and normals filtering need a PCL cloud
+	bool isFilteringPcl() const
+	{
+		return voxelSize_ > 0.0 ||
+			   (noiseFilterRadius_ > 0.0 && noiseFilterMinNeighbors_ > 0) ||
+			   normalK_ > 0 ||
+			   normalRadius_ > 0.0;
+	}
+
 	void processAndPublish(pcl::PointCloud<pcl::PointXYZ>::Ptr & pclCloud, pcl::IndicesPtr & indices, const std_msgs::Header & header)
 	{
 		if(indices->size() && voxelSize_ > 0.0)
@@ -336,6 +419,7 @@ private:
 
 		//publish the message
 		cloudPub_.publish(rosCloud);
+		diagnostics_.tickOutput(rosCloud.header.stamp);
 	}
 
 private:
@@ -350,8 +434,11 @@ private:
 	double normalRadius_;
 	bool filterNaNs_;
 	std::vector<float> roiRatios_;
+	DepthUndistorter depthUndistorter_;
 
 	ros::Publisher cloudPub_;
+	NodeletDiagnostics diagnostics_;
+	LazySubscription lazy_;
 
 	image_transport::SubscriberFilter imageDepthSub_;
 	message_filters::Subscriber<sensor_msgs::CameraInfo> cameraInfoSub_;
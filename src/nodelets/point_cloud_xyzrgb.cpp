@@ -34,6 +34,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <pcl_conversions/pcl_conversions.h>
 
 #include <rtabmap_ros/MsgConversion.h>
+#include <rtabmap_ros/NodeletDiagnostics.h>
+#include <rtabmap_ros/LazySubscription.h>
+#include <rtabmap_ros/StereoCloudGenerator.h>
 
 #include <sensor_msgs/PointCloud2.h>
 #include <sensor_msgs/Image.h>
@@ -78,6 +81,7 @@ public:
 		normalK_(0),
 		normalRadius_(0.0),
 		filterNaNs_(false),
+		stereoStripes_(0),
 		approxSyncDepth_(0),
 		approxSyncDisparity_(0),
 		approxSyncStereo_(0),
@@ -123,6 +127,7 @@ private:
 		pnh.param("normal_radius", normalRadius_, normalRadius_);
 		pnh.param("filter_nans", filterNaNs_, filterNaNs_);
 		pnh.param("roi_ratios", roiStr, roiStr);
+		pnh.param("stereo_stripes", stereoStripes_, stereoStripes_);
 
 		//parse roi (region of interest)
 		roiRatios_.resize(4, 0);
@@ -187,11 +192,19 @@ private:
 			}
 		}
 
+		stereoCloudGenerator_.setParameters(stereoBMParameters_);
+		stereoCloudGenerator_.setStripes(stereoStripes_);
+
 		NODELET_INFO("Approximate time sync = %s", approxSync?"true":"false");
+		NODELET_INFO("point_cloud_xyzrgb: stereo_stripes = %d", stereoStripes_);
 
-		cloudPub_ = nh.advertise<sensor_msgs::PointCloud2>("cloud", 1);
+		lazy_.init(pnh, getName(),
+				boost::bind(&PointCloudXYZRGB::subscribeInputs, this),
+				boost::bind(&PointCloudXYZRGB::unsubscribeInputs, this));
 
-		rgbdImageSub_ = nh.subscribe("rgbd_image", 1, &PointCloudXYZRGB::rgbdImageCallback, this);
+		cloudPub_ = nh.advertise<sensor_msgs::PointCloud2>("cloud", 1, lazy_.connectCallback(), lazy_.connectCallback());
+		lazy_.addOutput(cloudPub_);
+		diagnostics_.init(nh, pnh, getName());
 
 		if(approxSync)
 		{
@@ -217,6 +230,16 @@ private:
 			exactSyncStereo_->registerCallback(boost::bind(&PointCloudXYZRGB::stereoCallback, this, _1, _2, _3, _4));
 		}
 
+		lazy_.start();
+	}
+
+	void subscribeInputs()
+	{
+		ros::NodeHandle & nh = getNodeHandle();
+		ros::NodeHandle & pnh = getPrivateNodeHandle();
+
+		rgbdImageSub_ = nh.subscribe("rgbd_image", 1, &PointCloudXYZRGB::rgbdImageCallback, this);
+
 		ros::NodeHandle rgb_nh(nh, "rgb");
 		ros::NodeHandle depth_nh(nh, "depth");
 		ros::NodeHandle rgb_pnh(pnh, "rgb");
@@ -247,11 +270,26 @@ private:
 		cameraInfoRight_.subscribe(right_nh, "camera_info", 1);
 	}
 
+	void unsubscribeInputs()
+	{
+		rgbdImageSub_.shutdown();
+		imageSub_.unsubscribe();
+		imageDepthSub_.unsubscribe();
+		cameraInfoSub_.unsubscribe();
+		imageDisparitySub_.unsubscribe();
+		imageLeft_.unsubscribe();
+		imageRight_.unsubscribe();
+		cameraInfoLeft_.unsubscribe();
+		cameraInfoRight_.unsubscribe();
+	}
+
 	void depthCallback(
 			  const sensor_msgs::ImageConstPtr& image,
 			  const sensor_msgs::ImageConstPtr& imageDepth,
 			  const sensor_msgs::CameraInfoConstPtr& cameraInfo)
 	{
+		NodeletDiagnostics::ScopedTimer timer(diagnostics_);
+		diagnostics_.tickInput(image->header);
 		if(!(image->encoding.compare(sensor_msgs::image_encodings::TYPE_8UC1) ==0 ||
 			image->encoding.compare(sensor_msgs::image_encodings::MONO8) ==0 ||
 			image->encoding.compare(sensor_msgs::image_encodings::MONO16) == 0 ||
@@ -303,18 +341,37 @@ private:
 					model.fy(),
 					model.cx()-roiRatios_[0]*double(imageDepthPtr->image.cols),
 					model.cy()-roiRatios_[2]*double(imageDepthPtr->image.rows));
-			pcl::IndicesPtr indices(new std::vector<int>);
-			pclCloud = rtabmap::util3d::cloudFromDepthRGB(
-					cv::Mat(imagePtr->image, roi),
-					cv::Mat(imageDepthPtr->image, roi),
-					m,
-					decimation_,
-					maxDepth_,
-					minDepth_,
-					indices.get());
-
+			if(!isFilteringPcl())
+			{
+				// project directly in the published message
+				sensor_msgs::PointCloud2 rosCloud;
+				rtabmap_ros::depthToPointCloud2Msg(
+						cv::Mat(imageDepthPtr->image, roi),
+						m,
+						decimation_,
+						minDepth_,
+						maxDepth_,
+						filterNaNs_,
+						rosCloud,
+						cv::Mat(imagePtr->image, roi));
+				rosCloud.header = imagePtr->header;
+				cloudPub_.publish(rosCloud);
+				diagnostics_.tickOutput(rosCloud.header.stamp);
+			}
+			else
+			{
+				pcl::IndicesPtr indices(new std::vector<int>);
+				pclCloud = rtabmap::util3d::cloudFromDepthRGB(
+						cv::Mat(imagePtr->image, roi),
+						cv::Mat(imageDepthPtr->image, roi),
+						m,
+						decimation_,
+						maxDepth_,
+						minDepth_,
+						indices.get());
 
-			processAndPublish(pclCloud, indices, imagePtr->header);
+				processAndPublish(pclCloud, indices, imagePtr->header);
+			}
 
 			NODELET_DEBUG("point_cloud_xyzrgb from RGB-D time = %f s", (ros::WallTime::now() - time).toSec());
 		}
@@ -325,6 +382,8 @@ private:
 			const stereo_msgs::DisparityImageConstPtr& imageDisparity,
 			const sensor_msgs::CameraInfoConstPtr& cameraInfo)
 	{
+		NodeletDiagnostics::ScopedTimer timer(diagnostics_);
+		diagnostics_.tickInput(image->header);
 		cv_bridge::CvImageConstPtr imagePtr;
 		if(image->encoding.compare(sensor_msgs::image_encodings::TYPE_8UC1)==0)
 		{
@@ -387,6 +446,8 @@ private:
 			const sensor_msgs::CameraInfoConstPtr& camInfoLeft,
 			const sensor_msgs::CameraInfoConstPtr& camInfoRight)
 	{
+		NodeletDiagnostics::ScopedTimer timer(diagnostics_);
+		diagnostics_.tickInput(imageLeft->header);
 		if(!(imageLeft->encoding.compare(sensor_msgs::image_encodings::MONO8) == 0 ||
 				imageLeft->encoding.compare(sensor_msgs::image_encodings::MONO16) == 0 ||
 				imageLeft->encoding.compare(sensor_msgs::image_encodings::BGR8) == 0 ||
@@ -416,22 +477,38 @@ private:
 			}
 			ptrRightImage = cv_bridge::toCvShare(imageRight, "mono8");
 
-			if(roiRatios_[0]!=0.0f || roiRatios_[1]!=0.0f || roiRatios_[2]!=0.0f || roiRatios_[3]!=0.0f)
+			pcl::PointCloud<pcl::PointXYZRGB>::Ptr pclCloud;
+			pcl::IndicesPtr indices(new std::vector<int>);
+			if(stereoStripes_ > 0)
 			{
-				ROS_WARN("\"roi_ratios\" set but ignored for stereo images.");
+				// decimated, cropped and matched by stripes in parallel
+				pclCloud = stereoCloudGenerator_.generate(
+						ptrLeftImage->image,
+						ptrRightImage->image,
+						rtabmap_ros::stereoCameraModelFromROS(*camInfoLeft, *camInfoRight),
+						decimation_,
+						maxDepth_,
+						minDepth_,
+						roiRatios_,
+						*indices);
 			}
+			else
+			{
+				if(roiRatios_[0]!=0.0f || roiRatios_[1]!=0.0f || roiRatios_[2]!=0.0f || roiRatios_[3]!=0.0f)
+				{
+					ROS_WARN("\"roi_ratios\" set but ignored for stereo images (set \"stereo_stripes\" > 0 to use it).");
+				}
 
-			pcl::PointCloud<pcl::PointXYZRGB>::Ptr pclCloud;
-			pcl::IndicesPtr indices(new std::vector<int>);
-			pclCloud = rtabmap::util3d::cloudFromStereoImages(
-					ptrLeftImage->image,
-					ptrRightImage->image,
-					rtabmap_ros::stereoCameraModelFromROS(*camInfoLeft, *camInfoRight),
-					decimation_,
-					maxDepth_,
-					minDepth_,
-					indices.get(),
-					stereoBMParameters_);
+				pclCloud = rtabmap::util3d::cloudFromStereoImages(
+						ptrLeftImage->image,
+						ptrRightImage->image,
+						rtabmap_ros::stereoCameraModelFromROS(*camInfoLeft, *camInfoRight),
+						decimation_,
+						maxDepth_,
+						minDepth_,
+						indices.get(),
+						stereoBMParameters_);
+			}
 
 			processAndPublish(pclCloud, indices, imageLeft->header);
 
@@ -441,6 +518,8 @@ private:
 
 	void rgbdImageCallback(const rtabmap_ros::RGBDImageConstPtr & image)
 	{
+		NodeletDiagnostics::ScopedTimer timer(diagnostics_);
+		diagnostics_.tickInput(image->header);
 		if(cloudPub_.getNumSubscribers())
 		{
 			ros::WallTime time = ros::WallTime::now();
@@ -465,6 +544,15 @@ private:
 		}
 	}
 
+	// Voxel, noise and normals filtering need a PCL cloud
+	bool isFilteringPcl() const
+	{
+		return voxelSize_ > 0.0 ||
+			   (noiseFilterRadius_ > 0.0 && noiseFilterMinNeighbors_ > 0) ||
+			   normalK_ > 0 ||
+			   normalRadius_ > 0.0;
+	}
+
 	void processAndPublish(pcl::PointCloud<pcl::PointXYZRGB>::Ptr & pclCloud, pcl::IndicesPtr & indices, const std_msgs::Header & header)
 	{
 		if(indices->size() && voxelSize_ > 0.0)
@@ -515,6 +603,7 @@ private:
 
 		//publish the message
 		cloudPub_.publish(rosCloud);
+		diagnostics_.tickOutput(rosCloud.header.stamp);
 	}
 
 private:
@@ -530,8 +619,12 @@ private:
 	bool filterNaNs_;
 	std::vector<float> roiRatios_;
 	rtabmap::ParametersMap stereoBMParameters_;
+	int stereoStripes_;
+	StereoCloudGenerator stereoCloudGenerator_;
 
 	ros::Publisher cloudPub_;
+	NodeletDiagnostics diagnostics_;
+	LazySubscription lazy_;
 
 	ros::Subscriber rgbdImageSub_;
 
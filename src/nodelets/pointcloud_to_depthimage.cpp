@@ -32,6 +32,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <ros/subscriber.h>
 
 #include <rtabmap_ros/MsgConversion.h>
+#include <rtabmap_ros/NodeletDiagnostics.h>
+#include <rtabmap_ros/LazySubscription.h>
 #include <rtabmap/core/util3d.h>
 #include <rtabmap/core/util2d.h>
 #include <rtabmap/utilite/ULogger.h>
@@ -52,9 +54,194 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <message_filters/sync_policies/exact_time.h>
 #include <message_filters/subscriber.h>
 
+#include <opencv2/core/core.hpp>
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
+#include <cstring>
+
 namespace rtabmap_ros
 {
 
+/**
+ * Project points of a cloud in a z-buffer shared by all threads. Depths
+ * are positive floats, so their bit patterns can be compared as unsigned
+ * integers and the closest depth of each pixel is kept with an atomic min.
+ */
+class ZBufferProjection : public cv::ParallelLoopBody
+{
+public:
+	ZBufferProjection(
+			const sensor_msgs::PointCloud2 & cloud,
+			int xOffset, int yOffset, int zOffset,
+			const rtabmap::Transform & cameraFromCloud,
+			const rtabmap::CameraModel & model,
+			boost::atomic<unsigned int> * zbuffer) :
+		cloud_(cloud),
+		xOffset_(xOffset),
+		yOffset_(yOffset),
+		zOffset_(zOffset),
+		t_(cameraFromCloud),
+		fx_(model.fx()),
+		fy_(model.fy()),
+		cx_(model.cx()),
+		cy_(model.cy()),
+		width_(model.imageWidth()),
+		height_(model.imageHeight()),
+		zbuffer_(zbuffer)
+	{}
+
+	virtual void operator()(const cv::Range & range) const
+	{
+		for(int i=range.start; i<range.end; ++i)
+		{
+			const unsigned char * data = &cloud_.data[(i/cloud_.width)*cloud_.row_step + (i%cloud_.width)*cloud_.point_step];
+			float x,y,z;
+			memcpy(&x, data+xOffset_, sizeof(float));
+			memcpy(&y, data+yOffset_, sizeof(float));
+			memcpy(&z, data+zOffset_, sizeof(float));
+			float pz = t_.r31()*x + t_.r32()*y + t_.r33()*z + t_.z();
+			if(!(pz > 0.0f)) // also rejects NaNs
+			{
+				continue;
+			}
+			float px = t_.r11()*x + t_.r12()*y + t_.r13()*z + t_.x();
+			float py = t_.r21()*x + t_.r22()*y + t_.r23()*z + t_.y();
+			float invZ = 1.0f/pz;
+			int u = int(fx_*px*invZ + cx_);
+			int v = int(fy_*py*invZ + cy_);
+			if(u>=0 && u<width_ && v>=0 && v<height_)
+			{
+				unsigned int depth;
+				memcpy(&depth, &pz, sizeof(float));
+				boost::atomic<unsigned int> & pixel = zbuffer_[v*width_+u];
+				unsigned int current = pixel.load(boost::memory_order_relaxed);
+				while(depth < current && !pixel.compare_exchange_weak(current, depth, boost::memory_order_relaxed))
+				{
+				}
+			}
+		}
+	}
+
+private:
+	const sensor_msgs::PointCloud2 & cloud_;
+	int xOffset_;
+	int yOffset_;
+	int zOffset_;
+	rtabmap::Transform t_;
+	float fx_;
+	float fy_;
+	float cx_;
+	float cy_;
+	int width_;
+	int height_;
+	boost::atomic<unsigned int> * zbuffer_;
+};
+
+/**
+ * Convert rows of the z-buffer to a depth image, in meters (CV_32FC1)
+ * or in mm (CV_16UC1). Empty pixels are set to 0.
+ */
+class ZBufferToDepth : public cv::ParallelLoopBody
+{
+public:
+	ZBufferToDepth(boost::atomic<unsigned int> * zbuffer, cv::Mat & depth) :
+		zbuffer_(zbuffer),
+		depth_(depth)
+	{}
+
+	virtual void operator()(const cv::Range & range) const
+	{
+		for(int v=range.start; v<range.end; ++v)
+		{
+			boost::atomic<unsigned int> * pixels = zbuffer_ + v*depth_.cols;
+			for(int u=0; u<depth_.cols; ++u)
+			{
+				unsigned int bits = pixels[u].load(boost::memory_order_relaxed);
+				float d = 0.0f;
+				if(bits != 0xFFFFFFFF)
+				{
+					memcpy(&d, &bits, sizeof(float));
+				}
+				if(depth_.type() == CV_32FC1)
+				{
+					depth_.at<float>(v,u) = d;
+				}
+				else
+				{
+					// same as util2d::cvtDepthFromFloat()
+					depth_.at<unsigned short>(v,u) = d>0.0f && d<=65.535f?(unsigned short)(d*1000.0f+0.5f):0;
+				}
+			}
+		}
+	}
+
+private:
+	boost::atomic<unsigned int> * zbuffer_;
+	cv::Mat & depth_;
+};
+
+/**
+ * Separable hole filling: holes of at most maxHoleSize pixels between
+ * two valid depths are linearly interpolated if the relative difference
+ * of these depths is below maxErrorRatio. Rows are filled first (in
+ * parallel), then columns.
+ */
+template<typename T>
+class DepthHolesFiller : public cv::ParallelLoopBody
+{
+public:
+	DepthHolesFiller(cv::Mat & depth, int maxHoleSize, float maxErrorRatio, bool columns) :
+		depth_(depth),
+		maxHoleSize_(maxHoleSize),
+		maxErrorRatio_(maxErrorRatio),
+		columns_(columns)
+	{}
+
+	virtual void operator()(const cv::Range & range) const
+	{
+		int length = columns_?depth_.rows:depth_.cols;
+		for(int line=range.start; line<range.end; ++line)
+		{
+			int previous = -1; // last valid pixel
+			for(int i=0; i<length; ++i)
+			{
+				T & d = at(line, i);
+				if(d == 0)
+				{
+					continue;
+				}
+				int hole = i - previous - 1;
+				if(previous>=0 && hole > 0 && hole <= maxHoleSize_)
+				{
+					float d1 = at(line, previous);
+					float d2 = d;
+					if(fabs(d2-d1)/std::min(d1, d2) <= maxErrorRatio_)
+					{
+						float slope = (d2-d1)/float(hole+1);
+						for(int j=1; j<=hole; ++j)
+						{
+							at(line, previous+j) = T(d1 + slope*float(j));
+						}
+					}
+				}
+				previous = i;
+			}
+		}
+	}
+
+private:
+	T & at(int line, int i) const
+	{
+		return columns_?depth_.at<T>(i, line):depth_.at<T>(line, i);
+	}
+
+private:
+	cv::Mat & depth_;
+	int maxHoleSize_;
+	float maxErrorRatio_;
+	bool columns_;
+};
+
 class PointCloudToDepthImage : public nodelet::Nodelet
 {
 public:
@@ -66,7 +253,8 @@ public:
 		fillIterations_(1),
 		decimation_(1),
 		approxSync_(0),
-		exactSync_(0)
+		exactSync_(0),
+		zbufferSize_(0)
 			{}
 
 	virtual ~PointCloudToDepthImage()
@@ -119,10 +307,18 @@ private:
 		ROS_INFO("  fill_iterations=%d", fillIterations_);
 		ROS_INFO("  decimation=%d", decimation_);
 
+		lazy_.init(pnh, getName(),
+				boost::bind(&PointCloudToDepthImage::subscribeInputs, this),
+				boost::bind(&PointCloudToDepthImage::unsubscribeInputs, this));
+
 		image_transport::ImageTransport it(nh);
-		depthImage16Pub_ = it.advertise("image_raw", 1); // 16 bits unsigned in mm
-		depthImage32Pub_ = it.advertise("image", 1);     // 32 bits float in meters
-		pointCloudTransformedPub_ = nh.advertise<sensor_msgs::PointCloud2>(nh.resolveName("cloud")+"_transformed", 1);
+		depthImage16Pub_ = it.advertise("image_raw", 1, lazy_.imageConnectCallback(), lazy_.imageConnectCallback()); // 16 bits unsigned in mm
+		depthImage32Pub_ = it.advertise("image", 1, lazy_.imageConnectCallback(), lazy_.imageConnectCallback());     // 32 bits float in meters
+		pointCloudTransformedPub_ = nh.advertise<sensor_msgs::PointCloud2>(nh.resolveName("cloud")+"_transformed", 1, lazy_.connectCallback(), lazy_.connectCallback());
+		lazy_.addOutput(depthImage16Pub_);
+		lazy_.addOutput(depthImage32Pub_);
+		lazy_.addOutput(pointCloudTransformedPub_);
+		diagnostics_.init(nh, pnh, getName());
 
 		if(approx)
 		{
@@ -136,14 +332,28 @@ private:
 			exactSync_->registerCallback(boost::bind(&PointCloudToDepthImage::callback, this, _1, _2));
 		}
 
+		lazy_.start();
+	}
+
+	void subscribeInputs()
+	{
+		ros::NodeHandle & nh = getNodeHandle();
 		pointCloudSub_.subscribe(nh, "cloud", 1);
 		cameraInfoSub_.subscribe(nh, "camera_info", 1);
 	}
 
+	void unsubscribeInputs()
+	{
+		pointCloudSub_.unsubscribe();
+		cameraInfoSub_.unsubscribe();
+	}
+
 	void callback(
 			const sensor_msgs::PointCloud2ConstPtr & pointCloud2Msg,
 			const sensor_msgs::CameraInfoConstPtr & cameraInfoMsg)
 	{
+		NodeletDiagnostics::ScopedTimer timer(diagnostics_);
+		diagnostics_.tickInput(pointCloud2Msg->header);
 		if(depthImage32Pub_.getNumSubscribers() > 0 || depthImage16Pub_.getNumSubscribers() > 0)
 		{
 			double cloudStamp = pointCloud2Msg->header.stamp.toSec();
@@ -201,25 +411,62 @@ private:
 			UASSERT_MSG(pointCloud2Msg->data.size() == pointCloud2Msg->row_step*pointCloud2Msg->height,
 					uFormat("data=%d row_step=%d height=%d", pointCloud2Msg->data.size(), pointCloud2Msg->row_step, pointCloud2Msg->height).c_str());
 
-			pcl::PCLPointCloud2::Ptr cloud(new pcl::PCLPointCloud2);
-			pcl_conversions::toPCL(*pointCloud2Msg, *cloud);
-
 			cv_bridge::CvImage depthImage;
+			// Only 16 bits image requested: project directly in mm
+			int type = depthImage32Pub_.getNumSubscribers()?CV_32FC1:CV_16UC1;
 
-			if(cloud->data.empty())
+			if(pointCloud2Msg->data.empty())
 			{
 				ROS_WARN("Received an empty cloud on topic \"%s\"! A depth image with all zeros is returned.", pointCloudSub_.getTopic().c_str());
-				depthImage.image = cv::Mat::zeros(model.imageSize(), CV_32FC1);
+				depthImage.image = cv::Mat::zeros(model.imageSize(), type);
 			}
 			else
 			{
-				depthImage.image = rtabmap::util3d::projectCloudToCamera(model.imageSize(), model.K(), cloud, model.localTransform());
+				int xOffset=-1, yOffset=-1, zOffset=-1;
+				for(size_t i=0; i<pointCloud2Msg->fields.size(); ++i)
+				{
+					const sensor_msgs::PointField & field = pointCloud2Msg->fields[i];
+					if(field.datatype == sensor_msgs::PointField::FLOAT32)
+					{
+						if(field.name.compare("x") == 0) xOffset = field.offset;
+						else if(field.name.compare("y") == 0) yOffset = field.offset;
+						else if(field.name.compare("z") == 0) zOffset = field.offset;
+					}
+				}
+
+				if(xOffset>=0 && yOffset>=0 && zOffset>=0 && !pointCloud2Msg->is_bigendian)
+				{
+					size_t pixels = model.imageWidth()*model.imageHeight();
+					if(zbufferSize_ != pixels)
+					{
+						zbuffer_.reset(new boost::atomic<unsigned int>[pixels]);
+						zbufferSize_ = pixels;
+					}
+					for(size_t i=0; i<pixels; ++i)
+					{
+						zbuffer_[i].store(0xFFFFFFFF, boost::memory_order_relaxed);
+					}
+					cv::parallel_for_(cv::Range(0, pointCloud2Msg->width*pointCloud2Msg->height),
+							ZBufferProjection(*pointCloud2Msg, xOffset, yOffset, zOffset, model.localTransform().inverse(), model, zbuffer_.get()));
+					depthImage.image = cv::Mat(model.imageSize(), type);
+					cv::parallel_for_(cv::Range(0, depthImage.image.rows), ZBufferToDepth(zbuffer_.get(), depthImage.image));
+				}
+				else
+				{
+					pcl::PCLPointCloud2::Ptr cloud(new pcl::PCLPointCloud2);
+					pcl_conversions::toPCL(*pointCloud2Msg, *cloud);
+					depthImage.image = rtabmap::util3d::projectCloudToCamera(model.imageSize(), model.K(), cloud, model.localTransform());
+					if(type == CV_16UC1)
+					{
+						depthImage.image = rtabmap::util2d::cvtDepthFromFloat(depthImage.image);
+					}
+				}
 
 				if(fillHolesSize_ > 0 && fillIterations_ > 0)
 				{
 					for(int i=0; i<fillIterations_;++i)
 					{
-						depthImage.image = rtabmap::util2d::fillDepthHoles(depthImage.image, fillHolesSize_, fillHolesError_);
+						fillDepthHoles(depthImage.image, fillHolesSize_, fillHolesError_);
 					}
 				}
 
@@ -243,9 +490,13 @@ private:
 			if(depthImage16Pub_.getNumSubscribers())
 			{
 				depthImage.encoding = sensor_msgs::image_encodings::TYPE_16UC1;
-				depthImage.image = rtabmap::util2d::cvtDepthFromFloat(depthImage.image);
+				if(depthImage.image.type() == CV_32FC1)
+				{
+					depthImage.image = rtabmap::util2d::cvtDepthFromFloat(depthImage.image);
+				}
 				depthImage16Pub_.publish(depthImage.toImageMsg());
 			}
+			diagnostics_.tickOutput(depthImage.header.stamp);
 
 			if( cloudStamp != pointCloud2Msg->header.stamp.toSec() ||
 				infoStamp != cameraInfoMsg->header.stamp.toSec())
@@ -260,10 +511,26 @@ private:
 		}
 	}
 
+	void fillDepthHoles(cv::Mat & depth, int maxHoleSize, float maxErrorRatio)
+	{
+		if(depth.type() == CV_32FC1)
+		{
+			cv::parallel_for_(cv::Range(0, depth.rows), DepthHolesFiller<float>(depth, maxHoleSize, maxErrorRatio, false));
+			cv::parallel_for_(cv::Range(0, depth.cols), DepthHolesFiller<float>(depth, maxHoleSize, maxErrorRatio, true));
+		}
+		else
+		{
+			cv::parallel_for_(cv::Range(0, depth.rows), DepthHolesFiller<unsigned short>(depth, maxHoleSize, maxErrorRatio, false));
+			cv::parallel_for_(cv::Range(0, depth.cols), DepthHolesFiller<unsigned short>(depth, maxHoleSize, maxErrorRatio, true));
+		}
+	}
+
 private:
 	image_transport::Publisher depthImage16Pub_;
 	image_transport::Publisher depthImage32Pub_;
 	ros::Publisher pointCloudTransformedPub_;
+	NodeletDiagnostics diagnostics_;
+	LazySubscription lazy_;
 	message_filters::Subscriber<sensor_msgs::PointCloud2> pointCloudSub_;
 	message_filters::Subscriber<sensor_msgs::CameraInfo> cameraInfoSub_;
 	std::string fixedFrameId_;
@@ -278,6 +545,9 @@ private:
 	message_filters::Synchronizer<MyApproxSyncPolicy> * approxSync_;
 	typedef message_filters::sync_policies::ExactTime<sensor_msgs::PointCloud2, sensor_msgs::CameraInfo> MyExactSyncPolicy;
 	message_filters::Synchronizer<MyExactSyncPolicy> * exactSync_;
+
+	boost::scoped_array<boost::atomic<unsigned int> > zbuffer_;
+	size_t zbufferSize_;
 };
 
 PLUGINLIB_EXPORT_CLASS(rtabmap_ros::PointCloudToDepthImage, nodelet::Nodelet);
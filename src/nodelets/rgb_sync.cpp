@@ -47,6 +47,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <boost/thread.hpp>
 
 #include "rtabmap_ros/RGBDImage.h"
+#include "rtabmap_ros/NodeletDiagnostics.h"
 
 #include "rtabmap/core/Compression.h"
 #include "rtabmap/utilite/UConversion.h"
@@ -98,6 +99,7 @@ private:
 
 		rgbdImagePub_ = nh.advertise<rtabmap_ros::RGBDImage>("rgbd_image", 1);
 		rgbdImageCompressedPub_ = nh.advertise<rtabmap_ros::RGBDImage>("rgbd_image/compressed", 1);
+		diagnostics_.init(nh, pnh, getName());
 
 		if(approxSync)
 		{
@@ -152,6 +154,8 @@ private:
 			  const sensor_msgs::CameraInfoConstPtr& cameraInfo)
 	{
 		callbackCalled_ = true;
+		NodeletDiagnostics::ScopedTimer timer(diagnostics_);
+		diagnostics_.tickInput(image->header);
 		if(rgbdImagePub_.getNumSubscribers() || rgbdImageCompressedPub_.getNumSubscribers())
 		{
 			double stamp = image->header.stamp.toSec();
@@ -191,6 +195,7 @@ private:
 				msg.rgb = *image;
 				rgbdImagePub_.publish(msg);
 			}
+			diagnostics_.tickOutput(msg.header.stamp);
 
 			if( stamp != image->header.stamp.toSec())
 			{
@@ -211,6 +216,7 @@ private:
 
 	ros::Publisher rgbdImagePub_;
 	ros::Publisher rgbdImageCompressedPub_;
+	NodeletDiagnostics diagnostics_;
 
 	image_transport::SubscriberFilter imageSub_;
 	message_filters::Subscriber<sensor_msgs::CameraInfo> cameraInfoSub_;
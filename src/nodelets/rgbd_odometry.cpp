@@ -497,8 +497,10 @@ private:
 			std::vector<cv_bridge::CvImageConstPtr> imageMsgs(2);
 			std::vector<cv_bridge::CvImageConstPtr> depthMsgs(2);
 			std::vector<sensor_msgs::CameraInfo> infoMsgs;
-			rtabmap_ros::toCvShare(image, imageMsgs[0], depthMsgs[0]);
-			rtabmap_ros::toCvShare(image2, imageMsgs[1], depthMsgs[1]);
+			std::vector<rtabmap_ros::RGBDImageConstPtr> rgbdMsgs;
+			rgbdMsgs.push_back(image);
+			rgbdMsgs.push_back(image2);
+			rtabmap_ros::toCvShare(rgbdMsgs, imageMsgs, depthMsgs);
 			infoMsgs.push_back(image->rgb_camera_info);
 			infoMsgs.push_back(image2->rgb_camera_info);
 
@@ -517,9 +519,11 @@ private:
 			std::vector<cv_bridge::CvImageConstPtr> imageMsgs(3);
 			std::vector<cv_bridge::CvImageConstPtr> depthMsgs(3);
 			std::vector<sensor_msgs::CameraInfo> infoMsgs;
-			rtabmap_ros::toCvShare(image, imageMsgs[0], depthMsgs[0]);
-			rtabmap_ros::toCvShare(image2, imageMsgs[1], depthMsgs[1]);
-			rtabmap_ros::toCvShare(image3, imageMsgs[2], depthMsgs[2]);
+			std::vector<rtabmap_ros::RGBDImageConstPtr> rgbdMsgs;
+			rgbdMsgs.push_back(image);
+			rgbdMsgs.push_back(image2);
+			rgbdMsgs.push_back(image3);
+			rtabmap_ros::toCvShare(rgbdMsgs, imageMsgs, depthMsgs);
 			infoMsgs.push_back(image->rgb_camera_info);
 			infoMsgs.push_back(image2->rgb_camera_info);
 			infoMsgs.push_back(image3->rgb_camera_info);
@@ -540,10 +544,12 @@ private:
 			std::vector<cv_bridge::CvImageConstPtr> imageMsgs(4);
 			std::vector<cv_bridge::CvImageConstPtr> depthMsgs(4);
 			std::vector<sensor_msgs::CameraInfo> infoMsgs;
-			rtabmap_ros::toCvShare(image, imageMsgs[0], depthMsgs[0]);
-			rtabmap_ros::toCvShare(image2, imageMsgs[1], depthMsgs[1]);
-			rtabmap_ros::toCvShare(image3, imageMsgs[2], depthMsgs[2]);
-			rtabmap_ros::toCvShare(image4, imageMsgs[3], depthMsgs[3]);
+			std::vector<rtabmap_ros::RGBDImageConstPtr> rgbdMsgs;
+			rgbdMsgs.push_back(image);
+			rgbdMsgs.push_back(image2);
+			rgbdMsgs.push_back(image3);
+			rgbdMsgs.push_back(image4);
+			rtabmap_ros::toCvShare(rgbdMsgs, imageMsgs, depthMsgs);
 			infoMsgs.push_back(image->rgb_camera_info);
 			infoMsgs.push_back(image2->rgb_camera_info);
 			infoMsgs.push_back(image3->rgb_camera_info);
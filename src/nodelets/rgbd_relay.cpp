@@ -45,9 +45,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <opencv2/highgui/highgui.hpp>
 
 #include <boost/thread.hpp>
+#include <deque>
+#include <map>
 
 #include "rtabmap_ros/RGBDImage.h"
 #include "rtabmap_ros/MsgConversion.h"
+#include "rtabmap_ros/NodeletDiagnostics.h"
 
 #include "rtabmap/core/Compression.h"
 #include "rtabmap/utilite/UConversion.h"
@@ -55,16 +58,54 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 namespace rtabmap_ros
 {
 
+// Encoded images shared by the relays of the same process (nodelet
+// manager), so that relays of the same camera encode a frame only once.
+// Relays receiving the same message share its image buffer, the buffer
+// address is part of the key so that different streams with the same
+// header (e.g. raw and rectified, decimated and full) are never mixed.
+static boost::mutex g_compressedCacheMutex;
+static std::map<std::string, boost::shared_ptr<const sensor_msgs::CompressedImage> > g_compressedCache;
+static std::deque<std::string> g_compressedCacheOrder; // oldest first
+static const size_t kCompressedCacheSize = 32;
+
 class RGBDRelay : public nodelet::Nodelet
 {
 public:
 	RGBDRelay() :
 		compress_(false),
-		uncompress_(false)
+		uncompress_(false),
+		depthCompressedFormat_("png"),
+		sharedCache_(true),
+		maxLatency_(0.0),
+		workersRunning_(false),
+		dropped_(0),
+		depthWorker_(0),
+		depthWorkerRunning_(false)
 	{}
 
 	virtual ~RGBDRelay()
 	{
+		if(!workers_.empty())
+		{
+			jobsMutex_.lock();
+			workersRunning_ = false;
+			jobsCondition_.notify_all();
+			jobsMutex_.unlock();
+			for(size_t i=0; i<workers_.size(); ++i)
+			{
+				workers_[i]->join();
+				delete workers_[i];
+			}
+		}
+		if(depthWorker_)
+		{
+			depthMutex_.lock();
+			depthWorkerRunning_ = false;
+			depthCondition_.notify_all();
+			depthMutex_.unlock();
+			depthWorker_->join();
+			delete depthWorker_;
+		}
 	}
 
 private:
@@ -78,126 +119,359 @@ private:
 		pnh.param("queue_size", queueSize, queueSize);
 		pnh.param("compress", compress_, compress_);
 		pnh.param("uncompress", uncompress_, uncompress_);
+		pnh.param("depth_compressed_format", depthCompressedFormat_, depthCompressedFormat_);
+		int workers = 0;
+		pnh.param("workers", workers, workers);
+		pnh.param("max_latency", maxLatency_, maxLatency_);
+		pnh.param("shared_cache", sharedCache_, sharedCache_);
 
 		NODELET_INFO("%s: queue_size  = %d", getName().c_str(), queueSize);
+		NODELET_INFO("%s: depth_compressed_format = %s", getName().c_str(), depthCompressedFormat_.c_str());
+		NODELET_INFO("%s: workers = %d", getName().c_str(), workers);
+		NODELET_INFO("%s: max_latency = %f s", getName().c_str(), maxLatency_);
+		NODELET_INFO("%s: shared_cache = %s", getName().c_str(), sharedCache_?"true":"false");
 
 		rgbdImageSub_ = nh.subscribe("rgbd_image", 1, &RGBDRelay::callback, this);
 		rgbdImagePub_ = nh.advertise<rtabmap_ros::RGBDImage>(nh.resolveName("rgbd_image") + "_relay", 1);
+		diagnostics_.init(nh, pnh, getName());
+
+		if(workers > 0 && (compress_ || uncompress_))
+		{
+			workersRunning_ = true;
+			for(int i=0; i<workers; ++i)
+			{
+				workers_.push_back(new boost::thread(boost::bind(&RGBDRelay::workerLoop, this)));
+			}
+			if(compress_)
+			{
+				// depth of the frames is encoded in parallel of their rgb
+				depthWorkerRunning_ = true;
+				depthWorker_ = new boost::thread(boost::bind(&RGBDRelay::depthWorkerLoop, this));
+			}
+		}
 	}
 
 	void callback(const rtabmap_ros::RGBDImageConstPtr& input)
 	{
+		diagnostics_.tickInput(input->header);
 		if(rgbdImagePub_.getNumSubscribers())
 		{
 			if(!compress_ && !uncompress_)
 			{
 				//just republish it
 				rgbdImagePub_.publish(input);
+				diagnostics_.tickOutput(input->header.stamp);
 				return;
 			}
 
-			rtabmap_ros::RGBDImage output;
-			output.header = input->header;
-			output.rgb_camera_info = input->rgb_camera_info;
-			output.depth_camera_info = input->depth_camera_info;
-			output.key_points = input->key_points;
-			output.points = input->points;
-			output.descriptors = input->descriptors;
-			output.global_descriptor = input->global_descriptor;
+			if(!workers_.empty())
+			{
+				boost::mutex::scoped_lock lock(jobsMutex_);
+				// one pending frame per worker, older frames are dropped
+				if(jobs_.size() >= workers_.size())
+				{
+					jobs_.pop_front();
+					++dropped_;
+					diagnostics_.tickDrop();
+					NODELET_WARN_THROTTLE(5.0, "%s: workers are busy, %d frames dropped so far.", getName().c_str(), dropped_);
+				}
+				jobs_.push_back(input);
+				jobsCondition_.notify_one();
+				return;
+			}
 
-			rtabmap::StereoCameraModel stereoModel = stereoCameraModelFromROS(input->rgb_camera_info, input->depth_camera_info, rtabmap::Transform::getIdentity());
+			relay(input, false);
+		}
+	}
 
-			if(compress_)
+	void workerLoop()
+	{
+		while(true)
+		{
+			rtabmap_ros::RGBDImageConstPtr input;
 			{
-				if(!input->rgb_compressed.data.empty())
+				boost::mutex::scoped_lock lock(jobsMutex_);
+				while(workersRunning_ && jobs_.empty())
 				{
-					// already compressed, just copy pointer
-					output.rgb_compressed = input->rgb_compressed;
+					jobsCondition_.wait(lock);
 				}
-				else if(!input->rgb.data.empty())
+				if(!workersRunning_)
 				{
+					return;
+				}
+				input = jobs_.front();
+				jobs_.pop_front();
+			}
+			if(maxLatency_ > 0.0 && (ros::Time::now() - input->header.stamp).toSec() > maxLatency_)
+			{
+				boost::mutex::scoped_lock lock(jobsMutex_);
+				++dropped_;
+				diagnostics_.tickDrop();
+				NODELET_WARN_THROTTLE(5.0, "%s: frame older than max_latency (%fs), %d frames dropped so far.", getName().c_str(), maxLatency_, dropped_);
+				continue;
+			}
+			relay(input, true);
+		}
+	}
+
+	struct DepthJob
+	{
+		DepthJob() : stereo(false), output(0), done(false) {}
+		rtabmap_ros::RGBDImageConstPtr input;
+		bool stereo;
+		sensor_msgs::CompressedImage * output;
+		bool done;
+	};
+
+	void depthWorkerLoop()
+	{
+		while(true)
+		{
+			DepthJob * job = 0;
+			{
+				boost::mutex::scoped_lock lock(depthMutex_);
+				while(depthWorkerRunning_ && depthJobs_.empty())
+				{
+					depthCondition_.wait(lock);
+				}
+				if(!depthWorkerRunning_)
+				{
+					return;
+				}
+				job = depthJobs_.front();
+				depthJobs_.pop_front();
+			}
+			compressDepth(job->input, job->stereo, *job->output);
+			boost::mutex::scoped_lock lock(depthMutex_);
+			job->done = true;
+			depthCondition_.notify_all();
+		}
+	}
+
+	static std::string cacheKey(const sensor_msgs::Image & image, const std::string & format)
+	{
+		return uFormat("%s %d.%09d %dx%d %s %d %p/%d %s",
+				image.header.frame_id.c_str(), image.header.stamp.sec, image.header.stamp.nsec,
+				image.width, image.height, image.encoding.c_str(), image.step,
+				image.data.empty()?0:(const void*)&image.data[0], (int)image.data.size(),
+				format.c_str());
+	}
+
+	bool cachedCompressed(const std::string & key, sensor_msgs::CompressedImage & output)
+	{
+		if(!sharedCache_)
+		{
+			return false;
+		}
+		boost::mutex::scoped_lock lock(g_compressedCacheMutex);
+		std::map<std::string, boost::shared_ptr<const sensor_msgs::CompressedImage> >::iterator iter = g_compressedCache.find(key);
+		if(iter != g_compressedCache.end())
+		{
+			output = *iter->second;
+			return true;
+		}
+		return false;
+	}
+
+	void cacheCompressed(const std::string & key, const sensor_msgs::CompressedImage & image)
+	{
+		if(!sharedCache_)
+		{
+			return;
+		}
+		boost::mutex::scoped_lock lock(g_compressedCacheMutex);
+		if(g_compressedCache.insert(std::make_pair(key, boost::shared_ptr<const sensor_msgs::CompressedImage>(new sensor_msgs::CompressedImage(image)))).second)
+		{
+			g_compressedCacheOrder.push_back(key);
+			if(g_compressedCacheOrder.size() > kCompressedCacheSize)
+			{
+				g_compressedCache.erase(g_compressedCacheOrder.front());
+				g_compressedCacheOrder.pop_front();
+			}
+		}
+	}
+
+	void compressRgb(const rtabmap_ros::RGBDImageConstPtr & input, sensor_msgs::CompressedImage & output)
+	{
 #ifdef CV_BRIDGE_HYDRO
-					ROS_ERROR("Unsupported compressed image copy, please upgrade at least to ROS Indigo to use this.");
+		ROS_ERROR("Unsupported compressed image copy, please upgrade at least to ROS Indigo to use this.");
 #else
-					cv_bridge::CvImageConstPtr rgb = cv_bridge::toCvShare(input->rgb, input);
-					rgb->toCompressedImageMsg(output.rgb_compressed, cv_bridge::JPG);
+		std::string key = cacheKey(input->rgb, "rgb jpg");
+		if(!cachedCompressed(key, output))
+		{
+			cv_bridge::CvImageConstPtr rgb = cv_bridge::toCvShare(input->rgb, input);
+			rgb->toCompressedImageMsg(output, cv_bridge::JPG);
+			cacheCompressed(key, output);
+		}
 #endif
-				}
+	}
+
+	void compressDepth(const rtabmap_ros::RGBDImageConstPtr & input, bool stereo, sensor_msgs::CompressedImage & output)
+	{
+		std::string key = cacheKey(input->depth, stereo?"right jpg":"depth "+depthCompressedFormat_);
+		if(cachedCompressed(key, output))
+		{
+			return;
+		}
+		if(stereo)
+		{
+			// right stereo image
+			cv_bridge::CvImageConstPtr imageRightPtr = cv_bridge::toCvShare(input->depth, input);
+			imageRightPtr->toCompressedImageMsg(output, cv_bridge::JPG);
+		}
+		else
+		{
+			// depth image
+			cv_bridge::CvImageConstPtr imageDepthPtr = cv_bridge::toCvShare(input->depth, input);
+			rtabmap_ros::depthToCompressedMsg(imageDepthPtr->image, depthCompressedFormat_, output);
+		}
+		cacheCompressed(key, output);
+	}
+
+	/**
+	 * @param parallel encode rgb and depth in parallel
+	 */
+	void relay(const rtabmap_ros::RGBDImageConstPtr& input, bool parallel)
+	{
+		NodeletDiagnostics::ScopedTimer timer(diagnostics_);
+		rtabmap_ros::RGBDImage output;
+		output.header = input->header;
+		output.rgb_camera_info = input->rgb_camera_info;
+		output.depth_camera_info = input->depth_camera_info;
+		output.key_points = input->key_points;
+		output.points = input->points;
+		output.descriptors = input->descriptors;
+		output.global_descriptor = input->global_descriptor;
 
-				if(!input->depth_compressed.data.empty())
+		rtabmap::StereoCameraModel stereoModel = stereoCameraModelFromROS(input->rgb_camera_info, input->depth_camera_info, rtabmap::Transform::getIdentity());
+
+		if(compress_)
+		{
+			DepthJob depthJob;
+			if(!input->depth_compressed.data.empty())
+			{
+				// already compressed, just copy pointer
+				output.depth_compressed = input->depth_compressed;
+			}
+			else if(!input->depth.data.empty())
+			{
+				if(parallel && depthWorker_ && input->rgb_compressed.data.empty() && !input->rgb.data.empty())
 				{
-					// already compressed, just copy pointer
-					output.depth_compressed = input->depth_compressed;
+					depthJob.input = input;
+					depthJob.stereo = stereoModel.isValidForProjection();
+					depthJob.output = &output.depth_compressed;
+					boost::mutex::scoped_lock lock(depthMutex_);
+					depthJobs_.push_back(&depthJob);
+					depthCondition_.notify_all();
 				}
-				else if(!input->depth.data.empty())
+				else
 				{
-					if(stereoModel.isValidForProjection())
-					{
-						// right stereo image
-						cv_bridge::CvImageConstPtr imageRightPtr = cv_bridge::toCvShare(input->depth, input);
-						imageRightPtr->toCompressedImageMsg(output.depth_compressed, cv_bridge::JPG);
-					}
-					else
-					{
-						// depth image
-						cv_bridge::CvImageConstPtr imageDepthPtr = cv_bridge::toCvShare(input->depth, input);
-						output.depth_compressed.data = rtabmap::compressImage(imageDepthPtr->image, ".png");
-						output.depth_compressed.format = "png";
-					}
+					compressDepth(input, stereoModel.isValidForProjection(), output.depth_compressed);
 				}
 			}
-			if(uncompress_)
+
+			if(!input->rgb_compressed.data.empty())
+			{
+				// already compressed, just copy pointer
+				output.rgb_compressed = input->rgb_compressed;
+			}
+			else if(!input->rgb.data.empty())
+			{
+				compressRgb(input, output.rgb_compressed);
+			}
+
+			if(depthJob.output)
 			{
-				if(!input->rgb.data.empty())
+				boost::mutex::scoped_lock lock(depthMutex_);
+				while(!depthJob.done)
 				{
-					// already raw, just copy pointer
-					output.rgb = input->rgb;
+					depthCondition_.wait(lock);
 				}
-				if(!input->rgb_compressed.data.empty())
-				{
+			}
+		}
+		if(uncompress_)
+		{
+			if(!input->rgb.data.empty())
+			{
+				// already raw, just copy pointer
+				output.rgb = input->rgb;
+			}
+			if(!input->rgb_compressed.data.empty())
+			{
 #ifdef CV_BRIDGE_HYDRO
-					ROS_ERROR("Unsupported compressed image copy, please upgrade at least to ROS Indigo to use this.");
+				ROS_ERROR("Unsupported compressed image copy, please upgrade at least to ROS Indigo to use this.");
 #else
-					cv_bridge::toCvCopy(input->rgb_compressed)->toImageMsg(output.rgb);
+				cv_bridge::toCvCopy(input->rgb_compressed)->toImageMsg(output.rgb);
 #endif
-				}
+			}
 
-				if(!input->depth.data.empty())
-				{
-					// already raw, just copy pointer
-					output.depth = input->depth;
-				}
-				else if(input->depth_compressed.format.compare("jpg")==0)
-				{
-					// right stereo image
+			if(!input->depth.data.empty())
+			{
+				// already raw, just copy pointer
+				output.depth = input->depth;
+			}
+			else if(input->depth_compressed.format.compare("jpg")==0)
+			{
+				// right stereo image
 #ifdef CV_BRIDGE_HYDRO
-					ROS_ERROR("Unsupported compressed image copy, please upgrade at least to ROS Indigo to use this.");
+				ROS_ERROR("Unsupported compressed image copy, please upgrade at least to ROS Indigo to use this.");
 #else
-					cv_bridge::toCvCopy(input->depth_compressed)->toImageMsg(output.depth);
+				cv_bridge::toCvCopy(input->depth_compressed)->toImageMsg(output.depth);
 #endif
-				}
-				else
-				{
-					// depth image
-					cv_bridge::CvImagePtr ptr = boost::make_shared<cv_bridge::CvImage>();
-					ptr->header = input->depth_compressed.header;
-					ptr->image = rtabmap::uncompressImage(input->depth_compressed.data);
-					ROS_ASSERT(ptr->image.empty() || ptr->image.type() == CV_32FC1 || ptr->image.type() == CV_16UC1);
-					ptr->encoding = ptr->image.empty()?"":ptr->image.type() == CV_32FC1?sensor_msgs::image_encodings::TYPE_32FC1:sensor_msgs::image_encodings::TYPE_16UC1;
-					ptr->toImageMsg(output.depth);
-				}
 			}
+			else
+			{
+				// depth image
+				cv_bridge::CvImagePtr ptr = boost::make_shared<cv_bridge::CvImage>();
+				ptr->header = input->depth_compressed.header;
+				ptr->image = rtabmap_ros::depthFromCompressedMsg(input->depth_compressed);
+				ROS_ASSERT(ptr->image.empty() || ptr->image.type() == CV_32FC1 || ptr->image.type() == CV_16UC1);
+				ptr->encoding = ptr->image.empty()?"":ptr->image.type() == CV_32FC1?sensor_msgs::image_encodings::TYPE_32FC1:sensor_msgs::image_encodings::TYPE_16UC1;
+				ptr->toImageMsg(output.depth);
+			}
+		}
 
-			rgbdImagePub_.publish(output);
+		if(parallel && workers_.size() > 1)
+		{
+			// workers may finish out of order
+			boost::mutex::scoped_lock lock(publishMutex_);
+			if(output.header.stamp <= lastPublishedStamp_)
+			{
+				diagnostics_.tickDrop();
+				return;
+			}
+			lastPublishedStamp_ = output.header.stamp;
 		}
+		rgbdImagePub_.publish(output);
+		diagnostics_.tickOutput(output.header.stamp);
 	}
 
 private:
 
 	bool compress_;
 	bool uncompress_;
+	std::string depthCompressedFormat_;
+	bool sharedCache_;
+	double maxLatency_;
+
+	std::vector<boost::thread*> workers_;
+	std::deque<rtabmap_ros::RGBDImageConstPtr> jobs_;
+	boost::mutex jobsMutex_;
+	boost::condition_variable jobsCondition_;
+	bool workersRunning_;
+	int dropped_;
+	boost::mutex publishMutex_;
+	ros::Time lastPublishedStamp_;
+
+	boost::thread * depthWorker_;
+	std::deque<DepthJob*> depthJobs_;
+	boost::mutex depthMutex_;
+	boost::condition_variable depthCondition_;
+	bool depthWorkerRunning_;
+
 	ros::Subscriber rgbdImageSub_;
 	ros::Publisher rgbdImagePub_;
+	NodeletDiagnostics diagnostics_;
 };
 
 PLUGINLIB_EXPORT_CLASS(rtabmap_ros::RGBDRelay, nodelet::Nodelet);
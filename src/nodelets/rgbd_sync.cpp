@@ -34,6 +34,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sensor_msgs/image_encodings.h>
 #include <sensor_msgs/CameraInfo.h>
 
+#include <diagnostic_msgs/DiagnosticArray.h>
+
 #include <image_transport/image_transport.h>
 #include <image_transport/subscriber_filter.h>
 
@@ -46,8 +48,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <boost/thread.hpp>
 
+#include <tf/transform_listener.h>
+
 #include "rtabmap_ros/RGBDImage.h"
 #include "rtabmap_ros/MsgConversion.h"
+#include "rtabmap_ros/DepthUndistorter.h"
+#include "rtabmap_ros/DepthRegistration.h"
+#include "rtabmap_ros/NodeletDiagnostics.h"
+#include "rtabmap_ros/LazySubscription.h"
 
 #include "rtabmap/core/Compression.h"
 #include "rtabmap/core/util2d.h"
@@ -63,14 +71,30 @@ public:
 		depthScale_(1.0),
 		decimation_(1),
 		compressedRate_(0),
+		depthCompressedFormat_("png"),
+		registerDepth_(false),
+		waitForTransform_(0.1),
+		tfListener_(0),
 		warningThread_(0),
 		callbackCalled_(false),
+		compressionThread_(0),
+		compressionThreadRunning_(false),
+		compressionPending_(false),
+		compressionEncoded_(0),
+		compressionDropped_(0),
+		compressionLatencySum_(0.0),
+		compressionLatencyMax_(0.0),
+		depthThread_(0),
+		depthThreadRunning_(false),
+		depthJobOutput_(0),
+		depthJobDone_(true),
 		approxSyncDepth_(0),
 		exactSyncDepth_(0)
 	{}
 
 	virtual ~RGBDSync()
 	{
+		compressionDiagnostics_.stop();
 		if(approxSyncDepth_)
 			delete approxSyncDepth_;
 		if(exactSyncDepth_)
@@ -82,6 +106,26 @@ public:
 			warningThread_->join();
 			delete warningThread_;
 		}
+
+		if(compressionThread_)
+		{
+			compressionMutex_.lock();
+			compressionThreadRunning_ = false;
+			compressionCondition_.notify_all();
+			compressionMutex_.unlock();
+			compressionThread_->join();
+			delete compressionThread_;
+		}
+		if(depthThread_)
+		{
+			depthMutex_.lock();
+			depthThreadRunning_ = false;
+			depthCondition_.notify_all();
+			depthMutex_.unlock();
+			depthThread_->join();
+			delete depthThread_;
+		}
+		delete tfListener_;
 	}
 
 private:
@@ -97,6 +141,11 @@ private:
 		pnh.param("depth_scale", depthScale_, depthScale_);
 		pnh.param("decimation", decimation_, decimation_);
 		pnh.param("compressed_rate", compressedRate_, compressedRate_);
+		pnh.param("depth_compressed_format", depthCompressedFormat_, depthCompressedFormat_);
+		std::string depthDistortionModel;
+		pnh.param("depth_distortion_model", depthDistortionModel, depthDistortionModel);
+		pnh.param("register_depth", registerDepth_, registerDepth_);
+		pnh.param("wait_for_transform_duration", waitForTransform_, waitForTransform_);
 
 		if(decimation_<1)
 		{
@@ -108,9 +157,35 @@ private:
 		NODELET_INFO("%s: depth_scale = %f", getName().c_str(), depthScale_);
 		NODELET_INFO("%s: decimation = %d", getName().c_str(), decimation_);
 		NODELET_INFO("%s: compressed_rate = %f", getName().c_str(), compressedRate_);
+		NODELET_INFO("%s: depth_compressed_format = %s", getName().c_str(), depthCompressedFormat_.c_str());
+		NODELET_INFO("%s: depth_distortion_model = %s", getName().c_str(), depthDistortionModel.c_str());
+		NODELET_INFO("%s: register_depth = %s", getName().c_str(), registerDepth_?"true":"false");
+		NODELET_INFO("%s: wait_for_transform_duration = %f", getName().c_str(), waitForTransform_);
+		if(!depthDistortionModel.empty() && !depthUndistorter_.load(depthDistortionModel))
+		{
+			NODELET_ERROR("%s: Loaded distortion model from \"%s\" is not valid!", getName().c_str(), depthDistortionModel.c_str());
+		}
 
-		rgbdImagePub_ = nh.advertise<rtabmap_ros::RGBDImage>("rgbd_image", 1);
-		rgbdImageCompressedPub_ = nh.advertise<rtabmap_ros::RGBDImage>("rgbd_image/compressed", 1);
+		lazy_.init(pnh, getName(),
+				boost::bind(&RGBDSync::subscribeInputs, this),
+				boost::bind(&RGBDSync::unsubscribeInputs, this));
+
+		rgbdImagePub_ = nh.advertise<rtabmap_ros::RGBDImage>("rgbd_image", 1, lazy_.connectCallback(), lazy_.connectCallback());
+		rgbdImageCompressedPub_ = nh.advertise<rtabmap_ros::RGBDImage>("rgbd_image/compressed", 1, lazy_.connectCallback(), lazy_.connectCallback());
+		lazy_.addOutput(rgbdImagePub_);
+		lazy_.addOutput(rgbdImageCompressedPub_);
+		diagnostics_.init(nh, pnh, getName());
+		if(diagnostics_.enabled())
+		{
+			compressionDiagnostics_.start(nh, diagnostics_.period(), boost::bind(&RGBDSync::compressionStatus, this, _1, _2));
+		}
+
+		// Compression is done by its own thread so that the raw rgbd_image is never delayed
+		compressionThreadRunning_ = true;
+		compressionThread_ = new boost::thread(boost::bind(&RGBDSync::compressionLoop, this));
+		// RGB and depth are encoded in parallel
+		depthThreadRunning_ = true;
+		depthThread_ = new boost::thread(boost::bind(&RGBDSync::depthLoop, this));
 
 		if(approxSync)
 		{
@@ -123,6 +198,35 @@ private:
 			exactSyncDepth_->registerCallback(boost::bind(&RGBDSync::callback, this, _1, _2, _3));
 		}
 
+		if(registerDepth_)
+		{
+			tfListener_ = new tf::TransformListener;
+		}
+
+		ros::NodeHandle rgb_nh(nh, "rgb");
+		ros::NodeHandle depth_nh(nh, "depth");
+		std::string subscribedTopicsMsg = uFormat("\n%s subscribed to (%s sync):\n   %s \\\n   %s \\\n   %s",
+							getName().c_str(),
+							approxSync?"approx":"exact",
+							rgb_nh.resolveName("image").c_str(),
+							depth_nh.resolveName("image").c_str(),
+							rgb_nh.resolveName("camera_info").c_str());
+
+		if(registerDepth_)
+		{
+			subscribedTopicsMsg += uFormat("\n   %s (depth registration)", depth_nh.resolveName("camera_info").c_str());
+		}
+
+		lazy_.start();
+
+		warningThread_ = new boost::thread(boost::bind(&RGBDSync::warningLoop, this, subscribedTopicsMsg, approxSync));
+		NODELET_INFO("%s", subscribedTopicsMsg.c_str());
+	}
+
+	void subscribeInputs()
+	{
+		ros::NodeHandle & nh = getNodeHandle();
+		ros::NodeHandle & pnh = getPrivateNodeHandle();
 		ros::NodeHandle rgb_nh(nh, "rgb");
 		ros::NodeHandle depth_nh(nh, "depth");
 		ros::NodeHandle rgb_pnh(pnh, "rgb");
@@ -135,16 +239,25 @@ private:
 		imageSub_.subscribe(rgb_it, rgb_nh.resolveName("image"), 1, hintsRgb);
 		imageDepthSub_.subscribe(depth_it, depth_nh.resolveName("image"), 1, hintsDepth);
 		cameraInfoSub_.subscribe(rgb_nh, "camera_info", 1);
+		if(registerDepth_)
+		{
+			// depth intrinsics don't change, only the latest is kept (not synchronized)
+			depthCameraInfoSub_ = depth_nh.subscribe("camera_info", 1, &RGBDSync::depthCameraInfoCallback, this);
+		}
+	}
 
-		std::string subscribedTopicsMsg = uFormat("\n%s subscribed to (%s sync):\n   %s \\\n   %s \\\n   %s",
-							getName().c_str(),
-							approxSync?"approx":"exact",
-							imageSub_.getTopic().c_str(),
-							imageDepthSub_.getTopic().c_str(),
-							cameraInfoSub_.getTopic().c_str());
+	void unsubscribeInputs()
+	{
+		imageSub_.unsubscribe();
+		imageDepthSub_.unsubscribe();
+		cameraInfoSub_.unsubscribe();
+		depthCameraInfoSub_.shutdown();
+	}
 
-		warningThread_ = new boost::thread(boost::bind(&RGBDSync::warningLoop, this, subscribedTopicsMsg, approxSync));
-		NODELET_INFO("%s", subscribedTopicsMsg.c_str());
+	void depthCameraInfoCallback(const sensor_msgs::CameraInfoConstPtr & cameraInfo)
+	{
+		boost::mutex::scoped_lock lock(depthCameraInfoMutex_);
+		depthCameraInfo_ = cameraInfo;
 	}
 
 	void warningLoop(const std::string & subscribedTopicsMsg, bool approxSync)
@@ -153,7 +266,8 @@ private:
 		while(!callbackCalled_)
 		{
 			r.sleep();
-			if(!callbackCalled_)
+			// not expected to receive data while outputs are not subscribed
+			if(!callbackCalled_ && lazy_.subscribed())
 			{
 				ROS_WARN("%s: Did not receive data since 5 seconds! Make sure the input topics are "
 						"published (\"$ rostopic hz my_topic\") and the timestamps in their "
@@ -172,6 +286,8 @@ private:
 			  const sensor_msgs::CameraInfoConstPtr& cameraInfo)
 	{
 		callbackCalled_ = true;
+		NodeletDiagnostics::ScopedTimer timer(diagnostics_);
+		diagnostics_.tickInput(image->header);
 		if(rgbdImagePub_.getNumSubscribers() || rgbdImageCompressedPub_.getNumSubscribers())
 		{
 			double rgbStamp = image->header.stamp.toSec();
@@ -209,13 +325,85 @@ private:
 			rgbMat = imagePtr->image;
 			depthMat = imageDepthPtr->image;
 
+			if(depthUndistorter_.isValid())
+			{
+				if(depthMat.cols == depthUndistorter_.width() && depthMat.rows == depthUndistorter_.height())
+				{
+					depthMat = depthUndistorter_.undistort(depthMat);
+				}
+				else
+				{
+					NODELET_ERROR("Input depth image size (%dx%d) and distortion model "
+							"size (%dx%d) don't match! Cannot undistort image.",
+							depthMat.cols, depthMat.rows,
+							depthUndistorter_.width(), depthUndistorter_.height());
+				}
+			}
+
+			std_msgs::Header depthHeader = depth->header;
+			if(registerDepth_)
+			{
+				sensor_msgs::CameraInfoConstPtr depthCameraInfo;
+				{
+					boost::mutex::scoped_lock lock(depthCameraInfoMutex_);
+					depthCameraInfo = depthCameraInfo_;
+				}
+				if(!depthCameraInfo.get())
+				{
+					NODELET_WARN_THROTTLE(1, "%s: Waiting depth camera_info for registration...", getName().c_str());
+					diagnostics_.tickDrop();
+					return;
+				}
+				rtabmap::Transform rgbToDepth = rtabmap_ros::getTransform(
+						cameraInfo->header.frame_id,
+						depth->header.frame_id,
+						depth->header.stamp,
+						*tfListener_,
+						waitForTransform_);
+				if(rgbToDepth.isNull())
+				{
+					NODELET_WARN_THROTTLE(1, "%s: Cannot register depth, transform between \"%s\" and \"%s\" not available.",
+							getName().c_str(), cameraInfo->header.frame_id.c_str(), depth->header.frame_id.c_str());
+					diagnostics_.tickDrop();
+					return;
+				}
+				// registered directly at the decimated RGB resolution with the depth scale applied
+				rtabmap::CameraModel rgbModel = rtabmap_ros::cameraModelFromROS(*cameraInfo);
+				depthRegistration_.update(
+						rtabmap_ros::cameraModelFromROS(*depthCameraInfo),
+						decimation_>1?rgbModel.scaled(1.0f/float(decimation_)):rgbModel,
+						rgbToDepth);
+				if(!depthRegistration_.isValid())
+				{
+					NODELET_WARN_THROTTLE(1, "%s: Cannot register depth, rgb and depth camera_info should be valid for projection.",
+							getName().c_str());
+					diagnostics_.tickDrop();
+					return;
+				}
+				cv::Mat registered = depthRegistration_.registerDepth(depthMat, depthScale_);
+				if(registered.empty())
+				{
+					NODELET_WARN_THROTTLE(1, "%s: Cannot register depth, depth image (%dx%d, type=%d) should be 16UC1 or 32FC1 "
+							"with the size of its camera_info (%dx%d).",
+							getName().c_str(), depthMat.cols, depthMat.rows, depthMat.type(),
+							(int)depthCameraInfo->width, (int)depthCameraInfo->height);
+					diagnostics_.tickDrop();
+					return;
+				}
+				depthMat = registered;
+				depthHeader.frame_id = cameraInfo->header.frame_id;
+			}
+
 			if(decimation_>1)
 			{
 				rgbMat = rtabmap::util2d::decimate(rgbMat, decimation_);
-				depthMat = rtabmap::util2d::decimate(depthMat, decimation_);
+				if(!registerDepth_)
+				{
+					depthMat = rtabmap::util2d::decimate(depthMat, decimation_);
+				}
 			}
 
-			if(depthScale_ != 1.0)
+			if(depthScale_ != 1.0 && !registerDepth_)
 			{
 				depthMat*=depthScale_;
 			}
@@ -236,23 +424,37 @@ private:
 				{
 					lastCompressedPublished_ = ros::Time::now();
 
-					rtabmap_ros::RGBDImage msgCompressed;
-					msgCompressed.header = msg.header;
-					msgCompressed.rgb_camera_info = msg.rgb_camera_info;
-					msgCompressed.depth_camera_info = msg.depth_camera_info;
-
-					cv_bridge::CvImage cvImg;
-					cvImg.header = image->header;
-					cvImg.image = rgbMat;
-					cvImg.encoding = image->encoding;
-					cvImg.toCompressedImageMsg(msgCompressed.rgb_compressed, cv_bridge::JPG);
-
-					msgCompressed.depth_compressed.header = imageDepthPtr->header;
-					msgCompressed.depth_compressed.data = rtabmap::compressImage(depthMat, ".png");
-
-					msgCompressed.depth_compressed.format = "png";
-
-					rgbdImageCompressedPub_.publish(msgCompressed);
+					CompressionJob job;
+					job.header = msg.header;
+					job.rgbCameraInfo = msg.rgb_camera_info;
+					job.depthCameraInfo = msg.depth_camera_info;
+					job.rgbHeader = image->header;
+					job.rgbEncoding = image->encoding;
+					job.depthHeader = depthHeader;
+					job.rgb = rgbMat;
+					job.depth = depthMat;
+					// keep input images alive until they are encoded (rgbMat/depthMat may share their data)
+					job.rgbPtr = imagePtr;
+					job.depthPtr = imageDepthPtr;
+					job.queuedTime = ros::WallTime::now();
+					job.rawPublished = rgbdImagePub_.getNumSubscribers() != 0;
+
+					boost::mutex::scoped_lock lock(compressionMutex_);
+					if(compressionPending_)
+					{
+						// the encoder only takes the latest frame, counted in
+						// the compression status, the frame is an input drop
+						// only if it has not been published on rgbd_image
+						++compressionDropped_;
+						if(!compressionJob_.rawPublished)
+						{
+							diagnostics_.tickDrop();
+						}
+						NODELET_DEBUG("Compression is slower than input rate, previous frame is dropped.");
+					}
+					compressionJob_ = job;
+					compressionPending_ = true;
+					compressionCondition_.notify_one();
 				}
 			}
 
@@ -265,13 +467,14 @@ private:
 				cvImg.toImageMsg(msg.rgb);
 
 				cv_bridge::CvImage cvDepth;
-				cvDepth.header = depth->header;
+				cvDepth.header = depthHeader;
 				cvDepth.image = depthMat;
 				cvDepth.encoding = depth->encoding;
 				cvDepth.toImageMsg(msg.depth);
 
 				rgbdImagePub_.publish(msg);
 			}
+			diagnostics_.tickOutput(msg.header.stamp);
 
 			if( rgbStamp != image->header.stamp.toSec() ||
 				depthStamp != depth->header.stamp.toSec())
@@ -286,17 +489,180 @@ private:
 		}
 	}
 
+	struct CompressionJob
+	{
+		CompressionJob() : rawPublished(false) {}
+		std_msgs::Header header;
+		sensor_msgs::CameraInfo rgbCameraInfo;
+		sensor_msgs::CameraInfo depthCameraInfo;
+		std_msgs::Header rgbHeader;
+		std::string rgbEncoding;
+		std_msgs::Header depthHeader;
+		cv::Mat rgb;
+		cv::Mat depth;
+		cv_bridge::CvImageConstPtr rgbPtr;
+		cv_bridge::CvImageConstPtr depthPtr;
+		ros::WallTime queuedTime;
+		bool rawPublished; // the frame is also published on rgbd_image
+	};
+
+	// Encode the depth of the current compression job
+	void depthLoop()
+	{
+		while(true)
+		{
+			cv::Mat depth;
+			sensor_msgs::CompressedImage * output = 0;
+			{
+				boost::mutex::scoped_lock lock(depthMutex_);
+				while(depthThreadRunning_ && depthJobOutput_ == 0)
+				{
+					depthCondition_.wait(lock);
+				}
+				if(!depthThreadRunning_)
+				{
+					return;
+				}
+				depth = depthJobImage_;
+				output = depthJobOutput_;
+				depthJobImage_ = cv::Mat();
+				depthJobOutput_ = 0;
+			}
+			rtabmap_ros::depthToCompressedMsg(depth, depthCompressedFormat_, *output);
+			boost::mutex::scoped_lock lock(depthMutex_);
+			depthJobDone_ = true;
+			depthCondition_.notify_all();
+		}
+	}
+
+	void compressionLoop()
+	{
+		while(true)
+		{
+			CompressionJob job;
+			{
+				boost::mutex::scoped_lock lock(compressionMutex_);
+				while(compressionThreadRunning_ && !compressionPending_)
+				{
+					compressionCondition_.wait(lock);
+				}
+				if(!compressionThreadRunning_)
+				{
+					break;
+				}
+				job = compressionJob_;
+				compressionJob_ = CompressionJob();
+				compressionPending_ = false;
+			}
+
+			rtabmap_ros::RGBDImage msgCompressed;
+			msgCompressed.header = job.header;
+			msgCompressed.rgb_camera_info = job.rgbCameraInfo;
+			msgCompressed.depth_camera_info = job.depthCameraInfo;
+			msgCompressed.depth_compressed.header = job.depthHeader;
+
+			{
+				boost::mutex::scoped_lock lock(depthMutex_);
+				depthJobImage_ = job.depth;
+				depthJobOutput_ = &msgCompressed.depth_compressed;
+				depthJobDone_ = false;
+				depthCondition_.notify_all();
+			}
+
+			cv_bridge::CvImage cvImg;
+			cvImg.header = job.rgbHeader;
+			cvImg.image = job.rgb;
+			cvImg.encoding = job.rgbEncoding;
+			cvImg.toCompressedImageMsg(msgCompressed.rgb_compressed, cv_bridge::JPG);
+
+			{
+				boost::mutex::scoped_lock lock(depthMutex_);
+				while(!depthJobDone_)
+				{
+					depthCondition_.wait(lock);
+				}
+			}
+
+			rgbdImageCompressedPub_.publish(msgCompressed);
+
+			double latency = (ros::WallTime::now() - job.queuedTime).toSec();
+			NODELET_DEBUG("Compressed rgbd_image published (latency=%fs)", latency);
+			boost::mutex::scoped_lock lock(compressionMutex_);
+			++compressionEncoded_;
+			compressionLatencySum_ += latency;
+			compressionLatencyMax_ = std::max(compressionLatencyMax_, latency);
+		}
+	}
+
+	// Compression status published by compressionDiagnostics_ (timer thread)
+	void compressionStatus(diagnostic_msgs::DiagnosticStatus & status, double period)
+	{
+		boost::mutex::scoped_lock lock(compressionMutex_);
+		status.name = getName() + ": Compression";
+		status.hardware_id = getName();
+		status.level = compressionDropped_?diagnostic_msgs::DiagnosticStatus::WARN:diagnostic_msgs::DiagnosticStatus::OK;
+		status.message = compressionDropped_?"Compression is slower than input rate, frames are dropped":"OK";
+		diagnostic_msgs::KeyValue value;
+		value.key = "Rate (Hz)";
+		value.value = uNumber2Str(period>0.0?double(compressionEncoded_)/period:0.0);
+		status.values.push_back(value);
+		value.key = "Dropped";
+		value.value = uNumber2Str(compressionDropped_);
+		status.values.push_back(value);
+		value.key = "Latency mean (s)";
+		value.value = uNumber2Str(compressionEncoded_?compressionLatencySum_/double(compressionEncoded_):0.0);
+		status.values.push_back(value);
+		value.key = "Latency max (s)";
+		value.value = uNumber2Str(compressionLatencyMax_);
+		status.values.push_back(value);
+
+		compressionEncoded_ = 0;
+		compressionDropped_ = 0;
+		compressionLatencySum_ = 0.0;
+		compressionLatencyMax_ = 0.0;
+	}
+
 private:
 	double depthScale_;
 	int decimation_;
 	double compressedRate_;
+	std::string depthCompressedFormat_;
+	DepthUndistorter depthUndistorter_;
+	bool registerDepth_;
+	double waitForTransform_;
+	tf::TransformListener * tfListener_;
+	ros::Subscriber depthCameraInfoSub_;
+	boost::mutex depthCameraInfoMutex_;
+	sensor_msgs::CameraInfoConstPtr depthCameraInfo_;
+	DepthRegistration depthRegistration_;
 	boost::thread * warningThread_;
 	bool callbackCalled_;
 
 	ros::Time lastCompressedPublished_;
+	boost::thread * compressionThread_;
+	bool compressionThreadRunning_;
+	boost::mutex compressionMutex_;
+	boost::condition_variable compressionCondition_;
+	CompressionJob compressionJob_;
+	bool compressionPending_;
+	// stats since last diagnostics
+	unsigned int compressionEncoded_;
+	unsigned int compressionDropped_;
+	double compressionLatencySum_;
+	double compressionLatencyMax_;
+	DiagnosticsPublisher compressionDiagnostics_;
+	boost::thread * depthThread_;
+	bool depthThreadRunning_;
+	boost::mutex depthMutex_;
+	boost::condition_variable depthCondition_;
+	cv::Mat depthJobImage_;
+	sensor_msgs::CompressedImage * depthJobOutput_; // set when a depth job is pending
+	bool depthJobDone_;
 
 	ros::Publisher rgbdImagePub_;
 	ros::Publisher rgbdImageCompressedPub_;
+	NodeletDiagnostics diagnostics_;
+	LazySubscription lazy_;
 
 	image_transport::SubscriberFilter imageSub_;
 	image_transport::SubscriberFilter imageDepthSub_;
@@ -47,6 +47,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sensor_msgs/PointCloud2.h>
 #include <pcl_conversions/pcl_conversions.h>
 
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+
 #include "rtabmap_ros/MsgConversion.h"
 
 #include <rtabmap/core/util3d.h>
@@ -77,7 +80,11 @@ public:
 		scanCloudMaxPoints_(0),
 		scanVoxelSize_(0.0),
 		scanNormalK_(0),
-		scanNormalRadius_(0.0)
+		scanNormalRadius_(0.0),
+		parallelPreprocessing_(false),
+		featuresThread_(0),
+		featuresThreadRunning_(false),
+		featuresJob_(0)
 	{
 	}
 
@@ -99,6 +106,15 @@ public:
 		{
 			delete exactCloudSync_;
 		}
+		if(featuresThread_)
+		{
+			featuresMutex_.lock();
+			featuresThreadRunning_ = false;
+			featuresCondition_.notify_all();
+			featuresMutex_.unlock();
+			featuresThread_->join();
+			delete featuresThread_;
+		}
 	}
 
 private:
@@ -124,6 +140,22 @@ private:
 		}
 		pnh.param("scan_normal_radius", scanNormalRadius_, scanNormalRadius_);
 		pnh.param("keep_color", keepColor_, keepColor_);
+		pnh.param("parallel_preprocessing", parallelPreprocessing_, parallelPreprocessing_);
+		if(parallelPreprocessing_ && pipelineDepth() > 0)
+		{
+			// the extractor cannot be shared with processData(), which
+			// already extracts the features overlapping the registration
+			NODELET_WARN("RGBDIcpOdometry: \"parallel_preprocessing\" cannot be used with "
+					"\"pipeline_depth\">0, it is disabled.");
+			parallelPreprocessing_ = false;
+		}
+		if(parallelPreprocessing_ && !createFeatureExtractor())
+		{
+			NODELET_WARN("RGBDIcpOdometry: \"parallel_preprocessing\" is enabled but features "
+					"cannot be extracted outside odometry with current parameters (Odom/Strategy "
+					"should be 0 or 1 with Vis/CorType=0), it is disabled.");
+			parallelPreprocessing_ = false;
+		}
 
 		NODELET_INFO("RGBDIcpOdometry: approx_sync           = %s", approxSync?"true":"false");
 		NODELET_INFO("RGBDIcpOdometry: queue_size            = %d", queueSize_);
@@ -133,6 +165,13 @@ private:
 		NODELET_INFO("RGBDIcpOdometry: scan_normal_k         = %d", scanNormalK_);
 		NODELET_INFO("RGBDIcpOdometry: scan_normal_radius    = %f", scanNormalRadius_);
 		NODELET_INFO("RGBDIcpOdometry: keep_color            = %s", keepColor_?"true":"false");
+		NODELET_INFO("RGBDIcpOdometry: parallel_preprocessing = %s", parallelPreprocessing_?"true":"false");
+
+		if(parallelPreprocessing_)
+		{
+			featuresThreadRunning_ = true;
+			featuresThread_ = new boost::thread(boost::bind(&RGBDICPOdometry::featuresLoop, this));
+		}
 
 		ros::NodeHandle rgb_nh(nh, "rgb");
 		ros::NodeHandle depth_nh(nh, "depth");
@@ -226,6 +265,138 @@ private:
 		callbackCommon(image, depth, cameraInfo, scanMsg, cloudMsg);
 	}
 
+	// Filter the scan (or cloud) and compute its normals, in frameId() frame
+	bool preprocessScan(
+			const sensor_msgs::LaserScanConstPtr& scanMsg,
+			const sensor_msgs::PointCloud2ConstPtr& cloudMsg,
+			LaserScan & scan,
+			Transform & localScanTransform,
+			int & maxLaserScans)
+	{
+		if(scanMsg.get() != 0)
+		{
+			// make sure the frame of the laser is updated too
+			localScanTransform = getTransform(this->frameId(),
+					scanMsg->header.frame_id,
+					scanMsg->header.stamp + ros::Duration().fromSec(scanMsg->ranges.size()*scanMsg->time_increment));
+			if(localScanTransform.isNull())
+			{
+				ROS_ERROR("TF of received laser scan topic at time %fs is not set, aborting odometry update.", scanMsg->header.stamp.toSec());
+				return false;
+			}
+
+			//transform in frameId_ frame
+			sensor_msgs::PointCloud2 scanOut;
+			laser_geometry::LaserProjection projection;
+			projection.transformLaserScanToPointCloud(scanMsg->header.frame_id, *scanMsg, scanOut, this->tfListener());
+			pcl::PointCloud<pcl::PointXYZ>::Ptr pclScan(new pcl::PointCloud<pcl::PointXYZ>);
+			pcl::fromROSMsg(scanOut, *pclScan);
+			pclScan->is_dense = true;
+
+			maxLaserScans = (int)scanMsg->ranges.size();
+			if(pclScan->size())
+			{
+				if(scanVoxelSize_ > 0.0f)
+				{
+					float pointsBeforeFiltering = (float)pclScan->size();
+					pclScan = util3d::voxelize(pclScan, scanVoxelSize_);
+					float ratio = float(pclScan->size()) / pointsBeforeFiltering;
+					maxLaserScans = int(float(maxLaserScans) * ratio);
+				}
+				if(scanNormalK_ > 0 || scanNormalRadius_>0.0f)
+				{
+					//compute normals
+					pcl::PointCloud<pcl::Normal>::Ptr normals;
+					if(scanVoxelSize_ > 0.0f)
+					{
+						normals = util3d::computeNormals2D(pclScan, scanNormalK_, scanNormalRadius_);
+					}
+					else
+					{
+						normals = util3d::computeFastOrganizedNormals2D(pclScan, scanNormalK_, scanNormalRadius_);
+					}
+					pcl::PointCloud<pcl::PointNormal>::Ptr pclScanNormal(new pcl::PointCloud<pcl::PointNormal>);
+					pcl::concatenateFields(*pclScan, *normals, *pclScanNormal);
+					scan = util3d::laserScan2dFromPointCloud(*pclScanNormal);
+				}
+				else
+				{
+					scan = util3d::laserScan2dFromPointCloud(*pclScan);
+				}
+			}
+		}
+		else if(cloudMsg.get() != 0)
+		{
+			UASSERT_MSG(cloudMsg->data.size() == cloudMsg->row_step*cloudMsg->height,
+					uFormat("data=%d row_step=%d height=%d", cloudMsg->data.size(), cloudMsg->row_step, cloudMsg->height).c_str());
+
+
+			bool containNormals = false;
+			if(scanVoxelSize_ == 0.0f)
+			{
+				for(unsigned int i=0; i<cloudMsg->fields.size(); ++i)
+				{
+					if(cloudMsg->fields[i].name.compare("normal_x") == 0)
+					{
+						containNormals = true;
+						break;
+					}
+				}
+			}
+			localScanTransform = getTransform(this->frameId(), cloudMsg->header.frame_id, cloudMsg->header.stamp);
+			if(localScanTransform.isNull())
+			{
+				ROS_ERROR("TF of received scan cloud at time %fs is not set, aborting rtabmap update.", cloudMsg->header.stamp.toSec());
+				return false;
+			}
+
+			maxLaserScans = scanCloudMaxPoints_;
+			if(containNormals)
+			{
+				pcl::PointCloud<pcl::PointNormal>::Ptr pclScan(new pcl::PointCloud<pcl::PointNormal>);
+				pcl::fromROSMsg(*cloudMsg, *pclScan);
+				if(!pclScan->is_dense)
+				{
+					pclScan = util3d::removeNaNNormalsFromPointCloud(pclScan);
+				}
+				scan = util3d::laserScanFromPointCloud(*pclScan);
+			}
+			else
+			{
+				pcl::PointCloud<pcl::PointXYZ>::Ptr pclScan(new pcl::PointCloud<pcl::PointXYZ>);
+				pcl::fromROSMsg(*cloudMsg, *pclScan);
+				if(!pclScan->is_dense)
+				{
+					pclScan = util3d::removeNaNFromPointCloud(pclScan);
+				}
+
+				if(pclScan->size())
+				{
+					if(scanVoxelSize_ > 0.0f)
+					{
+						float pointsBeforeFiltering = (float)pclScan->size();
+						pclScan = util3d::voxelize(pclScan, scanVoxelSize_);
+						float ratio = float(pclScan->size()) / pointsBeforeFiltering;
+						maxLaserScans = int(float(maxLaserScans) * ratio);
+					}
+					if(scanNormalK_ > 0 || scanNormalRadius_>0.0f)
+					{
+						//compute normals
+						pcl::PointCloud<pcl::Normal>::Ptr normals = util3d::computeNormals(pclScan, scanNormalK_, scanNormalRadius_);
+						pcl::PointCloud<pcl::PointNormal>::Ptr pclScanNormal(new pcl::PointCloud<pcl::PointNormal>);
+						pcl::concatenateFields(*pclScan, *normals, *pclScanNormal);
+						scan = util3d::laserScanFromPointCloud(*pclScanNormal);
+					}
+					else
+					{
+						scan = util3d::laserScanFromPointCloud(*pclScan);
+					}
+				}
+			}
+		}
+		return true;
+	}
+
 	void callbackCommon(
 			const sensor_msgs::ImageConstPtr& image,
 			const sensor_msgs::ImageConstPtr& depth,
@@ -286,129 +457,36 @@ private:
 								keepColor_ && image->encoding.compare(sensor_msgs::image_encodings::MONO16)!=0?"bgr8":"mono8");
 				cv_bridge::CvImagePtr ptrDepth = cv_bridge::toCvCopy(depth);
 
+				rtabmap::SensorData visualData(
+						ptrImage->image,
+						ptrDepth->image,
+						rtabmapModel,
+						0,
+						rtabmap_ros::timestampFromROS(stamp));
+				if(featuresThread_)
+				{
+					// features are extracted while the scan is filtered below
+					boost::mutex::scoped_lock lock(featuresMutex_);
+					featuresJob_ = &visualData;
+					featuresCondition_.notify_all();
+				}
+
 				LaserScan scan;
 				Transform localScanTransform = Transform::getIdentity();
 				int maxLaserScans = 0;
-				if(scanMsg.get() != 0)
-				{
-					// make sure the frame of the laser is updated too
-					localScanTransform = getTransform(this->frameId(),
-							scanMsg->header.frame_id,
-							scanMsg->header.stamp + ros::Duration().fromSec(scanMsg->ranges.size()*scanMsg->time_increment));
-					if(localScanTransform.isNull())
-					{
-						ROS_ERROR("TF of received laser scan topic at time %fs is not set, aborting odometry update.", scanMsg->header.stamp.toSec());
-						return;
-					}
-
-					//transform in frameId_ frame
-					sensor_msgs::PointCloud2 scanOut;
-					laser_geometry::LaserProjection projection;
-					projection.transformLaserScanToPointCloud(scanMsg->header.frame_id, *scanMsg, scanOut, this->tfListener());
-					pcl::PointCloud<pcl::PointXYZ>::Ptr pclScan(new pcl::PointCloud<pcl::PointXYZ>);
-					pcl::fromROSMsg(scanOut, *pclScan);
-					pclScan->is_dense = true;
+				bool scanValid = preprocessScan(scanMsg, cloudMsg, scan, localScanTransform, maxLaserScans);
 
-					maxLaserScans = (int)scanMsg->ranges.size();
-					if(pclScan->size())
+				if(featuresThread_)
+				{
+					boost::mutex::scoped_lock lock(featuresMutex_);
+					while(featuresJob_)
 					{
-						if(scanVoxelSize_ > 0.0f)
-						{
-							float pointsBeforeFiltering = (float)pclScan->size();
-							pclScan = util3d::voxelize(pclScan, scanVoxelSize_);
-							float ratio = float(pclScan->size()) / pointsBeforeFiltering;
-							maxLaserScans = int(float(maxLaserScans) * ratio);
-						}
-						if(scanNormalK_ > 0 || scanNormalRadius_>0.0f)
-						{
-							//compute normals
-							pcl::PointCloud<pcl::Normal>::Ptr normals;
-							if(scanVoxelSize_ > 0.0f)
-							{
-								normals = util3d::computeNormals2D(pclScan, scanNormalK_, scanNormalRadius_);
-							}
-							else
-							{
-								normals = util3d::computeFastOrganizedNormals2D(pclScan, scanNormalK_, scanNormalRadius_);
-							}
-							pcl::PointCloud<pcl::PointNormal>::Ptr pclScanNormal(new pcl::PointCloud<pcl::PointNormal>);
-							pcl::concatenateFields(*pclScan, *normals, *pclScanNormal);
-							scan = util3d::laserScan2dFromPointCloud(*pclScanNormal);
-						}
-						else
-						{
-							scan = util3d::laserScan2dFromPointCloud(*pclScan);
-						}
+						featuresCondition_.wait(lock);
 					}
 				}
-				else if(cloudMsg.get() != 0)
+				if(!scanValid)
 				{
-					UASSERT_MSG(cloudMsg->data.size() == cloudMsg->row_step*cloudMsg->height,
-							uFormat("data=%d row_step=%d height=%d", cloudMsg->data.size(), cloudMsg->row_step, cloudMsg->height).c_str());
-
-
-					bool containNormals = false;
-					if(scanVoxelSize_ == 0.0f)
-					{
-						for(unsigned int i=0; i<cloudMsg->fields.size(); ++i)
-						{
-							if(cloudMsg->fields[i].name.compare("normal_x") == 0)
-							{
-								containNormals = true;
-								break;
-							}
-						}
-					}
-					localScanTransform = getTransform(this->frameId(), cloudMsg->header.frame_id, cloudMsg->header.stamp);
-					if(localScanTransform.isNull())
-					{
-						ROS_ERROR("TF of received scan cloud at time %fs is not set, aborting rtabmap update.", cloudMsg->header.stamp.toSec());
-						return;
-					}
-
-					maxLaserScans = scanCloudMaxPoints_;
-					if(containNormals)
-					{
-						pcl::PointCloud<pcl::PointNormal>::Ptr pclScan(new pcl::PointCloud<pcl::PointNormal>);
-						pcl::fromROSMsg(*cloudMsg, *pclScan);
-						if(!pclScan->is_dense)
-						{
-							pclScan = util3d::removeNaNNormalsFromPointCloud(pclScan);
-						}
-						scan = util3d::laserScanFromPointCloud(*pclScan);
-					}
-					else
-					{
-						pcl::PointCloud<pcl::PointXYZ>::Ptr pclScan(new pcl::PointCloud<pcl::PointXYZ>);
-						pcl::fromROSMsg(*cloudMsg, *pclScan);
-						if(!pclScan->is_dense)
-						{
-							pclScan = util3d::removeNaNFromPointCloud(pclScan);
-						}
-
-						if(pclScan->size())
-						{
-							if(scanVoxelSize_ > 0.0f)
-							{
-								float pointsBeforeFiltering = (float)pclScan->size();
-								pclScan = util3d::voxelize(pclScan, scanVoxelSize_);
-								float ratio = float(pclScan->size()) / pointsBeforeFiltering;
-								maxLaserScans = int(float(maxLaserScans) * ratio);
-							}
-							if(scanNormalK_ > 0 || scanNormalRadius_>0.0f)
-							{
-								//compute normals
-								pcl::PointCloud<pcl::Normal>::Ptr normals = util3d::computeNormals(pclScan, scanNormalK_, scanNormalRadius_);
-								pcl::PointCloud<pcl::PointNormal>::Ptr pclScanNormal(new pcl::PointCloud<pcl::PointNormal>);
-								pcl::concatenateFields(*pclScan, *normals, *pclScanNormal);
-								scan = util3d::laserScanFromPointCloud(*pclScanNormal);
-							}
-							else
-							{
-								scan = util3d::laserScanFromPointCloud(*pclScan);
-							}
-						}
-					}
+					return;
 				}
 
 				rtabmap::SensorData data(
@@ -425,11 +503,37 @@ private:
 				std_msgs::Header header;
 				header.stamp = stamp;
 				header.frame_id = image->header.frame_id;
+				if(!visualData.keypoints().empty())
+				{
+					data.setFeatures(visualData.keypoints(), visualData.keypoints3D(), visualData.descriptors());
+				}
 				this->processData(data, header);
 			}
 		}
 	}
 
+	void featuresLoop()
+	{
+		boost::mutex::scoped_lock lock(featuresMutex_);
+		while(true)
+		{
+			while(featuresThreadRunning_ && featuresJob_ == 0)
+			{
+				featuresCondition_.wait(lock);
+			}
+			if(!featuresThreadRunning_)
+			{
+				return;
+			}
+			rtabmap::SensorData * data = featuresJob_;
+			lock.unlock();
+			extractFeatures(*data);
+			lock.lock();
+			featuresJob_ = 0;
+			featuresCondition_.notify_all();
+		}
+	}
+
 protected:
 	virtual void flushCallbacks()
 	{
@@ -480,6 +584,12 @@ private:
 	double scanVoxelSize_;
 	int scanNormalK_;
 	double scanNormalRadius_;
+	bool parallelPreprocessing_;
+	boost::thread * featuresThread_;
+	bool featuresThreadRunning_;
+	rtabmap::SensorData * featuresJob_; // set while features are extracted
+	boost::mutex featuresMutex_;
+	boost::condition_variable featuresCondition_;
 };
 
 PLUGINLIB_EXPORT_CLASS(rtabmap_ros::RGBDICPOdometry, nodelet::Nodelet);
@@ -0,0 +1,214 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <ros/ros.h>
+#include <pluginlib/class_list_macros.h>
+#include <nodelet/nodelet.h>
+#include <image_transport/image_transport.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <rtabmap/core/CameraStereo.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UDirectory.h>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <boost/thread.hpp>
+#include "rtabmap_ros/MsgConversion.h"
+#include "rtabmap_ros/ImageBufferPool.h"
+#include "rtabmap_ros/NodeletDiagnostics.h"
+
+namespace rtabmap_ros
+{
+
+/**
+ * Nodelet version of the "uvc_stereo_camera" node: left and right images
+ * are scaled directly in a pool of preallocated messages, then published
+ * as shared pointers (no serialization nor copy for nodelets in the
+ * same manager).
+ */
+class StereoCameraNodelet : public nodelet::Nodelet
+{
+public:
+	StereoCameraNodelet() :
+		camera_(0),
+		captureThread_(0),
+		frameId_("camera_link"),
+		scale_(1.0),
+		leftPool_(4),
+		rightPool_(4)
+	{}
+
+	virtual ~StereoCameraNodelet()
+	{
+		if(captureThread_)
+		{
+			captureThread_->interrupt();
+			captureThread_->join();
+			delete captureThread_;
+		}
+		delete camera_;
+	}
+
+private:
+	virtual void onInit()
+	{
+		ros::NodeHandle & nh = getNodeHandle();
+		ros::NodeHandle & pnh = getPrivateNodeHandle();
+
+		double rate = 0.0;
+		int deviceId = 0;
+		std::string id = "camera";
+		int poolSize = (int)leftPool_.size();
+		pnh.param("rate", rate, rate);
+		pnh.param("device_id", deviceId, deviceId);
+		pnh.param("camera_id", id, id);
+		pnh.param("frame_id", frameId_, frameId_);
+		pnh.param("scale", scale_, scale_);
+		pnh.param("pool_size", poolSize, poolSize);
+		NODELET_INFO("rate: %f", rate);
+		NODELET_INFO("device_id: %d", deviceId);
+		NODELET_INFO("camera_id: %s", id.c_str());
+		NODELET_INFO("frame_id: %s", frameId_.c_str());
+		NODELET_INFO("scale: %f", scale_);
+		NODELET_INFO("pool_size: %d", poolSize);
+		if(scale_ <= 0.0)
+		{
+			NODELET_ERROR("scale should be > 0 (%f), setting to 1", scale_);
+			scale_ = 1.0;
+		}
+		// left and right images
+		poolSize = poolSize>0?poolSize:1;
+		leftPool_.setSize(poolSize);
+		rightPool_.setSize(poolSize);
+
+		ros::NodeHandle leftNh(nh, "left");
+		ros::NodeHandle rightNh(nh, "right");
+		image_transport::ImageTransport leftIt(leftNh);
+		image_transport::ImageTransport rightIt(rightNh);
+		imageLeftPub_ = leftIt.advertise("image_raw", 1);
+		imageRightPub_ = rightIt.advertise("image_raw", 1);
+		infoLeftPub_ = leftNh.advertise<sensor_msgs::CameraInfo>("camera_info", 1);
+		infoRightPub_ = rightNh.advertise<sensor_msgs::CameraInfo>("camera_info", 1);
+		diagnostics_.init(nh, pnh, getName());
+
+		camera_ = new rtabmap::CameraStereoVideo(deviceId, false, rate);
+		if(camera_->init(UDirectory::homeDir() + "/.ros/camera_info", id))
+		{
+			captureThread_ = new boost::thread(boost::bind(&StereoCameraNodelet::captureLoop, this));
+		}
+		else
+		{
+			NODELET_ERROR("Could not initialize the camera!");
+		}
+	}
+
+	sensor_msgs::ImagePtr toMsg(const cv::Mat & image, ImageBufferPool & pool, const std_msgs::Header & header)
+	{
+		sensor_msgs::ImagePtr msg;
+		if(scale_ != 1.0)
+		{
+			cv::Size size(int(image.cols*scale_+0.5), int(image.rows*scale_+0.5));
+			msg = pool.acquire(size.width, size.height, image.type());
+			cv::Mat dst = ImageBufferPool::toCvMat(*msg);
+			// dst has already the right size and type, resized in place
+			cv::resize(image, dst, size, 0, 0, CV_INTER_AREA);
+		}
+		else
+		{
+			msg = pool.acquire(image.cols, image.rows, image.type());
+			image.copyTo(ImageBufferPool::toCvMat(*msg));
+		}
+		msg->header = header;
+		return msg;
+	}
+
+	void captureLoop()
+	{
+		while(ros::ok() && !boost::this_thread::interruption_requested())
+		{
+			rtabmap::SensorData data = camera_->takeImage();
+			if(data.imageRaw().empty() || data.rightRaw().empty())
+			{
+				NODELET_WARN_THROTTLE(1, "Could not get images from the camera");
+				boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+				continue;
+			}
+			diagnostics_.tickInput();
+			if(imageLeftPub_.getNumSubscribers() == 0 &&
+				imageRightPub_.getNumSubscribers() == 0 &&
+				infoLeftPub_.getNumSubscribers() == 0 &&
+				infoRightPub_.getNumSubscribers() == 0)
+			{
+				diagnostics_.tickDrop();
+				continue;
+			}
+
+			std_msgs::Header header;
+			header.frame_id = frameId_;
+			header.stamp = data.stamp()>0.0?ros::Time(data.stamp()):ros::Time::now();
+			{
+				NodeletDiagnostics::ScopedTimer timer(diagnostics_);
+				if(imageLeftPub_.getNumSubscribers())
+				{
+					imageLeftPub_.publish(toMsg(data.imageRaw(), leftPool_, header));
+				}
+				if(imageRightPub_.getNumSubscribers())
+				{
+					imageRightPub_.publish(toMsg(data.rightRaw(), rightPool_, header));
+				}
+
+				sensor_msgs::CameraInfoPtr infoLeft(new sensor_msgs::CameraInfo);
+				sensor_msgs::CameraInfoPtr infoRight(new sensor_msgs::CameraInfo);
+				rtabmap_ros::cameraModelToROS(data.stereoCameraModel().left().scaled(scale_), *infoLeft);
+				rtabmap_ros::cameraModelToROS(data.stereoCameraModel().right().scaled(scale_), *infoRight);
+				infoLeft->header = header;
+				infoRight->header = header;
+				infoLeftPub_.publish(infoLeft);
+				infoRightPub_.publish(infoRight);
+			}
+			diagnostics_.tickOutput(header.stamp);
+		}
+		NODELET_DEBUG("Capture thread stopped (%lu buffers allocated, %lu images out of the pools)",
+				leftPool_.allocations() + rightPool_.allocations(),
+				leftPool_.exhausted() + rightPool_.exhausted());
+	}
+
+private:
+	rtabmap::CameraStereoVideo * camera_;
+	boost::thread * captureThread_;
+	std::string frameId_;
+	double scale_;
+	ImageBufferPool leftPool_;
+	ImageBufferPool rightPool_;
+	image_transport::Publisher imageLeftPub_;
+	image_transport::Publisher imageRightPub_;
+	ros::Publisher infoLeftPub_;
+	ros::Publisher infoRightPub_;
+	NodeletDiagnostics diagnostics_;
+};
+
+PLUGINLIB_EXPORT_CLASS(rtabmap_ros::StereoCameraNodelet, nodelet::Nodelet);
+}
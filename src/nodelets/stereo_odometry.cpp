@@ -44,6 +44,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <cv_bridge/cv_bridge.h>
 
 #include "rtabmap_ros/MsgConversion.h"
+#include "rtabmap_ros/StereoRectifier.h"
 
 #include <rtabmap/utilite/ULogger.h>
 #include <rtabmap/utilite/UTimer.h>
@@ -64,7 +65,8 @@ public:
 		approxSync_(0),
 		exactSync_(0),
 		queueSize_(5),
-		keepColor_(false)
+		keepColor_(false),
+		rectifyImages_(false)
 	{
 	}
 
@@ -157,6 +159,12 @@ private:
 			ROS_WARN("Stereo odometry works only with \"Reg/Strategy\"=0. Ignoring value %s.", iter->second.c_str());
 		}
 		uInsert(parameters, ParametersPair(Parameters::kRegStrategy(), "0"));
+
+		// Raw images are rectified here with cached maps, odometry receives rectified images
+		bool alreadyRectified = Parameters::defaultRtabmapImagesAlreadyRectified();
+		Parameters::parse(parameters, Parameters::kRtabmapImagesAlreadyRectified(), alreadyRectified);
+		rectifyImages_ = !alreadyRectified;
+		uInsert(parameters, ParametersPair(Parameters::kRtabmapImagesAlreadyRectified(), "true"));
 	}
 
 	void callback(
@@ -199,8 +207,7 @@ private:
 			int quality = -1;
 			if(imageRectLeft->data.size() && imageRectRight->data.size())
 			{
-				bool alreadyRectified = true;
-				Parameters::parse(parameters(), Parameters::kRtabmapImagesAlreadyRectified(), alreadyRectified);
+				bool alreadyRectified = !rectifyImages_;
 				rtabmap::Transform stereoTransform;
 				if(!alreadyRectified)
 				{
@@ -215,7 +222,20 @@ private:
 					}
 				}
 
-				rtabmap::StereoCameraModel stereoModel = rtabmap_ros::stereoCameraModelFromROS(*cameraInfoLeft, *cameraInfoRight, localTransform, stereoTransform);
+				rtabmap::StereoCameraModel stereoModel;
+				if(!alreadyRectified)
+				{
+					if(!rectifier_.update(*cameraInfoLeft, *cameraInfoRight, localTransform, stereoTransform))
+					{
+						NODELET_ERROR("Parameter %s is false but the camera info received cannot be used to rectify the images!", Parameters::kRtabmapImagesAlreadyRectified().c_str());
+						return;
+					}
+					stereoModel = rectifier_.rectifiedModel();
+				}
+				else
+				{
+					stereoModel = rtabmap_ros::stereoCameraModelFromROS(*cameraInfoLeft, *cameraInfoRight, localTransform, stereoTransform);
+				}
 
 				if(stereoModel.baseline() == 0 && alreadyRectified)
 				{
@@ -277,9 +297,15 @@ private:
 				UTimer stepTimer;
 				//
 				UDEBUG("localTransform = %s", localTransform.prettyPrint().c_str());
+				cv::Mat left = ptrImageLeft->image;
+				cv::Mat right = ptrImageRight->image;
+				if(!alreadyRectified)
+				{
+					rectifier_.rectify(left, right, left, right);
+				}
 				rtabmap::SensorData data(
-						ptrImageLeft->image,
-						ptrImageRight->image,
+						left,
+						right,
 						stereoModel,
 						0,
 						rtabmap_ros::timestampFromROS(stamp));
@@ -338,8 +364,7 @@ private:
 			int quality = -1;
 			if(!imageRectLeft->image.empty() && !imageRectRight->image.empty())
 			{
-				bool alreadyRectified = true;
-				Parameters::parse(parameters(), Parameters::kRtabmapImagesAlreadyRectified(), alreadyRectified);
+				bool alreadyRectified = !rectifyImages_;
 				rtabmap::Transform stereoTransform;
 				if(!alreadyRectified)
 				{
@@ -354,7 +379,20 @@ private:
 					}
 				}
 
-				rtabmap::StereoCameraModel stereoModel = rtabmap_ros::stereoCameraModelFromROS(image->rgb_camera_info, image->depth_camera_info, localTransform);
+				rtabmap::StereoCameraModel stereoModel;
+				if(!alreadyRectified)
+				{
+					if(!rectifier_.update(image->rgb_camera_info, image->depth_camera_info, localTransform, stereoTransform))
+					{
+						NODELET_ERROR("Parameter %s is false but the camera info received cannot be used to rectify the images!", Parameters::kRtabmapImagesAlreadyRectified().c_str());
+						return;
+					}
+					stereoModel = rectifier_.rectifiedModel();
+				}
+				else
+				{
+					stereoModel = rtabmap_ros::stereoCameraModelFromROS(image->rgb_camera_info, image->depth_camera_info, localTransform);
+				}
 
 				if(stereoModel.baseline() == 0 && alreadyRectified)
 				{
@@ -429,9 +467,15 @@ private:
 				UTimer stepTimer;
 				//
 				UDEBUG("localTransform = %s", localTransform.prettyPrint().c_str());
+				cv::Mat left = ptrImageLeft->image;
+				cv::Mat right = ptrImageRight->image;
+				if(!alreadyRectified)
+				{
+					rectifier_.rectify(left, right, left, right);
+				}
 				rtabmap::SensorData data(
-						ptrImageLeft->image,
-						ptrImageRight->image,
+						left,
+						right,
 						stereoModel,
 						0,
 						rtabmap_ros::timestampFromROS(stamp));
@@ -478,6 +522,8 @@ private:
 	ros::Subscriber rgbdSub_;
 	int queueSize_;
 	bool keepColor_;
+	bool rectifyImages_;
+	StereoRectifier rectifier_;
 };
 
 PLUGINLIB_EXPORT_CLASS(rtabmap_ros::StereoOdometry, nodelet::Nodelet);
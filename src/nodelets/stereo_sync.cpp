@@ -47,6 +47,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <boost/thread.hpp>
 
 #include "rtabmap_ros/RGBDImage.h"
+#include "rtabmap_ros/NodeletDiagnostics.h"
+#include "rtabmap_ros/LazySubscription.h"
 
 #include "rtabmap/core/Compression.h"
 #include "rtabmap/utilite/UConversion.h"
@@ -96,8 +98,15 @@ private:
 		NODELET_INFO("%s: queue_size  = %d", getName().c_str(), queueSize);
 		NODELET_INFO("%s: compressed_rate = %f", getName().c_str(), compressedRate_);
 
-		rgbdImagePub_ = nh.advertise<rtabmap_ros::RGBDImage>("rgbd_image", 1);
-		rgbdImageCompressedPub_ = nh.advertise<rtabmap_ros::RGBDImage>("rgbd_image/compressed", 1);
+		lazy_.init(pnh, getName(),
+				boost::bind(&StereoSync::subscribeInputs, this),
+				boost::bind(&StereoSync::unsubscribeInputs, this));
+
+		rgbdImagePub_ = nh.advertise<rtabmap_ros::RGBDImage>("rgbd_image", 1, lazy_.connectCallback(), lazy_.connectCallback());
+		rgbdImageCompressedPub_ = nh.advertise<rtabmap_ros::RGBDImage>("rgbd_image/compressed", 1, lazy_.connectCallback(), lazy_.connectCallback());
+		lazy_.addOutput(rgbdImagePub_);
+		lazy_.addOutput(rgbdImageCompressedPub_);
+		diagnostics_.init(nh, pnh, getName());
 
 		if(approxSync)
 		{
@@ -110,6 +119,26 @@ private:
 			exactSync_->registerCallback(boost::bind(&StereoSync::callback, this, _1, _2, _3, _4));
 		}
 
+		ros::NodeHandle left_nh(nh, "left");
+		ros::NodeHandle right_nh(nh, "right");
+		std::string subscribedTopicsMsg = uFormat("\n%s subscribed to (%s sync):\n   %s \\\n   %s \\\n   %s \\\n   %s",
+							getName().c_str(),
+							approxSync?"approx":"exact",
+							left_nh.resolveName("image_rect").c_str(),
+							right_nh.resolveName("image_rect").c_str(),
+							left_nh.resolveName("camera_info").c_str(),
+							right_nh.resolveName("camera_info").c_str());
+
+		lazy_.start();
+
+		warningThread_ = new boost::thread(boost::bind(&StereoSync::warningLoop, this, subscribedTopicsMsg, approxSync));
+		NODELET_INFO("%s", subscribedTopicsMsg.c_str());
+	}
+
+	void subscribeInputs()
+	{
+		ros::NodeHandle & nh = getNodeHandle();
+		ros::NodeHandle & pnh = getPrivateNodeHandle();
 		ros::NodeHandle left_nh(nh, "left");
 		ros::NodeHandle right_nh(nh, "right");
 		ros::NodeHandle left_pnh(pnh, "left");
@@ -123,17 +152,14 @@ private:
 		imageRightSub_.subscribe(depth_it, right_nh.resolveName("image_rect"), 1, hintsDepth);
 		cameraInfoLeftSub_.subscribe(left_nh, "camera_info", 1);
 		cameraInfoRightSub_.subscribe(right_nh, "camera_info", 1);
+	}
 
-		std::string subscribedTopicsMsg = uFormat("\n%s subscribed to (%s sync):\n   %s \\\n   %s \\\n   %s \\\n   %s",
-							getName().c_str(),
-							approxSync?"approx":"exact",
-							imageLeftSub_.getTopic().c_str(),
-							imageRightSub_.getTopic().c_str(),
-							cameraInfoLeftSub_.getTopic().c_str(),
-							cameraInfoRightSub_.getTopic().c_str());
-
-		warningThread_ = new boost::thread(boost::bind(&StereoSync::warningLoop, this, subscribedTopicsMsg, approxSync));
-		NODELET_INFO("%s", subscribedTopicsMsg.c_str());
+	void unsubscribeInputs()
+	{
+		imageLeftSub_.unsubscribe();
+		imageRightSub_.unsubscribe();
+		cameraInfoLeftSub_.unsubscribe();
+		cameraInfoRightSub_.unsubscribe();
 	}
 
 	void warningLoop(const std::string & subscribedTopicsMsg, bool approxSync)
@@ -142,7 +168,8 @@ private:
 		while(!callbackCalled_)
 		{
 			r.sleep();
-			if(!callbackCalled_)
+			// not expected to receive data while outputs are not subscribed
+			if(!callbackCalled_ && lazy_.subscribed())
 			{
 				ROS_WARN("%s: Did not receive data since 5 seconds! Make sure the input topics are "
 						"published (\"$ rostopic hz my_topic\") and the timestamps in their "
@@ -162,6 +189,8 @@ private:
 			  const sensor_msgs::CameraInfoConstPtr& cameraInfoRight)
 	{
 		callbackCalled_ = true;
+		NodeletDiagnostics::ScopedTimer timer(diagnostics_);
+		diagnostics_.tickInput(imageLeft->header);
 		if(rgbdImagePub_.getNumSubscribers() || rgbdImageCompressedPub_.getNumSubscribers())
 		{
 			double leftStamp = imageLeft->header.stamp.toSec();
@@ -209,6 +238,7 @@ private:
 				msg.depth = *imageRight;
 				rgbdImagePub_.publish(msg);
 			}
+			diagnostics_.tickOutput(msg.header.stamp);
 
 			if( leftStamp != imageLeft->header.stamp.toSec() ||
 				rightStamp != imageRight->header.stamp.toSec())
@@ -231,6 +261,8 @@ private:
 
 	ros::Publisher rgbdImagePub_;
 	ros::Publisher rgbdImageCompressedPub_;
+	NodeletDiagnostics diagnostics_;
+	LazySubscription lazy_;
 
 	image_transport::SubscriberFilter imageLeftSub_;
 	image_transport::SubscriberFilter imageRightSub_;
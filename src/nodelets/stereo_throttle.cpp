@@ -32,6 +32,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <message_filters/subscriber.h>
 #include <message_filters/time_synchronizer.h>
 #include <message_filters/sync_policies/approximate_time.h>
+#include <message_filters/pass_through.h>
 
 #include <image_transport/image_transport.h>
 #include <image_transport/subscriber_filter.h>
@@ -42,6 +43,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <rtabmap/core/util2d.h>
 
+#include "rtabmap_ros/ThrottleGate.h"
+#include "rtabmap_ros/NodeletDiagnostics.h"
+
 namespace rtabmap_ros
 {
 
@@ -50,7 +54,6 @@ class StereoThrottleNodelet : public nodelet::Nodelet
 public:
 	//Constructor
 	StereoThrottleNodelet():
-		rate_(0),
 		approxSync_(0),
 		exactSync_(0),
 		decimation_(1)
@@ -70,8 +73,6 @@ public:
 	}
 
 private:
-	ros::Time last_update_;
-	double rate_;
 	virtual void onInit()
 	{
 		ros::NodeHandle& nh = getNodeHandle();
@@ -89,22 +90,23 @@ private:
 		int queueSize = 5;
 		bool approxSync = false;
 		pnh.param("approx_sync", approxSync, approxSync);
-		pnh.param("rate", rate_, rate_);
+		gate_.init(nh, pnh, getName());
+		diagnostics_.init(nh, pnh, getName());
 		pnh.param("queue_size", queueSize, queueSize);
 		pnh.param("decimation", decimation_, decimation_);
 		ROS_ASSERT(decimation_ >= 1);
-		NODELET_INFO("Rate=%f Hz", rate_);
+		NODELET_INFO("Rate=%f Hz", gate_.rate());
 		NODELET_INFO("Decimation=%d", decimation_);
 		NODELET_INFO("Approximate time sync = %s", approxSync?"true":"false");
 
 		if(approxSync)
 		{
-			approxSync_ = new message_filters::Synchronizer<MyApproxSyncPolicy>(MyApproxSyncPolicy(queueSize), imageLeft_, imageRight_, cameraInfoLeft_, cameraInfoRight_);
+			approxSync_ = new message_filters::Synchronizer<MyApproxSyncPolicy>(MyApproxSyncPolicy(queueSize), imageLeftPass_, imageRightPass_, cameraInfoLeftPass_, cameraInfoRightPass_);
 			approxSync_->registerCallback(boost::bind(&StereoThrottleNodelet::callback, this, _1, _2, _3, _4));
 		}
 		else
 		{
-			exactSync_ = new message_filters::Synchronizer<MyExactSyncPolicy>(MyExactSyncPolicy(queueSize), imageLeft_, imageRight_, cameraInfoLeft_, cameraInfoRight_);
+			exactSync_ = new message_filters::Synchronizer<MyExactSyncPolicy>(MyExactSyncPolicy(queueSize), imageLeftPass_, imageRightPass_, cameraInfoLeftPass_, cameraInfoRightPass_);
 			exactSync_->registerCallback(boost::bind(&StereoThrottleNodelet::callback, this, _1, _2, _3, _4));
 		}
 
@@ -113,30 +115,40 @@ private:
 		cameraInfoLeft_.subscribe(left_nh, "camera_info", 1);
 		cameraInfoRight_.subscribe(right_nh, "camera_info", 1);
 
+		// Frames that won't be forwarded are dropped before synchronization
+		imageLeft_.registerCallback(boost::bind(&StereoThrottleNodelet::gateInput<sensor_msgs::Image>, this, _1, &imageLeftPass_));
+		imageRight_.registerCallback(boost::bind(&StereoThrottleNodelet::gateInput<sensor_msgs::Image>, this, _1, &imageRightPass_));
+		cameraInfoLeft_.registerCallback(boost::bind(&StereoThrottleNodelet::gateInput<sensor_msgs::CameraInfo>, this, _1, &cameraInfoLeftPass_));
+		cameraInfoRight_.registerCallback(boost::bind(&StereoThrottleNodelet::gateInput<sensor_msgs::CameraInfo>, this, _1, &cameraInfoRightPass_));
+
 		imageLeftPub_ = left_it.advertise(left_nh.resolveName("image")+"_throttle", 1);
 		imageRightPub_ = right_it.advertise(right_nh.resolveName("image")+"_throttle", 1);
 		infoLeftPub_ = left_nh.advertise<sensor_msgs::CameraInfo>(left_nh.resolveName("camera_info")+"_throttle", 1);
 		infoRightPub_ = right_nh.advertise<sensor_msgs::CameraInfo>(right_nh.resolveName("camera_info")+"_throttle", 1);
 	};
 
+	template<class M>
+	void gateInput(const boost::shared_ptr<M const> & msg, message_filters::PassThrough<M> * filter)
+	{
+		if(gate_.accept(msg->header.stamp))
+		{
+			filter->add(msg);
+		}
+	}
+
 	void callback(const sensor_msgs::ImageConstPtr& imageLeft,
 			const sensor_msgs::ImageConstPtr& imageRight,
 			const sensor_msgs::CameraInfoConstPtr& camInfoLeft,
 			const sensor_msgs::CameraInfoConstPtr& camInfoRight)
 	{
-		if (rate_ > 0.0)
+		// inputs are already filtered by the gate before synchronization
+		diagnostics_.tickInput();
+		if(!gate_.forward(imageLeft->header.stamp))
 		{
-			NODELET_DEBUG("update set to %f", rate_);
-			if ( last_update_ + ros::Duration(1.0/rate_) > ros::Time::now())
-			{
-				NODELET_DEBUG("throttle last update at %f skipping", last_update_.toSec());
-				return;
-			}
+			NODELET_DEBUG("throttle skipping frame %f", imageLeft->header.stamp.toSec());
+			return;
 		}
-		else
-			NODELET_DEBUG("rate unset continuing");
-
-		last_update_ = ros::Time::now();
+		NodeletDiagnostics::ScopedTimer timer(diagnostics_);
 
 		double leftStamp = imageLeft->header.stamp.toSec();
 		double rightStamp = imageRight->header.stamp.toSec();
@@ -227,6 +239,7 @@ private:
 				imageRightPub_.publish(imageRight);
 			}
 		}
+		diagnostics_.tickOutput(imageLeft->header.stamp);
 
 		if( leftStamp != imageLeft->header.stamp.toSec() ||
 			rightStamp != imageRight->header.stamp.toSec())
@@ -244,11 +257,16 @@ private:
 	image_transport::Publisher imageRightPub_;
 	ros::Publisher infoLeftPub_;
 	ros::Publisher infoRightPub_;
+	NodeletDiagnostics diagnostics_;
 
 	image_transport::SubscriberFilter imageLeft_;
 	image_transport::SubscriberFilter imageRight_;
 	message_filters::Subscriber<sensor_msgs::CameraInfo> cameraInfoLeft_;
 	message_filters::Subscriber<sensor_msgs::CameraInfo> cameraInfoRight_;
+	message_filters::PassThrough<sensor_msgs::Image> imageLeftPass_;
+	message_filters::PassThrough<sensor_msgs::Image> imageRightPass_;
+	message_filters::PassThrough<sensor_msgs::CameraInfo> cameraInfoLeftPass_;
+	message_filters::PassThrough<sensor_msgs::CameraInfo> cameraInfoRightPass_;
 
 	typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::Image, sensor_msgs::Image, sensor_msgs::CameraInfo, sensor_msgs::CameraInfo> MyApproxSyncPolicy;
 	message_filters::Synchronizer<MyApproxSyncPolicy> * approxSync_;
@@ -256,6 +274,7 @@ private:
 	message_filters::Synchronizer<MyExactSyncPolicy> * exactSync_;
 
 	int decimation_;
+	ThrottleGate gate_;
 
 };
 
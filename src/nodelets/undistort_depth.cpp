@@ -39,7 +39,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <cv_bridge/cv_bridge.h>
 #include <opencv2/highgui/highgui.hpp>
 
-#include "rtabmap/core/clams/discrete_depth_distortion_model.h"
+#include "rtabmap_ros/DepthUndistorter.h"
+#include "rtabmap_ros/ImageBufferPool.h"
+#include "rtabmap_ros/NodeletDiagnostics.h"
 #include "rtabmap/utilite/UConversion.h"
 
 namespace rtabmap_ros
@@ -69,8 +71,7 @@ private:
 			NODELET_ERROR("undistort_depth: \"model\" parameter should be set!");
 		}
 
-		model_.load(modelPath);
-		if(!model_.isValid())
+		if(!model_.load(modelPath))
 		{
 			NODELET_ERROR("Loaded distortion model from \"%s\" is not valid!", modelPath.c_str());
 		}
@@ -79,11 +80,14 @@ private:
 			image_transport::ImageTransport it(nh);
 			sub_ = it.subscribe("depth", 1, &UndistortDepth::callback, this);
 			pub_ = it.advertise(uFormat("%s_undistorted", nh.resolveName("depth").c_str()), 1);
+			diagnostics_.init(nh, pnh, getName());
 		}
 	}
 
 	void callback(const sensor_msgs::ImageConstPtr& depth)
 	{
+		NodeletDiagnostics::ScopedTimer timer(diagnostics_);
+		diagnostics_.tickInput(depth->header);
 		if(depth->encoding.compare(sensor_msgs::image_encodings::TYPE_16UC1)!=0 &&
 		   depth->encoding.compare(sensor_msgs::image_encodings::TYPE_32FC1)!=0 &&
 		   depth->encoding.compare(sensor_msgs::image_encodings::MONO16)!=0)
@@ -94,26 +98,36 @@ private:
 
 		if(pub_.getNumSubscribers())
 		{
-			if(depth->width == model_.getWidth() && depth->width == model_.getWidth())
+			if((int)depth->width == model_.width() && (int)depth->height == model_.height())
 			{
-				cv_bridge::CvImagePtr imageDepthPtr = cv_bridge::toCvCopy(depth);
-				model_.undistort(imageDepthPtr->image);
-				pub_.publish(imageDepthPtr->toImageMsg());
+				cv_bridge::CvImageConstPtr imageDepthPtr = cv_bridge::toCvShare(depth);
+
+				// Undistort directly in the data of a recycled output message
+				sensor_msgs::ImagePtr output = outputs_.acquire(depth->width, depth->height, imageDepthPtr->image.type());
+				cv::Mat outputMat = ImageBufferPool::toCvMat(*output);
+				output->header = depth->header;
+				output->encoding = depth->encoding;
+				output->is_bigendian = depth->is_bigendian;
+				model_.undistort(imageDepthPtr->image, outputMat);
+				pub_.publish(output);
+				diagnostics_.tickOutput(output->header.stamp);
 			}
 			else
 			{
 				NODELET_ERROR("Input depth image size (%dx%d) and distortion model "
 						"size (%dx%d) don't match! Cannot undistort image.",
 						depth->width, depth->height,
-						model_.getWidth(), model_.getHeight());
+						model_.width(), model_.height());
 			}
 		}
 	}
 
 private:
-	clams::DiscreteDepthDistortionModel model_;
+	DepthUndistorter model_;
+	ImageBufferPool outputs_; // output messages not referenced anymore by subscribers are reused
 	image_transport::Publisher pub_;
 	image_transport::Subscriber sub_;
+	NodeletDiagnostics diagnostics_;
 };
 
 PLUGINLIB_EXPORT_CLASS(rtabmap_ros::UndistortDepth, nodelet::Nodelet);
@@ -31,6 +31,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <OgreSceneNode.h>
 #include <OgreSceneManager.h>
+#include <OgreCamera.h>
 
 #include <ros/time.h>
 
@@ -38,6 +39,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <rviz/display_context.h>
 #include <rviz/frame_manager.h>
+#include <rviz/view_manager.h>
+#include <rviz/view_controller.h>
 #include <rviz/ogre_helpers/point_cloud.h>
 #include <rviz/validate_floats.h>
 #include <rviz/properties/int_property.h>
@@ -67,7 +70,9 @@ MapCloudDisplay::CloudInfo::CloudInfo() :
 		manager_(0),
 		pose_(rtabmap::Transform::getIdentity()),
 		id_(0),
-		scene_node_(0)
+		scene_node_(0),
+		lod_shown_(false),
+		distance_(0.0f)
 {}
 
 MapCloudDisplay::CloudInfo::~CloudInfo()
@@ -87,6 +92,8 @@ void MapCloudDisplay::CloudInfo::clear()
 MapCloudDisplay::MapCloudDisplay()
   : spinner_(1, &cbqueue_),
 	lastCloudAdded_(-1),
+	cloud_generation_(0),
+	workers_stop_(false),
     new_xyz_transformer_(false),
     new_color_transformer_(false),
     needs_retransform_(false),
@@ -194,6 +201,41 @@ MapCloudDisplay::MapCloudDisplay()
 											 "Download the optimized global graph (without cloud data) using rtabmap/GetMap service.",
 											 this, SLOT( downloadGraph() ), this );
 
+	cloud_workers_ = new rviz::IntProperty( "Cloud workers", 2,
+										 "Number of background threads creating the clouds of the nodes.",
+										 this, SLOT( updateCloudWorkers() ), this );
+	cloud_workers_->setMin( 1 );
+	cloud_workers_->setMax( 16 );
+
+	render_budget_ = new rviz::FloatProperty( "Render budget (ms)", 10.0f,
+										 "Maximum time per frame spent to add new clouds to the scene, "
+										 "remaining clouds are added on next frames.",
+										 this, SLOT( updateCloudParameters() ), this );
+	render_budget_->setMin( 1.0f );
+	render_budget_->setMax( 1000.0f );
+
+	lod_distance_ = new rviz::FloatProperty( "LOD distance (m)", 0.0f,
+										 "(Disabled=0) Clouds farther than this distance from the camera are shown "
+										 "with a coarser voxel size (see \"LOD voxel factor\").",
+										 this, SLOT( updateCloudParameters() ), this );
+	lod_distance_->setMin( 0.0f );
+	lod_distance_->setMax( 999.0f );
+
+	lod_voxel_factor_ = new rviz::FloatProperty( "LOD voxel factor", 4.0f,
+										 "Voxel size of the far clouds, as a factor of the cloud voxel size "
+										 "(or 1 cm if cloud voxel size is 0).",
+										 this, SLOT( updateCloudParameters() ), this );
+	lod_voxel_factor_->setMin( 1.0f );
+	lod_voxel_factor_->setMax( 100.0f );
+
+	memory_budget_ = new rviz::IntProperty( "Memory budget (MB)", 0,
+										 "(Disabled=0) Approximate memory used by the clouds. When exceeded, clouds "
+										 "of the farthest and least recently used nodes are removed and re-created "
+										 "when memory is available again.",
+										 this, SLOT( updateCloudParameters() ), this );
+	memory_budget_->setMin( 0 );
+	memory_budget_->setMax( 100000 );
+
 	// PointCloudCommon sets up a callback queue with a thread for each
 	// instance.  Use that for processing incoming messages.
 	update_nh_.setCallbackQueue( &cbqueue_ );
@@ -201,6 +243,8 @@ MapCloudDisplay::MapCloudDisplay()
 
 MapCloudDisplay::~MapCloudDisplay()
 {
+	stopCloudWorkers();
+
 	if ( transformer_class_loader_ )
 	{
 		delete transformer_class_loader_;
@@ -255,137 +299,272 @@ void MapCloudDisplay::onInitialize()
 	updateBillboardSize();
 	updateAlpha();
 
+	startCloudWorkers();
 	spinner_.start();
 }
 
+void MapCloudDisplay::startCloudWorkers()
+{
+	workers_stop_ = false;
+	for(int i=0; i<cloud_workers_->getInt(); ++i)
+	{
+		cloud_workers_threads_.push_back(new boost::thread(boost::bind(&MapCloudDisplay::cloudWorker, this)));
+	}
+}
+
+void MapCloudDisplay::stopCloudWorkers()
+{
+	{
+		boost::mutex::scoped_lock lock(cloud_jobs_mutex_);
+		workers_stop_ = true;
+	}
+	cloud_jobs_cond_.notify_all();
+	for(unsigned int i=0; i<cloud_workers_threads_.size(); ++i)
+	{
+		cloud_workers_threads_[i]->join();
+		delete cloud_workers_threads_[i];
+	}
+	cloud_workers_threads_.clear();
+}
+
+void MapCloudDisplay::updateCloudWorkers()
+{
+	stopCloudWorkers();
+	startCloudWorkers();
+}
+
 void MapCloudDisplay::processMessage( const rtabmap_ros::MapDataConstPtr& msg )
 {
-	processMapData(*msg);
+	processMapData(*msg, msg);
 
 	this->emitTimeSignal(msg->header.stamp);
 }
 
-void MapCloudDisplay::processMapData(const rtabmap_ros::MapData& map)
+int MapCloudDisplay::processMapData(const rtabmap_ros::MapData& map, const boost::shared_ptr<const void> & owner)
 {
 	std::map<int, rtabmap::Transform> poses;
-	for(unsigned int i=0; i<map.graph.posesId.size() && i<map.graph.poses.size(); ++i)
+	if(rtabmap_ros::mapGraphIsPacked(map.graph))
+	{
+		std::multimap<int, rtabmap::Link> links;
+		rtabmap::Transform mapToOdom;
+		rtabmap_ros::mapGraphFromROS(map.graph, poses, links, mapToOdom);
+	}
+	else
 	{
-		poses.insert(std::make_pair(map.graph.posesId[i], rtabmap_ros::transformFromPoseMsg(map.graph.poses[i])));
+		for(unsigned int i=0; i<map.graph.posesId.size() && i<map.graph.poses.size(); ++i)
+		{
+			poses.insert(std::make_pair(map.graph.posesId[i], rtabmap_ros::transformFromPoseMsg(map.graph.poses[i])));
+		}
 	}
+	int posesCount = (int)poses.size();
 
-	// Add new clouds...
+	// Add new clouds, they are created in background by the cloud workers
 	bool fromDepth = !cloud_from_scan_->getBool();
 	for(unsigned int i=0; i<map.nodes.size() && i<map.nodes.size(); ++i)
 	{
 		int id = map.nodes[i].id;
 
 		// Always refresh the cloud if there are data
-		rtabmap::Signature s = rtabmap_ros::nodeDataFromROS(map.nodes[i]);
+		rtabmap::Signature s = rtabmap_ros::nodeDataFromROS(map.nodes[i], owner);
 		if((fromDepth &&
 			!s.sensorData().imageCompressed().empty() &&
 		    !s.sensorData().depthOrRightCompressed().empty() &&
 		    (s.sensorData().cameraModels().size() || s.sensorData().stereoCameraModel().isValidForProjection())) ||
 		   (!fromDepth && !s.sensorData().laserScanCompressed().isEmpty()))
 		{
-			cv::Mat image, depth;
-			rtabmap::LaserScan scan;
-
-			s.sensorData().uncompressData(fromDepth?&image:0, fromDepth?&depth:0, !fromDepth?&scan:0);
-
-			sensor_msgs::PointCloud2::Ptr cloudMsg(new sensor_msgs::PointCloud2);
-			if(fromDepth && !s.sensorData().imageRaw().empty() && !s.sensorData().depthOrRightRaw().empty())
-			{
-				pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud;
-				pcl::IndicesPtr validIndices(new std::vector<int>);
+			CloudJobPtr job(new CloudJob);
+			job->id_ = id;
+			job->signature_ = s;
+			job->header_ = map.header;
+			job->owner_ = owner;
+			job->fromDepth_ = fromDepth;
+			job->decimation_ = cloud_decimation_->getInt();
+			job->maxDepth_ = cloud_max_depth_->getFloat();
+			job->minDepth_ = cloud_min_depth_->getFloat();
+			job->voxelSize_ = cloud_voxel_size_->getFloat();
+			job->lodVoxelSize_ = lod_distance_->getFloat() > 0.0f?
+					(job->voxelSize_>0.0f?job->voxelSize_:0.01f)*lod_voxel_factor_->getFloat():0.0f;
+			job->floorHeight_ = cloud_filter_floor_height_->getFloat();
+			job->ceilingHeight_ = cloud_filter_ceiling_height_->getFloat();
+			queueCloudJob(job);
+		}
+	}
 
-				cloud = rtabmap::util3d::cloudRGBFromSensorData(
-						s.sensorData(),
-						cloud_decimation_->getInt(),
-						cloud_max_depth_->getFloat(),
-						cloud_min_depth_->getFloat(),
-						validIndices.get());
+	// Update graph
+	if(node_filtering_angle_->getFloat() > 0.0f && node_filtering_radius_->getFloat() > 0.0f)
+	{
+		poses = rtabmap::graph::radiusPosesFiltering(poses,
+				node_filtering_radius_->getFloat(),
+				node_filtering_angle_->getFloat()*CV_PI/180.0);
+	}
 
-				if(!cloud->empty())
-				{
-					if(cloud_voxel_size_->getFloat())
-					{
-						cloud = rtabmap::util3d::voxelize(cloud, validIndices, cloud_voxel_size_->getFloat());
-					}
+	{
+		boost::mutex::scoped_lock lock(current_map_mutex_);
+		current_map_ = poses;
+	}
+	return posesCount;
+}
 
-					if(cloud_filter_floor_height_->getFloat() > 0.0f || cloud_filter_ceiling_height_->getFloat() > 0.0f)
-					{
-						// convert in /odom frame
-						cloud = rtabmap::util3d::transformPointCloud(cloud, s.getPose());
-						cloud = rtabmap::util3d::passThrough(cloud, "z",
-								cloud_filter_floor_height_->getFloat()>0.0f?cloud_filter_floor_height_->getFloat():-999.0f,
-								cloud_filter_ceiling_height_->getFloat()>0.0f && (cloud_filter_floor_height_->getFloat()<=0.0f || cloud_filter_ceiling_height_->getFloat()>cloud_filter_floor_height_->getFloat())?cloud_filter_ceiling_height_->getFloat():999.0f);
-						// convert back in /base_link frame
-						cloud = rtabmap::util3d::transformPointCloud(cloud, s.getPose().inverse());
-					}
+void MapCloudDisplay::queueCloudJob(const CloudJobPtr & job)
+{
+	{
+		boost::mutex::scoped_lock lock(cloud_jobs_mutex_);
+		{
+			boost::mutex::scoped_lock lockClouds(new_clouds_mutex_);
+			job->generation_ = cloud_generation_;
+		}
+		// only the latest data of a node is processed
+		for(std::deque<CloudJobPtr>::iterator iter=cloud_jobs_.begin(); iter!=cloud_jobs_.end(); ++iter)
+		{
+			if((*iter)->id_ == job->id_)
+			{
+				cloud_jobs_.erase(iter);
+				break;
+			}
+		}
+		cloud_jobs_.push_back(job);
+		evicted_clouds_.erase(job->id_);
+		if(memory_budget_->getInt() > 0)
+		{
+			cloud_sources_[job->id_] = job;
+		}
+	}
+	cloud_jobs_cond_.notify_one();
+}
 
-					if(!cloud->empty())
-					{
-						pcl::toROSMsg(*cloud, *cloudMsg);
-					}
-				}
+void MapCloudDisplay::cloudWorker()
+{
+	while(true)
+	{
+		CloudJobPtr job;
+		{
+			boost::mutex::scoped_lock lock(cloud_jobs_mutex_);
+			while(!workers_stop_ && cloud_jobs_.empty())
+			{
+				cloud_jobs_cond_.wait(lock);
 			}
-			else if(!fromDepth && !scan.isEmpty())
+			if(workers_stop_)
 			{
-				scan = rtabmap::util3d::commonFiltering(
-						scan,
-						1,
-						cloud_min_depth_->getFloat(),
-						cloud_max_depth_->getFloat(),
-						cloud_voxel_size_->getFloat());
-				pcl::PointCloud<pcl::PointXYZI>::Ptr cloud;
-				cloud = rtabmap::util3d::laserScanToPointCloudI(scan, scan.localTransform());
-				if(cloud_filter_floor_height_->getFloat() > 0.0f || cloud_filter_ceiling_height_->getFloat() > 0.0f)
-				{
-					// convert in /odom frame
-					cloud = rtabmap::util3d::transformPointCloud(cloud, s.getPose());
-					cloud = rtabmap::util3d::passThrough(cloud, "z",
-							cloud_filter_floor_height_->getFloat()>0.0f?cloud_filter_floor_height_->getFloat():-999.0f,
-							cloud_filter_ceiling_height_->getFloat()>0.0f && (cloud_filter_floor_height_->getFloat()<=0.0f || cloud_filter_ceiling_height_->getFloat()>cloud_filter_floor_height_->getFloat())?cloud_filter_ceiling_height_->getFloat():999.0f);
-					// convert back in /base_link frame
-					cloud = rtabmap::util3d::transformPointCloud(cloud, s.getPose().inverse());
-				}
+				return;
+			}
+			job = cloud_jobs_.front();
+			cloud_jobs_.pop_front();
+		}
 
-				if(!cloud->empty())
-				{
-					pcl::toROSMsg(*cloud, *cloudMsg);
-				}
+		CloudInfoPtr info = createCloudInfo(*job);
+		if(info.get())
+		{
+			boost::mutex::scoped_lock lock(new_clouds_mutex_);
+			// ignore clouds of jobs queued before a reset
+			if(job->generation_ == cloud_generation_)
+			{
+				new_cloud_infos_.erase(job->id_);
+				new_cloud_infos_.insert(std::make_pair(job->id_, info));
 			}
+		}
+	}
+}
 
-			if(!cloudMsg->data.empty())
+template<typename PointT>
+void filterCloudHeight(typename pcl::PointCloud<PointT>::Ptr & cloud, const rtabmap::Transform & pose, float floorHeight, float ceilingHeight)
+{
+	if(floorHeight > 0.0f || ceilingHeight > 0.0f)
+	{
+		// convert in /odom frame
+		cloud = rtabmap::util3d::transformPointCloud(cloud, pose);
+		cloud = rtabmap::util3d::passThrough(cloud, "z",
+				floorHeight>0.0f?floorHeight:-999.0f,
+				ceilingHeight>0.0f && (floorHeight<=0.0f || ceilingHeight>floorHeight)?ceilingHeight:999.0f);
+		// convert back in /base_link frame
+		cloud = rtabmap::util3d::transformPointCloud(cloud, pose.inverse());
+	}
+}
+
+MapCloudDisplay::CloudInfoPtr MapCloudDisplay::createCloudInfo(const CloudJob & job)
+{
+	// work on a copy to not keep uncompressed data in the sources
+	rtabmap::SensorData data = job.signature_.sensorData();
+	cv::Mat image, depth;
+	rtabmap::LaserScan scan;
+
+	data.uncompressData(job.fromDepth_?&image:0, job.fromDepth_?&depth:0, !job.fromDepth_?&scan:0);
+
+	sensor_msgs::PointCloud2::Ptr cloudMsg(new sensor_msgs::PointCloud2);
+	sensor_msgs::PointCloud2::Ptr lodCloudMsg;
+	if(job.fromDepth_ && !data.imageRaw().empty() && !data.depthOrRightRaw().empty())
+	{
+		pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud;
+		pcl::IndicesPtr validIndices(new std::vector<int>);
+
+		cloud = rtabmap::util3d::cloudRGBFromSensorData(
+				data,
+				job.decimation_,
+				job.maxDepth_,
+				job.minDepth_,
+				validIndices.get());
+
+		if(!cloud->empty())
+		{
+			if(job.voxelSize_)
 			{
-				cloudMsg->header = map.header;
-				CloudInfoPtr info(new CloudInfo);
-				info->message_ = cloudMsg;
-				info->pose_ = rtabmap::Transform::getIdentity();
-				info->id_ = id;
+				cloud = rtabmap::util3d::voxelize(cloud, validIndices, job.voxelSize_);
+			}
+
+			filterCloudHeight<pcl::PointXYZRGB>(cloud, job.signature_.getPose(), job.floorHeight_, job.ceilingHeight_);
 
-				if (transformCloud(info, true))
+			if(!cloud->empty())
+			{
+				pcl::toROSMsg(*cloud, *cloudMsg);
+				if(job.lodVoxelSize_ > job.voxelSize_)
 				{
-					boost::mutex::scoped_lock lock(new_clouds_mutex_);
-					new_cloud_infos_.erase(id);
-					new_cloud_infos_.insert(std::make_pair(id, info));
+					lodCloudMsg.reset(new sensor_msgs::PointCloud2);
+					pcl::toROSMsg(*rtabmap::util3d::voxelize(cloud, job.lodVoxelSize_), *lodCloudMsg);
 				}
 			}
 		}
 	}
-
-	// Update graph
-	if(node_filtering_angle_->getFloat() > 0.0f && node_filtering_radius_->getFloat() > 0.0f)
+	else if(!job.fromDepth_ && !scan.isEmpty())
 	{
-		poses = rtabmap::graph::radiusPosesFiltering(poses,
-				node_filtering_radius_->getFloat(),
-				node_filtering_angle_->getFloat()*CV_PI/180.0);
+		scan = rtabmap::util3d::commonFiltering(
+				scan,
+				1,
+				job.minDepth_,
+				job.maxDepth_,
+				job.voxelSize_);
+		pcl::PointCloud<pcl::PointXYZI>::Ptr cloud;
+		cloud = rtabmap::util3d::laserScanToPointCloudI(scan, scan.localTransform());
+		filterCloudHeight<pcl::PointXYZI>(cloud, job.signature_.getPose(), job.floorHeight_, job.ceilingHeight_);
+
+		if(!cloud->empty())
+		{
+			pcl::toROSMsg(*cloud, *cloudMsg);
+			if(job.lodVoxelSize_ > job.voxelSize_)
+			{
+				lodCloudMsg.reset(new sensor_msgs::PointCloud2);
+				pcl::toROSMsg(*rtabmap::util3d::voxelize(cloud, job.lodVoxelSize_), *lodCloudMsg);
+			}
+		}
 	}
 
+	if(!cloudMsg->data.empty())
 	{
-		boost::mutex::scoped_lock lock(current_map_mutex_);
-		current_map_ = poses;
+		cloudMsg->header = job.header_;
+		CloudInfoPtr info(new CloudInfo);
+		info->message_ = cloudMsg;
+		if(lodCloudMsg.get() && !lodCloudMsg->data.empty())
+		{
+			lodCloudMsg->header = job.header_;
+			info->lod_message_ = lodCloudMsg;
+		}
+		info->pose_ = rtabmap::Transform::getIdentity();
+		info->id_ = job.id_;
+
+		if (transformCloud(info, true))
+		{
+			return info;
+		}
 	}
+	return CloudInfoPtr();
 }
 
 void MapCloudDisplay::setPropertiesHidden( const QList<Property*>& props, bool hide )
@@ -561,13 +740,13 @@ void MapCloudDisplay::downloadMap()
 		}
 		else
 		{
-			messageBox->setText(tr("Creating all clouds (%1 poses and %2 clouds downloaded)...")
-					.arg(getMapSrv.response.data.graph.poses.size()).arg(getMapSrv.response.data.nodes.size()));
+			messageBox->setText(tr("Creating all clouds (%1 clouds downloaded)...")
+					.arg(getMapSrv.response.data.nodes.size()));
 			QApplication::processEvents();
 			this->reset();
-			processMapData(getMapSrv.response.data);
-			messageBox->setText(tr("Creating all clouds (%1 poses and %2 clouds downloaded)... done!")
-					.arg(getMapSrv.response.data.graph.poses.size()).arg(getMapSrv.response.data.nodes.size()));
+			int poses = processMapData(getMapSrv.response.data);
+			messageBox->setText(tr("Creating all clouds (%1 poses and %2 clouds downloaded)... done! Clouds are added in background.")
+					.arg(poses).arg(getMapSrv.response.data.nodes.size()));
 
 			QTimer::singleShot(1000, messageBox, SLOT(close()));
 		}
@@ -619,10 +798,10 @@ void MapCloudDisplay::downloadGraph()
 		}
 		else
 		{
-			messageBox->setText(tr("Updating the map (%1 nodes downloaded)...").arg(getMapSrv.response.data.graph.poses.size()));
+			messageBox->setText(tr("Updating the map..."));
 			QApplication::processEvents();
-			processMapData(getMapSrv.response.data);
-			messageBox->setText(tr("Updating the map (%1 nodes downloaded)... done!").arg(getMapSrv.response.data.graph.poses.size()));
+			int poses = processMapData(getMapSrv.response.data);
+			messageBox->setText(tr("Updating the map (%1 nodes downloaded)... done!").arg(poses));
 
 			QTimer::singleShot(1000, messageBox, SLOT(close()));
 		}
@@ -657,45 +836,55 @@ void MapCloudDisplay::update( float wall_dt, float ros_dt )
 		needs_retransform_ = false;
 	}
 
+	// Add clouds created by the workers, up to the render budget per frame
+	float size;
+	if( mode == rviz::PointCloud::RM_POINTS ) {
+		size = point_pixel_size_property_->getFloat();
+	} else {
+		size = point_world_size_property_->getFloat();
+	}
+	ros::WallTime addStart = ros::WallTime::now();
+	double budget = render_budget_->getFloat()/1000.0;
+	while((ros::WallTime::now() - addStart).toSec() < budget)
 	{
-		boost::mutex::scoped_lock lock(new_clouds_mutex_);
-		if( !new_cloud_infos_.empty() )
+		CloudInfoPtr cloud_info;
 		{
-			float size;
-			if( mode == rviz::PointCloud::RM_POINTS ) {
-				size = point_pixel_size_property_->getFloat();
-			} else {
-				size = point_world_size_property_->getFloat();
-			}
-
-			std::map<int, CloudInfoPtr>::iterator it = new_cloud_infos_.begin();
-			std::map<int, CloudInfoPtr>::iterator end = new_cloud_infos_.end();
-			for (; it != end; ++it)
+			boost::mutex::scoped_lock lock(new_clouds_mutex_);
+			if(new_cloud_infos_.empty())
 			{
-				CloudInfoPtr cloud_info = it->second;
+				break;
+			}
+			cloud_info = new_cloud_infos_.begin()->second;
+			new_cloud_infos_.erase(new_cloud_infos_.begin());
+		}
 
-				cloud_info->cloud_.reset( new rviz::PointCloud() );
-				cloud_info->cloud_->addPoints( &(cloud_info->transformed_points_.front()), cloud_info->transformed_points_.size() );
-				cloud_info->cloud_->setRenderMode( mode );
-				cloud_info->cloud_->setAlpha( alpha_property_->getFloat() );
-				cloud_info->cloud_->setDimensions( size, size, size );
-				cloud_info->cloud_->setAutoSize(false);
+		cloud_info->cloud_.reset( new rviz::PointCloud() );
+		cloud_info->cloud_->addPoints( &(cloud_info->transformed_points_.front()), cloud_info->transformed_points_.size() );
+		cloud_info->cloud_->setRenderMode( mode );
+		cloud_info->cloud_->setAlpha( alpha_property_->getFloat() );
+		cloud_info->cloud_->setDimensions( size, size, size );
+		cloud_info->cloud_->setAutoSize(false);
 
-				cloud_info->manager_ = context_->getSceneManager();
+		cloud_info->manager_ = context_->getSceneManager();
 
-				cloud_info->scene_node_ = scene_node_->createChildSceneNode();
+		cloud_info->scene_node_ = scene_node_->createChildSceneNode();
 
-				cloud_info->scene_node_->attachObject( cloud_info->cloud_.get() );
-				cloud_info->scene_node_->setVisible(false);
+		cloud_info->scene_node_->attachObject( cloud_info->cloud_.get() );
+		cloud_info->scene_node_->setVisible(false);
+		cloud_info->last_used_ = addStart;
 
-				cloud_infos_.erase(it->first);
-				cloud_infos_.insert(*it);
-				lastCloudAdded = it->first;
-			}
+		cloud_infos_.erase(cloud_info->id_);
+		cloud_infos_.insert(std::make_pair(cloud_info->id_, cloud_info));
+		lastCloudAdded = cloud_info->id_;
+	}
 
-			new_cloud_infos_.clear();
-		}
+	Ogre::Vector3 cameraPosition = Ogre::Vector3::ZERO;
+	if(context_->getViewManager() && context_->getViewManager()->getCurrent() && context_->getViewManager()->getCurrent()->getCamera())
+	{
+		cameraPosition = context_->getViewManager()->getCurrent()->getCamera()->getDerivedPosition();
 	}
+	float lodDistance = lod_distance_->getFloat();
+	ros::WallTime now = ros::WallTime::now();
 
 	{
 		boost::recursive_mutex::scoped_try_lock lock( transformers_mutex_ );
@@ -733,7 +922,6 @@ void MapCloudDisplay::update( float wall_dt, float ros_dt )
 				std::map<int, CloudInfoPtr>::iterator cloudInfoIt = cloud_infos_.find(it->first);
 				if(cloudInfoIt != cloud_infos_.end())
 				{
-					totalPoints += cloudInfoIt->second->transformed_points_.size();
 					cloudInfoIt->second->pose_ = it->second;
 					Ogre::Vector3 framePosition;
 					Ogre::Quaternion frameOrientation;
@@ -756,6 +944,24 @@ void MapCloudDisplay::update( float wall_dt, float ros_dt )
 						cloudInfoIt->second->scene_node_->setOrientation(poseOrientation);
 						cloudInfoIt->second->scene_node_->setVisible(true);
 						++totalNodesShown;
+
+						// level of detail, with some hysteresis to avoid switching back and forth
+						CloudInfo & info = *cloudInfoIt->second;
+						info.distance_ = posePosition.distance(cameraPosition);
+						bool showLod = !info.lod_transformed_points_.empty() && lodDistance > 0.0f &&
+								info.distance_ > (info.lod_shown_?0.9f:1.1f)*lodDistance;
+						if(showLod != info.lod_shown_)
+						{
+							info.lod_shown_ = showLod;
+							const rviz::V_PointCloudPoint & points = showLod?info.lod_transformed_points_:info.transformed_points_;
+							info.cloud_->clear();
+							info.cloud_->addPoints(&points.front(), points.size());
+						}
+						if(!info.lod_shown_)
+						{
+							info.last_used_ = now;
+						}
+						totalPoints += info.lod_shown_?info.lod_transformed_points_.size():info.transformed_points_.size();
 					}
 					else
 					{
@@ -793,15 +999,129 @@ void MapCloudDisplay::update( float wall_dt, float ros_dt )
 		lastCloudAdded_ = lastCloudAdded;
 	}
 
+	if(memory_budget_->getInt() > 0)
+	{
+		size_t memoryUsed = 0;
+		for(std::map<int, CloudInfoPtr>::iterator iter = cloud_infos_.begin(); iter!=cloud_infos_.end(); ++iter)
+		{
+			memoryUsed += cloudMemory(*iter->second);
+		}
+		evictClouds(memoryUsed, size_t(memory_budget_->getInt())*1024*1024);
+	}
+
 	this->setStatusStd(rviz::StatusProperty::Ok, "Points", tr("%1").arg(totalPoints).toStdString());
 	this->setStatusStd(rviz::StatusProperty::Ok, "Nodes", tr("%1 shown of %2").arg(totalNodesShown).arg(cloud_infos_.size()).toStdString());
 }
 
+size_t MapCloudDisplay::cloudMemory(const CloudInfo & info) const
+{
+	// Approximation: our transformed points, plus for the shown points
+	// the copy kept by rviz::PointCloud and its vertex buffer (up to 6 vertices per point).
+	size_t shown = info.lod_shown_?info.lod_transformed_points_.size():info.transformed_points_.size();
+	return (info.transformed_points_.size() + info.lod_transformed_points_.size() + shown) * sizeof(rviz::PointCloud::Point) +
+			shown * 6 * (sizeof(Ogre::Vector3) + sizeof(uint32_t));
+}
+
+void MapCloudDisplay::evictClouds(size_t memoryUsed, size_t memoryBudget)
+{
+	ros::WallTime now = ros::WallTime::now();
+	if(memoryUsed > memoryBudget)
+	{
+		// least recently used (at full resolution) first, then farthest
+		std::vector<std::pair<std::pair<double, float>, int> > candidates;
+		for(std::map<int, CloudInfoPtr>::iterator iter = cloud_infos_.begin(); iter!=cloud_infos_.end(); ++iter)
+		{
+			candidates.push_back(std::make_pair(std::make_pair(iter->second->last_used_.toSec(), -iter->second->distance_), iter->first));
+		}
+		std::sort(candidates.begin(), candidates.end());
+
+		boost::mutex::scoped_lock lock(cloud_jobs_mutex_);
+		for(unsigned int i=0; i<candidates.size() && memoryUsed > memoryBudget*9/10; ++i)
+		{
+			std::map<int, CloudInfoPtr>::iterator iter = cloud_infos_.find(candidates[i].second);
+			if((now - iter->second->last_used_).toSec() < 1.0)
+			{
+				// all remaining clouds are currently used
+				break;
+			}
+			memoryUsed -= cloudMemory(*iter->second);
+			if(cloud_sources_.find(iter->first) != cloud_sources_.end())
+			{
+				evicted_clouds_.insert(iter->first);
+			}
+			if(iter->first == lastCloudAdded_)
+			{
+				lastCloudAdded_ = -1;
+			}
+			cloud_infos_.erase(iter);
+		}
+	}
+	else if(memoryUsed < memoryBudget*3/4)
+	{
+		// re-create the nearest evicted cloud still in the map
+		CloudJobPtr job;
+		{
+			boost::mutex::scoped_lock lock(cloud_jobs_mutex_);
+			if(evicted_clouds_.empty() || !cloud_jobs_.empty())
+			{
+				return;
+			}
+			Ogre::Vector3 cameraPosition = Ogre::Vector3::ZERO;
+			if(context_->getViewManager() && context_->getViewManager()->getCurrent() && context_->getViewManager()->getCurrent()->getCamera())
+			{
+				cameraPosition = context_->getViewManager()->getCurrent()->getCamera()->getDerivedPosition();
+			}
+			boost::mutex::scoped_lock lockMap(current_map_mutex_);
+			float minDistance = -1.0f;
+			for(std::set<int>::iterator iter=evicted_clouds_.begin(); iter!=evicted_clouds_.end();)
+			{
+				std::map<int, rtabmap::Transform>::iterator poseIter = current_map_.find(*iter);
+				std::map<int, CloudJobPtr>::iterator sourceIter = cloud_sources_.find(*iter);
+				if(sourceIter == cloud_sources_.end())
+				{
+					evicted_clouds_.erase(iter++);
+					continue;
+				}
+				Ogre::Vector3 framePosition;
+				Ogre::Quaternion frameOrientation;
+				if(poseIter != current_map_.end() &&
+				   context_->getFrameManager()->getTransform(sourceIter->second->header_, framePosition, frameOrientation))
+				{
+					const rtabmap::Transform & p = poseIter->second;
+					Ogre::Vector3 position = framePosition + frameOrientation * Ogre::Vector3(p.x(), p.y(), p.z());
+					float distance = position.distance(cameraPosition);
+					if(minDistance < 0.0f || distance < minDistance)
+					{
+						minDistance = distance;
+						job = sourceIter->second;
+					}
+				}
+				++iter;
+			}
+			if(job.get())
+			{
+				evicted_clouds_.erase(job->id_);
+			}
+		}
+		if(job.get())
+		{
+			queueCloudJob(job);
+		}
+	}
+}
+
 void MapCloudDisplay::reset()
 {
 	lastCloudAdded_ = -1;
+	{
+		boost::mutex::scoped_lock lock(cloud_jobs_mutex_);
+		cloud_jobs_.clear();
+		cloud_sources_.clear();
+		evicted_clouds_.clear();
+	}
 	{
 		boost::mutex::scoped_lock lock(new_clouds_mutex_);
+		++cloud_generation_;
 		cloud_infos_.clear();
 		new_cloud_infos_.clear();
 	}
@@ -911,7 +1231,8 @@ void MapCloudDisplay::retransform()
 		const CloudInfoPtr& cloud_info = it->second;
 		transformCloud(cloud_info, false);
 		cloud_info->cloud_->clear();
-		cloud_info->cloud_->addPoints(&cloud_info->transformed_points_.front(), cloud_info->transformed_points_.size());
+		const rviz::V_PointCloudPoint & points = cloud_info->lod_shown_?cloud_info->lod_transformed_points_:cloud_info->transformed_points_;
+		cloud_info->cloud_->addPoints(&points.front(), points.size());
 	}
 }
 
@@ -953,6 +1274,24 @@ bool MapCloudDisplay::transformCloud(const CloudInfoPtr& cloud_info, bool update
 
 		xyz_trans->transform(cloud_info->message_, rviz::PointCloudTransformer::Support_XYZ, Ogre::Matrix4::IDENTITY, cloud_points);
 		color_trans->transform(cloud_info->message_, rviz::PointCloudTransformer::Support_Color, Ogre::Matrix4::IDENTITY, cloud_points);
+
+		if(cloud_info->lod_message_.get())
+		{
+			rviz::V_PointCloudPoint& lod_points = cloud_info->lod_transformed_points_;
+			lod_points.clear();
+			lod_points.resize(cloud_info->lod_message_->width * cloud_info->lod_message_->height, default_pt);
+			xyz_trans->transform(cloud_info->lod_message_, rviz::PointCloudTransformer::Support_XYZ, Ogre::Matrix4::IDENTITY, lod_points);
+			color_trans->transform(cloud_info->lod_message_, rviz::PointCloudTransformer::Support_Color, Ogre::Matrix4::IDENTITY, lod_points);
+			for (rviz::V_PointCloudPoint::iterator cloud_point = lod_points.begin(); cloud_point != lod_points.end(); ++cloud_point)
+			{
+				if (!rviz::validateFloats(cloud_point->position))
+				{
+					cloud_point->position.x = 999999.0f;
+					cloud_point->position.y = 999999.0f;
+					cloud_point->position.z = 999999.0f;
+				}
+			}
+		}
 	}
 
 	for (rviz::V_PointCloudPoint::iterator cloud_point = cloud_points.begin(); cloud_point != cloud_points.end(); ++cloud_point)
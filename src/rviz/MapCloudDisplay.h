@@ -31,11 +31,16 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef Q_MOC_RUN  // See: https://bugreports.qt-project.org/browse/QTBUG-22829
 
 #include <deque>
+#include <set>
 #include <queue>
 #include <vector>
 
 #include <rtabmap_ros/MapData.h>
 #include <rtabmap/core/Transform.h>
+#include <rtabmap/core/Signature.h>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
 
 #include <pluginlib/class_loader.h>
 #include <sensor_msgs/PointCloud2.h>
@@ -88,6 +93,7 @@ public:
 		Ogre::SceneManager *manager_;
 
 		sensor_msgs::PointCloud2ConstPtr message_;
+		sensor_msgs::PointCloud2ConstPtr lod_message_; // coarser cloud shown when far from the camera
 		rtabmap::Transform pose_;
 		int id_;
 
@@ -95,9 +101,35 @@ public:
 		boost::shared_ptr<rviz::PointCloud> cloud_;
 
 		std::vector<rviz::PointCloud::Point> transformed_points_;
+		std::vector<rviz::PointCloud::Point> lod_transformed_points_;
+		bool lod_shown_;
+		float distance_; // from the camera on last update
+		ros::WallTime last_used_; // last time shown at full resolution
 	};
 	typedef boost::shared_ptr<CloudInfo> CloudInfoPtr;
 
+	/**
+	 * Data and parameters required to create the cloud of a node, processed by the worker threads.
+	 */
+	struct CloudJob
+	{
+		int id_;
+		int generation_;
+		rtabmap::Signature signature_;
+		std_msgs::Header header_;
+		boost::shared_ptr<const void> owner_;
+
+		bool fromDepth_;
+		int decimation_;
+		float maxDepth_;
+		float minDepth_;
+		float voxelSize_;
+		float lodVoxelSize_;
+		float floorHeight_;
+		float ceilingHeight_;
+	};
+	typedef boost::shared_ptr<CloudJob> CloudJobPtr;
+
 	MapCloudDisplay();
 	virtual ~MapCloudDisplay();
 
@@ -121,6 +153,11 @@ public:
 	rviz::FloatProperty* node_filtering_angle_;
 	rviz::BoolProperty* download_map_;
 	rviz::BoolProperty* download_graph_;
+	rviz::IntProperty* cloud_workers_;
+	rviz::FloatProperty* render_budget_;
+	rviz::FloatProperty* lod_distance_;
+	rviz::FloatProperty* lod_voxel_factor_;
+	rviz::IntProperty* memory_budget_;
 
 public Q_SLOTS:
 	void causeRetransform();
@@ -136,6 +173,7 @@ private Q_SLOTS:
 	void updateCloudParameters();
 	void downloadMap();
 	void downloadGraph();
+	void updateCloudWorkers();
 
 protected:
 	/** @brief Do initialization. Overridden from MessageFilterDisplay. */
@@ -145,7 +183,8 @@ protected:
 	virtual void processMessage( const rtabmap_ros::MapDataConstPtr& cloud );
 
 private:
-	void processMapData(const rtabmap_ros::MapData& map);
+	// Returns the number of poses of the graph (packed or not)
+	int processMapData(const rtabmap_ros::MapData& map, const boost::shared_ptr<const void> & owner = boost::shared_ptr<const void>());
 
 	/**
 	* \brief Transforms the cloud into the correct frame, and sets up our renderable cloud
@@ -162,6 +201,14 @@ private:
 	void setPropertiesHidden( const QList<Property*>& props, bool hide );
 	void fillTransformerOptions( rviz::EnumProperty* prop, uint32_t mask );
 
+	void startCloudWorkers();
+	void stopCloudWorkers();
+	void cloudWorker();
+	CloudInfoPtr createCloudInfo(const CloudJob & job);
+	void queueCloudJob(const CloudJobPtr & job);
+	size_t cloudMemory(const CloudInfo & info) const;
+	void evictClouds(size_t memoryUsed, size_t memoryBudget);
+
 private:
 	ros::AsyncSpinner spinner_;
 	ros::CallbackQueue cbqueue_;
@@ -174,6 +221,16 @@ private:
 	std::map<int, rtabmap::Transform> current_map_;
 	boost::mutex current_map_mutex_;
 
+	// cloud generation in background
+	std::deque<CloudJobPtr> cloud_jobs_;
+	std::map<int, CloudJobPtr> cloud_sources_; // kept to re-create evicted clouds (memory budget set)
+	std::set<int> evicted_clouds_;
+	int cloud_generation_;
+	bool workers_stop_;
+	boost::mutex cloud_jobs_mutex_;
+	boost::condition_variable cloud_jobs_cond_;
+	std::vector<boost::thread*> cloud_workers_threads_;
+
 	int lastCloudAdded_;
 
 	struct TransformerInfo
@@ -32,6 +32,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <OgreManualObject.h>
 #include <OgreBillboardSet.h>
 #include <OgreMatrix4.h>
+#include <OgreHardwareVertexBuffer.h>
+#include <OgreAxisAlignedBox.h>
 
 #include <tf/transform_listener.h>
 
@@ -49,6 +51,48 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 namespace rtabmap_ros
 {
 
+// one vertex buffer per link color
+enum LinkBatchType
+{
+	kBatchNeighbor,
+	kBatchNeighborMerged,
+	kBatchVirtual,
+	kBatchUser,
+	kBatchLocal,
+	kBatchLandmark,
+	kBatchGlobal,
+	kBatchCount
+};
+
+static LinkBatchType linkBatchType(rtabmap::Link::Type type)
+{
+	if(type == rtabmap::Link::kNeighbor)
+	{
+		return kBatchNeighbor;
+	}
+	else if(type == rtabmap::Link::kNeighborMerged)
+	{
+		return kBatchNeighborMerged;
+	}
+	else if(type == rtabmap::Link::kVirtualClosure)
+	{
+		return kBatchVirtual;
+	}
+	else if(type == rtabmap::Link::kUserClosure)
+	{
+		return kBatchUser;
+	}
+	else if(type == rtabmap::Link::kLocalSpaceClosure || type == rtabmap::Link::kLocalTimeClosure)
+	{
+		return kBatchLocal;
+	}
+	else if(type == rtabmap::Link::kLandmark)
+	{
+		return kBatchLandmark;
+	}
+	return kBatchGlobal;
+}
+
 MapGraphDisplay::MapGraphDisplay()
 {
 	color_neighbor_property_ = new rviz::ColorProperty( "Neighbor", Qt::blue,
@@ -68,6 +112,11 @@ MapGraphDisplay::MapGraphDisplay()
 
 	alpha_property_ = new rviz::FloatProperty( "Alpha", 1.0,
                                        "Amount of transparency to apply to the path.", this );
+
+	update_threshold_property_ = new rviz::FloatProperty( "Update threshold (m)", 0.01,
+                                       "When the links didn't change since the last graph, only vertices of poses "
+                                       "that moved more than this distance are updated.", this );
+	update_threshold_property_->setMin( 0.0 );
 }
 
 MapGraphDisplay::~MapGraphDisplay()
@@ -89,17 +138,109 @@ void MapGraphDisplay::reset()
 
 void MapGraphDisplay::destroyObjects()
 {
-	for(unsigned int i=0; i<manual_objects_.size(); ++i)
+	for(unsigned int i=0; i<batches_.size(); ++i)
 	{
-		manual_objects_[i]->clear();
-		scene_manager_->destroyManualObject( manual_objects_[i] );
+		if(batches_[i].manual_object)
+		{
+			batches_[i].manual_object->clear();
+			scene_manager_->destroyManualObject( batches_[i].manual_object );
+		}
 	}
-	manual_objects_.clear();
+	batches_.clear();
+}
+
+void MapGraphDisplay::rebuildBatch(
+		LinkBatch & batch,
+		std::vector<std::pair<int, int> > & links,
+		std::vector<Ogre::Vector3> & positions,
+		const Ogre::ColourValue & color)
+{
+	if(batch.manual_object == 0)
+	{
+		batch.manual_object = scene_manager_->createManualObject();
+		batch.manual_object->setDynamic( true );
+		scene_node_->attachObject( batch.manual_object );
+	}
+
+	// keep some room so that the buffer is reused while the graph grows
+	batch.manual_object->estimateVertexCount(positions.size() + positions.size()/2);
+	if(batch.manual_object->getNumSections() == 0)
+	{
+		batch.manual_object->begin( "BaseWhiteNoLighting", Ogre::RenderOperation::OT_LINE_LIST );
+	}
+	else
+	{
+		batch.manual_object->beginUpdate(0);
+	}
+	for(unsigned int i=0; i<positions.size(); ++i)
+	{
+		batch.manual_object->position( positions[i].x, positions[i].y, positions[i].z );
+		batch.manual_object->colour( color );
+	}
+	batch.manual_object->end();
+
+	batch.links.swap(links);
+	batch.positions.swap(positions);
+	batch.color = color;
+}
+
+void MapGraphDisplay::updateBatch(LinkBatch & batch, const std::vector<Ogre::Vector3> & positions)
+{
+	float threshold = update_threshold_property_->getFloat();
+	threshold *= threshold;
+	int first = -1;
+	int last = -1;
+	for(unsigned int i=0; i<positions.size(); ++i)
+	{
+		if(positions[i].squaredDistance(batch.positions[i]) > threshold)
+		{
+			if(first < 0)
+			{
+				first = i;
+			}
+			last = i;
+		}
+	}
+	if(first < 0)
+	{
+		return;
+	}
+
+	// write only the vertices that moved directly in the existing vertex buffer
+	Ogre::RenderOperation* op = batch.manual_object->getSection(0)->getRenderOperation();
+	const Ogre::VertexElement* positionElement = op->vertexData->vertexDeclaration->findElementBySemantic(Ogre::VES_POSITION);
+	Ogre::HardwareVertexBufferSharedPtr vbuf = op->vertexData->vertexBufferBinding->getBuffer(positionElement->getSource());
+	size_t vertexSize = vbuf->getVertexSize();
+	unsigned char* data = static_cast<unsigned char*>(vbuf->lock(
+			(op->vertexData->vertexStart + first) * vertexSize,
+			(last - first + 1) * vertexSize,
+			Ogre::HardwareBuffer::HBL_NORMAL));
+	for(int i=first; i<=last; ++i)
+	{
+		if(positions[i].squaredDistance(batch.positions[i]) > threshold)
+		{
+			float* p;
+			positionElement->baseVertexPointerToElement(data + (i-first)*vertexSize, &p);
+			p[0] = positions[i].x;
+			p[1] = positions[i].y;
+			p[2] = positions[i].z;
+			batch.positions[i] = positions[i];
+		}
+	}
+	vbuf->unlock();
+
+	Ogre::AxisAlignedBox box;
+	for(unsigned int i=0; i<batch.positions.size(); ++i)
+	{
+		box.merge(batch.positions[i]);
+	}
+	batch.manual_object->setBoundingBox(box);
+	scene_node_->needUpdate();
 }
 
 void MapGraphDisplay::processMessage( const rtabmap_ros::MapGraph::ConstPtr& msg )
 {
-	if(!(msg->poses.size() == msg->posesId.size()))
+	if(!rtabmap_ros::mapGraphIsPacked(*msg) && !(msg->poses.size() == msg->posesId.size()))
 	{
 		ROS_ERROR("rtabmap_ros::MapGraph: Error pose ids and poses must have all the same size.");
 		return;
@@ -111,8 +252,6 @@ void MapGraphDisplay::processMessage( const rtabmap_ros::MapGraph::ConstPtr& msg
 	rtabmap::Transform mapToOdom;
 	rtabmap_ros::mapGraphFromROS(*msg, poses, links, mapToOdom);
 
-	destroyObjects();
-
 	Ogre::Vector3 position;
 	Ogre::Quaternion orientation;
 	if( !context_->getFrameManager()->getTransform( msg->header, position, orientation ))
@@ -123,62 +262,72 @@ void MapGraphDisplay::processMessage( const rtabmap_ros::MapGraph::ConstPtr& msg
 	Ogre::Matrix4 transform( orientation );
 	transform.setTrans( position );
 
-	if(links.size())
+	// sort the links by type
+	std::vector<std::vector<std::pair<int, int> > > batchLinks(kBatchCount);
+	std::vector<std::vector<Ogre::Vector3> > batchPositions(kBatchCount);
+	for(std::multimap<int, rtabmap::Link>::iterator iter=links.begin(); iter!=links.end(); ++iter)
 	{
-		Ogre::ColourValue color;
-		Ogre::ManualObject* manual_object = scene_manager_->createManualObject();
-		manual_object->setDynamic( true );
-		scene_node_->attachObject( manual_object );
-		manual_objects_.push_back(manual_object);
-
-		manual_object->estimateVertexCount(links.size() * 2);
-		manual_object->begin( "BaseWhiteNoLighting", Ogre::RenderOperation::OT_LINE_LIST );
-		for(std::multimap<int, rtabmap::Link>::iterator iter=links.begin(); iter!=links.end(); ++iter)
+		std::map<int, rtabmap::Transform>::iterator poseIterFrom = poses.find(iter->second.from());
+		std::map<int, rtabmap::Transform>::iterator poseIterTo = poses.find(iter->second.to());
+		if(poseIterFrom != poses.end() && poseIterTo != poses.end())
+		{
+			LinkBatchType type = linkBatchType(iter->second.type());
+			batchLinks[type].push_back(std::make_pair(iter->second.from(), iter->second.to()));
+			batchPositions[type].push_back(transform * Ogre::Vector3( poseIterFrom->second.x(), poseIterFrom->second.y(), poseIterFrom->second.z() ));
+			batchPositions[type].push_back(transform * Ogre::Vector3( poseIterTo->second.x(), poseIterTo->second.y(), poseIterTo->second.z() ));
+		}
+	}
+
+	batches_.resize(kBatchCount);
+	for(int i=0; i<kBatchCount; ++i)
+	{
+		LinkBatch & batch = batches_[i];
+		if(batchLinks[i].empty())
 		{
-			std::map<int, rtabmap::Transform>::iterator poseIterFrom = poses.find(iter->second.from());
-			std::map<int, rtabmap::Transform>::iterator poseIterTo = poses.find(iter->second.to());
-			if(poseIterFrom != poses.end() && poseIterTo != poses.end())
+			if(batch.manual_object)
 			{
-				if(iter->second.type() == rtabmap::Link::kNeighbor)
-				{
-					color = color_neighbor_property_->getOgreColor();
-				}
-				else if(iter->second.type() == rtabmap::Link::kNeighborMerged)
-				{
-					color = color_neighbor_merged_property_->getOgreColor();
-				}
-				else if(iter->second.type() == rtabmap::Link::kVirtualClosure)
-				{
-					color = color_virtual_property_->getOgreColor();
-				}
-				else if(iter->second.type() == rtabmap::Link::kUserClosure)
-				{
-					color = color_user_property_->getOgreColor();
-				}
-				else if(iter->second.type() == rtabmap::Link::kLocalSpaceClosure || iter->second.type() == rtabmap::Link::kLocalTimeClosure)
-				{
-					color = color_local_property_->getOgreColor();
-				}
-				else if(iter->second.type() == rtabmap::Link::kLandmark)
-				{
-					color = color_landmark_property_->getOgreColor();
-				}
-				else
-				{
-					color = color_global_property_->getOgreColor();
-				}
-				color.a = alpha_property_->getFloat();
-				Ogre::Vector3 pos;
-				pos = transform * Ogre::Vector3( poseIterFrom->second.x(), poseIterFrom->second.y(), poseIterFrom->second.z() );
-				manual_object->position( pos.x, pos.y, pos.z );
-				manual_object->colour( color );
-				pos = transform * Ogre::Vector3( poseIterTo->second.x(), poseIterTo->second.y(), poseIterTo->second.z() );
-				manual_object->position( pos.x, pos.y, pos.z );
-				manual_object->colour( color );
+				batch.manual_object->clear();
+				scene_manager_->destroyManualObject( batch.manual_object );
 			}
+			batch = LinkBatch();
+			continue;
 		}
 
-		manual_object->end();
+		Ogre::ColourValue color;
+		switch(i)
+		{
+		case kBatchNeighbor:
+			color = color_neighbor_property_->getOgreColor();
+			break;
+		case kBatchNeighborMerged:
+			color = color_neighbor_merged_property_->getOgreColor();
+			break;
+		case kBatchVirtual:
+			color = color_virtual_property_->getOgreColor();
+			break;
+		case kBatchUser:
+			color = color_user_property_->getOgreColor();
+			break;
+		case kBatchLocal:
+			color = color_local_property_->getOgreColor();
+			break;
+		case kBatchLandmark:
+			color = color_landmark_property_->getOgreColor();
+			break;
+		default:
+			color = color_global_property_->getOgreColor();
+			break;
+		}
+		color.a = alpha_property_->getFloat();
+
+		if(batch.manual_object && batch.color == color && batch.links == batchLinks[i])
+		{
+			updateBatch(batch, batchPositions[i]);
+		}
+		else
+		{
+			rebuildBatch(batch, batchLinks[i], batchPositions[i], color);
+		}
 	}
 }
 
@@ -33,6 +33,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <rviz/message_filter_display.h>
 
+#include <OgreVector3.h>
+#include <OgreColourValue.h>
+
 namespace Ogre
 {
 class ManualObject;
@@ -71,9 +74,27 @@ protected:
   void processMessage( const rtabmap_ros::MapGraph::ConstPtr& msg );
 
 private:
+  /**
+   * Lines of all links of the same type, kept in a single vertex buffer
+   * reused across messages.
+   */
+  struct LinkBatch
+  {
+    LinkBatch() : manual_object(0) {}
+    Ogre::ManualObject* manual_object;
+    std::vector<std::pair<int, int> > links;
+    std::vector<Ogre::Vector3> positions; // two per link, as in the vertex buffer
+    Ogre::ColourValue color;
+  };
+
   void destroyObjects();
+  void rebuildBatch(LinkBatch & batch,
+                    std::vector<std::pair<int, int> > & links,
+                    std::vector<Ogre::Vector3> & positions,
+                    const Ogre::ColourValue & color);
+  void updateBatch(LinkBatch & batch, const std::vector<Ogre::Vector3> & positions);
 
-  std::vector<Ogre::ManualObject*> manual_objects_;
+  std::vector<LinkBatch> batches_;
 
   ColorProperty* color_neighbor_property_;
   ColorProperty* color_neighbor_merged_property_;
@@ -83,6 +104,7 @@ private:
   ColorProperty* color_user_property_;
   ColorProperty* color_virtual_property_;
   FloatProperty* alpha_property_;
+  FloatProperty* update_threshold_property_;
 };
 
 } // namespace rtabmap_ros
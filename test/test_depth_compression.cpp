@@ -0,0 +1,130 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+#include "rtabmap_ros/MsgConversion.h"
+#include <sensor_msgs/CompressedImage.h>
+#include <opencv2/core/core.hpp>
+#include <cstring>
+
+using namespace rtabmap_ros;
+
+// Depth with invalid pixels: random holes, a long run and an empty row
+static cv::Mat syntheticDepth(int width, int height)
+{
+	cv::Mat depth(height, width, CV_16UC1);
+	cv::randu(depth, cv::Scalar(500), cv::Scalar(5000));
+	cv::Mat holes(height, width, CV_8UC1);
+	cv::randu(holes, cv::Scalar(0), cv::Scalar(4));
+	depth.setTo(0, holes == 0);
+	depth(cv::Rect(0, 0, width, height/4)).setTo(0);
+	depth.row(height/2).setTo(0);
+	return depth;
+}
+
+static bool sameMat(const cv::Mat & a, const cv::Mat & b)
+{
+	return a.type() == b.type() && a.size() == b.size() && cv::norm(a, b, cv::NORM_INF) == 0.0;
+}
+
+static void setWord(std::vector<unsigned char> & bytes, int index, unsigned int value)
+{
+	memcpy(&bytes[index*sizeof(unsigned int)], &value, sizeof(unsigned int));
+}
+
+TEST(DepthCompression, rvlRoundTrip)
+{
+	cv::Mat depth = syntheticDepth(640, 480);
+	sensor_msgs::CompressedImage msg;
+	depthToCompressedMsg(depth, "rvl", msg);
+	EXPECT_EQ("rvl", msg.format);
+	EXPECT_LT(msg.data.size(), depth.total()*depth.elemSize());
+	EXPECT_TRUE(sameMat(depth, depthFromCompressedMsg(msg)));
+}
+
+TEST(DepthCompression, rvlZeros)
+{
+	cv::Mat depth = cv::Mat::zeros(480, 640, CV_16UC1);
+	EXPECT_TRUE(sameMat(depth, uncompressDepthRVL(compressDepthRVL(depth))));
+
+	depth.at<unsigned short>(479, 639) = 65535;
+	depth.at<unsigned short>(0, 0) = 1;
+	EXPECT_TRUE(sameMat(depth, uncompressDepthRVL(compressDepthRVL(depth))));
+
+	cv::Mat odd = syntheticDepth(1, 7);
+	EXPECT_TRUE(sameMat(odd, uncompressDepthRVL(compressDepthRVL(odd))));
+}
+
+TEST(DepthCompression, float32FallsBackToPng)
+{
+	cv::Mat depth;
+	syntheticDepth(320, 240).convertTo(depth, CV_32FC1, 0.001);
+	sensor_msgs::CompressedImage msg;
+	depthToCompressedMsg(depth, "rvl", msg);
+	EXPECT_EQ("png", msg.format);
+	EXPECT_TRUE(sameMat(depth, depthFromCompressedMsg(msg)));
+}
+
+TEST(DepthCompression, rvlRejectsInvalidHeader)
+{
+	std::vector<unsigned char> bytes = compressDepthRVL(syntheticDepth(64, 48));
+	ASSERT_FALSE(uncompressDepthRVL(bytes).empty());
+
+	std::vector<unsigned char> invalid = bytes;
+	invalid[0] = 'X';
+	EXPECT_TRUE(uncompressDepthRVL(invalid).empty()); // magic
+
+	invalid = bytes;
+	setWord(invalid, 1, 99);
+	EXPECT_TRUE(uncompressDepthRVL(invalid).empty()); // version
+
+	invalid = bytes;
+	setWord(invalid, 2, 0x04030201);
+	EXPECT_TRUE(uncompressDepthRVL(invalid).empty()); // byte order
+
+	invalid = bytes;
+	invalid.resize(12);
+	EXPECT_TRUE(uncompressDepthRVL(invalid).empty()); // truncated header
+
+	invalid = bytes;
+	invalid.resize(bytes.size()-2*sizeof(unsigned int));
+	EXPECT_TRUE(uncompressDepthRVL(invalid).empty()); // truncated data
+}
+
+TEST(DepthCompression, rvlRejectsOversizedImage)
+{
+	std::vector<unsigned char> bytes = compressDepthRVL(cv::Mat::zeros(48, 64, CV_16UC1));
+	setWord(bytes, 3, 60000);
+	setWord(bytes, 4, 60000);
+	EXPECT_TRUE(uncompressDepthRVL(bytes).empty());
+}
+
+int main(int argc, char **argv)
+{
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,78 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <gtest/gtest.h>
+#include "rtabmap_ros/DescriptorIndex.h"
+
+using namespace rtabmap_ros;
+
+TEST(DescriptorIndex, replaceOnlyEntry)
+{
+	DescriptorIndex index;
+	cv::Mat a = (cv::Mat_<float>(1,4) << 1, 0, 0, 0);
+	cv::Mat b = (cv::Mat_<float>(1,4) << 0, 1, 0, 0);
+	ASSERT_TRUE(index.add(1, a));
+	ASSERT_TRUE(index.add(1, b));
+	EXPECT_EQ(1u, index.size());
+	EXPECT_EQ(4, index.dimension());
+	EXPECT_EQ(0.0, cv::norm(index.descriptor(1), b));
+
+	std::vector<std::pair<int, float> > results = index.knnSearch(b, 1);
+	ASSERT_EQ(1u, results.size());
+	EXPECT_EQ(1, results[0].first);
+	EXPECT_FLOAT_EQ(0.0f, results[0].second);
+}
+
+TEST(DescriptorIndex, replaceTriggeringRebuild)
+{
+	DescriptorIndex index;
+	cv::Mat a = (cv::Mat_<float>(1,4) << 1, 0, 0, 0);
+	// enough replacements of the same node for deleted nodes to trigger rebuilds
+	for(int i=0; i<100; ++i)
+	{
+		a.at<float>(0,1) = float(i);
+		ASSERT_TRUE(index.add(1, a));
+		ASSERT_EQ(1u, index.size());
+		ASSERT_EQ(4, index.dimension());
+	}
+	EXPECT_EQ(0.0, cv::norm(index.descriptor(1), a));
+}
+
+TEST(DescriptorIndex, rejectDimensionMismatch)
+{
+	DescriptorIndex index;
+	ASSERT_TRUE(index.add(1, cv::Mat::ones(1, 4, CV_32FC1)));
+	EXPECT_FALSE(index.add(2, cv::Mat::ones(1, 3, CV_32FC1)));
+	EXPECT_EQ(1u, index.size());
+}
+
+int main(int argc, char **argv)
+{
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,182 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <gtest/gtest.h>
+#include "rtabmap_ros/MessageSynchronizer.h"
+#include <cmath>
+
+using namespace rtabmap_ros;
+
+static MessageSynchronizer::MessagePtr message(int value)
+{
+	return MessageSynchronizer::MessagePtr(new int(value));
+}
+
+static int value(const MessageSynchronizer::MessagePtr & msg)
+{
+	return *boost::static_pointer_cast<int const>(msg);
+}
+
+TEST(MessageSynchronizer, exactSync)
+{
+	MessageSynchronizer sync;
+	sync.init(2, 10, false);
+	sync.add(0, 1.0, message(1));
+	sync.add(0, 2.0, message(2));
+	sync.add(1, 2.0, message(12));
+	sync.add(0, 3.0, message(3));
+	sync.add(1, 3.0, message(13));
+
+	std::vector<MessageSynchronizer::MessagePtr> msgs;
+	std::vector<double> stamps;
+	ASSERT_TRUE(sync.pop(msgs, stamps));
+	EXPECT_EQ(2, value(msgs[0]));
+	EXPECT_EQ(12, value(msgs[1]));
+	ASSERT_TRUE(sync.pop(msgs, stamps));
+	EXPECT_EQ(3, value(msgs[0]));
+	EXPECT_EQ(13, value(msgs[1]));
+	EXPECT_FALSE(sync.pop(msgs, stamps));
+}
+
+TEST(MessageSynchronizer, approxWaitsForCloserMessage)
+{
+	MessageSynchronizer sync;
+	sync.init(2, 10, true);
+	std::vector<MessageSynchronizer::MessagePtr> msgs;
+	std::vector<double> stamps;
+
+	sync.add(0, 0.0, message(0));
+	sync.add(1, 0.09, message(10));
+	// the next message of topic 0 can be closer
+	EXPECT_FALSE(sync.pop(msgs, stamps));
+
+	sync.add(0, 0.1, message(1));
+	ASSERT_TRUE(sync.pop(msgs, stamps));
+	EXPECT_EQ(1, value(msgs[0]));
+	EXPECT_EQ(10, value(msgs[1]));
+	EXPECT_DOUBLE_EQ(0.1, stamps[0]);
+	EXPECT_DOUBLE_EQ(0.09, stamps[1]);
+	EXPECT_FALSE(sync.pop(msgs, stamps));
+}
+
+TEST(MessageSynchronizer, approxSameRate)
+{
+	MessageSynchronizer sync;
+	sync.init(3, 10, true);
+	std::vector<MessageSynchronizer::MessagePtr> msgs;
+	std::vector<double> stamps;
+	int sets = 0;
+	for(int i=0; i<20; ++i)
+	{
+		sync.add(0, i*0.1, message(i));
+		sync.add(1, i*0.1+0.01, message(i));
+		sync.add(2, i*0.1+0.03, message(i));
+		while(sync.pop(msgs, stamps))
+		{
+			ASSERT_EQ(3u, msgs.size());
+			EXPECT_EQ(value(msgs[0]), value(msgs[1]));
+			EXPECT_EQ(value(msgs[0]), value(msgs[2]));
+			EXPECT_NEAR(0.03, stamps[2]-stamps[0], 1e-6);
+			++sets;
+		}
+	}
+	EXPECT_GE(sets, 19);
+}
+
+TEST(MessageSynchronizer, approxMaxInterval)
+{
+	MessageSynchronizer sync;
+	sync.init(2, 10, true, 0.1);
+	std::vector<MessageSynchronizer::MessagePtr> msgs;
+	std::vector<double> stamps;
+
+	sync.add(0, 0.0, message(0));
+	sync.add(1, 1.0, message(10));
+	sync.add(0, 1.01, message(1));
+	EXPECT_FALSE(sync.pop(msgs, stamps));
+	sync.add(1, 1.02, message(11));
+	ASSERT_TRUE(sync.pop(msgs, stamps));
+	EXPECT_EQ(1, value(msgs[0]));
+	EXPECT_EQ(10, value(msgs[1]));
+	EXPECT_FALSE(sync.pop(msgs, stamps));
+}
+
+TEST(MessageSynchronizer, queueOverflow)
+{
+	MessageSynchronizer sync;
+	sync.init(2, 2, true);
+	std::vector<MessageSynchronizer::MessagePtr> msgs;
+	std::vector<double> stamps;
+
+	EXPECT_TRUE(sync.add(0, 0.0, message(0)));
+	EXPECT_TRUE(sync.add(0, 0.1, message(1)));
+	EXPECT_FALSE(sync.add(0, 0.2, message(2)));
+	EXPECT_FALSE(sync.add(0, 0.2, message(3))); // duplicated
+	sync.add(1, 0.19, message(12));
+	sync.add(1, 0.29, message(13));
+	ASSERT_TRUE(sync.pop(msgs, stamps));
+	EXPECT_EQ(2, value(msgs[0]));
+	EXPECT_EQ(12, value(msgs[1]));
+}
+
+TEST(MessageSynchronizer, readySetsRing)
+{
+	MessageSynchronizer sync;
+	sync.init(2, 2, false);
+	std::vector<MessageSynchronizer::MessagePtr> msgs;
+	std::vector<double> stamps;
+
+	// sets not taken, the oldest is dropped
+	for(int i=0; i<3; ++i)
+	{
+		sync.add(0, i, message(i));
+		sync.add(1, i, message(10+i));
+	}
+	ASSERT_TRUE(sync.pop(msgs, stamps));
+	EXPECT_EQ(1, value(msgs[0]));
+	ASSERT_TRUE(sync.pop(msgs, stamps));
+	EXPECT_EQ(2, value(msgs[0]));
+	EXPECT_FALSE(sync.pop(msgs, stamps));
+
+	// slots are reused
+	for(int i=3; i<10; ++i)
+	{
+		sync.add(0, i, message(i));
+		sync.add(1, i, message(10+i));
+		ASSERT_TRUE(sync.pop(msgs, stamps));
+		EXPECT_EQ(i, value(msgs[0]));
+		EXPECT_EQ(10+i, value(msgs[1]));
+		EXPECT_FALSE(sync.pop(msgs, stamps));
+	}
+}
+
+int main(int argc, char **argv)
+{
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}